@@ -0,0 +1,801 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <osd/capture.h>
+#include <osd/latency.h>
+#include <osd/osd.h>
+#include <osd/packet.h>
+#include "osd-private.h"
+
+#include <assert.h>
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/*
+ * File layout (all values little endian)
+ *
+ * File header (32 byte)
+ *   0  char[8]  magic: "OSDCAP\r\n"
+ *   8  uint16   format version
+ *  10  uint16   size of the file header in bytes
+ *  12  uint32   flags (reserved, 0)
+ *  16  uint64   creation time (ns since the Unix epoch)
+ *  24  uint32   reserved, 0
+ *  28  uint32   CRC-32 of bytes 0 to 27
+ *
+ * Block header (16 byte), followed by the block payload
+ *   0  uint32   magic: "OSDB" (packet block) or "OSDL" (latency block)
+ *   4  uint32   size of the payload in bytes
+ *   8  uint32   number of records in the payload
+ *  12  uint32   CRC-32 of the payload
+ *
+ * Record (10 + 2 * data_size_words byte)
+ *   0  uint64   host receive timestamp (ns since the Unix epoch)
+ *   8  uint16   data_size_words
+ *  10  uint16[] packet data (data_raw)
+ *
+ * Bytes 8 and onwards of a record are identical to the in-memory
+ * representation of struct osd_packet on little endian hosts. All sizes are
+ * a multiple of two bytes to keep the packets 16 bit aligned.
+ *
+ * Latency block payload (version 2 and later)
+ *   0  uint32   number of hops (= number of records)
+ *   4  uint32   number of histogram buckets per hop
+ *   8  per hop: uint64 count, sum_ns, min_ns, max_ns, uint64[] buckets
+ */
+
+static const char file_magic[8] = { 'O', 'S', 'D', 'C', 'A', 'P', '\r', '\n' };
+static const char block_magic[4] = { 'O', 'S', 'D', 'B' };
+static const char latency_block_magic[4] = { 'O', 'S', 'D', 'L' };
+
+#define FILE_HEADER_SIZE 32
+#define BLOCK_HEADER_SIZE 16
+#define RECORD_HEADER_SIZE 8
+#define LATENCY_HEADER_SIZE 8
+#define LATENCY_HIST_HEADER_SIZE 32
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define CAPTURE_ZERO_COPY 1
+#endif
+
+static void put_le16(uint8_t *p, uint16_t v)
+{
+    v = htole16(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    v = htole32(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static void put_le64(uint8_t *p, uint64_t v)
+{
+    v = htole64(v);
+    memcpy(p, &v, sizeof(v));
+}
+
+static uint16_t get_le16(const uint8_t *p)
+{
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return le16toh(v);
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return le32toh(v);
+}
+
+static uint64_t get_le64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return le64toh(v);
+}
+
+/**
+ * Capture writer context
+ */
+struct osd_capture_writer_ctx {
+    struct osd_log_ctx *log_ctx;
+    FILE *fp;
+
+    /** block currently being assembled (including the block header) */
+    uint8_t *block;
+    /** allocated size of |block| */
+    size_t block_alloc;
+    /** write out the block once it would exceed this size */
+    size_t block_size;
+    /** used bytes in |block| */
+    size_t block_len;
+    /** number of records in |block| */
+    uint32_t block_records;
+};
+
+/**
+ * Capture reader context
+ */
+struct osd_capture_reader_ctx {
+    struct osd_log_ctx *log_ctx;
+
+    /** mapped capture file */
+    const uint8_t *data;
+    /** size of |data| in bytes */
+    size_t data_len;
+
+    uint64_t create_time_ns;
+    size_t first_block_offset;
+
+    /** offset of the header of the current block in |data| */
+    size_t block_offset;
+    /** offset of the next block header in |data| */
+    size_t next_block_offset;
+    /** offset of the next record in |data| */
+    size_t record_offset;
+    /** end of the payload of the current block */
+    size_t block_end;
+
+#ifndef CAPTURE_ZERO_COPY
+    /** packet in host byte order (no zero-copy possible) */
+    struct osd_packet *pkg_buf;
+#endif
+};
+
+API_EXPORT
+uint64_t osd_capture_timestamp_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+API_EXPORT
+osd_result osd_capture_writer_new(struct osd_capture_writer_ctx **ctx,
+                                  struct osd_log_ctx *log_ctx, FILE *fp,
+                                  size_t block_size)
+{
+    assert(fp);
+
+    if (block_size == 0) {
+        block_size = OSD_CAPTURE_BLOCK_SIZE_DEFAULT;
+    }
+
+    struct osd_capture_writer_ctx *c =
+        calloc(1, sizeof(struct osd_capture_writer_ctx));
+    assert(c);
+
+    c->log_ctx = log_ctx;
+    c->fp = fp;
+    c->block_size = block_size;
+    c->block_alloc = block_size;
+    c->block = malloc(c->block_alloc);
+    assert(c->block);
+    c->block_len = BLOCK_HEADER_SIZE;
+    c->block_records = 0;
+
+    uint8_t hdr[FILE_HEADER_SIZE] = { 0 };
+    memcpy(hdr, file_magic, sizeof(file_magic));
+    put_le16(hdr + 8, OSD_CAPTURE_VERSION);
+    put_le16(hdr + 10, FILE_HEADER_SIZE);
+    put_le32(hdr + 12, 0);
+    put_le64(hdr + 16, osd_capture_timestamp_now());
+    put_le32(hdr + 24, 0);
+    put_le32(hdr + 28, osd_crc32(0, hdr, 28));
+
+    if (fwrite(hdr, sizeof(hdr), 1, fp) != 1) {
+        err(log_ctx, "Unable to write capture file header: %s",
+            strerror(errno));
+        free(c->block);
+        free(c);
+        return OSD_ERROR_FILE;
+    }
+
+    *ctx = c;
+
+    return OSD_OK;
+}
+
+API_EXPORT
+osd_result osd_capture_writer_flush(struct osd_capture_writer_ctx *ctx)
+{
+    assert(ctx);
+
+    if (ctx->block_records == 0) {
+        return OSD_OK;
+    }
+
+    size_t payload_len = ctx->block_len - BLOCK_HEADER_SIZE;
+    memcpy(ctx->block, block_magic, sizeof(block_magic));
+    put_le32(ctx->block + 4, payload_len);
+    put_le32(ctx->block + 8, ctx->block_records);
+    put_le32(ctx->block + 12,
+             osd_crc32(0, ctx->block + BLOCK_HEADER_SIZE, payload_len));
+
+    size_t len = ctx->block_len;
+    ctx->block_len = BLOCK_HEADER_SIZE;
+    ctx->block_records = 0;
+
+    if (fwrite(ctx->block, len, 1, ctx->fp) != 1) {
+        err(ctx->log_ctx, "Unable to write %zu bytes to capture file: %s", len,
+            strerror(errno));
+        return OSD_ERROR_FILE;
+    }
+    if (fflush(ctx->fp) != 0) {
+        err(ctx->log_ctx, "Unable to flush capture file: %s", strerror(errno));
+        return OSD_ERROR_FILE;
+    }
+
+    return OSD_OK;
+}
+
+API_EXPORT
+osd_result osd_capture_writer_write(struct osd_capture_writer_ctx *ctx,
+                                    const struct osd_packet *pkg,
+                                    uint64_t rx_timestamp_ns)
+{
+    osd_result rv;
+
+    assert(ctx);
+    assert(pkg);
+
+    size_t record_len = RECORD_HEADER_SIZE + sizeof(uint16_t) +
+                        osd_packet_sizeof(pkg);
+    if (ctx->block_len + record_len > ctx->block_size) {
+        rv = osd_capture_writer_flush(ctx);
+        if (OSD_FAILED(rv)) {
+            return rv;
+        }
+    }
+    // a packet larger than a block gets a block on its own
+    if (ctx->block_len + record_len > ctx->block_alloc) {
+        ctx->block_alloc = ctx->block_len + record_len;
+        ctx->block = realloc(ctx->block, ctx->block_alloc);
+        assert(ctx->block);
+    }
+
+    uint8_t *p = ctx->block + ctx->block_len;
+    put_le64(p, rx_timestamp_ns);
+    put_le16(p + RECORD_HEADER_SIZE, pkg->data_size_words);
+#ifdef CAPTURE_ZERO_COPY
+    memcpy(p + RECORD_HEADER_SIZE + sizeof(uint16_t), pkg->data_raw,
+           osd_packet_sizeof(pkg));
+#else
+    for (size_t i = 0; i < pkg->data_size_words; i++) {
+        put_le16(p + RECORD_HEADER_SIZE + sizeof(uint16_t) * (i + 1),
+                 pkg->data_raw[i]);
+    }
+#endif
+    ctx->block_len += record_len;
+    ctx->block_records++;
+
+    return OSD_OK;
+}
+
+API_EXPORT
+osd_result osd_capture_writer_write_latency(
+    struct osd_capture_writer_ctx *ctx, const struct osd_latency_stats *stats)
+{
+    osd_result rv;
+
+    assert(ctx);
+    assert(stats);
+
+    // keep the order of packets and statistics in the file
+    rv = osd_capture_writer_flush(ctx);
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
+
+    size_t hist_len = LATENCY_HIST_HEADER_SIZE +
+                      OSD_LATENCY_HIST_BUCKETS * sizeof(uint64_t);
+    size_t payload_len = LATENCY_HEADER_SIZE + OSD_LATENCY_HOP_NUM * hist_len;
+    size_t len = BLOCK_HEADER_SIZE + payload_len;
+    uint8_t *block = malloc(len);
+    assert(block);
+
+    uint8_t *p = block + BLOCK_HEADER_SIZE;
+    put_le32(p, OSD_LATENCY_HOP_NUM);
+    put_le32(p + 4, OSD_LATENCY_HIST_BUCKETS);
+    p += LATENCY_HEADER_SIZE;
+    for (unsigned int hop = 0; hop < OSD_LATENCY_HOP_NUM; hop++) {
+        const struct osd_latency_hist *hist = &stats->hop[hop];
+        put_le64(p, hist->count);
+        put_le64(p + 8, hist->sum_ns);
+        put_le64(p + 16, hist->min_ns);
+        put_le64(p + 24, hist->max_ns);
+        p += LATENCY_HIST_HEADER_SIZE;
+        for (unsigned int i = 0; i < OSD_LATENCY_HIST_BUCKETS; i++) {
+            put_le64(p, hist->buckets[i]);
+            p += sizeof(uint64_t);
+        }
+    }
+
+    memcpy(block, latency_block_magic, sizeof(latency_block_magic));
+    put_le32(block + 4, payload_len);
+    put_le32(block + 8, OSD_LATENCY_HOP_NUM);
+    put_le32(block + 12, osd_crc32(0, block + BLOCK_HEADER_SIZE, payload_len));
+
+    rv = OSD_OK;
+    if (fwrite(block, len, 1, ctx->fp) != 1 || fflush(ctx->fp) != 0) {
+        err(ctx->log_ctx, "Unable to write latency statistics to capture "
+            "file: %s", strerror(errno));
+        rv = OSD_ERROR_FILE;
+    }
+    free(block);
+
+    return rv;
+}
+
+API_EXPORT
+void osd_capture_writer_free(struct osd_capture_writer_ctx **ctx_p)
+{
+    assert(ctx_p);
+    struct osd_capture_writer_ctx *ctx = *ctx_p;
+    if (!ctx) {
+        return;
+    }
+
+    osd_capture_writer_flush(ctx);
+
+    free(ctx->block);
+    free(ctx);
+    *ctx_p = NULL;
+}
+
+API_EXPORT
+bool osd_capture_is_capture_file(const char *filename)
+{
+    assert(filename);
+
+    FILE *fp = fopen(filename, "rb");
+    if (!fp) {
+        return false;
+    }
+
+    char magic[sizeof(file_magic)];
+    bool is_capture = (fread(magic, sizeof(magic), 1, fp) == 1 &&
+                       memcmp(magic, file_magic, sizeof(file_magic)) == 0);
+    fclose(fp);
+
+    return is_capture;
+}
+
+API_EXPORT
+osd_result osd_capture_reader_new(struct osd_capture_reader_ctx **ctx,
+                                  struct osd_log_ctx *log_ctx,
+                                  const char *filename)
+{
+    osd_result retval;
+
+    assert(filename);
+
+    struct osd_capture_reader_ctx *c =
+        calloc(1, sizeof(struct osd_capture_reader_ctx));
+    assert(c);
+    c->log_ctx = log_ctx;
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        err(log_ctx, "Unable to open file %s: %s (%d)", filename,
+            strerror(errno), errno);
+        retval = OSD_ERROR_FILE;
+        goto err_free_ctx;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        err(log_ctx, "Unable to stat file %s: %s (%d)", filename,
+            strerror(errno), errno);
+        retval = OSD_ERROR_FILE;
+        goto err_close_file;
+    }
+    c->data_len = st.st_size;
+
+    if (c->data_len < FILE_HEADER_SIZE) {
+        err(log_ctx, "%s is not a capture file (too small).", filename);
+        retval = OSD_ERROR_FILE;
+        goto err_close_file;
+    }
+
+    void *data = mmap(NULL, c->data_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+        err(log_ctx, "Unable to map file %s: %s (%d)", filename,
+            strerror(errno), errno);
+        retval = OSD_ERROR_FILE;
+        goto err_close_file;
+    }
+    madvise(data, c->data_len, MADV_SEQUENTIAL);
+    c->data = data;
+
+    // the mapping stays valid after closing the file descriptor
+    close(fd);
+
+    const uint8_t *hdr = c->data;
+    if (memcmp(hdr, file_magic, sizeof(file_magic)) != 0) {
+        err(log_ctx, "%s is not a capture file (wrong magic).", filename);
+        retval = OSD_ERROR_FILE;
+        goto err_unmap;
+    }
+    if (get_le32(hdr + 28) != osd_crc32(0, hdr, 28)) {
+        err(log_ctx, "Header of capture file %s is corrupt.", filename);
+        retval = OSD_ERROR_FILE;
+        goto err_unmap;
+    }
+    uint16_t version = get_le16(hdr + 8);
+    if (version > OSD_CAPTURE_VERSION) {
+        err(log_ctx, "Capture file %s has version %u, only versions up to %u "
+            "are supported.", filename, version, OSD_CAPTURE_VERSION);
+        retval = OSD_ERROR_FILE;
+        goto err_unmap;
+    }
+    uint16_t header_size = get_le16(hdr + 10);
+    if (header_size < FILE_HEADER_SIZE || header_size > c->data_len) {
+        err(log_ctx, "Capture file %s has an invalid header size.", filename);
+        retval = OSD_ERROR_FILE;
+        goto err_unmap;
+    }
+    c->create_time_ns = get_le64(hdr + 16);
+    c->first_block_offset = header_size;
+
+    osd_capture_reader_rewind(c);
+
+    *ctx = c;
+    return OSD_OK;
+
+err_unmap:
+    munmap((void *)c->data, c->data_len);
+    free(c);
+    return retval;
+err_close_file:
+    close(fd);
+err_free_ctx:
+    free(c);
+    return retval;
+}
+
+API_EXPORT
+void osd_capture_reader_free(struct osd_capture_reader_ctx **ctx_p)
+{
+    assert(ctx_p);
+    struct osd_capture_reader_ctx *ctx = *ctx_p;
+    if (!ctx) {
+        return;
+    }
+
+    munmap((void *)ctx->data, ctx->data_len);
+#ifndef CAPTURE_ZERO_COPY
+    osd_packet_free(&ctx->pkg_buf);
+#endif
+
+    free(ctx);
+    *ctx_p = NULL;
+}
+
+API_EXPORT
+osd_result osd_capture_reader_rewind(struct osd_capture_reader_ctx *ctx)
+{
+    assert(ctx);
+
+    ctx->block_offset = ctx->first_block_offset;
+    ctx->next_block_offset = ctx->first_block_offset;
+    ctx->record_offset = ctx->first_block_offset;
+    ctx->block_end = ctx->first_block_offset;
+
+    return OSD_OK;
+}
+
+API_EXPORT
+uint64_t osd_capture_reader_get_create_time(
+    const struct osd_capture_reader_ctx *ctx)
+{
+    assert(ctx);
+    return ctx->create_time_ns;
+}
+
+/**
+ * Validate the block at a given offset
+ *
+ * @param offset offset of the block header in the file
+ * @param[out] is_latency_block the block contains latency statistics
+ * @param[out] payload_len size of the block payload
+ * @return OSD_OK if a block was found
+ *         OSD_ERROR_ABORTED if the end of the file was reached
+ *         OSD_ERROR_CORRUPT if the block is corrupt or truncated
+ */
+static osd_result reader_check_block(const struct osd_capture_reader_ctx *ctx,
+                                     size_t offset, bool *is_latency_block,
+                                     size_t *payload_len)
+{
+    if (offset == ctx->data_len) {
+        return OSD_ERROR_ABORTED;
+    }
+    if (offset + BLOCK_HEADER_SIZE > ctx->data_len) {
+        err(ctx->log_ctx, "Capture file truncated at offset %zu.", offset);
+        return OSD_ERROR_CORRUPT;
+    }
+
+    const uint8_t *hdr = ctx->data + offset;
+    if (memcmp(hdr, block_magic, sizeof(block_magic)) == 0) {
+        *is_latency_block = false;
+    } else if (memcmp(hdr, latency_block_magic,
+                      sizeof(latency_block_magic)) == 0) {
+        *is_latency_block = true;
+    } else {
+        err(ctx->log_ctx, "No block found at offset %zu of the capture file.",
+            offset);
+        return OSD_ERROR_CORRUPT;
+    }
+    *payload_len = get_le32(hdr + 4);
+    size_t payload_offset = offset + BLOCK_HEADER_SIZE;
+    if (*payload_len > ctx->data_len - payload_offset) {
+        err(ctx->log_ctx, "Capture file truncated in block at offset %zu.",
+            offset);
+        return OSD_ERROR_CORRUPT;
+    }
+    uint32_t crc = osd_crc32(0, ctx->data + payload_offset, *payload_len);
+    if (crc != get_le32(hdr + 12)) {
+        err(ctx->log_ctx, "Checksum mismatch in block at offset %zu of the "
+            "capture file.", offset);
+        return OSD_ERROR_CORRUPT;
+    }
+
+    return OSD_OK;
+}
+
+/**
+ * Validate the next packet block and make it the current block
+ *
+ * Latency blocks in between are skipped.
+ *
+ * @return OSD_OK if a block was found
+ *         OSD_ERROR_ABORTED if the end of the file was reached
+ *         OSD_ERROR_CORRUPT if the block is corrupt or truncated
+ */
+static osd_result reader_enter_next_block(struct osd_capture_reader_ctx *ctx)
+{
+    osd_result rv;
+    size_t offset = ctx->next_block_offset;
+    bool is_latency_block;
+    size_t payload_len;
+
+    while (1) {
+        rv = reader_check_block(ctx, offset, &is_latency_block, &payload_len);
+        if (OSD_FAILED(rv)) {
+            return rv;
+        }
+        if (!is_latency_block) {
+            break;
+        }
+        offset += BLOCK_HEADER_SIZE + payload_len;
+        ctx->next_block_offset = offset;
+    }
+
+    size_t payload_offset = offset + BLOCK_HEADER_SIZE;
+    ctx->block_offset = offset;
+    ctx->record_offset = payload_offset;
+    ctx->block_end = payload_offset + payload_len;
+    ctx->next_block_offset = ctx->block_end;
+
+    return OSD_OK;
+}
+
+API_EXPORT
+osd_result osd_capture_reader_tell(const struct osd_capture_reader_ctx *ctx,
+                                   struct osd_capture_pos *pos)
+{
+    assert(ctx);
+    assert(pos);
+
+    if (ctx->record_offset == ctx->block_end) {
+        // the next packet is the first one in the next block
+        pos->block_offset = ctx->next_block_offset;
+        pos->record_offset = ctx->next_block_offset + BLOCK_HEADER_SIZE;
+    } else {
+        pos->block_offset = ctx->block_offset;
+        pos->record_offset = ctx->record_offset;
+    }
+
+    return OSD_OK;
+}
+
+API_EXPORT
+osd_result osd_capture_reader_seek(struct osd_capture_reader_ctx *ctx,
+                                   const struct osd_capture_pos *pos)
+{
+    osd_result rv;
+
+    assert(ctx);
+    assert(pos);
+
+    if (pos->block_offset < ctx->first_block_offset ||
+        pos->block_offset > ctx->data_len) {
+        return OSD_ERROR_CORRUPT;
+    }
+
+    ctx->next_block_offset = pos->block_offset;
+    rv = reader_enter_next_block(ctx);
+    if (rv == OSD_ERROR_ABORTED) {
+        // position at the end of the capture
+        ctx->record_offset = ctx->block_end = ctx->next_block_offset;
+        return OSD_OK;
+    }
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
+
+    // a position at the start of a latency block continues with the first
+    // packet of the following block
+    if (pos->record_offset == pos->block_offset + BLOCK_HEADER_SIZE &&
+        pos->block_offset != ctx->block_offset) {
+        return OSD_OK;
+    }
+    if (pos->record_offset < ctx->record_offset ||
+        pos->record_offset > ctx->block_end) {
+        return OSD_ERROR_CORRUPT;
+    }
+    ctx->record_offset = pos->record_offset;
+
+    return OSD_OK;
+}
+
+API_EXPORT
+osd_result osd_capture_reader_next(struct osd_capture_reader_ctx *ctx,
+                                   const struct osd_packet **pkg,
+                                   uint64_t *rx_timestamp_ns)
+{
+    osd_result rv;
+
+    assert(ctx);
+    assert(pkg);
+
+    *pkg = NULL;
+
+    while (ctx->record_offset == ctx->block_end) {
+        rv = reader_enter_next_block(ctx);
+        if (rv == OSD_ERROR_ABORTED) {
+            // end of capture
+            return OSD_OK;
+        }
+        if (OSD_FAILED(rv)) {
+            return rv;
+        }
+    }
+
+    const uint8_t *rec = ctx->data + ctx->record_offset;
+    size_t rec_avail = ctx->block_end - ctx->record_offset;
+    size_t rec_len = RECORD_HEADER_SIZE + sizeof(uint16_t);
+    if (rec_len <= rec_avail) {
+        rec_len += get_le16(rec + RECORD_HEADER_SIZE) * sizeof(uint16_t);
+    }
+    if (rec_len > rec_avail) {
+        err(ctx->log_ctx, "Invalid record at offset %zu of the capture file.",
+            ctx->record_offset);
+        return OSD_ERROR_CORRUPT;
+    }
+
+    if (rx_timestamp_ns) {
+        *rx_timestamp_ns = get_le64(rec);
+    }
+
+#ifdef CAPTURE_ZERO_COPY
+    *pkg = (const struct osd_packet *)(rec + RECORD_HEADER_SIZE);
+#else
+    uint16_t data_size_words = get_le16(rec + RECORD_HEADER_SIZE);
+    osd_packet_free(&ctx->pkg_buf);
+    rv = osd_packet_new(&ctx->pkg_buf, data_size_words);
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
+    for (size_t i = 0; i < data_size_words; i++) {
+        ctx->pkg_buf->data_raw[i] =
+            get_le16(rec + RECORD_HEADER_SIZE + sizeof(uint16_t) * (i + 1));
+    }
+    *pkg = ctx->pkg_buf;
+#endif
+
+    ctx->record_offset += rec_len;
+
+    return OSD_OK;
+}
+
+/**
+ * Read the latency statistics from a latency block payload
+ */
+static osd_result read_latency_block(const struct osd_capture_reader_ctx *ctx,
+                                     const uint8_t *payload, size_t payload_len,
+                                     struct osd_latency_stats *stats)
+{
+    if (payload_len < LATENCY_HEADER_SIZE) {
+        return OSD_ERROR_CORRUPT;
+    }
+    size_t num_hops = get_le32(payload);
+    size_t num_buckets = get_le32(payload + 4);
+    size_t hist_len = LATENCY_HIST_HEADER_SIZE + num_buckets * sizeof(uint64_t);
+    if (num_buckets > (payload_len - LATENCY_HEADER_SIZE) / sizeof(uint64_t) ||
+        num_hops > (payload_len - LATENCY_HEADER_SIZE) / hist_len) {
+        err(ctx->log_ctx, "Invalid latency block in capture file.");
+        return OSD_ERROR_CORRUPT;
+    }
+
+    osd_latency_stats_reset(stats);
+
+    const uint8_t *p = payload + LATENCY_HEADER_SIZE;
+    for (size_t hop = 0; hop < num_hops && hop < OSD_LATENCY_HOP_NUM; hop++) {
+        struct osd_latency_hist *hist = &stats->hop[hop];
+        hist->count = get_le64(p);
+        hist->sum_ns = get_le64(p + 8);
+        hist->min_ns = get_le64(p + 16);
+        hist->max_ns = get_le64(p + 24);
+        for (size_t i = 0; i < num_buckets; i++) {
+            // files with more buckets: fold the rest into the last bucket
+            size_t bucket = i < OSD_LATENCY_HIST_BUCKETS
+                                ? i
+                                : OSD_LATENCY_HIST_BUCKETS - 1;
+            hist->buckets[bucket] +=
+                get_le64(p + LATENCY_HIST_HEADER_SIZE + i * sizeof(uint64_t));
+        }
+        p += hist_len;
+    }
+
+    return OSD_OK;
+}
+
+API_EXPORT
+osd_result osd_capture_reader_get_latency(
+    const struct osd_capture_reader_ctx *ctx, struct osd_latency_stats *stats)
+{
+    osd_result rv;
+
+    assert(ctx);
+    assert(stats);
+
+    bool found = false;
+    size_t offset = ctx->first_block_offset;
+    while (1) {
+        bool is_latency_block;
+        size_t payload_len;
+        rv = reader_check_block(ctx, offset, &is_latency_block, &payload_len);
+        if (rv == OSD_ERROR_ABORTED) {
+            break;
+        }
+        if (OSD_FAILED(rv)) {
+            return rv;
+        }
+        if (is_latency_block) {
+            rv = read_latency_block(ctx, ctx->data + offset + BLOCK_HEADER_SIZE,
+                                    payload_len, stats);
+            if (OSD_FAILED(rv)) {
+                return rv;
+            }
+            found = true;
+        }
+        offset += BLOCK_HEADER_SIZE + payload_len;
+    }
+
+    if (!found) {
+        return OSD_ERROR_FAILURE;
+    }
+    return OSD_OK;
+}
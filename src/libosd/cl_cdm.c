@@ -16,25 +16,32 @@
 #include <osd/cl_cdm.h>
 
 #include <assert.h>
+#include <string.h>
 #include <osd/osd.h>
 #include <osd/packet.h>
 #include <osd/reg.h>
 #include "osd-private.h"
 
-static struct osd_cdm_event *build_cdm_event(
-    const struct osd_cdm_desc *cdm_desc, const struct osd_packet *pkg)
+API_EXPORT
+osd_result osd_cl_cdm_decode_event(const struct osd_cdm_desc *cdm_desc,
+                                   const struct osd_packet *pkg,
+                                   struct osd_cdm_event *ev)
 {
-    struct osd_cdm_event *ev = calloc(1, sizeof(struct osd_cdm_event));
+    assert(cdm_desc);
+    assert(pkg);
+    assert(ev);
+
+    memset(ev, 0, sizeof(struct osd_cdm_event));
 
     size_t exp_payload_len = 1;  // stall
-    assert(osd_packet_sizeconv_payload2data(exp_payload_len) ==
-               pkg->data_size_words &&
-           "CDM Protocol violation detected.");
+    if (osd_packet_sizeconv_payload2data(exp_payload_len) !=
+        pkg->data_size_words) {
+        return OSD_ERROR_DEVICE_INVALID_DATA;
+    }
 
-    bool stall = pkg->data.payload[0];
+    ev->stall = pkg->data.payload[0];
 
-    ev->stall = stall;
-    return ev;
+    return OSD_OK;
 }
 
 API_EXPORT
@@ -47,11 +54,12 @@ osd_result osd_cl_cdm_handle_event(void *arg, struct osd_packet *pkg)
 
     struct osd_cdm_event_handler *handler = arg;
 
-    struct osd_cdm_event *ev = build_cdm_event(handler->cdm_desc, pkg);
+    struct osd_cdm_event ev;
+    osd_result rv = osd_cl_cdm_decode_event(handler->cdm_desc, pkg, &ev);
+    assert(OSD_SUCCEEDED(rv) && "CDM Protocol violation detected.");
     osd_packet_free(&pkg);
 
-    handler->cb_fn(handler->cb_arg, handler->cdm_desc, ev);
-    free(ev);
+    handler->cb_fn(handler->cb_arg, handler->cdm_desc, &ev);
 
     return OSD_OK;
 }
@@ -177,3 +185,220 @@ osd_result cl_cdm_cpureg_write(struct osd_hostmod_ctx *hostmod_ctx,
 
     return OSD_OK;
 }
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t va = *(const uint64_t *)a;
+    uint64_t vb = *(const uint64_t *)b;
+    return (va > vb) - (va < vb);
+}
+
+/**
+ * Read or write many SPRs of the CPUs attached to one or more CDMs
+ *
+ * The registers of each CDM are grouped by the value required in the
+ * CORE_REG_UPPER register, starting with the currently selected value, to
+ * keep the number of CORE_REG_UPPER writes low. The accesses are performed
+ * in rounds: first the CORE_REG_UPPER writes of all CDMs which need a new
+ * register bank, then all accesses within the selected banks, with the
+ * accesses to the individual CDMs interleaved so that all CDMs work
+ * concurrently. A CDM whose CORE_REG_UPPER write failed is not accessed any
+ * more, as the following accesses would end up in the wrong bank.
+ */
+static osd_result cpureg_bulk(struct osd_hostmod_ctx *hostmod_ctx,
+                              struct osd_cdm_desc *cdm_descs, size_t num_cdms,
+                              const uint16_t *reg_addrs, size_t num_regs,
+                              void *reg_vals, bool write, int flags)
+{
+    assert(hostmod_ctx);
+    assert(cdm_descs);
+    assert(reg_addrs);
+    assert(reg_vals);
+
+    if (num_cdms == 0 || num_regs == 0) {
+        return OSD_OK;
+    }
+
+    osd_result rv;
+
+    // worst case per CDM: a CORE_REG_UPPER write before every access
+    size_t max_cdm_accesses = 2 * num_regs;
+    struct osd_hostmod_reg_access *cdm_accesses =
+        calloc(num_cdms * max_cdm_accesses,
+               sizeof(struct osd_hostmod_reg_access));
+    assert(cdm_accesses);
+    size_t *num_cdm_accesses = calloc(num_cdms, sizeof(size_t));
+    assert(num_cdm_accesses);
+    uint16_t *upper_vals = calloc(num_cdms * num_regs, sizeof(uint16_t));
+    assert(upper_vals);
+    uint64_t *order = calloc(num_regs, sizeof(uint64_t));
+    assert(order);
+
+    uint8_t *val = reg_vals;
+    for (size_t c = 0; c < num_cdms; c++) {
+        struct osd_cdm_desc *cdm_desc = &cdm_descs[c];
+        uint16_t core_dw = cdm_desc->core_data_width;
+        assert(core_dw != 128 &&
+               "128 bit wide register accesses are currently not supported.");
+
+        // sort key: other upper value than the current one, upper value,
+        // position in reg_addrs
+        for (size_t i = 0; i < num_regs; i++) {
+            uint16_t upper = reg_addrs[i] >> 15;
+            order[i] = ((uint64_t)(upper != cdm_desc->core_reg_upper) << 48) |
+                       ((uint64_t)upper << 32) | i;
+        }
+        qsort(order, num_regs, sizeof(uint64_t), cmp_u64);
+
+        struct osd_hostmod_reg_access *acc =
+            &cdm_accesses[c * max_cdm_accesses];
+        size_t n = 0;
+        uint16_t core_upper = cdm_desc->core_reg_upper;
+        for (size_t k = 0; k < num_regs; k++) {
+            size_t i = order[k] & 0xffffffff;
+            uint16_t reg_addr_upper = reg_addrs[i] >> 15;
+
+            if (reg_addr_upper != core_upper) {
+                upper_vals[c * num_regs + k] = reg_addr_upper;
+                acc[n].diaddr = cdm_desc->di_addr;
+                acc[n].reg_addr = OSD_REG_CDM_CORE_REG_UPPER;
+                acc[n].reg_size_bit = 16;
+                acc[n].write = true;
+                acc[n].reg_val = &upper_vals[c * num_regs + k];
+                n++;
+                core_upper = reg_addr_upper;
+            }
+
+            acc[n].diaddr = cdm_desc->di_addr;
+            acc[n].reg_addr = 0x8000 + (reg_addrs[i] & 0x7fff);
+            acc[n].reg_size_bit = core_dw;
+            acc[n].write = write;
+            acc[n].reg_val = val + i * (core_dw / 8);
+            n++;
+        }
+        num_cdm_accesses[c] = n;
+        val += num_regs * (core_dw / 8);
+    }
+
+    struct osd_hostmod_reg_access *batch =
+        calloc(num_cdms * max_cdm_accesses,
+               sizeof(struct osd_hostmod_reg_access));
+    assert(batch);
+    size_t *batch_idx = calloc(num_cdms * max_cdm_accesses, sizeof(size_t));
+    assert(batch_idx);
+    size_t *pos = calloc(num_cdms, sizeof(size_t));
+    assert(pos);
+    bool *upper_failed = calloc(num_cdms, sizeof(bool));
+    assert(upper_failed);
+
+    osd_result retval = OSD_OK;
+    bool done = false;
+    while (!done) {
+        // select the register bank of all CDMs which need a new one
+        size_t num_batch = 0;
+        for (size_t c = 0; c < num_cdms; c++) {
+            size_t k = c * max_cdm_accesses + pos[c];
+            if (!upper_failed[c] && pos[c] < num_cdm_accesses[c] &&
+                cdm_accesses[k].reg_addr == OSD_REG_CDM_CORE_REG_UPPER) {
+                batch[num_batch] = cdm_accesses[k];
+                batch_idx[num_batch] = k;
+                num_batch++;
+            }
+        }
+        if (num_batch) {
+            rv = osd_hostmod_reg_access_batch(hostmod_ctx, batch, num_batch,
+                                              flags);
+            if (OSD_FAILED(rv) && OSD_SUCCEEDED(retval)) {
+                retval = rv;
+            }
+        }
+        for (size_t i = 0; i < num_batch; i++) {
+            size_t c = batch_idx[i] / max_cdm_accesses;
+            cdm_accesses[batch_idx[i]].result = batch[i].result;
+            pos[c]++;
+            if (OSD_FAILED(batch[i].result)) {
+                upper_failed[c] = true;
+                continue;
+            }
+            cdm_descs[c].core_reg_upper = *(uint16_t *)batch[i].reg_val;
+        }
+
+        // access all registers in the selected banks, interleaved
+        num_batch = 0;
+        bool cdm_added;
+        do {
+            cdm_added = false;
+            for (size_t c = 0; c < num_cdms; c++) {
+                size_t k = c * max_cdm_accesses + pos[c];
+                if (upper_failed[c] || pos[c] >= num_cdm_accesses[c] ||
+                    cdm_accesses[k].reg_addr == OSD_REG_CDM_CORE_REG_UPPER) {
+                    continue;
+                }
+                batch[num_batch] = cdm_accesses[k];
+                batch_idx[num_batch] = k;
+                num_batch++;
+                pos[c]++;
+                cdm_added = true;
+            }
+        } while (cdm_added);
+        if (num_batch) {
+            rv = osd_hostmod_reg_access_batch(hostmod_ctx, batch, num_batch,
+                                              flags);
+            if (OSD_FAILED(rv) && OSD_SUCCEEDED(retval)) {
+                retval = rv;
+            }
+        }
+        for (size_t i = 0; i < num_batch; i++) {
+            cdm_accesses[batch_idx[i]].result = batch[i].result;
+        }
+
+        done = true;
+        for (size_t c = 0; c < num_cdms; c++) {
+            if (!upper_failed[c] && pos[c] < num_cdm_accesses[c]) {
+                done = false;
+            }
+        }
+    }
+
+    // skip the remaining accesses of CDMs with an unknown register bank
+    for (size_t c = 0; c < num_cdms; c++) {
+        for (size_t k = pos[c]; k < num_cdm_accesses[c]; k++) {
+            cdm_accesses[c * max_cdm_accesses + k].result = OSD_ERROR_ABORTED;
+        }
+    }
+
+    free(upper_failed);
+    free(pos);
+    free(batch_idx);
+    free(batch);
+    free(order);
+    free(upper_vals);
+    free(num_cdm_accesses);
+    free(cdm_accesses);
+
+    return retval;
+}
+
+API_EXPORT
+osd_result osd_cl_cdm_cpureg_read_bulk(struct osd_hostmod_ctx *hostmod_ctx,
+                                       struct osd_cdm_desc *cdm_descs,
+                                       size_t num_cdms,
+                                       const uint16_t *reg_addrs,
+                                       size_t num_regs, void *reg_vals,
+                                       int flags)
+{
+    return cpureg_bulk(hostmod_ctx, cdm_descs, num_cdms, reg_addrs, num_regs,
+                       reg_vals, false, flags);
+}
+
+API_EXPORT
+osd_result osd_cl_cdm_cpureg_write_bulk(struct osd_hostmod_ctx *hostmod_ctx,
+                                        struct osd_cdm_desc *cdm_descs,
+                                        size_t num_cdms,
+                                        const uint16_t *reg_addrs,
+                                        size_t num_regs, const void *reg_vals,
+                                        int flags)
+{
+    return cpureg_bulk(hostmod_ctx, cdm_descs, num_cdms, reg_addrs, num_regs,
+                       (void *)reg_vals, true, flags);
+}
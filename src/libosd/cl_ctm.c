@@ -21,17 +21,26 @@
 #include <osd/reg.h>
 #include "osd-private.h"
 
-static struct osd_ctm_event *build_ctm_event(
-    const struct osd_ctm_desc *ctm_desc, const struct osd_packet *pkg)
+#include <string.h>
+
+API_EXPORT
+osd_result osd_cl_ctm_decode_event(const struct osd_ctm_desc *ctm_desc,
+                                   const struct osd_packet *pkg,
+                                   struct osd_ctm_event *ev)
 {
-    struct osd_ctm_event *ev = calloc(1, sizeof(struct osd_ctm_event));
+    assert(ctm_desc);
+    assert(pkg);
+    assert(ev);
+
+    memset(ev, 0, sizeof(struct osd_ctm_event));
 
     if (osd_packet_get_type_sub(pkg) == EV_OVERFLOW) {
-        assert(osd_packet_sizeconv_payload2data(1) == pkg->data_size_words &&
-               "STM Protocol violation detected.");
+        if (osd_packet_sizeconv_payload2data(1) != pkg->data_size_words) {
+            return OSD_ERROR_DEVICE_INVALID_DATA;
+        }
 
         ev->overflow = pkg->data.payload[0];
-        return ev;
+        return OSD_OK;
     }
     size_t exp_payload_len_bit = 32                          // timestamp
                                  + ctm_desc->addr_width_bit  // npc
@@ -41,16 +50,18 @@ static struct osd_ctm_event *build_ctm_event(
                                  + 1                         // call
                                  + 1;                        // modechange
     size_t exp_payload_len = INT_DIV_CEIL(exp_payload_len_bit, 16);
-    assert(osd_packet_sizeconv_payload2data(exp_payload_len) ==
-               pkg->data_size_words &&
-           "CTM Protocol violation detected.");
+    if (osd_packet_sizeconv_payload2data(exp_payload_len) !=
+        pkg->data_size_words) {
+        return OSD_ERROR_DEVICE_INVALID_DATA;
+    }
 
     unsigned int aw_words = ctm_desc->addr_width_bit / 16;
 
     size_t w = 0;
 
     ev->overflow = 0;
-    ev->timestamp = (pkg->data.payload[w + 1] << 16) | pkg->data.payload[w];
+    ev->timestamp = ((uint32_t)pkg->data.payload[w + 1] << 16) |
+                    pkg->data.payload[w];
     w += 2;
 
     for (unsigned int i = 0; i < aw_words; i++) {
@@ -68,7 +79,7 @@ static struct osd_ctm_event *build_ctm_event(
     ev->is_call = pkg->data.payload[w] >> 3 & 0x1;
     ev->is_modechange = pkg->data.payload[w] >> 4 & 0x1;
 
-    return ev;
+    return OSD_OK;
 }
 
 API_EXPORT
@@ -81,12 +92,12 @@ osd_result osd_cl_ctm_handle_event(void *arg, struct osd_packet *pkg)
 
     struct osd_ctm_event_handler *handler = arg;
 
-    struct osd_ctm_event *ev = build_ctm_event(handler->ctm_desc, pkg);
+    struct osd_ctm_event ev;
+    osd_result rv = osd_cl_ctm_decode_event(handler->ctm_desc, pkg, &ev);
+    assert(OSD_SUCCEEDED(rv) && "CTM Protocol violation detected.");
     osd_packet_free(&pkg);
 
-    handler->cb_fn(handler->cb_arg, handler->ctm_desc, ev);
-
-    free(ev);
+    handler->cb_fn(handler->cb_arg, handler->ctm_desc, &ev);
 
     return OSD_OK;
 }
@@ -21,6 +21,11 @@
 #include <unistd.h>
 #include "osd-private.h"
 
+/**
+ * Maximum number of characters passed to the I/O thread in one message
+ */
+#define DEM_UART_TX_BATCH 256
+
 static bool is_dem_uart_module(struct osd_hostmod_ctx *hostmod_ctx,
                                uint16_t dem_uart_di_addr)
 {
@@ -77,32 +82,81 @@ osd_result osd_cl_dem_uart_receive_event(void *handler, struct osd_packet *pkg)
     return OSD_OK;
 }
 
+API_EXPORT
+osd_result osd_cl_dem_uart_receive_event_batch(void *handler,
+                                               struct osd_packet **pkgs,
+                                               size_t num_pkgs)
+{
+    assert(handler &&
+           "You need to give an event_handler_arg of type "
+           "struct osd_dem_uart_event_handler in osd_hostmod_new()");
+    assert(pkgs);
+
+    struct osd_dem_uart_event_handler *dem_uart_event_handler = handler;
+
+    // Pass all characters in the batch to the callback in one run
+    char str[OSD_HOSTMOD_EVENT_BATCH_MAX];
+    size_t len = 0;
+
+    for (size_t i = 0; i < num_pkgs; i++) {
+        str[len++] = pkgs[i]->data.payload[0] & 0xFF;
+        osd_packet_free(&pkgs[i]);
+
+        if (len == sizeof(str)) {
+            dem_uart_event_handler->cb_fn(dem_uart_event_handler->cb_arg, str,
+                                          len);
+            len = 0;
+        }
+    }
+
+    if (len > 0) {
+        dem_uart_event_handler->cb_fn(dem_uart_event_handler->cb_arg, str,
+                                      len);
+    }
+
+    return OSD_OK;
+}
+
 API_EXPORT
 osd_result osd_cl_dem_uart_send_string(struct osd_hostmod_ctx *hostmod_ctx,
                                        struct osd_dem_uart_desc *dem_uart_desc,
                                        const char *str, size_t len)
 {
-    osd_result rv;
+    osd_result rv = OSD_OK;
 
     assert(str && len > 0);
 
-    struct osd_packet *packet;
-    osd_packet_new(&packet, osd_packet_sizeconv_payload2data(1));
-
-    osd_packet_set_header(packet, dem_uart_desc->di_addr,
-                          osd_hostmod_get_diaddr(hostmod_ctx),
-                          OSD_PACKET_TYPE_EVENT, EV_LAST);
+    // One event packet per character. All packets of a batch are stored in
+    // a single buffer, which is reused for all batches. struct osd_packet
+    // consists only of 16 bit words, the packets can be placed back-to-back.
+    size_t batch_len = len < DEM_UART_TX_BATCH ? len : DEM_UART_TX_BATCH;
+    size_t pkg_words = 1 + osd_packet_sizeconv_payload2data(1);
+    uint16_t *pkg_buf = calloc(batch_len * pkg_words, sizeof(uint16_t));
+    assert(pkg_buf);
+    struct osd_packet *pkgs[DEM_UART_TX_BATCH];
+
+    for (size_t i = 0; i < batch_len; i++) {
+        pkgs[i] = (struct osd_packet *)(pkg_buf + i * pkg_words);
+        pkgs[i]->data_size_words = osd_packet_sizeconv_payload2data(1);
+        osd_packet_set_header(pkgs[i], dem_uart_desc->di_addr,
+                              osd_hostmod_get_diaddr(hostmod_ctx),
+                              OSD_PACKET_TYPE_EVENT, EV_LAST);
+    }
 
-    for (size_t i = 0; i < len; i++) {
-        packet->data.payload[0] = str[i] & 0xFF;
+    for (size_t pos = 0; pos < len; pos += batch_len) {
+        size_t n = len - pos < batch_len ? len - pos : batch_len;
+        for (size_t i = 0; i < n; i++) {
+            pkgs[i]->data.payload[0] = str[pos + i] & 0xFF;
+        }
 
-        rv = osd_hostmod_event_send(hostmod_ctx, packet);
+        rv = osd_hostmod_event_send_batch(
+            hostmod_ctx, (const struct osd_packet *const *)pkgs, n);
         if (OSD_FAILED(rv)) {
-            return rv;
+            break;
         }
     }
 
-    osd_packet_free(&packet);
+    free(pkg_buf);
 
-    return OSD_OK;
+    return rv;
 }
@@ -23,6 +23,7 @@
 #include <stdio.h>
 #include <string.h>
 #include "osd-private.h"
+#include "trace.h"
 
 /**
  * Maximum number of words in a burst write transfer.
@@ -491,15 +492,14 @@ static osd_result read_burst(const struct osd_mem_desc *mem_desc,
     return rv;
 }
 
-API_EXPORT
-osd_result osd_cl_mam_write(const struct osd_mem_desc *mem_desc,
-                            struct osd_hostmod_ctx *hostmod_ctx,
-                            const void *data, size_t nbyte, uint64_t start_addr)
+/**
+ * Write to memory (see osd_cl_mam_write())
+ */
+static osd_result mam_write_parts(const struct osd_mem_desc *mem_desc,
+                                  struct osd_hostmod_ctx *hostmod_ctx,
+                                  const void *data, size_t nbyte,
+                                  uint64_t start_addr)
 {
-    assert(mem_desc);
-    assert(data);
-    assert(hostmod_ctx);
-
     osd_result rv;
     unsigned int dw_b = (mem_desc->data_width_bit / 8);
     assert(dw_b);
@@ -538,15 +538,13 @@ osd_result osd_cl_mam_write(const struct osd_mem_desc *mem_desc,
     return OSD_OK;
 }
 
-API_EXPORT
-osd_result osd_cl_mam_read(const struct osd_mem_desc *mem_desc,
-                           struct osd_hostmod_ctx *hostmod_ctx,
-                           void *data, size_t nbyte, uint64_t start_addr)
+/**
+ * Read from memory (see osd_cl_mam_read())
+ */
+static osd_result mam_read_parts(const struct osd_mem_desc *mem_desc,
+                                 struct osd_hostmod_ctx *hostmod_ctx,
+                                 void *data, size_t nbyte, uint64_t start_addr)
 {
-    assert(mem_desc);
-    assert(data);
-    assert(hostmod_ctx);
-
     osd_result rv;
     unsigned int dw_b = (mem_desc->data_width_bit / 8);
 
@@ -581,6 +579,38 @@ osd_result osd_cl_mam_read(const struct osd_mem_desc *mem_desc,
     return OSD_OK;
 }
 
+API_EXPORT
+osd_result osd_cl_mam_write(const struct osd_mem_desc *mem_desc,
+                            struct osd_hostmod_ctx *hostmod_ctx,
+                            const void *data, size_t nbyte, uint64_t start_addr)
+{
+    assert(mem_desc);
+    assert(data);
+    assert(hostmod_ctx);
+
+    OSD_TRACE_MAM_XFER_START(mem_desc->di_addr, start_addr, nbyte, 1);
+    osd_result rv = mam_write_parts(mem_desc, hostmod_ctx, data, nbyte,
+                                    start_addr);
+    OSD_TRACE_MAM_XFER_END(mem_desc->di_addr, start_addr, nbyte, 1, rv);
+    return rv;
+}
+
+API_EXPORT
+osd_result osd_cl_mam_read(const struct osd_mem_desc *mem_desc,
+                           struct osd_hostmod_ctx *hostmod_ctx,
+                           void *data, size_t nbyte, uint64_t start_addr)
+{
+    assert(mem_desc);
+    assert(data);
+    assert(hostmod_ctx);
+
+    OSD_TRACE_MAM_XFER_START(mem_desc->di_addr, start_addr, nbyte, 0);
+    osd_result rv = mam_read_parts(mem_desc, hostmod_ctx, data, nbyte,
+                                   start_addr);
+    OSD_TRACE_MAM_XFER_END(mem_desc->di_addr, start_addr, nbyte, 0, rv);
+    return rv;
+}
+
 API_EXPORT
 osd_result osd_cl_mam_get_mem_desc(struct osd_hostmod_ctx *hostmod_ctx,
                                    unsigned int mam_di_addr,
@@ -21,17 +21,26 @@
 #include <osd/packet.h>
 #include "osd-private.h"
 
-static struct osd_stm_event* build_stm_event(const struct osd_stm_desc *stm_desc,
-                                             const struct osd_packet *pkg)
+#include <string.h>
+
+API_EXPORT
+osd_result osd_cl_stm_decode_event(const struct osd_stm_desc *stm_desc,
+                                   const struct osd_packet *pkg,
+                                   struct osd_stm_event *ev)
 {
-    struct osd_stm_event *ev = calloc(1, sizeof(struct osd_stm_event));
+    assert(stm_desc);
+    assert(pkg);
+    assert(ev);
+
+    memset(ev, 0, sizeof(struct osd_stm_event));
 
     if (osd_packet_get_type_sub(pkg) == EV_OVERFLOW) {
-        assert(osd_packet_sizeconv_payload2data(1) == pkg->data_size_words
-                   && "STM Protocol violation detected.");
+        if (osd_packet_sizeconv_payload2data(1) != pkg->data_size_words) {
+            return OSD_ERROR_DEVICE_INVALID_DATA;
+        }
 
         ev->overflow = pkg->data.payload[0];
-        return ev;
+        return OSD_OK;
     }
 
     size_t exp_payload_len_bit =
@@ -39,11 +48,13 @@ static struct osd_stm_event* build_stm_event(const struct osd_stm_desc *stm_desc
         + 16 // id
         + stm_desc->value_width_bit; // value
     size_t exp_payload_len = INT_DIV_CEIL(exp_payload_len_bit, 16);
-    assert(osd_packet_sizeconv_payload2data(exp_payload_len)
-           == pkg->data_size_words
-           && "STM Protocol violation detected.");
+    if (osd_packet_sizeconv_payload2data(exp_payload_len)
+        != pkg->data_size_words) {
+        return OSD_ERROR_DEVICE_INVALID_DATA;
+    }
 
-    uint32_t timestamp = (pkg->data.payload[1] << 16) | pkg->data.payload[0];
+    uint32_t timestamp = ((uint32_t)pkg->data.payload[1] << 16)
+                         | pkg->data.payload[0];
     uint16_t id = pkg->data.payload[2];
     uint64_t value = 0;
     unsigned int valw_words = stm_desc->value_width_bit / 16;
@@ -56,7 +67,7 @@ static struct osd_stm_event* build_stm_event(const struct osd_stm_desc *stm_desc
     ev->value = value;
     ev->overflow = 0;
 
-    return ev;
+    return OSD_OK;
 }
 
 API_EXPORT
@@ -69,12 +80,12 @@ osd_result osd_cl_stm_handle_event(void *arg, struct osd_packet *pkg)
 
     struct osd_stm_event_handler *handler = arg;
 
-    struct osd_stm_event *ev = build_stm_event(handler->stm_desc, pkg);
+    struct osd_stm_event ev;
+    osd_result rv = osd_cl_stm_decode_event(handler->stm_desc, pkg, &ev);
+    assert(OSD_SUCCEEDED(rv) && "STM Protocol violation detected.");
     osd_packet_free(&pkg);
 
-    handler->cb_fn(handler->cb_arg, handler->stm_desc, ev);
-
-    free(ev);
+    handler->cb_fn(handler->cb_arg, handler->stm_desc, &ev);
 
     return OSD_OK;
 }
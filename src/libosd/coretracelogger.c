@@ -18,21 +18,14 @@
 #include <osd/osd.h>
 #include <osd/reg.h>
 #include <osd/cl_ctm.h>
+#include <osd/coverage.h>
+#include <osd/symtab.h>
 #include "osd-private.h"
 
 #include <assert.h>
-#include <errno.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <string.h>
-#include <gelf.h>
-
-/**
- * A function in a ELF file
- */
-struct elf_function_table {
-    uint64_t addr;
-    char *name;
-};
 
 /**
  * Core Trace Logger context
@@ -42,102 +35,139 @@ struct osd_coretracelogger_ctx {
     struct osd_log_ctx *log_ctx;
     uint16_t ctm_di_addr;
     struct osd_ctm_desc ctm_desc;
-    struct osd_ctm_event_handler ctm_event_handler;
+    struct osd_tracepipe_ctx *pipe;
+    struct osd_tracepipe_source source;
     FILE *fp_log;
-    size_t num_funcs;
-    struct elf_function_table *funcs;
+    struct osd_symtab_ctx *symtab;
+    struct osd_tracestream_ctx *stream;
+
+    /** coverage collector, NULL if coverage collection is disabled */
+    struct osd_coverage_ctx *coverage;
+    char *coverage_filename;
+    /** protects coverage against concurrent updates and writes */
+    pthread_mutex_t coverage_lock;
 };
 
-static void print_with_elfdata(struct osd_coretracelogger_ctx *ctx,
-                               const struct osd_ctm_event *event)
+static int print_with_elfdata(FILE *fp, const struct osd_symtab_ctx *symtab,
+                              const struct osd_ctm_event *event)
 {
-    assert(ctx);
+    assert(fp);
+    assert(symtab);
     assert(event);
-    assert(ctx->funcs);
 
     if (event->is_modechange) {
-        fprintf(ctx->fp_log, "%08x change mode to %d\n", event->timestamp,
-                event->mode);
-        return;
+        return fprintf(fp, "%08x change mode to %d\n", event->timestamp,
+                       event->mode);
     }
 
     if (event->is_call) {
-        for (size_t f = 0; f < ctx->num_funcs; f++) {
-            if (ctx->funcs[f].addr == event->npc) {
-                fprintf(ctx->fp_log, "%08x enter %s\n", event->timestamp,
-                        ctx->funcs[f].name);
-                return;
-            }
+        const struct osd_symtab_entry *callee = osd_symtab_find(symtab,
+                                                                event->npc);
+        if (callee) {
+            return fprintf(fp, "%08x enter %s\n", event->timestamp,
+                           callee->name);
         }
-        return;
+        return 0;
     }
 
     if (event->is_ret) {
-        char* to = 0;
-        for (size_t f = 1; f <= ctx->num_funcs; f++) {
-            if (ctx->funcs[f].addr > event->npc) {
-                to = ctx->funcs[f - 1].name;
-                break;
-            }
-            if (f == ctx->num_funcs) {
-                to = ctx->funcs[ctx->num_funcs - 1].name;
-            }
+        // a return directly to the start of a function (tail call)
+        const struct osd_symtab_entry *callee = osd_symtab_find(symtab,
+                                                                event->npc);
+        if (callee) {
+            return fprintf(fp, "%08x enter %s\n", event->timestamp,
+                           callee->name);
         }
 
-        for (size_t f = 1; f <= ctx->num_funcs; f++) {
-            if (ctx->funcs[f].addr == event->npc) {
-                fprintf(ctx->fp_log, "%08x enter %s\n", event->timestamp,
-                        ctx->funcs[f].name);
-                break;
-            }
-
-            if (ctx->funcs[f].addr > event->pc) {
-                if (ctx->funcs[f - 1].name != to) {
-                    fprintf(ctx->fp_log, "%08x leave %s\n", event->timestamp,
-                            ctx->funcs[f - 1].name);
-                }
-                break;
-            }
-            if (f == ctx->num_funcs) {
-                if (ctx->funcs[ctx->num_funcs - 1].name != to) {
-                    fprintf(ctx->fp_log, "%08x leave %s\n", event->timestamp,
-                            ctx->funcs[ctx->num_funcs - 1].name);
-                }
-            }
+        const struct osd_symtab_entry *to =
+            osd_symtab_find_containing(symtab, event->npc);
+        const struct osd_symtab_entry *from =
+            osd_symtab_find_containing(symtab, event->pc);
+        if (from && from != to) {
+            return fprintf(fp, "%08x leave %s\n", event->timestamp,
+                           from->name);
         }
     }
+
+    return 0;
 }
 
-static void ctm_event_handler(void *ctx_void,
-                              const struct osd_ctm_desc *ctm_desc,
-                              const struct osd_ctm_event *event)
+API_EXPORT
+osd_result osd_coretracelogger_format_event(FILE *fp,
+                                            const struct osd_symtab_ctx *symtab,
+                                            const struct osd_ctm_event *event)
 {
     int rv;
-    struct osd_coretracelogger_ctx *ctx = ctx_void;
 
-    if (!ctx->fp_log) {
-        return;
-    }
+    assert(fp);
+    assert(event);
 
     if (event->overflow) {
-        rv = fprintf(ctx->fp_log, "Overflow, missed %u events\n",
-                     event->overflow);
-        if (rv < 0) {
-            err(ctx->log_ctx, "Unable to write CTM event to log file.");
+        rv = fprintf(fp, "Overflow, missed %u events\n", event->overflow);
+    } else if (!symtab) {
+        rv = fprintf(fp, "%08x %d %d %d %d %016lx %016lx\n",
+                     event->timestamp, event->is_modechange, event->is_call,
+                     event->is_ret, event->mode, event->pc, event->npc);
+    } else {
+        rv = print_with_elfdata(fp, symtab, event);
+    }
+
+    if (rv < 0) {
+        return OSD_ERROR_FILE;
+    }
+    return OSD_OK;
+}
+
+static osd_result coverage_process(void *arg, struct osd_trace_batch *batch)
+{
+    struct osd_coretracelogger_ctx *ctx = arg;
+
+    pthread_mutex_lock(&ctx->coverage_lock);
+    if (ctx->coverage) {
+        for (size_t i = 0; i < batch->num_events; i++) {
+            osd_coverage_add_event(ctx->coverage, &batch->events[i].data.ctm);
         }
-        return;
     }
+    pthread_mutex_unlock(&ctx->coverage_lock);
 
-    if (!ctx->funcs) {
-        rv = fprintf(ctx->fp_log, "%08x %d %d %d %d %016lx %016lx\n",
-                     event->timestamp, event->is_modechange, event->is_call,
-                     event->is_ret, event->mode, event->pc, event->npc);
-        if (rv < 0) {
-            err(ctx->log_ctx, "Unable to write CTM event to log file.");
+    return OSD_OK;
+}
+
+/**
+ * Add the configured outputs to the trace pipeline and start it
+ */
+static osd_result setup_pipeline(struct osd_coretracelogger_ctx *ctx)
+{
+    osd_result rv;
+
+    if (osd_tracepipe_is_running(ctx->pipe)) {
+        return OSD_OK;
+    }
+
+    if (ctx->stream) {
+        rv = osd_tracepipe_add_stream_sink(ctx->pipe, ctx->stream, 0);
+        if (OSD_FAILED(rv)) {
+            return rv;
+        }
+    }
+    if (ctx->coverage) {
+        static const struct osd_tracepipe_stage_ops coverage_ops = {
+            .process = coverage_process,
+        };
+        rv = osd_tracepipe_add_stage(ctx->pipe, &coverage_ops, ctx, 0);
+        if (OSD_FAILED(rv)) {
+            return rv;
+        }
+    }
+    if (ctx->fp_log) {
+        rv = osd_tracepipe_add_text_sink(ctx->pipe, ctx->fp_log, ctx->symtab,
+                                         0);
+        if (OSD_FAILED(rv)) {
+            return rv;
         }
-    } else {
-        print_with_elfdata(ctx, event);
     }
+
+    return osd_tracepipe_start(ctx->pipe);
 }
 
 API_EXPORT
@@ -154,12 +184,17 @@ osd_result osd_coretracelogger_new(struct osd_coretracelogger_ctx **ctx,
 
     c->log_ctx = log_ctx;
     c->ctm_di_addr = ctm_di_addr;
-    c->ctm_event_handler.cb_fn = ctm_event_handler;
-    c->ctm_event_handler.cb_arg = (void*)c;
+    pthread_mutex_init(&c->coverage_lock, NULL);
+
+    rv = osd_tracepipe_new(&c->pipe, log_ctx, 0, 0);
+    assert(OSD_SUCCEEDED(rv));
+    c->source.pipe = c->pipe;
+    c->source.type = OSD_TRACE_EVENT_CTM;
+    c->source.desc.ctm = &c->ctm_desc;
 
     struct osd_hostmod_ctx *hostmod_ctx;
     rv = osd_hostmod_new(&hostmod_ctx, log_ctx, host_controller_address,
-                         osd_cl_ctm_handle_event, (void*)&c->ctm_event_handler);
+                         osd_tracepipe_handle_packet, (void*)&c->source);
     assert(OSD_SUCCEEDED(rv));
     c->hostmod_ctx = hostmod_ctx;
 
@@ -186,16 +221,6 @@ bool osd_coretracelogger_is_connected(struct osd_coretracelogger_ctx *ctx)
     return osd_hostmod_is_connected(ctx->hostmod_ctx);
 }
 
-static void free_elf_data(struct osd_coretracelogger_ctx *ctx)
-{
-    if (ctx->funcs) {
-        for (size_t i = 0; i < ctx->num_funcs; i++) {
-            free(ctx->funcs[i].name);
-        }
-        free(ctx->funcs);
-    }
-}
-
 API_EXPORT
 void osd_coretracelogger_free(struct osd_coretracelogger_ctx **ctx_p)
 {
@@ -205,9 +230,15 @@ void osd_coretracelogger_free(struct osd_coretracelogger_ctx **ctx_p)
         return;
     }
 
+    // stop receiving events before flushing all outputs
     osd_hostmod_free(&ctx->hostmod_ctx);
+    osd_tracepipe_free(&ctx->pipe);
+
+    osd_coverage_free(&ctx->coverage);
+    free(ctx->coverage_filename);
+    pthread_mutex_destroy(&ctx->coverage_lock);
 
-    free_elf_data(ctx);
+    osd_symtab_free(&ctx->symtab);
 
     free(ctx);
     *ctx_p = NULL;
@@ -222,7 +253,11 @@ osd_result osd_coretracelogger_start(struct osd_coretracelogger_ctx *ctx)
     if (OSD_FAILED(rv)) {
         return rv;
     }
-    ctx->ctm_event_handler.ctm_desc = &ctx->ctm_desc;
+
+    rv = setup_pipeline(ctx);
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
 
     rv = osd_hostmod_mod_set_event_dest(ctx->hostmod_ctx, ctx->ctm_di_addr, 0);
     if (OSD_FAILED(rv)) {
@@ -246,6 +281,23 @@ osd_result osd_coretracelogger_stop(struct osd_coretracelogger_ctx *ctx)
     if (rv == OSD_ERROR_TIMEDOUT) {
         rv = OSD_OK;
     }
+
+    // write out all events received so far
+    osd_result flush_rv = osd_tracepipe_flush(ctx->pipe);
+    if (OSD_FAILED(flush_rv) && OSD_SUCCEEDED(rv)) {
+        rv = flush_rv;
+    }
+
+    if (ctx->coverage) {
+        pthread_mutex_lock(&ctx->coverage_lock);
+        osd_result write_rv = osd_coverage_write(ctx->coverage,
+                                                 ctx->coverage_filename);
+        pthread_mutex_unlock(&ctx->coverage_lock);
+        if (OSD_FAILED(write_rv) && OSD_SUCCEEDED(rv)) {
+            rv = write_rv;
+        }
+    }
+
     return rv;
 }
 
@@ -253,114 +305,96 @@ API_EXPORT
 osd_result osd_coretracelogger_set_log(struct osd_coretracelogger_ctx *ctx,
                                        FILE *fp)
 {
+    if (osd_tracepipe_is_running(ctx->pipe)) {
+        err(ctx->log_ctx, "Outputs must be set before starting the logger.");
+        return OSD_ERROR_FAILURE;
+    }
     ctx->fp_log = fp;
     return OSD_OK;
 }
 
+API_EXPORT
+osd_result osd_coretracelogger_set_stream(struct osd_coretracelogger_ctx *ctx,
+                                          struct osd_tracestream_ctx *stream)
+{
+    if (osd_tracepipe_is_running(ctx->pipe)) {
+        err(ctx->log_ctx, "Outputs must be set before starting the logger.");
+        return OSD_ERROR_FAILURE;
+    }
+    ctx->stream = stream;
+    return OSD_OK;
+}
+
 API_EXPORT
 osd_result osd_coretracelogger_set_elf(struct osd_coretracelogger_ctx *ctx,
                                        const char* elf_filename)
 {
-    osd_result retval;
+    osd_result rv;
 
-    if (ctx->funcs) {
-        free_elf_data(ctx);
+    if (osd_tracepipe_is_running(ctx->pipe)) {
+        err(ctx->log_ctx, "Outputs must be set before starting the logger.");
+        return OSD_ERROR_FAILURE;
     }
-
-    ctx->num_funcs = 0;
-    ctx->funcs = NULL;
+    // the coverage refers to the symbol table which is replaced
+    osd_coretracelogger_set_coverage(ctx, NULL);
+    osd_symtab_free(&ctx->symtab);
 
     if (elf_filename == NULL) {
         return OSD_OK;
     }
 
-    struct elf_function_table *tab = NULL;
-
-    if (elf_version(EV_CURRENT) == EV_NONE) {
-        err(ctx->log_ctx, "Version mismatch between elf library and system.");
-        return OSD_ERROR_FAILURE;
+    struct osd_symtab_ctx *symtab;
+    rv = osd_symtab_new(&symtab, ctx->log_ctx);
+    if (OSD_FAILED(rv)) {
+        return rv;
     }
 
-    int fd = open(elf_filename, O_RDONLY, 0);
-    if (fd < 0) {
-        err(ctx->log_ctx, "Unable to open file %s: %s (%d)", elf_filename,
-            strerror(errno), errno);
-        return OSD_ERROR_FILE;
+    rv = osd_symtab_load_elf(symtab, elf_filename);
+    if (OSD_FAILED(rv)) {
+        osd_symtab_free(&symtab);
+        return rv;
     }
 
-    Elf *elf_object = elf_begin(fd, ELF_C_READ, NULL);
-    if (elf_object == NULL) {
-        err(ctx->log_ctx, "%s", elf_errmsg(-1));
-        retval = OSD_ERROR_FAILURE;
-        goto return_free_file;
-    }
+    ctx->symtab = symtab;
 
-    Elf_Scn *sec = NULL;
-    while ((sec = elf_nextscn(elf_object, sec)) != NULL) {
-        GElf_Shdr shdr;
-        gelf_getshdr(sec, &shdr);
-
-        if (shdr.sh_type == SHT_SYMTAB) {
-            Elf_Data *edata = NULL;
-            edata = elf_getdata(sec, edata);
-
-            size_t allsyms = shdr.sh_size / shdr.sh_entsize;
-
-            size_t f = 0;
-            for (size_t i = 0; i < allsyms; i++) {
-                GElf_Sym sym;
-                gelf_getsym(edata, i, &sym);
-
-                if (ELF32_ST_TYPE(sym.st_info) == STT_FUNC
-                    || ELF32_ST_TYPE(sym.st_info) == STT_NOTYPE) {
-                    f++;
-                }
-            }
-
-            size_t base = ctx->num_funcs;
-            ctx->num_funcs += f;
-            tab = realloc(tab,
-                          ctx->num_funcs * sizeof(struct elf_function_table));
-
-            f = 0;
-            for (size_t i = 0; i < allsyms; i++) {
-                GElf_Sym sym;
-                gelf_getsym(edata, i, &sym);
-
-                if ((ELF32_ST_TYPE(sym.st_info) == STT_FUNC)
-                        || (ELF32_ST_TYPE(sym.st_info) == STT_NOTYPE)) {
-                    tab[base + f].addr = sym.st_value;
-                    tab[base + f].name = strdup(
-                            elf_strptr(elf_object, shdr.sh_link, sym.st_name));
-                    f++;
-                }
-            }
-        }
-    }
+    return OSD_OK;
+}
 
-    ctx->funcs = malloc(sizeof(struct elf_function_table) * ctx->num_funcs);
+API_EXPORT
+osd_result osd_coretracelogger_set_coverage(struct osd_coretracelogger_ctx *ctx,
+                                            const char *filename)
+{
+    osd_result rv;
+    struct osd_coverage_ctx *coverage = NULL;
 
-    for (size_t i = 0; i < ctx->num_funcs; i++) {
-        uint64_t min = -1;
-        struct elf_function_table *minp = NULL;
-        for (size_t j = 0; j < ctx->num_funcs; j++) {
-            if (tab[j].addr < min) {
-                min = tab[j].addr;
-                minp = &tab[j];
-            }
+    if (osd_tracepipe_is_running(ctx->pipe)) {
+        err(ctx->log_ctx, "Outputs must be set before starting the logger.");
+        return OSD_ERROR_FAILURE;
+    }
+    if (filename) {
+        if (!ctx->symtab) {
+            err(ctx->log_ctx, "Coverage collection requires an ELF file.");
+            return OSD_ERROR_FAILURE;
+        }
+        rv = osd_coverage_new(&coverage, ctx->log_ctx, ctx->symtab);
+        if (OSD_FAILED(rv)) {
+            return rv;
         }
-        ctx->funcs[i].addr = minp->addr;
-        ctx->funcs[i].name = minp->name;
-        minp->addr = -1;
     }
 
-    retval = OSD_OK;
-
-    free(tab);
-    elf_end(elf_object);
+    pthread_mutex_lock(&ctx->coverage_lock);
+    osd_coverage_free(&ctx->coverage);
+    free(ctx->coverage_filename);
+    ctx->coverage = coverage;
+    ctx->coverage_filename = filename ? strdup(filename) : NULL;
+    pthread_mutex_unlock(&ctx->coverage_lock);
 
-return_free_file:
-    close(fd);
+    return OSD_OK;
+}
 
-    return retval;
+API_EXPORT
+struct osd_tracepipe_ctx *osd_coretracelogger_get_tracepipe(
+    struct osd_coretracelogger_ctx *ctx)
+{
+    return ctx->pipe;
 }
@@ -0,0 +1,607 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <osd/coverage.h>
+#include <osd/osd.h>
+#include "osd-private.h"
+
+#include <assert.h>
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+ * Coverage file layout (all values little endian)
+ *
+ * File header (32 bytes):
+ *   0  magic "OSDCOV\r\n"
+ *   8  u16 format version
+ *  10  u16 header size in bytes
+ *  12  u32 number of symbols (n)
+ *  16  u32 checksum of the symbol table
+ *  20  u32 number of runs
+ *  24  u32 reserved (0)
+ *  28  u32 CRC-32 of the header (bytes 0-27) and the data
+ *
+ * Data:
+ *   bitmap: ceil(n / 64) u64 words, bit (i % 64) of word (i / 64) is set if
+ *           symbol i was called
+ *   hit counters: n u32 values
+ */
+
+static const char file_magic[8] = { 'O', 'S', 'D', 'C', 'O', 'V', '\r', '\n' };
+
+#define FILE_HEADER_SIZE 32
+
+/** Marks an unused slot in the address hash table */
+#define HT_EMPTY UINT32_MAX
+
+/**
+ * Coverage context
+ */
+struct osd_coverage_ctx {
+    struct osd_log_ctx *log_ctx;
+
+    /** symbol table, NULL for coverage read from a file */
+    const struct osd_symtab_ctx *symtab;
+    size_t num_symbols;
+    uint32_t symtab_checksum;
+    uint32_t runs;
+
+    uint64_t *bitmap;
+    size_t bitmap_words;
+    uint32_t *hits;
+
+    /**
+     * Hash table mapping symbol start addresses to symbol indices
+     * (open addressing, linear probing)
+     */
+    uint64_t *ht_addr;
+    uint32_t *ht_idx;
+    size_t ht_mask;
+};
+
+static size_t bitmap_words(size_t num_symbols)
+{
+    return (num_symbols + 63) / 64;
+}
+
+static uint32_t symtab_checksum(const struct osd_symtab_ctx *symtab)
+{
+    uint32_t crc = 0;
+    size_t count = osd_symtab_get_count(symtab);
+    for (size_t i = 0; i < count; i++) {
+        const struct osd_symtab_entry *e = osd_symtab_get(symtab, i);
+        uint64_t addr_le = htole64(e->addr);
+        crc = osd_crc32(crc, &addr_le, sizeof(addr_le));
+        crc = osd_crc32(crc, e->name, strlen(e->name) + 1);
+    }
+    return crc;
+}
+
+static size_t ht_slot(const struct osd_coverage_ctx *ctx, uint64_t addr)
+{
+    // Fibonacci hashing; the upper bits of the product are mixed best
+    return (size_t)((addr * 0x9E3779B97F4A7C15ULL) >> 32) & ctx->ht_mask;
+}
+
+static void ht_build(struct osd_coverage_ctx *ctx)
+{
+    // keep the load factor at or below 50%
+    size_t size = 16;
+    while (size < ctx->num_symbols * 2) {
+        size *= 2;
+    }
+    ctx->ht_mask = size - 1;
+    ctx->ht_addr = calloc(size, sizeof(uint64_t));
+    assert(ctx->ht_addr);
+    ctx->ht_idx = malloc(size * sizeof(uint32_t));
+    assert(ctx->ht_idx);
+    for (size_t i = 0; i < size; i++) {
+        ctx->ht_idx[i] = HT_EMPTY;
+    }
+
+    for (size_t i = 0; i < ctx->num_symbols; i++) {
+        uint64_t addr = osd_symtab_get(ctx->symtab, i)->addr;
+        size_t slot = ht_slot(ctx, addr);
+        while (ctx->ht_idx[slot] != HT_EMPTY) {
+            if (ctx->ht_addr[slot] == addr) {
+                // alias of a symbol already in the table; the first one wins
+                break;
+            }
+            slot = (slot + 1) & ctx->ht_mask;
+        }
+        if (ctx->ht_idx[slot] == HT_EMPTY) {
+            ctx->ht_addr[slot] = addr;
+            ctx->ht_idx[slot] = i;
+        }
+    }
+}
+
+static void alloc_data(struct osd_coverage_ctx *ctx)
+{
+    ctx->bitmap_words = bitmap_words(ctx->num_symbols);
+    ctx->bitmap = calloc(ctx->bitmap_words ? ctx->bitmap_words : 1,
+                         sizeof(uint64_t));
+    assert(ctx->bitmap);
+    ctx->hits = calloc(ctx->num_symbols ? ctx->num_symbols : 1,
+                       sizeof(uint32_t));
+    assert(ctx->hits);
+}
+
+API_EXPORT
+osd_result osd_coverage_new(struct osd_coverage_ctx **ctx,
+                            struct osd_log_ctx *log_ctx,
+                            const struct osd_symtab_ctx *symtab)
+{
+    assert(symtab);
+
+    struct osd_coverage_ctx *c = calloc(1, sizeof(struct osd_coverage_ctx));
+    assert(c);
+
+    c->log_ctx = log_ctx;
+    c->symtab = symtab;
+    c->num_symbols = osd_symtab_get_count(symtab);
+    if (c->num_symbols >= HT_EMPTY) {
+        err(log_ctx, "Too many symbols for coverage collection.");
+        free(c);
+        return OSD_ERROR_FAILURE;
+    }
+    c->symtab_checksum = symtab_checksum(symtab);
+    c->runs = 1;
+
+    alloc_data(c);
+    ht_build(c);
+
+    *ctx = c;
+
+    return OSD_OK;
+}
+
+API_EXPORT
+void osd_coverage_free(struct osd_coverage_ctx **ctx_p)
+{
+    assert(ctx_p);
+    struct osd_coverage_ctx *ctx = *ctx_p;
+    if (!ctx) {
+        return;
+    }
+
+    free(ctx->bitmap);
+    free(ctx->hits);
+    free(ctx->ht_addr);
+    free(ctx->ht_idx);
+
+    free(ctx);
+    *ctx_p = NULL;
+}
+
+static uint32_t add_saturated(uint32_t a, uint32_t b)
+{
+    return b > UINT32_MAX - a ? UINT32_MAX : a + b;
+}
+
+static void record_hit(struct osd_coverage_ctx *ctx, size_t idx)
+{
+    ctx->bitmap[idx / 64] |= 1ULL << (idx % 64);
+    if (ctx->hits[idx] != UINT32_MAX) {
+        ctx->hits[idx]++;
+    }
+}
+
+/**
+ * Does the idx-th symbol contain an address?
+ */
+static bool symbol_contains(struct osd_coverage_ctx *ctx, size_t idx,
+                            uint64_t addr)
+{
+    const struct osd_symtab_entry *e = osd_symtab_get(ctx->symtab, idx);
+    if (addr < e->addr) {
+        return false;
+    }
+    if (e->size) {
+        return addr - e->addr < e->size;
+    }
+
+    // size unknown: the function ends at the next symbol
+    if (idx + 1 < ctx->num_symbols) {
+        return addr < osd_symtab_get(ctx->symtab, idx + 1)->addr;
+    }
+    return false;
+}
+
+API_EXPORT
+void osd_coverage_add_call(struct osd_coverage_ctx *ctx, uint64_t target_addr)
+{
+    assert(ctx);
+    assert(ctx->symtab && "Coverage read from a file cannot be updated.");
+
+    if (ctx->num_symbols == 0) {
+        return;
+    }
+
+    // calls typically go to the start of a function
+    size_t slot = ht_slot(ctx, target_addr);
+    while (ctx->ht_idx[slot] != HT_EMPTY) {
+        if (ctx->ht_addr[slot] == target_addr) {
+            record_hit(ctx, ctx->ht_idx[slot]);
+            return;
+        }
+        slot = (slot + 1) & ctx->ht_mask;
+    }
+
+    // slow path: a call into the middle of a function
+    const struct osd_symtab_entry *e =
+        osd_symtab_find_containing(ctx->symtab, target_addr);
+    size_t idx = e - osd_symtab_get(ctx->symtab, 0);
+    if (!symbol_contains(ctx, idx, target_addr)) {
+        // not part of any known function
+        return;
+    }
+    record_hit(ctx, idx);
+}
+
+API_EXPORT
+void osd_coverage_add_event(struct osd_coverage_ctx *ctx,
+                            const struct osd_ctm_event *event)
+{
+    assert(event);
+
+    if (event->overflow || !event->is_call) {
+        return;
+    }
+    osd_coverage_add_call(ctx, event->npc);
+}
+
+API_EXPORT
+size_t osd_coverage_get_count(const struct osd_coverage_ctx *ctx)
+{
+    assert(ctx);
+    return ctx->num_symbols;
+}
+
+API_EXPORT
+size_t osd_coverage_get_covered_count(const struct osd_coverage_ctx *ctx)
+{
+    assert(ctx);
+
+    size_t count = 0;
+    for (size_t i = 0; i < ctx->bitmap_words; i++) {
+        count += __builtin_popcountll(ctx->bitmap[i]);
+    }
+    return count;
+}
+
+API_EXPORT
+unsigned int osd_coverage_get_runs(const struct osd_coverage_ctx *ctx)
+{
+    assert(ctx);
+    return ctx->runs;
+}
+
+API_EXPORT
+bool osd_coverage_is_covered(const struct osd_coverage_ctx *ctx, size_t idx)
+{
+    assert(ctx);
+    assert(idx < ctx->num_symbols);
+    return ctx->bitmap[idx / 64] & (1ULL << (idx % 64));
+}
+
+API_EXPORT
+uint32_t osd_coverage_get_hits(const struct osd_coverage_ctx *ctx, size_t idx)
+{
+    assert(ctx);
+    assert(idx < ctx->num_symbols);
+    return ctx->hits[idx];
+}
+
+API_EXPORT
+bool osd_coverage_matches_symtab(const struct osd_coverage_ctx *ctx,
+                                 const struct osd_symtab_ctx *symtab)
+{
+    assert(ctx);
+    assert(symtab);
+    return osd_symtab_get_count(symtab) == ctx->num_symbols &&
+           symtab_checksum(symtab) == ctx->symtab_checksum;
+}
+
+static size_t file_data_size(size_t num_symbols)
+{
+    return bitmap_words(num_symbols) * sizeof(uint64_t) +
+           num_symbols * sizeof(uint32_t);
+}
+
+API_EXPORT
+osd_result osd_coverage_write(const struct osd_coverage_ctx *ctx,
+                              const char *filename)
+{
+    assert(ctx);
+    assert(filename);
+
+    size_t len = FILE_HEADER_SIZE + file_data_size(ctx->num_symbols);
+    uint8_t *buf = calloc(1, len);
+    assert(buf);
+
+    memcpy(buf, file_magic, sizeof(file_magic));
+    uint16_t v16;
+    uint32_t v32;
+    v16 = htole16(OSD_COVERAGE_VERSION);
+    memcpy(buf + 8, &v16, sizeof(v16));
+    v16 = htole16(FILE_HEADER_SIZE);
+    memcpy(buf + 10, &v16, sizeof(v16));
+    v32 = htole32(ctx->num_symbols);
+    memcpy(buf + 12, &v32, sizeof(v32));
+    v32 = htole32(ctx->symtab_checksum);
+    memcpy(buf + 16, &v32, sizeof(v32));
+    v32 = htole32(ctx->runs);
+    memcpy(buf + 20, &v32, sizeof(v32));
+
+    uint8_t *p = buf + FILE_HEADER_SIZE;
+    for (size_t i = 0; i < ctx->bitmap_words; i++) {
+        uint64_t v64 = htole64(ctx->bitmap[i]);
+        memcpy(p, &v64, sizeof(v64));
+        p += sizeof(v64);
+    }
+    for (size_t i = 0; i < ctx->num_symbols; i++) {
+        v32 = htole32(ctx->hits[i]);
+        memcpy(p, &v32, sizeof(v32));
+        p += sizeof(v32);
+    }
+
+    uint32_t crc = osd_crc32(0, buf, 28);
+    crc = osd_crc32(crc, buf + FILE_HEADER_SIZE, len - FILE_HEADER_SIZE);
+    v32 = htole32(crc);
+    memcpy(buf + 28, &v32, sizeof(v32));
+
+    osd_result rv = OSD_OK;
+    FILE *fp = fopen(filename, "wb");
+    if (!fp) {
+        err(ctx->log_ctx, "Unable to open file %s: %s (%d)", filename,
+            strerror(errno), errno);
+        rv = OSD_ERROR_FILE;
+        goto free_return;
+    }
+    if (fwrite(buf, len, 1, fp) != 1) {
+        err(ctx->log_ctx, "Unable to write coverage to %s: %s", filename,
+            strerror(errno));
+        rv = OSD_ERROR_FILE;
+    }
+    if (fclose(fp) != 0 && OSD_SUCCEEDED(rv)) {
+        err(ctx->log_ctx, "Unable to write coverage to %s: %s", filename,
+            strerror(errno));
+        rv = OSD_ERROR_FILE;
+    }
+
+free_return:
+    free(buf);
+    return rv;
+}
+
+API_EXPORT
+osd_result osd_coverage_merge(struct osd_coverage_ctx *ctx,
+                              const struct osd_coverage_ctx *other)
+{
+    assert(ctx);
+    assert(other);
+
+    if (other->num_symbols != ctx->num_symbols ||
+        other->symtab_checksum != ctx->symtab_checksum) {
+        err(ctx->log_ctx, "Unable to merge coverage collected for a different "
+            "program.");
+        return OSD_ERROR_FAILURE;
+    }
+
+    for (size_t i = 0; i < ctx->bitmap_words; i++) {
+        ctx->bitmap[i] |= other->bitmap[i];
+    }
+    for (size_t i = 0; i < ctx->num_symbols; i++) {
+        ctx->hits[i] = add_saturated(ctx->hits[i], other->hits[i]);
+    }
+    ctx->runs = add_saturated(ctx->runs, other->runs);
+
+    return OSD_OK;
+}
+
+/**
+ * A mapped and validated coverage file
+ */
+struct coverage_file {
+    const uint8_t *data;
+    size_t len;
+    uint32_t num_symbols;
+    uint32_t symtab_checksum;
+    uint32_t runs;
+    const uint8_t *bitmap;
+    const uint8_t *hits;
+};
+
+static uint16_t get_le16(const uint8_t *p)
+{
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return le16toh(v);
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return le32toh(v);
+}
+
+static uint64_t get_le64(const uint8_t *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return le64toh(v);
+}
+
+static void coverage_file_close(struct coverage_file *f)
+{
+    if (f->data) {
+        munmap((void *)f->data, f->len);
+        f->data = NULL;
+    }
+}
+
+static osd_result coverage_file_open(struct osd_log_ctx *log_ctx,
+                                     const char *filename,
+                                     struct coverage_file *f)
+{
+    memset(f, 0, sizeof(struct coverage_file));
+
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0) {
+        err(log_ctx, "Unable to open file %s: %s (%d)", filename,
+            strerror(errno), errno);
+        return OSD_ERROR_FILE;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        err(log_ctx, "Unable to stat file %s: %s (%d)", filename,
+            strerror(errno), errno);
+        close(fd);
+        return OSD_ERROR_FILE;
+    }
+    f->len = st.st_size;
+    if (f->len < FILE_HEADER_SIZE) {
+        err(log_ctx, "%s is not a coverage file (too small).", filename);
+        close(fd);
+        return OSD_ERROR_FILE;
+    }
+    void *data = mmap(NULL, f->len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        err(log_ctx, "Unable to map file %s: %s (%d)", filename,
+            strerror(errno), errno);
+        return OSD_ERROR_FILE;
+    }
+    f->data = data;
+
+    if (memcmp(f->data, file_magic, sizeof(file_magic)) != 0) {
+        err(log_ctx, "%s is not a coverage file (wrong magic).", filename);
+        coverage_file_close(f);
+        return OSD_ERROR_FILE;
+    }
+    uint16_t version = get_le16(f->data + 8);
+    if (version > OSD_COVERAGE_VERSION) {
+        err(log_ctx, "Coverage file %s has version %u, only versions up to %u "
+            "are supported.", filename, version, OSD_COVERAGE_VERSION);
+        coverage_file_close(f);
+        return OSD_ERROR_FILE;
+    }
+    uint16_t header_size = get_le16(f->data + 10);
+    f->num_symbols = get_le32(f->data + 12);
+    f->symtab_checksum = get_le32(f->data + 16);
+    f->runs = get_le32(f->data + 20);
+    if (header_size < FILE_HEADER_SIZE ||
+        f->len != header_size + file_data_size(f->num_symbols)) {
+        err(log_ctx, "Coverage file %s is truncated or corrupt.", filename);
+        coverage_file_close(f);
+        return OSD_ERROR_CORRUPT;
+    }
+    uint32_t crc = osd_crc32(0, f->data, 28);
+    crc = osd_crc32(crc, f->data + header_size, f->len - header_size);
+    if (crc != get_le32(f->data + 28)) {
+        err(log_ctx, "Checksum mismatch in coverage file %s.", filename);
+        coverage_file_close(f);
+        return OSD_ERROR_CORRUPT;
+    }
+
+    f->bitmap = f->data + header_size;
+    f->hits = f->bitmap + bitmap_words(f->num_symbols) * sizeof(uint64_t);
+
+    return OSD_OK;
+}
+
+API_EXPORT
+osd_result osd_coverage_new_from_file(struct osd_coverage_ctx **ctx,
+                                      struct osd_log_ctx *log_ctx,
+                                      const char *filename)
+{
+    osd_result rv;
+    struct coverage_file f;
+
+    assert(filename);
+
+    rv = coverage_file_open(log_ctx, filename, &f);
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
+
+    struct osd_coverage_ctx *c = calloc(1, sizeof(struct osd_coverage_ctx));
+    assert(c);
+
+    c->log_ctx = log_ctx;
+    c->num_symbols = f.num_symbols;
+    c->symtab_checksum = f.symtab_checksum;
+    c->runs = f.runs;
+    alloc_data(c);
+
+    for (size_t i = 0; i < c->bitmap_words; i++) {
+        c->bitmap[i] = get_le64(f.bitmap + i * sizeof(uint64_t));
+    }
+    for (size_t i = 0; i < c->num_symbols; i++) {
+        c->hits[i] = get_le32(f.hits + i * sizeof(uint32_t));
+    }
+
+    coverage_file_close(&f);
+
+    *ctx = c;
+
+    return OSD_OK;
+}
+
+API_EXPORT
+osd_result osd_coverage_merge_file(struct osd_coverage_ctx *ctx,
+                                   const char *filename)
+{
+    osd_result rv;
+    struct coverage_file f;
+
+    assert(ctx);
+    assert(filename);
+
+    rv = coverage_file_open(ctx->log_ctx, filename, &f);
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
+
+    if (f.num_symbols != ctx->num_symbols ||
+        f.symtab_checksum != ctx->symtab_checksum) {
+        err(ctx->log_ctx, "Coverage file %s was collected for a different "
+            "program.", filename);
+        coverage_file_close(&f);
+        return OSD_ERROR_FAILURE;
+    }
+
+    for (size_t i = 0; i < ctx->bitmap_words; i++) {
+        ctx->bitmap[i] |= get_le64(f.bitmap + i * sizeof(uint64_t));
+    }
+    for (size_t i = 0; i < ctx->num_symbols; i++) {
+        ctx->hits[i] = add_saturated(ctx->hits[i],
+                                     get_le32(f.hits + i * sizeof(uint32_t)));
+    }
+    ctx->runs = add_saturated(ctx->runs, f.runs);
+
+    coverage_file_close(&f);
+
+    return OSD_OK;
+}
@@ -0,0 +1,417 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <osd/flightrec.h>
+#include <osd/latency.h>
+#include "osd-private.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/**
+ * Magic bytes at the start of a binary dump (including the format version)
+ */
+static const char FLIGHTREC_MAGIC[8] = "OSDFR\0\0\1";
+
+/**
+ * A flight recorder record
+ *
+ * This structure is written as-is to the binary dump.
+ */
+struct flightrec_record {
+    uint64_t timestamp_ns;
+    uint16_t event;
+    uint16_t reserved;
+    uint32_t arg[3];
+};
+
+/**
+ * Header of a binary dump
+ */
+struct flightrec_dump_header {
+    char magic[8];
+    /** size of struct flightrec_record */
+    uint32_t record_size;
+    /** number of rings following the header */
+    uint32_t num_rings;
+    /** time of the dump (osd_latency_now()) */
+    uint64_t dump_time_ns;
+};
+
+/**
+ * Header of a ring in a binary dump, followed by num_records records (oldest
+ * first)
+ */
+struct flightrec_dump_ring_header {
+    uint32_t tid;
+    uint32_t num_records;
+};
+
+/**
+ * Ring buffer of the records of one thread
+ *
+ * Only the owning thread writes to a ring. Rings are never freed; the ring of
+ * a terminated thread is reused by the next thread starting to record.
+ */
+struct flightrec_ring {
+    struct flightrec_record records[OSD_FLIGHTREC_RING_SIZE];
+    /** number of records written (the next record index) */
+    uint64_t pos;
+    /** Linux thread ID of the owning thread */
+    uint32_t tid;
+    /** ring is owned by a thread */
+    int in_use;
+    /** next ring in the list of all rings */
+    struct flightrec_ring *next;
+};
+
+/** Rings of all threads, only ever prepended to */
+static struct flightrec_ring *rings;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/** Ring of the calling thread */
+static __thread struct flightrec_ring *thread_ring;
+
+/** Releases the ring of a terminating thread */
+static pthread_key_t thread_ring_key;
+static pthread_once_t thread_ring_key_once = PTHREAD_ONCE_INIT;
+
+static volatile bool flightrec_enabled = true;
+
+/** Dump file of the signal handlers */
+static char signal_dump_path[PATH_MAX];
+
+static void thread_ring_release(void *ring_void)
+{
+    struct flightrec_ring *ring = ring_void;
+    __atomic_store_n(&ring->in_use, 0, __ATOMIC_RELEASE);
+}
+
+static void thread_ring_key_create(void)
+{
+    int rv = pthread_key_create(&thread_ring_key, thread_ring_release);
+    assert(rv == 0);
+}
+
+/**
+ * Get a ring for the calling thread (slow path of osd_flightrec_record())
+ */
+static struct flightrec_ring *thread_ring_acquire(void)
+{
+    pthread_once(&thread_ring_key_once, thread_ring_key_create);
+
+    struct flightrec_ring *ring;
+    pthread_mutex_lock(&rings_lock);
+    for (ring = rings; ring; ring = ring->next) {
+        if (!__atomic_load_n(&ring->in_use, __ATOMIC_ACQUIRE)) {
+            break;
+        }
+    }
+    if (!ring) {
+        ring = calloc(1, sizeof(struct flightrec_ring));
+        assert(ring);
+        ring->next = rings;
+        __atomic_store_n(&rings, ring, __ATOMIC_RELEASE);
+    }
+    ring->in_use = 1;
+    __atomic_store_n(&ring->pos, 0, __ATOMIC_RELEASE);
+    ring->tid = syscall(SYS_gettid);
+    pthread_mutex_unlock(&rings_lock);
+
+    pthread_setspecific(thread_ring_key, ring);
+    thread_ring = ring;
+    return ring;
+}
+
+API_EXPORT
+void osd_flightrec_record(uint16_t event, uint32_t arg0, uint32_t arg1,
+                          uint32_t arg2)
+{
+    if (!flightrec_enabled) {
+        return;
+    }
+
+    struct flightrec_ring *ring = thread_ring;
+    if (!ring) {
+        ring = thread_ring_acquire();
+    }
+
+    uint64_t pos = ring->pos;
+    struct flightrec_record *rec =
+        &ring->records[pos % OSD_FLIGHTREC_RING_SIZE];
+    rec->timestamp_ns = osd_latency_now();
+    rec->event = event;
+    rec->arg[0] = arg0;
+    rec->arg[1] = arg1;
+    rec->arg[2] = arg2;
+    __atomic_store_n(&ring->pos, pos + 1, __ATOMIC_RELEASE);
+}
+
+API_EXPORT
+void osd_flightrec_set_enabled(bool enabled)
+{
+    flightrec_enabled = enabled;
+}
+
+/**
+ * write() all data, async-signal-safe
+ */
+static osd_result write_all(int fd, const void *buf, size_t len)
+{
+    const char *p = buf;
+    while (len > 0) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return OSD_ERROR_FAILURE;
+        }
+        p += n;
+        len -= n;
+    }
+    return OSD_OK;
+}
+
+API_EXPORT
+osd_result osd_flightrec_dump(int fd)
+{
+    osd_result rv;
+
+    // Rings are only prepended to the list: walking the list from a snapshot
+    // of its head always finds the same rings.
+    struct flightrec_ring *first = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+
+    struct flightrec_dump_header hdr;
+    memcpy(hdr.magic, FLIGHTREC_MAGIC, sizeof(hdr.magic));
+    hdr.record_size = sizeof(struct flightrec_record);
+    hdr.num_rings = 0;
+    for (struct flightrec_ring *ring = first; ring; ring = ring->next) {
+        hdr.num_rings++;
+    }
+    hdr.dump_time_ns = osd_latency_now();
+    rv = write_all(fd, &hdr, sizeof(hdr));
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
+
+    for (struct flightrec_ring *ring = first; ring; ring = ring->next) {
+        uint64_t pos = __atomic_load_n(&ring->pos, __ATOMIC_ACQUIRE);
+
+        struct flightrec_dump_ring_header ring_hdr;
+        ring_hdr.tid = ring->tid;
+        ring_hdr.num_records = pos < OSD_FLIGHTREC_RING_SIZE
+                                   ? pos : OSD_FLIGHTREC_RING_SIZE;
+        rv = write_all(fd, &ring_hdr, sizeof(ring_hdr));
+        if (OSD_FAILED(rv)) {
+            return rv;
+        }
+
+        // oldest records first: the part of the ring after the write
+        // position, followed by the part before it
+        size_t wrap = pos % OSD_FLIGHTREC_RING_SIZE;
+        if (pos > OSD_FLIGHTREC_RING_SIZE) {
+            rv = write_all(fd, &ring->records[wrap],
+                           (OSD_FLIGHTREC_RING_SIZE - wrap) *
+                               sizeof(struct flightrec_record));
+            if (OSD_FAILED(rv)) {
+                return rv;
+            }
+        } else if (pos == OSD_FLIGHTREC_RING_SIZE) {
+            wrap = OSD_FLIGHTREC_RING_SIZE;
+        }
+        rv = write_all(fd, ring->records,
+                       wrap * sizeof(struct flightrec_record));
+        if (OSD_FAILED(rv)) {
+            return rv;
+        }
+    }
+
+    return OSD_OK;
+}
+
+/**
+ * Description of an event for osd_flightrec_decode()
+ */
+struct flightrec_event_desc {
+    const char *name;
+    /** names of the arguments, NULL if unused */
+    const char *arg_names[3];
+};
+
+static const struct flightrec_event_desc *event_desc(uint16_t event)
+{
+    static const struct flightrec_event_desc descs[] = {
+        [OSD_FLIGHTREC_PKG_ROUTED] =
+            { "pkg-routed", { "src", "dest", "words" } },
+        [OSD_FLIGHTREC_PKG_DROPPED] =
+            { "pkg-dropped", { "src", "dest", "reason" } },
+        [OSD_FLIGHTREC_PKG_TO_DEVICE] =
+            { "pkg-to-device", { "src", "dest", "result" } },
+        [OSD_FLIGHTREC_EVENT_REASSEMBLED] =
+            { "event-reassembled", { "src", "fragments", "words" } },
+        [OSD_FLIGHTREC_EVENT_DELIVERED] =
+            { "event-delivered", { "count", NULL, NULL } },
+        [OSD_FLIGHTREC_RECEIVE_TIMEOUT] =
+            { "receive-timeout", { "flags", NULL, NULL } },
+    };
+
+    if (event >= sizeof(descs) / sizeof(descs[0]) || !descs[event].name) {
+        return NULL;
+    }
+    return &descs[event];
+}
+
+API_EXPORT
+const char* osd_flightrec_event_name(uint16_t event)
+{
+    const struct flightrec_event_desc *desc = event_desc(event);
+    return desc ? desc->name : NULL;
+}
+
+/**
+ * A record of a dump together with its thread
+ */
+struct decoded_record {
+    struct flightrec_record rec;
+    uint32_t tid;
+};
+
+static int decoded_record_cmp(const void *a_void, const void *b_void)
+{
+    const struct decoded_record *a = a_void;
+    const struct decoded_record *b = b_void;
+    if (a->rec.timestamp_ns < b->rec.timestamp_ns) {
+        return -1;
+    }
+    if (a->rec.timestamp_ns > b->rec.timestamp_ns) {
+        return 1;
+    }
+    return 0;
+}
+
+API_EXPORT
+osd_result osd_flightrec_decode(FILE *in, FILE *out)
+{
+    osd_result retval = OSD_OK;
+    struct decoded_record *recs = NULL;
+    size_t num_recs = 0;
+
+    struct flightrec_dump_header hdr;
+    if (fread(&hdr, sizeof(hdr), 1, in) != 1 ||
+        memcmp(hdr.magic, FLIGHTREC_MAGIC, sizeof(hdr.magic)) ||
+        hdr.record_size != sizeof(struct flightrec_record)) {
+        return OSD_ERROR_FAILURE;
+    }
+
+    for (uint32_t r = 0; r < hdr.num_rings; r++) {
+        struct flightrec_dump_ring_header ring_hdr;
+        if (fread(&ring_hdr, sizeof(ring_hdr), 1, in) != 1 ||
+            ring_hdr.num_records > OSD_FLIGHTREC_RING_SIZE) {
+            retval = OSD_ERROR_FAILURE;
+            goto free_return;
+        }
+
+        recs = realloc(recs, (num_recs + ring_hdr.num_records) *
+                                 sizeof(struct decoded_record) + 1);
+        assert(recs);
+        for (uint32_t i = 0; i < ring_hdr.num_records; i++) {
+            if (fread(&recs[num_recs].rec, sizeof(struct flightrec_record), 1,
+                      in) != 1) {
+                retval = OSD_ERROR_FAILURE;
+                goto free_return;
+            }
+            recs[num_recs].tid = ring_hdr.tid;
+            num_recs++;
+        }
+    }
+
+    qsort(recs, num_recs, sizeof(struct decoded_record), decoded_record_cmp);
+
+    // times are printed relative to the time of the dump
+    fprintf(out, "%zu records from %u threads\n", num_recs, hdr.num_rings);
+    for (size_t i = 0; i < num_recs; i++) {
+        const struct flightrec_record *rec = &recs[i].rec;
+        double t = ((double)rec->timestamp_ns - (double)hdr.dump_time_ns) / 1e9;
+        fprintf(out, "%+14.9f %6u ", t, recs[i].tid);
+
+        const struct flightrec_event_desc *desc = event_desc(rec->event);
+        if (desc) {
+            fprintf(out, "%-18s", desc->name);
+            for (int a = 0; a < 3; a++) {
+                if (desc->arg_names[a]) {
+                    fprintf(out, " %s=%u", desc->arg_names[a], rec->arg[a]);
+                }
+            }
+        } else {
+            fprintf(out, "event-0x%04x       %u %u %u", rec->event,
+                    rec->arg[0], rec->arg[1], rec->arg[2]);
+        }
+        fprintf(out, "\n");
+    }
+
+free_return:
+    free(recs);
+    return retval;
+}
+
+static void flightrec_signal_handler(int signum)
+{
+    int saved_errno = errno;
+
+    int fd = open(signal_dump_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0644);
+    if (fd >= 0) {
+        osd_flightrec_dump(fd);
+        close(fd);
+    }
+
+    // For SIGABRT the default action has been restored (SA_RESETHAND), and
+    // abort() raises the signal again after this handler returns.
+    errno = saved_errno;
+}
+
+API_EXPORT
+osd_result osd_flightrec_install_signal_handlers(const char *path)
+{
+    assert(path);
+
+    if (strlen(path) >= sizeof(signal_dump_path)) {
+        return OSD_ERROR_FAILURE;
+    }
+    strcpy(signal_dump_path, path);
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = flightrec_signal_handler;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    if (sigaction(SIGUSR1, &sa, NULL) != 0) {
+        return OSD_ERROR_FAILURE;
+    }
+
+    sa.sa_flags = SA_RESETHAND;
+    if (sigaction(SIGABRT, &sa, NULL) != 0) {
+        return OSD_ERROR_FAILURE;
+    }
+
+    return OSD_OK;
+}
@@ -59,10 +59,12 @@
  *   thread and shuts down the devicerxthread thread (if still running).
  */
 
+#include <osd/flightrec.h>
 #include <osd/gateway.h>
 #include <osd/osd.h>
 #include <osd/packet.h>
 #include "osd-private.h"
+#include "trace.h"
 #include "worker.h"
 
 #include <assert.h>
@@ -119,6 +121,9 @@ struct osd_gateway_ctx {
 
     /** Transfer statistics */
     struct osd_gateway_transfer_stats stats;
+
+    /** Attach host timestamps to packets read from the device */
+    volatile bool latency_tracing;
 };
 
 /**
@@ -221,6 +226,9 @@ static void *devicerxthread_main(void *gateway_ctx_void)
             }
         }
         assert(rcv_packet);
+        OSD_TRACE_GATEWAY_PKG_RX(osd_packet_get_src(rcv_packet),
+                                 osd_packet_get_dest(rcv_packet),
+                                 rcv_packet->data_size_words);
 
         zmsg_t *msg;
         msg = zmsg_new();
@@ -229,6 +237,12 @@ static void *devicerxthread_main(void *gateway_ctx_void)
         assert(zmq_rv == 0);
         zmq_rv = zmsg_addmem(msg, rcv_packet->data_raw,
                              osd_packet_sizeof(rcv_packet));
+        if (gateway_ctx->latency_tracing) {
+            zframe_t *stamp_frame = osd_hoststamp_frame_new();
+            osd_hoststamp_set(stamp_frame, OSD_HOSTSTAMP_GATEWAY_RX);
+            zmq_rv = zmsg_append(msg, &stamp_frame);
+            assert(zmq_rv == 0);
+        }
         zmsg_send(&msg, gateway_ctx->device_rx_socket);
 
         stats_add_pkg(&gateway_ctx->stats.bytes_from_device, rcv_packet);
@@ -275,6 +289,12 @@ static int hostiothread_rcv_from_hostctrl(zloop_t *loop, zsock_t *reader,
         rv = osd_packet_new_from_zframe(&pkg, data_frame);
         assert(OSD_SUCCEEDED(rv));
         osd_result device_write_rv = usrctx->packet_write(pkg, usrctx->cb_arg);
+        OSD_TRACE_GATEWAY_PKG_TX(osd_packet_get_src(pkg),
+                                 osd_packet_get_dest(pkg),
+                                 pkg->data_size_words, device_write_rv);
+        osd_flightrec_record(OSD_FLIGHTREC_PKG_TO_DEVICE,
+                             osd_packet_get_src(pkg), osd_packet_get_dest(pkg),
+                             device_write_rv);
 
         stats_add_pkg(&usrctx->stats->bytes_to_device, pkg);
 
@@ -833,3 +853,11 @@ osd_gateway_get_transfer_stats(struct osd_gateway_ctx *ctx)
 {
     return &ctx->stats;
 }
+
+API_EXPORT
+void osd_gateway_set_latency_tracing(struct osd_gateway_ctx *ctx,
+                                     bool enabled)
+{
+    assert(ctx);
+    ctx->latency_tracing = enabled;
+}
@@ -385,3 +385,9 @@ osd_gateway_glip_get_transfer_stats(struct osd_gateway_glip_ctx *ctx)
 {
     return osd_gateway_get_transfer_stats(ctx->gw_ctx);
 }
+
+void osd_gateway_glip_set_latency_tracing(struct osd_gateway_glip_ctx *ctx,
+                                          bool enabled)
+{
+    osd_gateway_set_latency_tracing(ctx->gw_ctx, enabled);
+}
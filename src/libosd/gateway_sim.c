@@ -0,0 +1,865 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Gateway to a simulated debug subnet
+ *
+ * Packets written to the device by the gateway are processed directly in
+ * packet_write_to_device() (called from the gateway's host I/O thread). All
+ * responses are put into a FIFO together with the time they are due, and
+ * handed to the gateway in packet_read_from_device() (called from the
+ * device RX thread) once this time has passed.
+ */
+
+#include <osd/gateway.h>
+#include <osd/gateway_sim.h>
+#include <osd/latency.h>
+#include <osd/module.h>
+#include <osd/reg.h>
+#include "osd-private.h"
+
+#include <assert.h>
+#include <czmq.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/** Size of a page of simulated MAM memory (in byte) */
+#define SIM_MEM_PAGE_SIZE 4096
+
+/** Largest register size (in 16 bit words) */
+#define SIM_REG_MAX_WORDS 8
+
+/** Value of the SYSTEM_VENDOR_ID and SYSTEM_DEVICE_ID registers of the SCM */
+#define SIM_SYSTEM_VENDOR_ID OSD_MODULE_VENDOR_OSD
+#define SIM_SYSTEM_DEVICE_ID 0
+
+/** Address and data width of the simulated CPU cores (in bit) */
+#define SIM_CORE_ADDR_WIDTH 32
+#define SIM_CORE_DATA_WIDTH 32
+
+/** Value width of the simulated STM (in bit) */
+#define SIM_STM_VALWIDTH 32
+
+/**
+ * State of a simulated MAM
+ */
+struct sim_mam {
+    /** Memory contents: pages of SIM_MEM_PAGE_SIZE bytes, by page number */
+    zhash_t *pages;
+
+    /** Transfer currently being received */
+    uint8_t *xfer;
+    /** Bytes of the transfer received so far */
+    size_t xfer_len;
+};
+
+/**
+ * A simulated debug module
+ */
+struct sim_module {
+    /** Module type (the vendor is always OSD_MODULE_VENDOR_OSD) */
+    uint16_t type;
+
+    /** Registers written by the host; register values by register address */
+    zhash_t *regs;
+
+    /** MAM state, only set if type is OSD_MODULE_TYPE_STD_MAM */
+    struct sim_mam *mam;
+};
+
+/**
+ * Response waiting to be returned to the host
+ */
+struct sim_resp {
+    /** Time (osd_latency_now()) at which the response is returned */
+    uint64_t due;
+    /** Response packet */
+    struct osd_packet *pkg;
+};
+
+/**
+ * Simulated gateway context
+ */
+struct osd_gateway_sim_ctx {
+    /** Logging context */
+    struct osd_log_ctx *log_ctx;
+
+    /** OSD gateway context object */
+    struct osd_gateway_ctx *gw_ctx;
+
+    /** Configuration of the subnet */
+    struct osd_gateway_sim_config config;
+
+    /** Subnet address of the simulated device */
+    uint16_t subnet_addr;
+
+    /** Simulated modules, indexed by local address */
+    struct sim_module *modules;
+    /** Number of entries in @p modules */
+    unsigned int num_modules;
+
+    /** Protects all following members */
+    pthread_mutex_t lock;
+    /** Signaled when a response is queued or the device is disconnected */
+    pthread_cond_t cond;
+
+    /** Is the simulated device connected? */
+    bool connected;
+
+    /** Responses in the order they are returned (struct sim_resp) */
+    zlist_t *responses;
+    /** Due time of the last queued response */
+    uint64_t last_due;
+
+    /** Random seed for the latency jitter */
+    unsigned int seed;
+};
+
+API_EXPORT
+void osd_gateway_sim_config_init(struct osd_gateway_sim_config *config)
+{
+    memset(config, 0, sizeof(struct osd_gateway_sim_config));
+    config->num_mam = 1;
+    config->num_dem_uart = 1;
+    config->num_stm = 1;
+    config->num_ctm = 1;
+    config->num_cdm = 1;
+    config->latency_ns = 0;
+    config->latency_jitter_ns = 0;
+    config->mam_addr_width_bit = 32;
+    config->mam_data_width_bit = 32;
+    config->mam_memsize = 128 * 1024 * 1024;
+}
+
+API_EXPORT
+osd_result osd_gateway_sim_config_parse(struct osd_gateway_sim_config *config,
+                                        const char *str)
+{
+    osd_result retval = OSD_OK;
+
+    char *s = strdup(str);
+    assert(s);
+
+    char *saveptr;
+    for (char *tok = strtok_r(s, ",", &saveptr); tok;
+         tok = strtok_r(NULL, ",", &saveptr)) {
+        char *value_str = strchr(tok, '=');
+        if (!value_str) {
+            retval = OSD_ERROR_FAILURE;
+            break;
+        }
+        *value_str++ = '\0';
+
+        char *end;
+        errno = 0;
+        unsigned long long value = strtoull(value_str, &end, 0);
+        if (errno || end == value_str || *end != '\0') {
+            retval = OSD_ERROR_FAILURE;
+            break;
+        }
+
+        if (!strcmp(tok, "mam")) {
+            config->num_mam = value;
+        } else if (!strcmp(tok, "dem_uart")) {
+            config->num_dem_uart = value;
+        } else if (!strcmp(tok, "stm")) {
+            config->num_stm = value;
+        } else if (!strcmp(tok, "ctm")) {
+            config->num_ctm = value;
+        } else if (!strcmp(tok, "cdm")) {
+            config->num_cdm = value;
+        } else if (!strcmp(tok, "latency")) {
+            config->latency_ns = value;
+        } else if (!strcmp(tok, "jitter")) {
+            config->latency_jitter_ns = value;
+        } else if (!strcmp(tok, "aw")) {
+            config->mam_addr_width_bit = value;
+        } else if (!strcmp(tok, "dw")) {
+            config->mam_data_width_bit = value;
+        } else if (!strcmp(tok, "memsize")) {
+            config->mam_memsize = value;
+        } else {
+            retval = OSD_ERROR_FAILURE;
+            break;
+        }
+    }
+
+    free(s);
+    return retval;
+}
+
+static osd_result check_config(struct osd_log_ctx *log_ctx,
+                               const struct osd_gateway_sim_config *config)
+{
+    uint64_t num_modules = 1 /* SCM */ + (uint64_t)config->num_mam +
+                           config->num_dem_uart + config->num_stm +
+                           config->num_ctm + config->num_cdm;
+    if (num_modules > OSD_DIADDR_LOCAL_MAX + 1) {
+        err(log_ctx, "A subnet can contain at most %u modules, not %" PRIu64,
+            OSD_DIADDR_LOCAL_MAX + 1, num_modules);
+        return OSD_ERROR_FAILURE;
+    }
+
+    unsigned int aw = config->mam_addr_width_bit;
+    unsigned int dw = config->mam_data_width_bit;
+    // transfers must consist of full 16 bit words, and the byte select mask
+    // (SELSIZE) limits the data width to 8 byte
+    if (aw == 0 || aw > 64 || aw % 16) {
+        err(log_ctx, "Invalid MAM address width %u.", aw);
+        return OSD_ERROR_FAILURE;
+    }
+    if (dw == 0 || dw > 64 || dw % 16) {
+        err(log_ctx, "Invalid MAM data width %u.", dw);
+        return OSD_ERROR_FAILURE;
+    }
+
+    return OSD_OK;
+}
+
+/**
+ * Get the due time of the next response
+ *
+ * Responses are returned in order, a response is never due before the
+ * previous one.
+ *
+ * Must be called with ctx->lock held.
+ */
+static uint64_t next_due(struct osd_gateway_sim_ctx *ctx)
+{
+    uint64_t latency = ctx->config.latency_ns;
+    if (ctx->config.latency_jitter_ns) {
+        uint64_t r = (uint64_t)rand_r(&ctx->seed) << 31 | rand_r(&ctx->seed);
+        latency += r % (ctx->config.latency_jitter_ns + 1);
+    }
+
+    uint64_t due = osd_latency_now() + latency;
+    if (due < ctx->last_due) {
+        due = ctx->last_due;
+    }
+    ctx->last_due = due;
+    return due;
+}
+
+/**
+ * Queue a response to the host
+ *
+ * Must be called with ctx->lock held.
+ */
+static void queue_response(struct osd_gateway_sim_ctx *ctx,
+                           struct osd_packet *pkg, uint64_t due)
+{
+    struct sim_resp *resp = malloc(sizeof(struct sim_resp));
+    assert(resp);
+    resp->due = due;
+    resp->pkg = pkg;
+    zlist_append(ctx->responses, resp);
+    pthread_cond_signal(&ctx->cond);
+}
+
+static void free_responses(struct osd_gateway_sim_ctx *ctx)
+{
+    struct sim_resp *resp;
+    while ((resp = zlist_pop(ctx->responses))) {
+        osd_packet_free(&resp->pkg);
+        free(resp);
+    }
+}
+
+static struct osd_packet *new_response(const struct osd_packet *req,
+                                       unsigned int type,
+                                       unsigned int type_sub,
+                                       unsigned int payload_words)
+{
+    osd_result rv;
+    struct osd_packet *pkg;
+
+    rv = osd_packet_new(&pkg, osd_packet_sizeconv_payload2data(payload_words));
+    assert(OSD_SUCCEEDED(rv));
+    osd_packet_set_header(pkg, osd_packet_get_src(req),
+                          osd_packet_get_dest(req), type, type_sub);
+    return pkg;
+}
+
+/**
+ * Get the value of a register which is defined by the module type
+ *
+ * @return true if the module has a register with this address
+ */
+static bool reg_value_default(struct osd_gateway_sim_ctx *ctx,
+                              const struct sim_module *mod, uint16_t reg_addr,
+                              uint16_t *value)
+{
+    switch (reg_addr) {
+    case OSD_REG_BASE_MOD_VENDOR:
+        *value = OSD_MODULE_VENDOR_OSD;
+        return true;
+    case OSD_REG_BASE_MOD_TYPE:
+        *value = mod->type;
+        return true;
+    case OSD_REG_BASE_MOD_VERSION:
+        *value = 0;
+        return true;
+    }
+
+    switch (mod->type) {
+    case OSD_MODULE_TYPE_STD_SCM:
+        switch (reg_addr) {
+        case OSD_REG_SCM_SYSTEM_VENDOR_ID:
+            *value = SIM_SYSTEM_VENDOR_ID;
+            return true;
+        case OSD_REG_SCM_SYSTEM_DEVICE_ID:
+            *value = SIM_SYSTEM_DEVICE_ID;
+            return true;
+        case OSD_REG_SCM_NUM_MOD:
+            *value = ctx->num_modules;
+            return true;
+        case OSD_REG_SCM_MAX_PKT_LEN:
+            *value = OSD_MAX_PKG_LEN_WORDS;
+            return true;
+        }
+        break;
+
+    case OSD_MODULE_TYPE_STD_MAM:
+        switch (reg_addr) {
+        case OSD_REG_MAM_AW:
+            *value = ctx->config.mam_addr_width_bit;
+            return true;
+        case OSD_REG_MAM_DW:
+            *value = ctx->config.mam_data_width_bit;
+            return true;
+        case OSD_REG_MAM_REGIONS:
+            *value = 1;
+            return true;
+        }
+        // a single region starting at address 0
+        for (unsigned int w = 0; w < 4; w++) {
+            if (reg_addr == OSD_REG_MAM_REGION_BASEADDR(0, w)) {
+                *value = 0;
+                return true;
+            }
+            if (reg_addr == OSD_REG_MAM_REGION_MEMSIZE(0, w)) {
+                *value = (ctx->config.mam_memsize >> (w * 16)) & 0xFFFF;
+                return true;
+            }
+        }
+        break;
+
+    case OSD_MODULE_TYPE_STD_STM:
+        if (reg_addr == OSD_REG_STM_VALWIDTH) {
+            *value = SIM_STM_VALWIDTH;
+            return true;
+        }
+        break;
+
+    case OSD_MODULE_TYPE_STD_CTM:
+        if (reg_addr == OSD_REG_CTM_ADDR_WIDTH) {
+            *value = SIM_CORE_ADDR_WIDTH;
+            return true;
+        } else if (reg_addr == OSD_REG_CTM_DATA_WIDTH) {
+            *value = SIM_CORE_DATA_WIDTH;
+            return true;
+        }
+        break;
+
+    case OSD_MODULE_TYPE_STD_CDM:
+        if (reg_addr == OSD_REG_CDM_CORE_DATA_WIDTH) {
+            *value = SIM_CORE_DATA_WIDTH;
+            return true;
+        }
+        break;
+    }
+
+    return false;
+}
+
+/**
+ * Process a register access request
+ *
+ * Registers written by the host are stored and read back, all other
+ * registers read as their default value or 0.
+ *
+ * Must be called with ctx->lock held.
+ */
+static void reg_access(struct osd_gateway_sim_ctx *ctx, struct sim_module *mod,
+                       const struct osd_packet *req)
+{
+    unsigned int type_sub = osd_packet_get_type_sub(req);
+    unsigned int payload_words =
+        osd_packet_sizeconv_data2payload(req->data_size_words);
+    unsigned int reg_size_words = 1 << (type_sub & 0x3);
+    bool is_write = (type_sub & ~0x3) == REQ_WRITE_REG_16;
+    bool is_read = (type_sub & ~0x3) == REQ_READ_REG_16;
+
+    struct osd_packet *resp;
+    uint64_t due = next_due(ctx);
+
+    if (is_read && payload_words == 1) {
+        uint16_t reg_addr = req->data.payload[0];
+        resp = new_response(req, OSD_PACKET_TYPE_REG,
+                            RESP_READ_REG_SUCCESS_16 | (type_sub & 0x3),
+                            reg_size_words);
+        memset(resp->data.payload, 0, reg_size_words * sizeof(uint16_t));
+
+        char key[8];
+        snprintf(key, sizeof(key), "%x", reg_addr);
+        uint16_t *stored = mod->regs ? zhash_lookup(mod->regs, key) : NULL;
+        if (stored) {
+            memcpy(resp->data.payload, stored,
+                   reg_size_words * sizeof(uint16_t));
+        } else {
+            reg_value_default(ctx, mod, reg_addr, &resp->data.payload[0]);
+        }
+    } else if (is_write && payload_words == 1 + reg_size_words) {
+        uint16_t reg_addr = req->data.payload[0];
+
+        if (!mod->regs) {
+            mod->regs = zhash_new();
+            assert(mod->regs);
+        }
+        uint16_t *stored = calloc(SIM_REG_MAX_WORDS, sizeof(uint16_t));
+        assert(stored);
+        memcpy(stored, &req->data.payload[1],
+               reg_size_words * sizeof(uint16_t));
+
+        char key[8];
+        snprintf(key, sizeof(key), "%x", reg_addr);
+        zhash_update(mod->regs, key, stored);
+        zhash_freefn(mod->regs, key, free);
+
+        resp = new_response(req, OSD_PACKET_TYPE_REG, RESP_WRITE_REG_SUCCESS,
+                            0);
+    } else {
+        dbg(ctx->log_ctx, "Invalid register access request (type_sub %u, "
+            "%u payload words).", type_sub, payload_words);
+        resp = new_response(req, OSD_PACKET_TYPE_REG,
+                            is_write ? RESP_WRITE_REG_ERROR
+                                     : RESP_READ_REG_ERROR,
+                            0);
+    }
+
+    queue_response(ctx, resp, due);
+}
+
+/**
+ * Get a page of MAM memory
+ *
+ * @param create allocate a zeroed page if it does not exist yet
+ * @return the page, or NULL if the page does not exist and @p create is false
+ */
+static uint8_t *mam_page(struct sim_mam *mam, uint64_t page_nr, bool create)
+{
+    char key[20];
+    snprintf(key, sizeof(key), "%" PRIx64, page_nr);
+
+    uint8_t *page = zhash_lookup(mam->pages, key);
+    if (!page && create) {
+        page = calloc(1, SIM_MEM_PAGE_SIZE);
+        assert(page);
+        zhash_insert(mam->pages, key, page);
+        zhash_freefn(mam->pages, key, free);
+    }
+    return page;
+}
+
+static void mam_mem_write(struct sim_mam *mam, uint64_t addr, uint8_t byte)
+{
+    uint8_t *page = mam_page(mam, addr / SIM_MEM_PAGE_SIZE, true);
+    page[addr % SIM_MEM_PAGE_SIZE] = byte;
+}
+
+static uint8_t mam_mem_read(struct sim_mam *mam, uint64_t addr)
+{
+    uint8_t *page = mam_page(mam, addr / SIM_MEM_PAGE_SIZE, false);
+    return page ? page[addr % SIM_MEM_PAGE_SIZE] : 0;
+}
+
+/**
+ * Execute a completely received MAM transfer
+ *
+ * Must be called with ctx->lock held.
+ */
+static void mam_execute(struct osd_gateway_sim_ctx *ctx, struct sim_mam *mam,
+                        const struct osd_packet *req)
+{
+    unsigned int aw_b = ctx->config.mam_addr_width_bit / 8;
+    unsigned int dw_b = ctx->config.mam_data_width_bit / 8;
+
+    uint8_t hdr0 = mam->xfer[0];
+    uint8_t selsize = mam->xfer[1];
+    bool we = hdr0 >> 7 & 1;
+    bool burst = hdr0 >> 6 & 1;
+    bool sync = hdr0 >> 5 & 1;
+
+    uint64_t addr = 0;
+    for (unsigned int i = 0; i < aw_b; i++) {
+        addr = addr << 8 | mam->xfer[2 + i];
+    }
+
+    size_t num_words = burst ? selsize : 1;
+
+    if (we) {
+        const uint8_t *data = &mam->xfer[2 + aw_b];
+        for (size_t b = 0; b < num_words * dw_b; b++) {
+            // single-word writes carry a byte select mask in SELSIZE
+            if (!burst && !(selsize & (1 << b))) {
+                continue;
+            }
+            mam_mem_write(mam, addr + b, data[b]);
+        }
+
+        if (sync) {
+            queue_response(ctx, new_response(req, OSD_PACKET_TYPE_EVENT,
+                                             EV_LAST, 0),
+                           next_due(ctx));
+        }
+        return;
+    }
+
+    uint64_t due = next_due(ctx);
+
+    // read: return the data in packets of the maximum size
+    unsigned int max_words =
+        osd_packet_sizeconv_data2payload(OSD_MAX_PKG_LEN_WORDS);
+    size_t nbyte = num_words * dw_b;
+    size_t pos = 0;
+    while (pos < nbyte) {
+        unsigned int pkg_words = (nbyte - pos) / sizeof(uint16_t);
+        if (pkg_words > max_words) {
+            pkg_words = max_words;
+        }
+        struct osd_packet *resp =
+            new_response(req, OSD_PACKET_TYPE_EVENT, EV_LAST, pkg_words);
+        for (unsigned int w = 0; w < pkg_words; w++) {
+            resp->data.payload[w] = mam_mem_read(mam, addr + pos) << 8 |
+                                    mam_mem_read(mam, addr + pos + 1);
+            pos += 2;
+        }
+        queue_response(ctx, resp, due);
+    }
+}
+
+/**
+ * Receive a part of a MAM transfer
+ *
+ * Must be called with ctx->lock held.
+ */
+static void mam_receive(struct osd_gateway_sim_ctx *ctx, struct sim_mam *mam,
+                        const struct osd_packet *req)
+{
+    unsigned int aw_b = ctx->config.mam_addr_width_bit / 8;
+    unsigned int dw_b = ctx->config.mam_data_width_bit / 8;
+
+    unsigned int payload_words =
+        osd_packet_sizeconv_data2payload(req->data_size_words);
+    for (unsigned int w = 0; w < payload_words; w++) {
+        mam->xfer[mam->xfer_len++] = req->data.payload[w] >> 8;
+        mam->xfer[mam->xfer_len++] = req->data.payload[w] & 0xFF;
+
+        if (mam->xfer_len < 2 + aw_b) {
+            continue;
+        }
+        bool we = mam->xfer[0] >> 7 & 1;
+        bool burst = mam->xfer[0] >> 6 & 1;
+        size_t data_bytes = we ? (burst ? mam->xfer[1] : 1) * dw_b : 0;
+        if (mam->xfer_len >= 2 + aw_b + data_bytes) {
+            mam_execute(ctx, mam, req);
+            mam->xfer_len = 0;
+        }
+    }
+}
+
+static osd_result packet_write_to_device(const struct osd_packet *pkg,
+                                         void *cb_arg)
+{
+    struct osd_gateway_sim_ctx *ctx = cb_arg;
+    assert(ctx);
+
+    unsigned int dest = osd_packet_get_dest(pkg);
+    unsigned int localaddr = osd_diaddr_localaddr(dest);
+    if (osd_diaddr_subnet(dest) != ctx->subnet_addr ||
+        localaddr >= ctx->num_modules) {
+        dbg(ctx->log_ctx, "Dropping packet to non-existing module %u.", dest);
+        return OSD_OK;
+    }
+
+    pthread_mutex_lock(&ctx->lock);
+    if (!ctx->connected) {
+        pthread_mutex_unlock(&ctx->lock);
+        return OSD_ERROR_NOT_CONNECTED;
+    }
+
+    struct sim_module *mod = &ctx->modules[localaddr];
+    switch (osd_packet_get_type(pkg)) {
+    case OSD_PACKET_TYPE_REG:
+        reg_access(ctx, mod, pkg);
+        break;
+    case OSD_PACKET_TYPE_EVENT:
+        // events to all other modules (e.g. DEM-UART input) are discarded
+        if (mod->mam) {
+            mam_receive(ctx, mod->mam, pkg);
+        }
+        break;
+    default:
+        break;
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    return OSD_OK;
+}
+
+static osd_result packet_read_from_device(struct osd_packet **pkg, void *cb_arg)
+{
+    struct osd_gateway_sim_ctx *ctx = cb_arg;
+    assert(ctx);
+
+    pthread_mutex_lock(&ctx->lock);
+    while (1) {
+        if (!ctx->connected) {
+            pthread_mutex_unlock(&ctx->lock);
+            return OSD_ERROR_NOT_CONNECTED;
+        }
+
+        struct sim_resp *resp = zlist_first(ctx->responses);
+        if (!resp) {
+            pthread_cond_wait(&ctx->cond, &ctx->lock);
+            continue;
+        }
+
+        if (resp->due <= osd_latency_now()) {
+            zlist_pop(ctx->responses);
+            *pkg = resp->pkg;
+            free(resp);
+            break;
+        }
+
+        struct timespec ts = {
+            .tv_sec = resp->due / 1000000000,
+            .tv_nsec = resp->due % 1000000000,
+        };
+        pthread_cond_timedwait(&ctx->cond, &ctx->lock, &ts);
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    return OSD_OK;
+}
+
+static void free_modules(struct osd_gateway_sim_ctx *ctx)
+{
+    for (unsigned int i = 0; i < ctx->num_modules; i++) {
+        struct sim_module *mod = &ctx->modules[i];
+        zhash_destroy(&mod->regs);
+        if (mod->mam) {
+            zhash_destroy(&mod->mam->pages);
+            free(mod->mam->xfer);
+            free(mod->mam);
+        }
+    }
+    free(ctx->modules);
+}
+
+static void create_modules(struct osd_gateway_sim_ctx *ctx)
+{
+    const struct osd_gateway_sim_config *cfg = &ctx->config;
+    const struct {
+        uint16_t type;
+        unsigned int num;
+    } blocks[] = {
+        { OSD_MODULE_TYPE_STD_SCM, 1 },
+        { OSD_MODULE_TYPE_STD_MAM, cfg->num_mam },
+        { OSD_MODULE_TYPE_STD_DEM_UART, cfg->num_dem_uart },
+        { OSD_MODULE_TYPE_STD_STM, cfg->num_stm },
+        { OSD_MODULE_TYPE_STD_CTM, cfg->num_ctm },
+        { OSD_MODULE_TYPE_STD_CDM, cfg->num_cdm },
+    };
+
+    ctx->num_modules = 0;
+    for (size_t b = 0; b < sizeof(blocks) / sizeof(blocks[0]); b++) {
+        ctx->num_modules += blocks[b].num;
+    }
+    ctx->modules = calloc(ctx->num_modules, sizeof(struct sim_module));
+    assert(ctx->modules);
+
+    // largest transfer: header, address and a burst of 255 words
+    size_t max_xfer_len = 2 + cfg->mam_addr_width_bit / 8 +
+                          255 * cfg->mam_data_width_bit / 8;
+
+    unsigned int localaddr = 0;
+    for (size_t b = 0; b < sizeof(blocks) / sizeof(blocks[0]); b++) {
+        for (unsigned int i = 0; i < blocks[b].num; i++) {
+            struct sim_module *mod = &ctx->modules[localaddr++];
+            mod->type = blocks[b].type;
+            if (mod->type != OSD_MODULE_TYPE_STD_MAM) {
+                continue;
+            }
+            mod->mam = calloc(1, sizeof(struct sim_mam));
+            assert(mod->mam);
+            mod->mam->pages = zhash_new();
+            assert(mod->mam->pages);
+            mod->mam->xfer = malloc(max_xfer_len);
+            assert(mod->mam->xfer);
+        }
+    }
+}
+
+API_EXPORT
+osd_result osd_gateway_sim_new(struct osd_gateway_sim_ctx **ctx,
+                               struct osd_log_ctx *log_ctx,
+                               const char *host_controller_address,
+                               uint16_t device_subnet_addr,
+                               const struct osd_gateway_sim_config *config)
+{
+    osd_result rv;
+
+    rv = check_config(log_ctx, config);
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
+
+    struct osd_gateway_sim_ctx *c =
+        calloc(1, sizeof(struct osd_gateway_sim_ctx));
+    assert(c);
+
+    c->log_ctx = log_ctx;
+    c->config = *config;
+    c->subnet_addr = device_subnet_addr;
+    c->seed = 1;
+
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_condattr_t condattr;
+    pthread_condattr_init(&condattr);
+    pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&c->cond, &condattr);
+    pthread_condattr_destroy(&condattr);
+
+    c->responses = zlist_new();
+    assert(c->responses);
+
+    create_modules(c);
+    dbg(log_ctx, "Simulating subnet %u with %u modules.", device_subnet_addr,
+        c->num_modules);
+
+    rv = osd_gateway_new(&c->gw_ctx, log_ctx, host_controller_address,
+                         device_subnet_addr, packet_read_from_device,
+                         packet_write_to_device, (void *)c);
+    if (OSD_FAILED(rv)) {
+        osd_gateway_sim_free(&c);
+        return rv;
+    }
+    assert(c->gw_ctx);
+
+    *ctx = c;
+
+    return OSD_OK;
+}
+
+API_EXPORT
+osd_result osd_gateway_sim_connect(struct osd_gateway_sim_ctx *ctx)
+{
+    osd_result rv;
+
+    pthread_mutex_lock(&ctx->lock);
+    ctx->connected = true;
+    pthread_mutex_unlock(&ctx->lock);
+
+    rv = osd_gateway_connect(ctx->gw_ctx);
+    if (OSD_FAILED(rv)) {
+        err(ctx->log_ctx, "Unable to connect to host controller (%d).", rv);
+        pthread_mutex_lock(&ctx->lock);
+        ctx->connected = false;
+        pthread_mutex_unlock(&ctx->lock);
+        return rv;
+    }
+
+    return OSD_OK;
+}
+
+API_EXPORT
+osd_result osd_gateway_sim_disconnect(struct osd_gateway_sim_ctx *ctx)
+{
+    osd_result rv;
+
+    // end the device RX thread of the gateway
+    pthread_mutex_lock(&ctx->lock);
+    ctx->connected = false;
+    pthread_cond_broadcast(&ctx->cond);
+    pthread_mutex_unlock(&ctx->lock);
+
+    rv = osd_gateway_disconnect(ctx->gw_ctx);
+
+    pthread_mutex_lock(&ctx->lock);
+    free_responses(ctx);
+    ctx->last_due = 0;
+    pthread_mutex_unlock(&ctx->lock);
+
+    if (OSD_FAILED(rv)) {
+        err(ctx->log_ctx, "Unable to disconnect from host controller (%d)", rv);
+        return rv;
+    }
+
+    return OSD_OK;
+}
+
+API_EXPORT
+void osd_gateway_sim_free(struct osd_gateway_sim_ctx **ctx_p)
+{
+    assert(ctx_p);
+    struct osd_gateway_sim_ctx *ctx = *ctx_p;
+    if (!ctx) {
+        return;
+    }
+
+    osd_gateway_free(&ctx->gw_ctx);
+
+    free_responses(ctx);
+    zlist_destroy(&ctx->responses);
+    free_modules(ctx);
+
+    pthread_cond_destroy(&ctx->cond);
+    pthread_mutex_destroy(&ctx->lock);
+
+    free(ctx);
+    *ctx_p = NULL;
+}
+
+API_EXPORT
+bool osd_gateway_sim_is_connected(struct osd_gateway_sim_ctx *ctx)
+{
+    return osd_gateway_is_connected(ctx->gw_ctx);
+}
+
+API_EXPORT
+unsigned int osd_gateway_sim_get_num_modules(struct osd_gateway_sim_ctx *ctx)
+{
+    return ctx->num_modules;
+}
+
+API_EXPORT
+struct osd_gateway_transfer_stats*
+osd_gateway_sim_get_transfer_stats(struct osd_gateway_sim_ctx *ctx)
+{
+    return osd_gateway_get_transfer_stats(ctx->gw_ctx);
+}
+
+API_EXPORT
+void osd_gateway_sim_set_latency_tracing(struct osd_gateway_sim_ctx *ctx,
+                                         bool enabled)
+{
+    osd_gateway_set_latency_tracing(ctx->gw_ctx, enabled);
+}
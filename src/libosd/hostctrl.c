@@ -13,10 +13,12 @@
  * limitations under the License.
  */
 
+#include <osd/flightrec.h>
 #include <osd/hostctrl.h>
 #include <osd/osd.h>
 #include <osd/packet.h>
 #include "osd-private.h"
+#include "trace.h"
 #include "worker.h"
 
 #include <assert.h>
@@ -316,14 +318,18 @@ static void process_mgmt_msg(struct worker_thread_ctx *thread_ctx,
  * Route a DI data message to its destination
  *
  * This function gains ownership of the passed zframe_t arguments and is
- * expected to destroy and NULL them.
+ * expected to destroy and NULL them. The host timestamp frame is optional
+ * (*stamp_frame_p may be NULL); if present, it is forwarded together with the
+ * packet.
  */
 static void process_data_msg(struct worker_thread_ctx *thread_ctx,
-                             zframe_t **src_p, zframe_t **payload_frame_p)
+                             zframe_t **src_p, zframe_t **payload_frame_p,
+                             zframe_t **stamp_frame_p)
 {
     assert(thread_ctx);
     assert(src_p);
     assert(payload_frame_p);
+    assert(stamp_frame_p);
 
     zframe_t *src = *src_p;
     assert(src);
@@ -339,6 +345,9 @@ static void process_data_msg(struct worker_thread_ctx *thread_ctx,
     rv = osd_packet_new_from_zframe(&pkg, payload_frame);
     if (OSD_FAILED(rv)) {
         err(thread_ctx->log_ctx, "Dropping invalid data packet (%d)", rv);
+        OSD_TRACE_HOSTCTRL_ROUTE(0, 0, OSD_FLIGHTREC_DROP_INVALID);
+        osd_flightrec_record(OSD_FLIGHTREC_PKG_DROPPED, 0, 0,
+                             OSD_FLIGHTREC_DROP_INVALID);
         goto free_return;
     }
 
@@ -359,6 +368,12 @@ static void process_data_msg(struct worker_thread_ctx *thread_ctx,
             err(thread_ctx->log_ctx,
                 "No destination module registered for DI address %u.%u",
                 dest_diaddr_subnet, dest_diaddr_local);
+            OSD_TRACE_HOSTCTRL_ROUTE(osd_packet_get_src(pkg),
+                                     osd_packet_get_dest(pkg), OSD_FLIGHTREC_DROP_NO_MODULE);
+            osd_flightrec_record(OSD_FLIGHTREC_PKG_DROPPED,
+                                 osd_packet_get_src(pkg),
+                                 osd_packet_get_dest(pkg),
+                                 OSD_FLIGHTREC_DROP_NO_MODULE);
             goto free_return;
         }
         dbg(thread_ctx->log_ctx,
@@ -374,6 +389,12 @@ static void process_data_msg(struct worker_thread_ctx *thread_ctx,
                 dest_diaddr_subnet, dest_diaddr_subnet, dest_diaddr_local,
                 src_str);
             free(src_str);
+            OSD_TRACE_HOSTCTRL_ROUTE(osd_packet_get_src(pkg),
+                                     osd_packet_get_dest(pkg), OSD_FLIGHTREC_DROP_NO_GATEWAY);
+            osd_flightrec_record(OSD_FLIGHTREC_PKG_DROPPED,
+                                 osd_packet_get_src(pkg),
+                                 osd_packet_get_dest(pkg),
+                                 OSD_FLIGHTREC_DROP_NO_GATEWAY);
             goto free_return;
         }
         dbg(thread_ctx->log_ctx,
@@ -395,14 +416,25 @@ static void process_data_msg(struct worker_thread_ctx *thread_ctx,
     assert(zmq_rv == 0);
     zmq_rv = zmsg_addstr(msg, "D");
     assert(zmq_rv == 0);
-    zmsg_append(msg, payload_frame_p);
+    zmq_rv = zmsg_append(msg, payload_frame_p);
     assert(zmq_rv == 0);
+    if (*stamp_frame_p) {
+        osd_hoststamp_set(*stamp_frame_p, OSD_HOSTSTAMP_HOSTCTRL);
+        zmq_rv = zmsg_append(msg, stamp_frame_p);
+        assert(zmq_rv == 0);
+    }
     zmq_rv = zmsg_send(&msg, usrctx->router_socket);
     assert(zmq_rv == 0);
 
+    OSD_TRACE_HOSTCTRL_ROUTE(osd_packet_get_src(pkg), osd_packet_get_dest(pkg),
+                             0);
+    osd_flightrec_record(OSD_FLIGHTREC_PKG_ROUTED, osd_packet_get_src(pkg),
+                         osd_packet_get_dest(pkg), pkg->data_size_words);
+
 free_return:
     zframe_destroy(src_p);
     zframe_destroy(payload_frame_p);
+    zframe_destroy(stamp_frame_p);
     osd_packet_free(&pkg);
 }
 
@@ -436,8 +468,11 @@ static int iothread_handle_ext_msg(zloop_t *loop, zsock_t *reader,
         zframe_destroy(&payload_frame);
     } else if (type_str[0] == 'D') {
         zframe_t *payload_frame = zmsg_pop(msg);
-        process_data_msg(thread_ctx, &src_frame, &payload_frame);
+        zframe_t *stamp_frame = zmsg_pop(msg);
+        process_data_msg(thread_ctx, &src_frame, &payload_frame,
+                         &stamp_frame);
         zframe_destroy(&payload_frame);
+        zframe_destroy(&stamp_frame);
     } else {
         err(thread_ctx->log_ctx, "Ignoring message of unknown type '%s'.",
             type_str);
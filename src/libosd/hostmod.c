@@ -13,13 +13,16 @@
  * limitations under the License.
  */
 
+#include <osd/flightrec.h>
 #include <osd/hostmod.h>
+#include <osd/latency.h>
 #include <osd/osd.h>
 #include <osd/packet.h>
 #include <osd/reg.h>
 #include <osd/module.h>
 
 #include "osd-private.h"
+#include "trace.h"
 #include "worker.h"
 
 #include <assert.h>
@@ -41,6 +44,60 @@ struct osd_hostmod_ctx {
 
     /** I/O worker */
     struct worker_ctx *ioworker_ctx;
+
+    /** Latency histograms of received packets */
+    struct osd_latency_stats latency_stats;
+
+    /** Lock protecting latency_stats (updated from both threads) */
+    pthread_mutex_t latency_lock;
+
+    /** Busy-poll budget of the calling thread when waiting for a packet (us) */
+    unsigned int busy_poll_caller_us;
+
+    /** Busy-poll budget of the I/O thread after handling a packet (us) */
+    volatile unsigned int busy_poll_iothread_us;
+
+    /** Batch event handler (see osd_hostmod_set_event_batch_handler()) */
+    osd_hostmod_event_batch_handler_fn event_batch_handler;
+
+    /**
+     * User context of the I/O thread. Only to be used from within the I/O
+     * thread (i.e. from file descriptor handlers).
+     */
+    struct iothread_usr_ctx *iothread_usr;
+
+    /**
+     * Register accesses started with osd_hostmod_reg_access_async() waiting
+     * for their response (struct async_reg_access), oldest first
+     */
+    zlist_t *async_reg_accesses;
+};
+
+/**
+ * An asynchronous register access in flight
+ *
+ * @see osd_hostmod_reg_access_async()
+ */
+struct async_reg_access {
+    struct osd_hostmod_reg_access *acc;
+    osd_hostmod_reg_access_cb_fn cb;
+    void *cb_arg;
+};
+
+/**
+ * A file descriptor watched by the I/O thread
+ *
+ * @see osd_hostmod_add_fd_handler()
+ */
+struct iothread_fd_handler {
+    /** zloop poll item of the file descriptor */
+    zmq_pollitem_t pollitem;
+
+    /** Handler function */
+    osd_hostmod_fd_handler_fn handler;
+
+    /** Argument passed to handler */
+    void *arg;
 };
 
 /**
@@ -61,8 +118,96 @@ struct iothread_usr_ctx {
 
     /** Event re-assembly buffer (used to recombine split transactions) */
     zlist_t *event_reassembly_buf;
+
+    /** Latency histograms (osd_hostmod_ctx.latency_stats) */
+    struct osd_latency_stats *latency_stats;
+
+    /** Lock protecting latency_stats */
+    pthread_mutex_t *latency_lock;
+
+    /** Busy-poll budget (osd_hostmod_ctx.busy_poll_iothread_us) */
+    volatile unsigned int *busy_poll_us;
+
+    /** Batch event handler (osd_hostmod_ctx.event_batch_handler) */
+    osd_hostmod_event_batch_handler_fn *event_batch_handler;
+
+    /** Event packets collected for the batch event handler */
+    struct osd_packet *event_batch[OSD_HOSTMOD_EVENT_BATCH_MAX];
+
+    /** Number of packets in event_batch */
+    size_t event_batch_len;
+
+    /** Watched file descriptors (struct iothread_fd_handler) */
+    zlist_t *fd_handlers;
 };
 
+/**
+ * Spin until a message is ready to be received on one of the sockets
+ *
+ * The sockets are polled without sleeping to avoid the wake-up latency of a
+ * blocking receive.
+ *
+ * @param socks sockets to poll
+ * @param socks_len number of sockets in @p socks
+ * @param spin_us maximum time to spin (in us)
+ * @return true if a message is ready on one of the sockets, false if the
+ *         spin budget is used up
+ */
+static bool busy_poll(zsock_t **socks, size_t socks_len, unsigned int spin_us)
+{
+    uint64_t deadline = osd_latency_now() + (uint64_t)spin_us * 1000;
+    do {
+        for (size_t i = 0; i < socks_len; i++) {
+            if (zsock_events(socks[i]) & ZMQ_POLLIN) {
+                return true;
+            }
+        }
+    } while (osd_latency_now() < deadline);
+
+    return false;
+}
+
+/**
+ * Wait for the next message in the I/O thread by busy-polling
+ *
+ * Called after a data packet has been handled: the next message (the response
+ * to a forwarded request or the next request from the main thread) usually
+ * follows shortly. Spinning until it is ready lets the zloop pick it up
+ * without going to sleep.
+ */
+static void iothread_busy_poll(struct worker_thread_ctx *thread_ctx)
+{
+    struct iothread_usr_ctx *usrctx = thread_ctx->usr;
+
+    unsigned int spin_us = *usrctx->busy_poll_us;
+    if (spin_us == 0 || !usrctx->hostctrl_socket) {
+        return;
+    }
+
+    zsock_t *socks[] = { usrctx->hostctrl_socket, thread_ctx->inproc_socket };
+    busy_poll(socks, 2, spin_us);
+}
+
+/**
+ * Record the delivery of a packet in the latency histograms
+ *
+ * @param stamp_frame host timestamp frame of the packet. May be NULL if the
+ *                    packet carries no timestamps.
+ */
+static void record_latency(struct osd_latency_stats *stats,
+                           pthread_mutex_t *lock, zframe_t *stamp_frame)
+{
+    if (!stamp_frame) {
+        return;
+    }
+
+    osd_hoststamp_set(stamp_frame, OSD_HOSTSTAMP_DELIVERY);
+
+    pthread_mutex_lock(lock);
+    osd_latency_stats_add_hoststamps(stats, stamp_frame);
+    pthread_mutex_unlock(lock);
+}
+
 /**
  * Handle an EVENT packet received from the host controller
  *
@@ -72,10 +217,14 @@ struct iothread_usr_ctx {
  *
  * @param usrctx the user context in the I/O thread
  * @param pkg the packet to be handled, ownership is passed to this function
+ * @param stamp_frame host timestamps of the packet (can be NULL). The frame
+ *                    is only used (and not destroyed) if a packet is
+ *                    forwarded to the event handler.
  * @return a packet to be sent to the main thread (can be NULL)
  */
 static struct osd_packet* iothread_handle_in_eventpkg(struct iothread_usr_ctx *usrctx,
-                                                      struct osd_packet *pkg)
+                                                      struct osd_packet *pkg,
+                                                      zframe_t *stamp_frame)
 {
     int rv;
     osd_result osd_rv;
@@ -99,6 +248,7 @@ static struct osd_packet* iothread_handle_in_eventpkg(struct iothread_usr_ctx *u
     } else {
         // reassemble one packet out of the multiple EVENT packets in the
         // reassembly buffer
+        unsigned int num_fragments = 1;
         struct osd_packet *pkg_inbuf;
         pkg_inbuf = zlist_first(usrctx->event_reassembly_buf);
         while (pkg_inbuf) {
@@ -122,6 +272,7 @@ static struct osd_packet* iothread_handle_in_eventpkg(struct iothread_usr_ctx *u
                 osd_packet_free(&pkg_inbuf);
             }
 
+            num_fragments++;
             zlist_remove(usrctx->event_reassembly_buf, pkg_inbuf);
             pkg_inbuf = zlist_next(usrctx->event_reassembly_buf);
         }
@@ -138,10 +289,32 @@ static struct osd_packet* iothread_handle_in_eventpkg(struct iothread_usr_ctx *u
             assert(OSD_SUCCEEDED(osd_rv));
             osd_packet_free(&pkg);
         }
+
+        osd_flightrec_record(OSD_FLIGHTREC_EVENT_REASSEMBLED,
+                             osd_packet_get_src(fwd_pkg), num_fragments,
+                             fwd_pkg->data_size_words);
     }
 
 
+    if (*usrctx->event_batch_handler) {
+        record_latency(usrctx->latency_stats, usrctx->latency_lock,
+                       stamp_frame);
+
+        // Collect the packet, the batch is passed to the handler by
+        // iothread_flush_event_batch()
+        assert(usrctx->event_batch_len < OSD_HOSTMOD_EVENT_BATCH_MAX);
+        usrctx->event_batch[usrctx->event_batch_len++] = fwd_pkg;
+        return NULL;
+    }
+
     if (usrctx->event_handler) {
+        // The latency of a split transaction is the one of its last packet
+        record_latency(usrctx->latency_stats, usrctx->latency_lock,
+                       stamp_frame);
+
+        OSD_TRACE_HOSTMOD_EVENT_DELIVER(osd_packet_get_dest(fwd_pkg), 1);
+        osd_flightrec_record(OSD_FLIGHTREC_EVENT_DELIVERED, 1, 0, 0);
+
         // Forward EVENT packets to handler function.
         // Ownership of |pkg| is transferred to the event handler.
         osd_rv = usrctx->event_handler(usrctx->event_handler_arg, fwd_pkg);
@@ -172,27 +345,40 @@ static zmsg_t* iothread_handle_in_data_msg(struct iothread_usr_ctx *usrctx,
     zframe_t *data_frame = zmsg_next(msg);
     assert(data_frame);
 
+    // optional host timestamps
+    zframe_t *stamp_frame = zmsg_next(msg);
+    osd_hoststamp_set(stamp_frame, OSD_HOSTSTAMP_HOSTMOD_RX);
+
     struct osd_packet *pkg;
     osd_rv = osd_packet_new_from_zframe(&pkg, data_frame);
     assert(OSD_SUCCEEDED(osd_rv));
 
     if (osd_packet_get_type(pkg) == OSD_PACKET_TYPE_EVENT) {
+        if (stamp_frame) {
+            zmsg_remove(msg, stamp_frame);
+        }
         zmsg_destroy(&msg);
 
-        struct osd_packet *fwd_pkg = iothread_handle_in_eventpkg(usrctx, pkg);
+        struct osd_packet *fwd_pkg =
+            iothread_handle_in_eventpkg(usrctx, pkg, stamp_frame);
+        zmsg_t *fwd_msg = NULL;
         if (fwd_pkg) {
             // Create new message to forward packet to main thread
-            zmsg_t *fwd_msg = zmsg_new();
+            fwd_msg = zmsg_new();
             rv = zmsg_addstr(fwd_msg, "D");
             assert(rv == 0);
             rv = zmsg_addmem(fwd_msg, fwd_pkg->data_raw,
                              osd_packet_sizeof(fwd_pkg));
             assert(rv == 0);
+            if (stamp_frame) {
+                rv = zmsg_append(fwd_msg, &stamp_frame);
+                assert(rv == 0);
+            }
 
             osd_packet_free(&fwd_pkg);
-            return fwd_msg;
         }
-        return NULL;
+        zframe_destroy(&stamp_frame);
+        return fwd_msg;
     }
 
     osd_packet_free(&pkg);
@@ -201,9 +387,39 @@ static zmsg_t* iothread_handle_in_data_msg(struct iothread_usr_ctx *usrctx,
     return msg;
 }
 
+/**
+ * Pass the collected event packets to the batch event handler
+ */
+static void iothread_flush_event_batch(struct iothread_usr_ctx *usrctx)
+{
+    osd_result osd_rv;
+
+    if (usrctx->event_batch_len == 0) {
+        return;
+    }
+
+    OSD_TRACE_HOSTMOD_EVENT_DELIVER(osd_packet_get_dest(usrctx->event_batch[0]),
+                                    usrctx->event_batch_len);
+    osd_flightrec_record(OSD_FLIGHTREC_EVENT_DELIVERED,
+                         usrctx->event_batch_len, 0, 0);
+
+    // Ownership of the packets is transferred to the event handler.
+    osd_rv = (*usrctx->event_batch_handler)(usrctx->event_handler_arg,
+                                            usrctx->event_batch,
+                                            usrctx->event_batch_len);
+    if (OSD_FAILED(osd_rv)) {
+        // ignore (error in user logic, packets are possibly dropped)
+    }
+    usrctx->event_batch_len = 0;
+}
+
 /**
  * Process incoming messages from the host controller
  *
+ * If a batch event handler is set, all messages which are ready to be
+ * received are processed before the collected event packets are passed to
+ * the handler.
+ *
  * @return 0 if the message was processed, -1 if @p loop should be terminated
  */
 static int iothread_rcv_from_hostctrl(zloop_t *loop, zsock_t *reader,
@@ -223,24 +439,37 @@ static int iothread_rcv_from_hostctrl(zloop_t *loop, zsock_t *reader,
         return -1;  // process was interrupted, terminate zloop
     }
 
-    zframe_t *type_frame = zmsg_first(msg);
-    assert(type_frame);
-    if (zframe_streq(type_frame, "D")) {
-        zmsg_t *out_msg = iothread_handle_in_data_msg(usrctx, msg);
+    while (msg) {
+        zframe_t *type_frame = zmsg_first(msg);
+        assert(type_frame);
+        if (zframe_streq(type_frame, "D")) {
+            zmsg_t *out_msg = iothread_handle_in_data_msg(usrctx, msg);
 
-        // possibly send a message to the main thread
-        if (out_msg) {
-            rv = zmsg_send(&out_msg, thread_ctx->inproc_socket);
-            assert(rv == 0);
-        }
+            // possibly send a message to the main thread
+            if (out_msg) {
+                rv = zmsg_send(&out_msg, thread_ctx->inproc_socket);
+                assert(rv == 0);
+            }
 
-    } else if (zframe_streq(type_frame, "M")) {
-        assert(0 && "TODO: Handle incoming management messages.");
+        } else if (zframe_streq(type_frame, "M")) {
+            assert(0 && "TODO: Handle incoming management messages.");
 
-    } else {
-        assert(0 && "Message of unknown type received.");
+        } else {
+            assert(0 && "Message of unknown type received.");
+        }
+
+        msg = NULL;
+        if (*usrctx->event_batch_handler &&
+            usrctx->event_batch_len < OSD_HOSTMOD_EVENT_BATCH_MAX &&
+            (zsock_events(reader) & ZMQ_POLLIN)) {
+            msg = zmsg_recv(reader);
+        }
     }
 
+    iothread_flush_event_batch(usrctx);
+
+    iothread_busy_poll(thread_ctx);
+
     return 0;
 }
 
@@ -378,6 +607,126 @@ static void iothread_disconnect_from_hostctrl(
     worker_send_status(thread_ctx->inproc_socket, "I-DISCONNECT-DONE", retval);
 }
 
+/**
+ * Forward a batch of data packets to the host controller
+ *
+ * The packets are sent as one message per packet.
+ *
+ * @param usrctx the user context in the I/O thread
+ * @param msg a "DB" message: the type frame followed by one frame per packet.
+ *            The message is emptied, but not destroyed.
+ */
+static void iothread_send_batch_to_hostctrl(struct iothread_usr_ctx *usrctx,
+                                            zmsg_t *msg)
+{
+    int rv;
+
+    zframe_t *pkg_frame = zmsg_pop(msg);
+    zframe_destroy(&pkg_frame); // type frame
+    while ((pkg_frame = zmsg_pop(msg))) {
+        zmsg_t *pkg_msg = zmsg_new();
+        assert(pkg_msg);
+        rv = zmsg_addstr(pkg_msg, "D");
+        assert(rv == 0);
+        rv = zmsg_append(pkg_msg, &pkg_frame);
+        assert(rv == 0);
+        rv = zmsg_send(&pkg_msg, usrctx->hostctrl_socket);
+        assert(rv == 0);
+    }
+}
+
+/**
+ * Request to watch a file descriptor ("I-FD-ADD" message)
+ */
+struct iothread_fd_add_req {
+    int fd;
+    osd_hostmod_fd_handler_fn handler;
+    void *arg;
+};
+
+/**
+ * A watched file descriptor is ready for reading
+ */
+static int iothread_fd_ready(zloop_t *loop, zmq_pollitem_t *item,
+                             void *fd_handler_void)
+{
+    struct iothread_fd_handler *fd_handler = fd_handler_void;
+    osd_result rv;
+
+    rv = fd_handler->handler(fd_handler->arg, item->fd);
+    if (OSD_FAILED(rv)) {
+        // ignore (error in user logic)
+    }
+
+    return 0;
+}
+
+static void iothread_add_fd_handler(struct worker_thread_ctx *thread_ctx,
+                                    zmsg_t *msg)
+{
+    struct iothread_usr_ctx *usrctx = thread_ctx->usr;
+    int rv;
+
+    zmsg_first(msg);
+    zframe_t *req_frame = zmsg_next(msg);
+    assert(req_frame);
+    assert(zframe_size(req_frame) == sizeof(struct iothread_fd_add_req));
+    struct iothread_fd_add_req *req =
+        (struct iothread_fd_add_req *)zframe_data(req_frame);
+
+    struct iothread_fd_handler *fd_handler =
+        calloc(1, sizeof(struct iothread_fd_handler));
+    assert(fd_handler);
+    fd_handler->pollitem.fd = req->fd;
+    fd_handler->pollitem.events = ZMQ_POLLIN;
+    fd_handler->handler = req->handler;
+    fd_handler->arg = req->arg;
+
+    rv = zloop_poller(thread_ctx->zloop, &fd_handler->pollitem,
+                      iothread_fd_ready, fd_handler);
+    if (rv != 0) {
+        err(thread_ctx->log_ctx, "Unable to watch file descriptor %d",
+            req->fd);
+        free(fd_handler);
+        worker_send_status(thread_ctx->inproc_socket, "I-FD-ADD-DONE",
+                           OSD_ERROR_FAILURE);
+        return;
+    }
+
+    rv = zlist_append(usrctx->fd_handlers, fd_handler);
+    assert(rv == 0);
+
+    worker_send_status(thread_ctx->inproc_socket, "I-FD-ADD-DONE", OSD_OK);
+}
+
+static void iothread_remove_fd_handler(struct worker_thread_ctx *thread_ctx,
+                                       zmsg_t *msg)
+{
+    struct iothread_usr_ctx *usrctx = thread_ctx->usr;
+
+    zmsg_first(msg);
+    zframe_t *fd_frame = zmsg_next(msg);
+    assert(fd_frame);
+    assert(zframe_size(fd_frame) == sizeof(int));
+    int fd = *(int *)zframe_data(fd_frame);
+
+    struct iothread_fd_handler *fd_handler = zlist_first(usrctx->fd_handlers);
+    while (fd_handler && fd_handler->pollitem.fd != fd) {
+        fd_handler = zlist_next(usrctx->fd_handlers);
+    }
+    if (!fd_handler) {
+        worker_send_status(thread_ctx->inproc_socket, "I-FD-REMOVE-DONE",
+                           OSD_ERROR_FAILURE);
+        return;
+    }
+
+    zloop_poller_end(thread_ctx->zloop, &fd_handler->pollitem);
+    zlist_remove(usrctx->fd_handlers, fd_handler);
+    free(fd_handler);
+
+    worker_send_status(thread_ctx->inproc_socket, "I-FD-REMOVE-DONE", OSD_OK);
+}
+
 static osd_result iothread_handle_inproc_request(
     struct worker_thread_ctx *thread_ctx, const char *name, zmsg_t *msg)
 {
@@ -397,6 +746,17 @@ static osd_result iothread_handle_inproc_request(
         rv = zmsg_send(&msg, usrctx->hostctrl_socket);
         assert(rv == 0);
 
+        iothread_busy_poll(thread_ctx);
+
+    } else if (!strcmp(name, "DB")) {
+        iothread_send_batch_to_hostctrl(usrctx, msg);
+
+    } else if (!strcmp(name, "I-FD-ADD")) {
+        iothread_add_fd_handler(thread_ctx, msg);
+
+    } else if (!strcmp(name, "I-FD-REMOVE")) {
+        iothread_remove_fd_handler(thread_ctx, msg);
+
     } else {
         assert(0 && "Received unknown message from main thread.");
     }
@@ -413,6 +773,14 @@ static osd_result iothread_destroy(struct worker_thread_ctx *thread_ctx)
     assert(usrctx);
 
     zlist_destroy(&usrctx->event_reassembly_buf);
+
+    struct iothread_fd_handler *fd_handler;
+    while ((fd_handler = zlist_pop(usrctx->fd_handlers))) {
+        zloop_poller_end(thread_ctx->zloop, &fd_handler->pollitem);
+        free(fd_handler);
+    }
+    zlist_destroy(&usrctx->fd_handlers);
+
     free(usrctx->host_controller_address);
     free(usrctx);
     thread_ctx->usr = NULL;
@@ -466,12 +834,19 @@ static osd_result osd_hostmod_receive_packet(struct osd_hostmod_ctx *ctx,
     // block register read indefinitely until response has been received
     bool do_block = (flags & OSD_HOSTMOD_BLOCKING);
 
+    // low-latency mode: avoid a thread wake-up if the packet arrives soon
+    if (ctx->busy_poll_caller_us) {
+        busy_poll(&ctx->ioworker_ctx->inproc_socket, 1,
+                  ctx->busy_poll_caller_us);
+    }
+
     errno = 0;
     zmsg_t *msg;
     do {
         msg = zmsg_recv(ctx->ioworker_ctx->inproc_socket);
     } while (!msg && errno == EAGAIN && do_block);
     if (!msg && errno == EAGAIN) {
+        osd_flightrec_record(OSD_FLIGHTREC_RECEIVE_TIMEOUT, flags, 0, 0);
         return OSD_ERROR_TIMEDOUT;
     }
     if (!msg) {
@@ -494,6 +869,12 @@ static osd_result osd_hostmod_receive_packet(struct osd_hostmod_ctx *ctx,
     assert(OSD_SUCCEEDED(osd_rv));
 
     zframe_destroy(&data_frame);
+
+    // optional host timestamps
+    zframe_t *stamp_frame = zmsg_pop(msg);
+    record_latency(&ctx->latency_stats, &ctx->latency_lock, stamp_frame);
+    zframe_destroy(&stamp_frame);
+
     zmsg_destroy(&msg);
 
     *packet = p;
@@ -515,6 +896,7 @@ osd_result osd_hostmod_new(struct osd_hostmod_ctx **ctx,
 
     c->log_ctx = log_ctx;
     c->is_connected = false;
+    pthread_mutex_init(&c->latency_lock, NULL);
 
     // prepare custom data passed to I/O thread
     struct iothread_usr_ctx *iothread_usr_data =
@@ -526,6 +908,16 @@ osd_result osd_hostmod_new(struct osd_hostmod_ctx **ctx,
     iothread_usr_data->host_controller_address =
         strdup(host_controller_address);
     iothread_usr_data->event_reassembly_buf = zlist_new();
+    iothread_usr_data->fd_handlers = zlist_new();
+    assert(iothread_usr_data->fd_handlers);
+    iothread_usr_data->latency_stats = &c->latency_stats;
+    iothread_usr_data->latency_lock = &c->latency_lock;
+    iothread_usr_data->busy_poll_us = &c->busy_poll_iothread_us;
+    iothread_usr_data->event_batch_handler = &c->event_batch_handler;
+    c->iothread_usr = iothread_usr_data;
+
+    c->async_reg_accesses = zlist_new();
+    assert(c->async_reg_accesses);
 
     rv = worker_new(&c->ioworker_ctx, log_ctx, NULL, iothread_destroy,
                     iothread_handle_inproc_request, iothread_usr_data);
@@ -601,6 +993,16 @@ osd_result osd_hostmod_disconnect(struct osd_hostmod_ctx *ctx)
 
     ctx->is_connected = false;
 
+    // no responses can arrive any more
+    struct async_reg_access *a;
+    while ((a = zlist_pop(ctx->async_reg_accesses))) {
+        a->acc->result = OSD_ERROR_ABORTED;
+        OSD_TRACE_HOSTMOD_REG_DONE(a->acc->diaddr, a->acc->reg_addr,
+                                   a->acc->result);
+        a->cb(a->cb_arg, a->acc);
+        free(a);
+    }
+
     return OSD_OK;
 }
 
@@ -617,6 +1019,11 @@ void osd_hostmod_free(struct osd_hostmod_ctx **ctx_p)
 
     worker_free(&ctx->ioworker_ctx);
 
+    assert(zlist_size(ctx->async_reg_accesses) == 0);
+    zlist_destroy(&ctx->async_reg_accesses);
+
+    pthread_mutex_destroy(&ctx->latency_lock);
+
     free(ctx);
     *ctx_p = NULL;
 }
@@ -659,6 +1066,7 @@ static osd_result osd_hostmod_regaccess(
         retval = rv;
         goto err_free_req;
     }
+    OSD_TRACE_HOSTMOD_REG_REQ(module_addr, reg_addr, subtype_req);
 
     // wait for response
     struct osd_packet *pkg_resp;
@@ -699,6 +1107,7 @@ err_free_resp:
 err_free_req:
     free(pkg_req);
 
+    OSD_TRACE_HOSTMOD_REG_DONE(module_addr, reg_addr, retval);
     return retval;
 }
 
@@ -808,6 +1217,225 @@ err_free_resp:
     return retval;
 }
 
+/**
+ * Maximum number of register accesses of a batch waiting for a response
+ *
+ * Limits the number of requests queued up in the debug interconnect.
+ */
+#define REG_BATCH_MAX_INFLIGHT 32
+
+/**
+ * Create the request packet for a register access of a batch
+ */
+static osd_result reg_batch_request_new(struct osd_hostmod_ctx *ctx,
+                                        const struct osd_hostmod_reg_access *acc,
+                                        struct osd_packet **pkg_req)
+{
+    osd_result rv;
+
+    unsigned int wr_data_len_words = acc->write ? acc->reg_size_bit / 16 : 0;
+    rv = osd_packet_new(pkg_req,
+                        osd_packet_sizeconv_payload2data(1 + wr_data_len_words));
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
+
+    enum osd_packet_type_reg_subtype subtype_req =
+        acc->write ? get_subtype_reg_write_req(acc->reg_size_bit)
+                   : get_subtype_reg_read_req(acc->reg_size_bit);
+    osd_packet_set_header(*pkg_req, acc->diaddr, ctx->diaddr,
+                          OSD_PACKET_TYPE_REG, subtype_req);
+    (*pkg_req)->data.payload[0] = acc->reg_addr;
+    if (acc->write) {
+        memcpy(&(*pkg_req)->data.payload[1], acc->reg_val,
+               wr_data_len_words * sizeof(uint16_t));
+    }
+
+    return OSD_OK;
+}
+
+/**
+ * Check the response to a register access of a batch and store read data
+ */
+static osd_result reg_batch_handle_response(struct osd_hostmod_ctx *ctx,
+                                            struct osd_hostmod_reg_access *acc,
+                                            const struct osd_packet *pkg_resp)
+{
+    unsigned int subtype = osd_packet_get_type_sub(pkg_resp);
+    if (subtype == RESP_READ_REG_ERROR || subtype == RESP_WRITE_REG_ERROR) {
+        err(ctx->log_ctx, "Got error response when accessing register %u of "
+            "module %d", acc->reg_addr, acc->diaddr);
+        return OSD_ERROR_DEVICE_ERROR;
+    }
+
+    unsigned int subtype_exp =
+        acc->write ? RESP_WRITE_REG_SUCCESS
+                   : get_subtype_reg_read_success_resp(acc->reg_size_bit);
+    unsigned int payload_words_exp = acc->write ? 0 : acc->reg_size_bit / 16;
+    if (subtype != subtype_exp) {
+        err(ctx->log_ctx, "Expected register response of subtype %d, got %d",
+            subtype_exp, subtype);
+        return OSD_ERROR_DEVICE_INVALID_DATA;
+    }
+    if (pkg_resp->data_size_words !=
+        osd_packet_sizeconv_payload2data(payload_words_exp)) {
+        err(ctx->log_ctx, "Expected %u payload words in register access "
+            "response, got a packet with %u data words.", payload_words_exp,
+            pkg_resp->data_size_words);
+        return OSD_ERROR_DEVICE_INVALID_DATA;
+    }
+
+    if (!acc->write) {
+        memcpy(acc->reg_val, pkg_resp->data.payload, acc->reg_size_bit / 8);
+    }
+
+    return OSD_OK;
+}
+
+API_EXPORT
+osd_result osd_hostmod_reg_access_start(
+    struct osd_hostmod_ctx *ctx, const struct osd_hostmod_reg_access *acc)
+{
+    osd_result rv;
+
+    assert(ctx);
+    assert(acc);
+    assert(acc->reg_size_bit % 16 == 0 && acc->reg_size_bit <= 128);
+
+    if (!ctx->is_connected) {
+        return OSD_ERROR_NOT_CONNECTED;
+    }
+
+    struct osd_packet *pkg_req;
+    rv = reg_batch_request_new(ctx, acc, &pkg_req);
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
+    OSD_TRACE_HOSTMOD_REG_REQ(acc->diaddr, acc->reg_addr,
+                              osd_packet_get_type_sub(pkg_req));
+    rv = osd_hostmod_send_packet(ctx, pkg_req);
+    osd_packet_free(&pkg_req);
+
+    return rv;
+}
+
+API_EXPORT
+osd_result osd_hostmod_reg_access_finish(struct osd_hostmod_ctx *ctx,
+                                         struct osd_hostmod_reg_access *acc,
+                                         const struct osd_packet *response)
+{
+    assert(ctx);
+    assert(acc);
+    assert(response);
+
+    if (osd_packet_get_type(response) != OSD_PACKET_TYPE_REG) {
+        err(ctx->log_ctx, "Expected a register access response from module "
+            "%u, got a packet of type %u.", acc->diaddr,
+            osd_packet_get_type(response));
+        acc->result = OSD_ERROR_DEVICE_INVALID_DATA;
+    } else {
+        acc->result = reg_batch_handle_response(ctx, acc, response);
+    }
+    OSD_TRACE_HOSTMOD_REG_DONE(acc->diaddr, acc->reg_addr, acc->result);
+
+    return acc->result;
+}
+
+API_EXPORT
+osd_result osd_hostmod_reg_access_batch(struct osd_hostmod_ctx *ctx,
+                                        struct osd_hostmod_reg_access *accesses,
+                                        size_t num_accesses, int flags)
+{
+    assert(ctx);
+    if (!ctx->is_connected) {
+        return OSD_ERROR_NOT_CONNECTED;
+    }
+
+    if (num_accesses == 0) {
+        return OSD_OK;
+    }
+
+    osd_result rv;
+    osd_result retval = OSD_OK;
+
+    // completion state of all accesses
+    bool *done = calloc(num_accesses, sizeof(bool));
+    assert(done);
+
+    size_t next_send = 0; // next access to send a request for
+    size_t oldest = 0; // oldest access without response
+    size_t inflight = 0;
+
+    while (oldest < num_accesses) {
+        // fill the request window
+        while (next_send < num_accesses &&
+               inflight < REG_BATCH_MAX_INFLIGHT) {
+            struct osd_hostmod_reg_access *acc = &accesses[next_send];
+            rv = osd_hostmod_reg_access_start(ctx, acc);
+            if (OSD_FAILED(rv)) {
+                acc->result = rv;
+                done[next_send] = true;
+                OSD_TRACE_HOSTMOD_REG_DONE(acc->diaddr, acc->reg_addr, rv);
+            } else {
+                inflight++;
+            }
+            next_send++;
+        }
+
+        if (inflight > 0) {
+            struct osd_packet *pkg_resp;
+            rv = osd_hostmod_receive_packet(ctx, &pkg_resp, flags);
+            if (OSD_FAILED(rv)) {
+                // give up on all outstanding accesses
+                for (size_t i = oldest; i < next_send; i++) {
+                    if (!done[i]) {
+                        accesses[i].result = rv;
+                        done[i] = true;
+                        OSD_TRACE_HOSTMOD_REG_DONE(accesses[i].diaddr,
+                                                   accesses[i].reg_addr, rv);
+                    }
+                }
+                for (size_t i = next_send; i < num_accesses; i++) {
+                    accesses[i].result = rv;
+                }
+                retval = rv;
+                break;
+            }
+
+            // Modules answer requests in order: the response belongs to the
+            // oldest outstanding access to the module it came from.
+            unsigned int src = osd_packet_get_src(pkg_resp);
+            size_t i;
+            for (i = oldest; i < next_send; i++) {
+                if (!done[i] && accesses[i].diaddr == src) {
+                    break;
+                }
+            }
+            if (i == next_send ||
+                osd_packet_get_type(pkg_resp) != OSD_PACKET_TYPE_REG) {
+                err(ctx->log_ctx, "Dropping unexpected packet from module %u "
+                    "during register accesses.", src);
+            } else {
+                osd_hostmod_reg_access_finish(ctx, &accesses[i], pkg_resp);
+                done[i] = true;
+                inflight--;
+            }
+            osd_packet_free(&pkg_resp);
+        }
+
+        while (oldest < num_accesses && done[oldest]) {
+            if (OSD_FAILED(accesses[oldest].result) &&
+                OSD_SUCCEEDED(retval)) {
+                retval = accesses[oldest].result;
+            }
+            oldest++;
+        }
+    }
+
+    free(done);
+    return retval;
+}
+
 API_EXPORT
 osd_result osd_hostmod_reg_setbit(struct osd_hostmod_ctx *hostmod_ctx,
                                   unsigned int bitnum, bool bitval,
@@ -845,7 +1473,52 @@ osd_result osd_hostmod_event_send(struct osd_hostmod_ctx *ctx,
         return OSD_ERROR_NOT_CONNECTED;
     }
 
-    return osd_hostmod_send_packet(ctx, event_pkg);
+    return osd_hostmod_event_send_batch(ctx, &event_pkg, 1);
+}
+
+API_EXPORT
+osd_result osd_hostmod_event_send_batch(
+    struct osd_hostmod_ctx *ctx, const struct osd_packet *const *event_pkgs,
+    size_t num_pkgs)
+{
+    assert(ctx);
+    assert(event_pkgs || num_pkgs == 0);
+
+    int rv;
+
+    if (!osd_hostmod_is_connected(ctx)) {
+        return OSD_ERROR_NOT_CONNECTED;
+    }
+    if (num_pkgs == 0) {
+        return OSD_OK;
+    }
+
+    zmsg_t *msg = zmsg_new();
+    assert(msg);
+    rv = zmsg_addstr(msg, "DB");
+    assert(rv == 0);
+    for (size_t i = 0; i < num_pkgs; i++) {
+        assert(osd_packet_get_type(event_pkgs[i]) == OSD_PACKET_TYPE_EVENT);
+        rv = zmsg_addmem(msg, event_pkgs[i]->data_raw,
+                         osd_packet_sizeof(event_pkgs[i]));
+        assert(rv == 0);
+    }
+
+    // Called from a file descriptor handler in the I/O thread: the inproc
+    // socket belongs to the main thread, send to the host controller directly
+    if (pthread_equal(pthread_self(), ctx->ioworker_ctx->thread)) {
+        iothread_send_batch_to_hostctrl(ctx->iothread_usr, msg);
+        zmsg_destroy(&msg);
+        return OSD_OK;
+    }
+
+    rv = zmsg_send(&msg, ctx->ioworker_ctx->inproc_socket);
+    if (rv != 0) {
+        zmsg_destroy(&msg);
+        return OSD_ERROR_COM;
+    }
+
+    return OSD_OK;
 }
 
 osd_result osd_hostmod_event_receive(struct osd_hostmod_ctx *ctx,
@@ -875,6 +1548,159 @@ osd_result osd_hostmod_event_receive(struct osd_hostmod_ctx *ctx,
     return osd_hostmod_receive_packet(ctx, event_pkg, flags);
 }
 
+API_EXPORT
+osd_result osd_hostmod_event_receive_batch(struct osd_hostmod_ctx *ctx,
+                                           struct osd_packet **event_pkgs,
+                                           size_t max_pkgs, size_t *num_pkgs,
+                                           int flags)
+{
+    osd_result rv;
+
+    assert(ctx);
+    assert(event_pkgs);
+    assert(num_pkgs);
+    assert(max_pkgs > 0);
+
+    *num_pkgs = 0;
+
+    // wait for the first packet as osd_hostmod_event_receive() does
+    rv = osd_hostmod_receive_packet(ctx, &event_pkgs[0], flags);
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
+    *num_pkgs = 1;
+
+    // take all further packets which are already waiting
+    while (*num_pkgs < max_pkgs &&
+           (zsock_events(ctx->ioworker_ctx->inproc_socket) & ZMQ_POLLIN)) {
+        rv = osd_hostmod_receive_packet(ctx, &event_pkgs[*num_pkgs], flags);
+        if (OSD_FAILED(rv)) {
+            break;
+        }
+        (*num_pkgs)++;
+    }
+
+    return OSD_OK;
+}
+
+API_EXPORT
+int osd_hostmod_get_pollfd(struct osd_hostmod_ctx *ctx)
+{
+    assert(ctx);
+    assert(ctx->ioworker_ctx);
+
+    return zsock_fd(ctx->ioworker_ctx->inproc_socket);
+}
+
+API_EXPORT
+osd_result osd_hostmod_try_receive(struct osd_hostmod_ctx *ctx,
+                                   struct osd_packet **packet)
+{
+    assert(ctx);
+    assert(packet);
+
+    *packet = NULL;
+    if (!ctx->is_connected) {
+        return OSD_ERROR_NOT_CONNECTED;
+    }
+
+    // Reading ZMQ_EVENTS also resets the state of the pollfd
+    if (!(zsock_events(ctx->ioworker_ctx->inproc_socket) & ZMQ_POLLIN)) {
+        return OSD_OK;
+    }
+    return osd_hostmod_receive_packet(ctx, packet, 0);
+}
+
+API_EXPORT
+osd_result osd_hostmod_reg_access_async(struct osd_hostmod_ctx *ctx,
+                                        struct osd_hostmod_reg_access *acc,
+                                        osd_hostmod_reg_access_cb_fn cb,
+                                        void *cb_arg)
+{
+    osd_result rv;
+
+    assert(ctx);
+    assert(cb);
+
+    rv = osd_hostmod_reg_access_start(ctx, acc);
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
+
+    struct async_reg_access *a = calloc(1, sizeof(struct async_reg_access));
+    assert(a);
+    a->acc = acc;
+    a->cb = cb;
+    a->cb_arg = cb_arg;
+    int zrv = zlist_append(ctx->async_reg_accesses, a);
+    assert(zrv == 0);
+
+    return OSD_OK;
+}
+
+/**
+ * Complete the oldest asynchronous register access to the module which sent
+ * a register access response
+ */
+static void async_reg_access_complete(struct osd_hostmod_ctx *ctx,
+                                      const struct osd_packet *pkg_resp)
+{
+    // Modules answer requests in order: the response belongs to the oldest
+    // outstanding access to the module it came from.
+    unsigned int src = osd_packet_get_src(pkg_resp);
+    struct async_reg_access *a = zlist_first(ctx->async_reg_accesses);
+    while (a && a->acc->diaddr != src) {
+        a = zlist_next(ctx->async_reg_accesses);
+    }
+    if (!a) {
+        err(ctx->log_ctx, "Dropping unexpected register access response from "
+            "module %u.", src);
+        return;
+    }
+    zlist_remove(ctx->async_reg_accesses, a);
+
+    osd_hostmod_reg_access_finish(ctx, a->acc, pkg_resp);
+    a->cb(a->cb_arg, a->acc);
+    free(a);
+}
+
+API_EXPORT
+osd_result osd_hostmod_process(struct osd_hostmod_ctx *ctx,
+                               osd_hostmod_event_handler_fn event_handler,
+                               void *event_handler_arg)
+{
+    osd_result rv;
+
+    assert(ctx);
+
+    // The pollfd only signals changes: all waiting packets must be received.
+    while (1) {
+        struct osd_packet *pkg;
+        rv = osd_hostmod_try_receive(ctx, &pkg);
+        if (OSD_FAILED(rv)) {
+            return rv;
+        }
+        if (!pkg) {
+            return OSD_OK;
+        }
+
+        if (osd_packet_get_type(pkg) == OSD_PACKET_TYPE_REG) {
+            async_reg_access_complete(ctx, pkg);
+            osd_packet_free(&pkg);
+        } else if (event_handler) {
+            // Ownership of |pkg| is transferred to the event handler.
+            rv = event_handler(event_handler_arg, pkg);
+            if (OSD_FAILED(rv)) {
+                // ignore (error in user logic, packet is possibly dropped)
+            }
+        } else {
+            dbg(ctx->log_ctx, "Dropping event packet from module %u, no "
+                "event handler given.", osd_packet_get_src(pkg));
+            osd_packet_free(&pkg);
+        }
+    }
+}
+
 osd_result osd_hostmod_get_modules(struct osd_hostmod_ctx *ctx,
                                    unsigned int subnet_addr,
                                    struct osd_module_desc **modules,
@@ -979,6 +1805,96 @@ osd_result osd_hostmod_mod_set_event_active(struct osd_hostmod_ctx *ctx,
 }
 
 
+API_EXPORT
+void osd_hostmod_get_latency_stats(struct osd_hostmod_ctx *ctx,
+                                   struct osd_latency_stats *stats)
+{
+    assert(ctx);
+    assert(stats);
+
+    pthread_mutex_lock(&ctx->latency_lock);
+    *stats = ctx->latency_stats;
+    pthread_mutex_unlock(&ctx->latency_lock);
+}
+
+API_EXPORT
+void osd_hostmod_reset_latency_stats(struct osd_hostmod_ctx *ctx)
+{
+    assert(ctx);
+
+    pthread_mutex_lock(&ctx->latency_lock);
+    osd_latency_stats_reset(&ctx->latency_stats);
+    pthread_mutex_unlock(&ctx->latency_lock);
+}
+
+API_EXPORT
+void osd_hostmod_set_busy_poll(struct osd_hostmod_ctx *ctx,
+                               unsigned int caller_spin_us,
+                               unsigned int iothread_spin_us)
+{
+    assert(ctx);
+
+    ctx->busy_poll_caller_us = caller_spin_us;
+    ctx->busy_poll_iothread_us = iothread_spin_us;
+}
+
+API_EXPORT
+void osd_hostmod_set_event_batch_handler(
+    struct osd_hostmod_ctx *ctx,
+    osd_hostmod_event_batch_handler_fn event_batch_handler)
+{
+    assert(ctx);
+    assert(!ctx->is_connected);
+
+    ctx->event_batch_handler = event_batch_handler;
+}
+
+API_EXPORT
+osd_result osd_hostmod_add_fd_handler(struct osd_hostmod_ctx *ctx, int fd,
+                                      osd_hostmod_fd_handler_fn handler,
+                                      void *arg)
+{
+    assert(ctx);
+    assert(fd >= 0);
+    assert(handler);
+    assert(!pthread_equal(pthread_self(), ctx->ioworker_ctx->thread));
+
+    osd_result rv;
+    int retval;
+
+    struct iothread_fd_add_req req = {
+        .fd = fd, .handler = handler, .arg = arg,
+    };
+    worker_send_data(ctx->ioworker_ctx->inproc_socket, "I-FD-ADD", &req,
+                     sizeof(req));
+    rv = worker_wait_for_status(ctx->ioworker_ctx->inproc_socket,
+                                "I-FD-ADD-DONE", &retval);
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
+
+    return retval;
+}
+
+API_EXPORT
+osd_result osd_hostmod_remove_fd_handler(struct osd_hostmod_ctx *ctx, int fd)
+{
+    assert(ctx);
+    assert(!pthread_equal(pthread_self(), ctx->ioworker_ctx->thread));
+
+    osd_result rv;
+    int retval;
+
+    worker_send_status(ctx->ioworker_ctx->inproc_socket, "I-FD-REMOVE", fd);
+    rv = worker_wait_for_status(ctx->ioworker_ctx->inproc_socket,
+                                "I-FD-REMOVE-DONE", &retval);
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
+
+    return retval;
+}
+
 API_EXPORT
 struct osd_log_ctx* osd_hostmod_log_ctx(struct osd_hostmod_ctx *ctx)
 {
@@ -0,0 +1,249 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OSD_CAPTURE_H
+#define OSD_CAPTURE_H
+
+#include <osd/latency.h>
+#include <osd/osd.h>
+#include <osd/packet.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup libosd-capture Packet Capture
+ * @ingroup libosd
+ *
+ * Store packets in a portable capture file and read them back.
+ *
+ * A capture file starts with a file header (magic number, format version)
+ * followed by a sequence of blocks. Each block contains a number of packet
+ * records and is protected by a CRC-32 checksum. Every record stores the host
+ * receive timestamp of the packet together with the packet data. All values
+ * are stored in little endian byte order.
+ *
+ * Since version 2 a capture file can also contain the latency histograms of
+ * the host software (see @ref libosd-latency) in separate blocks.
+ *
+ * The writer collects packets in memory and writes full blocks at once. The
+ * reader maps the file into memory and returns pointers to the packets
+ * inside the mapping without copying them (on little endian hosts).
+ *
+ * @{
+ */
+
+/**
+ * Version of the capture file format written by this library
+ */
+#define OSD_CAPTURE_VERSION 2
+
+/**
+ * Default size of a block in a capture file in bytes
+ */
+#define OSD_CAPTURE_BLOCK_SIZE_DEFAULT (64 * 1024)
+
+struct osd_capture_writer_ctx;
+struct osd_capture_reader_ctx;
+
+/**
+ * Position of a packet in a capture file
+ *
+ * Treat the contents as opaque, only use positions obtained from
+ * osd_capture_reader_tell().
+ */
+struct osd_capture_pos {
+    uint64_t block_offset; //!< offset of the block header in the file
+    uint64_t record_offset; //!< offset of the record in the file
+};
+
+/**
+ * Get the current host time in the format used for capture timestamps
+ *
+ * @return nanoseconds since the Unix epoch
+ */
+uint64_t osd_capture_timestamp_now(void);
+
+/**
+ * Create a new capture writer and write the file header
+ *
+ * @param ctx the context object
+ * @param log_ctx the log context to use
+ * @param fp file to write the capture to, opened in binary write mode. The
+ *           file is not closed by the writer.
+ * @param block_size size of a block in bytes. Use 0 for the default size.
+ * @return OSD_OK on success
+ *         OSD_ERROR_FILE if writing the file header failed
+ */
+osd_result osd_capture_writer_new(struct osd_capture_writer_ctx **ctx,
+                                  struct osd_log_ctx *log_ctx, FILE *fp,
+                                  size_t block_size);
+
+/**
+ * Add a packet to the capture
+ *
+ * The packet is buffered and written to the file once the current block is
+ * full, or osd_capture_writer_flush() is called.
+ *
+ * @param ctx the context object
+ * @param pkg the packet to write
+ * @param rx_timestamp_ns time the packet was received by the host, see
+ *                        osd_capture_timestamp_now()
+ * @return OSD_OK on success
+ *         OSD_ERROR_FILE if writing a block to the file failed
+ */
+osd_result osd_capture_writer_write(struct osd_capture_writer_ctx *ctx,
+                                    const struct osd_packet *pkg,
+                                    uint64_t rx_timestamp_ns);
+
+/**
+ * Write all buffered packets to the file
+ *
+ * @return OSD_OK on success
+ *         OSD_ERROR_FILE if writing to the file failed
+ */
+osd_result osd_capture_writer_flush(struct osd_capture_writer_ctx *ctx);
+
+/**
+ * Write latency histograms to the capture
+ *
+ * All buffered packets are written first. The statistics can be written any
+ * number of times, e.g. periodically; readers use the last ones written.
+ *
+ * @param ctx the context object
+ * @param stats the latency histograms, e.g. from
+ *              osd_hostmod_get_latency_stats()
+ * @return OSD_OK on success
+ *         OSD_ERROR_FILE if writing to the file failed
+ */
+osd_result osd_capture_writer_write_latency(
+    struct osd_capture_writer_ctx *ctx, const struct osd_latency_stats *stats);
+
+/**
+ * Flush all buffered packets and free the writer
+ *
+ * Call osd_capture_writer_flush() before to check for write errors.
+ */
+void osd_capture_writer_free(struct osd_capture_writer_ctx **ctx_p);
+
+/**
+ * Check if a file is a capture file
+ *
+ * Only the magic number at the beginning of the file is checked.
+ *
+ * @param filename path of the file
+ * @return true if the file is a capture file
+ */
+bool osd_capture_is_capture_file(const char *filename);
+
+/**
+ * Open a capture file for reading
+ *
+ * @param ctx the context object
+ * @param log_ctx the log context to use
+ * @param filename path of the capture file
+ * @return OSD_OK on success
+ *         OSD_ERROR_FILE if the file cannot be opened or is not a capture file
+ *         of a supported version
+ */
+osd_result osd_capture_reader_new(struct osd_capture_reader_ctx **ctx,
+                                  struct osd_log_ctx *log_ctx,
+                                  const char *filename);
+
+/**
+ * Free the reader and unmap the file
+ */
+void osd_capture_reader_free(struct osd_capture_reader_ctx **ctx_p);
+
+/**
+ * Get the next packet from the capture
+ *
+ * The returned packet points into the mapped capture file (or into a buffer
+ * owned by the reader on big endian hosts). It stays valid until the next
+ * call to this function or until the reader is freed, whatever comes first.
+ * Copy the packet if you need to keep or modify it.
+ *
+ * @param ctx the context object
+ * @param[out] pkg the packet, or NULL if the end of the capture was reached
+ * @param[out] rx_timestamp_ns host receive timestamp of the packet.
+ *                             May be NULL.
+ * @return OSD_OK on success (including the end of the capture)
+ *         OSD_ERROR_CORRUPT if the checksum of a block does not match or the
+ *         file is truncated
+ */
+osd_result osd_capture_reader_next(struct osd_capture_reader_ctx *ctx,
+                                   const struct osd_packet **pkg,
+                                   uint64_t *rx_timestamp_ns);
+
+/**
+ * Restart reading at the first packet of the capture
+ */
+osd_result osd_capture_reader_rewind(struct osd_capture_reader_ctx *ctx);
+
+/**
+ * Get the position of the packet returned by the next call to
+ * osd_capture_reader_next()
+ */
+osd_result osd_capture_reader_tell(const struct osd_capture_reader_ctx *ctx,
+                                   struct osd_capture_pos *pos);
+
+/**
+ * Continue reading at a position obtained from osd_capture_reader_tell()
+ *
+ * Positions can be used with all readers of the same file. This allows
+ * reading different parts of a capture file in parallel.
+ *
+ * @return OSD_OK on success
+ *         OSD_ERROR_CORRUPT if the block at the position is corrupt
+ */
+osd_result osd_capture_reader_seek(struct osd_capture_reader_ctx *ctx,
+                                   const struct osd_capture_pos *pos);
+
+/**
+ * Get the time the capture file was created
+ *
+ * @return nanoseconds since the Unix epoch
+ */
+uint64_t osd_capture_reader_get_create_time(
+    const struct osd_capture_reader_ctx *ctx);
+
+/**
+ * Get the latency histograms stored in the capture
+ *
+ * The whole file is searched, independent of the current read position. If
+ * the capture contains multiple sets of latency histograms the last one is
+ * returned.
+ *
+ * @param ctx the context object
+ * @param[out] stats the latency histograms
+ * @return OSD_OK on success
+ *         OSD_ERROR_FAILURE if the capture contains no latency histograms
+ *         OSD_ERROR_CORRUPT if a block of the capture is corrupt
+ */
+osd_result osd_capture_reader_get_latency(
+    const struct osd_capture_reader_ctx *ctx, struct osd_latency_stats *stats);
+
+/**@}*/ /* end of doxygen group libosd-capture */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // OSD_CAPTURE_H
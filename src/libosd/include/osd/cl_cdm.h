@@ -75,6 +75,22 @@ osd_result osd_cl_cdm_get_desc(struct osd_hostmod_ctx *hostmod_ctx,
                                unsigned int cdm_di_addr,
                                struct osd_cdm_desc *cdm_desc);
 
+/**
+ * Decode a CDM event packet
+ *
+ * This function does not depend on any connection state and can be used to
+ * decode recorded traces offline.
+ *
+ * @param cdm_desc descriptor of the CDM module which emitted the event
+ * @param pkg the event packet
+ * @param[out] ev the decoded event
+ * @return OSD_OK on success
+ *         OSD_ERROR_DEVICE_INVALID_DATA if the packet is not a valid CDM event
+ */
+osd_result osd_cl_cdm_decode_event(const struct osd_cdm_desc *cdm_desc,
+                                   const struct osd_packet *pkg,
+                                   struct osd_cdm_event *ev);
+
 /**
  * Event handler to process CDM event, to be passed to a hostmod instance
  */
@@ -119,6 +135,64 @@ osd_result cl_cdm_cpureg_write(struct osd_hostmod_ctx *hostmod_ctx,
                                const void *reg_val, uint16_t reg_addr,
                                int flags);
 
+/**
+ * Read many SPRs of the CPUs attached to one or more CDMs
+ *
+ * Compared to calling cl_cdm_cpureg_read() for each register this function
+ * groups the registers to minimize the writes to the CORE_REG_UPPER register
+ * and keeps multiple reads in flight (see osd_hostmod_reg_access_batch()).
+ * If multiple CDMs are given the same registers are read from all of them
+ * concurrently, e.g. to take a snapshot of all CPU cores after a halt.
+ *
+ * @param hostmod_ctx the host module handling the communication
+ * @param cdm_descs descriptors of the CDMs to read from. The CORE_REG_UPPER
+ *                  values stored in the descriptors are updated.
+ * @param num_cdms number of entries in @p cdm_descs
+ * @param reg_addrs addresses of the registers to read
+ * @param num_regs number of entries in @p reg_addrs
+ * @param[out] reg_vals the read data. For each CDM (in the order of
+ *                      @p cdm_descs) @p num_regs values of
+ *                      osd_cdm_desc.core_data_width bits, in the order of
+ *                      @p reg_addrs.
+ * @param flags flags. Set OSD_HOSTMOD_BLOCKING to block indefinitely until the
+ *              accesses succeed.
+ * @return OSD_OK if all reads were successful
+ *         any other value indicates an error
+ *
+ * @see osd_cl_cdm_cpureg_write_bulk()
+ */
+osd_result osd_cl_cdm_cpureg_read_bulk(struct osd_hostmod_ctx *hostmod_ctx,
+                                       struct osd_cdm_desc *cdm_descs,
+                                       size_t num_cdms,
+                                       const uint16_t *reg_addrs,
+                                       size_t num_regs, void *reg_vals,
+                                       int flags);
+
+/**
+ * Write many SPRs of the CPUs attached to one or more CDMs
+ *
+ * @param hostmod_ctx the host module handling the communication
+ * @param cdm_descs descriptors of the CDMs to write to. The CORE_REG_UPPER
+ *                  values stored in the descriptors are updated.
+ * @param num_cdms number of entries in @p cdm_descs
+ * @param reg_addrs addresses of the registers to write
+ * @param num_regs number of entries in @p reg_addrs
+ * @param reg_vals the data to write, in the same layout as for
+ *                 osd_cl_cdm_cpureg_read_bulk()
+ * @param flags flags. Set OSD_HOSTMOD_BLOCKING to block indefinitely until the
+ *              accesses succeed.
+ * @return OSD_OK if all writes were successful
+ *         any other value indicates an error
+ *
+ * @see osd_cl_cdm_cpureg_read_bulk()
+ */
+osd_result osd_cl_cdm_cpureg_write_bulk(struct osd_hostmod_ctx *hostmod_ctx,
+                                        struct osd_cdm_desc *cdm_descs,
+                                        size_t num_cdms,
+                                        const uint16_t *reg_addrs,
+                                        size_t num_regs, const void *reg_vals,
+                                        int flags);
+
 /**@}*/ /* end of doxygen group libosd-cl_cdm */
 
 #ifdef __cplusplus
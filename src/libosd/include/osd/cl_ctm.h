@@ -85,6 +85,24 @@ osd_result osd_cl_ctm_get_desc(struct osd_hostmod_ctx *hostmod_ctx,
                                unsigned int ctm_di_addr,
                                struct osd_ctm_desc *ctm_desc);
 
+/**
+ * Decode a CTM event packet
+ *
+ * The packet must be a complete event, i.e. continuation packets
+ * (EV_CONT) must have been combined with the following packets already.
+ * This function does not depend on any connection state and can be used to
+ * decode recorded traces offline, also from multiple threads in parallel.
+ *
+ * @param ctm_desc descriptor of the CTM module which emitted the event
+ * @param pkg the event packet
+ * @param[out] ev the decoded event
+ * @return OSD_OK on success
+ *         OSD_ERROR_DEVICE_INVALID_DATA if the packet is not a valid CTM event
+ */
+osd_result osd_cl_ctm_decode_event(const struct osd_ctm_desc *ctm_desc,
+                                   const struct osd_packet *pkg,
+                                   struct osd_ctm_event *ev);
+
 /**
  * Event handler to process CTM event, to be passed to a hostmod instance
  */
@@ -65,6 +65,24 @@ osd_result osd_cl_dem_uart_get_desc(struct osd_hostmod_ctx *hostmod_ctx,
  */
 osd_result osd_cl_dem_uart_receive_event(void *handler, struct osd_packet *pkg);
 
+/**
+ * Handle a batch of packets received from a UART Device-Emulation-Module (DEM)
+ *
+ * This function should be passed to osd_hostmod_set_event_batch_handler().
+ * The characters of all packets are passed to the specified callback function
+ * in one string (or as few strings as possible), instead of one call per
+ * character.
+ *
+ * @param handler the event handler that should handle the events
+ * @param pkgs the osd_packets to be handled
+ * @param num_pkgs number of packets in @p pkgs
+ *
+ * @return OSD_OK on success, any other value indicates an error
+ */
+osd_result osd_cl_dem_uart_receive_event_batch(void *handler,
+                                               struct osd_packet **pkgs,
+                                               size_t num_pkgs);
+
 /**
  * Send the data to the UART Device-Emulation-Module (DEM)
  *
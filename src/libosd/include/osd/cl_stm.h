@@ -90,6 +90,24 @@ osd_result osd_cl_stm_get_desc(struct osd_hostmod_ctx *hostmod_ctx,
                                unsigned int stm_di_addr,
                                struct osd_stm_desc *stm_desc);
 
+/**
+ * Decode a STM event packet
+ *
+ * The packet must be a complete event, i.e. continuation packets
+ * (EV_CONT) must have been combined with the following packets already.
+ * This function does not depend on any connection state and can be used to
+ * decode recorded traces offline, also from multiple threads in parallel.
+ *
+ * @param stm_desc descriptor of the STM module which emitted the event
+ * @param pkg the event packet
+ * @param[out] ev the decoded event
+ * @return OSD_OK on success
+ *         OSD_ERROR_DEVICE_INVALID_DATA if the packet is not a valid STM event
+ */
+osd_result osd_cl_stm_decode_event(const struct osd_stm_desc *stm_desc,
+                                   const struct osd_packet *pkg,
+                                   struct osd_stm_event *ev);
+
 /**
  * Event handler to process STM event, to be passed to a hostmod instance
  */
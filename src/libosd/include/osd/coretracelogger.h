@@ -18,6 +18,11 @@
 
 #include <osd/osd.h>
 #include <osd/hostmod.h>
+#include <osd/cl_ctm.h>
+#include <osd/coverage.h>
+#include <osd/symtab.h>
+#include <osd/tracepipe.h>
+#include <osd/tracestream.h>
 
 #include <stdlib.h>
 
@@ -77,26 +82,90 @@ osd_result osd_coretracelogger_stop(struct osd_coretracelogger_ctx *ctx);
 /**
  * Set a file to write all log output to
  *
+ * All outputs (log, stream, ELF file and coverage) must be set before the
+ * logger is started.
+ *
  * @param ctx context object
  * @param fp a file pointer to write the logs to
- * @return OSD_OK if successful, any other value indicates an error
+ * @return OSD_OK if successful
+ *         OSD_ERROR_FAILURE if the logger is running
  */
 osd_result osd_coretracelogger_set_log(struct osd_coretracelogger_ctx *ctx,
                                        FILE *fp);
 
+/**
+ * Set a trace stream to publish all CTM events to
+ *
+ * The stream must not be freed before the core trace logger. The stream must
+ * be set before the logger is started.
+ *
+ * @param ctx context object
+ * @param stream the trace stream, or NULL to stop publishing events
+ * @return OSD_OK if successful
+ *         OSD_ERROR_FAILURE if the logger is running
+ */
+osd_result osd_coretracelogger_set_stream(struct osd_coretracelogger_ctx *ctx,
+                                          struct osd_tracestream_ctx *stream);
+
 /**
  * Set the path to the ELF file used to decode the core trace events
  *
- * To disable ELF parsing, set elf_filename to NULL.
+ * To disable ELF parsing, set elf_filename to NULL. The ELF file must be set
+ * before the logger is started.
  *
  * @param ctx context object
  * @param elf_filename path to the ELF file. Set to NULL to disable ELF parsing.
  * @return OSD_OK when reading the ELF file succeeded
+ *         OSD_ERROR_FAILURE if the logger is running
  *         any other value indicates an error
  */
 osd_result osd_coretracelogger_set_elf(struct osd_coretracelogger_ctx *ctx,
                                        const char* elf_filename);
 
+/**
+ * Collect function coverage and write it to a file when tracing stops
+ *
+ * The coverage is collected for the symbols of the ELF file, which must be
+ * set with osd_coretracelogger_set_elf() before. Setting a new ELF file
+ * disables coverage collection. Coverage collection must be set up before
+ * the logger is started.
+ *
+ * @param ctx context object
+ * @param filename path of the coverage file written by
+ *                 osd_coretracelogger_stop(). Set to NULL to disable coverage
+ *                 collection.
+ * @return OSD_OK if successful
+ *         OSD_ERROR_FAILURE if no ELF file is set or the logger is running
+ */
+osd_result osd_coretracelogger_set_coverage(struct osd_coretracelogger_ctx *ctx,
+                                            const char *filename);
+
+/**
+ * Get the trace pipeline processing the received CTM events
+ *
+ * Stages added to the pipeline before the logger is started run before the
+ * outputs of the logger, e.g. to filter the logged events or to add
+ * additional outputs.
+ */
+struct osd_tracepipe_ctx *osd_coretracelogger_get_tracepipe(
+    struct osd_coretracelogger_ctx *ctx);
+
+/**
+ * Write a CTM event in the core trace log format
+ *
+ * This is the output format used by the log file of the core trace logger.
+ * It is exposed to convert recorded traces offline into the same format.
+ *
+ * @param fp file to write the event to
+ * @param symtab symbol table used to translate addresses into function names.
+ *               Set to NULL to write the raw event data instead.
+ * @param event the event to write
+ * @return OSD_OK on success
+ *         OSD_ERROR_FILE if writing to @p fp failed
+ */
+osd_result osd_coretracelogger_format_event(FILE *fp,
+                                            const struct osd_symtab_ctx *symtab,
+                                            const struct osd_ctm_event *event);
 
 /**@}*/ /* end of doxygen group libosd-coretracelogger */
 
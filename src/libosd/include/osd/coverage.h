@@ -0,0 +1,198 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OSD_COVERAGE_H
+#define OSD_COVERAGE_H
+
+#include <osd/osd.h>
+#include <osd/cl_ctm.h>
+#include <osd/symtab.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup libosd-coverage Function Coverage
+ * @ingroup libosd
+ *
+ * Collect which functions were called, based on CTM call events.
+ *
+ * For each symbol in a symbol table the coverage holds a "covered" bit and a
+ * hit counter (the number of calls, saturating at UINT32_MAX). Symbols are
+ * identified by their index in the symbol table; call targets are mapped to
+ * symbol indices with a hash table in constant time.
+ *
+ * Coverage files store the bitmap and the counters together with a checksum
+ * of the symbol table, which ensures that only coverage of the same binary is
+ * merged. The symbol names are not stored; use the ELF file to map the
+ * indices back to function names.
+ *
+ * @{
+ */
+
+/**
+ * Version of the coverage file format written by this library
+ */
+#define OSD_COVERAGE_VERSION 1
+
+struct osd_coverage_ctx;
+
+/**
+ * Create a new (empty) coverage collector
+ *
+ * @param ctx the context object
+ * @param log_ctx the log context to use
+ * @param symtab the symbol table of the traced program. It must not be
+ *               modified or freed while the coverage collector exists.
+ * @return OSD_OK on success, any other value indicates an error
+ */
+osd_result osd_coverage_new(struct osd_coverage_ctx **ctx,
+                            struct osd_log_ctx *log_ctx,
+                            const struct osd_symtab_ctx *symtab);
+
+/**
+ * Create a coverage object from a coverage file
+ *
+ * Coverage objects created this way have no symbol table; they can be merged
+ * and written, but not updated with new events.
+ *
+ * @param ctx the context object
+ * @param log_ctx the log context to use
+ * @param filename the coverage file
+ * @return OSD_OK on success
+ *         OSD_ERROR_FILE if the file cannot be read or is no coverage file
+ *         OSD_ERROR_CORRUPT if the file is corrupt
+ */
+osd_result osd_coverage_new_from_file(struct osd_coverage_ctx **ctx,
+                                      struct osd_log_ctx *log_ctx,
+                                      const char *filename);
+
+/**
+ * Free the coverage object
+ */
+void osd_coverage_free(struct osd_coverage_ctx **ctx_p);
+
+/**
+ * Record a call to an address
+ *
+ * Calls to addresses inside a function (instead of its start) are attributed
+ * to the function containing the address. A function ends after its size, or
+ * at the next symbol if the size is unknown. Calls to addresses outside of
+ * all functions (e.g. to a ROM or behind the last function of unknown size)
+ * are ignored.
+ *
+ * @param ctx the context object
+ * @param target_addr the address of the called function
+ */
+void osd_coverage_add_call(struct osd_coverage_ctx *ctx, uint64_t target_addr);
+
+/**
+ * Update the coverage with a CTM event
+ *
+ * Only function calls are recorded, all other events are ignored.
+ */
+void osd_coverage_add_event(struct osd_coverage_ctx *ctx,
+                            const struct osd_ctm_event *event);
+
+/**
+ * Get the number of symbols the coverage covers
+ */
+size_t osd_coverage_get_count(const struct osd_coverage_ctx *ctx);
+
+/**
+ * Get the number of covered symbols
+ */
+size_t osd_coverage_get_covered_count(const struct osd_coverage_ctx *ctx);
+
+/**
+ * Get the number of runs this coverage was collected from
+ *
+ * A new coverage object counts as one run; merging adds up the runs.
+ */
+unsigned int osd_coverage_get_runs(const struct osd_coverage_ctx *ctx);
+
+/**
+ * Check if a symbol was called
+ *
+ * @param ctx the context object
+ * @param idx index of the symbol in the symbol table
+ */
+bool osd_coverage_is_covered(const struct osd_coverage_ctx *ctx, size_t idx);
+
+/**
+ * Get the number of calls to a symbol
+ *
+ * @param ctx the context object
+ * @param idx index of the symbol in the symbol table
+ */
+uint32_t osd_coverage_get_hits(const struct osd_coverage_ctx *ctx, size_t idx);
+
+/**
+ * Check if a symbol table is the one the coverage was collected for
+ */
+bool osd_coverage_matches_symtab(const struct osd_coverage_ctx *ctx,
+                                 const struct osd_symtab_ctx *symtab);
+
+/**
+ * Write the coverage to a file
+ *
+ * @return OSD_OK on success
+ *         OSD_ERROR_FILE if writing the file failed
+ */
+osd_result osd_coverage_write(const struct osd_coverage_ctx *ctx,
+                              const char *filename);
+
+/**
+ * Add the coverage from another coverage object
+ *
+ * The covered bits are combined, hit counters and runs are added up.
+ *
+ * @param ctx the context object
+ * @param other the coverage to add
+ * @return OSD_OK on success
+ *         OSD_ERROR_FAILURE if @p other was collected for a different symbol
+ *         table
+ */
+osd_result osd_coverage_merge(struct osd_coverage_ctx *ctx,
+                              const struct osd_coverage_ctx *other);
+
+/**
+ * Add the coverage from a coverage file
+ *
+ * The covered bits are combined, hit counters and runs are added up.
+ *
+ * @param ctx the context object
+ * @param filename the coverage file to merge
+ * @return OSD_OK on success
+ *         OSD_ERROR_FILE if the file cannot be read or is no coverage file
+ *         OSD_ERROR_CORRUPT if the file is corrupt
+ *         OSD_ERROR_FAILURE if the file was collected for a different
+ *         symbol table
+ */
+osd_result osd_coverage_merge_file(struct osd_coverage_ctx *ctx,
+                                   const char *filename);
+
+/**@}*/ /* end of doxygen group libosd-coverage */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // OSD_COVERAGE_H
@@ -0,0 +1,160 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OSD_FLIGHTREC_H
+#define OSD_FLIGHTREC_H
+
+#include <osd/osd.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup libosd-flightrec Flight Recorder
+ * @ingroup libosd
+ *
+ * Always-on recording of the most recent events in the host software.
+ *
+ * Debug log messages are compiled out unless libosd is built with DEBUG
+ * defined. To still be able to find out what happened in a misbehaving
+ * system, libosd records compact binary records of events on its hot paths
+ * (e.g. packets being routed or dropped by the host controller) into a
+ * fixed-size ring buffer per thread. Recording an event costs a timestamp
+ * and a few stores; older records are overwritten.
+ *
+ * The records of all threads can be dumped in a binary format with
+ * osd_flightrec_dump(), which is safe to call from a signal handler, and
+ * rendered as text with osd_flightrec_decode() (or the
+ * osd-flightrec-decode tool). osd_flightrec_install_signal_handlers()
+ * dumps the records to a file on SIGUSR1 and on SIGABRT, i.e. on a failed
+ * assertion.
+ *
+ * @{
+ */
+
+/**
+ * Number of records kept per thread
+ */
+#define OSD_FLIGHTREC_RING_SIZE 2048
+
+/**
+ * Events recorded by the flight recorder
+ *
+ * The meaning of the arguments of a record depends on the event.
+ */
+enum osd_flightrec_event {
+    /** host controller routed a packet: src, dest, size in words */
+    OSD_FLIGHTREC_PKG_ROUTED = 1,
+    /** host controller dropped a packet: src, dest, reason */
+    OSD_FLIGHTREC_PKG_DROPPED = 2,
+    /** gateway wrote a packet to the device: src, dest, result */
+    OSD_FLIGHTREC_PKG_TO_DEVICE = 3,
+    /** host module reassembled an event packet: src, fragments, size */
+    OSD_FLIGHTREC_EVENT_REASSEMBLED = 4,
+    /** host module delivered event packets to the handler: count */
+    OSD_FLIGHTREC_EVENT_DELIVERED = 5,
+    /** host module timed out waiting for a packet: flags */
+    OSD_FLIGHTREC_RECEIVE_TIMEOUT = 6,
+
+    /** events above this value can be used by applications */
+    OSD_FLIGHTREC_USER = 0x8000,
+};
+
+/**
+ * Reasons for OSD_FLIGHTREC_PKG_DROPPED
+ */
+enum osd_flightrec_drop_reason {
+    /** the packet could not be parsed */
+    OSD_FLIGHTREC_DROP_INVALID = 1,
+    /** no module is registered for the destination */
+    OSD_FLIGHTREC_DROP_NO_MODULE = 2,
+    /** no gateway is registered for the destination subnet */
+    OSD_FLIGHTREC_DROP_NO_GATEWAY = 3,
+};
+
+/**
+ * Record an event in the ring buffer of the calling thread
+ *
+ * @param event the event (see enum osd_flightrec_event)
+ * @param arg0 first argument of the event
+ * @param arg1 second argument of the event
+ * @param arg2 third argument of the event
+ */
+void osd_flightrec_record(uint16_t event, uint32_t arg0, uint32_t arg1,
+                          uint32_t arg2);
+
+/**
+ * Enable or disable recording
+ *
+ * Recording is enabled by default.
+ */
+void osd_flightrec_set_enabled(bool enabled);
+
+/**
+ * Write the records of all threads to a file descriptor (binary format)
+ *
+ * This function is async-signal-safe. Records written concurrently by other
+ * threads may be torn.
+ *
+ * @param fd the file descriptor to write to
+ * @return OSD_OK on success, any other value indicates an error
+ *
+ * @see osd_flightrec_decode()
+ */
+osd_result osd_flightrec_dump(int fd);
+
+/**
+ * Render a binary dump as text
+ *
+ * The records of all threads are printed in the order they were recorded,
+ * one record per line.
+ *
+ * @param in the binary dump, as written by osd_flightrec_dump()
+ * @param out the text output
+ * @return OSD_OK on success
+ *         OSD_ERROR_FAILURE if the dump is malformed
+ */
+osd_result osd_flightrec_decode(FILE *in, FILE *out);
+
+/**
+ * Dump the records to a file on SIGUSR1 and SIGABRT
+ *
+ * On SIGUSR1 the records are written to @p path and the program continues.
+ * On SIGABRT (e.g. on a failed assertion) the records are written to
+ * @p path, and the signal is raised again with the default action.
+ *
+ * @param path the file to write the records to. The string is copied.
+ * @return OSD_OK on success, any other value indicates an error
+ */
+osd_result osd_flightrec_install_signal_handlers(const char *path);
+
+/**
+ * Get a short human-readable name of an event
+ *
+ * @return the name, or NULL for unknown events
+ */
+const char* osd_flightrec_event_name(uint16_t event);
+
+/**@}*/ /* end of doxygen group libosd-flightrec */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // OSD_FLIGHTREC_H
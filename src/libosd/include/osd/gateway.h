@@ -148,6 +148,20 @@ bool osd_gateway_is_connected(struct osd_gateway_ctx *ctx);
 struct osd_gateway_transfer_stats*
 osd_gateway_get_transfer_stats(struct osd_gateway_ctx *ctx);
 
+/**
+ * Enable or disable latency tracing
+ *
+ * If enabled, host timestamps are attached to all packets read from the
+ * device. They are used to measure the latency of the individual hops on the
+ * way to the host modules, see osd_hostmod_get_latency_stats(). Latency
+ * tracing is disabled by default.
+ *
+ * @param ctx the context object
+ * @param enabled enable latency tracing
+ */
+void osd_gateway_set_latency_tracing(struct osd_gateway_ctx *ctx,
+                                     bool enabled);
+
 /**@}*/ /* end of doxygen group libosd-gateway */
 
 #ifdef __cplusplus
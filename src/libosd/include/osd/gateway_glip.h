@@ -84,6 +84,12 @@ bool osd_gateway_glip_is_connected(struct osd_gateway_glip_ctx *ctx);
 struct osd_gateway_transfer_stats*
 osd_gateway_glip_get_transfer_stats(struct osd_gateway_glip_ctx *ctx);
 
+/**
+ * @copydoc osd_gateway_set_latency_tracing()
+ */
+void osd_gateway_glip_set_latency_tracing(struct osd_gateway_glip_ctx *ctx,
+                                          bool enabled);
+
 /**@}*/ /* end of doxygen group libosd-gateway_glip */
 
 #ifdef __cplusplus
@@ -0,0 +1,174 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OSD_GATEWAY_SIM_H
+#define OSD_GATEWAY_SIM_H
+
+#include <osd/osd.h>
+#include <osd/packet.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup libosd-gateway_sim Gateway to a simulated debug subnet
+ * @ingroup libosd
+ *
+ * A gateway which connects a synthetic debug subnet to the host controller
+ * instead of a real device. The subnet consists of a SCM at local address 0,
+ * followed by the configured number of MAM, DEM-UART, STM, CTM and CDM
+ * modules (in this order), up to OSD_DIADDR_LOCAL_MAX modules in total.
+ *
+ * The simulated modules answer register accesses to their base and
+ * module-specific registers. Registers without a defined value read as 0,
+ * written values are stored and read back. The MAMs store written memory
+ * contents (unwritten memory reads as 0) and acknowledge synchronous writes.
+ * All responses are delayed by a configurable latency and returned in order,
+ * as on a real debug interconnect.
+ *
+ * This allows timing the enumeration and setup code paths, like
+ * osd_hostmod_get_modules() or osd_memaccess_find_memories(), on large
+ * systems without hardware.
+ *
+ * @{
+ */
+
+struct osd_gateway_sim_ctx;
+
+/**
+ * Configuration of the simulated debug subnet
+ */
+struct osd_gateway_sim_config {
+    /** Number of Memory Access Modules (MAM) */
+    unsigned int num_mam;
+    /** Number of Device Emulation Modules UART (DEM-UART) */
+    unsigned int num_dem_uart;
+    /** Number of System Trace Modules (STM) */
+    unsigned int num_stm;
+    /** Number of Core Trace Modules (CTM) */
+    unsigned int num_ctm;
+    /** Number of Core Debug Modules (CDM) */
+    unsigned int num_cdm;
+
+    /** Latency of every response of the subnet (in ns) */
+    uint64_t latency_ns;
+    /** Uniformly distributed additional latency (in ns) */
+    uint64_t latency_jitter_ns;
+
+    /** Address width of all MAMs (in bit) */
+    unsigned int mam_addr_width_bit;
+    /** Data width of all MAMs (in bit) */
+    unsigned int mam_data_width_bit;
+    /** Size of the memory behind each MAM (in byte) */
+    uint64_t mam_memsize;
+};
+
+/**
+ * Fill a configuration with default values
+ *
+ * The default subnet has one MAM, one DEM-UART, one STM, one CTM and one CDM,
+ * and answers without additional latency.
+ *
+ * @param[out] config the configuration to initialize
+ */
+void osd_gateway_sim_config_init(struct osd_gateway_sim_config *config);
+
+/**
+ * Set values of a configuration from a string
+ *
+ * The string is a comma-separated list of key=value pairs, e.g.
+ * "mam=4,ctm=500,cdm=500,latency=2000". Valid keys are mam, dem_uart, stm,
+ * ctm, cdm (number of modules), latency, jitter (in ns), aw, dw (MAM address
+ * and data width in bit) and memsize (in byte). Keys which are not given
+ * keep their current value.
+ *
+ * @param[in,out] config the configuration to modify
+ * @param[in] str the configuration string
+ *
+ * @return OSD_OK on success
+ * @return OSD_ERROR_FAILURE if the string cannot be parsed
+ */
+osd_result osd_gateway_sim_config_parse(struct osd_gateway_sim_config *config,
+                                        const char *str);
+
+/**
+ * Create new osd_gateway_sim instance
+ *
+ * @param[out] ctx the osd_gateway_sim_ctx context to be created
+ * @param[in] log_ctx the log context to be used. Set to NULL to disable logging
+ * @param[in] host_controller_address ZeroMQ endpoint of the host controller
+ * @param[in] device_subnet_addr Subnet address of the simulated device
+ * @param[in] config configuration of the simulated subnet
+ *
+ * @return OSD_OK on success
+ * @return OSD_ERROR_FAILURE if the configuration is invalid
+ *
+ * @see osd_gateway_new()
+ * @see osd_gateway_sim_free()
+ */
+osd_result osd_gateway_sim_new(struct osd_gateway_sim_ctx **ctx,
+                               struct osd_log_ctx *log_ctx,
+                               const char *host_controller_address,
+                               uint16_t device_subnet_addr,
+                               const struct osd_gateway_sim_config *config);
+
+/**
+ * @copydoc osd_gateway_free()
+ */
+void osd_gateway_sim_free(struct osd_gateway_sim_ctx **ctx_p);
+
+/**
+ * @copydoc osd_gateway_connect()
+ */
+osd_result osd_gateway_sim_connect(struct osd_gateway_sim_ctx *ctx);
+
+/**
+ * @copydoc osd_gateway_disconnect()
+ */
+osd_result osd_gateway_sim_disconnect(struct osd_gateway_sim_ctx *ctx);
+
+/**
+ * @copydoc osd_gateway_is_connected()
+ */
+bool osd_gateway_sim_is_connected(struct osd_gateway_sim_ctx *ctx);
+
+/**
+ * Get the number of modules in the simulated subnet, including the SCM
+ */
+unsigned int osd_gateway_sim_get_num_modules(struct osd_gateway_sim_ctx *ctx);
+
+/**
+ * @copydoc osd_gateway_get_transfer_stats();
+ */
+struct osd_gateway_transfer_stats*
+osd_gateway_sim_get_transfer_stats(struct osd_gateway_sim_ctx *ctx);
+
+/**
+ * @copydoc osd_gateway_set_latency_tracing()
+ */
+void osd_gateway_sim_set_latency_tracing(struct osd_gateway_sim_ctx *ctx,
+                                         bool enabled);
+
+/**@}*/ /* end of doxygen group libosd-gateway_sim */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // OSD_GATEWAY_SIM_H
@@ -16,6 +16,7 @@
 #ifndef OSD_HOSTMOD_H
 #define OSD_HOSTMOD_H
 
+#include <osd/latency.h>
 #include <osd/module.h>
 #include <osd/osd.h>
 #include <osd/packet.h>
@@ -53,6 +54,34 @@ struct osd_hostmod_ctx;
 typedef osd_result (*osd_hostmod_event_handler_fn)(
     void * /* arg */, struct osd_packet * /* packet */);
 
+/**
+ * Batch event handler function prototype
+ *
+ * Called with all event packets which were received back-to-back from the
+ * host controller, in the order they were received. The ownership of the
+ * packets is passed to the handler function, the array itself is owned by
+ * the caller.
+ *
+ * @see osd_hostmod_set_event_batch_handler()
+ */
+typedef osd_result (*osd_hostmod_event_batch_handler_fn)(
+    void * /* arg */, struct osd_packet ** /* packets */, size_t /* num */);
+
+/**
+ * Maximum number of event packets passed to a batch event handler at once
+ */
+#define OSD_HOSTMOD_EVENT_BATCH_MAX 256
+
+/**
+ * File descriptor handler function prototype
+ *
+ * Called from the I/O thread when the file descriptor is ready for reading.
+ *
+ * @see osd_hostmod_add_fd_handler()
+ */
+typedef osd_result (*osd_hostmod_fd_handler_fn)(void * /* arg */,
+                                                int /* fd */);
+
 /**
  * Create new osd_hostmod instance
  *
@@ -93,6 +122,9 @@ osd_result osd_hostmod_connect(struct osd_hostmod_ctx *ctx);
 /**
  * Shut down all communication with the device
  *
+ * Register accesses started with osd_hostmod_reg_access_async() which are
+ * still in flight are completed with OSD_ERROR_ABORTED.
+ *
  * @param ctx the osd_hostmod context object
  * @return OSD_OK on success, any other value indicates an error
  *
@@ -157,6 +189,49 @@ osd_result osd_hostmod_reg_write(struct osd_hostmod_ctx *ctx,
                                  uint16_t reg_addr, int reg_size_bit,
                                  int flags);
 
+/**
+ * A register access in a batch
+ *
+ * @see osd_hostmod_reg_access_batch()
+ */
+struct osd_hostmod_reg_access {
+    uint16_t diaddr; //!< DI address of the accessed module
+    uint16_t reg_addr; //!< address of the register
+    int reg_size_bit; //!< register size in bit (16, 32, 64 or 128)
+    bool write; //!< write (true) or read (false) the register
+    /**
+     * Read access: buffer for the result of @p reg_size_bit bits.
+     * Write access: the data to be written.
+     */
+    void *reg_val;
+    osd_result result; //!< [out] result of this access
+};
+
+/**
+ * Perform many register accesses with multiple requests in flight
+ *
+ * osd_hostmod_reg_read() and osd_hostmod_reg_write() wait for the response
+ * of each access before sending the next request. This function instead sends
+ * the requests of up to 32 accesses before waiting for the responses, which
+ * hides most of the round-trip latency for long sequences of accesses.
+ *
+ * Accesses to the same module are performed in the given order; accesses to
+ * different modules may overlap. The result of every access is stored in
+ * its @p result field.
+ *
+ * @param ctx the osd_hostmod_ctx context object
+ * @param accesses the register accesses
+ * @param num_accesses number of entries in @p accesses
+ * @param flags flags. Set OSD_HOSTMOD_BLOCKING to block indefinitely until all
+ *              accesses have been answered.
+ * @return OSD_OK if all accesses succeeded, otherwise the result of the first
+ *         failed access. If waiting for a response times out all
+ *         outstanding accesses fail with OSD_ERROR_TIMEDOUT.
+ */
+osd_result osd_hostmod_reg_access_batch(struct osd_hostmod_ctx *ctx,
+                                        struct osd_hostmod_reg_access *accesses,
+                                        size_t num_accesses, int flags);
+
 /**
  * Set (or unset) a bit in a debug module configuration register
  *
@@ -212,6 +287,23 @@ unsigned int osd_hostmod_get_max_event_words(struct osd_hostmod_ctx *ctx,
 osd_result osd_hostmod_event_send(struct osd_hostmod_ctx *ctx,
                                   const struct osd_packet* event_pkg);
 
+/**
+ * Send multiple event packets to their destinations
+ *
+ * All packets are passed to the I/O thread in a single message, which is
+ * considerably faster than calling osd_hostmod_event_send() for each packet.
+ * The packets are sent in the given order.
+ *
+ * @param ctx the osd_hostmod_ctx context object
+ * @param event_pkgs the event packets to be sent. The packets are copied and
+ *                   can be reused by the caller after this function returns.
+ * @param num_pkgs number of entries in @p event_pkgs
+ * @return OSD_OK on success, any other value indicates an error
+ */
+osd_result osd_hostmod_event_send_batch(
+    struct osd_hostmod_ctx *ctx, const struct osd_packet *const *event_pkgs,
+    size_t num_pkgs);
+
 /**
  * Receive an event packet
  *
@@ -229,6 +321,160 @@ osd_result osd_hostmod_event_receive(struct osd_hostmod_ctx *ctx,
                                      struct osd_packet **event_pkg,
                                      int flags);
 
+/**
+ * Receive multiple event packets at once
+ *
+ * Waits for the first packet like osd_hostmod_event_receive(), then returns
+ * all further packets which have already been received by the host module,
+ * without waiting for more.
+ *
+ * @param ctx the osd_hostmod_ctx context object
+ * @param[out] event_pkgs the received event packets. Allocated by this
+ *             function, must be free'd by the caller after use.
+ * @param max_pkgs number of entries in @p event_pkgs (at least 1)
+ * @param[out] num_pkgs number of packets written to @p event_pkgs
+ * @param flags a ORed list of flags (see osd_hostmod_event_receive())
+ * @return OSD_OK if at least one packet was received, any other value
+ *         indicates an error
+ */
+osd_result osd_hostmod_event_receive_batch(struct osd_hostmod_ctx *ctx,
+                                           struct osd_packet **event_pkgs,
+                                           size_t max_pkgs, size_t *num_pkgs,
+                                           int flags);
+
+/**
+ * Get a file descriptor to wait for received packets in an event loop
+ *
+ * The file descriptor can be watched with poll(), select() or epoll to learn
+ * when packets can be fetched with osd_hostmod_try_receive(). It is the
+ * ZMQ_FD of the socket between the I/O thread and the calling thread and has
+ * the same semantics: it signals that the state of the socket changed, not
+ * that a packet is waiting. After it became readable, call
+ * osd_hostmod_try_receive() until it returns no more packets. Never read
+ * from or write to the file descriptor.
+ *
+ * The file descriptor stays valid until osd_hostmod_free() is called.
+ *
+ * @param ctx the osd_hostmod_ctx context object
+ * @return the file descriptor
+ */
+int osd_hostmod_get_pollfd(struct osd_hostmod_ctx *ctx);
+
+/**
+ * Receive a packet without waiting
+ *
+ * Returns the next packet which has been received by the host module,
+ * register access responses and event packets alike.
+ *
+ * @param ctx the osd_hostmod_ctx context object
+ * @param[out] packet the received packet, or NULL if no packet is waiting.
+ *             Allocated by this function, must be free'd by the caller
+ *             after use.
+ * @return OSD_OK on success (also if no packet was waiting), any other value
+ *         indicates an error
+ *
+ * @see osd_hostmod_get_pollfd()
+ */
+osd_result osd_hostmod_try_receive(struct osd_hostmod_ctx *ctx,
+                                   struct osd_packet **packet);
+
+/**
+ * Send the request of a register access without waiting for the response
+ *
+ * Together with osd_hostmod_get_pollfd() and osd_hostmod_try_receive() this
+ * allows register accesses from an event loop: pass the response, i.e. the
+ * next register access packet received from @p acc->diaddr, to
+ * osd_hostmod_reg_access_finish(). Modules answer requests in the order
+ * they were sent.
+ *
+ * @param ctx the osd_hostmod_ctx context object
+ * @param acc the register access. The data of a write access is copied into
+ *            the request, the structure can be reused after this function
+ *            returns.
+ * @return OSD_OK if the request was sent, any other value indicates an error
+ */
+osd_result osd_hostmod_reg_access_start(
+    struct osd_hostmod_ctx *ctx, const struct osd_hostmod_reg_access *acc);
+
+/**
+ * Complete a register access started with osd_hostmod_reg_access_start()
+ *
+ * The response is checked, the read data is stored in @p acc->reg_val and
+ * the result in @p acc->result.
+ *
+ * @param ctx the osd_hostmod_ctx context object
+ * @param acc the register access
+ * @param response the response packet, still owned by the caller
+ * @return the result of the access (as stored in @p acc->result)
+ */
+osd_result osd_hostmod_reg_access_finish(struct osd_hostmod_ctx *ctx,
+                                         struct osd_hostmod_reg_access *acc,
+                                         const struct osd_packet *response);
+
+/**
+ * Completion callback of an asynchronous register access
+ *
+ * @see osd_hostmod_reg_access_async()
+ */
+typedef void (*osd_hostmod_reg_access_cb_fn)(
+    void * /* arg */, struct osd_hostmod_reg_access * /* acc */);
+
+/**
+ * Start a register access which completes through a callback
+ *
+ * The request is sent immediately. When the response is received by
+ * osd_hostmod_process(), the read data is stored in @p acc->reg_val, the
+ * result in @p acc->result, and @p cb is called from the thread calling
+ * osd_hostmod_process().
+ *
+ * Any number of accesses can be in flight at the same time. Accesses to the
+ * same module complete in the order they were started.
+ *
+ * While asynchronous accesses are in flight, only osd_hostmod_process() may
+ * receive packets from this host module, i.e. blocking register accesses,
+ * osd_hostmod_event_receive() and osd_hostmod_try_receive() must not be
+ * called.
+ *
+ * @param ctx the osd_hostmod_ctx context object
+ * @param acc the register access. Must stay valid until @p cb was called.
+ * @param cb the completion callback
+ * @param cb_arg argument passed to @p cb
+ * @return OSD_OK if the request was sent (@p cb will be called), any other
+ *         value indicates an error (@p cb will not be called)
+ */
+osd_result osd_hostmod_reg_access_async(struct osd_hostmod_ctx *ctx,
+                                        struct osd_hostmod_reg_access *acc,
+                                        osd_hostmod_reg_access_cb_fn cb,
+                                        void *cb_arg);
+
+/**
+ * Process all received packets without waiting
+ *
+ * Call this function from an event loop whenever the file descriptor
+ * returned by osd_hostmod_get_pollfd() becomes readable. All packets
+ * waiting in the host module are received: register access responses
+ * complete the accesses started with osd_hostmod_reg_access_async(), event
+ * packets are passed to @p event_handler. All callbacks are called from the
+ * calling thread before this function returns.
+ *
+ * Event packets are only received here if no event handler was passed to
+ * osd_hostmod_new(); such a handler is called from the I/O thread instead.
+ *
+ * Callbacks may start new asynchronous accesses and send packets, but must
+ * not call osd_hostmod_process(), osd_hostmod_disconnect() or
+ * osd_hostmod_free() for the same host module.
+ *
+ * @param ctx the osd_hostmod_ctx context object
+ * @param event_handler handler for received event packets, which are
+ *                      dropped if NULL. The ownership of the packet is
+ *                      passed to the handler.
+ * @param event_handler_arg argument passed to @p event_handler
+ * @return OSD_OK on success, any other value indicates an error
+ */
+osd_result osd_hostmod_process(struct osd_hostmod_ctx *ctx,
+                               osd_hostmod_event_handler_fn event_handler,
+                               void *event_handler_arg);
+
 /**
  * Get a list of all debug modules in a given subnet
  *
@@ -298,6 +544,109 @@ osd_result osd_hostmod_mod_set_event_active(struct osd_hostmod_ctx *ctx,
                                             uint16_t di_addr, bool enabled,
                                             int flags);
 
+/**
+ * Get the latency histograms of the packets received by this host module
+ *
+ * Latencies are only recorded for packets carrying host timestamps, i.e. if
+ * latency tracing is enabled in the gateway the packets came through (see
+ * osd_gateway_set_latency_tracing()). Both event packets and register access
+ * responses are recorded.
+ *
+ * @param ctx the osd_hostmod context object
+ * @param[out] stats a copy of the latency histograms
+ */
+void osd_hostmod_get_latency_stats(struct osd_hostmod_ctx *ctx,
+                                   struct osd_latency_stats *stats);
+
+/**
+ * Clear the latency histograms of this host module
+ *
+ * @param ctx the osd_hostmod context object
+ */
+void osd_hostmod_reset_latency_stats(struct osd_hostmod_ctx *ctx);
+
+/**
+ * Configure the low-latency busy-poll mode
+ *
+ * By default all threads involved in a register access sleep until the next
+ * message arrives, so the round-trip time of an access is dominated by
+ * thread wake-ups. In the busy-poll mode the waiting threads spin instead,
+ * for at most the given time, before falling back to sleeping:
+ *
+ * - the calling thread after sending a request (e.g. in
+ *   osd_hostmod_reg_read()), waiting for the response,
+ * - the I/O thread after handling a packet, waiting for the next packet
+ *   from the host controller or the next request from the calling thread.
+ *
+ * Spinning trades CPU time for latency; use it for long sequences of
+ * dependent register accesses. The mode can be changed at any time.
+ *
+ * @param ctx the osd_hostmod context object
+ * @param caller_spin_us spin budget of the calling thread in microseconds.
+ *                       0 disables spinning.
+ * @param iothread_spin_us spin budget of the I/O thread in microseconds.
+ *                         0 disables spinning.
+ */
+void osd_hostmod_set_busy_poll(struct osd_hostmod_ctx *ctx,
+                               unsigned int caller_spin_us,
+                               unsigned int iothread_spin_us);
+
+/**
+ * Receive event packets in batches
+ *
+ * By default the event handler passed to osd_hostmod_new() is called once
+ * for every event packet. If a batch handler is set, the I/O thread instead
+ * collects all event packets which are ready to be received (up to
+ * OSD_HOSTMOD_EVENT_BATCH_MAX) and passes them to the batch handler in one
+ * call. The batch handler is called with the event_handler_arg given to
+ * osd_hostmod_new().
+ *
+ * Call this function before osd_hostmod_connect().
+ *
+ * @param ctx the osd_hostmod context object
+ * @param event_batch_handler the batch handler, NULL to use the event handler
+ *                            for every packet
+ */
+void osd_hostmod_set_event_batch_handler(
+    struct osd_hostmod_ctx *ctx,
+    osd_hostmod_event_batch_handler_fn event_batch_handler);
+
+/**
+ * Watch a file descriptor in the I/O thread of the host module
+ *
+ * @p handler is called from the I/O thread whenever @p fd is ready for
+ * reading. This allows I/O on other file descriptors (e.g. a terminal) to be
+ * handled without a dedicated thread.
+ *
+ * The handler may send events with osd_hostmod_event_send() and
+ * osd_hostmod_event_send_batch(), which are passed on to the host controller
+ * directly. It must not perform register accesses or call any other function
+ * waiting for a response from the I/O thread.
+ *
+ * @param ctx the osd_hostmod context object
+ * @param fd the file descriptor to watch
+ * @param handler function called when @p fd is ready for reading
+ * @param arg argument passed to @p handler
+ * @return OSD_OK on success, any other value indicates an error
+ *
+ * @see osd_hostmod_remove_fd_handler()
+ */
+osd_result osd_hostmod_add_fd_handler(struct osd_hostmod_ctx *ctx, int fd,
+                                      osd_hostmod_fd_handler_fn handler,
+                                      void *arg);
+
+/**
+ * Stop watching a file descriptor
+ *
+ * After this function returns the handler is not called any more.
+ *
+ * @param ctx the osd_hostmod context object
+ * @param fd the file descriptor passed to osd_hostmod_add_fd_handler()
+ * @return OSD_OK on success
+ *         OSD_ERROR_FAILURE if no handler was registered for @p fd
+ */
+osd_result osd_hostmod_remove_fd_handler(struct osd_hostmod_ctx *ctx, int fd);
+
 /**
  * Get the logging context for this host module (internal use only)
  *
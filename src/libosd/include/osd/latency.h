@@ -0,0 +1,151 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OSD_LATENCY_H
+#define OSD_LATENCY_H
+
+#include <osd/osd.h>
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup libosd-latency Latency Histograms
+ * @ingroup libosd
+ *
+ * Measure how long packets from the device take through the host software.
+ *
+ * If latency tracing is enabled in the gateway (see
+ * osd_gateway_set_latency_tracing()), every packet read from the device is
+ * accompanied by a set of host timestamps: when it was received by the
+ * gateway, routed by the host controller, received by the I/O thread of the
+ * host module, and delivered to the event handler or register access
+ * function. The timestamps are carried next to the packet and do not change
+ * the DI packet format. The host module records the time between these points
+ * ("hops") in histograms, see osd_hostmod_get_latency_stats().
+ *
+ * All timestamps are taken from CLOCK_MONOTONIC. Latencies can only be
+ * measured if the gateway, the host controller and the host module run on
+ * the same host.
+ *
+ * The histograms use logarithmic buckets: bucket 0 counts latencies of 0 ns,
+ * bucket i counts latencies in [2^(i-1), 2^i) ns. The last bucket also counts
+ * all larger latencies.
+ *
+ * @{
+ */
+
+/**
+ * Number of buckets in a latency histogram
+ */
+#define OSD_LATENCY_HIST_BUCKETS 40
+
+/**
+ * Hops of a packet through the host software
+ */
+enum osd_latency_hop {
+    /** gateway receive to host controller routing */
+    OSD_LATENCY_HOP_GATEWAY = 0,
+    /** host controller routing to host module I/O thread receive */
+    OSD_LATENCY_HOP_HOSTCTRL = 1,
+    /** host module I/O thread receive to delivery to the consumer */
+    OSD_LATENCY_HOP_HOSTMOD = 2,
+    /** gateway receive to delivery to the consumer */
+    OSD_LATENCY_HOP_TOTAL = 3,
+
+    OSD_LATENCY_HOP_NUM
+};
+
+/**
+ * Latency histogram
+ */
+struct osd_latency_hist {
+    uint64_t count; //!< number of samples
+    uint64_t sum_ns; //!< sum of all samples
+    uint64_t min_ns; //!< smallest sample (0 if count is 0)
+    uint64_t max_ns; //!< largest sample
+    uint64_t buckets[OSD_LATENCY_HIST_BUCKETS]; //!< samples per bucket
+};
+
+/**
+ * Latency histograms of all hops
+ */
+struct osd_latency_stats {
+    struct osd_latency_hist hop[OSD_LATENCY_HOP_NUM];
+};
+
+/**
+ * Get the current time in the format used for latency timestamps
+ *
+ * @return nanoseconds of CLOCK_MONOTONIC
+ */
+uint64_t osd_latency_now(void);
+
+/**
+ * Get a short human-readable name of a hop
+ */
+const char* osd_latency_hop_name(enum osd_latency_hop hop);
+
+/**
+ * Add a sample to a histogram
+ *
+ * @param hist the histogram
+ * @param latency_ns the latency in ns
+ */
+void osd_latency_hist_add(struct osd_latency_hist *hist, uint64_t latency_ns);
+
+/**
+ * Add all samples of a histogram to another histogram
+ *
+ * @param hist the histogram to add to
+ * @param other the histogram to add
+ */
+void osd_latency_hist_merge(struct osd_latency_hist *hist,
+                            const struct osd_latency_hist *other);
+
+/**
+ * Estimate a percentile of the recorded latencies
+ *
+ * The result is the upper bound of the bucket containing the percentile,
+ * limited to the largest recorded sample.
+ *
+ * @param hist the histogram
+ * @param percentile the percentile (0 to 100)
+ * @return the latency in ns, or 0 if the histogram is empty
+ */
+uint64_t osd_latency_hist_percentile(const struct osd_latency_hist *hist,
+                                     double percentile);
+
+/**
+ * Remove all samples from all histograms
+ */
+void osd_latency_stats_reset(struct osd_latency_stats *stats);
+
+/**
+ * Add the histograms of all hops to another set of histograms
+ */
+void osd_latency_stats_merge(struct osd_latency_stats *stats,
+                             const struct osd_latency_stats *other);
+
+/**@}*/ /* end of doxygen group libosd-latency */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // OSD_LATENCY_H
@@ -116,6 +116,16 @@ osd_result osd_memaccess_loadelf(struct osd_memaccess_ctx *ctx,
                                  const struct osd_mem_desc* mem_desc,
                                  const char* elf_file_path, bool verify);
 
+/**
+ * Get the host module used for the memory accesses
+ *
+ * The host module can be used for other accesses to the debug system (e.g.
+ * to enumerate the modules) as long as no memory access is running
+ * concurrently.
+ */
+struct osd_hostmod_ctx* osd_memaccess_get_hostmod(
+    struct osd_memaccess_ctx *ctx);
+
 /**@}*/ /* end of doxygen group libosd-memaccess */
 
 #ifdef __cplusplus
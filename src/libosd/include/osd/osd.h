@@ -24,6 +24,7 @@
 
 #include <inttypes.h>
 #include <stdarg.h>
+#include <stdbool.h>
 #include <stdlib.h>
 #include <syslog.h>
 
@@ -69,6 +70,10 @@ typedef int osd_result;
 #define OSD_ERROR_MEM_VERIFY_FAILED -13
 /** Return code: unexpected module type */
 #define OSD_ERROR_WRONG_MODULE -14
+/** Return code: data is corrupt (integrity check failed) */
+#define OSD_ERROR_CORRUPT -15
+/** Return code: resource temporarily unavailable, try again later */
+#define OSD_ERROR_BUSY -16
 
 /**
  * Return true if |rv| is an error code
@@ -231,6 +236,77 @@ void osd_log_set_caller_ctx(struct osd_log_ctx *ctx, void *caller_ctx);
  */
 void *osd_log_get_caller_ctx(struct osd_log_ctx *ctx);
 
+/**
+ * Statistics of the asynchronous logging mode
+ *
+ * @see osd_log_get_async_stats()
+ */
+struct osd_log_async_stats {
+    /** Number of log records queued */
+    uint64_t num_records;
+    /** Number of log records dropped since the queue of a thread was full */
+    uint64_t num_dropped;
+};
+
+/**
+ * Enable or disable the asynchronous logging mode
+ *
+ * By default, the log function is called synchronously from the thread
+ * creating the log message, serialized by a global lock. In asynchronous
+ * mode, log messages are formatted and queued in a lock-free per-thread
+ * queue instead, and a background thread passes them to the log function
+ * (in the order they were created). If the queue of a thread is full, log
+ * messages are dropped and counted (see osd_log_get_async_stats()).
+ *
+ * In asynchronous mode, the log function is called from the background
+ * thread, and the @p file and @p fn arguments must be string literals (as
+ * they are when using the logging macros). Messages longer than 255
+ * characters are truncated.
+ *
+ * Disabling the asynchronous mode passes all queued messages to the log
+ * function before returning.
+ *
+ * @param ctx the log context
+ * @param async enable (true) or disable (false) the asynchronous mode
+ * @return OSD_OK on success, any other value indicates an error
+ *
+ * @see osd_log_flush()
+ */
+osd_result osd_log_set_async(struct osd_log_ctx *ctx, bool async);
+
+/**
+ * Is the asynchronous logging mode enabled?
+ *
+ * @param ctx the log context
+ * @return true if the asynchronous logging mode is enabled
+ *
+ * @see osd_log_set_async()
+ */
+bool osd_log_is_async(struct osd_log_ctx *ctx);
+
+/**
+ * Pass all queued log messages to the log function
+ *
+ * The log function is called from the calling thread. Use this function
+ * e.g. before terminating the program after a fatal error to ensure all log
+ * messages are written in asynchronous mode. In synchronous mode, this
+ * function does nothing.
+ *
+ * @param ctx the log context
+ *
+ * @see osd_log_set_async()
+ */
+void osd_log_flush(struct osd_log_ctx *ctx);
+
+/**
+ * Get the statistics of the asynchronous logging mode
+ *
+ * @param ctx the log context
+ * @param[out] stats the statistics
+ */
+void osd_log_get_async_stats(struct osd_log_ctx *ctx,
+                             struct osd_log_async_stats *stats);
+
 /**@}*/ /* end of doxygen group libosd-log */
 
 /**
@@ -263,34 +263,34 @@ void osd_packet_dump(const struct osd_packet *packet, FILE *fd);
 void osd_packet_to_string(const struct osd_packet *packet, char **str);
 
 /**
- * Write a packet from a file descriptor
+ * Write a packet to a file
  *
- * In its current implementation this function memory-dumps osd_packet structs
- * to a file, without any encoding. This has some consequences:
+ * The packet is written as its size in words followed by the packet data,
+ * all as 16 bit little endian values. No file header, timestamp or checksum
+ * is written, and each call results in a separate fwrite() call.
  *
- * - The resulting file is in native endianness, i.e. not portable between
- *   little and big endian machines.
- * - No file header is present, or any for of file magic number to identify
- *   the file type.
- * - No file integrity checks, such as checksums.
+ * For storing traces, use the capture file format instead, which adds all
+ * of this and is written in blocks.
  *
  * @param packet the packet to write
  * @param fd the open file descriptor to write to
  * @return bool operation successful?
  *
  * @see osd_packet_fread()
+ * @see osd_capture_writer_new()
  */
 bool osd_packet_fwrite(const struct osd_packet *packet, FILE *fd);
 
 /**
  * Read a packet from an open file descriptor
  *
- * See the discussion in osd_packet_fwrite() for known limitations.
+ * Reads a packet in the format written by osd_packet_fwrite().
  *
  * @param fd an open file descriptor to read from
  * @return the read packet, or NULL if reading failed
  *
  * @see osd_packet_fwrite()
+ * @see osd_capture_reader_new()
  */
 struct osd_packet* osd_packet_fread(FILE *fd);
 
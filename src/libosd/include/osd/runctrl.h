@@ -0,0 +1,210 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OSD_RUNCTRL_H
+#define OSD_RUNCTRL_H
+
+#include <osd/osd.h>
+#include <osd/hostmod.h>
+#include <osd/cl_cdm.h>
+
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup libosd-runctrl Run Control
+ * @ingroup libosd
+ *
+ * Stall (halt) and release (resume) a set of CPU cores at the same time.
+ *
+ * The cores are controlled through their Core Debug Modules (CDM). The
+ * CORE_CTRL register writes to all CDMs are sent back-to-back as one batch of
+ * register accesses, without waiting for the response of one write before
+ * sending the next one. The stall events sent by the CDMs are collected to
+ * determine the state of the cores and the achieved skew.
+ *
+ * @{
+ */
+
+struct osd_runctrl_ctx;
+
+/**
+ * Statistics of a synchronized stall or release
+ */
+struct osd_runctrl_sync_stats {
+    /** Number of controlled cores */
+    size_t num_cores;
+
+    /**
+     * Time from sending the first CORE_CTRL write until the responses to all
+     * writes have been received (ns)
+     */
+    uint64_t write_ns;
+
+    /** Number of cores which confirmed the new state with a stall event */
+    size_t num_events;
+
+    /**
+     * Time between the first and the last confirming stall event, as
+     * received by the host (ns). Only valid if num_events > 1.
+     */
+    uint64_t event_skew_ns;
+};
+
+/**
+ * Handler for stall events
+ *
+ * Called from the I/O thread of the host module for every stall event,
+ * including cores stalling by themselves (e.g. on a breakpoint).
+ *
+ * @param arg the argument given to osd_runctrl_set_stall_handler()
+ * @param core index of the core (in the order the cores were added)
+ * @param stalled the core is stalled
+ */
+typedef void (*osd_runctrl_stall_handler_fn)(void *arg, unsigned int core,
+                                             bool stalled);
+
+/**
+ * Maximum time to wait for the stall events confirming a synchronized stall
+ * or release (ms)
+ */
+#define OSD_RUNCTRL_EVENT_TIMEOUT_MS 100
+
+/**
+ * Create a new context object
+ */
+osd_result osd_runctrl_new(struct osd_runctrl_ctx **ctx,
+                           struct osd_log_ctx *log_ctx,
+                           const char *host_controller_address);
+
+/**
+ * @copydoc osd_hostmod_connect()
+ */
+osd_result osd_runctrl_connect(struct osd_runctrl_ctx *ctx);
+
+/**
+ * @copydoc osd_hostmod_disconnect()
+ */
+osd_result osd_runctrl_disconnect(struct osd_runctrl_ctx *ctx);
+
+/**
+ * @copydoc osd_hostmod_is_connected()
+ */
+bool osd_runctrl_is_connected(struct osd_runctrl_ctx *ctx);
+
+/**
+ * Free the context object
+ */
+void osd_runctrl_free(struct osd_runctrl_ctx **ctx_p);
+
+/**
+ * Add cores to be controlled
+ *
+ * The CDMs are described and configured to send their events to this
+ * context.
+ *
+ * @param ctx the context object
+ * @param cdm_diaddrs DI addresses of the CDMs of the cores
+ * @param num_cdms number of entries in @p cdm_diaddrs
+ * @return OSD_OK on success
+ *         OSD_ERROR_WRONG_MODULE if one of the modules is not a CDM
+ *         any other value indicates an error
+ */
+osd_result osd_runctrl_add_cores(struct osd_runctrl_ctx *ctx,
+                                 const unsigned int *cdm_diaddrs,
+                                 size_t num_cdms);
+
+/**
+ * Get the number of controlled cores
+ */
+size_t osd_runctrl_get_num_cores(struct osd_runctrl_ctx *ctx);
+
+/**
+ * Get the descriptor of the CDM of a core
+ *
+ * The descriptor can be used with the CPU register access functions of the
+ * CDM client (see osd_cl_cdm_cpureg_read_bulk()).
+ *
+ * @param ctx the context object
+ * @param core index of the core
+ * @return the descriptor, owned by @p ctx. It is valid until the next call to
+ *         osd_runctrl_add_cores().
+ */
+struct osd_cdm_desc* osd_runctrl_get_cdm_desc(struct osd_runctrl_ctx *ctx,
+                                              unsigned int core);
+
+/**
+ * Register a function to be called for every stall event
+ *
+ * @param ctx the context object
+ * @param handler the handler function, NULL to remove the handler
+ * @param arg argument passed to @p handler
+ */
+void osd_runctrl_set_stall_handler(struct osd_runctrl_ctx *ctx,
+                                   osd_runctrl_stall_handler_fn handler,
+                                   void *arg);
+
+/**
+ * Stall all cores as simultaneously as possible
+ *
+ * After writing the CORE_CTRL registers of all CDMs this function waits up
+ * to OSD_RUNCTRL_EVENT_TIMEOUT_MS for all cores to confirm the stall with an
+ * event.
+ *
+ * @param ctx the context object
+ * @param[out] stats statistics of the operation. Can be NULL.
+ * @return OSD_OK if all CORE_CTRL registers were written successfully
+ *         any other value indicates an error
+ *
+ * @see osd_runctrl_release()
+ */
+osd_result osd_runctrl_stall(struct osd_runctrl_ctx *ctx,
+                             struct osd_runctrl_sync_stats *stats);
+
+/**
+ * Release (resume) all cores as simultaneously as possible
+ *
+ * @param ctx the context object
+ * @param[out] stats statistics of the operation. Can be NULL.
+ * @return OSD_OK if all CORE_CTRL registers were written successfully
+ *         any other value indicates an error
+ *
+ * @see osd_runctrl_stall()
+ */
+osd_result osd_runctrl_release(struct osd_runctrl_ctx *ctx,
+                               struct osd_runctrl_sync_stats *stats);
+
+/**
+ * Is a core stalled?
+ *
+ * The state is initialized from the CORE_CTRL register when the core is
+ * added with osd_runctrl_add_cores() and updated with every stall event of
+ * the core afterwards.
+ *
+ * @param ctx the context object
+ * @param core index of the core
+ */
+bool osd_runctrl_is_stalled(struct osd_runctrl_ctx *ctx, unsigned int core);
+
+/**@}*/ /* end of doxygen group libosd-runctrl */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // OSD_RUNCTRL_H
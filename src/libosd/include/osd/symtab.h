@@ -0,0 +1,136 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OSD_SYMTAB_H
+#define OSD_SYMTAB_H
+
+#include <osd/osd.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup libosd-symtab Symbol Table
+ * @ingroup libosd
+ *
+ * Address to function name mapping, typically read from an ELF file.
+ *
+ * The table is kept sorted by address; all lookups are binary searches.
+ * Lookup functions do not modify the table and can be called from multiple
+ * threads concurrently, as long as no other thread adds symbols at the same
+ * time.
+ *
+ * @{
+ */
+
+struct osd_symtab_ctx;
+
+/**
+ * A function symbol
+ */
+struct osd_symtab_entry {
+    uint64_t addr; //!< start address of the function
+    uint64_t size; //!< size of the function in bytes, 0 if unknown
+    char *name; //!< name of the function
+};
+
+/**
+ * Create a new (empty) symbol table
+ */
+osd_result osd_symtab_new(struct osd_symtab_ctx **ctx,
+                          struct osd_log_ctx *log_ctx);
+
+/**
+ * Free the symbol table
+ */
+void osd_symtab_free(struct osd_symtab_ctx **ctx_p);
+
+/**
+ * Add all function symbols from an ELF file to the symbol table
+ *
+ * @param ctx the context object
+ * @param elf_filename path to the ELF file
+ * @return OSD_OK on success
+ *         OSD_ERROR_FILE if the file cannot be opened
+ *         any other value indicates an error
+ */
+osd_result osd_symtab_load_elf(struct osd_symtab_ctx *ctx,
+                               const char *elf_filename);
+
+/**
+ * Add a single symbol to the symbol table
+ *
+ * @param ctx the context object
+ * @param addr start address of the function
+ * @param size size of the function in bytes, 0 if unknown
+ * @param name name of the function (copied)
+ * @return OSD_OK on success, any other value indicates an error
+ */
+osd_result osd_symtab_add(struct osd_symtab_ctx *ctx, uint64_t addr,
+                          uint64_t size, const char *name);
+
+/**
+ * Get the number of symbols in the symbol table
+ */
+size_t osd_symtab_get_count(const struct osd_symtab_ctx *ctx);
+
+/**
+ * Get a symbol by its index
+ *
+ * Symbols are sorted by address, the index is stable as long as no symbols
+ * are added to the table.
+ *
+ * @param ctx the context object
+ * @param idx index of the symbol, must be smaller than osd_symtab_get_count()
+ * @return the symbol
+ */
+const struct osd_symtab_entry *osd_symtab_get(const struct osd_symtab_ctx *ctx,
+                                              size_t idx);
+
+/**
+ * Find the symbol starting exactly at an address
+ *
+ * @param ctx the context object
+ * @param addr the address to look up
+ * @return the symbol, or NULL if no symbol starts at @p addr
+ */
+const struct osd_symtab_entry *osd_symtab_find(const struct osd_symtab_ctx *ctx,
+                                               uint64_t addr);
+
+/**
+ * Find the symbol containing an address
+ *
+ * This is the symbol with the highest start address which is not larger
+ * than @p addr. Addresses below the first symbol are attributed to the first
+ * symbol.
+ *
+ * @param ctx the context object
+ * @param addr the address to look up
+ * @return the symbol, or NULL if the symbol table is empty
+ */
+const struct osd_symtab_entry *osd_symtab_find_containing(
+    const struct osd_symtab_ctx *ctx, uint64_t addr);
+
+/**@}*/ /* end of doxygen group libosd-symtab */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // OSD_SYMTAB_H
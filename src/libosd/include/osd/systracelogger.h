@@ -18,6 +18,9 @@
 
 #include <osd/osd.h>
 #include <osd/hostmod.h>
+#include <osd/cl_stm.h>
+#include <osd/tracepipe.h>
+#include <osd/tracestream.h>
 
 #include <stdlib.h>
 
@@ -76,16 +79,62 @@ osd_result osd_systracelogger_stop(struct osd_systracelogger_ctx *ctx);
 
 /**
  * Set a file to write all sysprint output to
+ *
+ * All outputs must be set before the logger is started.
+ *
+ * @return OSD_OK if successful
+ *         OSD_ERROR_FAILURE if the logger is running
  */
 osd_result osd_systracelogger_set_sysprint_log(
         struct osd_systracelogger_ctx *ctx, FILE *fp);
 
 /**
  * Set a file to write all received STM events to
+ *
+ * All outputs must be set before the logger is started.
+ *
+ * @return OSD_OK if successful
+ *         OSD_ERROR_FAILURE if the logger is running
  */
 osd_result osd_systracelogger_set_event_log(struct osd_systracelogger_ctx *ctx,
                                             FILE *fp);
 
+/**
+ * Set a trace stream to publish all received STM events to
+ *
+ * The stream must not be freed before the system trace logger. All outputs
+ * must be set before the logger is started.
+ *
+ * @return OSD_OK if successful
+ *         OSD_ERROR_FAILURE if the logger is running
+ */
+osd_result osd_systracelogger_set_stream(struct osd_systracelogger_ctx *ctx,
+                                         struct osd_tracestream_ctx *stream);
+
+/**
+ * Get the trace pipeline processing the received STM events
+ *
+ * Stages added to the pipeline before the logger is started run before the
+ * outputs of the logger, e.g. to filter the logged events or to add
+ * additional outputs.
+ */
+struct osd_tracepipe_ctx *osd_systracelogger_get_tracepipe(
+    struct osd_systracelogger_ctx *ctx);
+
+/**
+ * Write a STM event in the event log format
+ *
+ * This is the output format used by the event log of the system trace
+ * logger. It is exposed to convert recorded traces offline into the same
+ * format.
+ *
+ * @param fp file to write the event to
+ * @param event the event to write
+ * @return OSD_OK on success
+ *         OSD_ERROR_FILE if writing to @p fp failed
+ */
+osd_result osd_systracelogger_format_event(FILE *fp,
+                                           const struct osd_stm_event *event);
 
 /**@}*/ /* end of doxygen group libosd-systracelogger */
 
@@ -18,6 +18,7 @@
 
 #include <pthread.h>
 #include <stdlib.h>
+#include <time.h>
 
 #include <osd/cl_dem_uart.h>
 #include <osd/hostmod.h>
@@ -30,6 +31,32 @@ extern "C" {
 
 struct osd_terminal_ctx;
 
+/**
+ * Data transfer statistics of a terminal
+ *
+ * Data received from the DEM-UART is buffered and written to the device file
+ * in chunks; rx_writes / rx_chars gives the number of write() system calls
+ * per character.
+ *
+ * @see osd_terminal_get_stats()
+ */
+struct osd_terminal_stats {
+    /** Time the terminal was started (CLOCK_MONOTONIC) */
+    struct timespec start_time;
+
+    /** Characters received from the DEM-UART */
+    uint64_t rx_chars;
+
+    /** write() calls to the device file */
+    uint64_t rx_writes;
+
+    /** Characters sent to the DEM-UART */
+    uint64_t tx_chars;
+
+    /** read() calls on the device file */
+    uint64_t tx_reads;
+};
+
 /**
  * Create a new osd_terminal.
  *
@@ -137,6 +164,17 @@ bool osd_terminal_is_started(struct osd_terminal_ctx *ctx);
  */
 const char *osd_terminal_get_pts_path(struct osd_terminal_ctx *ctx);
 
+/**
+ * Get the data transfer statistics of this terminal
+ *
+ * The statistics are reset when the terminal is started.
+ *
+ * @param ctx the context of the terminal
+ * @param[out] stats the statistics
+ */
+void osd_terminal_get_stats(struct osd_terminal_ctx *ctx,
+                            struct osd_terminal_stats *stats);
+
 #ifdef __cplusplus
 }
 #endif
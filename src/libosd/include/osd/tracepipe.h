@@ -0,0 +1,446 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OSD_TRACEPIPE_H
+#define OSD_TRACEPIPE_H
+
+#include <osd/osd.h>
+#include <osd/cl_cdm.h>
+#include <osd/cl_ctm.h>
+#include <osd/cl_dem_uart.h>
+#include <osd/cl_stm.h>
+#include <osd/packet.h>
+#include <osd/symtab.h>
+#include <osd/tracestream.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup libosd-tracepipe Trace Pipeline
+ * @ingroup libosd
+ *
+ * Process decoded trace events in a chain of stages.
+ *
+ * A trace pipeline is fed by one or more sources, which decode event packets
+ * from STM, CTM, CDM or DEM-UART modules into trace events. The events pass
+ * through a list of stages in the order the stages were added: transform
+ * stages (filter, timestamp unwrapping, merging, symbolization) modify the
+ * events, sinks (text, binary, trace stream, counters) write them out.
+ * Custom stages can be added with osd_tracepipe_add_stage().
+ *
+ * Events are passed between the stages in batches. A batch is passed on when
+ * it is full, when osd_tracepipe_flush() is called, or at the latest
+ * OSD_TRACEPIPE_MAX_LATENCY_MS after its first event was pushed.
+ *
+ * @par Threading
+ * By default all stages run in the thread pushing the events (e.g. the I/O
+ * thread of a host module). A stage added with the flag
+ * OSD_TRACEPIPE_THREADED runs, together with all stages after it, in a
+ * separate thread. Batches are handed over to this thread through a bounded
+ * queue; if the queue is full, the previous stage waits until space is
+ * available. Each stage is only ever called from one thread at a time.
+ *
+ * @{
+ */
+
+/**
+ * Default number of events in a batch
+ */
+#define OSD_TRACEPIPE_BATCH_SIZE_DEFAULT 256
+
+/**
+ * Default number of batches queued in front of a threaded stage
+ */
+#define OSD_TRACEPIPE_QUEUE_DEPTH_DEFAULT 16
+
+/**
+ * Maximum time an event waits in an incomplete batch, in milliseconds
+ */
+#define OSD_TRACEPIPE_MAX_LATENCY_MS 10
+
+/**
+ * Run the stage, and all following stages, in a separate thread
+ */
+#define OSD_TRACEPIPE_THREADED 0x1
+
+/**
+ * Type of a trace event
+ */
+enum osd_trace_event_type {
+    OSD_TRACE_EVENT_STM = 1, //!< event from a System Trace Module
+    OSD_TRACE_EVENT_CTM = 2, //!< event from a Core Trace Module
+    OSD_TRACE_EVENT_CDM = 3, //!< event from a Core Debug Module
+    OSD_TRACE_EVENT_DEM_UART = 4, //!< character sent by a UART DEM
+};
+
+/**
+ * A trace event in the pipeline
+ */
+struct osd_trace_event {
+    enum osd_trace_event_type type; //!< type of the event
+    uint16_t di_addr; //!< DI address of the module which sent the event
+
+    /** host time when the event was received, ns since the Unix epoch */
+    uint64_t host_ns;
+
+    /**
+     * Target timestamp of the event
+     *
+     * The 32 bit timestamp of STM and CTM events, extended to 64 bit by the
+     * unwrap stage. Zero for events without timestamp.
+     */
+    uint64_t timestamp;
+
+    /**
+     * Function containing the address executed after the event (CTM only,
+     * set by the symbolize stage)
+     */
+    const struct osd_symtab_entry *sym_to;
+
+    /**
+     * Function containing the address of the traced instruction (CTM only,
+     * set by the symbolize stage)
+     */
+    const struct osd_symtab_entry *sym_from;
+
+    /** Event data, depending on the type */
+    union {
+        struct osd_stm_event stm; //!< OSD_TRACE_EVENT_STM
+        struct osd_ctm_event ctm; //!< OSD_TRACE_EVENT_CTM
+        struct osd_cdm_event cdm; //!< OSD_TRACE_EVENT_CDM
+        char dem_uart; //!< OSD_TRACE_EVENT_DEM_UART
+    } data;
+};
+
+/**
+ * A batch of trace events
+ */
+struct osd_trace_batch {
+    struct osd_trace_event *events; //!< the events
+    size_t num_events; //!< number of valid events in |events|
+    size_t capacity; //!< allocated size of |events|
+};
+
+/**
+ * Append an event to a batch
+ *
+ * @return the new (uninitialized) event at the end of the batch
+ */
+struct osd_trace_event *osd_trace_batch_append(struct osd_trace_batch *batch);
+
+/**
+ * Stage in a trace pipeline
+ */
+struct osd_tracepipe_stage_ops {
+    /**
+     * Process a batch of events
+     *
+     * Transform stages can change, remove or add events in the batch; the
+     * resulting batch is passed to the next stage. Sinks leave the batch
+     * unchanged. Only called for non-empty batches.
+     *
+     * @param arg the stage argument passed to osd_tracepipe_add_stage()
+     * @param batch the events
+     * @return OSD_OK on success. Errors are logged and counted, the batch is
+     *         passed on anyway.
+     */
+    osd_result (*process)(void *arg, struct osd_trace_batch *batch);
+
+    /**
+     * Flush the stage (optional)
+     *
+     * Called by osd_tracepipe_flush() after all preceding stages have been
+     * flushed. Stages holding back events add them to @p batch, which is
+     * passed on to the next stage; sinks write out buffered data.
+     */
+    osd_result (*flush)(void *arg, struct osd_trace_batch *batch);
+
+    /**
+     * Free the stage argument (optional)
+     *
+     * Called when the pipeline is freed.
+     */
+    void (*free)(void *arg);
+};
+
+/**
+ * Statistics of a pipeline
+ */
+struct osd_tracepipe_stats {
+    uint64_t events; //!< events pushed into the pipeline
+    uint64_t batches; //!< batches passed into the pipeline
+    uint64_t queue_full; //!< number of waits for space in a stage queue
+    uint64_t stage_errors; //!< failed calls to process() or flush()
+};
+
+struct osd_tracepipe_ctx;
+
+/**
+ * Create a new trace pipeline
+ *
+ * @param ctx the context object
+ * @param log_ctx the log context to use
+ * @param batch_size number of events in a batch, 0 for
+ *                   OSD_TRACEPIPE_BATCH_SIZE_DEFAULT
+ * @param queue_depth number of batches queued in front of a threaded stage,
+ *                    0 for OSD_TRACEPIPE_QUEUE_DEPTH_DEFAULT
+ * @return OSD_OK on success, any other value indicates an error
+ */
+osd_result osd_tracepipe_new(struct osd_tracepipe_ctx **ctx,
+                             struct osd_log_ctx *log_ctx, size_t batch_size,
+                             unsigned int queue_depth);
+
+/**
+ * Flush and free the pipeline, including all stages
+ */
+void osd_tracepipe_free(struct osd_tracepipe_ctx **ctx_p);
+
+/**
+ * Add a stage to the end of the pipeline
+ *
+ * Stages can only be added before osd_tracepipe_start() is called.
+ *
+ * @param ctx the context object
+ * @param ops the stage functions. The structure is copied.
+ * @param arg argument passed to all stage functions
+ * @param flags OSD_TRACEPIPE_THREADED or 0
+ * @return OSD_OK on success
+ *         OSD_ERROR_FAILURE if the pipeline is already running
+ */
+osd_result osd_tracepipe_add_stage(struct osd_tracepipe_ctx *ctx,
+                                   const struct osd_tracepipe_stage_ops *ops,
+                                   void *arg, unsigned int flags);
+
+/**
+ * Start the pipeline
+ *
+ * Starts the threads of all threaded stages. Events can only be pushed into a
+ * running pipeline.
+ */
+osd_result osd_tracepipe_start(struct osd_tracepipe_ctx *ctx);
+
+/**
+ * Is the pipeline running?
+ */
+bool osd_tracepipe_is_running(struct osd_tracepipe_ctx *ctx);
+
+/**
+ * Push an event into the pipeline
+ *
+ * This function can be called from multiple threads.
+ *
+ * @return OSD_OK on success
+ *         OSD_ERROR_FAILURE if the pipeline is not running
+ */
+osd_result osd_tracepipe_push(struct osd_tracepipe_ctx *ctx,
+                              const struct osd_trace_event *event);
+
+/**
+ * Pass all pushed events through the pipeline and flush all stages
+ *
+ * Returns after all stages have been flushed.
+ */
+osd_result osd_tracepipe_flush(struct osd_tracepipe_ctx *ctx);
+
+/**
+ * Get the statistics of the pipeline
+ */
+osd_result osd_tracepipe_get_stats(struct osd_tracepipe_ctx *ctx,
+                                   struct osd_tracepipe_stats *stats);
+
+/**
+ * A source of trace events: a decoder for the event packets of one module
+ *
+ * Pass osd_tracepipe_handle_packet() as event handler and a source as its
+ * argument to osd_hostmod_new() to feed the events received by the host
+ * module into a pipeline.
+ */
+struct osd_tracepipe_source {
+    struct osd_tracepipe_ctx *pipe; //!< pipeline to push the events into
+    enum osd_trace_event_type type; //!< type of the module
+
+    /** Descriptor of the module, depending on the type */
+    union {
+        const struct osd_stm_desc *stm;
+        const struct osd_ctm_desc *ctm;
+        const struct osd_cdm_desc *cdm;
+        const struct osd_dem_uart_desc *dem_uart;
+    } desc;
+};
+
+/**
+ * Decode an event packet into a trace event
+ *
+ * @param source the source describing the module which sent the packet
+ * @param pkg the event packet
+ * @param[out] event the decoded event
+ * @return OSD_OK on success
+ *         OSD_ERROR_DEVICE_INVALID_DATA if the packet is not a valid event
+ */
+osd_result osd_tracepipe_source_decode(
+    const struct osd_tracepipe_source *source, const struct osd_packet *pkg,
+    struct osd_trace_event *event);
+
+/**
+ * Decode an event packet and push the event into the pipeline of the source
+ *
+ * Event handler to be passed to a hostmod instance, with a
+ * struct osd_tracepipe_source as argument. Invalid packets are dropped.
+ */
+osd_result osd_tracepipe_handle_packet(void *arg, struct osd_packet *pkg);
+
+/**
+ * Decide if an event is passed on by a filter stage
+ *
+ * @return true to keep the event, false to drop it
+ */
+typedef bool (*osd_tracepipe_filter_fn)(
+    void * /* arg */, const struct osd_trace_event * /* ev */);
+
+/**
+ * Add a stage dropping all events for which @p fn returns false
+ */
+osd_result osd_tracepipe_add_filter(struct osd_tracepipe_ctx *ctx,
+                                    osd_tracepipe_filter_fn fn, void *fn_arg,
+                                    unsigned int flags);
+
+/**
+ * Add a stage extending the 32 bit timestamps of STM and CTM events to 64 bit
+ *
+ * Wrap-arounds are detected separately for each module.
+ */
+osd_result osd_tracepipe_add_unwrap(struct osd_tracepipe_ctx *ctx,
+                                    unsigned int flags);
+
+/**
+ * Add a stage ordering the events of multiple sources by their timestamp
+ *
+ * The stage holds back @p window events and passes on the oldest ones. Events
+ * are therefore only ordered correctly if they arrive out of order by no more
+ * than @p window events. Add an unwrap stage before this stage.
+ *
+ * @param ctx the context object
+ * @param window number of events held back by the stage
+ * @param flags OSD_TRACEPIPE_THREADED or 0
+ */
+osd_result osd_tracepipe_add_merge(struct osd_tracepipe_ctx *ctx,
+                                   size_t window, unsigned int flags);
+
+/**
+ * Add a stage setting the functions of CTM events
+ *
+ * @param ctx the context object
+ * @param symtab the symbol table. It must not be modified or freed before
+ *               the pipeline.
+ * @param flags OSD_TRACEPIPE_THREADED or 0
+ */
+osd_result osd_tracepipe_add_symbolize(struct osd_tracepipe_ctx *ctx,
+                                       const struct osd_symtab_ctx *symtab,
+                                       unsigned int flags);
+
+/**
+ * Add a sink writing events in the text formats of the trace loggers
+ *
+ * STM events are written as by osd_systracelogger_format_event(), CTM events
+ * as by osd_coretracelogger_format_event(). Characters from a DEM-UART are
+ * written as they are, CDM events as "stall 0|1".
+ *
+ * @param ctx the context object
+ * @param fp the file to write to. It is not closed by the pipeline.
+ * @param symtab symbol table to translate CTM addresses into function names,
+ *               or NULL
+ * @param flags OSD_TRACEPIPE_THREADED or 0
+ */
+osd_result osd_tracepipe_add_text_sink(struct osd_tracepipe_ctx *ctx, FILE *fp,
+                                       const struct osd_symtab_ctx *symtab,
+                                       unsigned int flags);
+
+/**
+ * Add a sink writing the text printed through STM sysprint events
+ *
+ * @param ctx the context object
+ * @param fp the file to write to. It is not closed by the pipeline.
+ * @param flags OSD_TRACEPIPE_THREADED or 0
+ */
+osd_result osd_tracepipe_add_sysprint_sink(struct osd_tracepipe_ctx *ctx,
+                                           FILE *fp, unsigned int flags);
+
+/**
+ * Add a sink writing STM and CTM events in a binary format
+ *
+ * Each event is written as one record in the format used by the trace stream
+ * (see @ref libosd-tracestream); the host time in the record header is the
+ * time the event was received. Other events are skipped.
+ *
+ * @param ctx the context object
+ * @param fp the file to write to. It is not closed by the pipeline.
+ * @param flags OSD_TRACEPIPE_THREADED or 0
+ */
+osd_result osd_tracepipe_add_binary_sink(struct osd_tracepipe_ctx *ctx,
+                                         FILE *fp, unsigned int flags);
+
+/**
+ * Add a sink publishing STM and CTM events to a trace stream
+ *
+ * @param ctx the context object
+ * @param stream the trace stream. It must not be freed before the pipeline.
+ * @param flags OSD_TRACEPIPE_THREADED or 0
+ */
+osd_result osd_tracepipe_add_stream_sink(struct osd_tracepipe_ctx *ctx,
+                                         struct osd_tracestream_ctx *stream,
+                                         unsigned int flags);
+
+/**
+ * Event counters, filled by the counter sink
+ */
+struct osd_trace_counters {
+    uint64_t stm_events; //!< STM events (excluding overflow events)
+    uint64_t stm_print_events; //!< STM sysprint events
+    uint64_t ctm_events; //!< CTM events (excluding overflow events)
+    uint64_t ctm_calls; //!< CTM function calls
+    uint64_t ctm_returns; //!< CTM function returns
+    uint64_t cdm_events; //!< CDM events
+    uint64_t dem_uart_chars; //!< characters from DEM-UARTs
+    uint64_t overflowed_events; //!< events lost according to overflow events
+};
+
+/**
+ * Add a sink counting events
+ *
+ * The counters are updated from the pipeline; read them only after
+ * osd_tracepipe_flush() returned and while no new events are pushed.
+ *
+ * @param ctx the context object
+ * @param counters the counters to update. They are not reset.
+ * @param flags OSD_TRACEPIPE_THREADED or 0
+ */
+osd_result osd_tracepipe_add_counter_sink(struct osd_tracepipe_ctx *ctx,
+                                          struct osd_trace_counters *counters,
+                                          unsigned int flags);
+
+/**@}*/ /* end of doxygen group libosd-tracepipe */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // OSD_TRACEPIPE_H
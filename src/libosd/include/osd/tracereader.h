@@ -0,0 +1,136 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OSD_TRACEREADER_H
+#define OSD_TRACEREADER_H
+
+#include <osd/osd.h>
+#include <osd/cl_ctm.h>
+#include <osd/cl_stm.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup libosd-tracereader Trace Reader
+ * @ingroup libosd
+ *
+ * Decode STM and CTM events from a capture file in large batches.
+ *
+ * The reader takes the event packets of one or all trace modules from a
+ * capture file (see @ref libosd-capture), reassembles events which are split
+ * across multiple packets (EV_CONT) and decodes them into arrays of
+ * struct osd_stm_event or struct osd_ctm_event. This is the same decoding as
+ * done by osd-trace-convert, but without formatting the events as text, which
+ * makes it suitable for analysis tools and language bindings.
+ *
+ * Packets which cannot be decoded are skipped and counted in the statistics.
+ * Events which are still incomplete at the end of the capture are dropped.
+ *
+ * @{
+ */
+
+/**
+ * Statistics of a trace reader
+ */
+struct osd_tracereader_stats {
+    uint64_t packets; //!< packets read from the capture
+    uint64_t events; //!< decoded events (excluding overflow events)
+    uint64_t overflowed_events; //!< events lost according to overflow events
+    uint64_t invalid_packets; //!< event packets which could not be decoded
+};
+
+struct osd_tracereader_ctx;
+
+/**
+ * Open a capture file for decoding
+ *
+ * @param ctx the context object
+ * @param log_ctx the log context to use
+ * @param filename path of the capture file
+ * @param source DI address of the trace module whose events are decoded, or
+ *               -1 to decode the events of all modules
+ * @return OSD_OK on success
+ *         OSD_ERROR_FILE if the file cannot be opened or is not a capture file
+ */
+osd_result osd_tracereader_new(struct osd_tracereader_ctx **ctx,
+                               struct osd_log_ctx *log_ctx,
+                               const char *filename, int source);
+
+/**
+ * Free the reader and close the capture file
+ */
+void osd_tracereader_free(struct osd_tracereader_ctx **ctx_p);
+
+/**
+ * Decode the next STM events
+ *
+ * @param ctx the context object
+ * @param stm_desc descriptor of the STM(s) which emitted the events
+ * @param[out] events the decoded events
+ * @param max_events number of elements in @p events
+ * @param[out] num_events number of decoded events. Less than @p max_events
+ *                        only at the end of the capture; 0 if all events
+ *                        have been read.
+ * @return OSD_OK on success
+ *         OSD_ERROR_CORRUPT if the capture file is corrupt or truncated
+ */
+osd_result osd_tracereader_read_stm(struct osd_tracereader_ctx *ctx,
+                                    const struct osd_stm_desc *stm_desc,
+                                    struct osd_stm_event *events,
+                                    size_t max_events, size_t *num_events);
+
+/**
+ * Decode the next CTM events
+ *
+ * @param ctx the context object
+ * @param ctm_desc descriptor of the CTM(s) which emitted the events
+ * @param[out] events the decoded events
+ * @param max_events number of elements in @p events
+ * @param[out] num_events number of decoded events. Less than @p max_events
+ *                        only at the end of the capture; 0 if all events
+ *                        have been read.
+ * @return OSD_OK on success
+ *         OSD_ERROR_CORRUPT if the capture file is corrupt or truncated
+ */
+osd_result osd_tracereader_read_ctm(struct osd_tracereader_ctx *ctx,
+                                    const struct osd_ctm_desc *ctm_desc,
+                                    struct osd_ctm_event *events,
+                                    size_t max_events, size_t *num_events);
+
+/**
+ * Restart decoding at the beginning of the capture
+ *
+ * The statistics are reset as well.
+ */
+osd_result osd_tracereader_rewind(struct osd_tracereader_ctx *ctx);
+
+/**
+ * Get the statistics of the reader since it was created or rewound
+ */
+void osd_tracereader_get_stats(struct osd_tracereader_ctx *ctx,
+                               struct osd_tracereader_stats *stats);
+
+/**@}*/ /* end of doxygen group libosd-tracereader */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // OSD_TRACEREADER_H
@@ -0,0 +1,221 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef OSD_TRACESTREAM_H
+#define OSD_TRACESTREAM_H
+
+#include <osd/osd.h>
+#include <osd/cl_ctm.h>
+#include <osd/cl_stm.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * @defgroup libosd-tracestream Trace Stream
+ * @ingroup libosd
+ *
+ * Publish decoded trace events to local subscribers over a Unix domain
+ * socket.
+ *
+ * @par Protocol
+ * A subscriber connects to the stream socket and sends a subscribe request
+ * (8 bytes):
+ *
+ * - 4 bytes: magic number "OSDT"
+ * - u8: protocol version (OSD_TRACESTREAM_PROTOCOL_VERSION)
+ * - u8: policy, see enum osd_tracestream_policy
+ * - u16: sample interval (only used by OSD_TRACESTREAM_POLICY_SAMPLE)
+ *
+ * The sink then sends a stream of records to the subscriber. All records start
+ * with a record header (16 bytes):
+ *
+ * - u16: record type, see enum osd_tracestream_record_type
+ * - u16: length of the record in bytes, including the header
+ * - u16: DI address of the module which generated the event
+ * - u16: reserved (0)
+ * - u64: host time when the event was published, in ns since the Unix epoch
+ *
+ * The remaining fields depend on the record type:
+ *
+ * - OSD_TRACESTREAM_RECORD_LOST: u64 number of records which were not
+ *   delivered to the subscriber since the previous record
+ * - OSD_TRACESTREAM_RECORD_STM: u32 timestamp, u16 id, u16 overflow,
+ *   u64 value
+ * - OSD_TRACESTREAM_RECORD_CTM: u32 timestamp, u16 overflow, u8 mode,
+ *   u8 flags (bit 0: is_ret, bit 1: is_call, bit 2: is_modechange),
+ *   u64 npc, u64 pc
+ *
+ * All values are little endian. Consumers must skip records of unknown
+ * types using the record length.
+ *
+ * @par Threading
+ * The publish functions are called from the thread receiving the trace (e.g.
+ * the I/O thread of the host module). They only copy the event into an input
+ * buffer; all socket I/O is done in a separate thread. Slow subscribers
+ * therefore never delay the receiving thread: if the input buffer is full,
+ * events are dropped and counted as overruns.
+ *
+ * @{
+ */
+
+/**
+ * Version of the trace stream protocol
+ */
+#define OSD_TRACESTREAM_PROTOCOL_VERSION 1
+
+/**
+ * Default size of the per-subscriber queue (and the input buffer) in bytes
+ */
+#define OSD_TRACESTREAM_QUEUE_SIZE_DEFAULT (1024 * 1024)
+
+/**
+ * What to do with new events if a subscriber cannot keep up
+ */
+enum osd_tracestream_policy {
+    /**
+     * Don't drop events for this subscriber; delivery of new events to all
+     * subscribers waits until the subscriber has space in its queue again.
+     * If the input buffer of the sink runs full in the meantime, events are
+     * dropped at the input (for all subscribers).
+     */
+    OSD_TRACESTREAM_POLICY_BLOCK = 0,
+
+    /** Drop the oldest queued events to make space for new ones */
+    OSD_TRACESTREAM_POLICY_DROP_OLDEST = 1,
+
+    /**
+     * Deliver only every n-th event while the queue is more than half full,
+     * and drop new events if it is full.
+     */
+    OSD_TRACESTREAM_POLICY_SAMPLE = 2,
+};
+
+/**
+ * Record types in the stream
+ */
+enum osd_tracestream_record_type {
+    OSD_TRACESTREAM_RECORD_LOST = 1, //!< events were dropped
+    OSD_TRACESTREAM_RECORD_STM = 2, //!< STM event
+    OSD_TRACESTREAM_RECORD_CTM = 3, //!< CTM event
+};
+
+/**
+ * Statistics of the sink
+ */
+struct osd_tracestream_stats {
+    uint64_t published_records; //!< records published
+    uint64_t overrun_records; //!< records dropped since the input was full
+    unsigned int num_subscribers; //!< currently connected subscribers
+};
+
+/**
+ * Statistics of a single subscriber
+ */
+struct osd_tracestream_subscriber_stats {
+    enum osd_tracestream_policy policy; //!< policy chosen by the subscriber
+    uint64_t sent_records; //!< records sent to the subscriber
+    uint64_t sent_bytes; //!< bytes sent to the subscriber
+    uint64_t dropped_records; //!< records not delivered to the subscriber
+    size_t lag_records; //!< records waiting to be sent
+    size_t lag_bytes; //!< bytes waiting to be sent
+    size_t max_lag_bytes; //!< maximum of lag_bytes since subscribing
+    uint64_t lag_ns; //!< age of the oldest record waiting to be sent
+};
+
+struct osd_tracestream_ctx;
+
+/**
+ * Create a new trace stream sink and start listening for subscribers
+ *
+ * An existing file at @p socket_path is replaced.
+ *
+ * @param ctx the context object
+ * @param log_ctx the log context to use
+ * @param socket_path path of the Unix domain socket to create
+ * @param queue_size size of the input buffer and of the queue of each
+ *                   subscriber in bytes. Use 0 for
+ *                   OSD_TRACESTREAM_QUEUE_SIZE_DEFAULT.
+ * @return OSD_OK on success
+ *         OSD_ERROR_FAILURE if the socket could not be created
+ */
+osd_result osd_tracestream_new(struct osd_tracestream_ctx **ctx,
+                               struct osd_log_ctx *log_ctx,
+                               const char *socket_path, size_t queue_size);
+
+/**
+ * Stop the sink, disconnect all subscribers and free the context
+ *
+ * Events which were not sent yet are discarded.
+ */
+void osd_tracestream_free(struct osd_tracestream_ctx **ctx_p);
+
+/**
+ * Publish a STM event
+ *
+ * @param ctx the context object
+ * @param di_addr DI address of the STM which generated the event
+ * @param event the event
+ * @return OSD_OK if the event was queued
+ *         OSD_ERROR_BUSY if the input buffer is full and the event was dropped
+ */
+osd_result osd_tracestream_publish_stm(struct osd_tracestream_ctx *ctx,
+                                       uint16_t di_addr,
+                                       const struct osd_stm_event *event);
+
+/**
+ * Publish a CTM event
+ *
+ * @param ctx the context object
+ * @param di_addr DI address of the CTM which generated the event
+ * @param event the event
+ * @return OSD_OK if the event was queued
+ *         OSD_ERROR_BUSY if the input buffer is full and the event was dropped
+ */
+osd_result osd_tracestream_publish_ctm(struct osd_tracestream_ctx *ctx,
+                                       uint16_t di_addr,
+                                       const struct osd_ctm_event *event);
+
+/**
+ * Get the statistics of the sink
+ */
+osd_result osd_tracestream_get_stats(struct osd_tracestream_ctx *ctx,
+                                     struct osd_tracestream_stats *stats);
+
+/**
+ * Get the statistics of a subscriber
+ *
+ * @param ctx the context object
+ * @param idx index of the subscriber, smaller than
+ *            osd_tracestream_stats.num_subscribers
+ * @param[out] stats the statistics
+ * @return OSD_OK on success
+ *         OSD_ERROR_FAILURE if no subscriber with this index exists (anymore)
+ */
+osd_result osd_tracestream_get_subscriber_stats(
+    struct osd_tracestream_ctx *ctx, unsigned int idx,
+    struct osd_tracestream_subscriber_stats *stats);
+
+/**@}*/ /* end of doxygen group libosd-tracestream */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  // OSD_TRACESTREAM_H
@@ -0,0 +1,212 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <osd/latency.h>
+#include <osd/osd.h>
+#include "osd-private.h"
+
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+
+static const char *hop_names[OSD_LATENCY_HOP_NUM] = {
+    [OSD_LATENCY_HOP_GATEWAY] = "gateway",
+    [OSD_LATENCY_HOP_HOSTCTRL] = "hostctrl",
+    [OSD_LATENCY_HOP_HOSTMOD] = "hostmod",
+    [OSD_LATENCY_HOP_TOTAL] = "total",
+};
+
+/**
+ * Timestamps marking the start and the end of each hop
+ */
+static const enum osd_hoststamp hop_stamps[OSD_LATENCY_HOP_NUM][2] = {
+    [OSD_LATENCY_HOP_GATEWAY] = { OSD_HOSTSTAMP_GATEWAY_RX,
+                                  OSD_HOSTSTAMP_HOSTCTRL },
+    [OSD_LATENCY_HOP_HOSTCTRL] = { OSD_HOSTSTAMP_HOSTCTRL,
+                                   OSD_HOSTSTAMP_HOSTMOD_RX },
+    [OSD_LATENCY_HOP_HOSTMOD] = { OSD_HOSTSTAMP_HOSTMOD_RX,
+                                  OSD_HOSTSTAMP_DELIVERY },
+    [OSD_LATENCY_HOP_TOTAL] = { OSD_HOSTSTAMP_GATEWAY_RX,
+                                OSD_HOSTSTAMP_DELIVERY },
+};
+
+API_EXPORT
+uint64_t osd_latency_now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NSEC_PER_SEC + ts.tv_nsec;
+}
+
+API_EXPORT
+const char* osd_latency_hop_name(enum osd_latency_hop hop)
+{
+    if (hop >= OSD_LATENCY_HOP_NUM) {
+        return "unknown";
+    }
+    return hop_names[hop];
+}
+
+/**
+ * Index of the histogram bucket for a latency
+ */
+static unsigned int hist_bucket(uint64_t latency_ns)
+{
+    if (latency_ns == 0) {
+        return 0;
+    }
+    unsigned int bucket = 64 - __builtin_clzll(latency_ns);
+    if (bucket >= OSD_LATENCY_HIST_BUCKETS) {
+        bucket = OSD_LATENCY_HIST_BUCKETS - 1;
+    }
+    return bucket;
+}
+
+API_EXPORT
+void osd_latency_hist_add(struct osd_latency_hist *hist, uint64_t latency_ns)
+{
+    assert(hist);
+
+    if (hist->count == 0 || latency_ns < hist->min_ns) {
+        hist->min_ns = latency_ns;
+    }
+    if (latency_ns > hist->max_ns) {
+        hist->max_ns = latency_ns;
+    }
+    hist->count++;
+    hist->sum_ns += latency_ns;
+    hist->buckets[hist_bucket(latency_ns)]++;
+}
+
+API_EXPORT
+void osd_latency_hist_merge(struct osd_latency_hist *hist,
+                            const struct osd_latency_hist *other)
+{
+    assert(hist);
+    assert(other);
+
+    if (other->count == 0) {
+        return;
+    }
+    if (hist->count == 0 || other->min_ns < hist->min_ns) {
+        hist->min_ns = other->min_ns;
+    }
+    if (other->max_ns > hist->max_ns) {
+        hist->max_ns = other->max_ns;
+    }
+    hist->count += other->count;
+    hist->sum_ns += other->sum_ns;
+    for (unsigned int i = 0; i < OSD_LATENCY_HIST_BUCKETS; i++) {
+        hist->buckets[i] += other->buckets[i];
+    }
+}
+
+API_EXPORT
+uint64_t osd_latency_hist_percentile(const struct osd_latency_hist *hist,
+                                     double percentile)
+{
+    assert(hist);
+
+    if (hist->count == 0) {
+        return 0;
+    }
+    if (percentile < 0) {
+        percentile = 0;
+    }
+    if (percentile > 100) {
+        percentile = 100;
+    }
+
+    // number of samples at or below the percentile, at least one
+    uint64_t rank = (uint64_t)(percentile / 100 * hist->count + 0.5);
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (unsigned int i = 0; i < OSD_LATENCY_HIST_BUCKETS; i++) {
+        seen += hist->buckets[i];
+        if (seen < rank) {
+            continue;
+        }
+        if (i == OSD_LATENCY_HIST_BUCKETS - 1) {
+            break;
+        }
+        uint64_t upper = i == 0 ? 0 : (UINT64_C(1) << i) - 1;
+        return upper < hist->max_ns ? upper : hist->max_ns;
+    }
+    return hist->max_ns;
+}
+
+API_EXPORT
+void osd_latency_stats_reset(struct osd_latency_stats *stats)
+{
+    assert(stats);
+    memset(stats, 0, sizeof(struct osd_latency_stats));
+}
+
+API_EXPORT
+void osd_latency_stats_merge(struct osd_latency_stats *stats,
+                             const struct osd_latency_stats *other)
+{
+    assert(stats);
+    assert(other);
+
+    for (unsigned int hop = 0; hop < OSD_LATENCY_HOP_NUM; hop++) {
+        osd_latency_hist_merge(&stats->hop[hop], &other->hop[hop]);
+    }
+}
+
+zframe_t* osd_hoststamp_frame_new(void)
+{
+    uint64_t stamps[OSD_HOSTSTAMP_NUM] = { 0 };
+    zframe_t *frame = zframe_new(stamps, sizeof(stamps));
+    assert(frame);
+    return frame;
+}
+
+void osd_hoststamp_set(zframe_t *frame, enum osd_hoststamp stamp)
+{
+    if (!frame || zframe_size(frame) != OSD_HOSTSTAMP_FRAME_SIZE) {
+        return;
+    }
+    assert(stamp < OSD_HOSTSTAMP_NUM);
+
+    uint64_t now = osd_latency_now();
+    memcpy((uint8_t *)zframe_data(frame) + stamp * sizeof(uint64_t), &now,
+           sizeof(now));
+}
+
+void osd_latency_stats_add_hoststamps(struct osd_latency_stats *stats,
+                                      const zframe_t *frame)
+{
+    assert(stats);
+
+    if (!frame || zframe_size((zframe_t *)frame) != OSD_HOSTSTAMP_FRAME_SIZE) {
+        return;
+    }
+
+    uint64_t stamps[OSD_HOSTSTAMP_NUM];
+    memcpy(stamps, zframe_data((zframe_t *)frame), sizeof(stamps));
+
+    for (unsigned int hop = 0; hop < OSD_LATENCY_HOP_NUM; hop++) {
+        uint64_t start = stamps[hop_stamps[hop][0]];
+        uint64_t end = stamps[hop_stamps[hop][1]];
+        if (start == 0 || end == 0 || end < start) {
+            continue;
+        }
+        osd_latency_hist_add(&stats->hop[hop], end - start);
+    }
+}
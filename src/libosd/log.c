@@ -14,11 +14,16 @@
  */
 
 #include <osd/osd.h>
+#include <osd/latency.h>
 #include "osd-private.h"
+#include "trace.h"
 
 #include <assert.h>
 #include <errno.h>
+#include <semaphore.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <syslog.h>
 
 /**
@@ -26,6 +31,65 @@
  */
 #define LOG_PRIORITY_DEFAULT LOG_ERR
 
+/**
+ * Number of records in the ring buffer of each logging thread (async mode)
+ */
+#define LOG_ASYNC_RING_SIZE 256
+
+/**
+ * Maximum length of a log message in async mode (including the terminating
+ * NUL character). Longer messages are truncated.
+ */
+#define LOG_ASYNC_MSG_MAX 256
+
+/**
+ * A log record queued in async mode
+ */
+struct log_record {
+    /** Time the record was created (osd_latency_now()) */
+    uint64_t timestamp_ns;
+    int priority;
+    /** Source file, points to a string literal (__FILE__) */
+    const char *file;
+    int line;
+    /** Source function, points to a string literal (__FUNCTION__) */
+    const char *fn;
+    /** Formatted message */
+    char msg[LOG_ASYNC_MSG_MAX];
+};
+
+/**
+ * Single-producer single-consumer ring buffer of log records
+ *
+ * Every thread logging to a context in async mode owns one ring. Only the
+ * owning thread adds records (and advances tail), only the draining thread
+ * removes them (and advances head). Neither side takes a lock.
+ */
+struct log_ring {
+    struct log_record records[LOG_ASYNC_RING_SIZE];
+
+    /** Index of the next record to be removed (written by the consumer) */
+    uint32_t head;
+
+    /** Index of the next record to be added (written by the producer) */
+    uint32_t tail;
+
+    /** Number of records added (written by the producer) */
+    uint64_t num_records;
+
+    /** Number of records dropped since the ring was full (producer) */
+    uint64_t num_dropped;
+
+    /** Log context of this ring, NULL after the context was freed */
+    struct osd_log_ctx *ctx;
+
+    /** References held by the owning thread and the log context */
+    int refcnt;
+
+    /** Next ring of the owning thread */
+    struct log_ring *thread_next;
+};
+
 /**
  * Logging context
  */
@@ -38,15 +102,275 @@ struct osd_log_ctx {
     void *caller_ctx;
     /** log mutex */
     pthread_mutex_t lock;
+
+    /** Asynchronous logging is enabled */
+    volatile bool async;
+
+    /** Rings of all threads which logged in async mode */
+    struct log_ring **rings;
+    /** Number of entries in rings */
+    size_t rings_len;
+    /** Allocated size of rings */
+    size_t rings_size;
+    /** Lock protecting rings, rings_len and rings_size */
+    pthread_mutex_t rings_lock;
+
+    /** Thread passing the queued records to log_fn */
+    pthread_t drain_thread;
+    /** Wakes up the drain thread */
+    sem_t drain_sem;
+    /** The drain thread has been woken up and not started draining yet */
+    int drain_pending;
+    /** The drain thread should terminate */
+    int drain_stop;
+    /** Serializes draining (drain thread and osd_log_flush()) */
+    pthread_mutex_t drain_lock;
+
+    /** Records and drops of rings of terminated threads */
+    struct osd_log_async_stats retired_stats;
 };
 
+/**
+ * Key of the thread-specific list of rings (struct log_ring)
+ */
+static pthread_key_t thread_rings_key;
+static pthread_once_t thread_rings_key_once = PTHREAD_ONCE_INIT;
+
+static void ring_unref(struct log_ring *ring)
+{
+    if (__atomic_sub_fetch(&ring->refcnt, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(ring);
+    }
+}
+
+/**
+ * Release all rings of a terminating thread
+ */
+static void thread_rings_release(void *rings)
+{
+    struct log_ring *ring = rings;
+    while (ring) {
+        struct log_ring *next = ring->thread_next;
+        ring_unref(ring);
+        ring = next;
+    }
+}
+
+static void thread_rings_key_create(void)
+{
+    int rv = pthread_key_create(&thread_rings_key, thread_rings_release);
+    assert(rv == 0);
+}
+
+/**
+ * Get the ring of the calling thread for a log context
+ *
+ * The ring is created on the first use.
+ */
+static struct log_ring *thread_ring_get(struct osd_log_ctx *ctx)
+{
+    pthread_once(&thread_rings_key_once, thread_rings_key_create);
+
+    struct log_ring *old_first = pthread_getspecific(thread_rings_key);
+    struct log_ring *first = old_first;
+    struct log_ring *prev = NULL;
+    struct log_ring *ring = first;
+    while (ring) {
+        struct osd_log_ctx *ring_ctx =
+            __atomic_load_n(&ring->ctx, __ATOMIC_ACQUIRE);
+        if (ring_ctx == ctx) {
+            if (first != old_first) {
+                // the previous list head was dropped
+                pthread_setspecific(thread_rings_key, first);
+            }
+            return ring;
+        }
+
+        struct log_ring *next = ring->thread_next;
+        if (!ring_ctx) {
+            // the log context was freed, drop the ring
+            if (prev) {
+                prev->thread_next = next;
+            } else {
+                first = next;
+            }
+            ring_unref(ring);
+        } else {
+            prev = ring;
+        }
+        ring = next;
+    }
+
+    ring = calloc(1, sizeof(struct log_ring));
+    assert(ring);
+    ring->ctx = ctx;
+    ring->refcnt = 2;
+    ring->thread_next = first;
+    pthread_setspecific(thread_rings_key, ring);
+
+    pthread_mutex_lock(&ctx->rings_lock);
+    if (ctx->rings_len == ctx->rings_size) {
+        ctx->rings_size = ctx->rings_size ? 2 * ctx->rings_size : 8;
+        ctx->rings =
+            realloc(ctx->rings, ctx->rings_size * sizeof(struct log_ring *));
+        assert(ctx->rings);
+    }
+    ctx->rings[ctx->rings_len++] = ring;
+    pthread_mutex_unlock(&ctx->rings_lock);
+
+    return ring;
+}
+
+/**
+ * Queue a log record (async mode)
+ */
+static void log_async(struct osd_log_ctx *ctx, int priority, const char *file,
+                      int line, const char *fn, const char *format,
+                      va_list args)
+{
+    struct log_ring *ring = thread_ring_get(ctx);
+
+    uint32_t tail = ring->tail;
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (tail - head == LOG_ASYNC_RING_SIZE) {
+        __atomic_store_n(&ring->num_dropped, ring->num_dropped + 1,
+                         __ATOMIC_RELAXED);
+        return;
+    }
+
+    struct log_record *rec = &ring->records[tail % LOG_ASYNC_RING_SIZE];
+    rec->timestamp_ns = osd_latency_now();
+    rec->priority = priority;
+    rec->file = file;
+    rec->line = line;
+    rec->fn = fn;
+    vsnprintf(rec->msg, sizeof(rec->msg), format, args);
+
+    __atomic_store_n(&ring->tail, tail + 1, __ATOMIC_RELEASE);
+    __atomic_store_n(&ring->num_records, ring->num_records + 1,
+                     __ATOMIC_RELAXED);
+
+    // wake up the drain thread, unless it is already awake
+    if (!__atomic_exchange_n(&ctx->drain_pending, 1, __ATOMIC_ACQ_REL)) {
+        sem_post(&ctx->drain_sem);
+    }
+}
+
+/**
+ * Call log_fn with a variable argument list
+ */
+static void log_fn_call(struct osd_log_ctx *ctx, int priority,
+                        const char *file, int line, const char *fn,
+                        const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    ctx->log_fn(ctx, priority, file, line, fn, format, args);
+    va_end(args);
+}
+
+/**
+ * Pass all queued records to log_fn
+ *
+ * The records of all threads are merged in the order they were created.
+ * Must be called with drain_lock held.
+ */
+static void log_drain(struct osd_log_ctx *ctx)
+{
+    // Work on a snapshot of the ring list: log_fn itself may log and
+    // register a new ring. Rings are only freed by this function.
+    pthread_mutex_lock(&ctx->rings_lock);
+    size_t rings_len = ctx->rings_len;
+    struct log_ring **rings = calloc(rings_len + 1, sizeof(struct log_ring *));
+    assert(rings);
+    if (rings_len) {
+        memcpy(rings, ctx->rings, rings_len * sizeof(struct log_ring *));
+    }
+    pthread_mutex_unlock(&ctx->rings_lock);
+
+    while (1) {
+        struct log_ring *oldest = NULL;
+        struct log_record *oldest_rec = NULL;
+        for (size_t i = 0; i < rings_len; i++) {
+            struct log_ring *ring = rings[i];
+            uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+            if (ring->head == tail) {
+                continue;
+            }
+            struct log_record *rec =
+                &ring->records[ring->head % LOG_ASYNC_RING_SIZE];
+            if (!oldest_rec || rec->timestamp_ns < oldest_rec->timestamp_ns) {
+                oldest = ring;
+                oldest_rec = rec;
+            }
+        }
+        if (!oldest) {
+            break;
+        }
+
+        if (ctx->log_fn) {
+            log_fn_call(ctx, oldest_rec->priority, oldest_rec->file,
+                        oldest_rec->line, oldest_rec->fn, "%s",
+                        oldest_rec->msg);
+        }
+        __atomic_store_n(&oldest->head, oldest->head + 1, __ATOMIC_RELEASE);
+    }
+    free(rings);
+
+    // Free the (empty) rings of terminated threads
+    pthread_mutex_lock(&ctx->rings_lock);
+    for (size_t i = 0; i < ctx->rings_len; /* nop */) {
+        struct log_ring *ring = ctx->rings[i];
+        if (__atomic_load_n(&ring->refcnt, __ATOMIC_ACQUIRE) == 1 &&
+            ring->head == ring->tail) {
+            ctx->retired_stats.num_records += ring->num_records;
+            ctx->retired_stats.num_dropped += ring->num_dropped;
+            ctx->rings[i] = ctx->rings[--ctx->rings_len];
+            ring_unref(ring);
+        } else {
+            i++;
+        }
+    }
+    pthread_mutex_unlock(&ctx->rings_lock);
+}
+
+static void *log_drain_thread(void *ctx_void)
+{
+    struct osd_log_ctx *ctx = ctx_void;
+
+    while (1) {
+        while (sem_wait(&ctx->drain_sem) != 0 && errno == EINTR) {
+            // retry
+        }
+        __atomic_store_n(&ctx->drain_pending, 0, __ATOMIC_RELEASE);
+        int stop = __atomic_load_n(&ctx->drain_stop, __ATOMIC_ACQUIRE);
+
+        pthread_mutex_lock(&ctx->drain_lock);
+        log_drain(ctx);
+        pthread_mutex_unlock(&ctx->drain_lock);
+
+        if (stop) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
 void osd_vlog(struct osd_log_ctx *ctx, int priority, const char *file, int line,
               const char *fn, const char *format, va_list args)
 {
+    OSD_TRACE_LOG(priority, file, line, format);
+
     if (!ctx->log_fn) {
         return;
     }
 
+    if (ctx->async) {
+        log_async(ctx, priority, file, line, fn, format, args);
+        return;
+    }
+
     // make thread doing the logging uncancellable while holding the lock to
     // avoid deadlocks if a thread is cancelled while creating a log entry
     int old_cancelstate;
@@ -86,6 +410,9 @@ osd_result osd_log_new(struct osd_log_ctx **ctx, const int log_priority,
     }
 
     pthread_mutex_init(&c->lock, NULL);
+    pthread_mutex_init(&c->rings_lock, NULL);
+    pthread_mutex_init(&c->drain_lock, NULL);
+    sem_init(&c->drain_sem, 0, 0);
 
     *ctx = c;
     return OSD_OK;
@@ -102,6 +429,20 @@ void osd_log_free(struct osd_log_ctx **ctx_p)
         return;
     }
 
+    osd_log_set_async(ctx, false);
+    osd_log_flush(ctx);
+
+    // Rings of threads which are still running are freed when the threads
+    // terminate
+    for (size_t i = 0; i < ctx->rings_len; i++) {
+        __atomic_store_n(&ctx->rings[i]->ctx, NULL, __ATOMIC_RELEASE);
+        ring_unref(ctx->rings[i]);
+    }
+    free(ctx->rings);
+
+    sem_destroy(&ctx->drain_sem);
+    pthread_mutex_destroy(&ctx->drain_lock);
+    pthread_mutex_destroy(&ctx->rings_lock);
     pthread_mutex_destroy(&ctx->lock);
     free(ctx);
 
@@ -134,3 +475,70 @@ void *osd_log_get_caller_ctx(struct osd_log_ctx *ctx)
 {
     return ctx->caller_ctx;
 }
+
+API_EXPORT
+osd_result osd_log_set_async(struct osd_log_ctx *ctx, bool async)
+{
+    assert(ctx);
+
+    if (async == ctx->async) {
+        return OSD_OK;
+    }
+
+    if (async) {
+        ctx->drain_stop = 0;
+        int rv = pthread_create(&ctx->drain_thread, NULL, log_drain_thread,
+                                ctx);
+        if (rv != 0) {
+            return OSD_ERROR_FAILURE;
+        }
+        ctx->async = true;
+    } else {
+        ctx->async = false;
+
+        // the drain thread passes all queued records to log_fn before it
+        // terminates
+        __atomic_store_n(&ctx->drain_stop, 1, __ATOMIC_RELEASE);
+        sem_post(&ctx->drain_sem);
+        pthread_join(ctx->drain_thread, NULL);
+
+        // catch records queued concurrently with stopping the drain thread
+        osd_log_flush(ctx);
+    }
+
+    return OSD_OK;
+}
+
+API_EXPORT
+bool osd_log_is_async(struct osd_log_ctx *ctx)
+{
+    return ctx->async;
+}
+
+API_EXPORT
+void osd_log_flush(struct osd_log_ctx *ctx)
+{
+    assert(ctx);
+
+    pthread_mutex_lock(&ctx->drain_lock);
+    log_drain(ctx);
+    pthread_mutex_unlock(&ctx->drain_lock);
+}
+
+API_EXPORT
+void osd_log_get_async_stats(struct osd_log_ctx *ctx,
+                             struct osd_log_async_stats *stats)
+{
+    assert(ctx);
+    assert(stats);
+
+    pthread_mutex_lock(&ctx->rings_lock);
+    *stats = ctx->retired_stats;
+    for (size_t i = 0; i < ctx->rings_len; i++) {
+        stats->num_records +=
+            __atomic_load_n(&ctx->rings[i]->num_records, __ATOMIC_RELAXED);
+        stats->num_dropped +=
+            __atomic_load_n(&ctx->rings[i]->num_dropped, __ATOMIC_RELAXED);
+    }
+    pthread_mutex_unlock(&ctx->rings_lock);
+}
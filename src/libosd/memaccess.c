@@ -94,6 +94,13 @@ void osd_memaccess_free(struct osd_memaccess_ctx **ctx_p)
     *ctx_p = NULL;
 }
 
+API_EXPORT
+struct osd_hostmod_ctx* osd_memaccess_get_hostmod(
+    struct osd_memaccess_ctx *ctx)
+{
+    return ctx->hostmod_ctx;
+}
+
 API_EXPORT
 osd_result osd_memaccess_cpus_start(struct osd_memaccess_ctx *ctx,
                                     unsigned int subnet_addr)
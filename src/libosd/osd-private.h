@@ -163,4 +163,93 @@ static inline bool zframe_eq_c(const zframe_t *self, const zframe_t *other)
  */
 #define INT_DIV_CEIL(x, y) 1 + (((x) - 1) / (y))
 
+/**
+ * Compute the CRC-32 (IEEE 802.3) checksum of a buffer
+ *
+ * @param crc CRC of the preceding data, or 0 to start a new checksum
+ * @param buf the data
+ * @param len length of |buf| in bytes
+ * @return the updated CRC
+ */
+uint32_t osd_crc32(uint32_t crc, const void *buf, size_t len);
+
+struct osd_stm_event;
+struct osd_ctm_event;
+
+/**
+ * Maximum size of a trace stream record in bytes
+ */
+#define OSD_TRACESTREAM_RECORD_SIZE_MAX 40
+
+/**
+ * Encode a STM event as trace stream record
+ *
+ * @param[out] rec the record, at least OSD_TRACESTREAM_RECORD_SIZE_MAX bytes
+ * @param di_addr DI address of the STM which generated the event
+ * @param host_ns host time of the event in ns since the Unix epoch
+ * @param event the event
+ * @return size of the record in bytes
+ */
+size_t osd_tracestream_encode_stm(uint8_t *rec, uint16_t di_addr,
+                                  uint64_t host_ns,
+                                  const struct osd_stm_event *event);
+
+/**
+ * Encode a CTM event as trace stream record
+ *
+ * @see osd_tracestream_encode_stm()
+ */
+size_t osd_tracestream_encode_ctm(uint8_t *rec, uint16_t di_addr,
+                                  uint64_t host_ns,
+                                  const struct osd_ctm_event *event);
+
+/**
+ * Points at which a packet from the device is timestamped on the host
+ *
+ * The timestamps (see osd_latency_now()) are carried as optional frame after
+ * the packet data frame of a "D" message, holding OSD_HOSTSTAMP_NUM uint64_t
+ * values in host byte order. Unset timestamps are 0.
+ */
+enum osd_hoststamp {
+    OSD_HOSTSTAMP_GATEWAY_RX = 0,
+    OSD_HOSTSTAMP_HOSTCTRL = 1,
+    OSD_HOSTSTAMP_HOSTMOD_RX = 2,
+    OSD_HOSTSTAMP_DELIVERY = 3,
+
+    OSD_HOSTSTAMP_NUM
+};
+
+/**
+ * Size of a host timestamp frame in bytes
+ */
+#define OSD_HOSTSTAMP_FRAME_SIZE (OSD_HOSTSTAMP_NUM * sizeof(uint64_t))
+
+/**
+ * Create a new host timestamp frame with all timestamps unset
+ */
+zframe_t* osd_hoststamp_frame_new(void);
+
+/**
+ * Record the current time in a host timestamp frame
+ *
+ * Frames of an unexpected size are ignored.
+ *
+ * @param frame the timestamp frame, may be NULL
+ * @param stamp the timestamp to set
+ */
+void osd_hoststamp_set(zframe_t *frame, enum osd_hoststamp stamp);
+
+struct osd_latency_stats;
+
+/**
+ * Add the hop latencies of a host timestamp frame to latency histograms
+ *
+ * Hops with missing timestamps, or timestamps going backwards, are skipped.
+ *
+ * @param stats the latency histograms
+ * @param frame the timestamp frame
+ */
+void osd_latency_stats_add_hoststamps(struct osd_latency_stats *stats,
+                                      const zframe_t *frame);
+
 #endif // OSD_OSD_PRIVATE_H
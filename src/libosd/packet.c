@@ -14,6 +14,7 @@
  */
 
 #include <assert.h>
+#include <endian.h>
 #include <errno.h>
 #include <osd/osd.h>
 #include <osd/packet.h>
@@ -297,7 +298,16 @@ bool osd_packet_fwrite(const struct osd_packet *packet, FILE *fd)
 {
     size_t pkg_struct_size_bytes = osd_packet_sizeof(packet)
             + sizeof(uint16_t) /* data_size_bytes */;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
     size_t items_written = fwrite(packet, pkg_struct_size_bytes, 1, fd);
+#else
+    uint16_t buf[pkg_struct_size_bytes / sizeof(uint16_t)];
+    buf[0] = htole16(packet->data_size_words);
+    for (size_t i = 0; i < packet->data_size_words; i++) {
+        buf[i + 1] = htole16(packet->data_raw[i]);
+    }
+    size_t items_written = fwrite(buf, pkg_struct_size_bytes, 1, fd);
+#endif
     return (items_written == 1);
 }
 
@@ -313,6 +323,7 @@ struct osd_packet* osd_packet_fread(FILE *fd)
     if (items_read != 1) {
         return NULL;
     }
+    data_size_words = le16toh(data_size_words);
 
     // create packet
     struct osd_packet *pkg;
@@ -328,6 +339,11 @@ struct osd_packet* osd_packet_fread(FILE *fd)
         osd_packet_free(&pkg);
         return NULL;
     }
+#if __BYTE_ORDER__ != __ORDER_LITTLE_ENDIAN__
+    for (size_t i = 0; i < data_size_words; i++) {
+        pkg->data_raw[i] = le16toh(pkg->data_raw[i]);
+    }
+#endif
 
     return pkg;
 }
@@ -0,0 +1,415 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <osd/runctrl.h>
+#include <osd/latency.h>
+#include <osd/osd.h>
+#include <osd/packet.h>
+#include <osd/reg.h>
+#include "osd-private.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * State of a controlled core
+ */
+struct runctrl_core {
+    struct osd_cdm_desc cdm_desc;
+
+    /** Core is stalled (according to the last event) */
+    bool stalled;
+
+    /** Host time the last event was received, 0 if none since the reset */
+    uint64_t event_time;
+};
+
+/**
+ * Run Control context
+ */
+struct osd_runctrl_ctx {
+    struct osd_hostmod_ctx *hostmod_ctx;
+    struct osd_log_ctx *log_ctx;
+
+    struct runctrl_core *cores;
+    size_t num_cores;
+
+    /** Protects the state of the cores and the stall handler */
+    pthread_mutex_t lock;
+    /** Signalled on every received stall event */
+    pthread_cond_t event_cond;
+
+    osd_runctrl_stall_handler_fn stall_handler;
+    void *stall_handler_arg;
+};
+
+static struct runctrl_core *find_core(struct osd_runctrl_ctx *ctx,
+                                      unsigned int di_addr, unsigned int *idx)
+{
+    for (size_t i = 0; i < ctx->num_cores; i++) {
+        if (ctx->cores[i].cdm_desc.di_addr == di_addr) {
+            *idx = i;
+            return &ctx->cores[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Handle an event packet sent by one of the CDMs
+ *
+ * Called in the I/O thread of the host module.
+ */
+static osd_result runctrl_handle_event(void *arg, struct osd_packet *pkg)
+{
+    osd_result rv;
+    struct osd_runctrl_ctx *ctx = arg;
+    uint64_t now = osd_latency_now();
+
+    pthread_mutex_lock(&ctx->lock);
+
+    unsigned int idx;
+    struct runctrl_core *core = find_core(ctx, osd_packet_get_src(pkg), &idx);
+    if (!core) {
+        pthread_mutex_unlock(&ctx->lock);
+        err(ctx->log_ctx, "Dropping event from unknown module %u",
+            osd_packet_get_src(pkg));
+        osd_packet_free(&pkg);
+        return OSD_OK;
+    }
+
+    struct osd_cdm_event ev;
+    rv = osd_cl_cdm_decode_event(&core->cdm_desc, pkg, &ev);
+    osd_packet_free(&pkg);
+    if (OSD_FAILED(rv)) {
+        pthread_mutex_unlock(&ctx->lock);
+        err(ctx->log_ctx, "Unable to decode event of CDM %u (%d)",
+            core->cdm_desc.di_addr, rv);
+        return OSD_OK;
+    }
+
+    core->stalled = ev.stall;
+    core->event_time = now;
+    pthread_cond_broadcast(&ctx->event_cond);
+
+    osd_runctrl_stall_handler_fn handler = ctx->stall_handler;
+    void *handler_arg = ctx->stall_handler_arg;
+    pthread_mutex_unlock(&ctx->lock);
+
+    if (handler) {
+        handler(handler_arg, idx, ev.stall);
+    }
+
+    return OSD_OK;
+}
+
+API_EXPORT
+osd_result osd_runctrl_new(struct osd_runctrl_ctx **ctx,
+                           struct osd_log_ctx *log_ctx,
+                           const char *host_controller_address)
+{
+    osd_result rv;
+
+    struct osd_runctrl_ctx *c = calloc(1, sizeof(struct osd_runctrl_ctx));
+    assert(c);
+
+    c->log_ctx = log_ctx;
+
+    pthread_mutex_init(&c->lock, NULL);
+    pthread_condattr_t condattr;
+    pthread_condattr_init(&condattr);
+    pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&c->event_cond, &condattr);
+    pthread_condattr_destroy(&condattr);
+
+    struct osd_hostmod_ctx *hostmod_ctx;
+    rv = osd_hostmod_new(&hostmod_ctx, log_ctx, host_controller_address,
+                         runctrl_handle_event, c);
+    assert(OSD_SUCCEEDED(rv));
+    c->hostmod_ctx = hostmod_ctx;
+
+    *ctx = c;
+
+    return OSD_OK;
+}
+
+API_EXPORT
+osd_result osd_runctrl_connect(struct osd_runctrl_ctx *ctx)
+{
+    return osd_hostmod_connect(ctx->hostmod_ctx);
+}
+
+API_EXPORT
+osd_result osd_runctrl_disconnect(struct osd_runctrl_ctx *ctx)
+{
+    return osd_hostmod_disconnect(ctx->hostmod_ctx);
+}
+
+API_EXPORT
+bool osd_runctrl_is_connected(struct osd_runctrl_ctx *ctx)
+{
+    return osd_hostmod_is_connected(ctx->hostmod_ctx);
+}
+
+API_EXPORT
+void osd_runctrl_free(struct osd_runctrl_ctx **ctx_p)
+{
+    assert(ctx_p);
+    struct osd_runctrl_ctx *ctx = *ctx_p;
+    if (!ctx) {
+        return;
+    }
+
+    osd_hostmod_free(&ctx->hostmod_ctx);
+
+    pthread_cond_destroy(&ctx->event_cond);
+    pthread_mutex_destroy(&ctx->lock);
+    free(ctx->cores);
+
+    free(ctx);
+    *ctx_p = NULL;
+}
+
+API_EXPORT
+osd_result osd_runctrl_add_cores(struct osd_runctrl_ctx *ctx,
+                                 const unsigned int *cdm_diaddrs,
+                                 size_t num_cdms)
+{
+    osd_result rv;
+
+    assert(ctx);
+    assert(cdm_diaddrs || num_cdms == 0);
+
+    for (size_t i = 0; i < num_cdms; i++) {
+        struct runctrl_core core = { 0 };
+
+        rv = osd_cl_cdm_get_desc(ctx->hostmod_ctx, cdm_diaddrs[i],
+                                 &core.cdm_desc);
+        if (OSD_FAILED(rv)) {
+            err(ctx->log_ctx, "Unable to get descriptor of CDM %u (%d)",
+                cdm_diaddrs[i], rv);
+            return rv;
+        }
+        core.stalled = core.cdm_desc.core_ctrl &
+                       BIT(OSD_REG_CDM_CORE_CTRL_STALL_BIT);
+
+        // events can arrive as soon as they are activated
+        pthread_mutex_lock(&ctx->lock);
+        ctx->cores = realloc(ctx->cores, (ctx->num_cores + 1) *
+                                         sizeof(struct runctrl_core));
+        assert(ctx->cores);
+        ctx->cores[ctx->num_cores++] = core;
+        pthread_mutex_unlock(&ctx->lock);
+
+        rv = osd_hostmod_mod_set_event_dest(ctx->hostmod_ctx, cdm_diaddrs[i],
+                                            0);
+        if (OSD_FAILED(rv)) {
+            err(ctx->log_ctx, "Unable to set event destination of CDM %u (%d)",
+                cdm_diaddrs[i], rv);
+            return rv;
+        }
+        rv = osd_hostmod_mod_set_event_active(ctx->hostmod_ctx, cdm_diaddrs[i],
+                                              true, 0);
+        if (OSD_FAILED(rv)) {
+            err(ctx->log_ctx, "Unable to activate events of CDM %u (%d)",
+                cdm_diaddrs[i], rv);
+            return rv;
+        }
+
+        dbg(ctx->log_ctx, "Added core %zu (CDM %u, %u bit)",
+            ctx->num_cores - 1, cdm_diaddrs[i],
+            core.cdm_desc.core_data_width);
+    }
+
+    return OSD_OK;
+}
+
+API_EXPORT
+size_t osd_runctrl_get_num_cores(struct osd_runctrl_ctx *ctx)
+{
+    return ctx->num_cores;
+}
+
+API_EXPORT
+struct osd_cdm_desc* osd_runctrl_get_cdm_desc(struct osd_runctrl_ctx *ctx,
+                                              unsigned int core)
+{
+    assert(core < ctx->num_cores);
+    return &ctx->cores[core].cdm_desc;
+}
+
+API_EXPORT
+void osd_runctrl_set_stall_handler(struct osd_runctrl_ctx *ctx,
+                                   osd_runctrl_stall_handler_fn handler,
+                                   void *arg)
+{
+    pthread_mutex_lock(&ctx->lock);
+    ctx->stall_handler = handler;
+    ctx->stall_handler_arg = arg;
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+API_EXPORT
+bool osd_runctrl_is_stalled(struct osd_runctrl_ctx *ctx, unsigned int core)
+{
+    assert(core < ctx->num_cores);
+
+    pthread_mutex_lock(&ctx->lock);
+    bool stalled = ctx->cores[core].stalled;
+    pthread_mutex_unlock(&ctx->lock);
+
+    return stalled;
+}
+
+/**
+ * Count the cores in state @p stall which sent an event since the last reset
+ *
+ * Must be called with ctx->lock held.
+ */
+static size_t count_events(struct osd_runctrl_ctx *ctx, bool stall,
+                           uint64_t *first, uint64_t *last)
+{
+    size_t num_events = 0;
+    *first = UINT64_MAX;
+    *last = 0;
+
+    for (size_t i = 0; i < ctx->num_cores; i++) {
+        struct runctrl_core *core = &ctx->cores[i];
+        if (core->event_time == 0 || core->stalled != stall) {
+            continue;
+        }
+        num_events++;
+        if (core->event_time < *first) {
+            *first = core->event_time;
+        }
+        if (core->event_time > *last) {
+            *last = core->event_time;
+        }
+    }
+    return num_events;
+}
+
+/**
+ * Write the CORE_CTRL register of all CDMs and wait for the stall events
+ */
+static osd_result set_stall(struct osd_runctrl_ctx *ctx, bool stall,
+                            struct osd_runctrl_sync_stats *stats)
+{
+    osd_result rv;
+    osd_result retval = OSD_OK;
+
+    assert(ctx);
+
+    size_t num_cores = ctx->num_cores;
+    if (stats) {
+        memset(stats, 0, sizeof(struct osd_runctrl_sync_stats));
+        stats->num_cores = num_cores;
+    }
+    if (num_cores == 0) {
+        return OSD_OK;
+    }
+
+    uint16_t core_ctrl = stall ? BIT(OSD_REG_CDM_CORE_CTRL_STALL_BIT) : 0;
+    struct osd_hostmod_reg_access *accesses =
+        calloc(num_cores, sizeof(struct osd_hostmod_reg_access));
+    assert(accesses);
+    for (size_t i = 0; i < num_cores; i++) {
+        accesses[i].diaddr = ctx->cores[i].cdm_desc.di_addr;
+        accesses[i].reg_addr = OSD_REG_CDM_CORE_CTRL;
+        accesses[i].reg_size_bit = 16;
+        accesses[i].write = true;
+        accesses[i].reg_val = &core_ctrl;
+    }
+
+    // forget events from before this request
+    pthread_mutex_lock(&ctx->lock);
+    for (size_t i = 0; i < num_cores; i++) {
+        ctx->cores[i].event_time = 0;
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    uint64_t t_start = osd_latency_now();
+    rv = osd_hostmod_reg_access_batch(ctx->hostmod_ctx, accesses, num_cores,
+                                      0);
+    uint64_t write_ns = osd_latency_now() - t_start;
+
+    size_t num_written = 0;
+    for (size_t i = 0; i < num_cores; i++) {
+        if (OSD_FAILED(accesses[i].result)) {
+            err(ctx->log_ctx, "Unable to write CORE_CTRL of CDM %u (%d)",
+                accesses[i].diaddr, accesses[i].result);
+            retval = accesses[i].result;
+            continue;
+        }
+        ctx->cores[i].cdm_desc.core_ctrl = core_ctrl;
+        num_written++;
+    }
+    if (OSD_FAILED(rv)) {
+        retval = rv;
+    }
+    free(accesses);
+
+    // wait for the cores to confirm the new state
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    timespec_add_ns(&deadline, OSD_RUNCTRL_EVENT_TIMEOUT_MS * 1000 * 1000);
+
+    uint64_t first, last;
+    size_t num_events;
+    pthread_mutex_lock(&ctx->lock);
+    while (1) {
+        num_events = count_events(ctx, stall, &first, &last);
+        if (num_events >= num_written) {
+            break;
+        }
+        int irv = pthread_cond_timedwait(&ctx->event_cond, &ctx->lock,
+                                         &deadline);
+        if (irv != 0) {
+            num_events = count_events(ctx, stall, &first, &last);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&ctx->lock);
+
+    if (num_events < num_written) {
+        dbg(ctx->log_ctx, "Only %zu of %zu cores confirmed the %s", num_events,
+            num_written, stall ? "stall" : "release");
+    }
+
+    if (stats) {
+        stats->write_ns = write_ns;
+        stats->num_events = num_events;
+        stats->event_skew_ns = num_events > 1 ? last - first : 0;
+    }
+
+    return retval;
+}
+
+API_EXPORT
+osd_result osd_runctrl_stall(struct osd_runctrl_ctx *ctx,
+                             struct osd_runctrl_sync_stats *stats)
+{
+    return set_stall(ctx, true, stats);
+}
+
+API_EXPORT
+osd_result osd_runctrl_release(struct osd_runctrl_ctx *ctx,
+                               struct osd_runctrl_sync_stats *stats)
+{
+    return set_stall(ctx, false, stats);
+}
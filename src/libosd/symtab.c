@@ -0,0 +1,286 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <osd/osd.h>
+#include <osd/symtab.h>
+#include "osd-private.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <gelf.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Symbol table context
+ */
+struct osd_symtab_ctx {
+    struct osd_log_ctx *log_ctx;
+
+    /** symbols, sorted by address */
+    struct osd_symtab_entry *entries;
+    /** number of valid entries in |entries| */
+    size_t num_entries;
+    /** allocated number of entries in |entries| */
+    size_t len_entries;
+};
+
+static int entry_cmp(const void *a_void, const void *b_void)
+{
+    const struct osd_symtab_entry *a = a_void;
+    const struct osd_symtab_entry *b = b_void;
+
+    if (a->addr < b->addr) {
+        return -1;
+    }
+    if (a->addr > b->addr) {
+        return 1;
+    }
+    // make the order of aliases deterministic
+    return strcmp(a->name, b->name);
+}
+
+/**
+ * Index of the first entry with an address not less than |addr|
+ */
+static size_t lower_bound(const struct osd_symtab_ctx *ctx, uint64_t addr)
+{
+    size_t lo = 0;
+    size_t hi = ctx->num_entries;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ctx->entries[mid].addr < addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/**
+ * Index of the first entry with an address greater than |addr|
+ */
+static size_t upper_bound(const struct osd_symtab_ctx *ctx, uint64_t addr)
+{
+    size_t lo = 0;
+    size_t hi = ctx->num_entries;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ctx->entries[mid].addr <= addr) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static void reserve_entries(struct osd_symtab_ctx *ctx, size_t num_entries)
+{
+    if (ctx->len_entries >= num_entries) {
+        return;
+    }
+
+    size_t len = ctx->len_entries ? ctx->len_entries : 64;
+    while (len < num_entries) {
+        len *= 2;
+    }
+    ctx->entries = realloc(ctx->entries, len * sizeof(struct osd_symtab_entry));
+    assert(ctx->entries);
+    ctx->len_entries = len;
+}
+
+API_EXPORT
+osd_result osd_symtab_new(struct osd_symtab_ctx **ctx,
+                          struct osd_log_ctx *log_ctx)
+{
+    struct osd_symtab_ctx *c = calloc(1, sizeof(struct osd_symtab_ctx));
+    assert(c);
+
+    c->log_ctx = log_ctx;
+
+    *ctx = c;
+
+    return OSD_OK;
+}
+
+API_EXPORT
+void osd_symtab_free(struct osd_symtab_ctx **ctx_p)
+{
+    assert(ctx_p);
+    struct osd_symtab_ctx *ctx = *ctx_p;
+    if (!ctx) {
+        return;
+    }
+
+    for (size_t i = 0; i < ctx->num_entries; i++) {
+        free(ctx->entries[i].name);
+    }
+    free(ctx->entries);
+
+    free(ctx);
+    *ctx_p = NULL;
+}
+
+API_EXPORT
+osd_result osd_symtab_add(struct osd_symtab_ctx *ctx, uint64_t addr,
+                          uint64_t size, const char *name)
+{
+    assert(ctx);
+    assert(name);
+
+    struct osd_symtab_entry entry = { .addr = addr, .size = size,
+                                      .name = strdup(name) };
+    assert(entry.name);
+
+    reserve_entries(ctx, ctx->num_entries + 1);
+
+    // insert at the sorted position
+    size_t pos = upper_bound(ctx, addr);
+    while (pos > 0 && ctx->entries[pos - 1].addr == addr &&
+           entry_cmp(&ctx->entries[pos - 1], &entry) > 0) {
+        pos--;
+    }
+    memmove(&ctx->entries[pos + 1], &ctx->entries[pos],
+            (ctx->num_entries - pos) * sizeof(struct osd_symtab_entry));
+    ctx->entries[pos] = entry;
+    ctx->num_entries++;
+
+    return OSD_OK;
+}
+
+API_EXPORT
+osd_result osd_symtab_load_elf(struct osd_symtab_ctx *ctx,
+                               const char *elf_filename)
+{
+    assert(ctx);
+    assert(elf_filename);
+
+    osd_result retval;
+
+    if (elf_version(EV_CURRENT) == EV_NONE) {
+        err(ctx->log_ctx, "Version mismatch between elf library and system.");
+        return OSD_ERROR_FAILURE;
+    }
+
+    int fd = open(elf_filename, O_RDONLY, 0);
+    if (fd < 0) {
+        err(ctx->log_ctx, "Unable to open file %s: %s (%d)", elf_filename,
+            strerror(errno), errno);
+        return OSD_ERROR_FILE;
+    }
+
+    Elf *elf_object = elf_begin(fd, ELF_C_READ, NULL);
+    if (elf_object == NULL) {
+        err(ctx->log_ctx, "%s", elf_errmsg(-1));
+        retval = OSD_ERROR_FAILURE;
+        goto return_free_file;
+    }
+
+    Elf_Scn *sec = NULL;
+    while ((sec = elf_nextscn(elf_object, sec)) != NULL) {
+        GElf_Shdr shdr;
+        gelf_getshdr(sec, &shdr);
+
+        if (shdr.sh_type != SHT_SYMTAB) {
+            continue;
+        }
+
+        Elf_Data *edata = NULL;
+        edata = elf_getdata(sec, edata);
+
+        size_t allsyms = shdr.sh_size / shdr.sh_entsize;
+        reserve_entries(ctx, ctx->num_entries + allsyms);
+
+        for (size_t i = 0; i < allsyms; i++) {
+            GElf_Sym sym;
+            gelf_getsym(edata, i, &sym);
+
+            if ((ELF32_ST_TYPE(sym.st_info) == STT_FUNC)
+                    || (ELF32_ST_TYPE(sym.st_info) == STT_NOTYPE)) {
+                struct osd_symtab_entry *e = &ctx->entries[ctx->num_entries];
+                e->addr = sym.st_value;
+                e->size = sym.st_size;
+                e->name = strdup(
+                        elf_strptr(elf_object, shdr.sh_link, sym.st_name));
+                assert(e->name);
+                ctx->num_entries++;
+            }
+        }
+    }
+
+    qsort(ctx->entries, ctx->num_entries, sizeof(struct osd_symtab_entry),
+          entry_cmp);
+
+    dbg(ctx->log_ctx, "Read %zu symbols from %s", ctx->num_entries,
+        elf_filename);
+
+    retval = OSD_OK;
+
+    elf_end(elf_object);
+
+return_free_file:
+    close(fd);
+
+    return retval;
+}
+
+API_EXPORT
+size_t osd_symtab_get_count(const struct osd_symtab_ctx *ctx)
+{
+    assert(ctx);
+    return ctx->num_entries;
+}
+
+API_EXPORT
+const struct osd_symtab_entry *osd_symtab_get(const struct osd_symtab_ctx *ctx,
+                                              size_t idx)
+{
+    assert(ctx);
+    assert(idx < ctx->num_entries);
+    return &ctx->entries[idx];
+}
+
+API_EXPORT
+const struct osd_symtab_entry *osd_symtab_find(const struct osd_symtab_ctx *ctx,
+                                               uint64_t addr)
+{
+    assert(ctx);
+
+    size_t idx = lower_bound(ctx, addr);
+    if (idx == ctx->num_entries || ctx->entries[idx].addr != addr) {
+        return NULL;
+    }
+    return &ctx->entries[idx];
+}
+
+API_EXPORT
+const struct osd_symtab_entry *osd_symtab_find_containing(
+    const struct osd_symtab_ctx *ctx, uint64_t addr)
+{
+    assert(ctx);
+
+    if (ctx->num_entries == 0) {
+        return NULL;
+    }
+
+    size_t idx = upper_bound(ctx, addr);
+    if (idx == 0) {
+        return &ctx->entries[0];
+    }
+    return &ctx->entries[idx - 1];
+}
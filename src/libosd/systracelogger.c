@@ -22,15 +22,10 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <inttypes.h>
 #include <stdbool.h>
 #include <string.h>
 
-struct event_stats {
-    unsigned int overflowed_events;
-    unsigned int sysprint_events;
-    unsigned int trace_events;
-};
-
 /**
  * System Trace Logger context
  */
@@ -39,72 +34,34 @@ struct osd_systracelogger_ctx {
     struct osd_log_ctx *log_ctx;
     uint16_t stm_di_addr;
     struct osd_stm_desc stm_desc;
-    struct osd_stm_event_handler stm_event_handler;
+    struct osd_tracepipe_ctx *pipe;
+    struct osd_tracepipe_source source;
     FILE *fp_sysprint;
     FILE *fp_event;
-    struct osd_cl_stm_print_buf sysprint_buf;
-    struct event_stats stats;
+    struct osd_tracestream_ctx *stream;
+    struct osd_trace_counters counters;
 };
 
-static void stm_event_handler(void *ctx_void,
-                              const struct osd_stm_desc *stm_desc,
-                              const struct osd_stm_event *event)
+API_EXPORT
+osd_result osd_systracelogger_format_event(FILE *fp,
+                                           const struct osd_stm_event *event)
 {
     int rv;
-    osd_result osd_rv;
-    struct osd_systracelogger_ctx *ctx = ctx_void;
 
-    // update stats
-    if (event->overflow) {
-        ctx->stats.overflowed_events += event->overflow;
-    } else {
-        ctx->stats.sysprint_events += osd_cl_stm_is_print_event(event);
-        ctx->stats.trace_events += 1;
-    }
+    assert(fp);
+    assert(event);
 
     if (event->overflow) {
-        if (ctx->fp_event) {
-            rv = fprintf(ctx->fp_event, "Overflow, missed %u events\n",
-                         event->overflow);
-            if (rv < 0) {
-                err(ctx->log_ctx, "Unable to write STM event to log file.");
-            }
-        }
-
-        // XXX: handle overflow in sysprint (e.g. by newline and explicit flush)
-
-        return;
-    }
-
-    if (ctx->fp_event) {
-        rv = fprintf(ctx->fp_event, "%08x %04x %016lx\n", event->timestamp,
-                     event->id, event->value);
-        if (rv < 0) {
-            err(ctx->log_ctx, "Unable to write STM event to log file.");
-        }
+        rv = fprintf(fp, "Overflow, missed %u events\n", event->overflow);
+    } else {
+        rv = fprintf(fp, "%08x %04x %016lx\n", event->timestamp, event->id,
+                     event->value);
     }
 
-    if (ctx->fp_sysprint && osd_cl_stm_is_print_event(event)) {
-        bool should_flush = false;
-        osd_rv = osd_cl_stm_add_to_print_buf(event, &ctx->sysprint_buf,
-                                             &should_flush);
-        if (OSD_FAILED(osd_rv)) {
-            return;
-        }
-        if (should_flush) {
-            size_t b_wr = fwrite(ctx->sysprint_buf.buf, 1,
-                                 ctx->sysprint_buf.len_str, ctx->fp_sysprint);
-            if (b_wr != ctx->sysprint_buf.len_str) {
-                err(ctx->log_ctx, "Unable to write %zu bytes to file.",
-                    ctx->sysprint_buf.len_str);
-                // not much more error handling we can do here
-            }
-            free(ctx->sysprint_buf.buf);
-            ctx->sysprint_buf.buf = NULL;
-            ctx->sysprint_buf.len_buf = 0;
-            ctx->sysprint_buf.len_str = 0;
-        }
+    if (rv < 0) {
+        return OSD_ERROR_FILE;
     }
+    return OSD_OK;
 }
 
 API_EXPORT
@@ -121,16 +78,16 @@ osd_result osd_systracelogger_new(struct osd_systracelogger_ctx **ctx,
 
     c->log_ctx = log_ctx;
     c->stm_di_addr = stm_di_addr;
-    c->stm_event_handler.cb_fn = stm_event_handler;
-    c->stm_event_handler.cb_arg = (void *)c;
-    c->stats.overflowed_events = 0;
-    c->stats.trace_events = 0;
-    c->stats.sysprint_events = 0;
+
+    rv = osd_tracepipe_new(&c->pipe, log_ctx, 0, 0);
+    assert(OSD_SUCCEEDED(rv));
+    c->source.pipe = c->pipe;
+    c->source.type = OSD_TRACE_EVENT_STM;
+    c->source.desc.stm = &c->stm_desc;
 
     struct osd_hostmod_ctx *hostmod_ctx;
-    rv =
-        osd_hostmod_new(&hostmod_ctx, log_ctx, host_controller_address,
-                        osd_cl_stm_handle_event, (void *)&c->stm_event_handler);
+    rv = osd_hostmod_new(&hostmod_ctx, log_ctx, host_controller_address,
+                         osd_tracepipe_handle_packet, (void *)&c->source);
     assert(OSD_SUCCEEDED(rv));
     c->hostmod_ctx = hostmod_ctx;
 
@@ -166,28 +123,56 @@ void osd_systracelogger_free(struct osd_systracelogger_ctx **ctx_p)
         return;
     }
 
-    // Flush remaining sysprint data to file
-    if (ctx->sysprint_buf.len_str > 0) {
-        size_t b_wr = fwrite(ctx->sysprint_buf.buf, 1,
-                             ctx->sysprint_buf.len_str, ctx->fp_sysprint);
-        if (b_wr != ctx->sysprint_buf.len_str) {
-            err(ctx->log_ctx, "Unable to write %zu bytes to file.",
-                ctx->sysprint_buf.len_str);
-            // not much more error handling we can do here
-        }
-        free(ctx->sysprint_buf.buf);
-    }
-
-    info(ctx->log_ctx, "Systracelogger statistics: %u overflowed packets, "
-         "%u trace events, %u sysprint events", ctx->stats.overflowed_events,
-         ctx->stats.trace_events, ctx->stats.sysprint_events);
-
+    // stop receiving events before flushing all outputs
     osd_hostmod_free(&ctx->hostmod_ctx);
+    osd_tracepipe_free(&ctx->pipe);
+
+    info(ctx->log_ctx, "Systracelogger statistics: %" PRIu64 " overflowed "
+         "packets, %" PRIu64 " trace events, %" PRIu64 " sysprint events",
+         ctx->counters.overflowed_events, ctx->counters.stm_events,
+         ctx->counters.stm_print_events);
 
     free(ctx);
     *ctx_p = NULL;
 }
 
+/**
+ * Add the configured outputs to the trace pipeline and start it
+ */
+static osd_result setup_pipeline(struct osd_systracelogger_ctx *ctx)
+{
+    osd_result rv;
+
+    if (osd_tracepipe_is_running(ctx->pipe)) {
+        return OSD_OK;
+    }
+
+    rv = osd_tracepipe_add_counter_sink(ctx->pipe, &ctx->counters, 0);
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
+    if (ctx->stream) {
+        rv = osd_tracepipe_add_stream_sink(ctx->pipe, ctx->stream, 0);
+        if (OSD_FAILED(rv)) {
+            return rv;
+        }
+    }
+    if (ctx->fp_event) {
+        rv = osd_tracepipe_add_text_sink(ctx->pipe, ctx->fp_event, NULL, 0);
+        if (OSD_FAILED(rv)) {
+            return rv;
+        }
+    }
+    if (ctx->fp_sysprint) {
+        rv = osd_tracepipe_add_sysprint_sink(ctx->pipe, ctx->fp_sysprint, 0);
+        if (OSD_FAILED(rv)) {
+            return rv;
+        }
+    }
+
+    return osd_tracepipe_start(ctx->pipe);
+}
+
 API_EXPORT
 osd_result osd_systracelogger_start(struct osd_systracelogger_ctx *ctx)
 {
@@ -198,7 +183,11 @@ osd_result osd_systracelogger_start(struct osd_systracelogger_ctx *ctx)
     if (OSD_FAILED(rv)) {
         return rv;
     }
-    ctx->stm_event_handler.stm_desc = &ctx->stm_desc;
+
+    rv = setup_pipeline(ctx);
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
 
     rv = osd_hostmod_mod_set_event_dest(ctx->hostmod_ctx, ctx->stm_di_addr, 0);
     if (OSD_FAILED(rv)) {
@@ -222,6 +211,13 @@ osd_result osd_systracelogger_stop(struct osd_systracelogger_ctx *ctx)
     if (rv == OSD_ERROR_TIMEDOUT) {
         rv = OSD_OK;
     }
+
+    // write out all events received so far
+    osd_result flush_rv = osd_tracepipe_flush(ctx->pipe);
+    if (OSD_FAILED(flush_rv) && OSD_SUCCEEDED(rv)) {
+        rv = flush_rv;
+    }
+
     return rv;
 }
 
@@ -229,6 +225,10 @@ API_EXPORT
 osd_result osd_systracelogger_set_sysprint_log(
     struct osd_systracelogger_ctx *ctx, FILE *fp)
 {
+    if (osd_tracepipe_is_running(ctx->pipe)) {
+        err(ctx->log_ctx, "Outputs must be set before starting the logger.");
+        return OSD_ERROR_FAILURE;
+    }
     ctx->fp_sysprint = fp;
     return OSD_OK;
 }
@@ -237,6 +237,29 @@ API_EXPORT
 osd_result osd_systracelogger_set_event_log(struct osd_systracelogger_ctx *ctx,
                                             FILE *fp)
 {
+    if (osd_tracepipe_is_running(ctx->pipe)) {
+        err(ctx->log_ctx, "Outputs must be set before starting the logger.");
+        return OSD_ERROR_FAILURE;
+    }
     ctx->fp_event = fp;
     return OSD_OK;
 }
+
+API_EXPORT
+osd_result osd_systracelogger_set_stream(struct osd_systracelogger_ctx *ctx,
+                                         struct osd_tracestream_ctx *stream)
+{
+    if (osd_tracepipe_is_running(ctx->pipe)) {
+        err(ctx->log_ctx, "Outputs must be set before starting the logger.");
+        return OSD_ERROR_FAILURE;
+    }
+    ctx->stream = stream;
+    return OSD_OK;
+}
+
+API_EXPORT
+struct osd_tracepipe_ctx *osd_systracelogger_get_tracepipe(
+    struct osd_systracelogger_ctx *ctx)
+{
+    return ctx->pipe;
+}
@@ -15,19 +15,47 @@
 
 #include <assert.h>
 #include <errno.h>
-#include <poll.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/timerfd.h>
 #include <termios.h>
+#include <time.h>
+#include <unistd.h>
 
 #include <osd/cl_dem_uart.h>
+#include <osd/latency.h>
 #include <osd/osd.h>
 #include <osd/terminal.h>
 #include "osd-private.h"
 
+/**
+ * Maximum number of bytes read from the pseudo-terminal and sent to the
+ * DEM-UART at once
+ */
+#define TERMINAL_TX_CHUNK 4096
+
+/**
+ * Size of the buffer for data received from the DEM-UART
+ *
+ * The buffer is written to the pseudo-terminal when it is full, when a
+ * newline is received, or when no data was received for
+ * TERMINAL_RX_FLUSH_MS.
+ */
+#define TERMINAL_RX_BUF_SIZE 4096
+
+/**
+ * Idle time after which buffered received data is written (ms)
+ */
+#define TERMINAL_RX_FLUSH_MS 10
+
 /**
  * Information about an active terminal
+ *
+ * The terminal has no thread of its own: the pseudo-terminal and the idle
+ * flush timer are watched by the I/O thread of the host module (see
+ * osd_hostmod_add_fd_handler()), which also delivers the received events.
  */
 struct osd_terminal_ctx {
     struct osd_hostmod_ctx *hostmod_ctx;
@@ -35,82 +63,184 @@ struct osd_terminal_ctx {
     struct osd_dem_uart_desc *dem_uart_desc;
     struct osd_dem_uart_event_handler dem_uart_event_handler;
 
-    /** Thread responsible for transmitting data to the DEM-UART */
-    pthread_t tx_thread;
-
     /** Absolute path of the created device file */
     char *pts_path;
 
     /** FD used for all the communication, it is thread-safe */
     int masterfd;
 
+    /**
+     * FD of the device file, kept open to prevent a hangup on masterfd if
+     * all users of the device file close it
+     */
+    int slavefd;
+
+    /** timerfd flushing rx_buf after the idle timeout */
+    int flush_timerfd;
+
     /** DI-address of the DEM-UART module we should connect to */
     uint16_t dem_uart_di_addr;
 
-    /** Status of this terminal, read-only for the tx_thread */
+    /** Status of this terminal */
     volatile bool running;
+
+    /** Lock protecting rx_buf, rx_buf_len, rx_last_ns and stats */
+    pthread_mutex_t rx_lock;
+
+    /** Data received from the DEM-UART, not yet written to masterfd */
+    char rx_buf[TERMINAL_RX_BUF_SIZE];
+
+    /** Number of bytes in rx_buf */
+    size_t rx_buf_len;
+
+    /** Time the last data was added to rx_buf (osd_latency_now()) */
+    uint64_t rx_last_ns;
+
+    /** Transfer statistics */
+    struct osd_terminal_stats stats;
 };
 
-static void handle_rx_data(void *arg, const char *str, size_t len)
+/**
+ * Write all buffered received data to the pseudo-terminal
+ *
+ * Must be called with rx_lock held.
+ */
+static void rx_buf_flush(struct osd_terminal_ctx *ctx)
 {
-    struct osd_terminal_ctx *ctx = arg;
-
     size_t written = 0;
     int ret = 0;
-    while (written < len) {
-        ret = write(ctx->masterfd, str + written, len - written);
+    while (written < ctx->rx_buf_len) {
+        ret = write(ctx->masterfd, ctx->rx_buf + written,
+                    ctx->rx_buf_len - written);
+        ctx->stats.rx_writes++;
 
         if (ret == -1) {
             err(ctx->log_ctx, "Failed to write() to device file: %s",
                 strerror(errno));
-            return;
+            break;
         }
 
         written += ret;
     }
+    ctx->rx_buf_len = 0;
 }
 
-static void *terminal_tx_thread(void *arg)
+/**
+ * Arm the idle flush timer (one-shot)
+ */
+static void rx_flush_timer_arm(struct osd_terminal_ctx *ctx, uint64_t ns)
+{
+    struct itimerspec its = {
+        .it_value = { .tv_sec = ns / 1000000000, .tv_nsec = ns % 1000000000 },
+    };
+    if (timerfd_settime(ctx->flush_timerfd, 0, &its, NULL) != 0) {
+        err(ctx->log_ctx, "Failed to arm flush timer: %s", strerror(errno));
+    }
+}
+
+static void handle_rx_data(void *arg, const char *str, size_t len)
 {
     struct osd_terminal_ctx *ctx = arg;
-    osd_result rv;
 
-    struct pollfd fds;
-    fds.fd = ctx->masterfd;
-    fds.events = POLLIN;
-
-    int ret;
-    char buf[256];
-
-    while (ctx->running) {
-        // We use a timeout here so that ctx->running is always checked
-        ret = poll(&fds, 1, 2000);
-        switch (ret) {
-            case -1:
-                err(ctx->log_ctx, "Failed to poll() masterfd: %s",
-                    strerror(errno));
-                return NULL;
-            case 0:
-                continue;
-            // The default is to run the code below
+    pthread_mutex_lock(&ctx->rx_lock);
+
+    if (!ctx->running) {
+        pthread_mutex_unlock(&ctx->rx_lock);
+        return;
+    }
+
+    bool was_empty = (ctx->rx_buf_len == 0);
+    ctx->stats.rx_chars += len;
+
+    while (len > 0) {
+        size_t n = sizeof(ctx->rx_buf) - ctx->rx_buf_len;
+        if (n > len) {
+            n = len;
         }
+        memcpy(ctx->rx_buf + ctx->rx_buf_len, str, n);
+        ctx->rx_buf_len += n;
 
-        ret = read(ctx->masterfd, buf, sizeof(buf));
+        bool newline = memchr(str, '\n', n) != NULL;
+        if (newline || ctx->rx_buf_len == sizeof(ctx->rx_buf)) {
+            rx_buf_flush(ctx);
+        }
 
-        if (ret == -1) {
+        str += n;
+        len -= n;
+    }
+
+    ctx->rx_last_ns = osd_latency_now();
+
+    // Flush the remaining data after the idle timeout. A timer which is
+    // already running is re-armed when it expires.
+    if (was_empty && ctx->rx_buf_len > 0) {
+        rx_flush_timer_arm(ctx, (uint64_t)TERMINAL_RX_FLUSH_MS * 1000 * 1000);
+    }
+
+    pthread_mutex_unlock(&ctx->rx_lock);
+}
+
+/**
+ * The idle flush timer expired
+ *
+ * Flush the received data if no new data was received for
+ * TERMINAL_RX_FLUSH_MS, otherwise wait for the rest of the idle time.
+ */
+static osd_result handle_rx_flush_timer(void *arg, int fd)
+{
+    struct osd_terminal_ctx *ctx = arg;
+
+    uint64_t expirations;
+    if (read(fd, &expirations, sizeof(expirations)) == -1) {
+        // spurious wakeup, the timer was re-armed or disarmed
+        return OSD_OK;
+    }
+
+    pthread_mutex_lock(&ctx->rx_lock);
+    if (ctx->rx_buf_len > 0) {
+        uint64_t idle_ns = osd_latency_now() - ctx->rx_last_ns;
+        uint64_t flush_ns = (uint64_t)TERMINAL_RX_FLUSH_MS * 1000 * 1000;
+        if (idle_ns >= flush_ns) {
+            rx_buf_flush(ctx);
+        } else {
+            rx_flush_timer_arm(ctx, flush_ns - idle_ns);
+        }
+    }
+    pthread_mutex_unlock(&ctx->rx_lock);
+
+    return OSD_OK;
+}
+
+/**
+ * Data is available on the pseudo-terminal: send it to the DEM-UART
+ */
+static osd_result handle_tx_data(void *arg, int fd)
+{
+    struct osd_terminal_ctx *ctx = arg;
+    osd_result rv;
+
+    char buf[TERMINAL_TX_CHUNK];
+    int ret = read(fd, buf, sizeof(buf));
+    if (ret <= 0) {
+        if (ret == -1 && errno != EAGAIN) {
             err(ctx->log_ctx, "Failed to read() from masterfd: %s",
                 strerror(errno));
-            continue;
         }
+        return OSD_ERROR_FAILURE;
+    }
 
-        rv = osd_cl_dem_uart_send_string(ctx->hostmod_ctx, ctx->dem_uart_desc,
-                                         buf, (size_t) ret);
-        if (OSD_FAILED(rv)) {
-            err(ctx->log_ctx, "Failed to send string to DEM-UART!");
-        }
+    pthread_mutex_lock(&ctx->rx_lock);
+    ctx->stats.tx_chars += ret;
+    ctx->stats.tx_reads++;
+    pthread_mutex_unlock(&ctx->rx_lock);
+
+    rv = osd_cl_dem_uart_send_string(ctx->hostmod_ctx, ctx->dem_uart_desc, buf,
+                                     (size_t)ret);
+    if (OSD_FAILED(rv)) {
+        err(ctx->log_ctx, "Failed to send string to DEM-UART!");
     }
 
-    return NULL;
+    return rv;
 }
 
 API_EXPORT
@@ -135,6 +265,13 @@ osd_result osd_terminal_new(struct osd_terminal_ctx **ctx,
     if (OSD_FAILED(rv)) {
         return rv;
     }
+    osd_hostmod_set_event_batch_handler(c->hostmod_ctx,
+                                        osd_cl_dem_uart_receive_event_batch);
+
+    pthread_mutex_init(&c->rx_lock, NULL);
+    c->masterfd = -1;
+    c->slavefd = -1;
+    c->flush_timerfd = -1;
 
     c->dem_uart_desc = calloc(1, sizeof(struct osd_dem_uart_desc));
     assert(c->dem_uart_desc);
@@ -155,6 +292,8 @@ void osd_terminal_free(struct osd_terminal_ctx **ctx_p)
 
     osd_hostmod_free(&(ctx->hostmod_ctx));
 
+    pthread_mutex_destroy(&ctx->rx_lock);
+
     free(ctx->dem_uart_desc);
     free(ctx->pts_path);
 
@@ -184,11 +323,34 @@ bool osd_terminal_is_connected(struct osd_terminal_ctx *ctx)
     return osd_hostmod_is_connected(ctx->hostmod_ctx);
 }
 
+/**
+ * Close all file descriptors of a started terminal
+ */
+static void close_fds(struct osd_terminal_ctx *ctx)
+{
+    // Closing all FDs of the pseudo-terminal also removes the corresponding
+    // /dev/pts/ node
+    if (ctx->slavefd != -1) {
+        close(ctx->slavefd);
+        ctx->slavefd = -1;
+    }
+    if (ctx->masterfd != -1) {
+        close(ctx->masterfd);
+        ctx->masterfd = -1;
+    }
+    if (ctx->flush_timerfd != -1) {
+        close(ctx->flush_timerfd);
+        ctx->flush_timerfd = -1;
+    }
+}
+
 API_EXPORT
 osd_result osd_terminal_start(struct osd_terminal_ctx *ctx)
 {
     struct termios termios;
     osd_result rv;
+    bool tx_handler_added = false;
+    bool flush_handler_added = false;
 
     osd_cl_dem_uart_get_desc(ctx->hostmod_ctx, ctx->dem_uart_di_addr,
                              ctx->dem_uart_desc);
@@ -206,6 +368,14 @@ osd_result osd_terminal_start(struct osd_terminal_ctx *ctx)
         return OSD_ERROR_FAILURE;
     }
 
+    ctx->flush_timerfd =
+        timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (ctx->flush_timerfd < 0) {
+        err(ctx->log_ctx, "Failed to create flush timer: %s", strerror(errno));
+        rv = OSD_ERROR_FAILURE;
+        goto error_return;
+    }
+
     if (grantpt(ctx->masterfd) != 0) {
         err(ctx->log_ctx, "granpt() failed: %s", strerror(errno));
         rv = OSD_ERROR_FAILURE;
@@ -250,22 +420,45 @@ osd_result osd_terminal_start(struct osd_terminal_ctx *ctx)
         goto error_return;
     }
 
-    rv = osd_hostmod_mod_set_event_active(ctx->hostmod_ctx,
-                                          ctx->dem_uart_desc->di_addr, true, 0);
-    if (OSD_FAILED(rv)) {
+    ctx->pts_path = strdup(ptsname(ctx->masterfd));
+    assert(ctx->pts_path);
+
+    // Without any open device file the master FD signals a hangup, which
+    // would wake up the I/O thread continuously.
+    ctx->slavefd = open(ctx->pts_path, O_RDWR | O_NOCTTY);
+    if (ctx->slavefd < 0) {
+        err(ctx->log_ctx, "Failed to open %s: %s", ctx->pts_path,
+            strerror(errno));
+        rv = OSD_ERROR_FAILURE;
         goto error_return;
     }
 
+    pthread_mutex_lock(&ctx->rx_lock);
+    ctx->rx_buf_len = 0;
+    memset(&ctx->stats, 0, sizeof(ctx->stats));
+    clock_gettime(CLOCK_MONOTONIC, &ctx->stats.start_time);
     ctx->running = true;
-    int ret = pthread_create(&(ctx->tx_thread), NULL, terminal_tx_thread, ctx);
-    if (ret) {
-        err(ctx->log_ctx, "Failed to create new pthread: %s", strerror(ret));
-        rv = OSD_ERROR_FAILURE;
+    pthread_mutex_unlock(&ctx->rx_lock);
+
+    rv = osd_hostmod_add_fd_handler(ctx->hostmod_ctx, ctx->masterfd,
+                                    handle_tx_data, ctx);
+    if (OSD_FAILED(rv)) {
         goto error_return;
     }
+    tx_handler_added = true;
 
-    ctx->pts_path = strdup(ptsname(ctx->masterfd));
-    assert(ctx->pts_path);
+    rv = osd_hostmod_add_fd_handler(ctx->hostmod_ctx, ctx->flush_timerfd,
+                                    handle_rx_flush_timer, ctx);
+    if (OSD_FAILED(rv)) {
+        goto error_return;
+    }
+    flush_handler_added = true;
+
+    rv = osd_hostmod_mod_set_event_active(ctx->hostmod_ctx,
+                                          ctx->dem_uart_desc->di_addr, true, 0);
+    if (OSD_FAILED(rv)) {
+        goto error_return;
+    }
 
     info(ctx->log_ctx, "DEM-UART pseudo-terminal available at %s\n",
          ctx->pts_path);
@@ -273,7 +466,15 @@ osd_result osd_terminal_start(struct osd_terminal_ctx *ctx)
     rv = OSD_OK;
 error_return:
     if (OSD_FAILED(rv)) {
-        close(ctx->masterfd);
+        ctx->running = false;
+        if (tx_handler_added) {
+            osd_hostmod_remove_fd_handler(ctx->hostmod_ctx, ctx->masterfd);
+        }
+        if (flush_handler_added) {
+            osd_hostmod_remove_fd_handler(ctx->hostmod_ctx,
+                                          ctx->flush_timerfd);
+        }
+        close_fds(ctx);
     }
 
     return rv;
@@ -290,14 +491,26 @@ osd_result osd_terminal_stop(struct osd_terminal_ctx *ctx)
         return rv;
     }
 
+    // Drop events which are still in flight
+    pthread_mutex_lock(&ctx->rx_lock);
     ctx->running = false;
+    pthread_mutex_unlock(&ctx->rx_lock);
 
-    if (pthread_join(ctx->tx_thread, NULL)) {
-        err(ctx->log_ctx, "Unable to join terminal_tx_thread");
+    // The I/O thread stops watching the FDs immediately
+    rv = osd_hostmod_remove_fd_handler(ctx->hostmod_ctx, ctx->masterfd);
+    if (OSD_FAILED(rv)) {
+        err(ctx->log_ctx, "Unable to stop watching the pseudo-terminal");
     }
+    rv = osd_hostmod_remove_fd_handler(ctx->hostmod_ctx, ctx->flush_timerfd);
+    if (OSD_FAILED(rv)) {
+        err(ctx->log_ctx, "Unable to stop watching the flush timer");
+    }
+
+    pthread_mutex_lock(&ctx->rx_lock);
+    rx_buf_flush(ctx);
+    pthread_mutex_unlock(&ctx->rx_lock);
 
-    // Closing the master FD also removes the corresponding /dev/pts/ node
-    close(ctx->masterfd);
+    close_fds(ctx);
 
     return OSD_OK;
 }
@@ -313,3 +526,15 @@ const char *osd_terminal_get_pts_path(struct osd_terminal_ctx *ctx)
 {
     return ctx->pts_path;
 }
+
+API_EXPORT
+void osd_terminal_get_stats(struct osd_terminal_ctx *ctx,
+                            struct osd_terminal_stats *stats)
+{
+    assert(ctx);
+    assert(stats);
+
+    pthread_mutex_lock(&ctx->rx_lock);
+    *stats = ctx->stats;
+    pthread_mutex_unlock(&ctx->rx_lock);
+}
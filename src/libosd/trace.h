@@ -0,0 +1,145 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Static tracepoints (USDT probes) of libosd
+ *
+ * If sys/sdt.h (SystemTap SDT headers) is available at build time, the
+ * tracepoints compile to USDT probes of the provider "libosd", which can be
+ * attached to with perf, bpftrace or SystemTap. A probe which is not attached
+ * costs a single nop instruction. Otherwise the tracepoints compile to
+ * nothing.
+ *
+ * All probes of libosd are listed in this file. The probe name is the macro
+ * name without the OSD_TRACE_ prefix, in lower case.
+ */
+
+#ifndef OSD_TRACE_H
+#define OSD_TRACE_H
+
+#ifdef USE_USDT
+#include <sys/sdt.h>
+#define OSD_TRACE1(name, a1) DTRACE_PROBE1(libosd, name, a1)
+#define OSD_TRACE2(name, a1, a2) DTRACE_PROBE2(libosd, name, a1, a2)
+#define OSD_TRACE3(name, a1, a2, a3) DTRACE_PROBE3(libosd, name, a1, a2, a3)
+#define OSD_TRACE4(name, a1, a2, a3, a4) \
+    DTRACE_PROBE4(libosd, name, a1, a2, a3, a4)
+#define OSD_TRACE5(name, a1, a2, a3, a4, a5) \
+    DTRACE_PROBE5(libosd, name, a1, a2, a3, a4, a5)
+#else
+#define OSD_TRACE1(name, a1) do {} while (0)
+#define OSD_TRACE2(name, a1, a2) do {} while (0)
+#define OSD_TRACE3(name, a1, a2, a3) do {} while (0)
+#define OSD_TRACE4(name, a1, a2, a3, a4) do {} while (0)
+#define OSD_TRACE5(name, a1, a2, a3, a4, a5) do {} while (0)
+#endif
+
+/**
+ * Gateway read a packet from the device
+ *
+ * @param src DI address of the packet source
+ * @param dest DI address of the packet destination
+ * @param words packet size in 16 bit words
+ */
+#define OSD_TRACE_GATEWAY_PKG_RX(src, dest, words) \
+    OSD_TRACE3(gateway_pkg_rx, src, dest, words)
+
+/**
+ * Gateway wrote a packet to the device
+ *
+ * @param src DI address of the packet source
+ * @param dest DI address of the packet destination
+ * @param words packet size in 16 bit words
+ * @param result return value of the packet_write() callback
+ */
+#define OSD_TRACE_GATEWAY_PKG_TX(src, dest, words, result) \
+    OSD_TRACE4(gateway_pkg_tx, src, dest, words, result)
+
+/**
+ * Host controller took a routing decision for a data packet
+ *
+ * @param src DI address of the packet source
+ * @param dest DI address of the packet destination
+ * @param result 0 if the packet was routed, otherwise the reason it was
+ *               dropped (enum osd_flightrec_drop_reason)
+ */
+#define OSD_TRACE_HOSTCTRL_ROUTE(src, dest, result) \
+    OSD_TRACE3(hostctrl_route, src, dest, result)
+
+/**
+ * Host module sent a register access request
+ *
+ * @param diaddr DI address of the accessed module
+ * @param reg_addr register address
+ * @param subtype packet subtype of the request (enum
+ *                osd_packet_type_reg_subtype)
+ */
+#define OSD_TRACE_HOSTMOD_REG_REQ(diaddr, reg_addr, subtype) \
+    OSD_TRACE3(hostmod_reg_req, diaddr, reg_addr, subtype)
+
+/**
+ * Host module completed a register access
+ *
+ * @param diaddr DI address of the accessed module
+ * @param reg_addr register address
+ * @param result result of the access (osd_result)
+ */
+#define OSD_TRACE_HOSTMOD_REG_DONE(diaddr, reg_addr, result) \
+    OSD_TRACE3(hostmod_reg_done, diaddr, reg_addr, result)
+
+/**
+ * Host module passed event packets to the event handler
+ *
+ * @param diaddr DI address of the host module (destination of the packets)
+ * @param count number of packets
+ */
+#define OSD_TRACE_HOSTMOD_EVENT_DELIVER(diaddr, count) \
+    OSD_TRACE2(hostmod_event_deliver, diaddr, count)
+
+/**
+ * Start of a memory transfer through a MAM
+ *
+ * @param diaddr DI address of the MAM
+ * @param addr start address in the memory
+ * @param nbyte number of bytes
+ * @param write 1 for writes, 0 for reads
+ */
+#define OSD_TRACE_MAM_XFER_START(diaddr, addr, nbyte, write) \
+    OSD_TRACE4(mam_xfer_start, diaddr, addr, nbyte, write)
+
+/**
+ * End of a memory transfer through a MAM
+ *
+ * @param diaddr DI address of the MAM
+ * @param addr start address in the memory
+ * @param nbyte number of bytes
+ * @param write 1 for writes, 0 for reads
+ * @param result result of the transfer (osd_result)
+ */
+#define OSD_TRACE_MAM_XFER_END(diaddr, addr, nbyte, write, result) \
+    OSD_TRACE5(mam_xfer_end, diaddr, addr, nbyte, write, result)
+
+/**
+ * A log record was emitted (independent of the log function being set)
+ *
+ * @param priority priority of the message (LOG_*)
+ * @param file source file (string)
+ * @param line source line
+ * @param format format string of the message (string)
+ */
+#define OSD_TRACE_LOG(priority, file, line, format) \
+    OSD_TRACE4(log, priority, file, line, format)
+
+#endif // OSD_TRACE_H
@@ -0,0 +1,1304 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <osd/capture.h>
+#include <osd/coretracelogger.h>
+#include <osd/osd.h>
+#include <osd/systracelogger.h>
+#include <osd/tracepipe.h>
+#include "osd-private.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * A batch of events travelling through the pipeline
+ */
+struct pipe_batch {
+    struct osd_trace_batch b; //!< the events (must be the first member)
+
+    /**
+     * The batch is a flush request: flush all stages when the batch passes
+     * them
+     */
+    bool is_flush;
+
+    struct pipe_batch *next_free; //!< next batch in the pool
+};
+
+/**
+ * A stage in the pipeline
+ */
+struct stage {
+    struct osd_tracepipe_stage_ops ops;
+    void *arg;
+    unsigned int flags;
+    uint64_t errors; //!< number of failed calls to the stage
+};
+
+/**
+ * A sequence of stages running in the same thread
+ *
+ * The first segment runs in the thread pushing the events, all other segments
+ * start with a threaded stage and have their own thread.
+ */
+struct segment {
+    struct osd_tracepipe_ctx *pipe;
+    size_t first_stage; //!< index of the first stage of the segment
+    size_t num_stages; //!< number of stages in the segment
+
+    pthread_t thread;
+    /** protects the queue and |stop| */
+    pthread_mutex_t lock;
+    /** signalled when a batch is added to or removed from the queue */
+    pthread_cond_t cond;
+    struct pipe_batch **queue; //!< ring buffer of batches to process
+    size_t queue_head; //!< index of the oldest batch in |queue|
+    size_t queue_len; //!< number of batches in |queue|
+    bool stop; //!< stop the thread once the queue is empty
+};
+
+/**
+ * Trace pipeline context
+ */
+struct osd_tracepipe_ctx {
+    struct osd_log_ctx *log_ctx;
+    size_t batch_size;
+    unsigned int queue_depth;
+
+    struct stage *stages;
+    size_t num_stages;
+
+    struct segment *segments;
+    size_t num_segments;
+
+    /**
+     * Protects the input batch, |running| and the input statistics. All
+     * stages in the first segment are called with this lock held.
+     */
+    pthread_mutex_t input_lock;
+    /** signalled when the input batch becomes non-empty */
+    pthread_cond_t input_cond;
+    bool running;
+    struct pipe_batch *input; //!< batch collecting newly pushed events
+    struct timespec input_start; //!< time the first event was pushed
+    uint64_t flush_requested; //!< number of flush requests
+    uint64_t stats_events;
+    uint64_t stats_batches;
+
+    /** dispatch incomplete batches after OSD_TRACEPIPE_MAX_LATENCY_MS */
+    pthread_t linger_thread;
+    bool linger_stop;
+
+    /** protects |pool| */
+    pthread_mutex_t pool_lock;
+    struct pipe_batch *pool; //!< unused batches
+
+    /** protects |flush_done| */
+    pthread_mutex_t flush_lock;
+    pthread_cond_t flush_cond;
+    uint64_t flush_done; //!< number of completed flush requests
+
+    /** protects the statistics updated from all threads */
+    pthread_mutex_t stats_lock;
+    uint64_t stats_queue_full;
+    uint64_t stats_stage_errors;
+};
+
+API_EXPORT
+struct osd_trace_event *osd_trace_batch_append(struct osd_trace_batch *batch)
+{
+    assert(batch);
+
+    if (batch->num_events == batch->capacity) {
+        batch->capacity = batch->capacity ? batch->capacity * 2 : 16;
+        batch->events =
+            realloc(batch->events,
+                    batch->capacity * sizeof(struct osd_trace_event));
+        assert(batch->events);
+    }
+    return &batch->events[batch->num_events++];
+}
+
+static struct pipe_batch *pool_get(struct osd_tracepipe_ctx *ctx)
+{
+    pthread_mutex_lock(&ctx->pool_lock);
+    struct pipe_batch *pb = ctx->pool;
+    if (pb) {
+        ctx->pool = pb->next_free;
+    }
+    pthread_mutex_unlock(&ctx->pool_lock);
+
+    if (!pb) {
+        pb = calloc(1, sizeof(struct pipe_batch));
+        assert(pb);
+        pb->b.capacity = ctx->batch_size;
+        pb->b.events = calloc(pb->b.capacity, sizeof(struct osd_trace_event));
+        assert(pb->b.events);
+    }
+    return pb;
+}
+
+static void pool_put(struct osd_tracepipe_ctx *ctx, struct pipe_batch *pb)
+{
+    pb->b.num_events = 0;
+    pb->is_flush = false;
+
+    pthread_mutex_lock(&ctx->pool_lock);
+    pb->next_free = ctx->pool;
+    ctx->pool = pb;
+    pthread_mutex_unlock(&ctx->pool_lock);
+}
+
+static void batch_free(struct pipe_batch *pb)
+{
+    free(pb->b.events);
+    free(pb);
+}
+
+static void stage_failed(struct osd_tracepipe_ctx *ctx, size_t stage_idx,
+                         osd_result rv)
+{
+    struct stage *stage = &ctx->stages[stage_idx];
+
+    // log only the first error to avoid flooding the log for every batch
+    if (stage->errors++ == 0) {
+        err(ctx->log_ctx, "Stage %zu of the trace pipeline failed (%d).",
+            stage_idx, rv);
+    }
+    pthread_mutex_lock(&ctx->stats_lock);
+    ctx->stats_stage_errors++;
+    pthread_mutex_unlock(&ctx->stats_lock);
+}
+
+static void segment_enqueue(struct segment *seg, struct pipe_batch *pb)
+{
+    struct osd_tracepipe_ctx *ctx = seg->pipe;
+
+    pthread_mutex_lock(&seg->lock);
+    if (seg->queue_len == ctx->queue_depth) {
+        pthread_mutex_lock(&ctx->stats_lock);
+        ctx->stats_queue_full++;
+        pthread_mutex_unlock(&ctx->stats_lock);
+
+        while (seg->queue_len == ctx->queue_depth) {
+            pthread_cond_wait(&seg->cond, &seg->lock);
+        }
+    }
+    seg->queue[(seg->queue_head + seg->queue_len) % ctx->queue_depth] = pb;
+    seg->queue_len++;
+    pthread_cond_broadcast(&seg->cond);
+    pthread_mutex_unlock(&seg->lock);
+}
+
+/**
+ * Pass a batch through all stages of a segment and hand it over to the next
+ * segment
+ */
+static void run_segment(struct osd_tracepipe_ctx *ctx, size_t seg_idx,
+                        struct pipe_batch *pb)
+{
+    osd_result rv;
+    struct segment *seg = &ctx->segments[seg_idx];
+
+    for (size_t i = seg->first_stage; i < seg->first_stage + seg->num_stages;
+         i++) {
+        struct stage *stage = &ctx->stages[i];
+
+        if (pb->b.num_events > 0) {
+            rv = stage->ops.process(stage->arg, &pb->b);
+            if (OSD_FAILED(rv)) {
+                stage_failed(ctx, i, rv);
+            }
+        }
+        if (pb->is_flush && stage->ops.flush) {
+            rv = stage->ops.flush(stage->arg, &pb->b);
+            if (OSD_FAILED(rv)) {
+                stage_failed(ctx, i, rv);
+            }
+        }
+    }
+
+    if (seg_idx + 1 < ctx->num_segments) {
+        if (pb->b.num_events == 0 && !pb->is_flush) {
+            // all events have been filtered out
+            pool_put(ctx, pb);
+            return;
+        }
+        segment_enqueue(&ctx->segments[seg_idx + 1], pb);
+        return;
+    }
+
+    if (pb->is_flush) {
+        pthread_mutex_lock(&ctx->flush_lock);
+        ctx->flush_done++;
+        pthread_cond_broadcast(&ctx->flush_cond);
+        pthread_mutex_unlock(&ctx->flush_lock);
+    }
+    pool_put(ctx, pb);
+}
+
+static void *segment_thread(void *arg)
+{
+    struct segment *seg = arg;
+    struct osd_tracepipe_ctx *ctx = seg->pipe;
+    size_t seg_idx = seg - ctx->segments;
+
+    pthread_mutex_lock(&seg->lock);
+    while (true) {
+        while (seg->queue_len == 0 && !seg->stop) {
+            pthread_cond_wait(&seg->cond, &seg->lock);
+        }
+        if (seg->queue_len == 0) {
+            break;
+        }
+        struct pipe_batch *pb = seg->queue[seg->queue_head];
+        seg->queue_head = (seg->queue_head + 1) % ctx->queue_depth;
+        seg->queue_len--;
+        pthread_cond_broadcast(&seg->cond);
+        pthread_mutex_unlock(&seg->lock);
+
+        run_segment(ctx, seg_idx, pb);
+
+        pthread_mutex_lock(&seg->lock);
+    }
+    pthread_mutex_unlock(&seg->lock);
+
+    return NULL;
+}
+
+/**
+ * Pass the input batch into the pipeline
+ *
+ * Must be called with the input lock held.
+ */
+static void dispatch_input(struct osd_tracepipe_ctx *ctx, bool is_flush)
+{
+    struct pipe_batch *pb = ctx->input;
+    ctx->input = pool_get(ctx);
+    pb->is_flush = is_flush;
+    ctx->stats_batches++;
+    run_segment(ctx, 0, pb);
+}
+
+static void timespec_add_ms(struct timespec *ts, unsigned int ms)
+{
+    ts->tv_sec += ms / 1000;
+    ts->tv_nsec += (ms % 1000) * 1000000L;
+    if (ts->tv_nsec >= 1000000000L) {
+        ts->tv_sec++;
+        ts->tv_nsec -= 1000000000L;
+    }
+}
+
+static bool timespec_before(const struct timespec *a, const struct timespec *b)
+{
+    return a->tv_sec < b->tv_sec ||
+           (a->tv_sec == b->tv_sec && a->tv_nsec < b->tv_nsec);
+}
+
+static void *linger_thread(void *arg)
+{
+    struct osd_tracepipe_ctx *ctx = arg;
+
+    pthread_mutex_lock(&ctx->input_lock);
+    while (!ctx->linger_stop) {
+        if (ctx->input->b.num_events == 0) {
+            pthread_cond_wait(&ctx->input_cond, &ctx->input_lock);
+            continue;
+        }
+
+        struct timespec deadline = ctx->input_start;
+        timespec_add_ms(&deadline, OSD_TRACEPIPE_MAX_LATENCY_MS);
+        pthread_cond_timedwait(&ctx->input_cond, &ctx->input_lock, &deadline);
+
+        // the batch might have been dispatched (and a new one started) while
+        // waiting
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        deadline = ctx->input_start;
+        timespec_add_ms(&deadline, OSD_TRACEPIPE_MAX_LATENCY_MS);
+        if (ctx->input->b.num_events > 0 && !timespec_before(&now, &deadline)) {
+            dispatch_input(ctx, false);
+        }
+    }
+    pthread_mutex_unlock(&ctx->input_lock);
+
+    return NULL;
+}
+
+API_EXPORT
+osd_result osd_tracepipe_new(struct osd_tracepipe_ctx **ctx,
+                             struct osd_log_ctx *log_ctx, size_t batch_size,
+                             unsigned int queue_depth)
+{
+    struct osd_tracepipe_ctx *c = calloc(1, sizeof(struct osd_tracepipe_ctx));
+    assert(c);
+
+    c->log_ctx = log_ctx;
+    c->batch_size = batch_size ? batch_size : OSD_TRACEPIPE_BATCH_SIZE_DEFAULT;
+    c->queue_depth = queue_depth ? queue_depth
+                                 : OSD_TRACEPIPE_QUEUE_DEPTH_DEFAULT;
+
+    pthread_mutex_init(&c->input_lock, NULL);
+    pthread_condattr_t condattr;
+    pthread_condattr_init(&condattr);
+    pthread_condattr_setclock(&condattr, CLOCK_MONOTONIC);
+    pthread_cond_init(&c->input_cond, &condattr);
+    pthread_condattr_destroy(&condattr);
+    pthread_mutex_init(&c->pool_lock, NULL);
+    pthread_mutex_init(&c->flush_lock, NULL);
+    pthread_cond_init(&c->flush_cond, NULL);
+    pthread_mutex_init(&c->stats_lock, NULL);
+
+    c->input = pool_get(c);
+
+    *ctx = c;
+
+    return OSD_OK;
+}
+
+/**
+ * Pass all pushed events through the pipeline and wait until all stages have
+ * been flushed
+ */
+static void flush_pipeline(struct osd_tracepipe_ctx *ctx)
+{
+    pthread_mutex_lock(&ctx->input_lock);
+    uint64_t flush_id = ++ctx->flush_requested;
+    dispatch_input(ctx, true);
+    pthread_mutex_unlock(&ctx->input_lock);
+
+    pthread_mutex_lock(&ctx->flush_lock);
+    while (ctx->flush_done < flush_id) {
+        pthread_cond_wait(&ctx->flush_cond, &ctx->flush_lock);
+    }
+    pthread_mutex_unlock(&ctx->flush_lock);
+}
+
+API_EXPORT
+void osd_tracepipe_free(struct osd_tracepipe_ctx **ctx_p)
+{
+    assert(ctx_p);
+    struct osd_tracepipe_ctx *ctx = *ctx_p;
+    if (!ctx) {
+        return;
+    }
+
+    pthread_mutex_lock(&ctx->input_lock);
+    bool was_running = ctx->running;
+    ctx->running = false;
+    pthread_mutex_unlock(&ctx->input_lock);
+
+    if (was_running) {
+        flush_pipeline(ctx);
+
+        pthread_mutex_lock(&ctx->input_lock);
+        ctx->linger_stop = true;
+        pthread_cond_signal(&ctx->input_cond);
+        pthread_mutex_unlock(&ctx->input_lock);
+        pthread_join(ctx->linger_thread, NULL);
+
+        for (size_t i = 1; i < ctx->num_segments; i++) {
+            struct segment *seg = &ctx->segments[i];
+            pthread_mutex_lock(&seg->lock);
+            seg->stop = true;
+            pthread_cond_broadcast(&seg->cond);
+            pthread_mutex_unlock(&seg->lock);
+            pthread_join(seg->thread, NULL);
+        }
+    }
+
+    for (size_t i = 0; i < ctx->num_segments; i++) {
+        pthread_mutex_destroy(&ctx->segments[i].lock);
+        pthread_cond_destroy(&ctx->segments[i].cond);
+        free(ctx->segments[i].queue);
+    }
+    free(ctx->segments);
+
+    for (size_t i = 0; i < ctx->num_stages; i++) {
+        if (ctx->stages[i].ops.free) {
+            ctx->stages[i].ops.free(ctx->stages[i].arg);
+        }
+    }
+    free(ctx->stages);
+
+    batch_free(ctx->input);
+    while (ctx->pool) {
+        struct pipe_batch *pb = ctx->pool;
+        ctx->pool = pb->next_free;
+        batch_free(pb);
+    }
+
+    pthread_mutex_destroy(&ctx->input_lock);
+    pthread_cond_destroy(&ctx->input_cond);
+    pthread_mutex_destroy(&ctx->pool_lock);
+    pthread_mutex_destroy(&ctx->flush_lock);
+    pthread_cond_destroy(&ctx->flush_cond);
+    pthread_mutex_destroy(&ctx->stats_lock);
+
+    free(ctx);
+    *ctx_p = NULL;
+}
+
+API_EXPORT
+osd_result osd_tracepipe_add_stage(struct osd_tracepipe_ctx *ctx,
+                                   const struct osd_tracepipe_stage_ops *ops,
+                                   void *arg, unsigned int flags)
+{
+    assert(ctx);
+    assert(ops);
+    assert(ops->process);
+
+    if (osd_tracepipe_is_running(ctx)) {
+        err(ctx->log_ctx, "Stages cannot be added to a running pipeline.");
+        return OSD_ERROR_FAILURE;
+    }
+
+    ctx->stages = realloc(ctx->stages,
+                          (ctx->num_stages + 1) * sizeof(struct stage));
+    assert(ctx->stages);
+    struct stage *stage = &ctx->stages[ctx->num_stages++];
+    memset(stage, 0, sizeof(struct stage));
+    stage->ops = *ops;
+    stage->arg = arg;
+    stage->flags = flags;
+
+    return OSD_OK;
+}
+
+API_EXPORT
+osd_result osd_tracepipe_start(struct osd_tracepipe_ctx *ctx)
+{
+    int irv;
+
+    assert(ctx);
+
+    if (osd_tracepipe_is_running(ctx)) {
+        return OSD_OK;
+    }
+
+    // split the stages into segments at all threaded stages
+    ctx->num_segments = 1;
+    for (size_t i = 0; i < ctx->num_stages; i++) {
+        if (ctx->stages[i].flags & OSD_TRACEPIPE_THREADED) {
+            ctx->num_segments++;
+        }
+    }
+    ctx->segments = calloc(ctx->num_segments, sizeof(struct segment));
+    assert(ctx->segments);
+
+    size_t seg_idx = 0;
+    for (size_t i = 0; i < ctx->num_stages; i++) {
+        if (ctx->stages[i].flags & OSD_TRACEPIPE_THREADED) {
+            seg_idx++;
+            ctx->segments[seg_idx].first_stage = i;
+        }
+        ctx->segments[seg_idx].num_stages++;
+    }
+
+    for (size_t i = 0; i < ctx->num_segments; i++) {
+        struct segment *seg = &ctx->segments[i];
+        seg->pipe = ctx;
+        pthread_mutex_init(&seg->lock, NULL);
+        pthread_cond_init(&seg->cond, NULL);
+        if (i == 0) {
+            continue;
+        }
+        seg->queue = calloc(ctx->queue_depth, sizeof(struct pipe_batch *));
+        assert(seg->queue);
+        irv = pthread_create(&seg->thread, NULL, segment_thread, seg);
+        assert(irv == 0);
+    }
+
+    irv = pthread_create(&ctx->linger_thread, NULL, linger_thread, ctx);
+    assert(irv == 0);
+
+    pthread_mutex_lock(&ctx->input_lock);
+    ctx->running = true;
+    pthread_mutex_unlock(&ctx->input_lock);
+
+    dbg(ctx->log_ctx, "Started trace pipeline with %zu stages in %zu threads.",
+        ctx->num_stages, ctx->num_segments);
+
+    return OSD_OK;
+}
+
+API_EXPORT
+bool osd_tracepipe_is_running(struct osd_tracepipe_ctx *ctx)
+{
+    assert(ctx);
+
+    pthread_mutex_lock(&ctx->input_lock);
+    bool running = ctx->running;
+    pthread_mutex_unlock(&ctx->input_lock);
+
+    return running;
+}
+
+API_EXPORT
+osd_result osd_tracepipe_push(struct osd_tracepipe_ctx *ctx,
+                              const struct osd_trace_event *event)
+{
+    assert(ctx);
+    assert(event);
+
+    pthread_mutex_lock(&ctx->input_lock);
+    if (!ctx->running) {
+        pthread_mutex_unlock(&ctx->input_lock);
+        return OSD_ERROR_FAILURE;
+    }
+
+    *osd_trace_batch_append(&ctx->input->b) = *event;
+    ctx->stats_events++;
+
+    if (ctx->input->b.num_events == 1) {
+        clock_gettime(CLOCK_MONOTONIC, &ctx->input_start);
+        pthread_cond_signal(&ctx->input_cond);
+    }
+    if (ctx->input->b.num_events >= ctx->batch_size) {
+        dispatch_input(ctx, false);
+    }
+    pthread_mutex_unlock(&ctx->input_lock);
+
+    return OSD_OK;
+}
+
+API_EXPORT
+osd_result osd_tracepipe_flush(struct osd_tracepipe_ctx *ctx)
+{
+    assert(ctx);
+
+    if (!osd_tracepipe_is_running(ctx)) {
+        return OSD_OK;
+    }
+    flush_pipeline(ctx);
+
+    return OSD_OK;
+}
+
+API_EXPORT
+osd_result osd_tracepipe_get_stats(struct osd_tracepipe_ctx *ctx,
+                                   struct osd_tracepipe_stats *stats)
+{
+    assert(ctx);
+    assert(stats);
+
+    pthread_mutex_lock(&ctx->input_lock);
+    stats->events = ctx->stats_events;
+    stats->batches = ctx->stats_batches;
+    pthread_mutex_unlock(&ctx->input_lock);
+
+    pthread_mutex_lock(&ctx->stats_lock);
+    stats->queue_full = ctx->stats_queue_full;
+    stats->stage_errors = ctx->stats_stage_errors;
+    pthread_mutex_unlock(&ctx->stats_lock);
+
+    return OSD_OK;
+}
+
+//
+// Sources
+//
+
+API_EXPORT
+osd_result osd_tracepipe_source_decode(
+    const struct osd_tracepipe_source *source, const struct osd_packet *pkg,
+    struct osd_trace_event *event)
+{
+    osd_result rv;
+
+    assert(source);
+    assert(pkg);
+    assert(event);
+
+    memset(event, 0, sizeof(struct osd_trace_event));
+    event->type = source->type;
+    event->di_addr = osd_packet_get_src(pkg);
+    event->host_ns = osd_capture_timestamp_now();
+
+    switch (source->type) {
+    case OSD_TRACE_EVENT_STM:
+        rv = osd_cl_stm_decode_event(source->desc.stm, pkg, &event->data.stm);
+        event->timestamp = event->data.stm.timestamp;
+        break;
+    case OSD_TRACE_EVENT_CTM:
+        rv = osd_cl_ctm_decode_event(source->desc.ctm, pkg, &event->data.ctm);
+        event->timestamp = event->data.ctm.timestamp;
+        break;
+    case OSD_TRACE_EVENT_CDM:
+        rv = osd_cl_cdm_decode_event(source->desc.cdm, pkg, &event->data.cdm);
+        break;
+    case OSD_TRACE_EVENT_DEM_UART:
+        if (pkg->data_size_words < osd_packet_sizeconv_payload2data(1)) {
+            return OSD_ERROR_DEVICE_INVALID_DATA;
+        }
+        event->data.dem_uart = pkg->data.payload[0] & 0xFF;
+        rv = OSD_OK;
+        break;
+    default:
+        assert(0 && "Unknown source type");
+        rv = OSD_ERROR_FAILURE;
+    }
+
+    return rv;
+}
+
+API_EXPORT
+osd_result osd_tracepipe_handle_packet(void *arg, struct osd_packet *pkg)
+{
+    osd_result rv;
+
+    assert(arg &&
+           "You need to give an event_handler_arg of type "
+           "struct osd_tracepipe_source in osd_hostmod_new()");
+    assert(pkg);
+
+    struct osd_tracepipe_source *source = arg;
+
+    struct osd_trace_event ev;
+    rv = osd_tracepipe_source_decode(source, pkg, &ev);
+    osd_packet_free(&pkg);
+    if (OSD_FAILED(rv)) {
+        // the packet is dropped, but the connection stays usable
+        return rv;
+    }
+
+    return osd_tracepipe_push(source->pipe, &ev);
+}
+
+//
+// Transform stages
+//
+
+struct filter_stage {
+    osd_tracepipe_filter_fn fn;
+    void *fn_arg;
+};
+
+static osd_result filter_process(void *arg, struct osd_trace_batch *batch)
+{
+    struct filter_stage *s = arg;
+
+    size_t out = 0;
+    for (size_t i = 0; i < batch->num_events; i++) {
+        if (s->fn(s->fn_arg, &batch->events[i])) {
+            if (out != i) {
+                batch->events[out] = batch->events[i];
+            }
+            out++;
+        }
+    }
+    batch->num_events = out;
+
+    return OSD_OK;
+}
+
+API_EXPORT
+osd_result osd_tracepipe_add_filter(struct osd_tracepipe_ctx *ctx,
+                                    osd_tracepipe_filter_fn fn, void *fn_arg,
+                                    unsigned int flags)
+{
+    assert(fn);
+
+    static const struct osd_tracepipe_stage_ops ops = {
+        .process = filter_process,
+        .free = free,
+    };
+
+    struct filter_stage *s = calloc(1, sizeof(struct filter_stage));
+    assert(s);
+    s->fn = fn;
+    s->fn_arg = fn_arg;
+
+    osd_result rv = osd_tracepipe_add_stage(ctx, &ops, s, flags);
+    if (OSD_FAILED(rv)) {
+        free(s);
+    }
+    return rv;
+}
+
+/**
+ * Timestamp state of a single module
+ */
+struct unwrap_source {
+    uint16_t di_addr;
+    uint32_t last_timestamp; //!< last seen 32 bit timestamp
+    uint64_t epoch; //!< number of wrap-arounds before |last_timestamp|
+};
+
+struct unwrap_stage {
+    struct unwrap_source *sources;
+    size_t num_sources;
+};
+
+static struct unwrap_source *unwrap_get_source(struct unwrap_stage *s,
+                                               uint16_t di_addr)
+{
+    // only a few modules send trace events, a linear search is sufficient
+    for (size_t i = 0; i < s->num_sources; i++) {
+        if (s->sources[i].di_addr == di_addr) {
+            return &s->sources[i];
+        }
+    }
+
+    s->sources = realloc(s->sources,
+                         (s->num_sources + 1) * sizeof(struct unwrap_source));
+    assert(s->sources);
+    struct unwrap_source *src = &s->sources[s->num_sources++];
+    memset(src, 0, sizeof(struct unwrap_source));
+    src->di_addr = di_addr;
+    return src;
+}
+
+static osd_result unwrap_process(void *arg, struct osd_trace_batch *batch)
+{
+    struct unwrap_stage *s = arg;
+
+    for (size_t i = 0; i < batch->num_events; i++) {
+        struct osd_trace_event *ev = &batch->events[i];
+        uint32_t ts;
+        uint16_t overflow;
+
+        if (ev->type == OSD_TRACE_EVENT_STM) {
+            ts = ev->data.stm.timestamp;
+            overflow = ev->data.stm.overflow;
+        } else if (ev->type == OSD_TRACE_EVENT_CTM) {
+            ts = ev->data.ctm.timestamp;
+            overflow = ev->data.ctm.overflow;
+        } else {
+            continue;
+        }
+
+        struct unwrap_source *src = unwrap_get_source(s, ev->di_addr);
+        if (overflow) {
+            // overflow events carry no timestamp
+            ev->timestamp = (src->epoch << 32) | src->last_timestamp;
+            continue;
+        }
+
+        // Timestamps further apart than half the range are assumed to be on
+        // different sides of a wrap-around.
+        uint64_t epoch = src->epoch;
+        if (ts < src->last_timestamp &&
+            src->last_timestamp - ts > UINT32_MAX / 2) {
+            epoch++;
+        } else if (ts > src->last_timestamp &&
+                   ts - src->last_timestamp > UINT32_MAX / 2 && epoch > 0) {
+            // a late event from before the last wrap-around
+            ev->timestamp = ((epoch - 1) << 32) | ts;
+            continue;
+        }
+
+        if (epoch > src->epoch || ts > src->last_timestamp) {
+            src->epoch = epoch;
+            src->last_timestamp = ts;
+        }
+        ev->timestamp = (epoch << 32) | ts;
+    }
+
+    return OSD_OK;
+}
+
+static void unwrap_free(void *arg)
+{
+    struct unwrap_stage *s = arg;
+    free(s->sources);
+    free(s);
+}
+
+API_EXPORT
+osd_result osd_tracepipe_add_unwrap(struct osd_tracepipe_ctx *ctx,
+                                    unsigned int flags)
+{
+    static const struct osd_tracepipe_stage_ops ops = {
+        .process = unwrap_process,
+        .free = unwrap_free,
+    };
+
+    struct unwrap_stage *s = calloc(1, sizeof(struct unwrap_stage));
+    assert(s);
+
+    osd_result rv = osd_tracepipe_add_stage(ctx, &ops, s, flags);
+    if (OSD_FAILED(rv)) {
+        unwrap_free(s);
+    }
+    return rv;
+}
+
+struct merge_item {
+    struct osd_trace_event ev;
+    uint64_t seq; //!< arrival order, keeps the sort stable
+};
+
+struct merge_stage {
+    size_t window;
+    struct merge_item *held;
+    size_t num_held;
+    size_t alloc_held;
+    uint64_t next_seq;
+};
+
+static int merge_item_cmp(const void *a_void, const void *b_void)
+{
+    const struct merge_item *a = a_void;
+    const struct merge_item *b = b_void;
+
+    if (a->ev.timestamp != b->ev.timestamp) {
+        return a->ev.timestamp < b->ev.timestamp ? -1 : 1;
+    }
+    return a->seq < b->seq ? -1 : (a->seq > b->seq);
+}
+
+/**
+ * Pass on all but the newest |keep| held events in timestamp order
+ */
+static void merge_release(struct merge_stage *s, struct osd_trace_batch *batch,
+                          size_t keep)
+{
+    if (s->num_held <= keep) {
+        return;
+    }
+
+    qsort(s->held, s->num_held, sizeof(struct merge_item), merge_item_cmp);
+
+    size_t release = s->num_held - keep;
+    for (size_t i = 0; i < release; i++) {
+        *osd_trace_batch_append(batch) = s->held[i].ev;
+    }
+    memmove(s->held, s->held + release, keep * sizeof(struct merge_item));
+    s->num_held = keep;
+}
+
+static osd_result merge_process(void *arg, struct osd_trace_batch *batch)
+{
+    struct merge_stage *s = arg;
+
+    if (s->num_held + batch->num_events > s->alloc_held) {
+        s->alloc_held = s->num_held + batch->num_events;
+        s->held = realloc(s->held, s->alloc_held * sizeof(struct merge_item));
+        assert(s->held);
+    }
+    for (size_t i = 0; i < batch->num_events; i++) {
+        s->held[s->num_held].ev = batch->events[i];
+        s->held[s->num_held].seq = s->next_seq++;
+        s->num_held++;
+    }
+    batch->num_events = 0;
+
+    merge_release(s, batch, s->window);
+
+    return OSD_OK;
+}
+
+static osd_result merge_flush(void *arg, struct osd_trace_batch *batch)
+{
+    struct merge_stage *s = arg;
+    merge_release(s, batch, 0);
+    return OSD_OK;
+}
+
+static void merge_free(void *arg)
+{
+    struct merge_stage *s = arg;
+    free(s->held);
+    free(s);
+}
+
+API_EXPORT
+osd_result osd_tracepipe_add_merge(struct osd_tracepipe_ctx *ctx,
+                                   size_t window, unsigned int flags)
+{
+    static const struct osd_tracepipe_stage_ops ops = {
+        .process = merge_process,
+        .flush = merge_flush,
+        .free = merge_free,
+    };
+
+    struct merge_stage *s = calloc(1, sizeof(struct merge_stage));
+    assert(s);
+    s->window = window;
+
+    osd_result rv = osd_tracepipe_add_stage(ctx, &ops, s, flags);
+    if (OSD_FAILED(rv)) {
+        merge_free(s);
+    }
+    return rv;
+}
+
+static osd_result symbolize_process(void *arg, struct osd_trace_batch *batch)
+{
+    const struct osd_symtab_ctx *symtab = arg;
+
+    for (size_t i = 0; i < batch->num_events; i++) {
+        struct osd_trace_event *ev = &batch->events[i];
+        if (ev->type != OSD_TRACE_EVENT_CTM || ev->data.ctm.overflow) {
+            continue;
+        }
+        ev->sym_to = osd_symtab_find_containing(symtab, ev->data.ctm.npc);
+        ev->sym_from = osd_symtab_find_containing(symtab, ev->data.ctm.pc);
+    }
+
+    return OSD_OK;
+}
+
+API_EXPORT
+osd_result osd_tracepipe_add_symbolize(struct osd_tracepipe_ctx *ctx,
+                                       const struct osd_symtab_ctx *symtab,
+                                       unsigned int flags)
+{
+    assert(symtab);
+
+    static const struct osd_tracepipe_stage_ops ops = {
+        .process = symbolize_process,
+    };
+
+    return osd_tracepipe_add_stage(ctx, &ops, (void *)symtab, flags);
+}
+
+//
+// Sinks
+//
+
+struct text_sink {
+    FILE *fp;
+    const struct osd_symtab_ctx *symtab;
+};
+
+static osd_result text_sink_process(void *arg, struct osd_trace_batch *batch)
+{
+    struct text_sink *s = arg;
+    osd_result retval = OSD_OK;
+    osd_result rv = OSD_OK;
+
+    for (size_t i = 0; i < batch->num_events; i++) {
+        const struct osd_trace_event *ev = &batch->events[i];
+
+        switch (ev->type) {
+        case OSD_TRACE_EVENT_STM:
+            rv = osd_systracelogger_format_event(s->fp, &ev->data.stm);
+            break;
+        case OSD_TRACE_EVENT_CTM:
+            rv = osd_coretracelogger_format_event(s->fp, s->symtab,
+                                                  &ev->data.ctm);
+            break;
+        case OSD_TRACE_EVENT_CDM:
+            rv = fprintf(s->fp, "stall %d\n", ev->data.cdm.stall) < 0
+                     ? OSD_ERROR_FILE
+                     : OSD_OK;
+            break;
+        case OSD_TRACE_EVENT_DEM_UART:
+            rv = fputc(ev->data.dem_uart, s->fp) == EOF ? OSD_ERROR_FILE
+                                                        : OSD_OK;
+            break;
+        }
+        if (OSD_FAILED(rv)) {
+            retval = rv;
+        }
+    }
+
+    return retval;
+}
+
+static osd_result text_sink_flush(void *arg, struct osd_trace_batch *batch)
+{
+    struct text_sink *s = arg;
+    return fflush(s->fp) == 0 ? OSD_OK : OSD_ERROR_FILE;
+}
+
+API_EXPORT
+osd_result osd_tracepipe_add_text_sink(struct osd_tracepipe_ctx *ctx, FILE *fp,
+                                       const struct osd_symtab_ctx *symtab,
+                                       unsigned int flags)
+{
+    assert(fp);
+
+    static const struct osd_tracepipe_stage_ops ops = {
+        .process = text_sink_process,
+        .flush = text_sink_flush,
+        .free = free,
+    };
+
+    struct text_sink *s = calloc(1, sizeof(struct text_sink));
+    assert(s);
+    s->fp = fp;
+    s->symtab = symtab;
+
+    osd_result rv = osd_tracepipe_add_stage(ctx, &ops, s, flags);
+    if (OSD_FAILED(rv)) {
+        free(s);
+    }
+    return rv;
+}
+
+struct sysprint_sink {
+    FILE *fp;
+    struct osd_cl_stm_print_buf buf;
+};
+
+static osd_result sysprint_sink_write(struct sysprint_sink *s)
+{
+    osd_result rv = OSD_OK;
+
+    size_t b_wr = fwrite(s->buf.buf, 1, s->buf.len_str, s->fp);
+    if (b_wr != s->buf.len_str) {
+        rv = OSD_ERROR_FILE;
+    }
+    free(s->buf.buf);
+    s->buf.buf = NULL;
+    s->buf.len_buf = 0;
+    s->buf.len_str = 0;
+
+    return rv;
+}
+
+static osd_result sysprint_sink_process(void *arg,
+                                        struct osd_trace_batch *batch)
+{
+    struct sysprint_sink *s = arg;
+    osd_result retval = OSD_OK;
+    osd_result rv;
+
+    for (size_t i = 0; i < batch->num_events; i++) {
+        const struct osd_trace_event *ev = &batch->events[i];
+
+        // XXX: handle overflow in sysprint (e.g. by newline and explicit
+        // flush)
+        if (ev->type != OSD_TRACE_EVENT_STM ||
+            !osd_cl_stm_is_print_event(&ev->data.stm)) {
+            continue;
+        }
+
+        bool should_flush = false;
+        rv = osd_cl_stm_add_to_print_buf(&ev->data.stm, &s->buf,
+                                         &should_flush);
+        if (OSD_FAILED(rv)) {
+            retval = rv;
+            continue;
+        }
+        if (should_flush) {
+            rv = sysprint_sink_write(s);
+            if (OSD_FAILED(rv)) {
+                retval = rv;
+            }
+        }
+    }
+
+    return retval;
+}
+
+static osd_result sysprint_sink_flush(void *arg, struct osd_trace_batch *batch)
+{
+    struct sysprint_sink *s = arg;
+    osd_result rv = OSD_OK;
+
+    // write an incomplete last line
+    if (s->buf.len_str > 0) {
+        rv = sysprint_sink_write(s);
+    }
+    if (fflush(s->fp) != 0) {
+        rv = OSD_ERROR_FILE;
+    }
+    return rv;
+}
+
+static void sysprint_sink_free(void *arg)
+{
+    struct sysprint_sink *s = arg;
+    free(s->buf.buf);
+    free(s);
+}
+
+API_EXPORT
+osd_result osd_tracepipe_add_sysprint_sink(struct osd_tracepipe_ctx *ctx,
+                                           FILE *fp, unsigned int flags)
+{
+    assert(fp);
+
+    static const struct osd_tracepipe_stage_ops ops = {
+        .process = sysprint_sink_process,
+        .flush = sysprint_sink_flush,
+        .free = sysprint_sink_free,
+    };
+
+    struct sysprint_sink *s = calloc(1, sizeof(struct sysprint_sink));
+    assert(s);
+    s->fp = fp;
+
+    osd_result rv = osd_tracepipe_add_stage(ctx, &ops, s, flags);
+    if (OSD_FAILED(rv)) {
+        sysprint_sink_free(s);
+    }
+    return rv;
+}
+
+struct binary_sink {
+    FILE *fp;
+    uint8_t *buf;
+    size_t buf_size;
+};
+
+static osd_result binary_sink_process(void *arg, struct osd_trace_batch *batch)
+{
+    struct binary_sink *s = arg;
+
+    size_t needed = batch->num_events * OSD_TRACESTREAM_RECORD_SIZE_MAX;
+    if (needed > s->buf_size) {
+        s->buf_size = needed;
+        s->buf = realloc(s->buf, s->buf_size);
+        assert(s->buf);
+    }
+
+    size_t len = 0;
+    for (size_t i = 0; i < batch->num_events; i++) {
+        const struct osd_trace_event *ev = &batch->events[i];
+        if (ev->type == OSD_TRACE_EVENT_STM) {
+            len += osd_tracestream_encode_stm(s->buf + len, ev->di_addr,
+                                              ev->host_ns, &ev->data.stm);
+        } else if (ev->type == OSD_TRACE_EVENT_CTM) {
+            len += osd_tracestream_encode_ctm(s->buf + len, ev->di_addr,
+                                              ev->host_ns, &ev->data.ctm);
+        }
+    }
+
+    if (len && fwrite(s->buf, len, 1, s->fp) != 1) {
+        return OSD_ERROR_FILE;
+    }
+    return OSD_OK;
+}
+
+static osd_result binary_sink_flush(void *arg, struct osd_trace_batch *batch)
+{
+    struct binary_sink *s = arg;
+    return fflush(s->fp) == 0 ? OSD_OK : OSD_ERROR_FILE;
+}
+
+static void binary_sink_free(void *arg)
+{
+    struct binary_sink *s = arg;
+    free(s->buf);
+    free(s);
+}
+
+API_EXPORT
+osd_result osd_tracepipe_add_binary_sink(struct osd_tracepipe_ctx *ctx,
+                                         FILE *fp, unsigned int flags)
+{
+    assert(fp);
+
+    static const struct osd_tracepipe_stage_ops ops = {
+        .process = binary_sink_process,
+        .flush = binary_sink_flush,
+        .free = binary_sink_free,
+    };
+
+    struct binary_sink *s = calloc(1, sizeof(struct binary_sink));
+    assert(s);
+    s->fp = fp;
+
+    osd_result rv = osd_tracepipe_add_stage(ctx, &ops, s, flags);
+    if (OSD_FAILED(rv)) {
+        binary_sink_free(s);
+    }
+    return rv;
+}
+
+static osd_result stream_sink_process(void *arg, struct osd_trace_batch *batch)
+{
+    struct osd_tracestream_ctx *stream = arg;
+
+    for (size_t i = 0; i < batch->num_events; i++) {
+        const struct osd_trace_event *ev = &batch->events[i];
+
+        // events dropped due to a full stream are counted by the stream
+        if (ev->type == OSD_TRACE_EVENT_STM) {
+            osd_tracestream_publish_stm(stream, ev->di_addr, &ev->data.stm);
+        } else if (ev->type == OSD_TRACE_EVENT_CTM) {
+            osd_tracestream_publish_ctm(stream, ev->di_addr, &ev->data.ctm);
+        }
+    }
+
+    return OSD_OK;
+}
+
+API_EXPORT
+osd_result osd_tracepipe_add_stream_sink(struct osd_tracepipe_ctx *ctx,
+                                         struct osd_tracestream_ctx *stream,
+                                         unsigned int flags)
+{
+    assert(stream);
+
+    static const struct osd_tracepipe_stage_ops ops = {
+        .process = stream_sink_process,
+    };
+
+    return osd_tracepipe_add_stage(ctx, &ops, stream, flags);
+}
+
+static osd_result counter_sink_process(void *arg,
+                                       struct osd_trace_batch *batch)
+{
+    struct osd_trace_counters *c = arg;
+
+    for (size_t i = 0; i < batch->num_events; i++) {
+        const struct osd_trace_event *ev = &batch->events[i];
+
+        switch (ev->type) {
+        case OSD_TRACE_EVENT_STM:
+            if (ev->data.stm.overflow) {
+                c->overflowed_events += ev->data.stm.overflow;
+                break;
+            }
+            c->stm_events++;
+            c->stm_print_events += osd_cl_stm_is_print_event(&ev->data.stm);
+            break;
+        case OSD_TRACE_EVENT_CTM:
+            if (ev->data.ctm.overflow) {
+                c->overflowed_events += ev->data.ctm.overflow;
+                break;
+            }
+            c->ctm_events++;
+            c->ctm_calls += ev->data.ctm.is_call;
+            c->ctm_returns += ev->data.ctm.is_ret;
+            break;
+        case OSD_TRACE_EVENT_CDM:
+            c->cdm_events++;
+            break;
+        case OSD_TRACE_EVENT_DEM_UART:
+            c->dem_uart_chars++;
+            break;
+        }
+    }
+
+    return OSD_OK;
+}
+
+API_EXPORT
+osd_result osd_tracepipe_add_counter_sink(struct osd_tracepipe_ctx *ctx,
+                                          struct osd_trace_counters *counters,
+                                          unsigned int flags)
+{
+    assert(counters);
+
+    static const struct osd_tracepipe_stage_ops ops = {
+        .process = counter_sink_process,
+    };
+
+    return osd_tracepipe_add_stage(ctx, &ops, counters, flags);
+}
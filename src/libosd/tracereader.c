@@ -0,0 +1,282 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <osd/capture.h>
+#include <osd/cl_ctm.h>
+#include <osd/cl_stm.h>
+#include <osd/osd.h>
+#include <osd/packet.h>
+#include <osd/tracereader.h>
+#include "osd-private.h"
+
+#include <assert.h>
+#include <string.h>
+
+/**
+ * A multi-packet event which is being reassembled
+ */
+struct pending_event {
+    unsigned int src;
+    struct osd_packet *pkg;
+};
+
+/**
+ * Trace reader context
+ */
+struct osd_tracereader_ctx {
+    struct osd_log_ctx *log_ctx;
+    struct osd_capture_reader_ctx *capture;
+
+    /** DI address of the trace module to decode, or -1 for all modules */
+    int source;
+
+    /**
+     * Multi-packet events being reassembled. Typically only very few
+     * sources are active at the same time, a linear search is sufficient.
+     */
+    struct pending_event *pending;
+    size_t num_pending;
+    size_t len_pending;
+
+    /** reassembled event returned by the last call to next_event_pkg() */
+    struct osd_packet *complete_pkg;
+
+    struct osd_tracereader_stats stats;
+};
+
+API_EXPORT
+osd_result osd_tracereader_new(struct osd_tracereader_ctx **ctx,
+                               struct osd_log_ctx *log_ctx,
+                               const char *filename, int source)
+{
+    osd_result rv;
+
+    struct osd_tracereader_ctx *c =
+        calloc(1, sizeof(struct osd_tracereader_ctx));
+    assert(c);
+    c->log_ctx = log_ctx;
+    c->source = source;
+
+    rv = osd_capture_reader_new(&c->capture, log_ctx, filename);
+    if (OSD_FAILED(rv)) {
+        free(c);
+        return rv;
+    }
+
+    *ctx = c;
+    return OSD_OK;
+}
+
+static void free_pending(struct osd_tracereader_ctx *ctx)
+{
+    for (size_t i = 0; i < ctx->num_pending; i++) {
+        osd_packet_free(&ctx->pending[i].pkg);
+    }
+    ctx->num_pending = 0;
+    osd_packet_free(&ctx->complete_pkg);
+}
+
+API_EXPORT
+void osd_tracereader_free(struct osd_tracereader_ctx **ctx_p)
+{
+    assert(ctx_p);
+    struct osd_tracereader_ctx *ctx = *ctx_p;
+    if (!ctx) {
+        return;
+    }
+
+    free_pending(ctx);
+    free(ctx->pending);
+    osd_capture_reader_free(&ctx->capture);
+
+    free(ctx);
+    *ctx_p = NULL;
+}
+
+static bool is_relevant_pkg(const struct osd_tracereader_ctx *ctx,
+                            const struct osd_packet *pkg)
+{
+    if (osd_packet_get_type(pkg) != OSD_PACKET_TYPE_EVENT) {
+        return false;
+    }
+    if (ctx->source >= 0 &&
+        osd_packet_get_src(pkg) != (unsigned int)ctx->source) {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Get the next complete event packet from the capture
+ *
+ * The returned packet is valid until the next call to this function.
+ *
+ * @param[out] ev_pkg the event packet, or NULL at the end of the capture
+ */
+static osd_result next_event_pkg(struct osd_tracereader_ctx *ctx,
+                                 const struct osd_packet **ev_pkg)
+{
+    osd_result rv;
+
+    osd_packet_free(&ctx->complete_pkg);
+
+    while (1) {
+        const struct osd_packet *pkg;
+        rv = osd_capture_reader_next(ctx->capture, &pkg, NULL);
+        if (OSD_FAILED(rv)) {
+            return rv;
+        }
+        if (!pkg) {
+            // events which are incomplete at the end of the trace are dropped
+            free_pending(ctx);
+            *ev_pkg = NULL;
+            return OSD_OK;
+        }
+        ctx->stats.packets++;
+
+        if (!is_relevant_pkg(ctx, pkg)) {
+            continue;
+        }
+
+        unsigned int src = osd_packet_get_src(pkg);
+        struct pending_event *pe = NULL;
+        for (size_t i = 0; i < ctx->num_pending; i++) {
+            if (ctx->pending[i].src == src) {
+                pe = &ctx->pending[i];
+                break;
+            }
+        }
+
+        if (osd_packet_get_type_sub(pkg) == EV_CONT) {
+            if (!pe) {
+                if (ctx->num_pending == ctx->len_pending) {
+                    ctx->len_pending = ctx->len_pending ?
+                                       ctx->len_pending * 2 : 4;
+                    ctx->pending = realloc(ctx->pending, ctx->len_pending *
+                                           sizeof(struct pending_event));
+                    assert(ctx->pending);
+                }
+                pe = &ctx->pending[ctx->num_pending++];
+                pe->src = src;
+                rv = osd_packet_new(&pe->pkg, pkg->data_size_words);
+                assert(OSD_SUCCEEDED(rv));
+                memcpy(pe->pkg->data_raw, pkg->data_raw,
+                       osd_packet_sizeof(pkg));
+                rv = osd_packet_set_type_sub(pe->pkg, EV_LAST);
+                assert(OSD_SUCCEEDED(rv));
+            } else {
+                rv = osd_packet_combine(&pe->pkg, pkg);
+                assert(OSD_SUCCEEDED(rv));
+            }
+            continue;
+        }
+
+        if (pe && osd_packet_get_type_sub(pkg) == EV_LAST) {
+            rv = osd_packet_combine(&pe->pkg, pkg);
+            assert(OSD_SUCCEEDED(rv));
+            ctx->complete_pkg = pe->pkg;
+            *pe = ctx->pending[--ctx->num_pending];
+            *ev_pkg = ctx->complete_pkg;
+        } else {
+            *ev_pkg = pkg;
+        }
+        return OSD_OK;
+    }
+}
+
+API_EXPORT
+osd_result osd_tracereader_read_stm(struct osd_tracereader_ctx *ctx,
+                                    const struct osd_stm_desc *stm_desc,
+                                    struct osd_stm_event *events,
+                                    size_t max_events, size_t *num_events)
+{
+    osd_result rv;
+    size_t n = 0;
+
+    while (n < max_events) {
+        const struct osd_packet *pkg;
+        rv = next_event_pkg(ctx, &pkg);
+        if (OSD_FAILED(rv)) {
+            *num_events = n;
+            return rv;
+        }
+        if (!pkg) {
+            break;
+        }
+
+        struct osd_stm_event *ev = &events[n];
+        rv = osd_cl_stm_decode_event(stm_desc, pkg, ev);
+        if (OSD_FAILED(rv)) {
+            ctx->stats.invalid_packets++;
+            continue;
+        }
+        ctx->stats.overflowed_events += ev->overflow;
+        ctx->stats.events += !ev->overflow;
+        n++;
+    }
+
+    *num_events = n;
+    return OSD_OK;
+}
+
+API_EXPORT
+osd_result osd_tracereader_read_ctm(struct osd_tracereader_ctx *ctx,
+                                    const struct osd_ctm_desc *ctm_desc,
+                                    struct osd_ctm_event *events,
+                                    size_t max_events, size_t *num_events)
+{
+    osd_result rv;
+    size_t n = 0;
+
+    while (n < max_events) {
+        const struct osd_packet *pkg;
+        rv = next_event_pkg(ctx, &pkg);
+        if (OSD_FAILED(rv)) {
+            *num_events = n;
+            return rv;
+        }
+        if (!pkg) {
+            break;
+        }
+
+        struct osd_ctm_event *ev = &events[n];
+        rv = osd_cl_ctm_decode_event(ctm_desc, pkg, ev);
+        if (OSD_FAILED(rv)) {
+            ctx->stats.invalid_packets++;
+            continue;
+        }
+        ctx->stats.overflowed_events += ev->overflow;
+        ctx->stats.events += !ev->overflow;
+        n++;
+    }
+
+    *num_events = n;
+    return OSD_OK;
+}
+
+API_EXPORT
+osd_result osd_tracereader_rewind(struct osd_tracereader_ctx *ctx)
+{
+    free_pending(ctx);
+    memset(&ctx->stats, 0, sizeof(struct osd_tracereader_stats));
+    return osd_capture_reader_rewind(ctx->capture);
+}
+
+API_EXPORT
+void osd_tracereader_get_stats(struct osd_tracereader_ctx *ctx,
+                               struct osd_tracereader_stats *stats)
+{
+    *stats = ctx->stats;
+}
@@ -0,0 +1,914 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <osd/capture.h>
+#include <osd/osd.h>
+#include <osd/tracestream.h>
+#include "osd-private.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define RECORD_HEADER_SIZE 16
+#define RECORD_SIZE_LOST (RECORD_HEADER_SIZE + 8)
+#define RECORD_SIZE_STM (RECORD_HEADER_SIZE + 16)
+#define RECORD_SIZE_CTM (RECORD_HEADER_SIZE + 24)
+#define RECORD_SIZE_MAX RECORD_SIZE_CTM
+
+#define SUBSCRIBE_REQ_SIZE 8
+static const char subscribe_magic[4] = { 'O', 'S', 'D', 'T' };
+
+/** Maximum number of concurrently connected subscribers */
+#define MAX_SUBSCRIBERS 32
+
+/** Size of the per-subscriber send buffer */
+#define SEND_BUF_SIZE (64 * 1024)
+
+/**
+ * FIFO of records, stored in a ring buffer
+ */
+struct record_queue {
+    uint8_t *buf;
+    size_t size; //!< size of |buf| in bytes
+    size_t rd; //!< offset of the oldest record in |buf|
+    size_t used; //!< number of used bytes
+    size_t num_records; //!< number of records in the queue
+};
+
+enum subscriber_state {
+    SUBSCRIBER_CONNECTED, //!< waiting for the subscribe request
+    SUBSCRIBER_ACTIVE, //!< receiving records
+};
+
+struct subscriber {
+    int fd;
+    enum subscriber_state state;
+
+    enum osd_tracestream_policy policy;
+    unsigned int sample_interval;
+    unsigned int sample_count;
+
+    /** records waiting to be sent */
+    struct record_queue queue;
+
+    /** data currently being sent */
+    uint8_t send_buf[SEND_BUF_SIZE];
+    size_t send_len;
+    size_t send_offset;
+
+    /** number of dropped records not yet reported to the subscriber */
+    uint64_t lost_unreported;
+
+    /** subscribe request being received */
+    uint8_t req_buf[SUBSCRIBE_REQ_SIZE];
+    size_t req_len;
+
+    struct osd_tracestream_subscriber_stats stats;
+};
+
+/**
+ * Trace stream context
+ */
+struct osd_tracestream_ctx {
+    struct osd_log_ctx *log_ctx;
+    char *socket_path;
+    int listen_fd;
+
+    /** wake up the sink thread */
+    int event_fd;
+
+    /** thread doing all socket I/O */
+    pthread_t thread;
+    volatile bool running;
+
+    size_t queue_size;
+
+    /**
+     * Input buffer, written by the publishing thread
+     *
+     * Protected by |input_lock|, which is only held for short copy
+     * operations to never stall the publishing thread.
+     */
+    pthread_mutex_t input_lock;
+    uint8_t *input_buf;
+    size_t input_len;
+    uint64_t published_records;
+    uint64_t overrun_records;
+
+    /**
+     * Records taken from the input buffer, being distributed to subscribers.
+     * Only used by the sink thread.
+     */
+    uint8_t *dist_buf;
+    size_t dist_len;
+    size_t dist_offset;
+    uint64_t overrun_records_seen;
+
+    /**
+     * Subscribers; modified by the sink thread, protected by |subs_lock|
+     * to read the statistics from other threads.
+     */
+    pthread_mutex_t subs_lock;
+    struct subscriber *subs[MAX_SUBSCRIBERS];
+    unsigned int num_subs;
+};
+
+static void put_le16(uint8_t *p, uint16_t v)
+{
+    p[0] = v & 0xff;
+    p[1] = v >> 8;
+}
+
+static void put_le32(uint8_t *p, uint32_t v)
+{
+    put_le16(p, v & 0xffff);
+    put_le16(p + 2, v >> 16);
+}
+
+static void put_le64(uint8_t *p, uint64_t v)
+{
+    put_le32(p, v & 0xffffffff);
+    put_le32(p + 4, v >> 32);
+}
+
+static uint16_t get_le16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint64_t get_le64(const uint8_t *p)
+{
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; i--) {
+        v = (v << 8) | p[i];
+    }
+    return v;
+}
+
+static void record_header_init(uint8_t *rec, uint16_t type, uint16_t len,
+                               uint16_t di_addr, uint64_t host_ns)
+{
+    put_le16(rec, type);
+    put_le16(rec + 2, len);
+    put_le16(rec + 4, di_addr);
+    put_le16(rec + 6, 0);
+    put_le64(rec + 8, host_ns);
+}
+
+static uint16_t record_len(const uint8_t *rec)
+{
+    return get_le16(rec + 2);
+}
+
+static void record_queue_init(struct record_queue *q, size_t size)
+{
+    q->buf = malloc(size);
+    assert(q->buf);
+    q->size = size;
+    q->rd = 0;
+    q->used = 0;
+    q->num_records = 0;
+}
+
+static void record_queue_destroy(struct record_queue *q)
+{
+    free(q->buf);
+    q->buf = NULL;
+}
+
+static bool record_queue_has_space(const struct record_queue *q, size_t len)
+{
+    return q->size - q->used >= len;
+}
+
+/**
+ * Copy |len| bytes starting at offset |offset| (relative to the oldest
+ * record) out of the queue
+ */
+static void record_queue_copy_out(const struct record_queue *q, size_t offset,
+                                  uint8_t *dst, size_t len)
+{
+    size_t start = (q->rd + offset) % q->size;
+    size_t first = q->size - start;
+    if (first >= len) {
+        memcpy(dst, q->buf + start, len);
+    } else {
+        memcpy(dst, q->buf + start, first);
+        memcpy(dst + first, q->buf, len - first);
+    }
+}
+
+static void record_queue_push(struct record_queue *q, const uint8_t *rec)
+{
+    size_t len = record_len(rec);
+    assert(record_queue_has_space(q, len));
+
+    size_t wr = (q->rd + q->used) % q->size;
+    size_t first = q->size - wr;
+    if (first >= len) {
+        memcpy(q->buf + wr, rec, len);
+    } else {
+        memcpy(q->buf + wr, rec, first);
+        memcpy(q->buf, rec + first, len - first);
+    }
+    q->used += len;
+    q->num_records++;
+}
+
+/**
+ * Remove the oldest record from the queue
+ *
+ * @param q the queue
+ * @param[out] rec buffer for the record (at least RECORD_SIZE_MAX bytes), or
+ *                 NULL to drop the record
+ * @return the length of the record
+ */
+static size_t record_queue_pop(struct record_queue *q, uint8_t *rec)
+{
+    assert(q->num_records > 0);
+
+    uint8_t hdr[RECORD_HEADER_SIZE];
+    record_queue_copy_out(q, 0, hdr, RECORD_HEADER_SIZE);
+    size_t len = record_len(hdr);
+    if (rec) {
+        record_queue_copy_out(q, 0, rec, len);
+    }
+
+    q->rd = (q->rd + len) % q->size;
+    q->used -= len;
+    q->num_records--;
+    return len;
+}
+
+/**
+ * Host time when the oldest record in the queue was published
+ */
+static uint64_t record_queue_oldest_time(const struct record_queue *q)
+{
+    assert(q->num_records > 0);
+
+    uint8_t hdr[RECORD_HEADER_SIZE];
+    record_queue_copy_out(q, 0, hdr, RECORD_HEADER_SIZE);
+    return get_le64(hdr + 8);
+}
+
+/**
+ * Add a record to the input buffer
+ *
+ * Called from the publishing thread.
+ */
+static osd_result publish_record(struct osd_tracestream_ctx *ctx,
+                                 const uint8_t *rec)
+{
+    size_t len = record_len(rec);
+    bool was_empty;
+
+    pthread_mutex_lock(&ctx->input_lock);
+    if (ctx->input_len + len > ctx->queue_size) {
+        ctx->overrun_records++;
+        pthread_mutex_unlock(&ctx->input_lock);
+        return OSD_ERROR_BUSY;
+    }
+    was_empty = (ctx->input_len == 0);
+    memcpy(ctx->input_buf + ctx->input_len, rec, len);
+    ctx->input_len += len;
+    ctx->published_records++;
+    pthread_mutex_unlock(&ctx->input_lock);
+
+    // Wake up the sink thread only for the first record; it takes all
+    // records in the input buffer at once.
+    if (was_empty) {
+        uint64_t v = 1;
+        ssize_t rv = write(ctx->event_fd, &v, sizeof(v));
+        (void)rv; // the counter cannot overflow in practice
+    }
+
+    return OSD_OK;
+}
+
+size_t osd_tracestream_encode_stm(uint8_t *rec, uint16_t di_addr,
+                                  uint64_t host_ns,
+                                  const struct osd_stm_event *event)
+{
+    record_header_init(rec, OSD_TRACESTREAM_RECORD_STM, RECORD_SIZE_STM,
+                       di_addr, host_ns);
+    uint8_t *p = rec + RECORD_HEADER_SIZE;
+    put_le32(p, event->timestamp);
+    put_le16(p + 4, event->id);
+    put_le16(p + 6, event->overflow);
+    put_le64(p + 8, event->value);
+
+    return RECORD_SIZE_STM;
+}
+
+size_t osd_tracestream_encode_ctm(uint8_t *rec, uint16_t di_addr,
+                                  uint64_t host_ns,
+                                  const struct osd_ctm_event *event)
+{
+    record_header_init(rec, OSD_TRACESTREAM_RECORD_CTM, RECORD_SIZE_CTM,
+                       di_addr, host_ns);
+    uint8_t *p = rec + RECORD_HEADER_SIZE;
+    put_le32(p, event->timestamp);
+    put_le16(p + 4, event->overflow);
+    p[6] = event->mode;
+    p[7] = (event->is_ret ? 0x1 : 0) | (event->is_call ? 0x2 : 0) |
+           (event->is_modechange ? 0x4 : 0);
+    put_le64(p + 8, event->npc);
+    put_le64(p + 16, event->pc);
+
+    return RECORD_SIZE_CTM;
+}
+
+API_EXPORT
+osd_result osd_tracestream_publish_stm(struct osd_tracestream_ctx *ctx,
+                                       uint16_t di_addr,
+                                       const struct osd_stm_event *event)
+{
+    assert(ctx);
+    assert(event);
+
+    uint8_t rec[RECORD_SIZE_STM];
+    osd_tracestream_encode_stm(rec, di_addr, osd_capture_timestamp_now(),
+                               event);
+    return publish_record(ctx, rec);
+}
+
+API_EXPORT
+osd_result osd_tracestream_publish_ctm(struct osd_tracestream_ctx *ctx,
+                                       uint16_t di_addr,
+                                       const struct osd_ctm_event *event)
+{
+    assert(ctx);
+    assert(event);
+
+    uint8_t rec[RECORD_SIZE_CTM];
+    osd_tracestream_encode_ctm(rec, di_addr, osd_capture_timestamp_now(),
+                               event);
+    return publish_record(ctx, rec);
+}
+
+static void subscriber_free(struct osd_tracestream_ctx *ctx,
+                            struct subscriber *sub)
+{
+    if (sub->state == SUBSCRIBER_ACTIVE) {
+        info(ctx->log_ctx, "Trace stream subscriber disconnected: %" PRIu64
+             " records sent, %" PRIu64 " records dropped, maximum lag %zu "
+             "bytes.", sub->stats.sent_records, sub->stats.dropped_records,
+             sub->stats.max_lag_bytes);
+    }
+    close(sub->fd);
+    record_queue_destroy(&sub->queue);
+    free(sub);
+}
+
+/**
+ * Remove the subscriber at index |idx|
+ */
+static void remove_subscriber(struct osd_tracestream_ctx *ctx,
+                              unsigned int idx)
+{
+    pthread_mutex_lock(&ctx->subs_lock);
+    struct subscriber *sub = ctx->subs[idx];
+    ctx->subs[idx] = ctx->subs[--ctx->num_subs];
+    ctx->subs[ctx->num_subs] = NULL;
+    pthread_mutex_unlock(&ctx->subs_lock);
+
+    subscriber_free(ctx, sub);
+}
+
+static void accept_subscribers(struct osd_tracestream_ctx *ctx)
+{
+    while (1) {
+        int fd = accept4(ctx->listen_fd, NULL, NULL,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                err(ctx->log_ctx, "Unable to accept trace stream "
+                    "subscriber: %s", strerror(errno));
+            }
+            return;
+        }
+
+        if (ctx->num_subs == MAX_SUBSCRIBERS) {
+            err(ctx->log_ctx, "Too many trace stream subscribers, rejecting "
+                "new subscriber.");
+            close(fd);
+            continue;
+        }
+
+        struct subscriber *sub = calloc(1, sizeof(struct subscriber));
+        assert(sub);
+        sub->fd = fd;
+        sub->state = SUBSCRIBER_CONNECTED;
+        record_queue_init(&sub->queue, ctx->queue_size);
+
+        pthread_mutex_lock(&ctx->subs_lock);
+        ctx->subs[ctx->num_subs++] = sub;
+        pthread_mutex_unlock(&ctx->subs_lock);
+    }
+}
+
+/**
+ * Read (parts of) the subscribe request
+ *
+ * @return false if the subscriber must be disconnected
+ */
+static bool read_subscribe_request(struct osd_tracestream_ctx *ctx,
+                                   struct subscriber *sub)
+{
+    ssize_t len = read(sub->fd, sub->req_buf + sub->req_len,
+                       SUBSCRIBE_REQ_SIZE - sub->req_len);
+    if (len < 0) {
+        return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR);
+    }
+    if (len == 0) {
+        return false;
+    }
+    sub->req_len += len;
+    if (sub->req_len < SUBSCRIBE_REQ_SIZE) {
+        return true;
+    }
+
+    if (memcmp(sub->req_buf, subscribe_magic, sizeof(subscribe_magic)) != 0 ||
+        sub->req_buf[4] != OSD_TRACESTREAM_PROTOCOL_VERSION) {
+        err(ctx->log_ctx, "Invalid trace stream subscribe request.");
+        return false;
+    }
+
+    unsigned int policy = sub->req_buf[5];
+    if (policy != OSD_TRACESTREAM_POLICY_BLOCK &&
+        policy != OSD_TRACESTREAM_POLICY_DROP_OLDEST &&
+        policy != OSD_TRACESTREAM_POLICY_SAMPLE) {
+        err(ctx->log_ctx, "Unknown trace stream policy %u requested.", policy);
+        return false;
+    }
+    sub->policy = policy;
+    sub->sample_interval = get_le16(sub->req_buf + 6);
+    if (sub->sample_interval == 0) {
+        sub->sample_interval = 1;
+    }
+
+    pthread_mutex_lock(&ctx->subs_lock);
+    sub->state = SUBSCRIBER_ACTIVE;
+    sub->stats.policy = sub->policy;
+    pthread_mutex_unlock(&ctx->subs_lock);
+
+    info(ctx->log_ctx, "New trace stream subscriber (policy %u).", policy);
+
+    return true;
+}
+
+/**
+ * Queue a record for a subscriber according to its policy
+ *
+ * Must be called with |subs_lock| held.
+ */
+static void subscriber_queue_record(struct subscriber *sub, const uint8_t *rec)
+{
+    size_t len = record_len(rec);
+    struct record_queue *q = &sub->queue;
+
+    switch (sub->policy) {
+        case OSD_TRACESTREAM_POLICY_BLOCK:
+            // space was checked before
+            break;
+        case OSD_TRACESTREAM_POLICY_DROP_OLDEST:
+            while (!record_queue_has_space(q, len)) {
+                record_queue_pop(q, NULL);
+                sub->lost_unreported++;
+                sub->stats.dropped_records++;
+            }
+            break;
+        case OSD_TRACESTREAM_POLICY_SAMPLE:
+            if (q->used > q->size / 2 &&
+                (sub->sample_count++ % sub->sample_interval) != 0) {
+                sub->lost_unreported++;
+                sub->stats.dropped_records++;
+                return;
+            }
+            if (!record_queue_has_space(q, len)) {
+                sub->lost_unreported++;
+                sub->stats.dropped_records++;
+                return;
+            }
+            break;
+    }
+
+    record_queue_push(q, rec);
+
+    size_t lag_bytes = q->used + sub->send_len - sub->send_offset;
+    if (lag_bytes > sub->stats.max_lag_bytes) {
+        sub->stats.max_lag_bytes = lag_bytes;
+    }
+}
+
+/**
+ * Distribute records from the input buffer to the subscriber queues
+ */
+static void distribute_records(struct osd_tracestream_ctx *ctx)
+{
+    while (1) {
+        if (ctx->dist_offset == ctx->dist_len) {
+            // all records are distributed, take the next batch
+            pthread_mutex_lock(&ctx->input_lock);
+            uint8_t *buf = ctx->input_buf;
+            ctx->input_buf = ctx->dist_buf;
+            ctx->dist_buf = buf;
+            ctx->dist_len = ctx->input_len;
+            ctx->input_len = 0;
+            uint64_t overrun = ctx->overrun_records - ctx->overrun_records_seen;
+            ctx->overrun_records_seen = ctx->overrun_records;
+            pthread_mutex_unlock(&ctx->input_lock);
+
+            ctx->dist_offset = 0;
+
+            // all subscribers missed the records dropped at the input
+            if (overrun) {
+                pthread_mutex_lock(&ctx->subs_lock);
+                for (unsigned int i = 0; i < ctx->num_subs; i++) {
+                    if (ctx->subs[i]->state == SUBSCRIBER_ACTIVE) {
+                        ctx->subs[i]->lost_unreported += overrun;
+                        ctx->subs[i]->stats.dropped_records += overrun;
+                    }
+                }
+                pthread_mutex_unlock(&ctx->subs_lock);
+            }
+
+            if (ctx->dist_len == 0) {
+                return;
+            }
+        }
+
+        pthread_mutex_lock(&ctx->subs_lock);
+        while (ctx->dist_offset < ctx->dist_len) {
+            const uint8_t *rec = ctx->dist_buf + ctx->dist_offset;
+            size_t len = record_len(rec);
+
+            // subscribers with the block policy hold back all delivery until
+            // they have space for the record
+            for (unsigned int i = 0; i < ctx->num_subs; i++) {
+                struct subscriber *sub = ctx->subs[i];
+                if (sub->state == SUBSCRIBER_ACTIVE &&
+                    sub->policy == OSD_TRACESTREAM_POLICY_BLOCK &&
+                    !record_queue_has_space(&sub->queue, len)) {
+                    pthread_mutex_unlock(&ctx->subs_lock);
+                    return;
+                }
+            }
+
+            for (unsigned int i = 0; i < ctx->num_subs; i++) {
+                if (ctx->subs[i]->state == SUBSCRIBER_ACTIVE) {
+                    subscriber_queue_record(ctx->subs[i], rec);
+                }
+            }
+            ctx->dist_offset += len;
+        }
+        pthread_mutex_unlock(&ctx->subs_lock);
+    }
+}
+
+static bool subscriber_has_data(const struct subscriber *sub)
+{
+    return sub->send_offset < sub->send_len || sub->queue.num_records > 0 ||
+           sub->lost_unreported > 0;
+}
+
+/**
+ * Send queued records to a subscriber without blocking
+ *
+ * @return false if the subscriber must be disconnected
+ */
+static bool subscriber_send(struct osd_tracestream_ctx *ctx,
+                            struct subscriber *sub)
+{
+    while (subscriber_has_data(sub)) {
+        if (sub->send_offset == sub->send_len) {
+            // refill the send buffer
+            pthread_mutex_lock(&ctx->subs_lock);
+            sub->send_len = 0;
+            sub->send_offset = 0;
+            if (sub->lost_unreported) {
+                uint8_t *rec = sub->send_buf;
+                record_header_init(rec, OSD_TRACESTREAM_RECORD_LOST,
+                                   RECORD_SIZE_LOST, 0,
+                                   osd_capture_timestamp_now());
+                put_le64(rec + RECORD_HEADER_SIZE, sub->lost_unreported);
+                sub->lost_unreported = 0;
+                sub->send_len += RECORD_SIZE_LOST;
+            }
+            while (sub->queue.num_records > 0 &&
+                   sub->send_len + RECORD_SIZE_MAX <= SEND_BUF_SIZE) {
+                sub->send_len += record_queue_pop(
+                    &sub->queue, sub->send_buf + sub->send_len);
+                sub->stats.sent_records++;
+            }
+            pthread_mutex_unlock(&ctx->subs_lock);
+        }
+
+        ssize_t len = send(sub->fd, sub->send_buf + sub->send_offset,
+                           sub->send_len - sub->send_offset,
+                           MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (len < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return true;
+            }
+            dbg(ctx->log_ctx, "Unable to send to trace stream subscriber: %s",
+                strerror(errno));
+            return false;
+        }
+        pthread_mutex_lock(&ctx->subs_lock);
+        sub->send_offset += len;
+        sub->stats.sent_bytes += len;
+        pthread_mutex_unlock(&ctx->subs_lock);
+    }
+    return true;
+}
+
+static void *sink_thread(void *arg)
+{
+    struct osd_tracestream_ctx *ctx = arg;
+
+    struct pollfd fds[2 + MAX_SUBSCRIBERS];
+
+    while (ctx->running) {
+        fds[0].fd = ctx->event_fd;
+        fds[0].events = POLLIN;
+        fds[1].fd = ctx->listen_fd;
+        fds[1].events = POLLIN;
+        unsigned int num_subs = ctx->num_subs;
+        for (unsigned int i = 0; i < num_subs; i++) {
+            struct subscriber *sub = ctx->subs[i];
+            fds[2 + i].fd = sub->fd;
+            // POLLIN also detects the subscriber closing the connection
+            fds[2 + i].events = POLLIN;
+            if (subscriber_has_data(sub)) {
+                fds[2 + i].events |= POLLOUT;
+            }
+        }
+
+        // We use a timeout here so that ctx->running is always checked
+        int ret = poll(fds, 2 + num_subs, 1000);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            err(ctx->log_ctx, "Failed to poll() trace stream sockets: %s",
+                strerror(errno));
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            uint64_t v;
+            ssize_t rv = read(ctx->event_fd, &v, sizeof(v));
+            (void)rv;
+        }
+
+        // iterate backwards, remove_subscriber() moves the last subscriber
+        for (int i = num_subs - 1; i >= 0; i--) {
+            struct subscriber *sub = ctx->subs[i];
+            short revents = fds[2 + i].revents;
+            bool keep = true;
+
+            if (revents & (POLLERR | POLLNVAL)) {
+                keep = false;
+            } else if (revents & (POLLIN | POLLHUP)) {
+                if (sub->state == SUBSCRIBER_CONNECTED) {
+                    keep = read_subscribe_request(ctx, sub);
+                } else {
+                    // subscribers are not expected to send anything after
+                    // the subscribe request
+                    uint8_t buf[64];
+                    ssize_t len = read(sub->fd, buf, sizeof(buf));
+                    keep = (len > 0 || (len < 0 && (errno == EAGAIN ||
+                                                   errno == EINTR)));
+                }
+            }
+            if (!keep) {
+                remove_subscriber(ctx, i);
+            }
+        }
+
+        if (fds[1].revents & POLLIN) {
+            accept_subscribers(ctx);
+        }
+
+        distribute_records(ctx);
+
+        for (int i = ctx->num_subs - 1; i >= 0; i--) {
+            struct subscriber *sub = ctx->subs[i];
+            if (sub->state == SUBSCRIBER_ACTIVE && !subscriber_send(ctx, sub)) {
+                remove_subscriber(ctx, i);
+            }
+        }
+
+        // sending may have made space for records held back by subscribers
+        // with the block policy
+        distribute_records(ctx);
+    }
+
+    return NULL;
+}
+
+API_EXPORT
+osd_result osd_tracestream_new(struct osd_tracestream_ctx **ctx,
+                               struct osd_log_ctx *log_ctx,
+                               const char *socket_path, size_t queue_size)
+{
+    osd_result rv;
+    int irv;
+
+    assert(socket_path);
+
+    struct osd_tracestream_ctx *c =
+        calloc(1, sizeof(struct osd_tracestream_ctx));
+    assert(c);
+
+    c->log_ctx = log_ctx;
+    c->queue_size =
+        queue_size ? queue_size : OSD_TRACESTREAM_QUEUE_SIZE_DEFAULT;
+    if (c->queue_size < RECORD_SIZE_MAX) {
+        c->queue_size = RECORD_SIZE_MAX;
+    }
+    c->socket_path = strdup(socket_path);
+    assert(c->socket_path);
+    c->input_buf = malloc(c->queue_size);
+    assert(c->input_buf);
+    c->dist_buf = malloc(c->queue_size);
+    assert(c->dist_buf);
+    pthread_mutex_init(&c->input_lock, NULL);
+    pthread_mutex_init(&c->subs_lock, NULL);
+    c->listen_fd = -1;
+
+    c->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (c->event_fd < 0) {
+        err(log_ctx, "Unable to create eventfd: %s", strerror(errno));
+        rv = OSD_ERROR_FAILURE;
+        goto err_free_ctx;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+        err(log_ctx, "Socket path %s is too long.", socket_path);
+        rv = OSD_ERROR_FAILURE;
+        goto err_free_ctx;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    c->listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                          0);
+    if (c->listen_fd < 0) {
+        err(log_ctx, "Unable to create socket: %s", strerror(errno));
+        rv = OSD_ERROR_FAILURE;
+        goto err_free_ctx;
+    }
+    unlink(socket_path);
+    if (bind(c->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(c->listen_fd, 8) != 0) {
+        err(log_ctx, "Unable to listen on %s: %s", socket_path,
+            strerror(errno));
+        rv = OSD_ERROR_FAILURE;
+        goto err_free_ctx;
+    }
+
+    c->running = true;
+    irv = pthread_create(&c->thread, NULL, sink_thread, c);
+    if (irv) {
+        err(log_ctx, "Failed to create new pthread: %s", strerror(irv));
+        unlink(socket_path);
+        rv = OSD_ERROR_FAILURE;
+        goto err_free_ctx;
+    }
+
+    info(log_ctx, "Trace stream available at %s", socket_path);
+
+    *ctx = c;
+    return OSD_OK;
+
+err_free_ctx:
+    if (c->listen_fd >= 0) {
+        close(c->listen_fd);
+    }
+    if (c->event_fd >= 0) {
+        close(c->event_fd);
+    }
+    pthread_mutex_destroy(&c->input_lock);
+    pthread_mutex_destroy(&c->subs_lock);
+    free(c->input_buf);
+    free(c->dist_buf);
+    free(c->socket_path);
+    free(c);
+    return rv;
+}
+
+API_EXPORT
+void osd_tracestream_free(struct osd_tracestream_ctx **ctx_p)
+{
+    assert(ctx_p);
+    struct osd_tracestream_ctx *ctx = *ctx_p;
+    if (!ctx) {
+        return;
+    }
+
+    ctx->running = false;
+    uint64_t v = 1;
+    ssize_t wrv = write(ctx->event_fd, &v, sizeof(v));
+    (void)wrv;
+    if (pthread_join(ctx->thread, NULL)) {
+        err(ctx->log_ctx, "Unable to join trace stream thread");
+    }
+
+    while (ctx->num_subs > 0) {
+        remove_subscriber(ctx, ctx->num_subs - 1);
+    }
+
+    if (ctx->overrun_records) {
+        info(ctx->log_ctx, "Trace stream: %" PRIu64 " of %" PRIu64 " records "
+             "dropped at the input.", ctx->overrun_records,
+             ctx->published_records + ctx->overrun_records);
+    }
+
+    close(ctx->listen_fd);
+    unlink(ctx->socket_path);
+    close(ctx->event_fd);
+
+    pthread_mutex_destroy(&ctx->input_lock);
+    pthread_mutex_destroy(&ctx->subs_lock);
+    free(ctx->input_buf);
+    free(ctx->dist_buf);
+    free(ctx->socket_path);
+
+    free(ctx);
+    *ctx_p = NULL;
+}
+
+API_EXPORT
+osd_result osd_tracestream_get_stats(struct osd_tracestream_ctx *ctx,
+                                     struct osd_tracestream_stats *stats)
+{
+    assert(ctx);
+    assert(stats);
+
+    pthread_mutex_lock(&ctx->input_lock);
+    stats->published_records = ctx->published_records;
+    stats->overrun_records = ctx->overrun_records;
+    pthread_mutex_unlock(&ctx->input_lock);
+
+    pthread_mutex_lock(&ctx->subs_lock);
+    stats->num_subscribers = ctx->num_subs;
+    pthread_mutex_unlock(&ctx->subs_lock);
+
+    return OSD_OK;
+}
+
+API_EXPORT
+osd_result osd_tracestream_get_subscriber_stats(
+    struct osd_tracestream_ctx *ctx, unsigned int idx,
+    struct osd_tracestream_subscriber_stats *stats)
+{
+    assert(ctx);
+    assert(stats);
+
+    pthread_mutex_lock(&ctx->subs_lock);
+    if (idx >= ctx->num_subs) {
+        pthread_mutex_unlock(&ctx->subs_lock);
+        return OSD_ERROR_FAILURE;
+    }
+    struct subscriber *sub = ctx->subs[idx];
+    *stats = sub->stats;
+    stats->lag_records = sub->queue.num_records;
+    stats->lag_bytes = sub->queue.used + sub->send_len - sub->send_offset;
+    stats->lag_ns = 0;
+    if (sub->queue.num_records > 0) {
+        uint64_t now = osd_capture_timestamp_now();
+        uint64_t oldest = record_queue_oldest_time(&sub->queue);
+        if (now > oldest) {
+            stats->lag_ns = now - oldest;
+        }
+    }
+    pthread_mutex_unlock(&ctx->subs_lock);
+
+    return OSD_OK;
+}
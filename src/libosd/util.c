@@ -17,6 +17,8 @@
 #include <osd/osd.h>
 #include "osd-private.h"
 
+#include <pthread.h>
+
 static const struct osd_version osd_version_internal = {
     OSD_VERSION_MAJOR, OSD_VERSION_MINOR, OSD_VERSION_MICRO,
     OSD_VERSION_SUFFIX};
@@ -62,3 +64,57 @@ unsigned int osd_diaddr_build(unsigned int subnet, unsigned int local_diaddr)
 
     return subnet << OSD_DIADDR_LOCAL_BITS | local_diaddr;
 }
+
+/**
+ * Lookup tables for the slicing-by-8 CRC-32 implementation
+ */
+static uint32_t crc32_table[8][256];
+static pthread_once_t crc32_table_once = PTHREAD_ONCE_INIT;
+
+static void crc32_table_init(void)
+{
+    // reflected polynomial of CRC-32 (IEEE 802.3)
+    const uint32_t poly = 0xedb88320;
+
+    for (unsigned int i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (unsigned int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (poly & -(crc & 1));
+        }
+        crc32_table[0][i] = crc;
+    }
+    for (unsigned int i = 0; i < 256; i++) {
+        for (unsigned int t = 1; t < 8; t++) {
+            uint32_t prev = crc32_table[t - 1][i];
+            crc32_table[t][i] = (prev >> 8) ^ crc32_table[0][prev & 0xff];
+        }
+    }
+}
+
+uint32_t osd_crc32(uint32_t crc, const void *buf, size_t len)
+{
+    pthread_once(&crc32_table_once, crc32_table_init);
+
+    const uint8_t *p = buf;
+    crc = ~crc;
+
+    while (len >= 8) {
+        crc ^= (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+               (uint32_t)p[3] << 24;
+        crc = crc32_table[7][crc & 0xff] ^
+              crc32_table[6][(crc >> 8) & 0xff] ^
+              crc32_table[5][(crc >> 16) & 0xff] ^
+              crc32_table[4][crc >> 24] ^
+              crc32_table[3][p[4]] ^
+              crc32_table[2][p[5]] ^
+              crc32_table[1][p[6]] ^
+              crc32_table[0][p[7]];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) {
+        crc = (crc >> 8) ^ crc32_table[0][(crc ^ *p++) & 0xff];
+    }
+
+    return ~crc;
+}
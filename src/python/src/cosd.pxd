@@ -13,7 +13,7 @@
 # limitations under the License.
 
 from cutil cimport va_list
-from libc.stdint cimport uint8_t, uint16_t, uint64_t
+from libc.stdint cimport uint8_t, uint16_t, uint32_t, uint64_t
 from libc.stdio cimport FILE
 from posix.time cimport timespec
 
@@ -62,6 +62,7 @@ cdef extern from "osd/packet.h" nogil:
     struct osd_packet:
         uint16_t data_size_words
         _osd_packet_data data
+        uint16_t *data_raw
 
     cdef enum osd_packet_type:
         OSD_PACKET_TYPE_REG = 0
@@ -97,8 +98,19 @@ cdef extern from "osd/hostmod.h" nogil:
     struct osd_hostmod_ctx:
         pass
 
+    enum: OSD_HOSTMOD_BLOCKING
+    enum: OSD_HOSTMOD_EVENT_BATCH_MAX
+
     ctypedef osd_result (*osd_hostmod_event_handler_fn)(void*, osd_packet*)
 
+    struct osd_hostmod_reg_access:
+        uint16_t diaddr
+        uint16_t reg_addr
+        int reg_size_bit
+        bint write
+        void *reg_val
+        osd_result result
+
     osd_result osd_hostmod_new(osd_hostmod_ctx **ctx, osd_log_ctx *log_ctx,
                                const char *host_controller_address,
                                osd_hostmod_event_handler_fn event_handler,
@@ -140,6 +152,23 @@ cdef extern from "osd/hostmod.h" nogil:
     osd_result osd_hostmod_event_receive(osd_hostmod_ctx *ctx,
                                          osd_packet **event_pkg, int flags)
 
+    osd_result osd_hostmod_event_receive_batch(osd_hostmod_ctx *ctx,
+                                               osd_packet **event_pkgs,
+                                               size_t max_pkgs,
+                                               size_t *num_pkgs, int flags)
+
+    int osd_hostmod_get_pollfd(osd_hostmod_ctx *ctx)
+
+    osd_result osd_hostmod_try_receive(osd_hostmod_ctx *ctx,
+                                       osd_packet **packet)
+
+    osd_result osd_hostmod_reg_access_start(
+        osd_hostmod_ctx *ctx, const osd_hostmod_reg_access *acc)
+
+    osd_result osd_hostmod_reg_access_finish(osd_hostmod_ctx *ctx,
+                                             osd_hostmod_reg_access *acc,
+                                             const osd_packet *response)
+
     osd_result osd_hostmod_mod_describe(osd_hostmod_ctx *ctx,
                                         uint16_t di_addr,
                                         osd_module_desc *desc)
@@ -202,6 +231,34 @@ cdef extern from "osd/gateway_glip.h" nogil:
 
     osd_gateway_transfer_stats* osd_gateway_glip_get_transfer_stats(osd_gateway_glip_ctx *ctx)
 
+cdef extern from "osd/gateway_sim.h" nogil:
+    struct osd_gateway_sim_ctx:
+        pass
+
+    struct osd_gateway_sim_config:
+        pass
+
+    void osd_gateway_sim_config_init(osd_gateway_sim_config *config)
+
+    osd_result osd_gateway_sim_config_parse(osd_gateway_sim_config *config,
+                                            const char *str)
+
+    osd_result osd_gateway_sim_new(osd_gateway_sim_ctx **ctx,
+                                   osd_log_ctx *log_ctx,
+                                   const char *host_controller_address,
+                                   uint16_t device_subnet_addr,
+                                   const osd_gateway_sim_config *config)
+
+    void osd_gateway_sim_free(osd_gateway_sim_ctx **ctx_p)
+
+    osd_result osd_gateway_sim_connect(osd_gateway_sim_ctx *ctx)
+
+    osd_result osd_gateway_sim_disconnect(osd_gateway_sim_ctx *ctx)
+
+    bint osd_gateway_sim_is_connected(osd_gateway_sim_ctx *ctx)
+
+    osd_gateway_transfer_stats* osd_gateway_sim_get_transfer_stats(osd_gateway_sim_ctx *ctx)
+
 cdef extern from "osd/cl_mam.h" nogil:
     cdef struct osd_mem_desc_region:
         uint64_t baseaddr
@@ -227,6 +284,64 @@ cdef extern from "osd/cl_mam.h" nogil:
                                 const void *data, size_t nbyte,
                                 uint64_t start_addr)
 
+cdef extern from "osd/cl_stm.h" nogil:
+    cdef struct osd_stm_desc:
+        unsigned int di_addr
+        uint16_t value_width_bit
+
+    cdef struct osd_stm_event:
+        uint32_t timestamp
+        uint16_t id
+        uint64_t value
+        uint16_t overflow
+
+cdef extern from "osd/cl_ctm.h" nogil:
+    cdef struct osd_ctm_desc:
+        unsigned int di_addr
+        uint16_t addr_width_bit
+        uint16_t data_width_bit
+
+    cdef struct osd_ctm_event:
+        uint16_t overflow
+        uint32_t timestamp
+        uint64_t npc
+        uint64_t pc
+        uint8_t mode
+        bint is_ret
+        bint is_call
+        bint is_modechange
+
+cdef extern from "osd/tracereader.h" nogil:
+    struct osd_tracereader_ctx:
+        pass
+
+    cdef struct osd_tracereader_stats:
+        uint64_t packets
+        uint64_t events
+        uint64_t overflowed_events
+        uint64_t invalid_packets
+
+    osd_result osd_tracereader_new(osd_tracereader_ctx **ctx,
+                                   osd_log_ctx *log_ctx,
+                                   const char *filename, int source)
+
+    void osd_tracereader_free(osd_tracereader_ctx **ctx_p)
+
+    osd_result osd_tracereader_read_stm(osd_tracereader_ctx *ctx,
+                                        const osd_stm_desc *stm_desc,
+                                        osd_stm_event *events,
+                                        size_t max_events, size_t *num_events)
+
+    osd_result osd_tracereader_read_ctm(osd_tracereader_ctx *ctx,
+                                        const osd_ctm_desc *ctm_desc,
+                                        osd_ctm_event *events,
+                                        size_t max_events, size_t *num_events)
+
+    osd_result osd_tracereader_rewind(osd_tracereader_ctx *ctx)
+
+    void osd_tracereader_get_stats(osd_tracereader_ctx *ctx,
+                                   osd_tracereader_stats *stats)
+
 cdef extern from "osd/module.h" nogil:
     cdef struct osd_module_desc:
         uint16_t addr
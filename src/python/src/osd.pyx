@@ -15,14 +15,19 @@
 cimport cosd
 cimport cutil
 from cutil cimport va_list, vasprintf, Py_AddPendingCall
-from libc.stdint cimport uint16_t
+from libc.stdint cimport uint8_t, uint16_t, uint32_t, uint64_t
+from cpython.pythread cimport PyThread_type_lock, PyThread_allocate_lock, \
+    PyThread_acquire_lock, PyThread_release_lock, WAIT_LOCK
 from cpython.mem cimport PyMem_Malloc, PyMem_Free
 from libc.stdlib cimport malloc, free
 from libc.stdio cimport FILE, fopen, fclose
 from libc.errno cimport errno
-from libc.string cimport strerror
+from libc.string cimport strerror, memcpy, memset
 from posix.time cimport timespec
+from cython cimport view
 
+import asyncio
+import collections
 import time
 import logging
 import os
@@ -45,6 +50,16 @@ cdef struct log_item:
     const char *fn
     char *msg
     size_t msg_len
+    log_item *next
+
+# Log entries waiting to be passed to the Python logger. The entries are
+# written from libosd threads without holding the GIL and passed on in
+# batches, i.e. the GIL is acquired once for all entries which were logged
+# in the meantime.
+cdef log_item *log_queue_head = NULL
+cdef log_item *log_queue_tail = NULL
+cdef bint log_queue_drain_pending = False
+cdef PyThread_type_lock log_queue_lock = PyThread_allocate_lock()
 
 cdef void log_cb(cosd.osd_log_ctx *ctx, int priority, const char *file,
                  int line, const char *fn, const char *format,
@@ -69,31 +84,73 @@ cdef void log_cb(cosd.osd_log_ctx *ctx, int priority, const char *file,
     item.fn = fn
     item.msg = msg
     item.msg_len = msg_len
+    item.next = NULL
+
+    log_queue_append(item)
+
+cdef void log_queue_append(log_item *item) nogil:
+    """
+    Queue a log entry to be processed with GIL held
 
-    # Queue callback to process item with GIL held
-    Py_AddPendingCall(log_cb_withgil, <void*>item)
+    Only the first entry added to an empty queue schedules log_queue_drain(),
+    all following entries are processed in the same call.
+    """
+    global log_queue_head, log_queue_tail, log_queue_drain_pending
 
-cdef int log_cb_withgil(void* item_void) with gil:
+    PyThread_acquire_lock(log_queue_lock, WAIT_LOCK)
+    if log_queue_tail:
+        log_queue_tail.next = item
+    else:
+        log_queue_head = item
+    log_queue_tail = item
+    schedule_drain = not log_queue_drain_pending
+    log_queue_drain_pending = True
+    PyThread_release_lock(log_queue_lock)
+
+    if schedule_drain and Py_AddPendingCall(log_queue_drain, NULL) != 0:
+        # The queue of pending calls is full, try again with the next entry
+        PyThread_acquire_lock(log_queue_lock, WAIT_LOCK)
+        log_queue_drain_pending = False
+        PyThread_release_lock(log_queue_lock)
+
+cdef int log_queue_drain(void* unused) with gil:
     """
-    Process a log entry with GIL held
+    Process all queued log entries with GIL held
 
     This function is called from the Python main thread with the GIL held.
-    The only argument is the log entry to be processed.
+    """
+    global log_queue_head, log_queue_tail, log_queue_drain_pending
+
+    PyThread_acquire_lock(log_queue_lock, WAIT_LOCK)
+    cdef log_item *item = log_queue_head
+    log_queue_head = NULL
+    log_queue_tail = NULL
+    log_queue_drain_pending = False
+    PyThread_release_lock(log_queue_lock)
+
+    cdef log_item *next_item
+    while item:
+        next_item = item.next
+        log_item_process(item)
+        item = next_item
+
+    return 0
+
+cdef log_item_process(log_item *item):
+    """
+    Pass a log entry to the Python logger and free it
 
     In this function all Python data structures can be accessed (since the GIL
     is held).
     """
-    cdef log_item *item = <log_item*> item_void
-    if not item:
-        return 0
-
     try:
         logger = logging.getLogger(__name__)
     except:
         # In the shutdown phase this function is called, but the logging
         # system is already destroyed. Discard messages.
+        free(item.msg)
         free(item)
-        return 0
+        return
 
     # handle log entry
     u_file = item.file.decode('UTF-8')
@@ -117,8 +174,6 @@ cdef int log_cb_withgil(void* item_void) with gil:
 
     free(item)
 
-    return 0
-
 cdef loglevel_py2syslog(py_level):
     """
     Convert Python logging severity levels to syslog levels as defined in
@@ -229,6 +284,14 @@ cdef class Packet:
         cdef uint16_t[:] payload_view = <uint16_t[:payload_size_words]>self._cself.data.payload
         return payload_view
 
+    @property
+    def raw(self):
+        """ Packet data (header and payload) as 16 bit words, without a copy """
+        self._ensure_cself()
+        cdef uint16_t[:] raw_view = \
+            <uint16_t[:self._cself.data_size_words]>self._cself.data_raw
+        return raw_view
+
     @property
     def size_payload_words(self):
         """ Payload size in 16 bit words """
@@ -254,6 +317,35 @@ cdef class Packet:
         return py_u_str
 
 
+def packet_array(packets):
+    """
+    Copy the data of many packets into one two-dimensional array
+
+    Each row of the returned uint16 array contains the raw data of one packet
+    (dest, src, flags, payload words), padded with zeros to the size of the
+    largest packet. The array supports the buffer protocol and can be passed
+    to numpy.asarray() without another copy.
+    """
+    cdef Packet pkg
+    cdef size_t num_pkgs = len(packets)
+    cdef size_t row_words = 0
+    cdef size_t i = 0
+    for pkg in packets:
+        pkg._ensure_cself()
+        row_words = max(row_words, pkg._cself.data_size_words)
+
+    cdef view.array arr = view.array(shape=(max(num_pkgs, 1), max(row_words, 1)),
+                                     itemsize=sizeof(uint16_t), format='H')
+    cdef uint16_t* data = <uint16_t*>arr.data
+    memset(data, 0, arr.len)
+    for pkg in packets:
+        memcpy(&data[i * row_words], pkg._cself.data_raw,
+               pkg._cself.data_size_words * sizeof(uint16_t))
+        i += 1
+
+    return arr[:num_pkgs, :row_words]
+
+
 cdef class Hostmod:
     cdef cosd.osd_hostmod_ctx* _cself
 
@@ -280,10 +372,12 @@ cdef class Hostmod:
         cosd.osd_hostmod_free(&self._cself)
 
     def connect(self):
-        cosd.osd_hostmod_connect(self._cself)
+        with nogil:
+            cosd.osd_hostmod_connect(self._cself)
 
     def disconnect(self):
-        cosd.osd_hostmod_disconnect(self._cself)
+        with nogil:
+            cosd.osd_hostmod_disconnect(self._cself)
 
     def is_connected(self):
         return cosd.osd_hostmod_is_connected(self._cself)
@@ -300,8 +394,14 @@ cdef class Hostmod:
         if reg_size_bit != 16:
             raise Exception("XXX: Extend to support other sizes than 16 bit registers")
 
-        rv = cosd.osd_hostmod_reg_read(self._cself, &outvalue, diaddr, reg_addr,
-                                       reg_size_bit, flags)
+        cdef uint16_t c_diaddr = diaddr
+        cdef uint16_t c_reg_addr = reg_addr
+        cdef int c_reg_size_bit = reg_size_bit
+        cdef int c_flags = flags
+        cdef cosd.osd_result rv
+        with nogil:
+            rv = cosd.osd_hostmod_reg_read(self._cself, &outvalue, c_diaddr,
+                                           c_reg_addr, c_reg_size_bit, c_flags)
         check_osd_result(rv)
 
         return outvalue
@@ -311,17 +411,26 @@ cdef class Hostmod:
             raise Exception("XXX: Extend to support other sizes than 16 bit registers")
 
         cdef uint16_t c_data = data
-
-        rv = cosd.osd_hostmod_reg_write(self._cself, &c_data, diaddr, reg_addr,
-                                        reg_size_bit, flags)
+        cdef uint16_t c_diaddr = diaddr
+        cdef uint16_t c_reg_addr = reg_addr
+        cdef int c_reg_size_bit = reg_size_bit
+        cdef int c_flags = flags
+        cdef cosd.osd_result rv
+        with nogil:
+            rv = cosd.osd_hostmod_reg_write(self._cself, &c_data, c_diaddr,
+                                            c_reg_addr, c_reg_size_bit,
+                                            c_flags)
         check_osd_result(rv)
 
     def get_modules(self, subnet_addr):
         cdef cosd.osd_module_desc *modules = NULL
         cdef size_t modules_len = 0
+        cdef unsigned int c_subnet_addr = subnet_addr
+        cdef cosd.osd_result rv
         try:
-            rv = cosd.osd_hostmod_get_modules(self._cself, subnet_addr,
-                                              &modules, &modules_len)
+            with nogil:
+                rv = cosd.osd_hostmod_get_modules(self._cself, c_subnet_addr,
+                                                  &modules, &modules_len)
             check_osd_result(rv)
 
             result_list = []
@@ -339,36 +448,56 @@ cdef class Hostmod:
 
     def mod_describe(self, di_addr):
         cdef cosd.osd_module_desc c_mod_desc
-        rv = cosd.osd_hostmod_mod_describe(self._cself, di_addr, &c_mod_desc)
+        cdef uint16_t c_di_addr = di_addr
+        cdef cosd.osd_result rv
+        with nogil:
+            rv = cosd.osd_hostmod_mod_describe(self._cself, c_di_addr,
+                                               &c_mod_desc)
         check_osd_result(rv)
 
         mod_desc = {}
         mod_desc['addr'] = c_mod_desc.addr
-        mod_desc['vendor'] = c_mod_desc.addr
-        mod_desc['type'] = c_mod_desc.addr
-        mod_desc['version'] = c_mod_desc.addr
+        mod_desc['vendor'] = c_mod_desc.vendor
+        mod_desc['type'] = c_mod_desc.type
+        mod_desc['version'] = c_mod_desc.version
 
         return mod_desc
 
     def mod_set_event_dest(self, di_addr, flags=0):
-        rv = cosd.osd_hostmod_mod_set_event_dest(self._cself, di_addr, flags)
+        cdef uint16_t c_di_addr = di_addr
+        cdef int c_flags = flags
+        cdef cosd.osd_result rv
+        with nogil:
+            rv = cosd.osd_hostmod_mod_set_event_dest(self._cself, c_di_addr,
+                                                     c_flags)
         check_osd_result(rv)
 
     def mod_set_event_active(self, di_addr, enabled=True, flags=0):
-        rv = cosd.osd_hostmod_mod_set_event_active(self._cself, di_addr,
-                                                   enabled, flags)
+        cdef uint16_t c_di_addr = di_addr
+        cdef int c_enabled = enabled
+        cdef int c_flags = flags
+        cdef cosd.osd_result rv
+        with nogil:
+            rv = cosd.osd_hostmod_mod_set_event_active(self._cself, c_di_addr,
+                                                       c_enabled, c_flags)
         check_osd_result(rv)
 
     def get_max_event_words(self, di_addr_target):
         return cosd.osd_hostmod_get_max_event_words(self._cself, di_addr_target)
 
     def event_send(self, Packet event_pkg):
-        rv = cosd.osd_hostmod_event_send(self._cself, event_pkg._cself)
+        cdef cosd.osd_result rv
+        with nogil:
+            rv = cosd.osd_hostmod_event_send(self._cself, event_pkg._cself)
         check_osd_result(rv)
 
     def event_receive(self, flags=0):
         cdef cosd.osd_packet* c_event_pkg
-        rv = cosd.osd_hostmod_event_receive(self._cself, &c_event_pkg, flags)
+        cdef int c_flags = flags
+        cdef cosd.osd_result rv
+        with nogil:
+            rv = cosd.osd_hostmod_event_receive(self._cself, &c_event_pkg,
+                                                c_flags)
         check_osd_result(rv)
 
         py_event_pkg = Packet()
@@ -376,6 +505,72 @@ cdef class Hostmod:
 
         return py_event_pkg
 
+    def event_receive_batch(self, max_pkgs=cosd.OSD_HOSTMOD_EVENT_BATCH_MAX,
+                            flags=0):
+        """
+        Receive all event packets which are ready, at least one
+
+        Waits for the first packet like event_receive() and returns a list of
+        up to max_pkgs packets.
+        """
+        cdef size_t c_max_pkgs = max_pkgs
+        cdef size_t num_pkgs = 0
+        cdef int c_flags = flags
+        cdef cosd.osd_result rv
+        if c_max_pkgs == 0:
+            raise ValueError("max_pkgs must be at least 1")
+
+        cdef cosd.osd_packet** c_event_pkgs = \
+            <cosd.osd_packet**>malloc(sizeof(cosd.osd_packet*) * c_max_pkgs)
+        if c_event_pkgs is NULL:
+            raise MemoryError()
+
+        try:
+            with nogil:
+                rv = cosd.osd_hostmod_event_receive_batch(self._cself,
+                                                          c_event_pkgs,
+                                                          c_max_pkgs,
+                                                          &num_pkgs, c_flags)
+            check_osd_result(rv)
+
+            py_event_pkgs = []
+            for i in range(num_pkgs):
+                py_event_pkg = Packet()
+                py_event_pkg._cself = c_event_pkgs[i]
+                py_event_pkgs.append(py_event_pkg)
+        finally:
+            free(c_event_pkgs)
+
+        return py_event_pkgs
+
+    @property
+    def pollfd(self):
+        """
+        File descriptor signaling received packets, see try_receive()
+
+        Like ZMQ_FD it is edge-triggered: once readable, call try_receive()
+        until it returns None.
+        """
+        return cosd.osd_hostmod_get_pollfd(self._cself)
+
+    def try_receive(self):
+        """
+        Receive a packet without waiting
+
+        Returns the next received packet (register access responses and event
+        packets alike), or None if no packet is waiting.
+        """
+        cdef cosd.osd_packet* c_pkg = NULL
+        cdef cosd.osd_result rv
+        rv = cosd.osd_hostmod_try_receive(self._cself, &c_pkg)
+        check_osd_result(rv)
+        if c_pkg is NULL:
+            return None
+
+        py_pkg = Packet()
+        py_pkg._cself = c_pkg
+        return py_pkg
+
 
 cdef class GatewayGlip:
     cdef cosd.osd_gateway_glip_ctx* _cself
@@ -425,10 +620,16 @@ cdef class GatewayGlip:
         cosd.osd_gateway_glip_free(&self._cself)
 
     def connect(self):
-        return cosd.osd_gateway_glip_connect(self._cself)
+        cdef cosd.osd_result rv
+        with nogil:
+            rv = cosd.osd_gateway_glip_connect(self._cself)
+        return rv
 
     def disconnect(self):
-        return cosd.osd_gateway_glip_disconnect(self._cself)
+        cdef cosd.osd_result rv
+        with nogil:
+            rv = cosd.osd_gateway_glip_disconnect(self._cself)
+        return rv
 
     def is_connected(self):
         return cosd.osd_gateway_glip_is_connected(self._cself)
@@ -447,6 +648,60 @@ cdef class GatewayGlip:
                  'connected_secs': time_elapsed }
 
 
+cdef class GatewaySim:
+    """
+    Gateway to a simulated debug subnet, see osd/gateway_sim.h
+
+    config is a configuration string as accepted by
+    osd_gateway_sim_config_parse(), e.g. "mam=1,cdm=2,latency=100000".
+    """
+    cdef cosd.osd_gateway_sim_ctx* _cself
+
+    def __cinit__(self, Log log, host_controller_address, device_subnet_addr,
+                  config=None):
+        cdef cosd.osd_gateway_sim_config c_config
+        cdef cosd.osd_result rv
+
+        cosd.osd_gateway_sim_config_init(&c_config)
+        if config is not None:
+            b_config = config.encode('UTF-8')
+            rv = cosd.osd_gateway_sim_config_parse(&c_config, b_config)
+            check_osd_result(rv)
+
+        b_host_controller_address = host_controller_address.encode('UTF-8')
+        cdef char* c_host_controller_address = b_host_controller_address
+
+        cosd.osd_gateway_sim_new(&self._cself, log._cself,
+                                 c_host_controller_address,
+                                 device_subnet_addr, &c_config)
+        if self._cself is NULL:
+            raise MemoryError()
+
+    def __dealloc__(self):
+        if self._cself is NULL:
+            return
+
+        if self.is_connected():
+            self.disconnect()
+
+        cosd.osd_gateway_sim_free(&self._cself)
+
+    def connect(self):
+        cdef cosd.osd_result rv
+        with nogil:
+            rv = cosd.osd_gateway_sim_connect(self._cself)
+        return rv
+
+    def disconnect(self):
+        cdef cosd.osd_result rv
+        with nogil:
+            rv = cosd.osd_gateway_sim_disconnect(self._cself)
+        return rv
+
+    def is_connected(self):
+        return cosd.osd_gateway_sim_is_connected(self._cself)
+
+
 cdef class Hostctrl:
     cdef cosd.osd_hostctrl_ctx* _cself
 
@@ -467,10 +722,16 @@ cdef class Hostctrl:
         cosd.osd_hostctrl_free(&self._cself)
 
     def start(self):
-        return cosd.osd_hostctrl_start(self._cself)
+        cdef cosd.osd_result rv
+        with nogil:
+            rv = cosd.osd_hostctrl_start(self._cself)
+        return rv
 
     def stop(self):
-        return cosd.osd_hostctrl_stop(self._cself)
+        cdef cosd.osd_result rv
+        with nogil:
+            rv = cosd.osd_hostctrl_stop(self._cself)
+        return rv
 
     def is_running(self):
         return cosd.osd_hostctrl_is_running(self._cself)
@@ -535,30 +796,385 @@ cdef class MemoryDescriptor:
         return str
 
 def cl_mam_get_mem_desc(Hostmod hostmod, mam_di_addr):
-    mem_desc = MemoryDescriptor()
+    cdef MemoryDescriptor mem_desc = MemoryDescriptor()
+    cdef unsigned int c_mam_di_addr = mam_di_addr
 
-    cosd.osd_cl_mam_get_mem_desc(hostmod._cself, mam_di_addr, &mem_desc._cself)
+    with nogil:
+        cosd.osd_cl_mam_get_mem_desc(hostmod._cself, c_mam_di_addr,
+                                     &mem_desc._cself)
 
     return mem_desc
 
 def cl_mam_write(MemoryDescriptor mem_desc, Hostmod hostmod, data, addr):
-    cdef char* c_data = data
-    rv = cosd.osd_cl_mam_write(&mem_desc._cself, hostmod._cself, c_data,
-                               len(data), addr)
+    """
+    Write data to the memory
+
+    data can be any contiguous object supporting the buffer protocol, e.g.
+    bytes, bytearray, memoryview or a NumPy array. It is not copied.
+    """
+    cdef const uint8_t[::1] c_data = memoryview(data).cast('B')
+    cdef size_t c_nbyte = c_data.shape[0]
+    cdef uint64_t c_addr = addr
+    cdef cosd.osd_result rv
+    if c_nbyte == 0:
+        return
+
+    with nogil:
+        rv = cosd.osd_cl_mam_write(&mem_desc._cself, hostmod._cself,
+                                   &c_data[0], c_nbyte, c_addr)
     if rv != 0:
         raise Exception("Memory write failed (%d)" % rv)
 
-def cl_mam_read(MemoryDescriptor mem_desc, Hostmod hostmod, addr, nbyte):
-    data = bytearray(nbyte)
-    cdef char* c_data = data
+def cl_mam_read_into(MemoryDescriptor mem_desc, Hostmod hostmod, buffer, addr):
+    """
+    Read len(buffer) bytes from the memory into buffer
+
+    buffer can be any writable, contiguous object supporting the buffer
+    protocol, e.g. a bytearray, a memoryview or a NumPy array. The data is
+    written directly into it.
+
+    Returns the number of bytes read.
+    """
+    cdef uint8_t[::1] c_data = memoryview(buffer).cast('B')
+    cdef size_t c_nbyte = c_data.shape[0]
+    cdef uint64_t c_addr = addr
+    cdef cosd.osd_result rv
+    if c_nbyte == 0:
+        return 0
 
-    rv = cosd.osd_cl_mam_read(&mem_desc._cself, hostmod._cself, c_data,
-                              nbyte, addr)
+    with nogil:
+        rv = cosd.osd_cl_mam_read(&mem_desc._cself, hostmod._cself,
+                                  &c_data[0], c_nbyte, c_addr)
     if rv != 0:
         raise Exception("Memory read failed (%d)" % rv)
 
+    return c_nbyte
+
+def cl_mam_read(MemoryDescriptor mem_desc, Hostmod hostmod, addr, nbyte):
+    data = bytearray(nbyte)
+    cl_mam_read_into(mem_desc, hostmod, data, addr)
     return data
 
+
+# Maximum number of words in a MAM burst transfer (see cl_mam.c)
+cdef enum:
+    MAM_MAX_BURST_WORDS = 255
+
+cdef class _RegAccess:
+    """ A register access started by AsyncHostmod """
+    cdef cosd.osd_hostmod_reg_access _cself
+    cdef uint16_t _value
+    cdef object future
+
+cdef class _MamReadTransfer:
+    """ The response data of a MAM read request sent by AsyncHostmod """
+    cdef bytearray data
+    cdef size_t pos
+    cdef object future
+
+cdef class AsyncHostmod:
+    """
+    asyncio interface to a connected host module
+
+    Watches the pollfd of the host module in an asyncio event loop and
+    dispatches the received packets: register access responses and MAM read
+    data complete the pending coroutines, all other event packets are
+    returned by event_receive(). One event loop can drive many host modules
+    concurrently without a thread for each of them.
+
+    Create the object from within a coroutine, or pass the event loop. While
+    it is in use, the blocking methods of the host module (and
+    MemoryAccess/cl_mam_*() functions using it) must not be called, as they
+    would receive packets meant for this object. Call close() to hand the
+    host module back.
+    """
+    cdef Hostmod _hostmod
+    cdef object _loop
+    cdef int _pollfd
+    cdef object _events
+    cdef dict _reg_accesses
+    cdef dict _mam_transfers
+
+    def __init__(self, Hostmod hostmod, loop=None):
+        if not hostmod.is_connected():
+            raise Exception("The host module is not connected")
+
+        self._hostmod = hostmod
+        self._loop = loop if loop is not None else asyncio.get_running_loop()
+        self._events = asyncio.Queue()
+        # pending accesses and transfers by DI address, in the order of the
+        # requests; modules answer them in this order
+        self._reg_accesses = {}
+        self._mam_transfers = {}
+
+        self._pollfd = cosd.osd_hostmod_get_pollfd(hostmod._cself)
+        self._loop.add_reader(self._pollfd, self._on_readable)
+        # the pollfd is edge-triggered: collect packets which are already
+        # waiting
+        self._loop.call_soon(self._on_readable)
+
+    @property
+    def hostmod(self):
+        return self._hostmod
+
+    def close(self):
+        """
+        Stop watching the host module and cancel all pending operations
+        """
+        if self._pollfd < 0:
+            return
+        self._loop.remove_reader(self._pollfd)
+        self._pollfd = -1
+        self._fail_pending(None)
+
+    def _fail_pending(self, exc):
+        for pending in (self._reg_accesses, self._mam_transfers):
+            for queue in pending.values():
+                for op in queue:
+                    if op.future.done():
+                        continue
+                    if exc is None:
+                        op.future.cancel()
+                    else:
+                        op.future.set_exception(exc)
+            pending.clear()
+
+    def _on_readable(self):
+        cdef cosd.osd_packet* c_pkg
+        cdef cosd.osd_result rv
+        cdef unsigned int src
+
+        if self._pollfd < 0:
+            return
+
+        while True:
+            c_pkg = NULL
+            rv = cosd.osd_hostmod_try_receive(self._hostmod._cself, &c_pkg)
+            if rv != 0:
+                # fail the pending operations before close() cancels them
+                self._fail_pending(OsdErrorException(rv))
+                self.close()
+                return
+            if c_pkg is NULL:
+                return
+
+            src = cosd.osd_packet_get_src(c_pkg)
+            if cosd.osd_packet_get_type(c_pkg) == cosd.OSD_PACKET_TYPE_REG:
+                self._complete_reg_access(src, c_pkg)
+                cosd.osd_packet_free(&c_pkg)
+            elif self._mam_transfers.get(src):
+                self._receive_mam_data(src, c_pkg)
+                cosd.osd_packet_free(&c_pkg)
+            else:
+                py_pkg = Packet()
+                py_pkg._cself = c_pkg
+                self._events.put_nowait(py_pkg)
+
+    cdef _complete_reg_access(self, unsigned int src,
+                              const cosd.osd_packet* c_pkg):
+        cdef _RegAccess acc
+        cdef cosd.osd_result rv
+
+        queue = self._reg_accesses.get(src)
+        if not queue:
+            logger = logging.getLogger(__name__)
+            logger.warning("Dropping unexpected register access response "
+                           "from module %d" % src)
+            return
+
+        acc = queue.popleft()
+        rv = cosd.osd_hostmod_reg_access_finish(self._hostmod._cself,
+                                                &acc._cself, c_pkg)
+        if acc.future.done():
+            return
+        if rv != 0:
+            acc.future.set_exception(OsdErrorException(rv))
+        elif acc._cself.write:
+            acc.future.set_result(None)
+        else:
+            acc.future.set_result(acc._value)
+
+    cdef _receive_mam_data(self, unsigned int src,
+                           const cosd.osd_packet* c_pkg):
+        cdef _MamReadTransfer transfer
+        cdef size_t payload_words = \
+            cosd.osd_packet_sizeconv_data2payload(c_pkg.data_size_words)
+        cdef size_t w
+        cdef uint16_t word
+
+        queue = self._mam_transfers[src]
+        transfer = queue[0]
+        cdef uint8_t[::1] data = transfer.data
+        for w in range(payload_words):
+            if transfer.pos + 2 > <size_t>data.shape[0]:
+                break
+            word = c_pkg.data.payload[w]
+            data[transfer.pos] = (word >> 8) & 0xFF
+            data[transfer.pos + 1] = word & 0xFF
+            transfer.pos += 2
+
+        if transfer.pos == <size_t>data.shape[0]:
+            queue.popleft()
+            if not transfer.future.done():
+                transfer.future.set_result(transfer.data)
+
+    cdef _start_reg_access(self, _RegAccess acc):
+        cdef cosd.osd_result rv
+        if self._pollfd < 0:
+            raise Exception("AsyncHostmod is closed")
+
+        rv = cosd.osd_hostmod_reg_access_start(self._hostmod._cself,
+                                               &acc._cself)
+        check_osd_result(rv)
+
+        acc.future = self._loop.create_future()
+        self._reg_accesses.setdefault(acc._cself.diaddr,
+                                      collections.deque()).append(acc)
+        # after a send the pollfd does not necessarily signal packets
+        # which arrived in the meantime
+        self._loop.call_soon(self._on_readable)
+        return acc.future
+
+    async def reg_read(self, diaddr, reg_addr, reg_size_bit=16):
+        """ Read a register, see Hostmod.reg_read() """
+        if reg_size_bit != 16:
+            raise Exception("XXX: Extend to support other sizes than 16 bit registers")
+
+        cdef _RegAccess acc = _RegAccess()
+        acc._cself.diaddr = diaddr
+        acc._cself.reg_addr = reg_addr
+        acc._cself.reg_size_bit = reg_size_bit
+        acc._cself.write = False
+        acc._cself.reg_val = &acc._value
+        return await self._start_reg_access(acc)
+
+    async def reg_write(self, data, diaddr, reg_addr, reg_size_bit=16):
+        """ Write a register, see Hostmod.reg_write() """
+        if reg_size_bit != 16:
+            raise Exception("XXX: Extend to support other sizes than 16 bit registers")
+
+        cdef _RegAccess acc = _RegAccess()
+        acc._value = data
+        acc._cself.diaddr = diaddr
+        acc._cself.reg_addr = reg_addr
+        acc._cself.reg_size_bit = reg_size_bit
+        acc._cself.write = True
+        acc._cself.reg_val = &acc._value
+        await self._start_reg_access(acc)
+
+    async def event_receive(self):
+        """ Receive the next event packet """
+        return await self._events.get()
+
+    cdef _send_mam_read_request(self, MemoryDescriptor mem_desc,
+                                uint64_t word_addr, bint burst,
+                                uint8_t selsize, size_t nbyte):
+        """
+        Send a MAM read request (see mam_read() in cl_mam.c) and return a
+        future for the nbyte bytes of read data
+        """
+        cdef cosd.osd_packet* c_pkg = NULL
+        cdef cosd.osd_result rv
+        cdef unsigned int aw_b = mem_desc._cself.addr_width_bit // 8
+        cdef unsigned int i, w, pkg_words
+        cdef unsigned int max_words = cosd.osd_hostmod_get_max_event_words(
+            self._hostmod._cself, mem_desc._cself.di_addr)
+        cdef uint16_t hostmod_diaddr = \
+            cosd.osd_hostmod_get_diaddr(self._hostmod._cself)
+
+        # HDR0 (we = 0, sync = 0), HDR1 (selsize), ADDR (big endian)
+        transfer = bytearray(2 + aw_b)
+        transfer[0] = burst << 6
+        transfer[1] = selsize
+        for i in range(aw_b):
+            transfer[2 + i] = (word_addr >> ((aw_b - i - 1) * 8)) & 0xFF
+
+        cdef unsigned int transfer_words = len(transfer) // 2
+        for w in range(0, transfer_words, max_words):
+            pkg_words = min(max_words, transfer_words - w)
+            rv = cosd.osd_packet_new(
+                &c_pkg, cosd.osd_packet_sizeconv_payload2data(pkg_words))
+            check_osd_result(rv)
+            try:
+                cosd.osd_packet_set_header(c_pkg, mem_desc._cself.di_addr,
+                                           hostmod_diaddr,
+                                           cosd.OSD_PACKET_TYPE_EVENT, 0)
+                for i in range(pkg_words):
+                    c_pkg.data.payload[i] = transfer[2 * (w + i)] << 8 | \
+                                            transfer[2 * (w + i) + 1]
+                rv = cosd.osd_hostmod_event_send(self._hostmod._cself, c_pkg)
+                check_osd_result(rv)
+            finally:
+                cosd.osd_packet_free(&c_pkg)
+
+        cdef _MamReadTransfer t = _MamReadTransfer()
+        t.data = bytearray(nbyte)
+        t.pos = 0
+        t.future = self._loop.create_future()
+        self._mam_transfers.setdefault(mem_desc._cself.di_addr,
+                                       collections.deque()).append(t)
+        self._loop.call_soon(self._on_readable)
+        return t.future
+
+    async def cl_mam_read(self, MemoryDescriptor mem_desc, addr, nbyte):
+        """
+        Read nbyte bytes from the memory, see cl_mam_read()
+
+        All read requests of the transfer are sent at once, reads from many
+        memories can be in progress at the same time.
+        """
+        if self._pollfd < 0:
+            raise Exception("AsyncHostmod is closed")
+
+        cdef uint64_t dw_b = mem_desc._cself.data_width_bit // 8
+        cdef uint64_t start_addr = addr
+        cdef uint64_t prolog, bulk, epilog, baddr, pos, burst_nbyte
+
+        # see calculate_parts() in cl_mam.c
+        if nbyte < dw_b:
+            prolog, bulk, epilog = nbyte, 0, 0
+        else:
+            prolog = (dw_b - start_addr % dw_b) % dw_b
+            epilog = (start_addr + nbyte) % dw_b
+            bulk = nbyte - prolog - epilog
+
+        # (position in data, future, offset of the requested bytes in the
+        # response, number of requested bytes), in the order of the requests
+        parts = []
+        for (pos, part_nbyte, burst) in ((0, prolog, False),
+                                         (prolog, bulk, True),
+                                         (prolog + bulk, epilog, False)):
+            if not part_nbyte:
+                continue
+
+            if burst:
+                for pos in range(pos, pos + part_nbyte,
+                                 MAM_MAX_BURST_WORDS * dw_b):
+                    burst_nbyte = min(MAM_MAX_BURST_WORDS * dw_b,
+                                      prolog + bulk - pos)
+                    fut = self._send_mam_read_request(
+                        mem_desc, start_addr + pos, True,
+                        burst_nbyte // dw_b, burst_nbyte)
+                    parts.append((pos, fut, 0, burst_nbyte))
+                continue
+
+            # single-word read with byte select of the unaligned bytes
+            baddr = (start_addr + pos) % dw_b
+            byte_select = 0
+            for i in range(baddr, baddr + part_nbyte):
+                byte_select |= 1 << i
+            fut = self._send_mam_read_request(mem_desc,
+                                              start_addr + pos - baddr,
+                                              False, byte_select, dw_b)
+            parts.append((pos, fut, baddr, part_nbyte))
+
+        data = bytearray(nbyte)
+        for (pos, fut, offset, part_nbyte) in parts:
+            part_data = await fut
+            data[pos:pos + part_nbyte] = part_data[offset:offset + part_nbyte]
+
+        return data
+
 cdef class MemoryAccess:
     cdef cosd.osd_memaccess_ctx* _cself
 
@@ -581,31 +1197,45 @@ cdef class MemoryAccess:
         cosd.osd_memaccess_free(&self._cself)
 
     def connect(self):
-        rv = cosd.osd_memaccess_connect(self._cself)
+        cdef cosd.osd_result rv
+        with nogil:
+            rv = cosd.osd_memaccess_connect(self._cself)
         check_osd_result(rv)
 
     def disconnect(self):
-        rv = cosd.osd_memaccess_disconnect(self._cself)
+        cdef cosd.osd_result rv
+        with nogil:
+            rv = cosd.osd_memaccess_disconnect(self._cself)
         check_osd_result(rv)
 
     def is_connected(self):
         return cosd.osd_memaccess_is_connected(self._cself)
 
     def cpus_stop(self, subnet_addr):
-        rv = cosd.osd_memaccess_cpus_stop(self._cself, subnet_addr)
+        cdef unsigned int c_subnet_addr = subnet_addr
+        cdef cosd.osd_result rv
+        with nogil:
+            rv = cosd.osd_memaccess_cpus_stop(self._cself, c_subnet_addr)
         check_osd_result(rv)
 
     def cpus_start(self, subnet_addr):
-        rv = cosd.osd_memaccess_cpus_start(self._cself, subnet_addr)
+        cdef unsigned int c_subnet_addr = subnet_addr
+        cdef cosd.osd_result rv
+        with nogil:
+            rv = cosd.osd_memaccess_cpus_start(self._cself, c_subnet_addr)
         check_osd_result(rv)
 
     def find_memories(self, subnet_addr):
-        cdef cosd.osd_mem_desc *memories
+        cdef cosd.osd_mem_desc *memories = NULL
         cdef size_t num_memories = 0
+        cdef unsigned int c_subnet_addr = subnet_addr
+        cdef cosd.osd_result rv
         try:
-            rv = cosd.osd_memaccess_find_memories(self._cself, subnet_addr,
-                                                  &memories,
-                                                  &num_memories)
+            with nogil:
+                rv = cosd.osd_memaccess_find_memories(self._cself,
+                                                      c_subnet_addr,
+                                                      &memories,
+                                                      &num_memories)
             check_osd_result(rv)
 
             result_list = []
@@ -622,6 +1252,7 @@ cdef class MemoryAccess:
         py_byte_string = elf_file_path.encode('UTF-8')
         cdef char* c_elf_file_path = py_byte_string
         cdef int c_verify = verify
+        cdef cosd.osd_result rv
 
         with nogil:
             rv = cosd.osd_memaccess_loadelf(self._cself, &mem_desc._cself,
@@ -666,22 +1297,30 @@ cdef class SystraceLogger:
         cosd.osd_systracelogger_free(&self._cself)
 
     def connect(self):
-        rv = cosd.osd_systracelogger_connect(self._cself)
+        cdef cosd.osd_result rv
+        with nogil:
+            rv = cosd.osd_systracelogger_connect(self._cself)
         check_osd_result(rv)
 
     def disconnect(self):
-        rv = cosd.osd_systracelogger_disconnect(self._cself)
+        cdef cosd.osd_result rv
+        with nogil:
+            rv = cosd.osd_systracelogger_disconnect(self._cself)
         check_osd_result(rv)
 
     def is_connected(self):
         return cosd.osd_systracelogger_is_connected(self._cself)
 
     def stop(self):
-        rv = cosd.osd_systracelogger_stop(self._cself)
+        cdef cosd.osd_result rv
+        with nogil:
+            rv = cosd.osd_systracelogger_stop(self._cself)
         check_osd_result(rv)
 
     def start(self):
-        rv = cosd.osd_systracelogger_start(self._cself)
+        cdef cosd.osd_result rv
+        with nogil:
+            rv = cosd.osd_systracelogger_start(self._cself)
         check_osd_result(rv)
 
     @property
@@ -754,22 +1393,30 @@ cdef class CoretraceLogger:
         cosd.osd_coretracelogger_free(&self._cself)
 
     def connect(self):
-        rv = cosd.osd_coretracelogger_connect(self._cself)
+        cdef cosd.osd_result rv
+        with nogil:
+            rv = cosd.osd_coretracelogger_connect(self._cself)
         check_osd_result(rv)
 
     def disconnect(self):
-        rv = cosd.osd_coretracelogger_disconnect(self._cself)
+        cdef cosd.osd_result rv
+        with nogil:
+            rv = cosd.osd_coretracelogger_disconnect(self._cself)
         check_osd_result(rv)
 
     def is_connected(self):
         return cosd.osd_coretracelogger_is_connected(self._cself)
 
     def stop(self):
-        rv = cosd.osd_coretracelogger_stop(self._cself)
+        cdef cosd.osd_result rv
+        with nogil:
+            rv = cosd.osd_coretracelogger_stop(self._cself)
         check_osd_result(rv)
 
     def start(self):
-        rv = cosd.osd_coretracelogger_start(self._cself)
+        cdef cosd.osd_result rv
+        with nogil:
+            rv = cosd.osd_coretracelogger_start(self._cself)
         check_osd_result(rv)
 
     @property
@@ -802,3 +1449,167 @@ cdef class CoretraceLogger:
         b_filename = os.fsencode(elf_filename)
         rv = cosd.osd_coretracelogger_set_elf(self._cself, b_filename)
         check_osd_result(rv)
+
+
+cdef struct stm_record:
+    uint32_t timestamp
+    uint16_t id
+    uint16_t overflow
+    uint64_t value
+
+cdef struct ctm_record:
+    uint32_t timestamp
+    uint16_t overflow
+    uint8_t mode
+    uint8_t flags
+    uint64_t npc
+    uint64_t pc
+
+cdef enum:
+    _CTM_FLAG_RET = 0x1
+    _CTM_FLAG_CALL = 0x2
+    _CTM_FLAG_MODECHANGE = 0x4
+
+CTM_FLAG_RET = _CTM_FLAG_RET
+CTM_FLAG_CALL = _CTM_FLAG_CALL
+CTM_FLAG_MODECHANGE = _CTM_FLAG_MODECHANGE
+
+cdef class TraceReader:
+    """
+    Decode STM or CTM events from a capture file in chunks
+
+    Iterating over the reader yields arrays of up to chunk_size events. The
+    arrays support the buffer protocol with a structured item format and can
+    be passed to numpy.asarray() without a copy, resulting in the fields
+
+    - STM: timestamp, id, overflow, value
+    - CTM: timestamp, overflow, mode, flags, npc, pc
+
+    flags is a combination of CTM_FLAG_RET, CTM_FLAG_CALL and
+    CTM_FLAG_MODECHANGE. Overflow events have a non-zero overflow field and
+    no valid other fields except the timestamp.
+    """
+    cdef cosd.osd_tracereader_ctx* _cself
+    cdef cosd.osd_stm_desc _stm_desc
+    cdef cosd.osd_ctm_desc _ctm_desc
+    cdef bint _is_stm
+    cdef size_t _chunk_size
+    cdef void* _events
+
+    def __cinit__(self, Log log, filename, trace_type, width_bit=32,
+                  source=None, chunk_size=64 * 1024):
+        if trace_type not in ('stm', 'ctm'):
+            raise ValueError("trace_type must be 'stm' or 'ctm'")
+        if chunk_size < 1:
+            raise ValueError("chunk_size must be at least 1")
+
+        self._is_stm = (trace_type == 'stm')
+        self._chunk_size = chunk_size
+        cdef int c_source = -1 if source is None else source
+        self._stm_desc.di_addr = max(c_source, 0)
+        self._stm_desc.value_width_bit = width_bit
+        self._ctm_desc.di_addr = max(c_source, 0)
+        self._ctm_desc.addr_width_bit = width_bit
+        self._ctm_desc.data_width_bit = width_bit
+
+        if self._is_stm:
+            self._events = malloc(self._chunk_size * sizeof(cosd.osd_stm_event))
+        else:
+            self._events = malloc(self._chunk_size * sizeof(cosd.osd_ctm_event))
+        if self._events is NULL:
+            raise MemoryError()
+
+        b_filename = os.fsencode(filename)
+        rv = cosd.osd_tracereader_new(&self._cself, log._cself, b_filename,
+                                      c_source)
+        check_osd_result(rv)
+
+    def __dealloc__(self):
+        free(self._events)
+        if self._cself is not NULL:
+            cosd.osd_tracereader_free(&self._cself)
+
+    def __iter__(self):
+        while True:
+            chunk = self.read()
+            if chunk is None:
+                return
+            yield chunk
+
+    def rewind(self):
+        rv = cosd.osd_tracereader_rewind(self._cself)
+        check_osd_result(rv)
+
+    def read(self):
+        """
+        Decode the next chunk of events
+
+        Returns an array of up to chunk_size events, or None at the end of
+        the capture.
+        """
+        cdef size_t num_events = 0
+        cdef cosd.osd_result rv
+        with nogil:
+            if self._is_stm:
+                rv = cosd.osd_tracereader_read_stm(
+                    self._cself, &self._stm_desc,
+                    <cosd.osd_stm_event*>self._events, self._chunk_size,
+                    &num_events)
+            else:
+                rv = cosd.osd_tracereader_read_ctm(
+                    self._cself, &self._ctm_desc,
+                    <cosd.osd_ctm_event*>self._events, self._chunk_size,
+                    &num_events)
+        check_osd_result(rv)
+
+        if num_events == 0:
+            return None
+        if self._is_stm:
+            return self._stm_records(num_events)
+        return self._ctm_records(num_events)
+
+    cdef _stm_records(self, size_t num_events):
+        cdef cosd.osd_stm_event* ev = <cosd.osd_stm_event*>self._events
+        cdef size_t i
+        cdef stm_record* rec = <stm_record*>malloc(num_events * sizeof(stm_record))
+        if rec is NULL:
+            raise MemoryError()
+
+        with nogil:
+            for i in range(num_events):
+                rec[i].timestamp = ev[i].timestamp
+                rec[i].id = ev[i].id
+                rec[i].overflow = ev[i].overflow
+                rec[i].value = ev[i].value
+
+        cdef view.array arr = <stm_record[:num_events]>rec
+        arr.callback_free_data = free
+        return arr
+
+    cdef _ctm_records(self, size_t num_events):
+        cdef cosd.osd_ctm_event* ev = <cosd.osd_ctm_event*>self._events
+        cdef size_t i
+        cdef ctm_record* rec = <ctm_record*>malloc(num_events * sizeof(ctm_record))
+        if rec is NULL:
+            raise MemoryError()
+
+        with nogil:
+            for i in range(num_events):
+                rec[i].timestamp = ev[i].timestamp
+                rec[i].overflow = ev[i].overflow
+                rec[i].mode = ev[i].mode
+                rec[i].flags = (ev[i].is_ret * _CTM_FLAG_RET |
+                                ev[i].is_call * _CTM_FLAG_CALL |
+                                ev[i].is_modechange * _CTM_FLAG_MODECHANGE)
+                rec[i].npc = ev[i].npc
+                rec[i].pc = ev[i].pc
+
+        cdef view.array arr = <ctm_record[:num_events]>rec
+        arr.callback_free_data = free
+        return arr
+
+    @property
+    def stats(self):
+        cdef cosd.osd_tracereader_stats c_stats
+        cosd.osd_tracereader_get_stats(self._cself, &c_stats)
+        return c_stats
@@ -0,0 +1,134 @@
+# Copyright 2018 The Open SoC Debug Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#    http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import asyncio
+
+import pytest
+
+import osd
+
+# register addresses, see osd/reg.h
+REG_BASE_MOD_VENDOR = 0x0000
+REG_BASE_MOD_TYPE = 0x0001
+REG_SCM_NUM_MOD = 0x0202
+
+OSD_ERROR_NOT_CONNECTED = -6
+
+# module addresses in the simulated subnet 0: SCM, MAM, DEM-UART, STM, CTM,
+# CDM
+SCM_DIADDR = 0
+MAM_DIADDR = 1
+
+
+@pytest.fixture
+def hostmod(request):
+    """ A host module connected to a simulated subnet """
+    log = osd.Log()
+    address = "inproc://" + request.node.name
+
+    hostctrl = osd.Hostctrl(log, address)
+    assert hostctrl.start() == 0
+    gateway = osd.GatewaySim(log, address, 0, "latency=100000")
+    assert gateway.connect() == 0
+    hostmod = osd.Hostmod(log, address)
+    hostmod.connect()
+    assert hostmod.is_connected()
+
+    yield hostmod
+
+    if hostmod.is_connected():
+        hostmod.disconnect()
+    gateway.disconnect()
+    hostctrl.stop()
+
+
+def test_reg_read(hostmod):
+    expected = [hostmod.reg_read(SCM_DIADDR, reg)
+                for reg in (REG_BASE_MOD_VENDOR, REG_BASE_MOD_TYPE,
+                            REG_SCM_NUM_MOD)]
+
+    async def read_all():
+        am = osd.AsyncHostmod(hostmod)
+        values = await asyncio.gather(
+            am.reg_read(SCM_DIADDR, REG_BASE_MOD_VENDOR),
+            am.reg_read(SCM_DIADDR, REG_BASE_MOD_TYPE),
+            am.reg_read(SCM_DIADDR, REG_SCM_NUM_MOD))
+        am.close()
+        return values
+
+    assert asyncio.run(read_all()) == expected
+
+
+def test_reg_write_read_back(hostmod):
+    async def write_read():
+        am = osd.AsyncHostmod(hostmod)
+        # accesses to two modules in flight at the same time
+        await asyncio.gather(am.reg_write(0x1234, SCM_DIADDR, 0x8000),
+                             am.reg_write(0x5678, MAM_DIADDR, 0x8000))
+        values = await asyncio.gather(am.reg_read(SCM_DIADDR, 0x8000),
+                                      am.reg_read(MAM_DIADDR, 0x8000))
+        am.close()
+        return values
+
+    assert asyncio.run(write_read()) == [0x1234, 0x5678]
+
+
+def test_cl_mam_read(hostmod):
+    mem_desc = osd.cl_mam_get_mem_desc(hostmod, MAM_DIADDR)
+    data = bytes(range(256)) * 4
+    osd.cl_mam_write(mem_desc, hostmod, data, 0x1001)
+
+    async def read():
+        am = osd.AsyncHostmod(hostmod)
+        result = await am.cl_mam_read(mem_desc, 0x1001, len(data))
+        am.close()
+        return result
+
+    assert asyncio.run(read()) == data
+
+
+def test_close_cancels_pending(hostmod):
+    async def close_pending():
+        am = osd.AsyncHostmod(hostmod)
+        task = asyncio.ensure_future(am.reg_read(SCM_DIADDR,
+                                                 REG_BASE_MOD_VENDOR))
+        # let the task send its request
+        await asyncio.sleep(0)
+        am.close()
+        with pytest.raises(asyncio.CancelledError):
+            await task
+
+    asyncio.run(close_pending())
+
+
+def test_receive_error_fails_pending(hostmod):
+    async def disconnect_pending():
+        am = osd.AsyncHostmod(hostmod)
+        task = asyncio.ensure_future(am.reg_read(SCM_DIADDR,
+                                                 REG_BASE_MOD_VENDOR))
+        # let the task send its request, then lose the connection before
+        # the response is received
+        await asyncio.sleep(0)
+        hostmod.disconnect()
+
+        # the waiter sees the receive error, not a cancellation
+        with pytest.raises(osd.OsdErrorException) as excinfo:
+            await task
+        assert excinfo.value.args == (OSD_ERROR_NOT_CONNECTED,)
+
+        # the object is closed afterwards
+        with pytest.raises(Exception, match="closed"):
+            await am.reg_read(SCM_DIADDR, REG_BASE_MOD_VENDOR)
+
+    asyncio.run(disconnect_pending())
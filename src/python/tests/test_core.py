@@ -20,3 +20,14 @@ def test_core():
     assert('minor' in result)
     assert('micro' in result)
     assert('suffix' in result)
+
+def test_packet_array():
+    pkg = osd.Packet()
+    pkg.set_header(dest=1, src=2, type=2, type_sub=0)
+    raw = pkg.raw
+    assert(len(raw) == pkg.size_words)
+    assert(raw[0] == 1 and raw[1] == 2)
+
+    arr = memoryview(osd.packet_array([pkg, pkg]))
+    assert(arr.shape == (2, pkg.size_words))
+    assert(arr.tolist()[1] == list(raw))
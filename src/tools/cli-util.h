@@ -14,6 +14,7 @@
  */
 
 #include <osd/osd.h>
+#include <osd/flightrec.h>
 
 #include <assert.h>
 #include <stdio.h>
@@ -341,6 +342,15 @@ int main(int argc, char** argv)
         cfg_update_with_cli_args();
     }
 
+    // Dump the libosd flight recorder on SIGUSR1 and on abort()
+    char flightrec_path[64];
+    snprintf(flightrec_path, sizeof(flightrec_path), "/tmp/%s.%d.flightrec",
+             CLI_TOOL_PROGNAME, (int)getpid());
+    rv = osd_flightrec_install_signal_handlers(flightrec_path);
+    if (OSD_FAILED(rv)) {
+        info("Unable to install the flight recorder signal handlers.");
+    }
+
     exitcode = run();
 
 exit:
@@ -0,0 +1,354 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Merge function coverage files of many runs into one coverage file
+ *
+ * The input files are distributed over a pool of worker threads. Every worker
+ * merges its share of the files into its own coverage object, the results of
+ * all workers are combined at the end.
+ */
+
+#define CLI_TOOL_PROGNAME "osd-coverage-merge"
+#define CLI_TOOL_SHORTDESC "Merge function coverage files"
+
+#include <osd/coverage.h>
+#include <osd/symtab.h>
+#include "../cli-util.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * Maximum number of input files given on the command line
+ */
+#define MAX_INPUT_FILES 100000
+
+// command line arguments
+struct arg_file *a_input;
+struct arg_file *a_files_from;
+struct arg_file *a_output;
+struct arg_file *a_elf;
+struct arg_file *a_report;
+struct arg_int *a_jobs;
+
+struct merge_ctx {
+    struct osd_log_ctx *log_ctx;
+    char **filenames;
+    size_t num_files;
+    unsigned int num_workers;
+};
+
+struct merge_worker {
+    struct merge_ctx *merge;
+    unsigned int idx; //!< worker index
+    struct osd_coverage_ctx *coverage; //!< merged coverage of this worker
+    size_t merged_files;
+    size_t failed_files;
+};
+
+static void *worker_thread(void *arg)
+{
+    osd_result rv;
+    struct merge_worker *w = arg;
+    struct merge_ctx *merge = w->merge;
+
+    for (size_t i = w->idx; i < merge->num_files; i += merge->num_workers) {
+        if (!w->coverage) {
+            rv = osd_coverage_new_from_file(&w->coverage, merge->log_ctx,
+                                            merge->filenames[i]);
+        } else {
+            rv = osd_coverage_merge_file(w->coverage, merge->filenames[i]);
+        }
+        if (OSD_FAILED(rv)) {
+            err("Skipping coverage file %s (%d)", merge->filenames[i], rv);
+            w->failed_files++;
+            continue;
+        }
+        w->merged_files++;
+    }
+
+    return NULL;
+}
+
+static void add_filename(struct merge_ctx *merge, size_t *alloc_files,
+                         const char *filename)
+{
+    if (merge->num_files == *alloc_files) {
+        *alloc_files = *alloc_files ? *alloc_files * 2 : 64;
+        merge->filenames = realloc(merge->filenames,
+                                   *alloc_files * sizeof(char *));
+        assert(merge->filenames);
+    }
+    merge->filenames[merge->num_files] = strdup(filename);
+    assert(merge->filenames[merge->num_files]);
+    merge->num_files++;
+}
+
+static osd_result read_files_from(struct merge_ctx *merge, size_t *alloc_files,
+                                  const char *list_filename)
+{
+    FILE *fp = fopen(list_filename, "r");
+    if (!fp) {
+        fatal("Unable to open file %s: %s", list_filename, strerror(errno));
+        return OSD_ERROR_FILE;
+    }
+
+    char *line = NULL;
+    size_t line_len = 0;
+    ssize_t len;
+    while ((len = getline(&line, &line_len, fp)) != -1) {
+        while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+            line[--len] = '\0';
+        }
+        if (len == 0) {
+            continue;
+        }
+        add_filename(merge, alloc_files, line);
+    }
+    free(line);
+    fclose(fp);
+
+    return OSD_OK;
+}
+
+static osd_result write_report(FILE *fp, const struct osd_coverage_ctx *cov,
+                               const struct osd_symtab_ctx *symtab)
+{
+    size_t count = osd_coverage_get_count(cov);
+    size_t covered = osd_coverage_get_covered_count(cov);
+
+    fprintf(fp, "# runs: %u\n", osd_coverage_get_runs(cov));
+    fprintf(fp, "# covered functions: %zu/%zu (%.1f%%)\n", covered, count,
+            count ? 100.0 * covered / count : 0.0);
+    fprintf(fp, "# address hits name\n");
+    for (size_t i = 0; i < count; i++) {
+        const struct osd_symtab_entry *sym = osd_symtab_get(symtab, i);
+        fprintf(fp, "%016lx %u %s\n", sym->addr, osd_coverage_get_hits(cov, i),
+                sym->name);
+    }
+
+    if (ferror(fp)) {
+        return OSD_ERROR_FILE;
+    }
+    return OSD_OK;
+}
+
+osd_result setup(void)
+{
+    a_input = arg_filen(NULL, NULL, "<file>", 0, MAX_INPUT_FILES,
+                        "coverage files to merge");
+    osd_tool_add_arg(a_input);
+
+    a_files_from = arg_file0("l", "files-from", "<file>",
+                             "read the names of the coverage files to merge "
+                             "from this file, one per line");
+    osd_tool_add_arg(a_files_from);
+
+    a_output = arg_file0("o", "output", "<file>", "merged coverage file");
+    osd_tool_add_arg(a_output);
+
+    a_elf = arg_file0("e", "elf", "<file>",
+                      "ELF file the coverage was collected for (required for "
+                      "--report)");
+    osd_tool_add_arg(a_elf);
+
+    a_report = arg_file0("r", "report", "<file>",
+                         "write the number of calls of all functions to this "
+                         "file (use - for stdout)");
+    osd_tool_add_arg(a_report);
+
+    a_jobs = arg_int0("j", "jobs", "<N>",
+                      "number of merging threads "
+                      "(default: number of online CPUs)");
+    a_jobs->ival[0] = 0;
+    osd_tool_add_arg(a_jobs);
+
+    return OSD_OK;
+}
+
+int run(void)
+{
+    osd_result rv;
+    int exitcode = 0;
+    struct merge_worker *workers = NULL;
+    pthread_t *threads = NULL;
+    struct osd_coverage_ctx *coverage = NULL;
+    struct osd_symtab_ctx *symtab = NULL;
+    FILE *fp_report = NULL;
+
+    struct osd_log_ctx *osd_log_ctx;
+    rv = osd_log_new(&osd_log_ctx, cfg.log_level, &osd_log_handler);
+    assert(OSD_SUCCEEDED(rv));
+
+    struct merge_ctx merge = { 0 };
+    merge.log_ctx = osd_log_ctx;
+
+    size_t alloc_files = 0;
+    for (int i = 0; i < a_input->count; i++) {
+        add_filename(&merge, &alloc_files, a_input->filename[i]);
+    }
+    if (a_files_from->count) {
+        rv = read_files_from(&merge, &alloc_files, a_files_from->filename[0]);
+        if (OSD_FAILED(rv)) {
+            exitcode = 1;
+            goto free_return;
+        }
+    }
+    if (merge.num_files == 0) {
+        fatal("No coverage files given.");
+        exitcode = 1;
+        goto free_return;
+    }
+    if (!a_output->count && !a_report->count) {
+        fatal("Nothing to do, specify --output and/or --report.");
+        exitcode = 1;
+        goto free_return;
+    }
+    if (a_report->count && !a_elf->count) {
+        fatal("--report requires the ELF file (--elf).");
+        exitcode = 1;
+        goto free_return;
+    }
+
+    struct timespec t_start, t_end;
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+
+    merge.num_workers = a_jobs->ival[0];
+    if (merge.num_workers == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        merge.num_workers = cpus > 0 ? cpus : 1;
+    }
+    if (merge.num_workers > merge.num_files) {
+        merge.num_workers = merge.num_files;
+    }
+
+    workers = calloc(merge.num_workers, sizeof(struct merge_worker));
+    assert(workers);
+    threads = calloc(merge.num_workers, sizeof(pthread_t));
+    assert(threads);
+    for (unsigned int i = 0; i < merge.num_workers; i++) {
+        workers[i].merge = &merge;
+        workers[i].idx = i;
+        int irv = pthread_create(&threads[i], NULL, worker_thread, &workers[i]);
+        assert(irv == 0);
+    }
+
+    size_t merged_files = 0;
+    size_t failed_files = 0;
+    for (unsigned int i = 0; i < merge.num_workers; i++) {
+        pthread_join(threads[i], NULL);
+
+        merged_files += workers[i].merged_files;
+        failed_files += workers[i].failed_files;
+        if (!workers[i].coverage) {
+            continue;
+        }
+        if (!coverage) {
+            coverage = workers[i].coverage;
+            workers[i].coverage = NULL;
+            continue;
+        }
+        rv = osd_coverage_merge(coverage, workers[i].coverage);
+        if (OSD_FAILED(rv)) {
+            err("The coverage files were collected for different programs.");
+            failed_files += workers[i].merged_files;
+            merged_files -= workers[i].merged_files;
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t_end);
+
+    if (!coverage) {
+        fatal("None of the coverage files could be read.");
+        exitcode = 1;
+        goto free_return;
+    }
+    if (failed_files) {
+        exitcode = 1;
+    }
+
+    double t_total = (t_end.tv_sec - t_start.tv_sec) +
+                     (t_end.tv_nsec - t_start.tv_nsec) / 1e9;
+    info("Merged %zu coverage files (%u runs) in %.3f s using %u threads, "
+         "%zu/%zu functions covered.",
+         merged_files, osd_coverage_get_runs(coverage), t_total,
+         merge.num_workers, osd_coverage_get_covered_count(coverage),
+         osd_coverage_get_count(coverage));
+
+    if (a_output->count) {
+        rv = osd_coverage_write(coverage, a_output->filename[0]);
+        if (OSD_FAILED(rv)) {
+            fatal("Unable to write coverage file %s (%d)",
+                  a_output->filename[0], rv);
+            exitcode = 1;
+            goto free_return;
+        }
+    }
+
+    if (a_report->count) {
+        rv = osd_symtab_new(&symtab, osd_log_ctx);
+        assert(OSD_SUCCEEDED(rv));
+        rv = osd_symtab_load_elf(symtab, a_elf->filename[0]);
+        if (OSD_FAILED(rv)) {
+            fatal("Unable to read ELF file %s (%d)", a_elf->filename[0], rv);
+            exitcode = 1;
+            goto free_return;
+        }
+        if (!osd_coverage_matches_symtab(coverage, symtab)) {
+            fatal("The coverage was not collected for ELF file %s.",
+                  a_elf->filename[0]);
+            exitcode = 1;
+            goto free_return;
+        }
+
+        if (!strcmp(a_report->filename[0], "-")) {
+            fp_report = stdout;
+        } else {
+            fp_report = fopen(a_report->filename[0], "w");
+            if (!fp_report) {
+                fatal("Unable to open report file %s: %s",
+                      a_report->filename[0], strerror(errno));
+                exitcode = 1;
+                goto free_return;
+            }
+        }
+        rv = write_report(fp_report, coverage, symtab);
+        if (OSD_FAILED(rv)) {
+            fatal("Unable to write coverage report.");
+            exitcode = 1;
+        }
+    }
+
+free_return:
+    if (fp_report && fp_report != stdout) {
+        fclose(fp_report);
+    }
+    if (workers) {
+        for (unsigned int i = 0; i < merge.num_workers; i++) {
+            osd_coverage_free(&workers[i].coverage);
+        }
+    }
+    free(workers);
+    free(threads);
+    osd_coverage_free(&coverage);
+    osd_symtab_free(&symtab);
+    for (size_t i = 0; i < merge.num_files; i++) {
+        free(merge.filenames[i]);
+    }
+    free(merge.filenames);
+    osd_log_free(&osd_log_ctx);
+    return exitcode;
+}
@@ -42,6 +42,7 @@ struct glip_ctx *glip_ctx;
 struct arg_str *a_glip_backend;
 struct arg_str *a_glip_backend_options;
 struct arg_str *a_hostctrl_ep;
+struct arg_lit *a_latency_tracing;
 
 osd_result setup(void)
 {
@@ -61,6 +62,11 @@ osd_result setup(void)
                  "<option1=value1,option2=value2,...>", "GLIP backend options");
     osd_tool_add_arg(a_glip_backend_options);
 
+    a_latency_tracing =
+        arg_lit0(NULL, "latency-tracing",
+                 "attach host timestamps to all packets from the device");
+    osd_tool_add_arg(a_latency_tracing);
+
     return OSD_OK;
 }
 
@@ -100,6 +106,9 @@ int run(void)
     }
     assert(gateway_glip_ctx);
 
+    osd_gateway_glip_set_latency_tracing(gateway_glip_ctx,
+                                         a_latency_tracing->count > 0);
+
     rv = osd_gateway_glip_connect(gateway_glip_ctx);
     if (OSD_FAILED(rv)) {
         fatal("Unable to connect to host controller and to device.");
@@ -0,0 +1,84 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Render a flight recorder dump as text
+ *
+ * The OSD tools write the flight recorder of libosd to
+ * /tmp/<tool>.<pid>.flightrec on SIGUSR1 and when they abort.
+ */
+
+#define CLI_TOOL_PROGNAME "osd-flightrec-decode"
+#define CLI_TOOL_SHORTDESC "Render a flight recorder dump as text"
+
+#include <osd/flightrec.h>
+#include "../cli-util.h"
+
+#include <errno.h>
+#include <string.h>
+
+// command line arguments
+struct arg_file *a_input;
+struct arg_file *a_output;
+
+osd_result setup(void)
+{
+    a_input = arg_file1(NULL, NULL, "<file>", "flight recorder dump");
+    osd_tool_add_arg(a_input);
+
+    a_output = arg_file0("o", "output", "<file>",
+                         "write the text to this file (default: stdout)");
+    osd_tool_add_arg(a_output);
+
+    return OSD_OK;
+}
+
+int run(void)
+{
+    osd_result rv;
+    int exitcode = 0;
+    FILE *fp_out = stdout;
+
+    FILE *fp_in = fopen(a_input->filename[0], "rb");
+    if (!fp_in) {
+        fatal("Unable to open file %s: %s", a_input->filename[0],
+              strerror(errno));
+        return 1;
+    }
+
+    if (a_output->count) {
+        fp_out = fopen(a_output->filename[0], "w");
+        if (!fp_out) {
+            fatal("Unable to open file %s: %s", a_output->filename[0],
+                  strerror(errno));
+            exitcode = 1;
+            goto free_return;
+        }
+    }
+
+    rv = osd_flightrec_decode(fp_in, fp_out);
+    if (OSD_FAILED(rv)) {
+        fatal("%s is not a valid flight recorder dump.",
+              a_input->filename[0]);
+        exitcode = 1;
+    }
+
+free_return:
+    if (fp_out && fp_out != stdout) {
+        fclose(fp_out);
+    }
+    fclose(fp_in);
+    return exitcode;
+}
@@ -0,0 +1,1415 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * GDB server: attach GDB to the CPU cores of a debug system
+ *
+ * Implements the GDB Remote Serial Protocol (RSP) over TCP. All CPU cores
+ * (i.e. all Core Debug Modules, CDM) are served on one connection, each core
+ * is a GDB thread (thread ID = core index + 1). The server runs in all-stop
+ * mode: when one core stops all other cores are stalled as well through the
+ * run control, and continuing resumes all cores at once. CPU registers are
+ * accessed through the CDM, memory through the Memory Access Modules (MAM).
+ *
+ * Every access to the device costs at least one round trip through the host
+ * controller. To keep stepping responsive the register files and memory pages
+ * are cached while the cores are halted, and all registers (or memory pages)
+ * needed for a request are read in one batch.
+ *
+ * The register layout is the one of the OpenRISC 1000 (or1k) architecture,
+ * currently the only CPU architecture with a CDM.
+ */
+
+#define CLI_TOOL_PROGNAME "osd-gdbserver"
+#define CLI_TOOL_SHORTDESC "GDB server for Open SoC Debug-enabled targets"
+
+#include <osd/cl_cdm.h>
+#include <osd/cl_mam.h>
+#include <osd/hostmod.h>
+#include <osd/module.h>
+#include <osd/reg.h>
+#include <osd/runctrl.h>
+#include "../cli-util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/**
+ * Subnet address of the device. Currently static and must be 0.
+ */
+#define DEVICE_SUBNET_ADDRESS 0
+
+/** Default TCP port */
+#define DEFAULT_PORT 5555
+
+/** Maximum size of a RSP packet (payload) */
+#define RSP_PACKET_MAX 4096
+
+/** Time between checks for a shutdown request (ms) */
+#define POLL_INTERVAL_MS 100
+
+/** Size of a cached memory page (bytes) */
+#define MEM_PAGE_SIZE 256
+
+/** Number of cached memory pages */
+#define MEM_CACHE_PAGES 64
+
+/** Maximum number of software breakpoints */
+#define MAX_BREAKPOINTS 64
+
+// or1k registers as seen by GDB: r0-r31, ppc, npc, sr
+#define OR1K_NUM_REGS 35
+#define OR1K_REGNUM_NPC 33
+#define OR1K_SPR_NPC 0x0010
+#define OR1K_SPR_SR 0x0011
+#define OR1K_SPR_PPC 0x0012
+#define OR1K_SPR_GPR(n) (0x0400 + (n))
+#define OR1K_SPR_DMR1 0x3010
+#define OR1K_SPR_DSR 0x3014
+#define OR1K_SPR_DRR 0x3015
+#define OR1K_DMR1_ST BIT(22)
+#define OR1K_DSR_TE BIT(13)
+
+/** Instruction used as software breakpoint: l.trap 1 */
+static const uint8_t or1k_trap_insn[4] = { 0x21, 0x00, 0x00, 0x01 };
+
+// GDB signal numbers
+#define GDB_SIGINT 2
+#define GDB_SIGTRAP 5
+
+// command line arguments
+struct arg_str *a_hostctrl_ep;
+struct arg_int *a_port;
+struct arg_lit *a_no_mem_cache;
+
+struct mem_page {
+    bool valid;
+    uint64_t addr;
+    uint8_t data[MEM_PAGE_SIZE];
+};
+
+struct breakpoint {
+    uint64_t addr;
+    uint8_t orig_insn[4];
+};
+
+/**
+ * A CPU core, seen as thread by GDB
+ */
+struct gdb_core {
+    unsigned int idx;
+    struct osd_cdm_desc cdm_desc;
+
+    // register cache, valid while the core is halted
+    bool regs_valid;
+    uint32_t regs[OR1K_NUM_REGS];
+};
+
+/**
+ * Stall event of a core, forwarded from the run control
+ */
+struct stall_event {
+    unsigned int core;
+    bool stalled;
+};
+
+/**
+ * The GDB connection and the state shared by all cores
+ */
+struct gdb_server {
+    struct osd_hostmod_ctx *hostmod_ctx;
+
+    struct gdb_core *cores;
+    size_t num_cores;
+
+    /** Stall events of all cores (struct stall_event) */
+    int event_pipe[2];
+
+    // GDB connection
+    int fd;
+    bool no_ack;
+    uint8_t rxbuf[RSP_PACKET_MAX];
+    size_t rxbuf_pos;
+    size_t rxbuf_len;
+
+    /** Core selected for register and memory accesses (Hg) */
+    struct gdb_core *g_core;
+    /** Core selected for stepping (Hc), NULL for all cores */
+    struct gdb_core *c_core;
+    /** Core which caused the last stop */
+    struct gdb_core *stop_core;
+
+    // memory cache, valid while the cores are halted
+    struct mem_page *pages;
+
+    // software breakpoints in the memory shared by all cores
+    struct breakpoint breakpoints[MAX_BREAKPOINTS];
+    unsigned int num_breakpoints;
+};
+
+/** SPR addresses of the registers in the order GDB expects them */
+static uint16_t or1k_reg_addrs[OR1K_NUM_REGS];
+
+static struct osd_log_ctx *osd_log_ctx;
+static struct osd_runctrl_ctx *runctrl_ctx;
+static struct osd_mem_desc *mems;
+static size_t num_mems;
+
+osd_result setup(void)
+{
+    a_hostctrl_ep = arg_str0("e", "hostctrl", "<URL>",
+                             "ZeroMQ endpoint of the host controller "
+                             "(default: " DEFAULT_HOSTCTRL_EP ")");
+    a_hostctrl_ep->sval[0] = DEFAULT_HOSTCTRL_EP;
+    osd_tool_add_arg(a_hostctrl_ep);
+
+    a_port = arg_int0("p", "port", "<port>", "TCP port (default: 5555)");
+    a_port->ival[0] = DEFAULT_PORT;
+    osd_tool_add_arg(a_port);
+
+    a_no_mem_cache = arg_lit0(NULL, "no-mem-cache",
+                              "do not cache memory while the cores are halted. "
+                              "Use if the memory is modified by other cores "
+                              "or devices while debugging.");
+    osd_tool_add_arg(a_no_mem_cache);
+
+    return OSD_OK;
+}
+
+static void invalidate_caches(struct gdb_server *srv)
+{
+    for (size_t i = 0; i < srv->num_cores; i++) {
+        srv->cores[i].regs_valid = false;
+    }
+    if (srv->pages) {
+        for (unsigned int i = 0; i < MEM_CACHE_PAGES; i++) {
+            srv->pages[i].valid = false;
+        }
+    }
+}
+
+/*
+ * Register access
+ */
+
+static osd_result regs_fetch(struct gdb_server *srv, struct gdb_core *core)
+{
+    osd_result rv;
+
+    if (core->regs_valid) {
+        return OSD_OK;
+    }
+
+    // all registers in one batch
+    rv = osd_cl_cdm_cpureg_read_bulk(srv->hostmod_ctx, &core->cdm_desc, 1,
+                                     or1k_reg_addrs, OR1K_NUM_REGS,
+                                     core->regs, 0);
+    if (OSD_FAILED(rv)) {
+        err("Core %u: unable to read registers (%d)", core->idx, rv);
+        return rv;
+    }
+    core->regs_valid = true;
+    return OSD_OK;
+}
+
+static osd_result regs_store(struct gdb_server *srv, struct gdb_core *core,
+                             const uint32_t *regs)
+{
+    osd_result rv;
+
+    rv = osd_cl_cdm_cpureg_write_bulk(srv->hostmod_ctx, &core->cdm_desc, 1,
+                                      or1k_reg_addrs, OR1K_NUM_REGS, regs, 0);
+    if (OSD_FAILED(rv)) {
+        err("Core %u: unable to write registers (%d)", core->idx, rv);
+        core->regs_valid = false;
+        return rv;
+    }
+    memcpy(core->regs, regs, sizeof(core->regs));
+    core->regs_valid = true;
+    return OSD_OK;
+}
+
+static osd_result reg_store(struct gdb_server *srv, struct gdb_core *core,
+                            unsigned int regno, uint32_t val)
+{
+    osd_result rv;
+
+    rv = cl_cdm_cpureg_write(srv->hostmod_ctx, &core->cdm_desc, &val,
+                             or1k_reg_addrs[regno], 0);
+    if (OSD_FAILED(rv)) {
+        err("Core %u: unable to write register %u (%d)", core->idx, regno,
+            rv);
+        core->regs_valid = false;
+        return rv;
+    }
+    core->regs[regno] = val;
+    return OSD_OK;
+}
+
+/**
+ * Set or clear bits in a debug SPR (not cached)
+ */
+static osd_result spr_modify(struct gdb_server *srv, struct gdb_core *core,
+                             uint16_t spr, uint32_t set, uint32_t clear)
+{
+    osd_result rv;
+    uint32_t val;
+
+    rv = cl_cdm_cpureg_read(srv->hostmod_ctx, &core->cdm_desc, &val, spr, 0);
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
+    uint32_t new_val = (val & ~clear) | set;
+    if (new_val == val) {
+        return OSD_OK;
+    }
+    return cl_cdm_cpureg_write(srv->hostmod_ctx, &core->cdm_desc, &new_val,
+                               spr, 0);
+}
+
+/*
+ * Memory access
+ */
+
+/**
+ * Find the memory region containing @p addr
+ *
+ * @param[out] region_end first address after the region
+ */
+static const struct osd_mem_desc *find_mem(uint64_t addr,
+                                           uint64_t *region_end)
+{
+    for (size_t m = 0; m < num_mems; m++) {
+        for (unsigned int r = 0; r < mems[m].num_regions; r++) {
+            const struct osd_mem_desc_region *region = &mems[m].regions[r];
+            if (addr >= region->baseaddr &&
+                addr - region->baseaddr < region->memsize) {
+                *region_end = region->baseaddr + region->memsize;
+                return &mems[m];
+            }
+        }
+    }
+    return NULL;
+}
+
+static struct mem_page *cache_page(struct gdb_server *srv, uint64_t page_addr)
+{
+    return &srv->pages[(page_addr / MEM_PAGE_SIZE) % MEM_CACHE_PAGES];
+}
+
+/**
+ * Read memory through the page cache
+ *
+ * All missing pages of the requested range are read with a single MAM
+ * access.
+ */
+static osd_result mem_read(struct gdb_server *srv, uint64_t addr, size_t len,
+                           uint8_t *buf)
+{
+    osd_result rv;
+
+    while (len) {
+        uint64_t region_end;
+        const struct osd_mem_desc *mem = find_mem(addr, &region_end);
+        if (!mem) {
+            return OSD_ERROR_FAILURE;
+        }
+        size_t chunk = len < region_end - addr ? len : region_end - addr;
+
+        uint64_t page_addr = addr & ~(uint64_t)(MEM_PAGE_SIZE - 1);
+        if (!srv->pages || page_addr + MEM_PAGE_SIZE > region_end ||
+            find_mem(page_addr, &region_end) != mem) {
+            // not cacheable: partial page at a region boundary
+            rv = osd_cl_mam_read(mem, srv->hostmod_ctx, buf, chunk, addr);
+            if (OSD_FAILED(rv)) {
+                return rv;
+            }
+            addr += chunk;
+            buf += chunk;
+            len -= chunk;
+            continue;
+        }
+
+        struct mem_page *page = cache_page(srv, page_addr);
+        if (!page->valid || page->addr != page_addr) {
+            // read all following missing pages of the request at once
+            unsigned int num_pages = 1;
+            uint64_t next = page_addr + MEM_PAGE_SIZE;
+            while (num_pages < MEM_CACHE_PAGES && next < addr + len &&
+                   next + MEM_PAGE_SIZE <= region_end) {
+                struct mem_page *p = cache_page(srv, next);
+                if (p->valid && p->addr == next) {
+                    break;
+                }
+                num_pages++;
+                next += MEM_PAGE_SIZE;
+            }
+
+            uint8_t *data = malloc(num_pages * MEM_PAGE_SIZE);
+            assert(data);
+            rv = osd_cl_mam_read(mem, srv->hostmod_ctx, data,
+                                 num_pages * MEM_PAGE_SIZE, page_addr);
+            if (OSD_FAILED(rv)) {
+                free(data);
+                return rv;
+            }
+            for (unsigned int i = 0; i < num_pages; i++) {
+                struct mem_page *p =
+                    cache_page(srv, page_addr + i * MEM_PAGE_SIZE);
+                p->addr = page_addr + i * MEM_PAGE_SIZE;
+                p->valid = true;
+                memcpy(p->data, data + i * MEM_PAGE_SIZE, MEM_PAGE_SIZE);
+            }
+            free(data);
+        }
+
+        size_t offset = addr - page_addr;
+        size_t n = MEM_PAGE_SIZE - offset;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(buf, page->data + offset, n);
+        addr += n;
+        buf += n;
+        len -= n;
+    }
+
+    return OSD_OK;
+}
+
+/**
+ * Write memory (write-through)
+ */
+static osd_result mem_write(struct gdb_server *srv, uint64_t addr, size_t len,
+                            const uint8_t *buf)
+{
+    osd_result rv;
+
+    while (len) {
+        uint64_t region_end;
+        const struct osd_mem_desc *mem = find_mem(addr, &region_end);
+        if (!mem) {
+            return OSD_ERROR_FAILURE;
+        }
+        size_t chunk = len < region_end - addr ? len : region_end - addr;
+
+        rv = osd_cl_mam_write(mem, srv->hostmod_ctx, buf, chunk, addr);
+        if (OSD_FAILED(rv)) {
+            invalidate_caches(srv);
+            return rv;
+        }
+
+        // update the cached pages
+        for (size_t done = 0; srv->pages && done < chunk;) {
+            uint64_t a = addr + done;
+            uint64_t page_addr = a & ~(uint64_t)(MEM_PAGE_SIZE - 1);
+            size_t offset = a - page_addr;
+            size_t n = MEM_PAGE_SIZE - offset;
+            if (n > chunk - done) {
+                n = chunk - done;
+            }
+            struct mem_page *p = cache_page(srv, page_addr);
+            if (p->valid && p->addr == page_addr) {
+                memcpy(p->data + offset, buf + done, n);
+            }
+            done += n;
+        }
+
+        addr += chunk;
+        buf += chunk;
+        len -= chunk;
+    }
+
+    return OSD_OK;
+}
+
+/*
+ * Run control
+ */
+
+/**
+ * Called by the run control for every stall event (in its I/O thread)
+ */
+static void stall_handler(void *arg, unsigned int core_idx, bool stalled)
+{
+    struct gdb_server *srv = arg;
+    struct stall_event ev = { .core = core_idx, .stalled = stalled };
+
+    // smaller than PIPE_BUF, i.e. written atomically
+    ssize_t rv = write(srv->event_pipe[1], &ev, sizeof(ev));
+    if (rv != sizeof(ev) && errno != EAGAIN) {
+        err("Core %u: unable to forward stall event", core_idx);
+    }
+}
+
+static void drain_events(struct gdb_server *srv)
+{
+    struct stall_event ev;
+    while (read(srv->event_pipe[0], &ev, sizeof(ev)) > 0) {
+    }
+}
+
+static osd_result core_set_stall(struct gdb_server *srv,
+                                 struct gdb_core *core, bool stall)
+{
+    uint16_t val = stall ? BIT(OSD_REG_CDM_CORE_CTRL_STALL_BIT) : 0;
+    return osd_hostmod_reg_write(srv->hostmod_ctx, &val,
+                                 core->cdm_desc.di_addr,
+                                 OSD_REG_CDM_CORE_CTRL, 16, 0);
+}
+
+/**
+ * Prepare a core for resuming, optionally for a single instruction
+ */
+static osd_result core_prepare_resume(struct gdb_server *srv,
+                                      struct gdb_core *core, bool step)
+{
+    osd_result rv;
+
+    rv = spr_modify(srv, core, OR1K_SPR_DMR1, step ? OR1K_DMR1_ST : 0,
+                    step ? 0 : OR1K_DMR1_ST);
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
+    // clear the reason of the last stop
+    uint32_t zero = 0;
+    return cl_cdm_cpureg_write(srv->hostmod_ctx, &core->cdm_desc, &zero,
+                               OR1K_SPR_DRR, 0);
+}
+
+/**
+ * Resume all cores at once, or step a single core
+ *
+ * @param step_core the core to step, NULL to resume all cores
+ */
+static osd_result cores_resume(struct gdb_server *srv,
+                               struct gdb_core *step_core)
+{
+    osd_result rv;
+
+    if (step_core) {
+        rv = core_prepare_resume(srv, step_core, true);
+        if (OSD_FAILED(rv)) {
+            return rv;
+        }
+    } else {
+        for (size_t i = 0; i < srv->num_cores; i++) {
+            rv = core_prepare_resume(srv, &srv->cores[i], false);
+            if (OSD_FAILED(rv)) {
+                return rv;
+            }
+        }
+    }
+
+    invalidate_caches(srv);
+    drain_events(srv);
+    if (step_core) {
+        return core_set_stall(srv, step_core, false);
+    }
+    return osd_runctrl_release(runctrl_ctx, NULL);
+}
+
+/**
+ * Halt all cores (which are not stalled already)
+ */
+static osd_result cores_halt(struct gdb_server *srv)
+{
+    osd_result rv;
+    struct osd_runctrl_sync_stats stats;
+
+    rv = osd_runctrl_stall(runctrl_ctx, &stats);
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
+    // cores which stopped by themselves before do not confirm the stall
+    dbg("%zu of %zu cores confirmed the halt request", stats.num_events,
+        stats.num_cores);
+    invalidate_caches(srv);
+    return OSD_OK;
+}
+
+static osd_result breakpoint_insert(struct gdb_server *srv, uint64_t addr)
+{
+    osd_result rv;
+
+    for (unsigned int i = 0; i < srv->num_breakpoints; i++) {
+        if (srv->breakpoints[i].addr == addr) {
+            return OSD_OK;
+        }
+    }
+    if (srv->num_breakpoints == MAX_BREAKPOINTS) {
+        return OSD_ERROR_FAILURE;
+    }
+
+    struct breakpoint *bp = &srv->breakpoints[srv->num_breakpoints];
+    rv = mem_read(srv, addr, sizeof(bp->orig_insn), bp->orig_insn);
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
+    rv = mem_write(srv, addr, sizeof(or1k_trap_insn), or1k_trap_insn);
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
+    bp->addr = addr;
+    srv->num_breakpoints++;
+    return OSD_OK;
+}
+
+static osd_result breakpoint_remove(struct gdb_server *srv, uint64_t addr)
+{
+    osd_result rv;
+
+    for (unsigned int i = 0; i < srv->num_breakpoints; i++) {
+        struct breakpoint *bp = &srv->breakpoints[i];
+        if (bp->addr != addr) {
+            continue;
+        }
+        rv = mem_write(srv, addr, sizeof(bp->orig_insn), bp->orig_insn);
+        if (OSD_FAILED(rv)) {
+            return rv;
+        }
+        *bp = srv->breakpoints[--srv->num_breakpoints];
+        return OSD_OK;
+    }
+    return OSD_ERROR_FAILURE;
+}
+
+static void breakpoints_remove_all(struct gdb_server *srv)
+{
+    while (srv->num_breakpoints) {
+        uint64_t addr = srv->breakpoints[0].addr;
+        if (OSD_FAILED(breakpoint_remove(srv, addr))) {
+            err("Unable to remove breakpoint at 0x%" PRIx64, addr);
+            srv->breakpoints[0] = srv->breakpoints[--srv->num_breakpoints];
+        }
+    }
+}
+
+/*
+ * RSP packet handling
+ */
+
+static int hex2int(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static const char hexchars[] = "0123456789abcdef";
+
+static void bin2hex(char *hex, const uint8_t *bin, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        hex[2 * i] = hexchars[bin[i] >> 4];
+        hex[2 * i + 1] = hexchars[bin[i] & 0xf];
+    }
+    hex[2 * len] = '\0';
+}
+
+static bool hex2bin(uint8_t *bin, const char *hex, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        int hi = hex2int(hex[2 * i]);
+        int lo = hi < 0 ? -1 : hex2int(hex[2 * i + 1]);
+        if (lo < 0) {
+            return false;
+        }
+        bin[i] = (hi << 4) | lo;
+    }
+    return true;
+}
+
+/** Format a register value in target (big endian) byte order */
+static void reg2hex(char *hex, uint32_t val)
+{
+    uint8_t bin[4] = { val >> 24, val >> 16, val >> 8, val };
+    bin2hex(hex, bin, 4);
+}
+
+static bool hex2reg(uint32_t *val, const char *hex)
+{
+    uint8_t bin[4];
+    if (!hex2bin(bin, hex, 4)) {
+        return false;
+    }
+    *val = (uint32_t)bin[0] << 24 | bin[1] << 16 | bin[2] << 8 | bin[3];
+    return true;
+}
+
+/**
+ * Get the next byte from the GDB connection
+ *
+ * @return the byte, or -1 if the connection was closed or the tool is
+ *         interrupted
+ */
+static int rsp_getc(struct gdb_server *srv)
+{
+    while (srv->rxbuf_pos == srv->rxbuf_len) {
+        if (zsys_interrupted) {
+            return -1;
+        }
+        struct pollfd pfd = { .fd = srv->fd, .events = POLLIN };
+        int rv = poll(&pfd, 1, POLL_INTERVAL_MS);
+        if (rv <= 0) {
+            continue;
+        }
+        ssize_t n = recv(srv->fd, srv->rxbuf, sizeof(srv->rxbuf), 0);
+        if (n <= 0) {
+            return -1;
+        }
+        srv->rxbuf_pos = 0;
+        srv->rxbuf_len = n;
+    }
+    return srv->rxbuf[srv->rxbuf_pos++];
+}
+
+static bool rsp_write(struct gdb_server *srv, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    while (len) {
+        ssize_t n = send(srv->fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static bool rsp_put_packet(struct gdb_server *srv, const char *data)
+{
+    size_t len = strlen(data);
+    char *pkt = malloc(len + 5);
+    assert(pkt);
+
+    uint8_t checksum = 0;
+    for (size_t i = 0; i < len; i++) {
+        checksum += data[i];
+    }
+    pkt[0] = '$';
+    memcpy(pkt + 1, data, len);
+    pkt[len + 1] = '#';
+    pkt[len + 2] = hexchars[checksum >> 4];
+    pkt[len + 3] = hexchars[checksum & 0xf];
+
+    dbg("-> %s", data);
+
+    bool ok;
+    while (1) {
+        ok = rsp_write(srv, pkt, len + 4);
+        if (!ok || srv->no_ack) {
+            break;
+        }
+        int c = rsp_getc(srv);
+        if (c < 0) {
+            ok = false;
+            break;
+        }
+        if (c == '-') {
+            continue; // retransmit
+        }
+        if (c != '+') {
+            // start of the next packet: treat as acknowledged
+            srv->rxbuf_pos--;
+        }
+        break;
+    }
+
+    free(pkt);
+    return ok;
+}
+
+/**
+ * Receive the next packet
+ *
+ * @param[out] buf the packet payload, zero-terminated
+ * @return false if the connection was closed
+ */
+static bool rsp_get_packet(struct gdb_server *srv, char *buf)
+{
+    int c;
+
+    while (1) {
+        do {
+            c = rsp_getc(srv);
+            if (c < 0) {
+                return false;
+            }
+        } while (c != '$');
+
+        size_t len = 0;
+        uint8_t checksum = 0;
+        while (1) {
+            c = rsp_getc(srv);
+            if (c < 0) {
+                return false;
+            }
+            if (c == '#') {
+                break;
+            }
+            if (len < RSP_PACKET_MAX - 1) {
+                buf[len++] = c;
+            }
+            checksum += c;
+        }
+        buf[len] = '\0';
+
+        int hi = rsp_getc(srv);
+        int lo = rsp_getc(srv);
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+        bool valid = hex2int(hi) >= 0 && hex2int(lo) >= 0 &&
+                     (hex2int(hi) << 4 | hex2int(lo)) == checksum;
+
+        if (!srv->no_ack) {
+            if (!rsp_write(srv, valid ? "+" : "-", 1)) {
+                return false;
+            }
+        }
+        if (valid) {
+            dbg("<- %s", buf);
+            return true;
+        }
+    }
+}
+
+/**
+ * Resume the cores and wait until one of them stops again
+ *
+ * All other cores are halted as soon as one core stops (all-stop mode). An
+ * interrupt request from GDB (Ctrl-C) halts all cores.
+ *
+ * @param step_core the core to step, NULL to resume all cores
+ * @param[out] signal the GDB signal reporting the stop reason
+ * @return false if the connection was closed
+ */
+static bool run_until_stop(struct gdb_server *srv, struct gdb_core *step_core,
+                           int *signal)
+{
+    osd_result rv;
+
+    *signal = GDB_SIGTRAP;
+    rv = cores_resume(srv, step_core);
+    if (OSD_FAILED(rv)) {
+        err("Unable to resume (%d)", rv);
+        return true;
+    }
+
+    struct gdb_core *stopped = NULL;
+    while (!zsys_interrupted && !stopped) {
+        struct pollfd pfds[2] = {
+            { .fd = srv->event_pipe[0], .events = POLLIN },
+            { .fd = srv->fd, .events = POLLIN },
+        };
+        // pending data from GDB is handled below
+        bool rx_pending = srv->rxbuf_pos != srv->rxbuf_len;
+        int prv = poll(pfds, rx_pending ? 1 : 2,
+                       rx_pending ? 0 : POLL_INTERVAL_MS);
+        if (prv < 0) {
+            continue;
+        }
+
+        if (pfds[0].revents & POLLIN) {
+            struct stall_event ev;
+            while (!stopped &&
+                   read(srv->event_pipe[0], &ev, sizeof(ev)) == sizeof(ev)) {
+                if (ev.stalled && ev.core < srv->num_cores &&
+                    (!step_core || step_core->idx == ev.core)) {
+                    stopped = &srv->cores[ev.core];
+                }
+            }
+            if (stopped) {
+                break;
+            }
+        }
+
+        if (rx_pending || (pfds[1].revents & (POLLIN | POLLHUP))) {
+            int c = rsp_getc(srv);
+            if (c < 0) {
+                return false;
+            }
+            if (c == 0x03) {
+                *signal = GDB_SIGINT;
+                stopped = step_core ? step_core : srv->g_core;
+            }
+        }
+    }
+
+    if (!step_core || *signal == GDB_SIGINT) {
+        rv = cores_halt(srv);
+        if (OSD_FAILED(rv)) {
+            err("Unable to halt (%d)", rv);
+        }
+    }
+    invalidate_caches(srv);
+    if (stopped) {
+        srv->stop_core = stopped;
+        srv->g_core = stopped;
+    }
+    return true;
+}
+
+/** GDB thread ID of a core */
+static unsigned int core_tid(const struct gdb_core *core)
+{
+    return core->idx + 1;
+}
+
+/**
+ * Find the core with a GDB thread ID
+ *
+ * @return the core, or NULL if the thread ID is unknown
+ */
+static struct gdb_core *find_core(struct gdb_server *srv, unsigned long tid)
+{
+    if (tid < 1 || tid > srv->num_cores) {
+        return NULL;
+    }
+    return &srv->cores[tid - 1];
+}
+
+/**
+ * Select a thread with the H packet
+ *
+ * Thread ID 0 (any thread) keeps the current selection, -1 (all threads) is
+ * only valid for Hc.
+ *
+ * @return true if the thread ID is valid
+ */
+static bool select_thread(struct gdb_server *srv, const char *pkt)
+{
+    char op = pkt[1];
+    const char *tid_str = pkt + 2;
+
+    if (op != 'g' && op != 'c') {
+        return false;
+    }
+    if (!strcmp(tid_str, "-1")) {
+        if (op != 'c') {
+            return false;
+        }
+        srv->c_core = NULL;
+        return true;
+    }
+
+    char *end;
+    unsigned long tid = strtoul(tid_str, &end, 16);
+    if (end == tid_str || *end) {
+        return false;
+    }
+    if (tid == 0) {
+        return true;
+    }
+    struct gdb_core *core = find_core(srv, tid);
+    if (!core) {
+        return false;
+    }
+    if (op == 'g') {
+        srv->g_core = core;
+    } else {
+        srv->c_core = core;
+    }
+    return true;
+}
+
+static void stop_reply(struct gdb_server *srv, char *reply, int signal)
+{
+    sprintf(reply, "T%02xthread:%x;", signal, core_tid(srv->stop_core));
+}
+
+/**
+ * Handle a query packet (q)
+ */
+static void handle_query(struct gdb_server *srv, const char *pkt, char *reply)
+{
+    if (!strncmp(pkt, "qSupported", 10)) {
+        sprintf(reply, "PacketSize=%x;QStartNoAckMode+", RSP_PACKET_MAX);
+    } else if (!strcmp(pkt, "qAttached")) {
+        strcpy(reply, "1");
+    } else if (!strcmp(pkt, "qC")) {
+        sprintf(reply, "QC%x", core_tid(srv->g_core));
+    } else if (!strcmp(pkt, "qfThreadInfo")) {
+        // all threads in one reply
+        char *p = reply;
+        *p++ = 'm';
+        for (size_t i = 0; i < srv->num_cores; i++) {
+            p += sprintf(p, i ? ",%x" : "%x", core_tid(&srv->cores[i]));
+        }
+    } else if (!strcmp(pkt, "qsThreadInfo")) {
+        strcpy(reply, "l");
+    } else if (!strncmp(pkt, "qThreadExtraInfo,", 17)) {
+        struct gdb_core *core = find_core(srv, strtoul(pkt + 17, NULL, 16));
+        if (!core) {
+            strcpy(reply, "E00");
+            return;
+        }
+        char info[32];
+        snprintf(info, sizeof(info), "CDM %u", core->cdm_desc.di_addr);
+        bin2hex(reply, (const uint8_t *)info, strlen(info));
+    }
+}
+
+/**
+ * Handle a packet and build the reply
+ *
+ * @return false if the session should end
+ */
+static bool handle_packet(struct gdb_server *srv, char *pkt, char *reply)
+{
+    osd_result rv;
+    struct gdb_core *core = srv->g_core;
+    reply[0] = '\0';
+
+    switch (pkt[0]) {
+    case '?':
+        stop_reply(srv, reply, GDB_SIGTRAP);
+        break;
+
+    case 'g': {
+        rv = regs_fetch(srv, core);
+        if (OSD_FAILED(rv)) {
+            strcpy(reply, "E01");
+            break;
+        }
+        for (unsigned int i = 0; i < OR1K_NUM_REGS; i++) {
+            reg2hex(reply + 8 * i, core->regs[i]);
+        }
+        break;
+    }
+
+    case 'G': {
+        uint32_t regs[OR1K_NUM_REGS];
+        bool ok = strlen(pkt + 1) >= 8 * OR1K_NUM_REGS;
+        for (unsigned int i = 0; ok && i < OR1K_NUM_REGS; i++) {
+            ok = hex2reg(&regs[i], pkt + 1 + 8 * i);
+        }
+        if (!ok) {
+            strcpy(reply, "E00");
+            break;
+        }
+        rv = regs_store(srv, core, regs);
+        strcpy(reply, OSD_SUCCEEDED(rv) ? "OK" : "E01");
+        break;
+    }
+
+    case 'p': {
+        unsigned long regno = strtoul(pkt + 1, NULL, 16);
+        if (regno >= OR1K_NUM_REGS) {
+            strcpy(reply, "E00");
+            break;
+        }
+        rv = regs_fetch(srv, core);
+        if (OSD_FAILED(rv)) {
+            strcpy(reply, "E01");
+            break;
+        }
+        reg2hex(reply, core->regs[regno]);
+        break;
+    }
+
+    case 'P': {
+        char *end;
+        unsigned long regno = strtoul(pkt + 1, &end, 16);
+        uint32_t val;
+        if (regno >= OR1K_NUM_REGS || *end != '=' || !hex2reg(&val, end + 1)) {
+            strcpy(reply, "E00");
+            break;
+        }
+        rv = reg_store(srv, core, regno, val);
+        strcpy(reply, OSD_SUCCEEDED(rv) ? "OK" : "E01");
+        break;
+    }
+
+    case 'm': {
+        char *end;
+        uint64_t addr = strtoull(pkt + 1, &end, 16);
+        size_t len = *end == ',' ? strtoul(end + 1, NULL, 16) : 0;
+        if (*end != ',' || len == 0 || len > (RSP_PACKET_MAX - 1) / 2) {
+            strcpy(reply, "E00");
+            break;
+        }
+        uint8_t *data = malloc(len);
+        assert(data);
+        rv = mem_read(srv, addr, len, data);
+        if (OSD_SUCCEEDED(rv)) {
+            bin2hex(reply, data, len);
+        } else {
+            strcpy(reply, "E01");
+        }
+        free(data);
+        break;
+    }
+
+    case 'M': {
+        char *end;
+        uint64_t addr = strtoull(pkt + 1, &end, 16);
+        size_t len = *end == ',' ? strtoul(end + 1, &end, 16) : 0;
+        if (*end != ':' || strlen(end + 1) < 2 * len) {
+            strcpy(reply, "E00");
+            break;
+        }
+        uint8_t *data = malloc(len ? len : 1);
+        assert(data);
+        if (!hex2bin(data, end + 1, len)) {
+            strcpy(reply, "E00");
+        } else {
+            rv = mem_write(srv, addr, len, data);
+            strcpy(reply, OSD_SUCCEEDED(rv) ? "OK" : "E01");
+        }
+        free(data);
+        break;
+    }
+
+    case 'c':
+    case 's': {
+        // stepping applies to the thread selected with Hc, continuing
+        // resumes all threads
+        struct gdb_core *resume_core = srv->c_core ? srv->c_core : core;
+        if (pkt[1]) {
+            // continue at address: set the next PC
+            rv = reg_store(srv, resume_core, OR1K_REGNUM_NPC,
+                           strtoul(pkt + 1, NULL, 16));
+            if (OSD_FAILED(rv)) {
+                strcpy(reply, "E01");
+                break;
+            }
+        }
+        int signal;
+        if (!run_until_stop(srv, pkt[0] == 's' ? resume_core : NULL,
+                            &signal)) {
+            return false;
+        }
+        stop_reply(srv, reply, signal);
+        break;
+    }
+
+    case 'Z':
+    case 'z': {
+        char *end;
+        if (pkt[1] != '0' || pkt[2] != ',') {
+            // only software breakpoints are supported
+            break;
+        }
+        uint64_t addr = strtoull(pkt + 3, &end, 16);
+        rv = pkt[0] == 'Z' ? breakpoint_insert(srv, addr)
+                           : breakpoint_remove(srv, addr);
+        strcpy(reply, OSD_SUCCEEDED(rv) ? "OK" : "E01");
+        break;
+    }
+
+    case 'H':
+        strcpy(reply, select_thread(srv, pkt) ? "OK" : "E01");
+        break;
+
+    case 'T':
+        strcpy(reply, find_core(srv, strtoul(pkt + 1, NULL, 16)) ? "OK"
+                                                                 : "E01");
+        break;
+
+    case 'D':
+        breakpoints_remove_all(srv);
+        rv = cores_resume(srv, NULL);
+        if (OSD_FAILED(rv)) {
+            err("Unable to resume (%d)", rv);
+        }
+        rsp_put_packet(srv, "OK");
+        return false;
+
+    case 'k':
+        return false;
+
+    case 'q':
+        handle_query(srv, pkt, reply);
+        break;
+
+    case 'Q':
+        if (!strcmp(pkt, "QStartNoAckMode")) {
+            // acknowledged in ack mode, no acks from the next packet on
+            rsp_put_packet(srv, "OK");
+            srv->no_ack = true;
+            return true;
+        }
+        break;
+
+    default:
+        // unsupported packets are answered with an empty reply
+        break;
+    }
+
+    return rsp_put_packet(srv, reply);
+}
+
+static void serve_connection(struct gdb_server *srv)
+{
+    osd_result rv;
+
+    srv->no_ack = false;
+    srv->rxbuf_pos = srv->rxbuf_len = 0;
+    srv->num_breakpoints = 0;
+    srv->g_core = srv->stop_core = &srv->cores[0];
+    srv->c_core = NULL;
+
+    rv = cores_halt(srv);
+    if (OSD_FAILED(rv)) {
+        err("Unable to halt the cores (%d)", rv);
+        return;
+    }
+    // let software breakpoints (l.trap) stall the cores
+    for (size_t i = 0; i < srv->num_cores; i++) {
+        rv = spr_modify(srv, &srv->cores[i], OR1K_SPR_DSR, OR1K_DSR_TE, 0);
+        if (OSD_FAILED(rv)) {
+            err("Core %zu: unable to enable trap handling (%d)", i, rv);
+        }
+    }
+
+    char *pkt = malloc(RSP_PACKET_MAX);
+    char *reply = malloc(RSP_PACKET_MAX + 1);
+    assert(pkt && reply);
+
+    while (rsp_get_packet(srv, pkt)) {
+        if (!handle_packet(srv, pkt, reply)) {
+            break;
+        }
+    }
+
+    // GDB went away without detaching (connection lost, 'k'): restore the
+    // original instructions, they are forgotten with the next connection
+    breakpoints_remove_all(srv);
+
+    free(pkt);
+    free(reply);
+}
+
+/**
+ * Accept GDB connections until the tool is interrupted
+ */
+static void serve(struct gdb_server *srv, uint16_t port)
+{
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert(listen_fd >= 0);
+    int one = 1;
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    struct sockaddr_in sa = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    if (bind(listen_fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 ||
+        listen(listen_fd, 1) < 0) {
+        err("Unable to listen on port %u: %s", port, strerror(errno));
+        close(listen_fd);
+        return;
+    }
+    info("Waiting for GDB on port %u", port);
+
+    while (!zsys_interrupted) {
+        struct pollfd pfd = { .fd = listen_fd, .events = POLLIN };
+        if (poll(&pfd, 1, POLL_INTERVAL_MS) <= 0) {
+            continue;
+        }
+        srv->fd = accept(listen_fd, NULL, NULL);
+        if (srv->fd < 0) {
+            continue;
+        }
+        setsockopt(srv->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        info("GDB connected");
+
+        serve_connection(srv);
+
+        close(srv->fd);
+        srv->fd = -1;
+        info("GDB disconnected");
+    }
+
+    close(listen_fd);
+}
+
+static bool is_module(const struct osd_module_desc *mod, unsigned int type)
+{
+    return mod->vendor == OSD_MODULE_VENDOR_OSD && mod->type == type &&
+           mod->version == 0;
+}
+
+/**
+ * Find the CDMs and MAMs in the device
+ */
+static osd_result discover(struct osd_hostmod_ctx *hostmod_ctx,
+                           unsigned int **cdm_addrs, size_t *num_cdms)
+{
+    osd_result rv;
+    struct osd_module_desc *mods;
+    size_t num_mods;
+
+    rv = osd_hostmod_get_modules(hostmod_ctx, DEVICE_SUBNET_ADDRESS, &mods,
+                                 &num_mods);
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
+
+    *cdm_addrs = calloc(num_mods ? num_mods : 1, sizeof(unsigned int));
+    mems = calloc(num_mods ? num_mods : 1, sizeof(struct osd_mem_desc));
+    assert(*cdm_addrs && mems);
+    *num_cdms = 0;
+    num_mems = 0;
+
+    for (size_t i = 0; i < num_mods; i++) {
+        if (is_module(&mods[i], OSD_MODULE_TYPE_STD_CDM)) {
+            (*cdm_addrs)[(*num_cdms)++] = mods[i].addr;
+        } else if (is_module(&mods[i], OSD_MODULE_TYPE_STD_MAM)) {
+            rv = osd_cl_mam_get_mem_desc(hostmod_ctx, mods[i].addr,
+                                         &mems[num_mems]);
+            if (OSD_FAILED(rv)) {
+                err("Unable to describe memory at MAM %u (%d)", mods[i].addr,
+                    rv);
+                continue;
+            }
+            num_mems++;
+        }
+    }
+    free(mods);
+
+    return OSD_OK;
+}
+
+int run(void)
+{
+    osd_result rv;
+    int exitcode = 0;
+    struct gdb_server srv = { .fd = -1, .event_pipe = { -1, -1 } };
+    unsigned int *cdm_addrs = NULL;
+
+    zsys_init();
+
+    rv = osd_log_new(&osd_log_ctx, cfg.log_level, &osd_log_handler);
+    assert(OSD_SUCCEEDED(rv));
+
+    for (unsigned int i = 0; i < 32; i++) {
+        or1k_reg_addrs[i] = OR1K_SPR_GPR(i);
+    }
+    or1k_reg_addrs[32] = OR1K_SPR_PPC;
+    or1k_reg_addrs[OR1K_REGNUM_NPC] = OR1K_SPR_NPC;
+    or1k_reg_addrs[34] = OR1K_SPR_SR;
+
+    rv = osd_hostmod_new(&srv.hostmod_ctx, osd_log_ctx,
+                         a_hostctrl_ep->sval[0], NULL, NULL);
+    assert(OSD_SUCCEEDED(rv));
+    rv = osd_hostmod_connect(srv.hostmod_ctx);
+    if (OSD_FAILED(rv)) {
+        fatal("Unable to connect to host controller at %s (%d)",
+              a_hostctrl_ep->sval[0], rv);
+        exitcode = 1;
+        goto free_return;
+    }
+
+    rv = discover(srv.hostmod_ctx, &cdm_addrs, &srv.num_cores);
+    if (OSD_FAILED(rv)) {
+        fatal("Unable to enumerate the debug modules (%d)", rv);
+        exitcode = 1;
+        goto free_return;
+    }
+    if (srv.num_cores == 0) {
+        fatal("No CPU cores with a Core Debug Module (CDM) found.");
+        exitcode = 1;
+        goto free_return;
+    }
+    info("Found %zu cores and %zu memories", srv.num_cores, num_mems);
+
+    rv = osd_runctrl_new(&runctrl_ctx, osd_log_ctx, a_hostctrl_ep->sval[0]);
+    assert(OSD_SUCCEEDED(rv));
+    rv = osd_runctrl_connect(runctrl_ctx);
+    if (OSD_FAILED(rv)) {
+        fatal("Unable to connect to host controller at %s (%d)",
+              a_hostctrl_ep->sval[0], rv);
+        exitcode = 1;
+        goto free_return;
+    }
+
+    int irv = pipe(srv.event_pipe);
+    assert(irv == 0);
+    fcntl(srv.event_pipe[0], F_SETFL, O_NONBLOCK);
+    // never block the I/O thread of the run control in stall_handler(),
+    // e.g. while no GDB is connected to drain the pipe
+    fcntl(srv.event_pipe[1], F_SETFL, O_NONBLOCK);
+    osd_runctrl_set_stall_handler(runctrl_ctx, stall_handler, &srv);
+
+    rv = osd_runctrl_add_cores(runctrl_ctx, cdm_addrs, srv.num_cores);
+    if (OSD_FAILED(rv)) {
+        fatal("Unable to set up the Core Debug Modules (%d)", rv);
+        exitcode = 1;
+        goto free_return;
+    }
+
+    srv.cores = calloc(srv.num_cores, sizeof(struct gdb_core));
+    assert(srv.cores);
+    for (unsigned int i = 0; i < srv.num_cores; i++) {
+        struct gdb_core *core = &srv.cores[i];
+        core->idx = i;
+        core->cdm_desc = *osd_runctrl_get_cdm_desc(runctrl_ctx, i);
+        if (core->cdm_desc.core_data_width != 32) {
+            fatal("Core %u: %u bit cores are not supported.", i,
+                  core->cdm_desc.core_data_width);
+            exitcode = 1;
+            goto free_return;
+        }
+        info("Core %u (CDM %u): GDB thread %u", i, core->cdm_desc.di_addr,
+             core_tid(core));
+    }
+    if (!a_no_mem_cache->count) {
+        srv.pages = calloc(MEM_CACHE_PAGES, sizeof(struct mem_page));
+        assert(srv.pages);
+    }
+
+    serve(&srv, a_port->ival[0]);
+
+free_return:
+    if (runctrl_ctx) {
+        osd_runctrl_set_stall_handler(runctrl_ctx, NULL, NULL);
+        if (osd_runctrl_is_connected(runctrl_ctx)) {
+            osd_runctrl_disconnect(runctrl_ctx);
+        }
+        osd_runctrl_free(&runctrl_ctx);
+    }
+    if (srv.event_pipe[0] >= 0) {
+        close(srv.event_pipe[0]);
+        close(srv.event_pipe[1]);
+    }
+    free(srv.cores);
+    free(srv.pages);
+    free(cdm_addrs);
+    free(mems);
+    if (srv.hostmod_ctx) {
+        if (osd_hostmod_is_connected(srv.hostmod_ctx)) {
+            osd_hostmod_disconnect(srv.hostmod_ctx);
+        }
+        osd_hostmod_free(&srv.hostmod_ctx);
+    }
+    osd_log_free(&osd_log_ctx);
+    return exitcode;
+}
@@ -0,0 +1,748 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Load generator for a host controller
+ *
+ * Simulated host modules (clients) and simulated gateways (devices) are
+ * spread across one or more worker processes and connect to a host
+ * controller. Every client runs in its own thread and generates traffic to a
+ * device behind one of the gateways:
+ *
+ * - reg: register reads, answered by the device
+ * - event: event packets, echoed back by the device to the sender
+ * - mixed: alternating register reads and events
+ *
+ * At the end the throughput, the latency distribution and the fairness
+ * between the clients (Jain's fairness index of the operations per client)
+ * are reported.
+ *
+ * The worker processes are forked before ZeroMQ is initialized; the main
+ * process coordinates them over pipes and runs the host controller, unless
+ * the endpoint of an existing one is given.
+ */
+
+#define CLI_TOOL_PROGNAME "osd-hostctrl-loadgen"
+#define CLI_TOOL_SHORTDESC "Generate load on a host controller"
+
+#include <osd/gateway.h>
+#include <osd/hostctrl.h>
+#include <osd/hostmod.h>
+#include <osd/latency.h>
+#include <osd/packet.h>
+#include "../cli-util.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+
+/** Host controller endpoint if no external host controller is used */
+#define LOCAL_HOSTCTRL_EP_FMT "ipc:///tmp/osd-hostctrl-loadgen.%d"
+
+/** Local address of the simulated debug module in every device */
+#define DEVICE_MODULE_LOCALADDR 1
+
+/** Subnet of the host modules (assigned by the host controller) */
+#define HOST_SUBNET_ADDRESS 1
+
+/** Commands from the main process to the worker processes */
+#define CMD_CONNECT 'c'
+#define CMD_START 's'
+#define CMD_QUIT 'q'
+
+enum traffic_pattern {
+    PATTERN_REG,
+    PATTERN_EVENT,
+    PATTERN_MIXED,
+};
+
+// command line arguments
+struct arg_str *a_hostctrl_ep;
+struct arg_int *a_hostmods;
+struct arg_int *a_gateways;
+struct arg_int *a_processes;
+struct arg_int *a_duration;
+struct arg_str *a_pattern;
+struct arg_int *a_rate;
+
+/** Settings shared by all processes */
+static struct {
+    char hostctrl_ep[128];
+    unsigned int num_hostmods;
+    unsigned int num_gateways;
+    unsigned int num_processes;
+    unsigned int duration_s;
+    enum traffic_pattern pattern;
+    unsigned int rate;
+} lg;
+
+/**
+ * A simulated gateway and the device behind it
+ */
+struct sim_gateway {
+    unsigned int subnet;
+    struct osd_gateway_ctx *gateway_ctx;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    zlist_t *responses; //!< packets to be sent to the host
+    bool connected;
+};
+
+/**
+ * A simulated host module
+ */
+struct sim_client {
+    unsigned int idx; //!< index of the client across all processes
+    uint16_t target; //!< DI address of the device module to talk to
+    struct osd_hostmod_ctx *hostmod_ctx;
+    uint64_t deadline_ns;
+
+    uint64_t ops;
+    uint64_t errors;
+    struct osd_latency_hist hist;
+};
+
+/**
+ * Result of a single client, sent from a worker to the main process
+ */
+struct client_result {
+    uint32_t idx;
+    uint64_t ops;
+    uint64_t errors;
+};
+
+/**
+ * Header of the results of a worker process
+ */
+struct proc_result {
+    uint32_t num_clients;
+    double elapsed_s;
+    struct osd_latency_hist hist;
+};
+
+static osd_result write_all(int fd, const void *buf, size_t len)
+{
+    const uint8_t *p = buf;
+    while (len) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return OSD_ERROR_FAILURE;
+        }
+        p += n;
+        len -= n;
+    }
+    return OSD_OK;
+}
+
+static osd_result read_all(int fd, void *buf, size_t len)
+{
+    uint8_t *p = buf;
+    while (len) {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return OSD_ERROR_FAILURE;
+        }
+        p += n;
+        len -= n;
+    }
+    return OSD_OK;
+}
+
+/**
+ * Subnet address of a gateway, skipping the subnet of the host modules
+ */
+static unsigned int gateway_subnet(unsigned int gateway_idx)
+{
+    return gateway_idx < HOST_SUBNET_ADDRESS ? gateway_idx : gateway_idx + 1;
+}
+
+static osd_result sim_device_read(struct osd_packet **pkg, void *cb_arg)
+{
+    struct sim_gateway *gw = cb_arg;
+
+    pthread_mutex_lock(&gw->lock);
+    while (gw->connected && zlist_size(gw->responses) == 0) {
+        pthread_cond_wait(&gw->cond, &gw->lock);
+    }
+    if (!gw->connected) {
+        pthread_mutex_unlock(&gw->lock);
+        return OSD_ERROR_NOT_CONNECTED;
+    }
+    *pkg = zlist_pop(gw->responses);
+    pthread_mutex_unlock(&gw->lock);
+
+    return OSD_OK;
+}
+
+/**
+ * Simulated device: answer register reads with the register address, and
+ * echo event packets back to their sender
+ */
+static osd_result sim_device_write(const struct osd_packet *pkg, void *cb_arg)
+{
+    osd_result rv;
+    struct sim_gateway *gw = cb_arg;
+    struct osd_packet *resp;
+
+    if (osd_packet_get_type(pkg) == OSD_PACKET_TYPE_REG &&
+        osd_packet_get_type_sub(pkg) == REQ_READ_REG_16) {
+        rv = osd_packet_new(&resp, osd_packet_sizeconv_payload2data(1));
+        assert(OSD_SUCCEEDED(rv));
+        osd_packet_set_header(resp, osd_packet_get_src(pkg),
+                              osd_packet_get_dest(pkg), OSD_PACKET_TYPE_REG,
+                              RESP_READ_REG_SUCCESS_16);
+        resp->data.payload[0] = pkg->data.payload[0];
+    } else if (osd_packet_get_type(pkg) == OSD_PACKET_TYPE_EVENT) {
+        rv = osd_packet_new(&resp, pkg->data_size_words);
+        assert(OSD_SUCCEEDED(rv));
+        memcpy(&resp->data, &pkg->data,
+               pkg->data_size_words * sizeof(uint16_t));
+        osd_packet_set_header(resp, osd_packet_get_src(pkg),
+                              osd_packet_get_dest(pkg), OSD_PACKET_TYPE_EVENT,
+                              osd_packet_get_type_sub(pkg));
+    } else {
+        return OSD_OK;
+    }
+
+    pthread_mutex_lock(&gw->lock);
+    zlist_append(gw->responses, resp);
+    pthread_cond_signal(&gw->cond);
+    pthread_mutex_unlock(&gw->lock);
+
+    return OSD_OK;
+}
+
+static osd_result sim_gateway_connect(struct sim_gateway *gw,
+                                      struct osd_log_ctx *log_ctx)
+{
+    osd_result rv;
+
+    pthread_mutex_init(&gw->lock, NULL);
+    pthread_cond_init(&gw->cond, NULL);
+    gw->responses = zlist_new();
+    assert(gw->responses);
+    gw->connected = true;
+
+    rv = osd_gateway_new(&gw->gateway_ctx, log_ctx, lg.hostctrl_ep,
+                         gw->subnet, sim_device_read, sim_device_write, gw);
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
+    return osd_gateway_connect(gw->gateway_ctx);
+}
+
+static void sim_gateway_free(struct sim_gateway *gw)
+{
+    pthread_mutex_lock(&gw->lock);
+    gw->connected = false;
+    pthread_cond_signal(&gw->cond);
+    pthread_mutex_unlock(&gw->lock);
+
+    if (gw->gateway_ctx && osd_gateway_is_connected(gw->gateway_ctx)) {
+        osd_gateway_disconnect(gw->gateway_ctx);
+    }
+    osd_gateway_free(&gw->gateway_ctx);
+
+    while (zlist_size(gw->responses)) {
+        struct osd_packet *pkg = zlist_pop(gw->responses);
+        osd_packet_free(&pkg);
+    }
+    zlist_destroy(&gw->responses);
+    pthread_cond_destroy(&gw->cond);
+    pthread_mutex_destroy(&gw->lock);
+}
+
+static osd_result client_reg_read(struct sim_client *c)
+{
+    osd_result rv;
+    uint16_t reg_addr = 0x200 + c->ops % 0x100;
+    uint16_t reg_val;
+
+    rv = osd_hostmod_reg_read(c->hostmod_ctx, &reg_val, c->target, reg_addr,
+                              16, 0);
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
+    return reg_val == reg_addr ? OSD_OK : OSD_ERROR_FAILURE;
+}
+
+static osd_result client_event_echo(struct sim_client *c,
+                                    struct osd_packet *event)
+{
+    osd_result rv;
+
+    event->data.payload[0] = c->ops & 0xffff;
+    rv = osd_hostmod_event_send(c->hostmod_ctx, event);
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
+
+    struct osd_packet *echo;
+    rv = osd_hostmod_event_receive(c->hostmod_ctx, &echo, 0);
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
+    bool ok = (echo->data.payload[0] == event->data.payload[0]);
+    osd_packet_free(&echo);
+    return ok ? OSD_OK : OSD_ERROR_FAILURE;
+}
+
+static void *client_thread(void *arg)
+{
+    osd_result rv;
+    struct sim_client *c = arg;
+
+    struct osd_packet *event;
+    rv = osd_packet_new(&event, osd_packet_sizeconv_payload2data(4));
+    assert(OSD_SUCCEEDED(rv));
+    osd_packet_set_header(event, c->target,
+                          osd_hostmod_get_diaddr(c->hostmod_ctx),
+                          OSD_PACKET_TYPE_EVENT, 0);
+    memset(event->data.payload, 0, 4 * sizeof(uint16_t));
+
+    uint64_t t_start = osd_latency_now();
+    uint64_t num_started = 0;
+    while (!zsys_interrupted) {
+        uint64_t t = osd_latency_now();
+
+        // With a fixed rate the latency is measured from the time the
+        // operation was scheduled, not from when it was actually started, to
+        // include the time spent waiting behind a slow operation.
+        if (lg.rate) {
+            uint64_t t_sched = t_start + num_started * 1000000000ull / lg.rate;
+            if (t_sched > t) {
+                struct timespec ts = {
+                    .tv_sec = (t_sched - t) / 1000000000ull,
+                    .tv_nsec = (t_sched - t) % 1000000000ull,
+                };
+                nanosleep(&ts, NULL);
+            }
+            t = t_sched;
+        }
+        if (t >= c->deadline_ns) {
+            break;
+        }
+        num_started++;
+
+        bool reg = (lg.pattern == PATTERN_REG ||
+                    (lg.pattern == PATTERN_MIXED && num_started % 2));
+        if (reg) {
+            rv = client_reg_read(c);
+        } else {
+            rv = client_event_echo(c, event);
+        }
+        if (OSD_FAILED(rv)) {
+            c->errors++;
+            continue;
+        }
+        osd_latency_hist_add(&c->hist, osd_latency_now() - t);
+        c->ops++;
+    }
+
+    osd_packet_free(&event);
+    return NULL;
+}
+
+/**
+ * Run the gateways and clients of one worker process
+ *
+ * @param proc_idx index of this worker process
+ * @param cmd_fd pipe to read commands from
+ * @param result_fd pipe to write the status and the results to
+ */
+static int run_worker(unsigned int proc_idx, int cmd_fd, int result_fd)
+{
+    osd_result rv;
+    int exitcode = 0;
+    char cmd;
+
+    // wait for the host controller to come up
+    if (OSD_FAILED(read_all(cmd_fd, &cmd, 1)) || cmd != CMD_CONNECT) {
+        return 1;
+    }
+
+    unsigned int num_gateways = 0;
+    struct sim_gateway *gateways = calloc(lg.num_gateways,
+                                          sizeof(struct sim_gateway));
+    assert(gateways);
+    unsigned int num_clients = 0;
+    struct sim_client *clients = calloc(lg.num_hostmods,
+                                        sizeof(struct sim_client));
+    assert(clients);
+    pthread_t *threads = calloc(lg.num_hostmods, sizeof(pthread_t));
+    assert(threads);
+
+    zsys_init();
+
+    struct osd_log_ctx *osd_log_ctx;
+    rv = osd_log_new(&osd_log_ctx, cfg.log_level, &osd_log_handler);
+    assert(OSD_SUCCEEDED(rv));
+
+    bool ok = true;
+    for (unsigned int g = proc_idx; g < lg.num_gateways && ok;
+         g += lg.num_processes) {
+        struct sim_gateway *gw = &gateways[num_gateways++];
+        gw->subnet = gateway_subnet(g);
+        rv = sim_gateway_connect(gw, osd_log_ctx);
+        if (OSD_FAILED(rv)) {
+            fatal("Unable to connect gateway for subnet %u (%d)", gw->subnet,
+                  rv);
+            ok = false;
+        }
+    }
+    for (unsigned int i = proc_idx; i < lg.num_hostmods && ok;
+         i += lg.num_processes) {
+        struct sim_client *c = &clients[num_clients++];
+        c->idx = i;
+        c->target = osd_diaddr_build(gateway_subnet(i % lg.num_gateways),
+                                     DEVICE_MODULE_LOCALADDR);
+        rv = osd_hostmod_new(&c->hostmod_ctx, osd_log_ctx, lg.hostctrl_ep,
+                             NULL, NULL);
+        assert(OSD_SUCCEEDED(rv));
+        rv = osd_hostmod_connect(c->hostmod_ctx);
+        if (OSD_FAILED(rv)) {
+            fatal("Unable to connect host module %u (%d)", i, rv);
+            ok = false;
+        }
+    }
+
+    // report readiness, and wait until all workers are ready
+    char status = ok ? 0 : 1;
+    rv = write_all(result_fd, &status, 1);
+    if (OSD_FAILED(rv) || !ok ||
+        OSD_FAILED(read_all(cmd_fd, &cmd, 1)) || cmd != CMD_START) {
+        exitcode = 1;
+        goto free_return;
+    }
+
+    uint64_t t_start = osd_latency_now();
+    for (unsigned int i = 0; i < num_clients; i++) {
+        clients[i].deadline_ns = t_start + lg.duration_s * 1000000000ull;
+        int irv = pthread_create(&threads[i], NULL, client_thread,
+                                 &clients[i]);
+        assert(irv == 0);
+    }
+
+    struct proc_result result = { .num_clients = num_clients };
+    for (unsigned int i = 0; i < num_clients; i++) {
+        pthread_join(threads[i], NULL);
+        osd_latency_hist_merge(&result.hist, &clients[i].hist);
+    }
+    result.elapsed_s = (osd_latency_now() - t_start) / 1e9;
+
+    rv = write_all(result_fd, &result, sizeof(result));
+    for (unsigned int i = 0; i < num_clients && OSD_SUCCEEDED(rv); i++) {
+        struct client_result cr = {
+            .idx = clients[i].idx,
+            .ops = clients[i].ops,
+            .errors = clients[i].errors,
+        };
+        rv = write_all(result_fd, &cr, sizeof(cr));
+    }
+    if (OSD_FAILED(rv)) {
+        exitcode = 1;
+    }
+
+free_return:
+    for (unsigned int i = 0; i < num_clients; i++) {
+        if (osd_hostmod_is_connected(clients[i].hostmod_ctx)) {
+            osd_hostmod_disconnect(clients[i].hostmod_ctx);
+        }
+        osd_hostmod_free(&clients[i].hostmod_ctx);
+    }
+    for (unsigned int i = 0; i < num_gateways; i++) {
+        sim_gateway_free(&gateways[i]);
+    }
+    free(threads);
+    free(clients);
+    free(gateways);
+    osd_log_free(&osd_log_ctx);
+    return exitcode;
+}
+
+/**
+ * Send a command to all worker processes
+ */
+static void send_cmd(const int *cmd_fds, unsigned int num_procs, char cmd)
+{
+    for (unsigned int p = 0; p < num_procs; p++) {
+        write_all(cmd_fds[p], &cmd, 1);
+    }
+}
+
+static void report(const struct osd_latency_hist *hist,
+                   const struct client_result *clients, double elapsed_s)
+{
+    uint64_t ops = 0, errors = 0;
+    uint64_t ops_min = UINT64_MAX, ops_max = 0;
+    double sum_sq = 0;
+    for (unsigned int i = 0; i < lg.num_hostmods; i++) {
+        ops += clients[i].ops;
+        errors += clients[i].errors;
+        if (clients[i].ops < ops_min) ops_min = clients[i].ops;
+        if (clients[i].ops > ops_max) ops_max = clients[i].ops;
+        sum_sq += (double)clients[i].ops * clients[i].ops;
+    }
+
+    // Jain's fairness index: 1 if all clients got the same share,
+    // 1/num_hostmods if a single client got everything
+    double fairness = sum_sq ? (double)ops * ops / (lg.num_hostmods * sum_sq)
+                             : 0;
+
+    printf("%u host modules, %u gateways, %u processes, %.1f s\n",
+           lg.num_hostmods, lg.num_gateways, lg.num_processes, elapsed_s);
+    printf("throughput: %" PRIu64 " operations (%" PRIu64 " errors), "
+           "%.0f operations/s\n", ops, errors, ops / elapsed_s);
+    if (hist->count) {
+        printf("latency (us): min %.1f  avg %.1f  p50 %.1f  p90 %.1f  "
+               "p99 %.1f  max %.1f\n",
+               hist->min_ns / 1e3, (double)hist->sum_ns / hist->count / 1e3,
+               osd_latency_hist_percentile(hist, 50) / 1e3,
+               osd_latency_hist_percentile(hist, 90) / 1e3,
+               osd_latency_hist_percentile(hist, 99) / 1e3,
+               hist->max_ns / 1e3);
+    }
+    printf("fairness: Jain's index %.3f, operations/s per host module: "
+           "min %.0f  avg %.0f  max %.0f\n",
+           fairness, ops_min / elapsed_s,
+           ops / elapsed_s / lg.num_hostmods, ops_max / elapsed_s);
+}
+
+osd_result setup(void)
+{
+    a_hostctrl_ep = arg_str0("e", "hostctrl", "<URL>",
+                             "ZeroMQ endpoint of an existing host controller "
+                             "(default: start a host controller)");
+    osd_tool_add_arg(a_hostctrl_ep);
+
+    a_hostmods = arg_int0("n", "hostmods", "<N>",
+                          "number of simulated host modules (default: 16)");
+    a_hostmods->ival[0] = 16;
+    osd_tool_add_arg(a_hostmods);
+
+    a_gateways = arg_int0("g", "gateways", "<N>",
+                          "number of simulated gateways (default: 1)");
+    a_gateways->ival[0] = 1;
+    osd_tool_add_arg(a_gateways);
+
+    a_processes = arg_int0("P", "processes", "<N>",
+                           "number of processes to spread the host modules "
+                           "and gateways across (default: 1)");
+    a_processes->ival[0] = 1;
+    osd_tool_add_arg(a_processes);
+
+    a_duration = arg_int0("t", "duration", "<s>",
+                          "duration of the measurement (default: 10)");
+    a_duration->ival[0] = 10;
+    osd_tool_add_arg(a_duration);
+
+    a_pattern = arg_str0(NULL, "pattern", "<reg|event|mixed>",
+                         "traffic generated by every host module "
+                         "(default: reg)");
+    a_pattern->sval[0] = "reg";
+    osd_tool_add_arg(a_pattern);
+
+    a_rate = arg_int0(NULL, "rate", "<N>",
+                      "operations/s per host module (default: 0, as fast as "
+                      "possible)");
+    a_rate->ival[0] = 0;
+    osd_tool_add_arg(a_rate);
+
+    return OSD_OK;
+}
+
+int run(void)
+{
+    osd_result rv;
+    int exitcode = 0;
+    struct osd_log_ctx *osd_log_ctx = NULL;
+    struct osd_hostctrl_ctx *hostctrl_ctx = NULL;
+    unsigned int num_started = 0;
+
+    if (a_hostmods->ival[0] <= 0 ||
+        a_hostmods->ival[0] > OSD_DIADDR_LOCAL_MAX ||
+        a_gateways->ival[0] <= 0 ||
+        a_gateways->ival[0] > OSD_DIADDR_SUBNET_MAX ||
+        a_processes->ival[0] <= 0 || a_duration->ival[0] <= 0 ||
+        a_rate->ival[0] < 0) {
+        fatal("Invalid number of host modules, gateways, processes, duration "
+              "or rate.");
+        return 1;
+    }
+    lg.num_hostmods = a_hostmods->ival[0];
+    lg.num_gateways = a_gateways->ival[0];
+    lg.num_processes = a_processes->ival[0];
+    lg.duration_s = a_duration->ival[0];
+    lg.rate = a_rate->ival[0];
+    if (!strcmp(a_pattern->sval[0], "reg")) {
+        lg.pattern = PATTERN_REG;
+    } else if (!strcmp(a_pattern->sval[0], "event")) {
+        lg.pattern = PATTERN_EVENT;
+    } else if (!strcmp(a_pattern->sval[0], "mixed")) {
+        lg.pattern = PATTERN_MIXED;
+    } else {
+        fatal("Unknown traffic pattern %s.", a_pattern->sval[0]);
+        return 1;
+    }
+    if (a_hostctrl_ep->count) {
+        snprintf(lg.hostctrl_ep, sizeof(lg.hostctrl_ep), "%s",
+                 a_hostctrl_ep->sval[0]);
+    } else {
+        snprintf(lg.hostctrl_ep, sizeof(lg.hostctrl_ep),
+                 LOCAL_HOSTCTRL_EP_FMT, (int)getpid());
+    }
+
+    int *cmd_fds = calloc(lg.num_processes, sizeof(int));
+    assert(cmd_fds);
+    int *result_fds = calloc(lg.num_processes, sizeof(int));
+    assert(result_fds);
+    pid_t *pids = calloc(lg.num_processes, sizeof(pid_t));
+    assert(pids);
+    struct client_result *clients = calloc(lg.num_hostmods,
+                                           sizeof(struct client_result));
+    assert(clients);
+
+    // Fork the workers before ZeroMQ (and its threads) are initialized
+    fflush(stdout);
+    fflush(stderr);
+    for (unsigned int p = 0; p < lg.num_processes; p++) {
+        int cmd_pipe[2], result_pipe[2];
+        if (pipe(cmd_pipe) || pipe(result_pipe)) {
+            fatal("Unable to create pipes: %s", strerror(errno));
+            exitcode = 1;
+            goto free_return;
+        }
+        pids[p] = fork();
+        if (pids[p] < 0) {
+            fatal("Unable to fork: %s", strerror(errno));
+            exitcode = 1;
+            goto free_return;
+        }
+        if (pids[p] == 0) {
+            close(cmd_pipe[1]);
+            close(result_pipe[0]);
+            for (unsigned int i = 0; i < p; i++) {
+                close(cmd_fds[i]);
+                close(result_fds[i]);
+            }
+            _exit(run_worker(p, cmd_pipe[0], result_pipe[1]));
+        }
+        close(cmd_pipe[0]);
+        close(result_pipe[1]);
+        cmd_fds[p] = cmd_pipe[1];
+        result_fds[p] = result_pipe[0];
+        num_started++;
+    }
+
+    // workers which failed are gone, don't die writing to their pipes
+    signal(SIGPIPE, SIG_IGN);
+
+    zsys_init();
+
+    rv = osd_log_new(&osd_log_ctx, cfg.log_level, &osd_log_handler);
+    assert(OSD_SUCCEEDED(rv));
+
+    if (!a_hostctrl_ep->count) {
+        rv = osd_hostctrl_new(&hostctrl_ctx, osd_log_ctx, lg.hostctrl_ep);
+        assert(OSD_SUCCEEDED(rv));
+        rv = osd_hostctrl_start(hostctrl_ctx);
+        if (OSD_FAILED(rv)) {
+            fatal("Unable to start host controller at %s (%d)",
+                  lg.hostctrl_ep, rv);
+            exitcode = 1;
+            goto free_return;
+        }
+    }
+    info("Connecting %u host modules and %u gateways to %s", lg.num_hostmods,
+         lg.num_gateways, lg.hostctrl_ep);
+
+    send_cmd(cmd_fds, num_started, CMD_CONNECT);
+    bool ok = true;
+    for (unsigned int p = 0; p < lg.num_processes; p++) {
+        char status;
+        if (OSD_FAILED(read_all(result_fds[p], &status, 1)) || status != 0) {
+            ok = false;
+        }
+    }
+    if (!ok) {
+        exitcode = 1;
+        goto free_return;
+    }
+
+    info("Generating %s traffic for %u s", a_pattern->sval[0],
+         lg.duration_s);
+    send_cmd(cmd_fds, num_started, CMD_START);
+
+    struct osd_latency_hist hist = { 0 };
+    double elapsed_s = 0;
+    for (unsigned int p = 0; p < lg.num_processes; p++) {
+        struct proc_result result;
+        rv = read_all(result_fds[p], &result, sizeof(result));
+        for (unsigned int i = 0; OSD_SUCCEEDED(rv) && i < result.num_clients;
+             i++) {
+            struct client_result cr;
+            rv = read_all(result_fds[p], &cr, sizeof(cr));
+            if (OSD_SUCCEEDED(rv)) {
+                assert(cr.idx < lg.num_hostmods);
+                clients[cr.idx] = cr;
+            }
+        }
+        if (OSD_FAILED(rv)) {
+            fatal("Lost worker process %u", p);
+            exitcode = 1;
+            goto free_return;
+        }
+        osd_latency_hist_merge(&hist, &result.hist);
+        if (result.elapsed_s > elapsed_s) {
+            elapsed_s = result.elapsed_s;
+        }
+    }
+
+    report(&hist, clients, elapsed_s);
+
+free_return:
+    // workers waiting for a command quit, all others are done already
+    send_cmd(cmd_fds, num_started, CMD_QUIT);
+    for (unsigned int p = 0; p < num_started; p++) {
+        close(cmd_fds[p]);
+        close(result_fds[p]);
+        int status;
+        waitpid(pids[p], &status, 0);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            exitcode = 1;
+        }
+    }
+
+    if (hostctrl_ctx && osd_hostctrl_is_running(hostctrl_ctx)) {
+        osd_hostctrl_stop(hostctrl_ctx);
+    }
+    osd_hostctrl_free(&hostctrl_ctx);
+    osd_log_free(&osd_log_ctx);
+    free(clients);
+    free(pids);
+    free(result_fds);
+    free(cmd_fds);
+    return exitcode;
+}
@@ -0,0 +1,401 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Measure the register access latency and throughput of a debug system
+ *
+ * A register of a debug module is read repeatedly through a host controller,
+ * either sequentially (one blocking access at a time) or pipelined: a fixed
+ * number of asynchronous accesses is kept in flight on a single host module,
+ * and a new access is started as soon as one completes.
+ */
+
+#define CLI_TOOL_PROGNAME "osd-ping"
+#define CLI_TOOL_SHORTDESC "Measure register access latency"
+
+#include <osd/hostmod.h>
+#include <osd/reg.h>
+#include "../cli-util.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * Default number of concurrent accesses in pipelined mode
+ */
+#define DEFAULT_CONCURRENCY 8
+
+/**
+ * Time without any response after which the accesses in flight are aborted
+ * in pipelined mode (same as the timeout of a blocking access)
+ */
+#define PIPELINED_TIMEOUT_MS 1000
+
+// command line arguments
+struct arg_str *a_hostctrl_ep;
+struct arg_int *a_module;
+struct arg_int *a_register;
+struct arg_int *a_count;
+struct arg_lit *a_pipelined;
+struct arg_int *a_concurrency;
+struct arg_int *a_busy_poll;
+
+struct ping_ctx {
+    struct osd_hostmod_ctx *hostmod_ctx;
+    uint16_t diaddr;
+    uint16_t reg_addr;
+
+    /** Number of accesses not started yet */
+    int64_t remaining;
+    /** Number of accesses in flight (pipelined mode) */
+    unsigned int in_flight;
+    /** Do not start any more accesses (pipelined mode) */
+    bool stop;
+    /** Time the last access completed (pipelined mode, ns) */
+    uint64_t t_last_done;
+
+    uint64_t *samples; //!< latency of all successful accesses (ns)
+    size_t num_samples;
+    size_t alloc_samples;
+    size_t errors;
+};
+
+/**
+ * An access kept in flight in pipelined mode
+ */
+struct ping_slot {
+    struct ping_ctx *ping;
+    struct osd_hostmod_reg_access acc;
+    uint16_t reg_val;
+    uint64_t t_start; //!< time the request was sent (ns)
+};
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void record_access(struct ping_ctx *ping, osd_result result,
+                          uint64_t latency_ns)
+{
+    if (OSD_FAILED(result)) {
+        ping->errors++;
+        return;
+    }
+
+    if (ping->num_samples == ping->alloc_samples) {
+        ping->alloc_samples =
+            ping->alloc_samples ? ping->alloc_samples * 2 : 1024;
+        ping->samples = realloc(ping->samples,
+                                ping->alloc_samples * sizeof(uint64_t));
+        assert(ping->samples);
+    }
+    ping->samples[ping->num_samples++] = latency_ns;
+}
+
+static void run_sequential(struct ping_ctx *ping)
+{
+    while (!zsys_interrupted && ping->remaining > 0) {
+        ping->remaining--;
+
+        uint16_t reg_val;
+        uint64_t t = now_ns();
+        osd_result rv = osd_hostmod_reg_read(ping->hostmod_ctx, &reg_val,
+                                             ping->diaddr, ping->reg_addr,
+                                             16, 0);
+        record_access(ping, rv, now_ns() - t);
+    }
+}
+
+static void slot_start(struct ping_slot *slot);
+
+/**
+ * Completion callback of a pipelined access: record it and start the next
+ */
+static void slot_done(void *arg, struct osd_hostmod_reg_access *acc)
+{
+    struct ping_slot *slot = arg;
+    struct ping_ctx *ping = slot->ping;
+
+    ping->in_flight--;
+    ping->t_last_done = now_ns();
+    record_access(ping, acc->result, ping->t_last_done - slot->t_start);
+    slot_start(slot);
+}
+
+static void slot_start(struct ping_slot *slot)
+{
+    struct ping_ctx *ping = slot->ping;
+
+    if (ping->stop || zsys_interrupted || ping->remaining <= 0) {
+        return;
+    }
+    ping->remaining--;
+
+    slot->t_start = now_ns();
+    osd_result rv = osd_hostmod_reg_access_async(ping->hostmod_ctx,
+                                                 &slot->acc, slot_done, slot);
+    if (OSD_FAILED(rv)) {
+        ping->errors++;
+        return;
+    }
+    ping->in_flight++;
+}
+
+/**
+ * Keep num_slots accesses in flight until all accesses have been performed
+ *
+ * All accesses are sent and received by the calling thread through the
+ * asynchronous register access API of a single host module.
+ */
+static void run_pipelined(struct ping_ctx *ping, struct ping_slot *slots,
+                          unsigned int num_slots)
+{
+    ping->t_last_done = now_ns();
+    for (unsigned int i = 0; i < num_slots; i++) {
+        slots[i].ping = ping;
+        slots[i].acc.diaddr = ping->diaddr;
+        slots[i].acc.reg_addr = ping->reg_addr;
+        slots[i].acc.reg_size_bit = 16;
+        slots[i].acc.write = false;
+        slots[i].acc.reg_val = &slots[i].reg_val;
+        slot_start(&slots[i]);
+    }
+
+    struct pollfd pfd = {
+        .fd = osd_hostmod_get_pollfd(ping->hostmod_ctx),
+        .events = POLLIN,
+    };
+    while (ping->in_flight > 0) {
+        // The pollfd only signals changes, and sending a request can
+        // consume the signal of a response: fetch all waiting responses
+        // before waiting again.
+        osd_result rv = osd_hostmod_process(ping->hostmod_ctx, NULL, NULL);
+        if (OSD_FAILED(rv)) {
+            err("Unable to receive responses (%d)", rv);
+            break;
+        }
+        if (ping->in_flight == 0) {
+            break;
+        }
+
+        // the pollfd can also signal without a response being received
+        int64_t wait_ms = PIPELINED_TIMEOUT_MS -
+                          (int64_t)(now_ns() - ping->t_last_done) / 1000000;
+        if (wait_ms <= 0) {
+            err("No response received within %d ms, aborting %u accesses.",
+                PIPELINED_TIMEOUT_MS, ping->in_flight);
+            break;
+        }
+        int prv = poll(&pfd, 1, wait_ms);
+        if (prv < 0 && errno != EINTR) {
+            err("poll() failed: %s", strerror(errno));
+            break;
+        }
+    }
+
+    // Disconnecting aborts the accesses still in flight, which are recorded
+    // as errors.
+    ping->stop = true;
+    if (ping->in_flight > 0) {
+        osd_hostmod_disconnect(ping->hostmod_ctx);
+    }
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t va = *(const uint64_t *)a;
+    uint64_t vb = *(const uint64_t *)b;
+    return (va > vb) - (va < vb);
+}
+
+/**
+ * Get a percentile of sorted samples
+ */
+static uint64_t percentile(const uint64_t *samples, size_t num_samples,
+                           double p)
+{
+    size_t idx = (size_t)(p / 100 * num_samples + 0.5);
+    if (idx > 0) {
+        idx--;
+    }
+    if (idx >= num_samples) {
+        idx = num_samples - 1;
+    }
+    return samples[idx];
+}
+
+static void report(uint64_t *samples, size_t num_samples, size_t errors,
+                   double t_total)
+{
+    printf("%zu accesses, %zu errors, %.3f s, %.0f accesses/s\n",
+           num_samples + errors, errors, t_total, num_samples / t_total);
+    if (num_samples == 0) {
+        return;
+    }
+
+    qsort(samples, num_samples, sizeof(uint64_t), cmp_u64);
+
+    uint64_t sum = 0;
+    for (size_t i = 0; i < num_samples; i++) {
+        sum += samples[i];
+    }
+
+    printf("latency (us): min %.1f  avg %.1f  p50 %.1f  p99 %.1f  "
+           "p99.9 %.1f  max %.1f\n",
+           samples[0] / 1e3, (double)sum / num_samples / 1e3,
+           percentile(samples, num_samples, 50) / 1e3,
+           percentile(samples, num_samples, 99) / 1e3,
+           percentile(samples, num_samples, 99.9) / 1e3,
+           samples[num_samples - 1] / 1e3);
+}
+
+osd_result setup(void)
+{
+    a_hostctrl_ep = arg_str0("e", "hostctrl", "<URL>",
+                             "ZeroMQ endpoint of the host controller "
+                             "(default: " DEFAULT_HOSTCTRL_EP ")");
+    a_hostctrl_ep->sval[0] = DEFAULT_HOSTCTRL_EP;
+    osd_tool_add_arg(a_hostctrl_ep);
+
+    a_module = arg_int0("m", "module", "<diaddr>",
+                        "DI address of the module to access "
+                        "(default: 0, the SCM)");
+    a_module->ival[0] = 0;
+    osd_tool_add_arg(a_module);
+
+    a_register = arg_int0("r", "register", "<addr>",
+                          "address of the 16 bit register to read "
+                          "(default: 0x200, SCM_SYSTEM_VENDOR_ID)");
+    a_register->ival[0] = OSD_REG_SCM_SYSTEM_VENDOR_ID;
+    osd_tool_add_arg(a_register);
+
+    a_count = arg_int0("n", "count", "<N>",
+                       "number of register reads (default: 10000)");
+    a_count->ival[0] = 10000;
+    osd_tool_add_arg(a_count);
+
+    a_pipelined = arg_lit0("p", "pipelined",
+                           "keep multiple register reads in flight");
+    osd_tool_add_arg(a_pipelined);
+
+    a_concurrency = arg_int0("j", "concurrency", "<N>",
+                             "number of register reads in flight in pipelined "
+                             "mode (default: 8)");
+    a_concurrency->ival[0] = DEFAULT_CONCURRENCY;
+    osd_tool_add_arg(a_concurrency);
+
+    a_busy_poll = arg_int0(NULL, "busy-poll", "<us>",
+                           "busy-poll for up to <us> microseconds while "
+                           "waiting for a response (default: 0, disabled)");
+    a_busy_poll->ival[0] = 0;
+    osd_tool_add_arg(a_busy_poll);
+
+    return OSD_OK;
+}
+
+int run(void)
+{
+    osd_result rv;
+    int exitcode = 0;
+    struct ping_slot *slots = NULL;
+
+    zsys_init();
+
+    struct osd_log_ctx *osd_log_ctx;
+    rv = osd_log_new(&osd_log_ctx, cfg.log_level, &osd_log_handler);
+    assert(OSD_SUCCEEDED(rv));
+
+    struct ping_ctx ping = {
+        .diaddr = a_module->ival[0],
+        .reg_addr = a_register->ival[0],
+        .remaining = a_count->ival[0],
+    };
+
+    if (a_count->ival[0] <= 0 || a_concurrency->ival[0] <= 0 ||
+        a_busy_poll->ival[0] < 0) {
+        fatal("--count and --concurrency must be positive, --busy-poll must "
+              "not be negative.");
+        exitcode = 1;
+        goto free_return;
+    }
+    if (a_module->ival[0] < 0 || a_module->ival[0] > UINT16_MAX ||
+        a_register->ival[0] < 0 || a_register->ival[0] > UINT16_MAX) {
+        fatal("Module and register addresses must be 16 bit values.");
+        exitcode = 1;
+        goto free_return;
+    }
+
+    unsigned int num_in_flight =
+        a_pipelined->count ? a_concurrency->ival[0] : 1;
+
+    rv = osd_hostmod_new(&ping.hostmod_ctx, osd_log_ctx,
+                         a_hostctrl_ep->sval[0], NULL, NULL);
+    assert(OSD_SUCCEEDED(rv));
+    rv = osd_hostmod_connect(ping.hostmod_ctx);
+    if (OSD_FAILED(rv)) {
+        fatal("Unable to connect to host controller at %s (%d)",
+              a_hostctrl_ep->sval[0], rv);
+        exitcode = 1;
+        goto free_return;
+    }
+    osd_hostmod_set_busy_poll(ping.hostmod_ctx, a_busy_poll->ival[0],
+                              a_busy_poll->ival[0]);
+
+    // check that the register can be read at all before measuring
+    uint16_t reg_val;
+    rv = osd_hostmod_reg_read(ping.hostmod_ctx, &reg_val, ping.diaddr,
+                              ping.reg_addr, 16, 0);
+    if (OSD_FAILED(rv)) {
+        fatal("Unable to read register 0x%x of module %u (%d)", ping.reg_addr,
+              ping.diaddr, rv);
+        exitcode = 1;
+        goto free_return;
+    }
+    printf("Reading register 0x%x of module %u (value 0x%04x), %s, "
+           "%u in flight\n", ping.reg_addr, ping.diaddr, reg_val,
+           a_pipelined->count ? "pipelined" : "sequential", num_in_flight);
+
+    uint64_t t_start = now_ns();
+    if (a_pipelined->count) {
+        slots = calloc(num_in_flight, sizeof(struct ping_slot));
+        assert(slots);
+        run_pipelined(&ping, slots, num_in_flight);
+    } else {
+        run_sequential(&ping);
+    }
+    double t_total = (now_ns() - t_start) / 1e9;
+
+    report(ping.samples, ping.num_samples, ping.errors, t_total);
+    if (ping.errors) {
+        exitcode = 1;
+    }
+
+free_return:
+    if (ping.hostmod_ctx) {
+        if (osd_hostmod_is_connected(ping.hostmod_ctx)) {
+            osd_hostmod_disconnect(ping.hostmod_ctx);
+        }
+        osd_hostmod_free(&ping.hostmod_ctx);
+    }
+    free(slots);
+    free(ping.samples);
+    osd_log_free(&osd_log_ctx);
+    return exitcode;
+}
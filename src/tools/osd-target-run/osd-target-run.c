@@ -23,13 +23,18 @@
 #include <czmq.h>
 #include <osd/coretracelogger.h>
 #include <osd/gateway_glip.h>
+#include <osd/gateway_sim.h>
 #include <osd/hostctrl.h>
 #include <osd/memaccess.h>
 #include <osd/packet.h>
 #include <osd/systracelogger.h>
 #include <osd/terminal.h>
+#include <osd/tracestream.h>
 #include "../cli-util.h"
 
+#include <inttypes.h>
+#include <pthread.h>
+#include <time.h>
 #include <unistd.h>
 
 /**
@@ -48,24 +53,65 @@
 // command line arguments
 struct arg_str *a_glip_backend;
 struct arg_str *a_glip_backend_options;
+struct arg_str *a_sim;
 struct arg_str *a_hostctrl_ep;
 struct arg_lit *a_coretrace;
 struct arg_lit *a_systrace;
+struct arg_lit *a_coverage;
 struct arg_lit *a_verify_memload;
 struct arg_lit *a_terminal;
 struct arg_file *a_elf_file;
+struct arg_file *a_trace_stream;
 
 // global objects
 struct glip_ctx *glip_ctx;
 struct osd_log_ctx *osd_log_ctx;
 struct osd_hostctrl_ctx *hostctrl_ctx;
 struct osd_gateway_glip_ctx *gateway_glip_ctx;
-struct osd_terminal_ctx *terminal_ctx;
+struct osd_gateway_sim_ctx *gateway_sim_ctx;
+struct osd_tracestream_ctx *tracestream_ctx;
 
+zlist_t *terminals;
 zlist_t *ctloggers;
 zlist_t *stloggers;
 zlist_t *open_files;
 
+/** Protects the lists above during the (parallel) setup */
+pthread_mutex_t setup_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Maximum number of threads setting up trace loggers and terminals
+ */
+#define SETUP_THREADS_MAX 16
+
+/**
+ * A trace logger or terminal to be set up
+ */
+struct setup_job {
+    uint16_t type; //!< module type (OSD_MODULE_TYPE_STD_*)
+    uint16_t di_addr; //!< DI address of the module
+    osd_result result;
+};
+
+/**
+ * Trace logger and terminal setup, shared by all setup threads
+ */
+struct setup_ctx {
+    struct setup_job *jobs;
+    size_t num_jobs;
+    /** index of the next job to be taken by a setup thread */
+    size_t next_job;
+};
+
+/**
+ * Loading the ELF file into all memories (in a separate thread)
+ */
+struct memload_ctx {
+    struct osd_memaccess_ctx *memaccess_ctx;
+    struct osd_mem_desc *mems;
+    size_t mems_len;
+};
+
 osd_result setup(void)
 {
     a_elf_file =
@@ -80,10 +126,21 @@ osd_result setup(void)
         arg_lit0(NULL, "systrace", "create a system trace for all CPU cores");
     osd_tool_add_arg(a_systrace);
 
+    a_coverage = arg_lit0(NULL, "coverage",
+                          "collect function coverage for all CPU cores "
+                          "(requires --coretrace)");
+    osd_tool_add_arg(a_coverage);
+
+    a_trace_stream = arg_file0(NULL, "trace-stream", "<socket>",
+                               "publish all trace events to subscribers "
+                               "connecting to this Unix domain socket");
+    osd_tool_add_arg(a_trace_stream);
+
     a_verify_memload = arg_lit0(NULL, "verify-memload", "verify loaded memory");
     osd_tool_add_arg(a_verify_memload);
 
-    a_terminal = arg_lit0(NULL, "terminal", "create pseudo-terminal device");
+    a_terminal = arg_lit0(NULL, "terminal",
+                          "create a pseudo-terminal device for every DEM-UART");
     osd_tool_add_arg(a_terminal);
 
     a_glip_backend =
@@ -96,6 +153,11 @@ osd_result setup(void)
                  "<option1=value1,option2=value2,...>", "GLIP backend options");
     osd_tool_add_arg(a_glip_backend_options);
 
+    a_sim = arg_str0(NULL, "sim", "<mam=N,ctm=N,...,latency=NS>",
+                     "connect to a simulated debug subnet instead of a "
+                     "device (see osd_gateway_sim_config_parse())");
+    osd_tool_add_arg(a_sim);
+
     return OSD_OK;
 }
 
@@ -132,6 +194,38 @@ static osd_result run_gateway_glip(void)
     return OSD_OK;
 }
 
+static osd_result run_gateway_sim(void)
+{
+    osd_result rv;
+
+    struct osd_gateway_sim_config config;
+    osd_gateway_sim_config_init(&config);
+    rv = osd_gateway_sim_config_parse(&config, a_sim->sval[0]);
+    if (OSD_FAILED(rv)) {
+        fatal("Unable to parse simulated subnet configuration.");
+        return OSD_ERROR_FAILURE;
+    }
+
+    rv = osd_gateway_sim_new(&gateway_sim_ctx, osd_log_ctx, HOSTCTRL_EP,
+                             DEVICE_SUBNET_ADDRESS, &config);
+    if (OSD_FAILED(rv)) {
+        fatal("Unable to create simulated gateway.");
+        return OSD_ERROR_FAILURE;
+    }
+    assert(gateway_sim_ctx);
+
+    rv = osd_gateway_sim_connect(gateway_sim_ctx);
+    if (OSD_FAILED(rv)) {
+        fatal("Unable to connect to host controller.");
+        return OSD_ERROR_FAILURE;
+    }
+
+    info("Simulating a debug subnet with %u modules",
+         osd_gateway_sim_get_num_modules(gateway_sim_ctx));
+
+    return OSD_OK;
+}
+
 static osd_result run_hostctrl(void)
 {
     osd_result rv;
@@ -153,6 +247,27 @@ static osd_result run_hostctrl(void)
     return OSD_OK;
 }
 
+/**
+ * Append an item to one of the global lists (thread-safe)
+ */
+static void list_append_locked(zlist_t *list, void *item)
+{
+    pthread_mutex_lock(&setup_lock);
+    int irv = zlist_append(list, item);
+    assert(irv == 0);
+    pthread_mutex_unlock(&setup_lock);
+}
+
+/**
+ * Time since a point in time in seconds
+ */
+static double seconds_since(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
 static osd_result run_systrace(uint16_t stm_di_addr)
 {
     osd_result rv;
@@ -173,6 +288,14 @@ static osd_result run_systrace(uint16_t stm_di_addr)
         goto free_return;
     }
 
+    if (tracestream_ctx) {
+        rv = osd_systracelogger_set_stream(systracelogger_ctx, tracestream_ctx);
+        if (OSD_FAILED(rv)) {
+            retval = rv;
+            goto free_return;
+        }
+    }
+
     // event output
     char systrace_log_filename_event[18] = {0};
     irv = snprintf(systrace_log_filename_event, 18, "systrace.%04d.log",
@@ -192,8 +315,7 @@ static osd_result run_systrace(uint16_t stm_di_addr)
         retval = rv;
         goto free_return;
     }
-    irv = zlist_append(open_files, fp);
-    assert(irv == 0);
+    list_append_locked(open_files, fp);
     info("Writing system trace event output to file %s",
          systrace_log_filename_event);
 
@@ -216,8 +338,7 @@ static osd_result run_systrace(uint16_t stm_di_addr)
         retval = rv;
         goto free_return;
     }
-    irv = zlist_append(open_files, fp);
-    assert(irv == 0);
+    list_append_locked(open_files, fp);
     info("Writing system trace print output to file %s",
          systrace_log_filename_sysprint);
 
@@ -229,8 +350,7 @@ static osd_result run_systrace(uint16_t stm_di_addr)
     }
 
     fflush(stdout);
-    irv = zlist_append(stloggers, systracelogger_ctx);
-    assert(irv == 0);
+    list_append_locked(stloggers, systracelogger_ctx);
 
     retval = OSD_OK;
 free_return:
@@ -264,6 +384,15 @@ static osd_result run_coretrace(uint16_t ctm_di_addr)
         goto free_return;
     }
 
+    if (tracestream_ctx) {
+        rv = osd_coretracelogger_set_stream(coretracelogger_ctx,
+                                            tracestream_ctx);
+        if (OSD_FAILED(rv)) {
+            retval = rv;
+            goto free_return;
+        }
+    }
+
     // ELF decoding
     rv = osd_coretracelogger_set_elf(coretracelogger_ctx,
                                      a_elf_file->filename[0]);
@@ -273,6 +402,23 @@ static osd_result run_coretrace(uint16_t ctm_di_addr)
         // continue without ELF decoding
     }
 
+    // function coverage
+    if (a_coverage->count) {
+        char coverage_filename[19] = {0};
+        irv = snprintf(coverage_filename, 19, "coverage.%04d.cov",
+                       osd_diaddr_localaddr(ctm_di_addr));
+        assert(irv >= 0);
+
+        rv = osd_coretracelogger_set_coverage(coretracelogger_ctx,
+                                              coverage_filename);
+        if (OSD_FAILED(rv)) {
+            err("Unable to collect coverage without ELF symbols.");
+            // continue without coverage collection
+        } else {
+            info("Writing coverage to file %s", coverage_filename);
+        }
+    }
+
     // trace output file
     char coretrace_log_filename[19] = {0};
     irv = snprintf(coretrace_log_filename, 19, "coretrace.%04d.log",
@@ -292,8 +438,7 @@ static osd_result run_coretrace(uint16_t ctm_di_addr)
         retval = rv;
         goto free_return;
     }
-    irv = zlist_append(open_files, fp);
-    assert(irv == 0);
+    list_append_locked(open_files, fp);
     info("Writing core trace to file %s", coretrace_log_filename);
 
     // start tracing
@@ -303,8 +448,7 @@ static osd_result run_coretrace(uint16_t ctm_di_addr)
         goto free_return;
     }
 
-    irv = zlist_append(ctloggers, coretracelogger_ctx);
-    assert(irv == 0);
+    list_append_locked(ctloggers, coretracelogger_ctx);
 
     retval = OSD_OK;
 free_return:
@@ -318,139 +462,233 @@ free_return:
     return retval;
 }
 
-static osd_result run_tracing(void)
+/**
+ * Create a pseudo-terminal for a DEM-UART
+ *
+ * The terminals have no threads of their own, their I/O is handled by the
+ * I/O threads of their host modules.
+ */
+static osd_result run_terminal(uint16_t dem_uart_di_addr)
 {
     osd_result rv;
-    osd_result retval;
 
-    struct osd_hostmod_ctx *hostmod_enum = NULL;
-    rv = osd_hostmod_new(&hostmod_enum, osd_log_ctx, HOSTCTRL_EP, NULL, NULL);
+    struct osd_terminal_ctx *terminal_ctx;
+    rv = osd_terminal_new(&terminal_ctx, osd_log_ctx, HOSTCTRL_EP,
+                          dem_uart_di_addr);
     if (OSD_FAILED(rv)) {
-        retval = rv;
-        goto free_return;
+        fatal("osd_terminal_new() failed with code: %i", rv);
+        return rv;
     }
 
-    rv = osd_hostmod_connect(hostmod_enum);
+    rv = osd_terminal_connect(terminal_ctx);
     if (OSD_FAILED(rv)) {
-        retval = rv;
-        goto free_return;
+        fatal("osd_terminal_connect() failed with code: %i", rv);
+
+        if (rv != OSD_ERROR_CONNECTION_FAILED) {
+            osd_terminal_disconnect(terminal_ctx);
+        }
+
+        osd_terminal_free(&terminal_ctx);
+        return rv;
     }
 
-    struct osd_module_desc *modules = NULL;
-    size_t modules_len;
-    rv = osd_hostmod_get_modules(hostmod_enum, DEVICE_SUBNET_ADDRESS, &modules,
-                                 &modules_len);
+    rv = osd_terminal_start(terminal_ctx);
     if (OSD_FAILED(rv)) {
-        retval = rv;
-        goto free_return;
+        fatal("osd_terminal_start() failed with code: %i", rv);
+
+        osd_terminal_disconnect(terminal_ctx);
+        osd_terminal_free(&terminal_ctx);
+        return rv;
     }
 
-    for (size_t i = 0; i < modules_len; i++) {
-        if (a_coretrace->count && modules[i].vendor == OSD_MODULE_VENDOR_OSD &&
-            modules[i].type == OSD_MODULE_TYPE_STD_CTM) {
-            rv = run_coretrace(modules[i].addr);
-            if (OSD_FAILED(rv)) return rv;
+    list_append_locked(terminals, terminal_ctx);
+    return OSD_OK;
+}
+
+/**
+ * Setup thread: set up trace loggers and terminals until all jobs are taken
+ *
+ * Every logger and terminal talks to the device through its own host module,
+ * the setup of several of them runs in parallel to hide the latency of the
+ * register accesses.
+ */
+static void *setup_thread(void *setup_ctx_void)
+{
+    struct setup_ctx *setup = setup_ctx_void;
+
+    while (1) {
+        size_t i = __sync_fetch_and_add(&setup->next_job, 1);
+        if (i >= setup->num_jobs) {
+            break;
         }
-        if (a_systrace->count && modules[i].vendor == OSD_MODULE_VENDOR_OSD &&
-            modules[i].type == OSD_MODULE_TYPE_STD_STM) {
-            rv = run_systrace(modules[i].addr);
-            if (OSD_FAILED(rv)) return rv;
+
+        struct setup_job *job = &setup->jobs[i];
+        switch (job->type) {
+        case OSD_MODULE_TYPE_STD_CTM:
+            job->result = run_coretrace(job->di_addr);
+            break;
+        case OSD_MODULE_TYPE_STD_STM:
+            job->result = run_systrace(job->di_addr);
+            break;
+        case OSD_MODULE_TYPE_STD_DEM_UART:
+            job->result = run_terminal(job->di_addr);
+            break;
+        default:
+            assert(0);
+        }
+        if (OSD_FAILED(job->result)) {
+            err("Unable to set up module at DI address %u (%d)",
+                job->di_addr, job->result);
         }
     }
 
-    rv = osd_hostmod_disconnect(hostmod_enum);
-    if (OSD_FAILED(rv)) return rv;
-
-    retval = OSD_OK;
-free_return:
-    free(modules);
-    osd_hostmod_free(&hostmod_enum);
-    return retval;
+    return NULL;
 }
 
-static osd_result run_terminal(void)
+/**
+ * Collect the trace loggers and terminals to be set up
+ *
+ * @param modules all modules in the debug system
+ * @param modules_len number of entries in @p modules
+ * @param[out] setup the setup jobs
+ */
+static void setup_jobs_collect(const struct osd_module_desc *modules,
+                               size_t modules_len, struct setup_ctx *setup)
 {
-    struct osd_module_desc *modules;
-    struct osd_hostmod_ctx *hostmod_enum;
-    osd_result rv;
-    size_t modules_len;
+    setup->jobs = calloc(modules_len, sizeof(struct setup_job));
+    assert(setup->jobs || modules_len == 0);
+    setup->num_jobs = 0;
+    setup->next_job = 0;
 
-    // We only create the pseudo-terminal if it was explicitly specified
-    if (!a_terminal->count) {
-        return OSD_OK;
+    for (size_t i = 0; i < modules_len; i++) {
+        if (modules[i].vendor != OSD_MODULE_VENDOR_OSD) {
+            continue;
+        }
+        if ((modules[i].type == OSD_MODULE_TYPE_STD_CTM &&
+             a_coretrace->count) ||
+            (modules[i].type == OSD_MODULE_TYPE_STD_STM &&
+             a_systrace->count) ||
+            (modules[i].type == OSD_MODULE_TYPE_STD_DEM_UART &&
+             a_terminal->count)) {
+            setup->jobs[setup->num_jobs].type = modules[i].type;
+            setup->jobs[setup->num_jobs].di_addr = modules[i].addr;
+            setup->num_jobs++;
+        }
     }
+}
 
-    rv = osd_hostmod_new(&hostmod_enum, osd_log_ctx, HOSTCTRL_EP, NULL, NULL);
-    if (OSD_FAILED(rv)) {
-        goto free_return;
-    }
+/**
+ * Read the descriptions of all memories
+ *
+ * @param hostmod_ctx the host module to use
+ * @param modules all modules in the debug system
+ * @param modules_len number of entries in @p modules
+ * @param[out] memload the memories
+ */
+static void find_memories(struct osd_hostmod_ctx *hostmod_ctx,
+                          const struct osd_module_desc *modules,
+                          size_t modules_len, struct memload_ctx *memload)
+{
+    osd_result rv;
 
-    rv = osd_hostmod_connect(hostmod_enum);
-    if (OSD_FAILED(rv)) {
-        goto free_return;
-    }
+    memload->mems = calloc(modules_len, sizeof(struct osd_mem_desc));
+    assert(memload->mems || modules_len == 0);
+    memload->mems_len = 0;
 
-    rv = osd_hostmod_get_modules(hostmod_enum, DEVICE_SUBNET_ADDRESS, &modules,
-                                 &modules_len);
-    if (OSD_FAILED(rv)) {
-        goto free_return;
+    for (size_t i = 0; i < modules_len; i++) {
+        if (modules[i].vendor != OSD_MODULE_VENDOR_OSD ||
+            modules[i].type != OSD_MODULE_TYPE_STD_MAM ||
+            modules[i].version != 0) {
+            continue;
+        }
+        rv = osd_cl_mam_get_mem_desc(hostmod_ctx, modules[i].addr,
+                                     &memload->mems[memload->mems_len]);
+        if (OSD_FAILED(rv)) {
+            err("Unable to get information from MAM module at address %u "
+                "(%d)", modules[i].addr, rv);
+            continue;
+        }
+        memload->mems_len++;
     }
+}
 
-    for (size_t i = 0; i < modules_len; i++) {
-        if (modules[i].vendor == OSD_MODULE_VENDOR_OSD &&
-            modules[i].type == OSD_MODULE_TYPE_STD_DEM_UART) {
-            rv = osd_terminal_new(&terminal_ctx, osd_log_ctx, HOSTCTRL_EP,
-                                  modules[i].addr);
-            if (OSD_FAILED(rv)) {
-                fatal("osd_terminal_new() failed with code: %i", rv);
-                goto free_return;
-            }
-
-            rv = osd_terminal_connect(terminal_ctx);
-            if (OSD_FAILED(rv)) {
-                fatal("osd_terminal_connect() failed with code: %i", rv);
-
-                if (rv != OSD_ERROR_CONNECTION_FAILED) {
-                    osd_terminal_disconnect(terminal_ctx);
-                }
-
-                osd_terminal_free(&terminal_ctx);
-                goto free_return;
-            }
-
-            rv = osd_terminal_start(terminal_ctx);
-            if (OSD_FAILED(rv)) {
-                fatal("osd_terminal_start() failed with code: %i", rv);
-
-                osd_terminal_disconnect(terminal_ctx);
-                osd_terminal_free(&terminal_ctx);
-                goto free_return;
-            }
-
-            // Currently, we can only handle a single osd_terminal.
-            break;
+/**
+ * Memory load thread: load the ELF file into all memories
+ */
+static void *memload_thread(void *memload_ctx_void)
+{
+    osd_result rv;
+    struct memload_ctx *memload = memload_ctx_void;
+
+    for (size_t i = 0; i < memload->mems_len; i++) {
+        struct osd_mem_desc *mem = &memload->mems[i];
+        if (a_verify_memload->count) {
+            info("Loading memory at DI address %d with ELF file %s (verifying "
+                 "write through readback)",
+                 mem->di_addr, a_elf_file->filename[0]);
+        } else {
+            info("Loading memory at DI address %d with ELF file %s (not "
+                 "verifying write)",
+                 mem->di_addr, a_elf_file->filename[0]);
+        }
+        rv = osd_memaccess_loadelf(memload->memaccess_ctx, mem,
+                                   a_elf_file->filename[0],
+                                   a_verify_memload->count);
+        if (OSD_FAILED(rv)) {
+            err("Unable to load memory at DI address %d (%d)", mem->di_addr,
+                rv);
+            // continue anyways
         }
     }
 
-    rv = osd_hostmod_disconnect(hostmod_enum);
-    if (OSD_FAILED(rv)) {
-        goto free_return;
+    return NULL;
+}
+
+/**
+ * Log the throughput of a terminal
+ */
+static void print_terminal_stats(struct osd_terminal_ctx *terminal_ctx)
+{
+    struct osd_terminal_stats stats;
+    osd_terminal_get_stats(terminal_ctx, &stats);
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double time_elapsed = (now.tv_sec - stats.start_time.tv_sec) +
+                          (now.tv_nsec - stats.start_time.tv_nsec) * 1e-9;
+
+    if (stats.rx_chars == 0 || time_elapsed <= 0) {
+        return;
     }
 
-    rv = OSD_OK;
-free_return:
-    free(modules);
-    osd_hostmod_free(&hostmod_enum);
-    return rv;
+    info("Terminal %s: received %" PRIu64 " characters "
+         "(%.0f characters/s), %.3f write() calls per character",
+         osd_terminal_get_pts_path(terminal_ctx), stats.rx_chars,
+         stats.rx_chars / time_elapsed,
+         (double)stats.rx_writes / stats.rx_chars);
 }
 
 int run(void)
 {
     osd_result rv;
     int exitcode;
+    struct osd_memaccess_ctx *memaccess_ctx = NULL;
+    struct osd_module_desc *modules = NULL;
+    size_t modules_len = 0;
+    struct setup_ctx setup = { 0 };
+    struct memload_ctx memload = { 0 };
+    pthread_t memload_thread_id;
+    bool memload_running = false;
+
+    // startup phase timings
+    struct timespec t_start;
+    double t_connect = 0, t_enumerate = 0, t_setup = 0, t_memload = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
 
     zsys_init();
 
+    terminals = zlist_new();
+    assert(terminals);
     ctloggers = zlist_new();
     assert(ctloggers);
     stloggers = zlist_new();
@@ -469,14 +707,18 @@ int run(void)
     }
 
     // device gateway
-    rv = run_gateway_glip();
+    if (a_sim->count) {
+        rv = run_gateway_sim();
+    } else {
+        rv = run_gateway_glip();
+    }
     if (OSD_FAILED(rv)) {
         exitcode = -1;
         goto free_return;
     }
 
-    // setup memory access helper
-    struct osd_memaccess_ctx *memaccess_ctx = NULL;
+    // setup memory access helper. Its host module is also used to enumerate
+    // the debug system.
     rv = osd_memaccess_new(&memaccess_ctx, osd_log_ctx, HOSTCTRL_EP);
     if (OSD_FAILED(rv)) {
         exitcode = -1;
@@ -487,6 +729,9 @@ int run(void)
         exitcode = -1;
         goto free_return;
     }
+    struct osd_hostmod_ctx *hostmod_ctx =
+        osd_memaccess_get_hostmod(memaccess_ctx);
+    t_connect = seconds_since(&t_start);
 
     // stop all CPUs on target device
     info("Stopping all CPUs in the system");
@@ -497,53 +742,65 @@ int run(void)
         goto free_return;
     }
 
-    // setup tracing
-    info("Setting up tracing");
-    rv = run_tracing();
+    // enumerate the debug system once for all following steps
+    struct timespec t_phase;
+    clock_gettime(CLOCK_MONOTONIC, &t_phase);
+    rv = osd_hostmod_get_modules(hostmod_ctx, DEVICE_SUBNET_ADDRESS, &modules,
+                                 &modules_len);
     if (OSD_FAILED(rv)) {
+        fatal("Unable to enumerate the debug system (%d)", rv);
         exitcode = -1;
         goto free_return;
     }
+    find_memories(hostmod_ctx, modules, modules_len, &memload);
+    t_enumerate = seconds_since(&t_phase);
 
-    // setup terminal
-    info("Setting up terminal");
-    rv = run_terminal();
-    if (OSD_FAILED(rv)) {
-        exitcode = -1;
-        goto free_return;
+    if (a_trace_stream->count) {
+        rv = osd_tracestream_new(&tracestream_ctx, osd_log_ctx,
+                                 a_trace_stream->filename[0], 0);
+        if (OSD_FAILED(rv)) {
+            fatal("Unable to create trace stream at %s",
+                  a_trace_stream->filename[0]);
+            exitcode = -1;
+            goto free_return;
+        }
     }
 
-    // load memories
+    // Load the memories while the trace loggers and terminals are set up.
+    // The memory load thread owns the host module of memaccess_ctx until it
+    // is joined.
     info("Loading memories ...");
-    struct osd_mem_desc *mems;
-    size_t mems_len;
-    rv = osd_memaccess_find_memories(memaccess_ctx, DEVICE_SUBNET_ADDRESS,
-                                     &mems, &mems_len);
-    if (OSD_FAILED(rv)) {
-        fatal("Unable to enumerate memories on target (%d)", rv);
-        exitcode = -1;
-        goto free_return;
+    clock_gettime(CLOCK_MONOTONIC, &t_phase);
+    memload.memaccess_ctx = memaccess_ctx;
+    int irv = pthread_create(&memload_thread_id, NULL, memload_thread,
+                             &memload);
+    assert(irv == 0);
+    memload_running = true;
+
+    info("Setting up tracing and terminals");
+    setup_jobs_collect(modules, modules_len, &setup);
+    size_t num_setup_threads = setup.num_jobs < SETUP_THREADS_MAX
+                                   ? setup.num_jobs : SETUP_THREADS_MAX;
+    pthread_t setup_threads[SETUP_THREADS_MAX];
+    for (size_t i = 0; i < num_setup_threads; i++) {
+        irv = pthread_create(&setup_threads[i], NULL, setup_thread, &setup);
+        assert(irv == 0);
     }
-    for (size_t i = 0; i < mems_len; i++) {
-        if (a_verify_memload->count) {
-            info("Loading memory at DI address %d with ELF file %s (verifying "
-                 "write through readback)",
-                 mems[i].di_addr, a_elf_file->filename[0]);
-        } else {
-            info("Loading memory at DI address %d with ELF file %s (not "
-                 "verifying write)",
-                 mems[i].di_addr, a_elf_file->filename[0]);
-        }
-        rv = osd_memaccess_loadelf(memaccess_ctx, &mems[i],
-                                   a_elf_file->filename[0],
-                                   a_verify_memload->count);
-        if (OSD_FAILED(rv)) {
-            err("Unable to load memory at DI address %d (%d)", mems[i].di_addr,
-                rv);
-            // continue anyways
+    for (size_t i = 0; i < num_setup_threads; i++) {
+        pthread_join(setup_threads[i], NULL);
+    }
+    t_setup = seconds_since(&t_phase);
+
+    pthread_join(memload_thread_id, NULL);
+    memload_running = false;
+    t_memload = seconds_since(&t_phase);
+
+    for (size_t i = 0; i < setup.num_jobs; i++) {
+        if (OSD_FAILED(setup.jobs[i].result)) {
+            exitcode = -1;
+            goto free_return;
         }
     }
-    free(mems);
 
     // start CPUs on target
     info("Starting all CPUs");
@@ -554,6 +811,12 @@ int run(void)
         goto free_return;
     }
 
+    info("Startup took %.3f s: connecting %.3f s, enumeration %.3f s, "
+         "setup of %zu trace loggers and terminals %.3f s, loading %zu "
+         "memories %.3f s (in parallel to the setup)",
+         seconds_since(&t_start), t_connect, t_enumerate, setup.num_jobs,
+         t_setup, memload.mems_len, t_memload);
+
     // memaccess isn't needed any more
     rv = osd_memaccess_disconnect(memaccess_ctx);
     if (OSD_FAILED(rv)) {
@@ -572,16 +835,33 @@ int run(void)
 
     exitcode = 0;
 
-free_return:;
-    dbg("Shutting down terminal");
-    if (terminal_ctx) {
-        rv = osd_terminal_disconnect(terminal_ctx);
+free_return:
+    if (memload_running) {
+        pthread_join(memload_thread_id, NULL);
+    }
+    free(memload.mems);
+    free(setup.jobs);
+    free(modules);
+    if (memaccess_ctx && osd_memaccess_is_connected(memaccess_ctx)) {
+        osd_memaccess_disconnect(memaccess_ctx);
+    }
+    osd_memaccess_free(&memaccess_ctx);
+
+    dbg("Shutting down terminals");
+    struct osd_terminal_ctx *t = zlist_first(terminals);
+    while (t) {
+        print_terminal_stats(t);
+
+        osd_terminal_stop(t);
+        rv = osd_terminal_disconnect(t);
         if (OSD_FAILED(rv) && rv != OSD_ERROR_NOT_CONNECTED) {
             fatal("Unable to shut down terminal");
             exitcode = -1;
         }
-        osd_terminal_free(&terminal_ctx);
+        osd_terminal_free(&t);
+        t = zlist_next(terminals);
     }
+    zlist_destroy(&terminals);
 
     dbg("Shutting down systrace loggers");
     struct osd_systracelogger_ctx *s = zlist_first(stloggers);
@@ -603,6 +883,10 @@ free_return:;
     }
     zlist_destroy(&ctloggers);
 
+    // all loggers publishing to the stream are gone now
+    dbg("Shutting down trace stream");
+    osd_tracestream_free(&tracestream_ctx);
+
     dbg("Closing open files");
     FILE *f = zlist_first(open_files);
     while (f) {
@@ -612,12 +896,21 @@ free_return:;
     zlist_destroy(&open_files);
 
     dbg("Disconnecting gateway");
-    rv = osd_gateway_glip_disconnect(gateway_glip_ctx);
-    if (OSD_FAILED(rv) && rv != OSD_ERROR_NOT_CONNECTED) {
-        fatal("Unable to GLIP device gateway (%d)", rv);
-        exitcode = -1;
+    if (gateway_sim_ctx) {
+        rv = osd_gateway_sim_disconnect(gateway_sim_ctx);
+        if (OSD_FAILED(rv) && rv != OSD_ERROR_NOT_CONNECTED) {
+            fatal("Unable to disconnect simulated gateway (%d)", rv);
+            exitcode = -1;
+        }
+        osd_gateway_sim_free(&gateway_sim_ctx);
+    } else {
+        rv = osd_gateway_glip_disconnect(gateway_glip_ctx);
+        if (OSD_FAILED(rv) && rv != OSD_ERROR_NOT_CONNECTED) {
+            fatal("Unable to GLIP device gateway (%d)", rv);
+            exitcode = -1;
+        }
+        osd_gateway_glip_free(&gateway_glip_ctx);
     }
-    osd_gateway_glip_free(&gateway_glip_ctx);
 
     dbg("Stopping host controller");
     rv = osd_hostctrl_stop(hostctrl_ctx);
@@ -0,0 +1,837 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Convert recorded trace packets into decoded STM/CTM events
+ *
+ * The input is a capture file, or a sequence of packets as written by
+ * osd_packet_fwrite(). It is first indexed and split into chunks at points
+ * where no multi-packet event is in flight (i.e. no EV_CONT packet is waiting
+ * for its EV_LAST packet). The chunks are then decoded independently on a
+ * pool of worker threads, and the output of all chunks is written in the
+ * original order.
+ */
+
+#define CLI_TOOL_PROGNAME "osd-trace-convert"
+#define CLI_TOOL_SHORTDESC "Decode recorded STM/CTM trace packets"
+
+#include <osd/capture.h>
+#include <osd/cl_ctm.h>
+#include <osd/cl_stm.h>
+#include <osd/coretracelogger.h>
+#include <osd/packet.h>
+#include <osd/symtab.h>
+#include <osd/systracelogger.h>
+#include "../cli-util.h"
+
+#include <endian.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+
+/**
+ * Default number of packets in one chunk
+ */
+#define DEFAULT_CHUNK_PACKETS (64 * 1024)
+
+/**
+ * Number of decoded chunks per worker thread which may wait to be written
+ */
+#define CHUNKS_IN_FLIGHT_PER_WORKER 4
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+/** raw packet dumps (little endian) can be used in place */
+#define RAW_DUMP_ZERO_COPY 1
+#endif
+
+// command line arguments
+struct arg_file *a_input;
+struct arg_file *a_output;
+struct arg_str *a_type;
+struct arg_int *a_width;
+struct arg_int *a_source;
+struct arg_file *a_elf;
+struct arg_file *a_sysprint;
+struct arg_int *a_jobs;
+struct arg_int *a_chunk_packets;
+
+enum trace_type { TRACE_TYPE_STM, TRACE_TYPE_CTM };
+
+struct conv_stats {
+    size_t packets;
+    size_t events;
+    size_t overflowed_events;
+    size_t invalid_packets;
+};
+
+/**
+ * A part of the input file which can be decoded independently
+ */
+struct chunk {
+    struct osd_capture_pos start; //!< position of the first packet
+    size_t num_packets; //!< number of packets in the chunk
+
+    bool done; //!< chunk has been decoded
+    osd_result rv; //!< result of the decoding
+    char *out_buf; //!< decoded events
+    size_t out_len; //!< length of |out_buf|
+    char *sysprint_buf; //!< sysprint output (STM only)
+    size_t sysprint_len; //!< length of |sysprint_buf|
+    struct conv_stats stats; //!< statistics of this chunk
+};
+
+/**
+ * A multi-packet event which is being reassembled
+ */
+struct pending_event {
+    unsigned int src;
+    struct osd_packet *pkg;
+};
+
+struct conv_ctx {
+    struct osd_log_ctx *log_ctx;
+    const char *filename; //!< input file
+    bool is_capture; //!< input is a capture file (not a raw packet dump)
+
+    enum trace_type type;
+    int source; //!< DI address of the trace module, or -1 to take all
+    struct osd_stm_desc stm_desc;
+    struct osd_ctm_desc ctm_desc;
+    struct osd_symtab_ctx *symtab;
+    bool with_sysprint;
+
+    const uint8_t *data; //!< mapped input file (raw packet dump only)
+    size_t data_len; //!< length of |data| in bytes
+
+    struct chunk *chunks;
+    size_t num_chunks;
+
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    size_t next_chunk; //!< next chunk to be picked up by a worker
+    size_t written_chunks; //!< number of chunks written to the output
+    size_t max_in_flight; //!< max. number of decoded but unwritten chunks
+};
+
+/**
+ * Sequential reader for all supported input formats
+ */
+struct pkg_reader {
+    const struct conv_ctx *conv;
+    struct osd_capture_reader_ctx *capture; //!< capture file reader
+    size_t offset; //!< offset of the next packet in a raw packet dump
+#ifndef RAW_DUMP_ZERO_COPY
+    /** packet of a raw packet dump in host byte order */
+    struct osd_packet *pkg_buf;
+#endif
+};
+
+static osd_result pkg_reader_open(struct pkg_reader *r,
+                                  const struct conv_ctx *conv)
+{
+    memset(r, 0, sizeof(struct pkg_reader));
+    r->conv = conv;
+    if (conv->is_capture) {
+        return osd_capture_reader_new(&r->capture, conv->log_ctx,
+                                      conv->filename);
+    }
+    return OSD_OK;
+}
+
+static void pkg_reader_close(struct pkg_reader *r)
+{
+    osd_capture_reader_free(&r->capture);
+#ifndef RAW_DUMP_ZERO_COPY
+    osd_packet_free(&r->pkg_buf);
+#endif
+}
+
+static void pkg_reader_tell(const struct pkg_reader *r,
+                            struct osd_capture_pos *pos)
+{
+    if (r->capture) {
+        osd_capture_reader_tell(r->capture, pos);
+    } else {
+        pos->block_offset = 0;
+        pos->record_offset = r->offset;
+    }
+}
+
+static osd_result pkg_reader_seek(struct pkg_reader *r,
+                                  const struct osd_capture_pos *pos)
+{
+    if (r->capture) {
+        return osd_capture_reader_seek(r->capture, pos);
+    }
+    r->offset = pos->record_offset;
+    return OSD_OK;
+}
+
+static uint16_t get_le16(const uint8_t *p)
+{
+    uint16_t v;
+    memcpy(&v, p, sizeof(v));
+    return le16toh(v);
+}
+
+/**
+ * Get the next packet
+ *
+ * Raw packet dumps and capture files store packets as little endian 16 bit
+ * words, which matches the in-memory representation of struct osd_packet on
+ * little endian hosts. There the packets are used in place without copying
+ * them; on big endian hosts they are converted into a buffer.
+ *
+ * @param[out] pkg the packet, or NULL at the end of the input. Valid until
+ *                 the next call.
+ */
+static osd_result pkg_reader_next(struct pkg_reader *r,
+                                  const struct osd_packet **pkg)
+{
+    if (r->capture) {
+        return osd_capture_reader_next(r->capture, pkg, NULL);
+    }
+
+    const struct conv_ctx *conv = r->conv;
+    *pkg = NULL;
+    if (r->offset == conv->data_len) {
+        return OSD_OK;
+    }
+
+    const uint8_t *rec = conv->data + r->offset;
+    uint16_t data_size_words = 0;
+    size_t len = sizeof(uint16_t);
+    if (r->offset + len <= conv->data_len) {
+        data_size_words = get_le16(rec);
+        len += data_size_words * sizeof(uint16_t);
+    }
+    if (r->offset + len > conv->data_len ||
+        data_size_words < osd_packet_sizeconv_payload2data(0)) {
+        err("Truncated or corrupt packet at offset %zu.", r->offset);
+        return OSD_ERROR_CORRUPT;
+    }
+    r->offset += len;
+
+#ifdef RAW_DUMP_ZERO_COPY
+    *pkg = (const struct osd_packet *)rec;
+#else
+    osd_result rv;
+    osd_packet_free(&r->pkg_buf);
+    rv = osd_packet_new(&r->pkg_buf, data_size_words);
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
+    for (size_t i = 0; i < data_size_words; i++) {
+        r->pkg_buf->data_raw[i] = get_le16(rec + sizeof(uint16_t) * (i + 1));
+    }
+    *pkg = r->pkg_buf;
+#endif
+
+    return OSD_OK;
+}
+
+static bool is_relevant_pkg(const struct conv_ctx *conv,
+                            const struct osd_packet *pkg)
+{
+    if (osd_packet_get_type(pkg) != OSD_PACKET_TYPE_EVENT) {
+        return false;
+    }
+    if (conv->source >= 0 &&
+        osd_packet_get_src(pkg) != (unsigned int)conv->source) {
+        return false;
+    }
+    return true;
+}
+
+static void add_chunk(struct conv_ctx *conv, size_t *len_chunks,
+                      const struct osd_capture_pos *start, size_t num_packets)
+{
+    if (conv->num_chunks == *len_chunks) {
+        *len_chunks *= 2;
+        conv->chunks = realloc(conv->chunks,
+                               *len_chunks * sizeof(struct chunk));
+        assert(conv->chunks);
+    }
+    struct chunk *c = &conv->chunks[conv->num_chunks++];
+    memset(c, 0, sizeof(struct chunk));
+    c->start = *start;
+    c->num_packets = num_packets;
+}
+
+/**
+ * Split the input file into chunks
+ *
+ * Chunks contain at least |chunk_packets| packets and end only after a
+ * packet which leaves no multi-packet event of any source incomplete.
+ */
+static osd_result index_input(struct conv_ctx *conv, size_t chunk_packets)
+{
+    osd_result rv;
+
+    size_t len_chunks = 64;
+    conv->chunks = calloc(len_chunks, sizeof(struct chunk));
+    assert(conv->chunks);
+    conv->num_chunks = 0;
+
+    struct pkg_reader reader;
+    rv = pkg_reader_open(&reader, conv);
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
+
+    // sources with a EV_CONT packet waiting for the final EV_LAST packet
+    const size_t pending_bitmap_words = (UINT16_MAX + 1) / 64;
+    uint64_t *pending = calloc(pending_bitmap_words, sizeof(uint64_t));
+    assert(pending);
+    unsigned int num_pending = 0;
+
+    struct osd_capture_pos chunk_start;
+    pkg_reader_tell(&reader, &chunk_start);
+    size_t pkgs_in_chunk = 0;
+    while (1) {
+        const struct osd_packet *pkg;
+        rv = pkg_reader_next(&reader, &pkg);
+        if (OSD_FAILED(rv)) {
+            err("Ignoring the remainder of the input file.");
+            break;
+        }
+        if (!pkg) {
+            break;
+        }
+        pkgs_in_chunk++;
+
+        if (is_relevant_pkg(conv, pkg)) {
+            unsigned int src = osd_packet_get_src(pkg);
+            uint64_t mask = 1ULL << (src % 64);
+            bool is_cont = (osd_packet_get_type_sub(pkg) == EV_CONT);
+            bool was_pending = pending[src / 64] & mask;
+            if (is_cont && !was_pending) {
+                pending[src / 64] |= mask;
+                num_pending++;
+            } else if (!is_cont && was_pending) {
+                pending[src / 64] &= ~mask;
+                num_pending--;
+            }
+        }
+
+        if (pkgs_in_chunk >= chunk_packets && num_pending == 0) {
+            add_chunk(conv, &len_chunks, &chunk_start, pkgs_in_chunk);
+            pkg_reader_tell(&reader, &chunk_start);
+            pkgs_in_chunk = 0;
+        }
+    }
+
+    // the remaining packets form the last chunk
+    if (pkgs_in_chunk > 0) {
+        add_chunk(conv, &len_chunks, &chunk_start, pkgs_in_chunk);
+    }
+
+    if (num_pending) {
+        info("%u multi-packet events are incomplete at the end of the trace.",
+             num_pending);
+    }
+
+    free(pending);
+    pkg_reader_close(&reader);
+    return OSD_OK;
+}
+
+static osd_result decode_event(const struct conv_ctx *conv,
+                               const struct osd_packet *pkg,
+                               FILE *fp_out, FILE *fp_sysprint,
+                               struct conv_stats *stats)
+{
+    osd_result rv;
+
+    if (conv->type == TRACE_TYPE_STM) {
+        struct osd_stm_event ev;
+        rv = osd_cl_stm_decode_event(&conv->stm_desc, pkg, &ev);
+        if (OSD_FAILED(rv)) {
+            stats->invalid_packets++;
+            return OSD_OK;
+        }
+        stats->overflowed_events += ev.overflow;
+        stats->events += !ev.overflow;
+
+        if (fp_sysprint && osd_cl_stm_is_print_event(&ev)) {
+            if (fputc((uint8_t)ev.value, fp_sysprint) == EOF) {
+                return OSD_ERROR_FILE;
+            }
+        }
+        return osd_systracelogger_format_event(fp_out, &ev);
+    }
+
+    struct osd_ctm_event ev;
+    rv = osd_cl_ctm_decode_event(&conv->ctm_desc, pkg, &ev);
+    if (OSD_FAILED(rv)) {
+        stats->invalid_packets++;
+        return OSD_OK;
+    }
+    stats->overflowed_events += ev.overflow;
+    stats->events += !ev.overflow;
+
+    return osd_coretracelogger_format_event(fp_out, conv->symtab, &ev);
+}
+
+static osd_result decode_chunk(const struct conv_ctx *conv,
+                               struct pkg_reader *reader, struct chunk *c)
+{
+    osd_result rv;
+
+    rv = pkg_reader_seek(reader, &c->start);
+    if (OSD_FAILED(rv)) {
+        return rv;
+    }
+
+    FILE *fp_out = open_memstream(&c->out_buf, &c->out_len);
+    assert(fp_out);
+    FILE *fp_sysprint = NULL;
+    if (conv->with_sysprint) {
+        fp_sysprint = open_memstream(&c->sysprint_buf, &c->sysprint_len);
+        assert(fp_sysprint);
+    }
+
+    // multi-packet events being reassembled; typically only very few
+    // sources are active at the same time, a linear search is sufficient.
+    struct pending_event *pending = NULL;
+    size_t num_pending = 0;
+
+    for (size_t p = 0; p < c->num_packets; p++) {
+        const struct osd_packet *pkg;
+        rv = pkg_reader_next(reader, &pkg);
+        if (OSD_FAILED(rv)) {
+            break;
+        }
+        if (!pkg) {
+            // the file was indexed before, it must not end early
+            rv = OSD_ERROR_FILE;
+            break;
+        }
+        c->stats.packets++;
+
+        if (!is_relevant_pkg(conv, pkg)) {
+            continue;
+        }
+
+        unsigned int src = osd_packet_get_src(pkg);
+        struct pending_event *pe = NULL;
+        for (size_t i = 0; i < num_pending; i++) {
+            if (pending[i].src == src) {
+                pe = &pending[i];
+                break;
+            }
+        }
+
+        if (osd_packet_get_type_sub(pkg) == EV_CONT) {
+            if (!pe) {
+                pending = realloc(pending, (num_pending + 1) *
+                                           sizeof(struct pending_event));
+                assert(pending);
+                pe = &pending[num_pending++];
+                pe->src = src;
+                rv = osd_packet_new(&pe->pkg, pkg->data_size_words);
+                assert(OSD_SUCCEEDED(rv));
+                memcpy(pe->pkg->data_raw, pkg->data_raw,
+                       osd_packet_sizeof(pkg));
+                rv = osd_packet_set_type_sub(pe->pkg, EV_LAST);
+                assert(OSD_SUCCEEDED(rv));
+            } else {
+                rv = osd_packet_combine(&pe->pkg, pkg);
+                assert(OSD_SUCCEEDED(rv));
+            }
+            continue;
+        }
+
+        if (pe && osd_packet_get_type_sub(pkg) == EV_LAST) {
+            rv = osd_packet_combine(&pe->pkg, pkg);
+            assert(OSD_SUCCEEDED(rv));
+            rv = decode_event(conv, pe->pkg, fp_out, fp_sysprint, &c->stats);
+
+            osd_packet_free(&pe->pkg);
+            *pe = pending[--num_pending];
+        } else {
+            rv = decode_event(conv, pkg, fp_out, fp_sysprint, &c->stats);
+        }
+        if (OSD_FAILED(rv)) {
+            break;
+        }
+    }
+
+    // events which are incomplete at the end of the trace are dropped
+    for (size_t i = 0; i < num_pending; i++) {
+        osd_packet_free(&pending[i].pkg);
+    }
+    free(pending);
+
+    if (fclose(fp_out) != 0) {
+        rv = OSD_ERROR_OOM;
+    }
+    if (fp_sysprint && fclose(fp_sysprint) != 0) {
+        rv = OSD_ERROR_OOM;
+    }
+
+    return rv;
+}
+
+static void *worker_thread(void *arg)
+{
+    osd_result rv;
+    struct conv_ctx *conv = arg;
+
+    // each worker has its own reader to read the file independently
+    struct pkg_reader reader;
+    osd_result reader_rv = pkg_reader_open(&reader, conv);
+
+    while (1) {
+        pthread_mutex_lock(&conv->lock);
+        // limit the amount of decoded data waiting to be written
+        while (conv->next_chunk < conv->num_chunks &&
+               conv->next_chunk >= conv->written_chunks + conv->max_in_flight) {
+            pthread_cond_wait(&conv->cond, &conv->lock);
+        }
+        if (conv->next_chunk >= conv->num_chunks) {
+            pthread_mutex_unlock(&conv->lock);
+            break;
+        }
+        struct chunk *c = &conv->chunks[conv->next_chunk++];
+        pthread_mutex_unlock(&conv->lock);
+
+        if (OSD_SUCCEEDED(reader_rv)) {
+            rv = decode_chunk(conv, &reader, c);
+        } else {
+            rv = reader_rv;
+        }
+
+        pthread_mutex_lock(&conv->lock);
+        c->rv = rv;
+        c->done = true;
+        pthread_cond_broadcast(&conv->cond);
+        pthread_mutex_unlock(&conv->lock);
+    }
+
+    pkg_reader_close(&reader);
+    return NULL;
+}
+
+/**
+ * Write the decoded chunks in order as they become available
+ */
+static osd_result write_chunks(struct conv_ctx *conv, FILE *fp_out,
+                               FILE *fp_sysprint, struct conv_stats *stats)
+{
+    osd_result retval = OSD_OK;
+
+    for (size_t i = 0; i < conv->num_chunks; i++) {
+        struct chunk *c = &conv->chunks[i];
+
+        pthread_mutex_lock(&conv->lock);
+        while (!c->done) {
+            pthread_cond_wait(&conv->cond, &conv->lock);
+        }
+        pthread_mutex_unlock(&conv->lock);
+
+        if (OSD_FAILED(c->rv) && OSD_SUCCEEDED(retval)) {
+            err("Unable to decode chunk %zu (%d)", i, c->rv);
+            retval = c->rv;
+        }
+        if (OSD_SUCCEEDED(retval)) {
+            if (fwrite(c->out_buf, 1, c->out_len, fp_out) != c->out_len) {
+                err("Unable to write to output file: %s", strerror(errno));
+                retval = OSD_ERROR_FILE;
+            }
+            if (fp_sysprint && fwrite(c->sysprint_buf, 1, c->sysprint_len,
+                                      fp_sysprint) != c->sysprint_len) {
+                err("Unable to write to sysprint file: %s", strerror(errno));
+                retval = OSD_ERROR_FILE;
+            }
+        }
+
+        stats->packets += c->stats.packets;
+        stats->events += c->stats.events;
+        stats->overflowed_events += c->stats.overflowed_events;
+        stats->invalid_packets += c->stats.invalid_packets;
+
+        free(c->out_buf);
+        c->out_buf = NULL;
+        free(c->sysprint_buf);
+        c->sysprint_buf = NULL;
+
+        // on errors we continue to consume chunks to let the workers finish
+        pthread_mutex_lock(&conv->lock);
+        conv->written_chunks++;
+        pthread_cond_broadcast(&conv->cond);
+        pthread_mutex_unlock(&conv->lock);
+    }
+
+    return retval;
+}
+
+static double timespec_diff_s(const struct timespec *start,
+                              const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) +
+           (end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+osd_result setup(void)
+{
+    a_input = arg_file1("i", "input", "<file>",
+                        "recorded trace packets (capture file or packets "
+                        "written by osd_packet_fwrite())");
+    osd_tool_add_arg(a_input);
+
+    a_output = arg_file0("o", "output", "<file>",
+                         "output file (default: stdout)");
+    osd_tool_add_arg(a_output);
+
+    a_type = arg_str1("t", "type", "<stm|ctm>", "type of the trace");
+    osd_tool_add_arg(a_type);
+
+    a_width = arg_int0("w", "width", "<bits>",
+                       "VALWIDTH of the STM or ADDR_WIDTH of the CTM "
+                       "(default: 32)");
+    a_width->ival[0] = 32;
+    osd_tool_add_arg(a_width);
+
+    a_source = arg_int0("s", "source", "<diaddr>",
+                        "only decode events sent by the module with this DI "
+                        "address (default: all)");
+    a_source->ival[0] = -1;
+    osd_tool_add_arg(a_source);
+
+    a_elf = arg_file0("e", "elf", "<file>",
+                      "ELF file to translate CTM addresses into function "
+                      "names");
+    osd_tool_add_arg(a_elf);
+
+    a_sysprint = arg_file0(NULL, "sysprint", "<file>",
+                           "write STM sysprint output to this file");
+    osd_tool_add_arg(a_sysprint);
+
+    a_jobs = arg_int0("j", "jobs", "<N>",
+                      "number of decoding threads "
+                      "(default: number of online CPUs)");
+    a_jobs->ival[0] = 0;
+    osd_tool_add_arg(a_jobs);
+
+    a_chunk_packets = arg_int0(NULL, "chunk-packets", "<N>",
+                               "minimum number of packets in one chunk");
+    a_chunk_packets->ival[0] = DEFAULT_CHUNK_PACKETS;
+    osd_tool_add_arg(a_chunk_packets);
+
+    return OSD_OK;
+}
+
+int run(void)
+{
+    osd_result rv;
+    int exitcode = 0;
+    int fd_in = -1;
+    FILE *fp_out = stdout;
+    FILE *fp_sysprint = NULL;
+    pthread_t *workers = NULL;
+    unsigned int num_workers = 0;
+
+    struct osd_log_ctx *osd_log_ctx;
+    rv = osd_log_new(&osd_log_ctx, cfg.log_level, &osd_log_handler);
+    assert(OSD_SUCCEEDED(rv));
+
+    struct conv_ctx conv = { 0 };
+    pthread_mutex_init(&conv.lock, NULL);
+    pthread_cond_init(&conv.cond, NULL);
+    conv.log_ctx = osd_log_ctx;
+    conv.filename = a_input->filename[0];
+    conv.source = a_source->ival[0];
+
+    if (!strcmp(a_type->sval[0], "stm")) {
+        conv.type = TRACE_TYPE_STM;
+    } else if (!strcmp(a_type->sval[0], "ctm")) {
+        conv.type = TRACE_TYPE_CTM;
+    } else {
+        fatal("Unknown trace type '%s'", a_type->sval[0]);
+        exitcode = 1;
+        goto free_return;
+    }
+
+    int width = a_width->ival[0];
+    if (width != 16 && width != 32 && width != 64) {
+        fatal("Invalid width %d, valid values are 16, 32 and 64.", width);
+        exitcode = 1;
+        goto free_return;
+    }
+    conv.stm_desc.di_addr = conv.source >= 0 ? conv.source : 0;
+    conv.stm_desc.value_width_bit = width;
+    conv.ctm_desc.di_addr = conv.stm_desc.di_addr;
+    conv.ctm_desc.addr_width_bit = width;
+    conv.ctm_desc.data_width_bit = width;
+
+    if (a_elf->count) {
+        if (conv.type != TRACE_TYPE_CTM) {
+            info("Ignoring ELF file, only CTM traces can be symbolized.");
+        } else {
+            rv = osd_symtab_new(&conv.symtab, osd_log_ctx);
+            assert(OSD_SUCCEEDED(rv));
+            rv = osd_symtab_load_elf(conv.symtab, a_elf->filename[0]);
+            if (OSD_FAILED(rv)) {
+                fatal("Unable to read ELF file %s (%d)", a_elf->filename[0],
+                      rv);
+                exitcode = 1;
+                goto free_return;
+            }
+        }
+    }
+
+    if (a_sysprint->count) {
+        if (conv.type != TRACE_TYPE_STM) {
+            info("Ignoring sysprint file, sysprint is only part of STM "
+                 "traces.");
+        } else {
+            fp_sysprint = fopen(a_sysprint->filename[0], "w");
+            if (!fp_sysprint) {
+                fatal("Unable to open sysprint file %s: %s",
+                      a_sysprint->filename[0], strerror(errno));
+                exitcode = 1;
+                goto free_return;
+            }
+            conv.with_sysprint = true;
+        }
+    }
+
+    if (a_output->count) {
+        fp_out = fopen(a_output->filename[0], "w");
+        if (!fp_out) {
+            fatal("Unable to open output file %s: %s", a_output->filename[0],
+                  strerror(errno));
+            fp_out = NULL;
+            exitcode = 1;
+            goto free_return;
+        }
+    }
+
+    conv.is_capture = osd_capture_is_capture_file(conv.filename);
+    if (!conv.is_capture) {
+        // raw packet dump: map the file once and share it between all workers
+        fd_in = open(conv.filename, O_RDONLY);
+        if (fd_in < 0) {
+            fatal("Unable to open input file %s: %s", conv.filename,
+                  strerror(errno));
+            exitcode = 1;
+            goto free_return;
+        }
+        struct stat st;
+        if (fstat(fd_in, &st) != 0) {
+            fatal("Unable to stat input file: %s", strerror(errno));
+            exitcode = 1;
+            goto free_return;
+        }
+        conv.data_len = st.st_size;
+        if (conv.data_len > 0) {
+            void *data = mmap(NULL, conv.data_len, PROT_READ, MAP_PRIVATE,
+                              fd_in, 0);
+            if (data == MAP_FAILED) {
+                fatal("Unable to map input file: %s", strerror(errno));
+                exitcode = 1;
+                goto free_return;
+            }
+            madvise(data, conv.data_len, MADV_SEQUENTIAL);
+            conv.data = data;
+        }
+    }
+
+    struct timespec t_start, t_indexed, t_end;
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+
+    int chunk_packets = a_chunk_packets->ival[0];
+    if (chunk_packets < 1) {
+        chunk_packets = 1;
+    }
+    rv = index_input(&conv, chunk_packets);
+    if (OSD_FAILED(rv)) {
+        fatal("Unable to index input file (%d)", rv);
+        exitcode = 1;
+        goto free_return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t_indexed);
+
+    num_workers = a_jobs->ival[0];
+    if (num_workers == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        num_workers = cpus > 0 ? cpus : 1;
+    }
+    if (num_workers > conv.num_chunks) {
+        num_workers = conv.num_chunks ? conv.num_chunks : 1;
+    }
+    conv.max_in_flight = num_workers * CHUNKS_IN_FLIGHT_PER_WORKER;
+
+    dbg("Split input into %zu chunks, decoding with %u threads.",
+        conv.num_chunks, num_workers);
+
+    workers = calloc(num_workers, sizeof(pthread_t));
+    assert(workers);
+    for (unsigned int i = 0; i < num_workers; i++) {
+        int irv = pthread_create(&workers[i], NULL, worker_thread, &conv);
+        assert(irv == 0);
+    }
+
+    struct conv_stats stats = { 0 };
+    rv = write_chunks(&conv, fp_out, fp_sysprint, &stats);
+    if (OSD_FAILED(rv)) {
+        exitcode = 1;
+    }
+
+    for (unsigned int i = 0; i < num_workers; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t_end);
+
+    double t_total = timespec_diff_s(&t_start, &t_end);
+    info("Decoded %zu events from %zu packets in %.3f s (indexing: %.3f s), "
+         "%.0f packets/s using %u threads.",
+         stats.events, stats.packets, t_total,
+         timespec_diff_s(&t_start, &t_indexed),
+         t_total > 0 ? stats.packets / t_total : 0.0, num_workers);
+    if (stats.overflowed_events) {
+        info("%zu events were lost due to overflows.",
+             stats.overflowed_events);
+    }
+    if (stats.invalid_packets) {
+        err("%zu packets could not be decoded. Check --type and --width.",
+            stats.invalid_packets);
+    }
+
+free_return:
+    free(workers);
+    free(conv.chunks);
+    if (conv.data) {
+        munmap((void *)conv.data, conv.data_len);
+    }
+    if (fd_in >= 0) {
+        close(fd_in);
+    }
+    if (fp_out && fp_out != stdout) {
+        fclose(fp_out);
+    }
+    if (fp_sysprint) {
+        fclose(fp_sysprint);
+    }
+    osd_symtab_free(&conv.symtab);
+    pthread_cond_destroy(&conv.cond);
+    pthread_mutex_destroy(&conv.lock);
+    osd_log_free(&osd_log_ctx);
+    return exitcode;
+}
@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+# Copyright 2018 The Open SoC Debug Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#    http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""
+Compare benchmark results against a baseline
+
+Both files contain one JSON object per line, as written by the benchmarks if
+OSD_BENCH_JSON is set. A case regresses if its throughput dropped, or its
+median or 99th percentile latency increased, by more than the threshold.
+
+Exits with status 1 if any case regressed.
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(filename):
+    results = {}
+    with open(filename) as f:
+        for line in f:
+            line = line.strip()
+            if not line:
+                continue
+            r = json.loads(line)
+            if r['name'] == 'warm-up':
+                continue
+            results[(r['bench'], r['name'])] = r
+    return results
+
+
+def change(base, cur):
+    if base == 0:
+        return 0.0
+    return (cur - base) / base
+
+
+def compare(baseline, current, threshold):
+    """
+    Yield (bench, name, metric, base, cur, change, regressed) for all
+    metrics of all cases in both result sets
+    """
+    for key in sorted(current):
+        if key not in baseline:
+            continue
+        base = baseline[key]
+        cur = current[key]
+
+        c = change(base['items_per_s'], cur['items_per_s'])
+        yield (key + (cur['unit'] + '/s', base['items_per_s'],
+                      cur['items_per_s'], c, c < -threshold))
+
+        if 'latency_ns' in base and 'latency_ns' in cur:
+            for p in ('p50', 'p99'):
+                b = base['latency_ns'][p]
+                n = cur['latency_ns'][p]
+                c = change(b, n)
+                yield (key + ('latency ' + p + ' ns', b, n, c,
+                              c > threshold))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.strip().split('\n')[0])
+    parser.add_argument('baseline', help='stored baseline results')
+    parser.add_argument('current', help='results of the current build')
+    parser.add_argument('-t', '--threshold', type=float, default=10.0,
+                        help='allowed change in percent (default: 10)')
+    args = parser.parse_args()
+
+    baseline = load(args.baseline)
+    current = load(args.current)
+    threshold = args.threshold / 100
+
+    regressions = 0
+    print('%-16s %-24s %-20s %14s %14s %8s' %
+          ('bench', 'case', 'metric', 'baseline', 'current', 'change'))
+    for bench, name, metric, base, cur, c, regressed in \
+            compare(baseline, current, threshold):
+        print('%-16s %-24s %-20s %14.1f %14.1f %+7.1f%% %s' %
+              (bench, name, metric, base, cur, c * 100,
+               'REGRESSION' if regressed else ''))
+        if regressed:
+            regressions += 1
+
+    for key in sorted(set(baseline) - set(current)):
+        print('%s: %s missing in current results' % key)
+    for key in sorted(set(current) - set(baseline)):
+        print('%s: %s not in baseline' % key)
+
+    if regressions:
+        print('%d regression(s) beyond %.1f%%' % (regressions, args.threshold))
+        return 1
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
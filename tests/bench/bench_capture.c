@@ -0,0 +1,170 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Throughput benchmark: packet dumps (osd_packet_fwrite()/osd_packet_fread())
+ * vs. capture files (osd_capture_writer_*()/osd_capture_reader_*())
+ *
+ * Usage: bench_capture [NUM_PACKETS]
+ */
+
+#include <osd/osd.h>
+#include <osd/capture.h>
+#include <osd/packet.h>
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "benchutil.h"
+
+#define NUM_PACKETS_DEFAULT 2000000
+
+static struct osd_packet **pkgs;
+static size_t num_pkgs;
+static size_t pkgs_bytes;
+
+/**
+ * Create trace-like packets with 1 to 12 payload words
+ */
+static void create_packets(void)
+{
+    osd_result rv;
+
+    pkgs = calloc(num_pkgs, sizeof(struct osd_packet *));
+    assert(pkgs);
+    srand(1);
+    for (size_t i = 0; i < num_pkgs; i++) {
+        unsigned int payload_words = 1 + rand() % 12;
+        rv = osd_packet_new(&pkgs[i],
+                            osd_packet_sizeconv_payload2data(payload_words));
+        assert(OSD_SUCCEEDED(rv));
+        osd_packet_set_header(pkgs[i], 0, 2 + i % 4, OSD_PACKET_TYPE_EVENT, 0);
+        for (unsigned int w = 0; w < payload_words; w++) {
+            pkgs[i]->data.payload[w] = rand();
+        }
+        pkgs_bytes += osd_packet_sizeof(pkgs[i]);
+    }
+}
+
+static void report(const char *name, double t)
+{
+    struct bench_result r = {
+        .bench = "bench_capture",
+        .name = name,
+        .unit = "packets",
+        .items = num_pkgs,
+        .bytes = pkgs_bytes,
+        .seconds = t,
+    };
+    bench_report(&r);
+}
+
+static void bench_packet_dump(const char *filename)
+{
+    double t;
+    size_t count = 0;
+
+    FILE *fp = fopen(filename, "wb");
+    assert(fp);
+    t = bench_now_s();
+    for (size_t i = 0; i < num_pkgs; i++) {
+        bool ok = osd_packet_fwrite(pkgs[i], fp);
+        assert(ok);
+    }
+    fclose(fp);
+    report("dump write", bench_now_s() - t);
+
+    fp = fopen(filename, "rb");
+    assert(fp);
+    t = bench_now_s();
+    struct osd_packet *pkg;
+    while ((pkg = osd_packet_fread(fp))) {
+        count++;
+        osd_packet_free(&pkg);
+    }
+    report("dump read", bench_now_s() - t);
+    fclose(fp);
+    assert(count == num_pkgs);
+}
+
+static void bench_capture(const char *filename)
+{
+    osd_result rv;
+    double t;
+    size_t count = 0;
+
+    FILE *fp = fopen(filename, "wb");
+    assert(fp);
+    t = bench_now_s();
+    struct osd_capture_writer_ctx *writer;
+    rv = osd_capture_writer_new(&writer, NULL, fp, 0);
+    assert(OSD_SUCCEEDED(rv));
+    for (size_t i = 0; i < num_pkgs; i++) {
+        rv = osd_capture_writer_write(writer, pkgs[i],
+                                      osd_capture_timestamp_now());
+        assert(OSD_SUCCEEDED(rv));
+    }
+    rv = osd_capture_writer_flush(writer);
+    assert(OSD_SUCCEEDED(rv));
+    osd_capture_writer_free(&writer);
+    fclose(fp);
+    report("capture write", bench_now_s() - t);
+
+    t = bench_now_s();
+    struct osd_capture_reader_ctx *reader;
+    rv = osd_capture_reader_new(&reader, NULL, filename);
+    assert(OSD_SUCCEEDED(rv));
+    while (1) {
+        const struct osd_packet *pkg;
+        rv = osd_capture_reader_next(reader, &pkg, NULL);
+        assert(OSD_SUCCEEDED(rv));
+        if (!pkg) {
+            break;
+        }
+        count++;
+    }
+    osd_capture_reader_free(&reader);
+    report("capture read", bench_now_s() - t);
+    assert(count == num_pkgs);
+}
+
+int main(int argc, char **argv)
+{
+    num_pkgs = NUM_PACKETS_DEFAULT;
+    if (argc > 1) {
+        num_pkgs = strtoul(argv[1], NULL, 0);
+    }
+
+    char filename[] = "/tmp/bench_capture_XXXXXX";
+    int fd = mkstemp(filename);
+    assert(fd >= 0);
+    close(fd);
+
+    create_packets();
+    printf("%zu packets, %.1f MB\n", num_pkgs, pkgs_bytes / 1e6);
+
+    bench_packet_dump(filename);
+    bench_capture(filename);
+
+    unlink(filename);
+    for (size_t i = 0; i < num_pkgs; i++) {
+        osd_packet_free(&pkgs[i]);
+    }
+    free(pkgs);
+
+    return 0;
+}
@@ -0,0 +1,216 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Throughput benchmark: sending data to a DEM-UART through the host software
+ * (osd_hostmod -> osd_hostctrl -> osd_gateway -> device)
+ *
+ * The data is sent once character by character (one call to
+ * osd_cl_dem_uart_send_string() per character), and once in chunks as the
+ * terminal does it. The throughput is measured until all characters have
+ * arrived at the emulated device.
+ *
+ * Usage: bench_dem_uart [NUM_BYTES] [CHUNK_SIZE]
+ */
+
+#include <osd/osd.h>
+#include <osd/cl_dem_uart.h>
+#include <osd/gateway.h>
+#include <osd/hostctrl.h>
+#include <osd/hostmod.h>
+#include <osd/latency.h>
+#include <osd/packet.h>
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "benchutil.h"
+
+#define NUM_BYTES_DEFAULT (256 * 1024)
+#define CHUNK_SIZE_DEFAULT 4096
+
+#define HOSTCTRL_EP "inproc://bench-dem-uart"
+
+/** Subnet of the emulated device */
+#define DEVICE_SUBNET_ADDRESS 0
+
+/** The DEM-UART in the emulated device */
+#define DEM_UART_LOCALADDR 2
+
+/**
+ * Emulated device: counts the received characters
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    size_t rx_bytes;
+    bool connected;
+} dev = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static osd_result dev_packet_read(struct osd_packet **pkg, void *cb_arg)
+{
+    // the device never sends anything
+    pthread_mutex_lock(&dev.lock);
+    while (dev.connected) {
+        pthread_cond_wait(&dev.cond, &dev.lock);
+    }
+    pthread_mutex_unlock(&dev.lock);
+
+    return OSD_ERROR_NOT_CONNECTED;
+}
+
+static osd_result dev_packet_write(const struct osd_packet *pkg, void *cb_arg)
+{
+    if (osd_packet_get_type(pkg) != OSD_PACKET_TYPE_EVENT) {
+        return OSD_OK;
+    }
+
+    pthread_mutex_lock(&dev.lock);
+    dev.rx_bytes++;
+    pthread_cond_broadcast(&dev.cond);
+    pthread_mutex_unlock(&dev.lock);
+
+    return OSD_OK;
+}
+
+static void dev_wait_for_bytes(size_t num_bytes)
+{
+    pthread_mutex_lock(&dev.lock);
+    while (dev.rx_bytes < num_bytes) {
+        pthread_cond_wait(&dev.cond, &dev.lock);
+    }
+    dev.rx_bytes = 0;
+    pthread_mutex_unlock(&dev.lock);
+}
+
+static void dev_disconnect(void)
+{
+    pthread_mutex_lock(&dev.lock);
+    dev.connected = false;
+    pthread_cond_broadcast(&dev.cond);
+    pthread_mutex_unlock(&dev.lock);
+}
+
+static void bench_send(struct osd_hostmod_ctx *hostmod_ctx,
+                       struct osd_dem_uart_desc *desc, const char *name,
+                       const char *data, size_t num_bytes, size_t chunk_size)
+{
+    osd_result rv;
+
+    uint64_t t_start = osd_latency_now();
+    for (size_t pos = 0; pos < num_bytes; pos += chunk_size) {
+        size_t len = num_bytes - pos < chunk_size ? num_bytes - pos
+                                                  : chunk_size;
+        rv = osd_cl_dem_uart_send_string(hostmod_ctx, desc, data + pos, len);
+        assert(OSD_SUCCEEDED(rv));
+    }
+    dev_wait_for_bytes(num_bytes);
+    double t_total = (osd_latency_now() - t_start) / 1e9;
+
+    struct bench_result r = {
+        .bench = "bench_dem_uart",
+        .name = name,
+        .unit = "bytes",
+        .items = num_bytes,
+        .bytes = num_bytes,
+        .seconds = t_total,
+    };
+    bench_report(&r);
+}
+
+int main(int argc, char **argv)
+{
+    osd_result rv;
+    size_t num_bytes = NUM_BYTES_DEFAULT;
+    size_t chunk_size = CHUNK_SIZE_DEFAULT;
+
+    if (argc > 1) {
+        num_bytes = strtoul(argv[1], NULL, 0);
+    }
+    if (argc > 2) {
+        chunk_size = strtoul(argv[2], NULL, 0);
+    }
+    assert(num_bytes > 0 && chunk_size > 0);
+
+    zsys_init();
+
+    struct osd_log_ctx *log_ctx;
+    rv = osd_log_new(&log_ctx, LOG_ERR, NULL);
+    assert(OSD_SUCCEEDED(rv));
+
+    struct osd_hostctrl_ctx *hostctrl_ctx;
+    rv = osd_hostctrl_new(&hostctrl_ctx, log_ctx, HOSTCTRL_EP);
+    assert(OSD_SUCCEEDED(rv));
+    rv = osd_hostctrl_start(hostctrl_ctx);
+    assert(OSD_SUCCEEDED(rv));
+
+    dev.connected = true;
+    struct osd_gateway_ctx *gateway_ctx;
+    rv = osd_gateway_new(&gateway_ctx, log_ctx, HOSTCTRL_EP,
+                         DEVICE_SUBNET_ADDRESS, dev_packet_read,
+                         dev_packet_write, NULL);
+    assert(OSD_SUCCEEDED(rv));
+    rv = osd_gateway_connect(gateway_ctx);
+    assert(OSD_SUCCEEDED(rv));
+
+    struct osd_hostmod_ctx *hostmod_ctx;
+    rv = osd_hostmod_new(&hostmod_ctx, log_ctx, HOSTCTRL_EP, NULL, NULL);
+    assert(OSD_SUCCEEDED(rv));
+    rv = osd_hostmod_connect(hostmod_ctx);
+    assert(OSD_SUCCEEDED(rv));
+
+    struct osd_dem_uart_desc desc = {
+        .di_addr = osd_diaddr_build(DEVICE_SUBNET_ADDRESS, DEM_UART_LOCALADDR),
+    };
+
+    char *data = malloc(num_bytes);
+    assert(data);
+    for (size_t i = 0; i < num_bytes; i++) {
+        data[i] = ' ' + i % 95;
+    }
+
+    printf("%zu bytes, chunk size %zu bytes\n", num_bytes, chunk_size);
+
+    // warm up
+    bench_send(hostmod_ctx, &desc, "warm-up", data, num_bytes / 10 + 1,
+               chunk_size);
+
+    bench_send(hostmod_ctx, &desc, "per character", data, num_bytes, 1);
+    bench_send(hostmod_ctx, &desc, "chunked", data, num_bytes, chunk_size);
+
+    free(data);
+
+    rv = osd_hostmod_disconnect(hostmod_ctx);
+    assert(OSD_SUCCEEDED(rv));
+    osd_hostmod_free(&hostmod_ctx);
+
+    dev_disconnect();
+    rv = osd_gateway_disconnect(gateway_ctx);
+    assert(OSD_SUCCEEDED(rv));
+    osd_gateway_free(&gateway_ctx);
+
+    rv = osd_hostctrl_stop(hostctrl_ctx);
+    assert(OSD_SUCCEEDED(rv));
+    osd_hostctrl_free(&hostctrl_ctx);
+
+    osd_log_free(&log_ctx);
+
+    return 0;
+}
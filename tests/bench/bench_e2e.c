@@ -0,0 +1,558 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * End-to-end benchmark: packets flowing through the whole host software
+ *
+ * - event tx: osd_hostmod -> osd_hostctrl -> osd_gateway -> device
+ * - event rx: device -> osd_gateway -> osd_hostctrl -> osd_hostmod, with and
+ *   without splitting the events into multiple packets (event reassembly)
+ * - host to host: osd_hostmod -> osd_hostctrl -> osd_hostmod (routing within
+ *   the host subnet)
+ * - mam write: osd_cl_mam_write() to a memory in the device (MAM
+ *   packetization and synchronous completion)
+ *
+ * The device is emulated in-process. Every event carries the time it was
+ * created in its payload, the latency is measured from there to the
+ * reception at the other end. To avoid overrunning the queues the number of
+ * events in flight is limited to WINDOW_SIZE.
+ *
+ * Usage: bench_e2e [NUM_EVENTS]
+ */
+
+#include <osd/osd.h>
+#include <osd/cl_mam.h>
+#include <osd/gateway.h>
+#include <osd/hostctrl.h>
+#include <osd/hostmod.h>
+#include <osd/latency.h>
+#include <osd/packet.h>
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "benchutil.h"
+
+#define NUM_EVENTS_DEFAULT 200000
+
+#define BENCH_NAME "bench_e2e"
+
+#define HOSTCTRL_EP "inproc://bench-e2e"
+
+/** Subnet of the emulated device */
+#define DEVICE_SUBNET_ADDRESS 0
+
+/** The debug module in the emulated device sending and receiving events */
+#define EVENT_LOCALADDR 2
+
+/** The MAM in the emulated device */
+#define MAM_LOCALADDR 3
+
+/** Address and data width of the emulated memory (in bytes) */
+#define MAM_AW_BYTES 4
+#define MAM_DW_BYTES 4
+
+/** Size of a single osd_cl_mam_write() call */
+#define MAM_WRITE_SIZE 4096
+
+/** Maximum number of events in flight */
+#define WINDOW_SIZE 256
+
+/** Number of events passed to osd_hostmod_event_send_batch() at once */
+#define SEND_BATCH_SIZE 64
+
+/** Payload of the largest packet on the debug interconnect (in words) */
+#define MAX_PAYLOAD_WORDS 5
+
+/** The creation timestamp occupies the first four payload words */
+#define TIMESTAMP_WORDS 4
+
+/**
+ * Statistics of received events, shared between the producer and the
+ * receiver of a scenario
+ */
+struct rx_stats {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint64_t events;
+    uint64_t bytes;
+    struct bench_latency latency;
+};
+
+/**
+ * Emulated device
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool connected;
+
+    /** packets to be sent to the host (responses of the MAM) */
+    zlist_t *tx_queue;
+
+    /** events to be generated and sent to the host (event rx scenario) */
+    uint64_t gen_events_remaining;
+    unsigned int gen_fragments;
+    unsigned int gen_fragment_idx;
+    uint16_t gen_dest;
+    uint64_t gen_events;
+
+    /** bytes left in the current MAM transfer */
+    size_t mam_remaining;
+    bool mam_sync;
+} dev = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+/** events received by the device */
+static struct rx_stats dev_rx = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+/** events received by the host module with the event handler */
+static struct rx_stats host_rx = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static void stamp_payload(struct osd_packet *pkg, uint64_t t)
+{
+    for (unsigned int i = 0; i < TIMESTAMP_WORDS; i++) {
+        pkg->data.payload[i] = (t >> (i * 16)) & 0xffff;
+    }
+}
+
+static uint64_t read_stamp(const struct osd_packet *pkg)
+{
+    uint64_t t = 0;
+    for (unsigned int i = 0; i < TIMESTAMP_WORDS; i++) {
+        t |= (uint64_t)pkg->data.payload[i] << (i * 16);
+    }
+    return t;
+}
+
+static void rx_stats_add(struct rx_stats *stats, const struct osd_packet *pkg)
+{
+    uint64_t latency = osd_latency_now() - read_stamp(pkg);
+
+    pthread_mutex_lock(&stats->lock);
+    stats->events++;
+    stats->bytes += osd_packet_sizeof(pkg);
+    bench_latency_add(&stats->latency, latency);
+    pthread_cond_broadcast(&stats->cond);
+    pthread_mutex_unlock(&stats->lock);
+}
+
+static void rx_stats_reset(struct rx_stats *stats)
+{
+    pthread_mutex_lock(&stats->lock);
+    stats->events = 0;
+    stats->bytes = 0;
+    bench_latency_reset(&stats->latency);
+    pthread_mutex_unlock(&stats->lock);
+}
+
+/**
+ * Wait until at least @p num_events events have been received
+ */
+static void rx_stats_wait(struct rx_stats *stats, uint64_t num_events)
+{
+    pthread_mutex_lock(&stats->lock);
+    while (stats->events < num_events) {
+        pthread_cond_wait(&stats->cond, &stats->lock);
+    }
+    pthread_mutex_unlock(&stats->lock);
+}
+
+static void dev_wake_up(void)
+{
+    pthread_mutex_lock(&dev.lock);
+    pthread_cond_signal(&dev.cond);
+    pthread_mutex_unlock(&dev.lock);
+}
+
+static osd_result host_event_handler(void *arg, struct osd_packet *pkg)
+{
+    rx_stats_add(&host_rx, pkg);
+    osd_packet_free(&pkg);
+
+    // the device might wait for free space in the window
+    dev_wake_up();
+    return OSD_OK;
+}
+
+/**
+ * Create the next fragment of the generated events
+ *
+ * Must be called with dev.lock held.
+ */
+static struct osd_packet *dev_generate_fragment(void)
+{
+    osd_result rv;
+    struct osd_packet *pkg;
+
+    bool last = (dev.gen_fragment_idx == dev.gen_fragments - 1);
+    rv = osd_packet_new(&pkg,
+                        osd_packet_sizeconv_payload2data(MAX_PAYLOAD_WORDS));
+    assert(OSD_SUCCEEDED(rv));
+    osd_packet_set_header(pkg, dev.gen_dest,
+                          osd_diaddr_build(DEVICE_SUBNET_ADDRESS,
+                                           EVENT_LOCALADDR),
+                          OSD_PACKET_TYPE_EVENT, last ? EV_LAST : EV_CONT);
+    if (dev.gen_fragment_idx == 0) {
+        stamp_payload(pkg, osd_latency_now());
+    } else {
+        memset(pkg->data.payload, 0, MAX_PAYLOAD_WORDS * sizeof(uint16_t));
+    }
+
+    if (last) {
+        dev.gen_fragment_idx = 0;
+        dev.gen_events_remaining--;
+        dev.gen_events++;
+    } else {
+        dev.gen_fragment_idx++;
+    }
+    return pkg;
+}
+
+static bool dev_can_generate(void)
+{
+    if (!dev.gen_events_remaining) {
+        return false;
+    }
+    // only limit the window at event boundaries
+    if (dev.gen_fragment_idx != 0) {
+        return true;
+    }
+    pthread_mutex_lock(&host_rx.lock);
+    bool window_free = (dev.gen_events - host_rx.events < WINDOW_SIZE);
+    pthread_mutex_unlock(&host_rx.lock);
+    return window_free;
+}
+
+static osd_result dev_packet_read(struct osd_packet **pkg, void *cb_arg)
+{
+    pthread_mutex_lock(&dev.lock);
+    while (1) {
+        if (!dev.connected) {
+            pthread_mutex_unlock(&dev.lock);
+            return OSD_ERROR_NOT_CONNECTED;
+        }
+        if (zlist_size(dev.tx_queue)) {
+            *pkg = zlist_pop(dev.tx_queue);
+            break;
+        }
+        if (dev_can_generate()) {
+            *pkg = dev_generate_fragment();
+            break;
+        }
+        // woken up by new responses, new events to generate, and by the
+        // host module receiving an event
+        pthread_cond_wait(&dev.cond, &dev.lock);
+    }
+    pthread_mutex_unlock(&dev.lock);
+
+    return OSD_OK;
+}
+
+/**
+ * Emulate a MAM: acknowledge all synchronous transfers
+ *
+ * Must be called with dev.lock held.
+ */
+static void dev_mam_receive(const struct osd_packet *pkg)
+{
+    osd_result rv;
+
+    if (dev.mam_remaining == 0) {
+        // first packet of a transfer: HDR0, HDR1 (SELSIZE), ADDR, DATA
+        uint8_t hdr0 = pkg->data.payload[0] >> 8;
+        uint8_t selsize = pkg->data.payload[0] & 0xff;
+        bool we = hdr0 >> 7 & 1;
+        bool burst = hdr0 >> 6 & 1;
+        dev.mam_sync = hdr0 >> 5 & 1;
+        size_t data_bytes = we ? (burst ? selsize : 1) * MAM_DW_BYTES : 0;
+        dev.mam_remaining = 2 + MAM_AW_BYTES + data_bytes;
+    }
+
+    size_t payload_bytes =
+        osd_packet_sizeconv_data2payload(pkg->data_size_words) *
+        sizeof(uint16_t);
+    assert(payload_bytes <= dev.mam_remaining);
+    dev.mam_remaining -= payload_bytes;
+
+    if (dev.mam_remaining == 0 && dev.mam_sync) {
+        struct osd_packet *ack;
+        rv = osd_packet_new(&ack, osd_packet_sizeconv_payload2data(0));
+        assert(OSD_SUCCEEDED(rv));
+        osd_packet_set_header(ack, osd_packet_get_src(pkg),
+                              osd_packet_get_dest(pkg), OSD_PACKET_TYPE_EVENT,
+                              EV_LAST);
+        zlist_append(dev.tx_queue, ack);
+        pthread_cond_signal(&dev.cond);
+    }
+}
+
+static osd_result dev_packet_write(const struct osd_packet *pkg, void *cb_arg)
+{
+    if (osd_packet_get_type(pkg) != OSD_PACKET_TYPE_EVENT) {
+        return OSD_OK;
+    }
+
+    if (osd_packet_get_dest(pkg) ==
+        osd_diaddr_build(DEVICE_SUBNET_ADDRESS, MAM_LOCALADDR)) {
+        pthread_mutex_lock(&dev.lock);
+        dev_mam_receive(pkg);
+        pthread_mutex_unlock(&dev.lock);
+        return OSD_OK;
+    }
+
+    rx_stats_add(&dev_rx, pkg);
+    return OSD_OK;
+}
+
+static void dev_disconnect(void)
+{
+    pthread_mutex_lock(&dev.lock);
+    dev.connected = false;
+    pthread_cond_signal(&dev.cond);
+    pthread_mutex_unlock(&dev.lock);
+}
+
+static void report(const char *name, const char *unit, uint64_t items,
+                   uint64_t bytes, double t, struct bench_latency *latency)
+{
+    struct bench_result r = {
+        .bench = BENCH_NAME,
+        .name = name,
+        .unit = unit,
+        .items = items,
+        .bytes = bytes,
+        .seconds = t,
+        .latency = latency,
+    };
+    bench_report(&r);
+}
+
+/**
+ * Send events from a host module to @p dest and wait until they arrived
+ *
+ * @param stats the statistics of the receiver
+ */
+static void send_events(struct osd_hostmod_ctx *hostmod_ctx,
+                        struct rx_stats *stats, const char *name,
+                        uint16_t dest, uint64_t num_events)
+{
+    osd_result rv;
+    struct osd_packet *batch[SEND_BATCH_SIZE];
+
+    for (size_t i = 0; i < SEND_BATCH_SIZE; i++) {
+        rv = osd_packet_new(&batch[i], osd_packet_sizeconv_payload2data(
+                                           MAX_PAYLOAD_WORDS));
+        assert(OSD_SUCCEEDED(rv));
+        osd_packet_set_header(batch[i], dest,
+                              osd_hostmod_get_diaddr(hostmod_ctx),
+                              OSD_PACKET_TYPE_EVENT, EV_LAST);
+        batch[i]->data.payload[TIMESTAMP_WORDS] = i;
+    }
+
+    rx_stats_reset(stats);
+    double t = bench_now_s();
+    for (uint64_t sent = 0; sent < num_events;) {
+        size_t num = num_events - sent < SEND_BATCH_SIZE ? num_events - sent
+                                                         : SEND_BATCH_SIZE;
+
+        // keep at most WINDOW_SIZE events in flight
+        if (sent + num > WINDOW_SIZE) {
+            rx_stats_wait(stats, sent + num - WINDOW_SIZE);
+        }
+
+        uint64_t now = osd_latency_now();
+        for (size_t i = 0; i < num; i++) {
+            stamp_payload(batch[i], now);
+        }
+        rv = osd_hostmod_event_send_batch(
+            hostmod_ctx, (const struct osd_packet *const *)batch, num);
+        assert(OSD_SUCCEEDED(rv));
+        sent += num;
+    }
+    rx_stats_wait(stats, num_events);
+    t = bench_now_s() - t;
+
+    report(name, "events", stats->events, stats->bytes, t, &stats->latency);
+
+    for (size_t i = 0; i < SEND_BATCH_SIZE; i++) {
+        osd_packet_free(&batch[i]);
+    }
+}
+
+/**
+ * Let the device send events to a host module and wait until they arrived
+ */
+static void receive_events(struct osd_hostmod_ctx *hostmod_ctx,
+                           const char *name, uint64_t num_events,
+                           unsigned int fragments)
+{
+    rx_stats_reset(&host_rx);
+    double t = bench_now_s();
+
+    pthread_mutex_lock(&dev.lock);
+    dev.gen_dest = osd_hostmod_get_diaddr(hostmod_ctx);
+    dev.gen_fragments = fragments;
+    dev.gen_fragment_idx = 0;
+    dev.gen_events = 0;
+    dev.gen_events_remaining = num_events;
+    pthread_cond_signal(&dev.cond);
+    pthread_mutex_unlock(&dev.lock);
+
+    rx_stats_wait(&host_rx, num_events);
+    t = bench_now_s() - t;
+
+    report(name, "events", host_rx.events, host_rx.bytes, t,
+           &host_rx.latency);
+}
+
+static void mam_write(struct osd_hostmod_ctx *hostmod_ctx, const char *name,
+                      unsigned int num_writes)
+{
+    osd_result rv;
+    struct bench_latency latency = { 0 };
+    struct osd_mem_desc mem_desc = {
+        .di_addr = osd_diaddr_build(DEVICE_SUBNET_ADDRESS, MAM_LOCALADDR),
+        .data_width_bit = MAM_DW_BYTES * 8,
+        .addr_width_bit = MAM_AW_BYTES * 8,
+        .num_regions = 1,
+        .regions = { { .baseaddr = 0, .memsize = 64 * 1024 * 1024 } },
+    };
+
+    uint8_t *data = malloc(MAM_WRITE_SIZE);
+    assert(data);
+    for (size_t i = 0; i < MAM_WRITE_SIZE; i++) {
+        data[i] = i;
+    }
+
+    double t = bench_now_s();
+    for (unsigned int i = 0; i < num_writes; i++) {
+        uint64_t t_write = osd_latency_now();
+        rv = osd_cl_mam_write(&mem_desc, hostmod_ctx, data, MAM_WRITE_SIZE,
+                              (uint64_t)i * MAM_WRITE_SIZE);
+        assert(OSD_SUCCEEDED(rv));
+        bench_latency_add(&latency, osd_latency_now() - t_write);
+    }
+    t = bench_now_s() - t;
+
+    report(name, "writes", num_writes, (uint64_t)num_writes * MAM_WRITE_SIZE,
+           t, &latency);
+    bench_latency_free(&latency);
+    free(data);
+}
+
+int main(int argc, char **argv)
+{
+    osd_result rv;
+    uint64_t num_events = NUM_EVENTS_DEFAULT;
+
+    if (argc > 1) {
+        num_events = strtoull(argv[1], NULL, 0);
+    }
+    assert(num_events > 0);
+
+    zsys_init();
+
+    struct osd_log_ctx *log_ctx;
+    rv = osd_log_new(&log_ctx, LOG_ERR, NULL);
+    assert(OSD_SUCCEEDED(rv));
+
+    struct osd_hostctrl_ctx *hostctrl_ctx;
+    rv = osd_hostctrl_new(&hostctrl_ctx, log_ctx, HOSTCTRL_EP);
+    assert(OSD_SUCCEEDED(rv));
+    rv = osd_hostctrl_start(hostctrl_ctx);
+    assert(OSD_SUCCEEDED(rv));
+
+    dev.tx_queue = zlist_new();
+    dev.connected = true;
+    struct osd_gateway_ctx *gateway_ctx;
+    rv = osd_gateway_new(&gateway_ctx, log_ctx, HOSTCTRL_EP,
+                         DEVICE_SUBNET_ADDRESS, dev_packet_read,
+                         dev_packet_write, NULL);
+    assert(OSD_SUCCEEDED(rv));
+    rv = osd_gateway_connect(gateway_ctx);
+    assert(OSD_SUCCEEDED(rv));
+
+    // sends events and accesses the MAM
+    struct osd_hostmod_ctx *hostmod_tx;
+    rv = osd_hostmod_new(&hostmod_tx, log_ctx, HOSTCTRL_EP, NULL, NULL);
+    assert(OSD_SUCCEEDED(rv));
+    rv = osd_hostmod_connect(hostmod_tx);
+    assert(OSD_SUCCEEDED(rv));
+
+    // receives events in an event handler
+    struct osd_hostmod_ctx *hostmod_rx;
+    rv = osd_hostmod_new(&hostmod_rx, log_ctx, HOSTCTRL_EP, host_event_handler,
+                         NULL);
+    assert(OSD_SUCCEEDED(rv));
+    rv = osd_hostmod_connect(hostmod_rx);
+    assert(OSD_SUCCEEDED(rv));
+
+    uint16_t dev_event_dest = osd_diaddr_build(DEVICE_SUBNET_ADDRESS,
+                                               EVENT_LOCALADDR);
+    unsigned int num_mam_writes = num_events / 100 + 1;
+
+    printf("%" PRIu64 " events, %u MAM writes of %u bytes\n", num_events,
+           num_mam_writes, MAM_WRITE_SIZE);
+
+    // warm up
+    send_events(hostmod_tx, &dev_rx, "warm-up", dev_event_dest,
+                num_events / 10 + 1);
+
+    send_events(hostmod_tx, &dev_rx, "event tx", dev_event_dest, num_events);
+    receive_events(hostmod_rx, "event rx", num_events, 1);
+    receive_events(hostmod_rx, "event rx 4 fragments", num_events / 4 + 1, 4);
+    send_events(hostmod_tx, &host_rx, "host to host",
+                osd_hostmod_get_diaddr(hostmod_rx), num_events);
+    mam_write(hostmod_tx, "mam write", num_mam_writes);
+
+    rv = osd_hostmod_disconnect(hostmod_rx);
+    assert(OSD_SUCCEEDED(rv));
+    osd_hostmod_free(&hostmod_rx);
+    rv = osd_hostmod_disconnect(hostmod_tx);
+    assert(OSD_SUCCEEDED(rv));
+    osd_hostmod_free(&hostmod_tx);
+
+    dev_disconnect();
+    rv = osd_gateway_disconnect(gateway_ctx);
+    assert(OSD_SUCCEEDED(rv));
+    osd_gateway_free(&gateway_ctx);
+
+    rv = osd_hostctrl_stop(hostctrl_ctx);
+    assert(OSD_SUCCEEDED(rv));
+    osd_hostctrl_free(&hostctrl_ctx);
+
+    while (zlist_size(dev.tx_queue)) {
+        struct osd_packet *pkg = zlist_pop(dev.tx_queue);
+        osd_packet_free(&pkg);
+    }
+    zlist_destroy(&dev.tx_queue);
+    bench_latency_free(&dev_rx.latency);
+    bench_latency_free(&host_rx.latency);
+    osd_log_free(&log_ctx);
+
+    return 0;
+}
@@ -0,0 +1,319 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Microbenchmarks of the building blocks of the host software
+ *
+ * - packet primitives (allocation, header access)
+ * - event reassembly (combining EV_CONT fragments into one packet)
+ * - STM and CTM event decoding
+ * - handoff of a message between two threads over an inproc PAIR socket, as
+ *   done between a worker and its main thread
+ *
+ * The host controller routing and the MAM packetization are measured in
+ * bench_e2e, as they cannot be exercised without the surrounding threads.
+ *
+ * Usage: bench_micro [ITERATIONS]
+ */
+
+#include <osd/osd.h>
+#include <osd/cl_ctm.h>
+#include <osd/cl_stm.h>
+#include <osd/packet.h>
+
+#include <assert.h>
+#include <czmq.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "benchutil.h"
+
+#define ITERATIONS_DEFAULT 2000000
+
+#define BENCH_NAME "bench_micro"
+
+/** Number of packets the access benchmarks cycle through */
+#define NUM_PKGS 4096
+
+/** Number of fragments an event is split into for the reassembly */
+#define NUM_FRAGMENTS 4
+
+/** Size of the largest packet on the debug interconnect (in 16 bit words) */
+#define MAX_PKG_LEN_WORDS 8
+
+#define HANDOFF_EP "inproc://bench-micro-handoff"
+
+/** Keeps the compiler from optimizing away the benchmarked code */
+static volatile uint64_t sink;
+
+static void report(const char *name, const char *unit, uint64_t items,
+                   uint64_t bytes, double t, struct bench_latency *latency)
+{
+    struct bench_result r = {
+        .bench = BENCH_NAME,
+        .name = name,
+        .unit = unit,
+        .items = items,
+        .bytes = bytes,
+        .seconds = t,
+        .latency = latency,
+    };
+    bench_report(&r);
+}
+
+static struct osd_packet *create_event(unsigned int payload_words,
+                                       unsigned int type_sub, unsigned int i)
+{
+    osd_result rv;
+    struct osd_packet *pkg;
+
+    rv = osd_packet_new(&pkg, osd_packet_sizeconv_payload2data(payload_words));
+    assert(OSD_SUCCEEDED(rv));
+    osd_packet_set_header(pkg, 1, 2 + i % 4, OSD_PACKET_TYPE_EVENT, type_sub);
+    for (unsigned int w = 0; w < payload_words; w++) {
+        pkg->data.payload[w] = i + w;
+    }
+    return pkg;
+}
+
+static void bench_packet_new_free(unsigned int iterations)
+{
+    osd_result rv;
+    uint64_t bytes = 0;
+
+    double t = bench_now_s();
+    for (unsigned int i = 0; i < iterations; i++) {
+        struct osd_packet *pkg;
+        rv = osd_packet_new(&pkg, osd_packet_sizeconv_payload2data(8));
+        assert(OSD_SUCCEEDED(rv));
+        osd_packet_set_header(pkg, 1, 2, OSD_PACKET_TYPE_EVENT, 0);
+        bytes += osd_packet_sizeof(pkg);
+        osd_packet_free(&pkg);
+    }
+    report("packet new/free", "packets", iterations, bytes,
+           bench_now_s() - t, NULL);
+}
+
+static void bench_packet_header(unsigned int iterations)
+{
+    struct osd_packet *pkgs[NUM_PKGS];
+    for (unsigned int i = 0; i < NUM_PKGS; i++) {
+        pkgs[i] = create_event(1 + i % 12, EV_LAST, i);
+    }
+
+    uint64_t sum = 0;
+    double t = bench_now_s();
+    for (unsigned int i = 0; i < iterations; i++) {
+        const struct osd_packet *pkg = pkgs[i % NUM_PKGS];
+        sum += osd_packet_get_dest(pkg) + osd_packet_get_src(pkg) +
+               osd_packet_get_type(pkg) + osd_packet_get_type_sub(pkg);
+    }
+    report("packet header access", "packets", iterations, 0,
+           bench_now_s() - t, NULL);
+    sink = sum;
+
+    for (unsigned int i = 0; i < NUM_PKGS; i++) {
+        osd_packet_free(&pkgs[i]);
+    }
+}
+
+/**
+ * Reassemble events the way the host module does: the first fragment is
+ * copied, all following fragments are appended to it.
+ */
+static void bench_event_reassembly(unsigned int iterations)
+{
+    osd_result rv;
+    struct osd_packet *frags[NUM_FRAGMENTS];
+    unsigned int max_payload =
+        osd_packet_sizeconv_data2payload(MAX_PKG_LEN_WORDS);
+    for (unsigned int i = 0; i < NUM_FRAGMENTS; i++) {
+        frags[i] = create_event(max_payload,
+                                i == NUM_FRAGMENTS - 1 ? EV_LAST : EV_CONT, i);
+    }
+
+    uint64_t bytes = 0;
+    double t = bench_now_s();
+    for (unsigned int i = 0; i < iterations; i++) {
+        struct osd_packet *ev;
+        rv = osd_packet_new(&ev, frags[0]->data_size_words);
+        assert(OSD_SUCCEEDED(rv));
+        memcpy(&ev->data, &frags[0]->data,
+               frags[0]->data_size_words * sizeof(uint16_t));
+        for (unsigned int f = 1; f < NUM_FRAGMENTS; f++) {
+            rv = osd_packet_combine(&ev, frags[f]);
+            assert(OSD_SUCCEEDED(rv));
+        }
+        bytes += osd_packet_sizeof(ev);
+        osd_packet_free(&ev);
+    }
+    report("event reassembly", "events", iterations, bytes,
+           bench_now_s() - t, NULL);
+
+    for (unsigned int i = 0; i < NUM_FRAGMENTS; i++) {
+        osd_packet_free(&frags[i]);
+    }
+}
+
+static void bench_stm_decode(unsigned int iterations)
+{
+    osd_result rv;
+    struct osd_stm_desc desc = { .di_addr = 1, .value_width_bit = 32 };
+
+    // timestamp (2 words), id (1 word), value (2 words)
+    struct osd_packet *pkgs[NUM_PKGS];
+    for (unsigned int i = 0; i < NUM_PKGS; i++) {
+        pkgs[i] = create_event(5, EV_LAST, i);
+    }
+
+    uint64_t sum = 0;
+    double t = bench_now_s();
+    for (unsigned int i = 0; i < iterations; i++) {
+        struct osd_stm_event ev;
+        rv = osd_cl_stm_decode_event(&desc, pkgs[i % NUM_PKGS], &ev);
+        assert(OSD_SUCCEEDED(rv));
+        sum += ev.value;
+    }
+    report("stm decode", "events", iterations, 0, bench_now_s() - t, NULL);
+    sink = sum;
+
+    for (unsigned int i = 0; i < NUM_PKGS; i++) {
+        osd_packet_free(&pkgs[i]);
+    }
+}
+
+static void bench_ctm_decode(unsigned int iterations)
+{
+    osd_result rv;
+    struct osd_ctm_desc desc = { .di_addr = 1, .addr_width_bit = 32 };
+
+    // timestamp (2 words), npc (2 words), pc (2 words), flags (1 word)
+    struct osd_packet *pkgs[NUM_PKGS];
+    for (unsigned int i = 0; i < NUM_PKGS; i++) {
+        pkgs[i] = create_event(7, EV_LAST, i);
+    }
+
+    uint64_t sum = 0;
+    double t = bench_now_s();
+    for (unsigned int i = 0; i < iterations; i++) {
+        struct osd_ctm_event ev;
+        rv = osd_cl_ctm_decode_event(&desc, pkgs[i % NUM_PKGS], &ev);
+        assert(OSD_SUCCEEDED(rv));
+        sum += ev.pc;
+    }
+    report("ctm decode", "events", iterations, 0, bench_now_s() - t, NULL);
+    sink = sum;
+
+    for (unsigned int i = 0; i < NUM_PKGS; i++) {
+        osd_packet_free(&pkgs[i]);
+    }
+}
+
+/**
+ * Other side of the handoff: send every message back until a message with a
+ * single frame is received
+ */
+static void *handoff_echo_thread(void *arg)
+{
+    zsock_t *sock = zsock_new_pair(">" HANDOFF_EP);
+    assert(sock);
+
+    while (1) {
+        zmsg_t *msg = zmsg_recv(sock);
+        assert(msg);
+        bool last = (zmsg_size(msg) == 1);
+        int zmq_rv = zmsg_send(&msg, sock);
+        assert(zmq_rv == 0);
+        if (last) {
+            break;
+        }
+    }
+
+    zsock_destroy(&sock);
+    return NULL;
+}
+
+static void bench_worker_handoff(unsigned int iterations)
+{
+    int zmq_rv;
+    struct bench_latency latency = { 0 };
+
+    zsock_t *sock = zsock_new_pair("@" HANDOFF_EP);
+    assert(sock);
+    pthread_t thread;
+    int irv = pthread_create(&thread, NULL, handoff_echo_thread, NULL);
+    assert(irv == 0);
+
+    // a message as sent by worker_send_data(): name and one packet
+    uint16_t data[MAX_PKG_LEN_WORDS] = { 0 };
+
+    double t = bench_now_s();
+    for (unsigned int i = 0; i < iterations; i++) {
+        uint64_t t_msg = osd_latency_now();
+
+        zmsg_t *msg = zmsg_new();
+        assert(msg);
+        zmq_rv = zmsg_addstr(msg, "D-PKG");
+        assert(zmq_rv == 0);
+        zmq_rv = zmsg_addmem(msg, data, sizeof(data));
+        assert(zmq_rv == 0);
+        zmq_rv = zmsg_send(&msg, sock);
+        assert(zmq_rv == 0);
+
+        msg = zmsg_recv(sock);
+        assert(msg);
+        zmsg_destroy(&msg);
+
+        bench_latency_add(&latency, osd_latency_now() - t_msg);
+    }
+    report("worker handoff", "round trips", iterations,
+           (uint64_t)iterations * sizeof(data) * 2, bench_now_s() - t,
+           &latency);
+    bench_latency_free(&latency);
+
+    zmsg_t *msg = zmsg_new();
+    zmq_rv = zmsg_addstr(msg, "STOP");
+    assert(zmq_rv == 0);
+    zmq_rv = zmsg_send(&msg, sock);
+    assert(zmq_rv == 0);
+    msg = zmsg_recv(sock);
+    zmsg_destroy(&msg);
+    pthread_join(thread, NULL);
+    zsock_destroy(&sock);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned int iterations = ITERATIONS_DEFAULT;
+    if (argc > 1) {
+        iterations = strtoul(argv[1], NULL, 0);
+    }
+    assert(iterations > 0);
+
+    zsys_init();
+
+    printf("%u iterations\n", iterations);
+
+    bench_packet_new_free(iterations);
+    bench_packet_header(iterations);
+    bench_event_reassembly(iterations / 10 + 1);
+    bench_stm_decode(iterations);
+    bench_ctm_decode(iterations);
+    bench_worker_handoff(iterations / 20 + 1);
+
+    return 0;
+}
@@ -0,0 +1,236 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Latency benchmark: register read round trips through the host software
+ * (osd_hostmod -> osd_hostctrl -> osd_gateway -> device and back), with and
+ * without the busy-poll mode (osd_hostmod_set_busy_poll())
+ *
+ * The device is emulated in-process and answers every register read request
+ * immediately.
+ *
+ * Usage: bench_regaccess [NUM_ACCESSES] [SPIN_US]
+ */
+
+#include <osd/osd.h>
+#include <osd/gateway.h>
+#include <osd/hostctrl.h>
+#include <osd/hostmod.h>
+#include <osd/latency.h>
+#include <osd/packet.h>
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "benchutil.h"
+
+#define NUM_ACCESSES_DEFAULT 20000
+#define SPIN_US_DEFAULT 100
+
+#define HOSTCTRL_EP "inproc://bench-regaccess"
+
+/** Subnet of the emulated device */
+#define DEVICE_SUBNET_ADDRESS 0
+
+/** Debug module in the emulated device the registers are read from */
+#define TARGET_LOCALADDR 1
+
+/**
+ * Emulated device: a queue of response packets
+ */
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    zlist_t *responses;
+    bool connected;
+} dev = {
+    .lock = PTHREAD_MUTEX_INITIALIZER,
+    .cond = PTHREAD_COND_INITIALIZER,
+};
+
+static osd_result dev_packet_read(struct osd_packet **pkg, void *cb_arg)
+{
+    pthread_mutex_lock(&dev.lock);
+    while (dev.connected && zlist_size(dev.responses) == 0) {
+        pthread_cond_wait(&dev.cond, &dev.lock);
+    }
+    if (!dev.connected) {
+        pthread_mutex_unlock(&dev.lock);
+        return OSD_ERROR_NOT_CONNECTED;
+    }
+    *pkg = zlist_pop(dev.responses);
+    pthread_mutex_unlock(&dev.lock);
+
+    return OSD_OK;
+}
+
+/**
+ * Answer all register read requests with the register address
+ */
+static osd_result dev_packet_write(const struct osd_packet *pkg, void *cb_arg)
+{
+    osd_result rv;
+
+    if (osd_packet_get_type(pkg) != OSD_PACKET_TYPE_REG ||
+        osd_packet_get_type_sub(pkg) != REQ_READ_REG_16) {
+        return OSD_OK;
+    }
+
+    struct osd_packet *resp;
+    rv = osd_packet_new(&resp, osd_packet_sizeconv_payload2data(1));
+    assert(OSD_SUCCEEDED(rv));
+    osd_packet_set_header(resp, osd_packet_get_src(pkg),
+                          osd_packet_get_dest(pkg), OSD_PACKET_TYPE_REG,
+                          RESP_READ_REG_SUCCESS_16);
+    resp->data.payload[0] = pkg->data.payload[0];
+
+    pthread_mutex_lock(&dev.lock);
+    zlist_append(dev.responses, resp);
+    pthread_cond_signal(&dev.cond);
+    pthread_mutex_unlock(&dev.lock);
+
+    return OSD_OK;
+}
+
+static void dev_disconnect(void)
+{
+    pthread_mutex_lock(&dev.lock);
+    dev.connected = false;
+    pthread_cond_signal(&dev.cond);
+    pthread_mutex_unlock(&dev.lock);
+}
+
+static void report(const char *name, struct bench_latency *latency,
+                   double total_s)
+{
+    struct bench_result r = {
+        .bench = "bench_regaccess",
+        .name = name,
+        .unit = "accesses",
+        .items = latency->num,
+        .seconds = total_s,
+        .latency = latency,
+    };
+    bench_report(&r);
+}
+
+static void bench_reg_read(struct osd_hostmod_ctx *hostmod_ctx,
+                           const char *name, unsigned int num_accesses,
+                           unsigned int caller_spin_us,
+                           unsigned int iothread_spin_us)
+{
+    osd_result rv;
+    struct bench_latency latency = { 0 };
+    uint16_t target = osd_diaddr_build(DEVICE_SUBNET_ADDRESS,
+                                       TARGET_LOCALADDR);
+
+    osd_hostmod_set_busy_poll(hostmod_ctx, caller_spin_us, iothread_spin_us);
+
+    uint64_t t_start = osd_latency_now();
+    for (unsigned int i = 0; i < num_accesses; i++) {
+        uint16_t reg_addr = 0x200 + i % 0x100;
+        uint16_t reg_val;
+
+        uint64_t t = osd_latency_now();
+        rv = osd_hostmod_reg_read(hostmod_ctx, &reg_val, target, reg_addr, 16,
+                                  0);
+        bench_latency_add(&latency, osd_latency_now() - t);
+
+        assert(OSD_SUCCEEDED(rv));
+        assert(reg_val == reg_addr);
+    }
+    uint64_t t_total = osd_latency_now() - t_start;
+
+    report(name, &latency, t_total / 1e9);
+    bench_latency_free(&latency);
+}
+
+int main(int argc, char **argv)
+{
+    osd_result rv;
+    unsigned int num_accesses = NUM_ACCESSES_DEFAULT;
+    unsigned int spin_us = SPIN_US_DEFAULT;
+
+    if (argc > 1) {
+        num_accesses = strtoul(argv[1], NULL, 0);
+    }
+    if (argc > 2) {
+        spin_us = strtoul(argv[2], NULL, 0);
+    }
+
+    zsys_init();
+
+    struct osd_log_ctx *log_ctx;
+    rv = osd_log_new(&log_ctx, LOG_ERR, NULL);
+    assert(OSD_SUCCEEDED(rv));
+
+    struct osd_hostctrl_ctx *hostctrl_ctx;
+    rv = osd_hostctrl_new(&hostctrl_ctx, log_ctx, HOSTCTRL_EP);
+    assert(OSD_SUCCEEDED(rv));
+    rv = osd_hostctrl_start(hostctrl_ctx);
+    assert(OSD_SUCCEEDED(rv));
+
+    dev.responses = zlist_new();
+    dev.connected = true;
+    struct osd_gateway_ctx *gateway_ctx;
+    rv = osd_gateway_new(&gateway_ctx, log_ctx, HOSTCTRL_EP,
+                         DEVICE_SUBNET_ADDRESS, dev_packet_read,
+                         dev_packet_write, NULL);
+    assert(OSD_SUCCEEDED(rv));
+    rv = osd_gateway_connect(gateway_ctx);
+    assert(OSD_SUCCEEDED(rv));
+
+    struct osd_hostmod_ctx *hostmod_ctx;
+    rv = osd_hostmod_new(&hostmod_ctx, log_ctx, HOSTCTRL_EP, NULL, NULL);
+    assert(OSD_SUCCEEDED(rv));
+    rv = osd_hostmod_connect(hostmod_ctx);
+    assert(OSD_SUCCEEDED(rv));
+
+    printf("%u register reads, spin budget %u us\n", num_accesses, spin_us);
+
+    // warm up
+    bench_reg_read(hostmod_ctx, "warm-up", num_accesses / 10, 0, 0);
+
+    bench_reg_read(hostmod_ctx, "blocking", num_accesses, 0, 0);
+    bench_reg_read(hostmod_ctx, "busy-poll caller", num_accesses, spin_us, 0);
+    bench_reg_read(hostmod_ctx, "busy-poll I/O thread", num_accesses, 0,
+                   spin_us);
+    bench_reg_read(hostmod_ctx, "busy-poll both", num_accesses, spin_us,
+                   spin_us);
+
+    rv = osd_hostmod_disconnect(hostmod_ctx);
+    assert(OSD_SUCCEEDED(rv));
+    osd_hostmod_free(&hostmod_ctx);
+
+    dev_disconnect();
+    rv = osd_gateway_disconnect(gateway_ctx);
+    assert(OSD_SUCCEEDED(rv));
+    osd_gateway_free(&gateway_ctx);
+
+    rv = osd_hostctrl_stop(hostctrl_ctx);
+    assert(OSD_SUCCEEDED(rv));
+    osd_hostctrl_free(&hostctrl_ctx);
+
+    while (zlist_size(dev.responses)) {
+        struct osd_packet *pkg = zlist_pop(dev.responses);
+        osd_packet_free(&pkg);
+    }
+    zlist_destroy(&dev.responses);
+    osd_log_free(&log_ctx);
+
+    return 0;
+}
@@ -0,0 +1,178 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ * Reporting of benchmark results
+ *
+ * All results are printed in a human-readable form. If the environment
+ * variable OSD_BENCH_JSON is set to a file name, every result is additionally
+ * appended to this file as one JSON object per line, which can be compared
+ * against a baseline with bench-compare.py.
+ */
+
+#ifndef BENCHUTIL_H
+#define BENCHUTIL_H
+
+#include <osd/osd.h>
+#include <osd/latency.h>
+
+#include <assert.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/**
+ * Latency samples of a benchmark case
+ *
+ * All samples are kept to report exact percentiles: the log2 buckets of
+ * struct osd_latency_hist are too coarse to detect a regression of a few
+ * percent.
+ */
+struct bench_latency {
+    uint64_t *samples_ns;
+    size_t num;
+    size_t alloc;
+    bool sorted;
+};
+
+static inline void bench_latency_add(struct bench_latency *l, uint64_t ns)
+{
+    if (l->num == l->alloc) {
+        l->alloc = l->alloc ? l->alloc * 2 : 1024;
+        l->samples_ns = realloc(l->samples_ns, l->alloc * sizeof(uint64_t));
+        assert(l->samples_ns);
+    }
+    l->samples_ns[l->num++] = ns;
+    l->sorted = false;
+}
+
+static inline void bench_latency_reset(struct bench_latency *l)
+{
+    l->num = 0;
+}
+
+static inline void bench_latency_free(struct bench_latency *l)
+{
+    free(l->samples_ns);
+    l->samples_ns = NULL;
+    l->num = l->alloc = 0;
+}
+
+static inline int bench_cmp_u64(const void *a, const void *b)
+{
+    uint64_t va = *(const uint64_t *)a;
+    uint64_t vb = *(const uint64_t *)b;
+    return (va > vb) - (va < vb);
+}
+
+/**
+ * Get a percentile (nearest rank) of the samples
+ */
+static inline uint64_t bench_latency_percentile(struct bench_latency *l,
+                                                double p)
+{
+    assert(l->num);
+    if (!l->sorted) {
+        qsort(l->samples_ns, l->num, sizeof(uint64_t), bench_cmp_u64);
+        l->sorted = true;
+    }
+
+    size_t idx = (size_t)(p / 100 * l->num + 0.5);
+    if (idx > 0) {
+        idx--;
+    }
+    if (idx >= l->num) {
+        idx = l->num - 1;
+    }
+    return l->samples_ns[idx];
+}
+
+/**
+ * Result of a single benchmark case
+ */
+struct bench_result {
+    const char *bench; //!< name of the benchmark program
+    const char *name; //!< name of the case
+    const char *unit; //!< what is counted in items, e.g. "packets"
+    uint64_t items; //!< number of processed items
+    uint64_t bytes; //!< number of processed bytes (0 if not applicable)
+    double seconds; //!< wall clock time of the case
+    /** latency per item (NULL if not measured) */
+    struct bench_latency *latency;
+};
+
+static inline double bench_now_s(void)
+{
+    return osd_latency_now() / 1e9;
+}
+
+static void bench_report_json(const struct bench_result *r)
+{
+    const char *filename = getenv("OSD_BENCH_JSON");
+    if (!filename || !filename[0]) {
+        return;
+    }
+
+    FILE *fp = fopen(filename, "a");
+    if (!fp) {
+        fprintf(stderr, "Unable to open %s\n", filename);
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(fp,
+            "{\"bench\": \"%s\", \"name\": \"%s\", \"unit\": \"%s\", "
+            "\"items\": %" PRIu64 ", \"bytes\": %" PRIu64 ", "
+            "\"seconds\": %.6f, \"items_per_s\": %.1f, "
+            "\"bytes_per_s\": %.1f",
+            r->bench, r->name, r->unit, r->items, r->bytes, r->seconds,
+            r->items / r->seconds, r->bytes / r->seconds);
+    if (r->latency && r->latency->num) {
+        fprintf(fp,
+                ", \"latency_ns\": {\"min\": %" PRIu64 ", \"p50\": %" PRIu64
+                ", \"p90\": %" PRIu64 ", \"p99\": %" PRIu64
+                ", \"max\": %" PRIu64 "}",
+                bench_latency_percentile(r->latency, 0),
+                bench_latency_percentile(r->latency, 50),
+                bench_latency_percentile(r->latency, 90),
+                bench_latency_percentile(r->latency, 99),
+                bench_latency_percentile(r->latency, 100));
+    }
+    fprintf(fp, "}\n");
+    fclose(fp);
+}
+
+/**
+ * Report the result of a benchmark case
+ */
+static void bench_report(const struct bench_result *r)
+{
+    printf("%-24s %12.0f %s/s", r->name, r->items / r->seconds, r->unit);
+    if (r->bytes) {
+        printf(" %9.1f MB/s", r->bytes / r->seconds / 1e6);
+    }
+    if (r->latency && r->latency->num) {
+        printf("   p50 %7.1f   p90 %7.1f   p99 %7.1f   max %8.1f us",
+               bench_latency_percentile(r->latency, 50) / 1e3,
+               bench_latency_percentile(r->latency, 90) / 1e3,
+               bench_latency_percentile(r->latency, 99) / 1e3,
+               bench_latency_percentile(r->latency, 100) / 1e3);
+    }
+    printf("\n");
+
+    bench_report_json(r);
+}
+
+#endif // BENCHUTIL_H
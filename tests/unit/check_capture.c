@@ -0,0 +1,382 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TEST_SUITE_NAME "check_capture"
+
+#include "testutil.h"
+
+#include <osd/osd.h>
+#include <osd/capture.h>
+#include <osd/latency.h>
+#include <osd/packet.h>
+
+#include <unistd.h>
+
+#define NUM_TEST_PACKETS 1000
+
+struct osd_log_ctx *log_ctx;
+char capture_filename[] = "/tmp/check_capture_XXXXXX";
+
+/**
+ * Create the i-th test packet; packets have different sizes
+ */
+static struct osd_packet *create_test_packet(unsigned int i)
+{
+    osd_result rv;
+    struct osd_packet *pkg;
+
+    unsigned int payload_words = i % 13;
+    rv = osd_packet_new(&pkg, osd_packet_sizeconv_payload2data(payload_words));
+    ck_assert_int_eq(rv, OSD_OK);
+    osd_packet_set_header(pkg, i % 0x100, 0x100 + i % 0x100,
+                          OSD_PACKET_TYPE_EVENT, i % 4);
+    for (unsigned int w = 0; w < payload_words; w++) {
+        pkg->data.payload[w] = i + w;
+    }
+    return pkg;
+}
+
+/**
+ * Write NUM_TEST_PACKETS test packets into the capture file
+ */
+static void write_test_capture(size_t block_size)
+{
+    osd_result rv;
+    struct osd_capture_writer_ctx *writer;
+
+    FILE *fp = fopen(capture_filename, "wb");
+    ck_assert_ptr_ne(fp, NULL);
+
+    rv = osd_capture_writer_new(&writer, log_ctx, fp, block_size);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    for (unsigned int i = 0; i < NUM_TEST_PACKETS; i++) {
+        struct osd_packet *pkg = create_test_packet(i);
+        rv = osd_capture_writer_write(writer, pkg, 1000 + i);
+        ck_assert_int_eq(rv, OSD_OK);
+        osd_packet_free(&pkg);
+    }
+
+    rv = osd_capture_writer_flush(writer);
+    ck_assert_int_eq(rv, OSD_OK);
+    osd_capture_writer_free(&writer);
+    ck_assert_ptr_eq(writer, NULL);
+
+    fclose(fp);
+}
+
+/**
+ * Read packets starting at packet |first| and compare them to the expected
+ * test packets
+ */
+static void check_test_packets(struct osd_capture_reader_ctx *reader,
+                               unsigned int first)
+{
+    osd_result rv;
+    const struct osd_packet *pkg;
+    uint64_t ts;
+
+    for (unsigned int i = first; i < NUM_TEST_PACKETS; i++) {
+        rv = osd_capture_reader_next(reader, &pkg, &ts);
+        ck_assert_int_eq(rv, OSD_OK);
+        ck_assert_ptr_ne(pkg, NULL);
+
+        struct osd_packet *exp_pkg = create_test_packet(i);
+        ck_assert(osd_packet_equal(pkg, exp_pkg));
+        osd_packet_free(&exp_pkg);
+        ck_assert_uint_eq(ts, 1000 + i);
+    }
+
+    // end of the capture
+    rv = osd_capture_reader_next(reader, &pkg, &ts);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_ptr_eq(pkg, NULL);
+}
+
+/**
+ * Test fixture: setup (called before each tests)
+ */
+void setup(void)
+{
+    log_ctx = testutil_get_log_ctx();
+
+    int fd = mkstemp(capture_filename);
+    ck_assert_int_ge(fd, 0);
+    close(fd);
+}
+
+/**
+ * Test fixture: teardown (called after each test)
+ */
+void teardown(void)
+{
+    unlink(capture_filename);
+    strcpy(capture_filename, "/tmp/check_capture_XXXXXX");
+
+    osd_log_free(&log_ctx);
+}
+
+START_TEST(test_write_read)
+{
+    osd_result rv;
+    struct osd_capture_reader_ctx *reader;
+
+    uint64_t t_start = osd_capture_timestamp_now();
+
+    // use small blocks to get many of them
+    write_test_capture(256);
+
+    ck_assert(osd_capture_is_capture_file(capture_filename));
+
+    rv = osd_capture_reader_new(&reader, log_ctx, capture_filename);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_uint_ge(osd_capture_reader_get_create_time(reader), t_start);
+
+    check_test_packets(reader, 0);
+
+    // and once again
+    rv = osd_capture_reader_rewind(reader);
+    ck_assert_int_eq(rv, OSD_OK);
+    check_test_packets(reader, 0);
+
+    osd_capture_reader_free(&reader);
+    ck_assert_ptr_eq(reader, NULL);
+}
+END_TEST
+
+START_TEST(test_empty)
+{
+    osd_result rv;
+    struct osd_capture_reader_ctx *reader;
+    struct osd_capture_writer_ctx *writer;
+    const struct osd_packet *pkg;
+
+    FILE *fp = fopen(capture_filename, "wb");
+    ck_assert_ptr_ne(fp, NULL);
+    rv = osd_capture_writer_new(&writer, log_ctx, fp, 0);
+    ck_assert_int_eq(rv, OSD_OK);
+    osd_capture_writer_free(&writer);
+    fclose(fp);
+
+    rv = osd_capture_reader_new(&reader, log_ctx, capture_filename);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    rv = osd_capture_reader_next(reader, &pkg, NULL);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_ptr_eq(pkg, NULL);
+
+    osd_capture_reader_free(&reader);
+}
+END_TEST
+
+START_TEST(test_tell_seek)
+{
+    osd_result rv;
+    struct osd_capture_reader_ctx *reader;
+    struct osd_capture_reader_ctx *reader2;
+    const struct osd_packet *pkg;
+    struct osd_capture_pos pos;
+
+    write_test_capture(256);
+
+    rv = osd_capture_reader_new(&reader, log_ctx, capture_filename);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    for (unsigned int i = 0; i < NUM_TEST_PACKETS / 2; i++) {
+        rv = osd_capture_reader_next(reader, &pkg, NULL);
+        ck_assert_int_eq(rv, OSD_OK);
+        ck_assert_ptr_ne(pkg, NULL);
+    }
+    rv = osd_capture_reader_tell(reader, &pos);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    // positions are valid for all readers of the same file
+    rv = osd_capture_reader_new(&reader2, log_ctx, capture_filename);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_capture_reader_seek(reader2, &pos);
+    ck_assert_int_eq(rv, OSD_OK);
+    check_test_packets(reader2, NUM_TEST_PACKETS / 2);
+
+    check_test_packets(reader, NUM_TEST_PACKETS / 2);
+
+    osd_capture_reader_free(&reader2);
+    osd_capture_reader_free(&reader);
+}
+END_TEST
+
+START_TEST(test_corrupt)
+{
+    osd_result rv;
+    struct osd_capture_reader_ctx *reader;
+    const struct osd_packet *pkg;
+
+    write_test_capture(0);
+
+    // flip a bit in the middle of the file (inside the first block)
+    FILE *fp = fopen(capture_filename, "r+b");
+    ck_assert_ptr_ne(fp, NULL);
+    ck_assert_int_eq(fseek(fp, 100, SEEK_SET), 0);
+    int c = fgetc(fp);
+    ck_assert_int_ne(c, EOF);
+    ck_assert_int_eq(fseek(fp, 100, SEEK_SET), 0);
+    fputc(c ^ 0x01, fp);
+    fclose(fp);
+
+    rv = osd_capture_reader_new(&reader, log_ctx, capture_filename);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    rv = osd_capture_reader_next(reader, &pkg, NULL);
+    ck_assert_int_eq(rv, OSD_ERROR_CORRUPT);
+
+    osd_capture_reader_free(&reader);
+}
+END_TEST
+
+START_TEST(test_truncated)
+{
+    osd_result rv;
+    struct osd_capture_reader_ctx *reader;
+    const struct osd_packet *pkg;
+
+    write_test_capture(0);
+    ck_assert_int_eq(truncate(capture_filename, 200), 0);
+
+    rv = osd_capture_reader_new(&reader, log_ctx, capture_filename);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    rv = osd_capture_reader_next(reader, &pkg, NULL);
+    ck_assert_int_eq(rv, OSD_ERROR_CORRUPT);
+
+    osd_capture_reader_free(&reader);
+}
+END_TEST
+
+START_TEST(test_latency)
+{
+    osd_result rv;
+    struct osd_capture_writer_ctx *writer;
+    struct osd_capture_reader_ctx *reader;
+    struct osd_capture_reader_ctx *reader2;
+    struct osd_latency_stats stats = { 0 };
+    struct osd_latency_stats stats_read;
+    const struct osd_packet *pkg;
+    struct osd_capture_pos pos;
+
+    FILE *fp = fopen(capture_filename, "wb");
+    ck_assert_ptr_ne(fp, NULL);
+    rv = osd_capture_writer_new(&writer, log_ctx, fp, 256);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    // latency statistics in between the packets
+    for (unsigned int i = 0; i < NUM_TEST_PACKETS; i++) {
+        if (i == NUM_TEST_PACKETS / 2) {
+            osd_latency_hist_add(&stats.hop[OSD_LATENCY_HOP_TOTAL], 100);
+            rv = osd_capture_writer_write_latency(writer, &stats);
+            ck_assert_int_eq(rv, OSD_OK);
+        }
+        struct osd_packet *pkg_w = create_test_packet(i);
+        rv = osd_capture_writer_write(writer, pkg_w, 1000 + i);
+        ck_assert_int_eq(rv, OSD_OK);
+        osd_packet_free(&pkg_w);
+    }
+    osd_latency_hist_add(&stats.hop[OSD_LATENCY_HOP_GATEWAY], 5000);
+    osd_latency_hist_add(&stats.hop[OSD_LATENCY_HOP_TOTAL], 7000);
+    rv = osd_capture_writer_write_latency(writer, &stats);
+    ck_assert_int_eq(rv, OSD_OK);
+    osd_capture_writer_free(&writer);
+    fclose(fp);
+
+    rv = osd_capture_reader_new(&reader, log_ctx, capture_filename);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    // the last statistics written are returned
+    rv = osd_capture_reader_get_latency(reader, &stats_read);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert(!memcmp(&stats, &stats_read, sizeof(stats)));
+    ck_assert_uint_eq(stats_read.hop[OSD_LATENCY_HOP_TOTAL].count, 2);
+    ck_assert_uint_eq(stats_read.hop[OSD_LATENCY_HOP_TOTAL].max_ns, 7000);
+
+    // latency blocks are skipped when reading packets
+    for (unsigned int i = 0; i < NUM_TEST_PACKETS / 2; i++) {
+        rv = osd_capture_reader_next(reader, &pkg, NULL);
+        ck_assert_int_eq(rv, OSD_OK);
+        ck_assert_ptr_ne(pkg, NULL);
+    }
+    rv = osd_capture_reader_tell(reader, &pos);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    rv = osd_capture_reader_new(&reader2, log_ctx, capture_filename);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_capture_reader_seek(reader2, &pos);
+    ck_assert_int_eq(rv, OSD_OK);
+    check_test_packets(reader2, NUM_TEST_PACKETS / 2);
+
+    check_test_packets(reader, NUM_TEST_PACKETS / 2);
+
+    osd_capture_reader_free(&reader2);
+    osd_capture_reader_free(&reader);
+
+    // a capture without latency statistics
+    write_test_capture(0);
+    rv = osd_capture_reader_new(&reader, log_ctx, capture_filename);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_capture_reader_get_latency(reader, &stats_read);
+    ck_assert_int_eq(rv, OSD_ERROR_FAILURE);
+    osd_capture_reader_free(&reader);
+}
+END_TEST
+
+START_TEST(test_not_a_capture)
+{
+    osd_result rv;
+    struct osd_capture_reader_ctx *reader;
+
+    // a packet dump written by osd_packet_fwrite() is no capture file
+    FILE *fp = fopen(capture_filename, "wb");
+    ck_assert_ptr_ne(fp, NULL);
+    struct osd_packet *pkg = create_test_packet(5);
+    ck_assert(osd_packet_fwrite(pkg, fp));
+    osd_packet_free(&pkg);
+    fclose(fp);
+
+    ck_assert(!osd_capture_is_capture_file(capture_filename));
+
+    rv = osd_capture_reader_new(&reader, log_ctx, capture_filename);
+    ck_assert_int_eq(rv, OSD_ERROR_FILE);
+
+    ck_assert(!osd_capture_is_capture_file("/nonexisting/file.osdcap"));
+}
+END_TEST
+
+Suite *suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create(TEST_SUITE_NAME);
+
+    tc_core = tcase_create("Core");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+    tcase_add_test(tc_core, test_write_read);
+    tcase_add_test(tc_core, test_empty);
+    tcase_add_test(tc_core, test_tell_seek);
+    tcase_add_test(tc_core, test_corrupt);
+    tcase_add_test(tc_core, test_truncated);
+    tcase_add_test(tc_core, test_latency);
+    tcase_add_test(tc_core, test_not_a_capture);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
@@ -464,10 +464,101 @@ START_TEST(test_cpu_reg64_write_test2)
 }
 END_TEST
 
+/**
+ * Read multiple registers at once
+ *
+ * Registers in the currently selected CORE_REG_UPPER bank are read first,
+ * the bank is switched only once.
+ */
+START_TEST(test_cpu_reg_read_bulk)
+{
+    osd_result rv;
+    struct osd_cdm_desc cdm_desc = get_cdm_desc32();
+
+    const uint16_t reg_addrs[] = { 0x8001, 0x0002, 0x8003, 0x0004 };
+
+    mock_hostmod_expect_reg_read32(0x1002, cdm_diaddr, 0x8002, OSD_OK);
+    mock_hostmod_expect_reg_read32(0x1004, cdm_diaddr, 0x8004, OSD_OK);
+    mock_hostmod_expect_reg_write16(1, cdm_diaddr, OSD_REG_CDM_CORE_REG_UPPER,
+                                    OSD_OK);
+    mock_hostmod_expect_reg_read32(0x1001, cdm_diaddr, 0x8001, OSD_OK);
+    mock_hostmod_expect_reg_read32(0x1003, cdm_diaddr, 0x8003, OSD_OK);
+
+    uint32_t reg_vals[4];
+    rv = osd_cl_cdm_cpureg_read_bulk(mock_hostmod_get_ctx(), &cdm_desc, 1,
+                                     reg_addrs, 4, reg_vals, 0);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_uint_eq(reg_vals[0], 0x1001);
+    ck_assert_uint_eq(reg_vals[1], 0x1002);
+    ck_assert_uint_eq(reg_vals[2], 0x1003);
+    ck_assert_uint_eq(reg_vals[3], 0x1004);
+    ck_assert_uint_eq(cdm_desc.core_reg_upper, 1);
+}
+END_TEST
+
+/**
+ * Read the same registers from multiple CDMs
+ *
+ * The CORE_REG_UPPER writes are performed first, then the register reads of
+ * both CDMs are interleaved.
+ */
+START_TEST(test_cpu_reg_read_bulk_multi)
+{
+    osd_result rv;
+    struct osd_cdm_desc cdm_descs[2] = { get_cdm_desc32(), get_cdm_desc32() };
+    cdm_descs[1].di_addr = cdm_diaddr + 1;
+    cdm_descs[1].core_reg_upper = 1;
+
+    const uint16_t reg_addrs[] = { 0x0010, 0x0011 };
+
+    mock_hostmod_expect_reg_write16(0, cdm_diaddr + 1,
+                                    OSD_REG_CDM_CORE_REG_UPPER, OSD_OK);
+    mock_hostmod_expect_reg_read32(0xa10, cdm_diaddr, 0x8010, OSD_OK);
+    mock_hostmod_expect_reg_read32(0xb10, cdm_diaddr + 1, 0x8010, OSD_OK);
+    mock_hostmod_expect_reg_read32(0xa11, cdm_diaddr, 0x8011, OSD_OK);
+    mock_hostmod_expect_reg_read32(0xb11, cdm_diaddr + 1, 0x8011, OSD_OK);
+
+    uint32_t reg_vals[2][2];
+    rv = osd_cl_cdm_cpureg_read_bulk(mock_hostmod_get_ctx(), cdm_descs, 2,
+                                     reg_addrs, 2, reg_vals, 0);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_uint_eq(reg_vals[0][0], 0xa10);
+    ck_assert_uint_eq(reg_vals[0][1], 0xa11);
+    ck_assert_uint_eq(reg_vals[1][0], 0xb10);
+    ck_assert_uint_eq(reg_vals[1][1], 0xb11);
+    ck_assert_uint_eq(cdm_descs[1].core_reg_upper, 0);
+}
+END_TEST
+
+/**
+ * Write multiple registers at once; a failed bank switch is not recorded
+ *
+ * No register in the new bank is written after the bank switch failed, as the
+ * write would end up in the previously selected bank.
+ */
+START_TEST(test_cpu_reg_write_bulk)
+{
+    osd_result rv;
+    struct osd_cdm_desc cdm_desc = get_cdm_desc32();
+
+    const uint16_t reg_addrs[] = { 0x8001, 0x0002 };
+    const uint32_t reg_vals[] = { 0xabcd0001, 0xabcd0002 };
+
+    mock_hostmod_expect_reg_write32(0xabcd0002, cdm_diaddr, 0x8002, OSD_OK);
+    mock_hostmod_expect_reg_write16(1, cdm_diaddr, OSD_REG_CDM_CORE_REG_UPPER,
+                                    OSD_ERROR_TIMEDOUT);
+
+    rv = osd_cl_cdm_cpureg_write_bulk(mock_hostmod_get_ctx(), &cdm_desc, 1,
+                                      reg_addrs, 2, reg_vals, 0);
+    ck_assert_int_eq(rv, OSD_ERROR_TIMEDOUT);
+    ck_assert_uint_eq(cdm_desc.core_reg_upper, 0);
+}
+END_TEST
+
 Suite *suite(void)
 {
     Suite *s;
-    TCase *tc_core, *tc_rw16, *tc_rw32, *tc_rw64;
+    TCase *tc_core, *tc_rw16, *tc_rw32, *tc_rw64, *tc_bulk;
 
     s = suite_create(TEST_SUITE_NAME);
 
@@ -502,5 +593,12 @@ Suite *suite(void)
     tcase_add_test(tc_rw64, test_cpu_reg64_write_test2);
     suite_add_tcase(s, tc_rw64);
 
+    tc_bulk = tcase_create("Bulk CPU Register read/write");
+    tcase_add_checked_fixture(tc_bulk, setup, teardown);
+    tcase_add_test(tc_bulk, test_cpu_reg_read_bulk);
+    tcase_add_test(tc_bulk, test_cpu_reg_read_bulk_multi);
+    tcase_add_test(tc_bulk, test_cpu_reg_write_bulk);
+    suite_add_tcase(s, tc_bulk);
+
     return s;
 }
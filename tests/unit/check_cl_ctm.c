@@ -161,6 +161,29 @@ START_TEST(test_handle_event_overflow)
 }
 END_TEST
 
+START_TEST(test_decode_event_invalid)
+{
+    osd_result rv;
+
+    struct osd_ctm_desc ctm_desc;
+    ctm_desc.di_addr = 2;
+    ctm_desc.addr_width_bit = 32;
+    ctm_desc.data_width_bit = 32;
+
+    // one payload word too short for the configured width
+    struct osd_packet *pkg_trace;
+    osd_packet_new(&pkg_trace, osd_packet_sizeconv_payload2data(6));
+    rv = osd_packet_set_header(pkg_trace, 1, 2, OSD_PACKET_TYPE_EVENT, 0);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    struct osd_ctm_event event;
+    rv = osd_cl_ctm_decode_event(&ctm_desc, pkg_trace, &event);
+    ck_assert_int_eq(rv, OSD_ERROR_DEVICE_INVALID_DATA);
+
+    osd_packet_free(&pkg_trace);
+}
+END_TEST
+
 Suite *suite(void)
 {
     Suite *s;
@@ -174,6 +197,7 @@ Suite *suite(void)
     tcase_add_test(tc_core, test_get_desc_wrong_module);
     tcase_add_test(tc_core, test_handle_event);
     tcase_add_test(tc_core, test_handle_event_overflow);
+    tcase_add_test(tc_core, test_decode_event_invalid);
     suite_add_tcase(s, tc_core);
 
     return s;
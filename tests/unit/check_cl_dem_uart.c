@@ -96,6 +96,53 @@ START_TEST(test_receive_event)
 }
 END_TEST
 
+static char batch_rcv_buf[1000];
+static size_t batch_rcv_len;
+static unsigned int batch_rcv_calls;
+
+static void dem_uart_batch_handler(void *arg, const char *str, size_t len)
+{
+    ck_assert(str && len > 0);
+    ck_assert_uint_le(batch_rcv_len + len, sizeof(batch_rcv_buf));
+
+    memcpy(batch_rcv_buf + batch_rcv_len, str, len);
+    batch_rcv_len += len;
+    batch_rcv_calls++;
+}
+
+START_TEST(test_receive_event_batch)
+{
+    osd_result rv;
+
+    const char *TEST_STR = "Hello\nWorld";
+    const size_t num_pkgs = strlen(TEST_STR);
+
+    struct osd_dem_uart_event_handler ev_handler;
+    ev_handler.cb_fn = dem_uart_batch_handler;
+    ev_handler.cb_arg = NULL;
+
+    struct osd_packet *pkgs[num_pkgs];
+    for (size_t i = 0; i < num_pkgs; i++) {
+        osd_packet_new(&pkgs[i], osd_packet_sizeconv_payload2data(1));
+        osd_packet_set_header(pkgs[i], MOCK_HOSTMOD_DIADDR, dem_uart_diaddr,
+                              OSD_PACKET_TYPE_EVENT, EV_LAST);
+        pkgs[i]->data.payload[0] = TEST_STR[i];
+    }
+
+    batch_rcv_len = 0;
+    batch_rcv_calls = 0;
+
+    rv = osd_cl_dem_uart_receive_event_batch((void *)&ev_handler, pkgs,
+                                             num_pkgs);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    // all characters are passed to the callback at once
+    ck_assert_uint_eq(batch_rcv_calls, 1);
+    ck_assert_uint_eq(batch_rcv_len, num_pkgs);
+    ck_assert(memcmp(batch_rcv_buf, TEST_STR, num_pkgs) == 0);
+}
+END_TEST
+
 START_TEST(test_send_string)
 {
     osd_result rv;
@@ -122,6 +169,36 @@ START_TEST(test_send_string)
 }
 END_TEST
 
+START_TEST(test_send_string_long)
+{
+    osd_result rv;
+
+    // longer than one batch of packets passed to the I/O thread
+    char test_str[1000];
+    for (size_t i = 0; i < sizeof(test_str); i++) {
+        test_str[i] = 'a' + i % 26;
+    }
+
+    struct osd_dem_uart_desc desc;
+    desc.di_addr = dem_uart_diaddr;
+
+    struct osd_packet *exp_packet;
+
+    for (size_t i = 0; i < sizeof(test_str); i++) {
+        osd_packet_new(&exp_packet, osd_packet_sizeconv_payload2data(1));
+        osd_packet_set_header(exp_packet, dem_uart_diaddr, MOCK_HOSTMOD_DIADDR,
+                              OSD_PACKET_TYPE_EVENT, EV_LAST);
+        exp_packet->data.payload[0] = test_str[i] & 0xFF;
+
+        mock_hostmod_expect_event_send(exp_packet, OSD_OK);
+    }
+
+    rv = osd_cl_dem_uart_send_string(mock_hostmod_get_ctx(), &desc,
+                                     test_str, sizeof(test_str));
+    ck_assert_int_eq(rv, OSD_OK);
+}
+END_TEST
+
 Suite *suite(void)
 {
     Suite *s;
@@ -138,7 +215,9 @@ Suite *suite(void)
     tc_event_rxtx = tcase_create("Core RX/TX Functionality");
     tcase_add_checked_fixture(tc_event_rxtx, setup, teardown);
     tcase_add_test(tc_event_rxtx, test_receive_event);
+    tcase_add_test(tc_event_rxtx, test_receive_event_batch);
     tcase_add_test(tc_event_rxtx, test_send_string);
+    tcase_add_test(tc_event_rxtx, test_send_string_long);
     suite_add_tcase(s, tc_event_rxtx);
 
     return s;
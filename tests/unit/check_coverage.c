@@ -0,0 +1,285 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TEST_SUITE_NAME "check_coverage"
+
+#include "testutil.h"
+
+#include <osd/osd.h>
+#include <osd/coverage.h>
+#include <osd/symtab.h>
+
+#include <unistd.h>
+
+/** Number of symbols in the test symbol table */
+#define NUM_SYMBOLS 100
+
+struct osd_log_ctx *log_ctx;
+struct osd_symtab_ctx *symtab_ctx;
+struct osd_coverage_ctx *coverage_ctx;
+char coverage_filename[] = "/tmp/check_coverage_XXXXXX";
+
+/**
+ * Start address of the i-th test symbol
+ */
+static uint64_t sym_addr(unsigned int i)
+{
+    return 0x1000 + i * 0x100;
+}
+
+/**
+ * Test fixture: setup (called before each tests)
+ */
+void setup(void)
+{
+    osd_result rv;
+    char name[32];
+
+    log_ctx = testutil_get_log_ctx();
+
+    rv = osd_symtab_new(&symtab_ctx, log_ctx);
+    ck_assert_int_eq(rv, OSD_OK);
+    for (unsigned int i = 0; i < NUM_SYMBOLS; i++) {
+        snprintf(name, sizeof(name), "func_%u", i);
+        rv = osd_symtab_add(symtab_ctx, sym_addr(i), 0, name);
+        ck_assert_int_eq(rv, OSD_OK);
+    }
+
+    rv = osd_coverage_new(&coverage_ctx, log_ctx, symtab_ctx);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_ptr_ne(coverage_ctx, NULL);
+
+    int fd = mkstemp(coverage_filename);
+    ck_assert_int_ge(fd, 0);
+    close(fd);
+}
+
+/**
+ * Test fixture: teardown (called after each test)
+ */
+void teardown(void)
+{
+    unlink(coverage_filename);
+    strcpy(coverage_filename, "/tmp/check_coverage_XXXXXX");
+
+    osd_coverage_free(&coverage_ctx);
+    ck_assert_ptr_eq(coverage_ctx, NULL);
+    osd_symtab_free(&symtab_ctx);
+
+    osd_log_free(&log_ctx);
+}
+
+START_TEST(test_add_call)
+{
+    ck_assert_uint_eq(osd_coverage_get_count(coverage_ctx), NUM_SYMBOLS);
+    ck_assert_uint_eq(osd_coverage_get_covered_count(coverage_ctx), 0);
+    ck_assert_uint_eq(osd_coverage_get_runs(coverage_ctx), 1);
+
+    // call to the start of a function
+    osd_coverage_add_call(coverage_ctx, sym_addr(3));
+    osd_coverage_add_call(coverage_ctx, sym_addr(3));
+    // call into the middle of a function
+    osd_coverage_add_call(coverage_ctx, sym_addr(70) + 0x10);
+    // last symbol (spans a bitmap word boundary)
+    osd_coverage_add_call(coverage_ctx, sym_addr(NUM_SYMBOLS - 1));
+
+    ck_assert_uint_eq(osd_coverage_get_covered_count(coverage_ctx), 3);
+    ck_assert(osd_coverage_is_covered(coverage_ctx, 3));
+    ck_assert_uint_eq(osd_coverage_get_hits(coverage_ctx, 3), 2);
+    ck_assert(osd_coverage_is_covered(coverage_ctx, 70));
+    ck_assert_uint_eq(osd_coverage_get_hits(coverage_ctx, 70), 1);
+    ck_assert(osd_coverage_is_covered(coverage_ctx, NUM_SYMBOLS - 1));
+    ck_assert(!osd_coverage_is_covered(coverage_ctx, 4));
+    ck_assert_uint_eq(osd_coverage_get_hits(coverage_ctx, 4), 0);
+}
+END_TEST
+
+START_TEST(test_add_call_outside)
+{
+    osd_result rv;
+
+    // below the first symbol, e.g. a ROM
+    osd_coverage_add_call(coverage_ctx, sym_addr(0) - 0x100);
+    // behind the last symbol, whose size is unknown
+    osd_coverage_add_call(coverage_ctx, sym_addr(NUM_SYMBOLS - 1) + 0x10);
+    ck_assert_uint_eq(osd_coverage_get_covered_count(coverage_ctx), 0);
+
+    // behind the end of a function with a known size
+    struct osd_symtab_ctx *sized_symtab;
+    struct osd_coverage_ctx *sized_coverage;
+    rv = osd_symtab_new(&sized_symtab, log_ctx);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_symtab_add(sized_symtab, 0x1000, 0x20, "func_a");
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_symtab_add(sized_symtab, 0x2000, 0x20, "func_b");
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_coverage_new(&sized_coverage, log_ctx, sized_symtab);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    osd_coverage_add_call(sized_coverage, 0x1040);
+    osd_coverage_add_call(sized_coverage, 0x2020);
+    ck_assert_uint_eq(osd_coverage_get_covered_count(sized_coverage), 0);
+    osd_coverage_add_call(sized_coverage, 0x201e);
+    ck_assert_uint_eq(osd_coverage_get_covered_count(sized_coverage), 1);
+    ck_assert(osd_coverage_is_covered(sized_coverage, 1));
+
+    osd_coverage_free(&sized_coverage);
+    osd_symtab_free(&sized_symtab);
+}
+END_TEST
+
+START_TEST(test_add_event)
+{
+    struct osd_ctm_event ev = { 0 };
+
+    // only calls count
+    ev.is_call = 1;
+    ev.npc = sym_addr(5);
+    osd_coverage_add_event(coverage_ctx, &ev);
+
+    ev.is_call = 0;
+    ev.is_ret = 1;
+    ev.npc = sym_addr(6);
+    osd_coverage_add_event(coverage_ctx, &ev);
+
+    ev.is_ret = 0;
+    ev.overflow = 10;
+    osd_coverage_add_event(coverage_ctx, &ev);
+
+    ck_assert_uint_eq(osd_coverage_get_covered_count(coverage_ctx), 1);
+    ck_assert(osd_coverage_is_covered(coverage_ctx, 5));
+}
+END_TEST
+
+START_TEST(test_write_merge)
+{
+    osd_result rv;
+    struct osd_coverage_ctx *merged;
+
+    osd_coverage_add_call(coverage_ctx, sym_addr(1));
+    osd_coverage_add_call(coverage_ctx, sym_addr(65));
+    rv = osd_coverage_write(coverage_ctx, coverage_filename);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    rv = osd_coverage_new_from_file(&merged, log_ctx, coverage_filename);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert(osd_coverage_matches_symtab(merged, symtab_ctx));
+    ck_assert_uint_eq(osd_coverage_get_count(merged), NUM_SYMBOLS);
+    ck_assert_uint_eq(osd_coverage_get_covered_count(merged), 2);
+    ck_assert_uint_eq(osd_coverage_get_runs(merged), 1);
+
+    // a second run covering another function
+    osd_coverage_add_call(coverage_ctx, sym_addr(2));
+    rv = osd_coverage_write(coverage_ctx, coverage_filename);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    rv = osd_coverage_merge_file(merged, coverage_filename);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_uint_eq(osd_coverage_get_runs(merged), 2);
+    ck_assert_uint_eq(osd_coverage_get_covered_count(merged), 3);
+    ck_assert_uint_eq(osd_coverage_get_hits(merged, 1), 2);
+    ck_assert_uint_eq(osd_coverage_get_hits(merged, 2), 1);
+    ck_assert_uint_eq(osd_coverage_get_hits(merged, 65), 2);
+
+    // merging in memory gives the same result
+    rv = osd_coverage_merge(merged, coverage_ctx);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_uint_eq(osd_coverage_get_runs(merged), 3);
+    ck_assert_uint_eq(osd_coverage_get_hits(merged, 65), 3);
+
+    osd_coverage_free(&merged);
+}
+END_TEST
+
+START_TEST(test_symtab_mismatch)
+{
+    osd_result rv;
+    struct osd_symtab_ctx *other_symtab;
+    struct osd_coverage_ctx *other;
+
+    rv = osd_symtab_new(&other_symtab, log_ctx);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_symtab_add(other_symtab, 0x1000, 0, "main");
+    ck_assert_int_eq(rv, OSD_OK);
+
+    rv = osd_coverage_new(&other, log_ctx, other_symtab);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert(!osd_coverage_matches_symtab(other, symtab_ctx));
+
+    rv = osd_coverage_write(other, coverage_filename);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_coverage_merge_file(coverage_ctx, coverage_filename);
+    ck_assert_int_eq(rv, OSD_ERROR_FAILURE);
+    rv = osd_coverage_merge(coverage_ctx, other);
+    ck_assert_int_eq(rv, OSD_ERROR_FAILURE);
+
+    osd_coverage_free(&other);
+    osd_symtab_free(&other_symtab);
+}
+END_TEST
+
+START_TEST(test_corrupt)
+{
+    osd_result rv;
+
+    osd_coverage_add_call(coverage_ctx, sym_addr(1));
+    rv = osd_coverage_write(coverage_ctx, coverage_filename);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    // flip a bit in the bitmap
+    FILE *fp = fopen(coverage_filename, "r+b");
+    ck_assert_ptr_ne(fp, NULL);
+    ck_assert_int_eq(fseek(fp, 32, SEEK_SET), 0);
+    ck_assert_int_eq(fputc(0x80, fp), 0x80);
+    fclose(fp);
+
+    rv = osd_coverage_merge_file(coverage_ctx, coverage_filename);
+    ck_assert_int_eq(rv, OSD_ERROR_CORRUPT);
+
+    // truncated file
+    ck_assert_int_eq(truncate(coverage_filename, 40), 0);
+    rv = osd_coverage_merge_file(coverage_ctx, coverage_filename);
+    ck_assert_int_eq(rv, OSD_ERROR_CORRUPT);
+
+    // no coverage file at all
+    ck_assert_int_eq(truncate(coverage_filename, 0), 0);
+    rv = osd_coverage_merge_file(coverage_ctx, coverage_filename);
+    ck_assert_int_eq(rv, OSD_ERROR_FILE);
+
+    // merging failed files must not change the coverage
+    ck_assert_uint_eq(osd_coverage_get_runs(coverage_ctx), 1);
+    ck_assert_uint_eq(osd_coverage_get_covered_count(coverage_ctx), 1);
+}
+END_TEST
+
+Suite *suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create(TEST_SUITE_NAME);
+
+    tc_core = tcase_create("Core");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+    tcase_add_test(tc_core, test_add_call);
+    tcase_add_test(tc_core, test_add_call_outside);
+    tcase_add_test(tc_core, test_add_event);
+    tcase_add_test(tc_core, test_write_merge);
+    tcase_add_test(tc_core, test_symtab_mismatch);
+    tcase_add_test(tc_core, test_corrupt);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
@@ -0,0 +1,165 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TEST_SUITE_NAME "check_flightrec"
+
+#include "testutil.h"
+
+#include <osd/osd.h>
+#include <osd/flightrec.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+/**
+ * Dump the flight recorder and decode it
+ *
+ * @return the text, free() after use
+ */
+static char *dump_and_decode(void)
+{
+    osd_result rv;
+
+    FILE *fp_dump = tmpfile();
+    ck_assert_ptr_ne(fp_dump, NULL);
+    rv = osd_flightrec_dump(fileno(fp_dump));
+    ck_assert_int_eq(rv, OSD_OK);
+    rewind(fp_dump);
+
+    char *text = NULL;
+    size_t text_size = 0;
+    FILE *fp_text = open_memstream(&text, &text_size);
+    ck_assert_ptr_ne(fp_text, NULL);
+    rv = osd_flightrec_decode(fp_dump, fp_text);
+    ck_assert_int_eq(rv, OSD_OK);
+    fclose(fp_text);
+    fclose(fp_dump);
+
+    return text;
+}
+
+/**
+ * Count the lines of a text containing a string
+ */
+static unsigned int count_lines(const char *text, const char *str)
+{
+    unsigned int count = 0;
+    const char *line = text;
+    while (*line) {
+        const char *eol = strchr(line, '\n');
+        size_t len = eol ? (size_t)(eol - line) : strlen(line);
+        char *l = strndup(line, len);
+        if (strstr(l, str)) {
+            count++;
+        }
+        free(l);
+        line += len + (eol ? 1 : 0);
+    }
+    return count;
+}
+
+START_TEST(test_record_decode)
+{
+    osd_flightrec_record(OSD_FLIGHTREC_PKG_ROUTED, 1, 0x402, 5);
+    osd_flightrec_record(OSD_FLIGHTREC_PKG_DROPPED, 2, 0x1003,
+                         OSD_FLIGHTREC_DROP_NO_GATEWAY);
+    osd_flightrec_record(OSD_FLIGHTREC_USER + 1, 7, 8, 9);
+
+    char *text = dump_and_decode();
+    ck_assert_int_eq(count_lines(text, "pkg-routed         src=1 dest=1026 "
+                                       "words=5"), 1);
+    ck_assert_int_eq(count_lines(text, "pkg-dropped        src=2 dest=4099 "
+                                       "reason=3"), 1);
+    ck_assert_int_eq(count_lines(text, "event-0x8001       7 8 9"), 1);
+
+    // records are printed in the order they were recorded
+    ck_assert(strstr(text, "pkg-routed") < strstr(text, "pkg-dropped"));
+    free(text);
+
+    ck_assert_str_eq(osd_flightrec_event_name(OSD_FLIGHTREC_PKG_ROUTED),
+                     "pkg-routed");
+    ck_assert_ptr_eq(osd_flightrec_event_name(OSD_FLIGHTREC_USER), NULL);
+}
+END_TEST
+
+START_TEST(test_disabled)
+{
+    osd_flightrec_set_enabled(false);
+    osd_flightrec_record(OSD_FLIGHTREC_USER + 2, 1, 2, 3);
+    osd_flightrec_set_enabled(true);
+
+    char *text = dump_and_decode();
+    ck_assert_int_eq(count_lines(text, "event-0x8002"), 0);
+    free(text);
+}
+END_TEST
+
+static void *record_thread(void *arg)
+{
+    unsigned int num = *(unsigned int *)arg;
+    for (unsigned int i = 0; i < num; i++) {
+        osd_flightrec_record(OSD_FLIGHTREC_USER + 3, i, 0, 0);
+    }
+    return NULL;
+}
+
+START_TEST(test_ring_wrap)
+{
+    // only the most recent records of a thread are kept
+    unsigned int num = OSD_FLIGHTREC_RING_SIZE + 10;
+    pthread_t thread;
+    pthread_create(&thread, NULL, record_thread, &num);
+    pthread_join(thread, NULL);
+
+    char *text = dump_and_decode();
+    ck_assert_int_eq(count_lines(text, "event-0x8003"),
+                     OSD_FLIGHTREC_RING_SIZE);
+    ck_assert_int_eq(count_lines(text, "event-0x8003       9 0 0"), 0);
+    ck_assert_int_eq(count_lines(text, "event-0x8003       10 0 0"), 1);
+    free(text);
+}
+END_TEST
+
+START_TEST(test_decode_invalid)
+{
+    FILE *fp = tmpfile();
+    ck_assert_ptr_ne(fp, NULL);
+    fputs("not a flight recorder dump", fp);
+    rewind(fp);
+
+    osd_result rv = osd_flightrec_decode(fp, stdout);
+    ck_assert_int_eq(rv, OSD_ERROR_FAILURE);
+    fclose(fp);
+}
+END_TEST
+
+Suite *suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create(TEST_SUITE_NAME);
+
+    tc_core = tcase_create("Core");
+    tcase_add_test(tc_core, test_record_decode);
+    tcase_add_test(tc_core, test_disabled);
+    tcase_add_test(tc_core, test_ring_wrap);
+    tcase_add_test(tc_core, test_decode_invalid);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
@@ -0,0 +1,294 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TEST_SUITE_NAME "check_gateway_sim"
+
+#include "testutil.h"
+
+#include <osd/cl_mam.h>
+#include <osd/gateway_sim.h>
+#include <osd/hostctrl.h>
+#include <osd/hostmod.h>
+#include <osd/memaccess.h>
+#include <osd/module.h>
+#include <osd/osd.h>
+#include <osd/reg.h>
+
+#include <string.h>
+
+#define HOSTCTRL_EP "inproc://testing"
+#define SUBNET_ADDR 0
+
+struct osd_log_ctx *log_ctx;
+struct osd_hostctrl_ctx *hostctrl_ctx;
+struct osd_gateway_sim_ctx *gateway_sim_ctx;
+struct osd_memaccess_ctx *memaccess_ctx;
+struct osd_hostmod_ctx *hostmod_ctx;
+
+/** A system with as many modules as fit into a subnet */
+const struct osd_gateway_sim_config config_large = {
+    .num_mam = 4,
+    .num_dem_uart = 1,
+    .num_stm = 1,
+    .num_ctm = 508,
+    .num_cdm = 509,
+    .latency_ns = 0,
+    .latency_jitter_ns = 0,
+    .mam_addr_width_bit = 32,
+    .mam_data_width_bit = 64,
+    .mam_memsize = 0x10000000,
+};
+
+/**
+ * Test fixture: setup (called before each tests)
+ */
+void setup(void)
+{
+    osd_result rv;
+
+    log_ctx = testutil_get_log_ctx();
+    // debug messages for each of the 1024 modules are not helpful
+    osd_log_set_priority(log_ctx, LOG_WARNING);
+
+    rv = osd_hostctrl_new(&hostctrl_ctx, log_ctx, HOSTCTRL_EP);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_hostctrl_start(hostctrl_ctx);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    rv = osd_gateway_sim_new(&gateway_sim_ctx, log_ctx, HOSTCTRL_EP,
+                             SUBNET_ADDR, &config_large);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_uint_eq(osd_gateway_sim_get_num_modules(gateway_sim_ctx), 1024);
+    rv = osd_gateway_sim_connect(gateway_sim_ctx);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert(osd_gateway_sim_is_connected(gateway_sim_ctx));
+
+    rv = osd_memaccess_new(&memaccess_ctx, log_ctx, HOSTCTRL_EP);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_memaccess_connect(memaccess_ctx);
+    ck_assert_int_eq(rv, OSD_OK);
+    hostmod_ctx = osd_memaccess_get_hostmod(memaccess_ctx);
+}
+
+/**
+ * Test fixture: teardown (called after each test)
+ */
+void teardown(void)
+{
+    osd_result rv;
+
+    rv = osd_memaccess_disconnect(memaccess_ctx);
+    ck_assert_int_eq(rv, OSD_OK);
+    osd_memaccess_free(&memaccess_ctx);
+
+    rv = osd_gateway_sim_disconnect(gateway_sim_ctx);
+    ck_assert_int_eq(rv, OSD_OK);
+    osd_gateway_sim_free(&gateway_sim_ctx);
+    ck_assert_ptr_eq(gateway_sim_ctx, NULL);
+
+    rv = osd_hostctrl_stop(hostctrl_ctx);
+    ck_assert_int_eq(rv, OSD_OK);
+    osd_hostctrl_free(&hostctrl_ctx);
+
+    osd_log_free(&log_ctx);
+}
+
+START_TEST(test_config_parse)
+{
+    osd_result rv;
+    struct osd_gateway_sim_config config;
+
+    osd_gateway_sim_config_init(&config);
+    rv = osd_gateway_sim_config_parse(&config,
+                                      "mam=2,ctm=500,cdm=0x10,latency=2000");
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_uint_eq(config.num_mam, 2);
+    ck_assert_uint_eq(config.num_ctm, 500);
+    ck_assert_uint_eq(config.num_cdm, 16);
+    ck_assert_uint_eq(config.latency_ns, 2000);
+    // unchanged defaults
+    ck_assert_uint_eq(config.num_stm, 1);
+    ck_assert_uint_eq(config.mam_data_width_bit, 32);
+
+    rv = osd_gateway_sim_config_parse(&config, "mam=two");
+    ck_assert_int_eq(rv, OSD_ERROR_FAILURE);
+    rv = osd_gateway_sim_config_parse(&config, "foo=1");
+    ck_assert_int_eq(rv, OSD_ERROR_FAILURE);
+    rv = osd_gateway_sim_config_parse(&config, "mam");
+    ck_assert_int_eq(rv, OSD_ERROR_FAILURE);
+}
+END_TEST
+
+START_TEST(test_config_too_many_modules)
+{
+    osd_result rv;
+    struct osd_gateway_sim_config config;
+    struct osd_gateway_sim_ctx *ctx = NULL;
+
+    log_ctx = testutil_get_log_ctx();
+
+    osd_gateway_sim_config_init(&config);
+    config.num_cdm = OSD_DIADDR_LOCAL_MAX;
+    rv = osd_gateway_sim_new(&ctx, log_ctx, HOSTCTRL_EP, SUBNET_ADDR, &config);
+    ck_assert_int_eq(rv, OSD_ERROR_FAILURE);
+    ck_assert_ptr_eq(ctx, NULL);
+
+    osd_log_free(&log_ctx);
+}
+END_TEST
+
+START_TEST(test_init_base)
+{
+    setup();
+    teardown();
+}
+END_TEST
+
+START_TEST(test_get_modules)
+{
+    osd_result rv;
+    struct osd_module_desc *modules;
+    size_t modules_len;
+
+    rv = osd_hostmod_get_modules(hostmod_ctx, SUBNET_ADDR, &modules,
+                                 &modules_len);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_uint_eq(modules_len, 1024);
+
+    unsigned int num_by_type[OSD_MODULE_TYPE_STD_CDM + 1] = { 0 };
+    for (size_t i = 0; i < modules_len; i++) {
+        ck_assert_uint_eq(modules[i].addr,
+                          osd_diaddr_build(SUBNET_ADDR, i));
+        ck_assert_uint_eq(modules[i].vendor, OSD_MODULE_VENDOR_OSD);
+        ck_assert_uint_le(modules[i].type, OSD_MODULE_TYPE_STD_CDM);
+        num_by_type[modules[i].type]++;
+    }
+    free(modules);
+
+    ck_assert_uint_eq(num_by_type[OSD_MODULE_TYPE_STD_SCM], 1);
+    ck_assert_uint_eq(num_by_type[OSD_MODULE_TYPE_STD_MAM], 4);
+    ck_assert_uint_eq(num_by_type[OSD_MODULE_TYPE_STD_DEM_UART], 1);
+    ck_assert_uint_eq(num_by_type[OSD_MODULE_TYPE_STD_STM], 1);
+    ck_assert_uint_eq(num_by_type[OSD_MODULE_TYPE_STD_CTM], 508);
+    ck_assert_uint_eq(num_by_type[OSD_MODULE_TYPE_STD_CDM], 509);
+}
+END_TEST
+
+START_TEST(test_find_memories)
+{
+    osd_result rv;
+    struct osd_mem_desc *mems;
+    size_t mems_len;
+
+    rv = osd_memaccess_find_memories(memaccess_ctx, SUBNET_ADDR, &mems,
+                                     &mems_len);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_uint_eq(mems_len, 4);
+    for (size_t i = 0; i < mems_len; i++) {
+        // MAMs directly follow the SCM
+        ck_assert_uint_eq(mems[i].di_addr,
+                          osd_diaddr_build(SUBNET_ADDR, 1 + i));
+        ck_assert_uint_eq(mems[i].addr_width_bit, 32);
+        ck_assert_uint_eq(mems[i].data_width_bit, 64);
+        ck_assert_uint_eq(mems[i].num_regions, 1);
+        ck_assert_uint_eq(mems[i].regions[0].baseaddr, 0);
+        ck_assert_uint_eq(mems[i].regions[0].memsize, 0x10000000);
+    }
+    free(mems);
+}
+END_TEST
+
+START_TEST(test_reg_readback)
+{
+    osd_result rv;
+    uint16_t value;
+    uint16_t ctm_addr = osd_diaddr_build(SUBNET_ADDR, 1 + 4 + 1 + 1);
+
+    rv = osd_hostmod_reg_read(hostmod_ctx, &value, ctm_addr,
+                              OSD_REG_CTM_ADDR_WIDTH, 16, 0);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_uint_eq(value, 32);
+
+    // unknown registers read as 0 until written
+    rv = osd_hostmod_reg_read(hostmod_ctx, &value, ctm_addr,
+                              OSD_REG_BASE_MOD_EVENT_DEST, 16, 0);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_uint_eq(value, 0);
+
+    value = 0x1234;
+    rv = osd_hostmod_reg_write(hostmod_ctx, &value, ctm_addr,
+                               OSD_REG_BASE_MOD_EVENT_DEST, 16, 0);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_hostmod_reg_read(hostmod_ctx, &value, ctm_addr,
+                              OSD_REG_BASE_MOD_EVENT_DEST, 16, 0);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_uint_eq(value, 0x1234);
+}
+END_TEST
+
+START_TEST(test_mam_readback)
+{
+    osd_result rv;
+    struct osd_mem_desc mem;
+    uint8_t wr_data[3000], rd_data[3000];
+
+    rv = osd_cl_mam_get_mem_desc(hostmod_ctx, osd_diaddr_build(SUBNET_ADDR, 2),
+                                 &mem);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    for (size_t i = 0; i < sizeof(wr_data); i++) {
+        wr_data[i] = i * 7;
+    }
+
+    // unaligned start and end: single-word writes with byte select and bursts
+    rv = osd_cl_mam_write(&mem, hostmod_ctx, wr_data, sizeof(wr_data), 0x1003);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_cl_mam_read(&mem, hostmod_ctx, rd_data, sizeof(rd_data), 0x1003);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_int_eq(memcmp(wr_data, rd_data, sizeof(wr_data)), 0);
+
+    // the bytes around the written range are untouched
+    rv = osd_cl_mam_read(&mem, hostmod_ctx, rd_data, 3, 0x1000);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_uint_eq(rd_data[0] | rd_data[1] | rd_data[2], 0);
+}
+END_TEST
+
+Suite *suite(void)
+{
+    Suite *s;
+    TCase *tc_config, *tc_init, *tc_core;
+
+    s = suite_create(TEST_SUITE_NAME);
+
+    tc_config = tcase_create("Config");
+    tcase_add_test(tc_config, test_config_parse);
+    tcase_add_test(tc_config, test_config_too_many_modules);
+    suite_add_tcase(s, tc_config);
+
+    tc_init = tcase_create("Init");
+    tcase_add_test(tc_init, test_init_base);
+    suite_add_tcase(s, tc_init);
+
+    tc_core = tcase_create("Core");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+    tcase_add_test(tc_core, test_get_modules);
+    tcase_add_test(tc_core, test_find_memories);
+    tcase_add_test(tc_core, test_reg_readback);
+    tcase_add_test(tc_core, test_mam_readback);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
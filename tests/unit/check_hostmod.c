@@ -24,6 +24,10 @@
 #include <osd/packet.h>
 #include <osd/reg.h>
 
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+
 struct osd_hostmod_ctx *hostmod_ctx;
 struct osd_log_ctx *log_ctx;
 
@@ -219,6 +223,56 @@ START_TEST(test_core_event_send)
 }
 END_TEST
 
+static osd_result fd_handler(void *arg, int fd)
+{
+    struct osd_packet *event_pkg = arg;
+
+    char c;
+    ck_assert_int_eq(read(fd, &c, 1), 1);
+
+    // events sent from a handler bypass the main thread
+    event_pkg->data.payload[0] = c;
+    return osd_hostmod_event_send(hostmod_ctx, event_pkg);
+}
+
+START_TEST(test_core_fd_handler)
+{
+    osd_result rv;
+
+    int fds[2];
+    ck_assert_int_eq(pipe(fds), 0);
+
+    struct osd_packet *event_pkg;
+    osd_packet_new(&event_pkg, osd_packet_sizeconv_payload2data(1));
+    osd_packet_set_header(event_pkg, mock_hostmod_diaddr, 1,
+                          OSD_PACKET_TYPE_EVENT, 0);
+
+    rv = osd_hostmod_add_fd_handler(hostmod_ctx, fds[0], fd_handler,
+                                    event_pkg);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    struct osd_packet *exp_pkg;
+    osd_packet_new(&exp_pkg, osd_packet_sizeconv_payload2data(1));
+    osd_packet_set_header(exp_pkg, mock_hostmod_diaddr, 1,
+                          OSD_PACKET_TYPE_EVENT, 0);
+    exp_pkg->data.payload[0] = 'x';
+    mock_host_controller_expect_data_req(exp_pkg, NULL);
+
+    ck_assert_int_eq(write(fds[1], "x", 1), 1);
+    mock_host_controller_wait_for_requests();
+
+    rv = osd_hostmod_remove_fd_handler(hostmod_ctx, fds[0]);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_hostmod_remove_fd_handler(hostmod_ctx, fds[0]);
+    ck_assert_int_eq(rv, OSD_ERROR_FAILURE);
+
+    close(fds[0]);
+    close(fds[1]);
+    osd_packet_free(&exp_pkg);
+    osd_packet_free(&event_pkg);
+}
+END_TEST
+
 START_TEST(test_core_event_receive)
 {
     osd_result rv;
@@ -242,6 +296,402 @@ START_TEST(test_core_event_receive)
 }
 END_TEST
 
+START_TEST(test_core_event_receive_batch)
+{
+    osd_result rv;
+    struct osd_packet *event_pkgs[3];
+
+    for (unsigned int i = 0; i < 3; i++) {
+        osd_packet_new(&event_pkgs[i], osd_packet_sizeconv_payload2data(1));
+        osd_packet_set_header(event_pkgs[i], 1, mock_hostmod_diaddr,
+                              OSD_PACKET_TYPE_EVENT, EV_LAST);
+        event_pkgs[i]->data.payload[0] = i;
+        mock_host_controller_queue_data_packet(event_pkgs[i]);
+    }
+
+    // packets which have not arrived yet are returned by the next call
+    struct osd_packet *rcv_event_pkgs[4];
+    size_t num_rcv = 0;
+    while (num_rcv < 3) {
+        size_t num;
+        rv = osd_hostmod_event_receive_batch(hostmod_ctx,
+                                             &rcv_event_pkgs[num_rcv],
+                                             4 - num_rcv, &num, 0);
+        ck_assert_int_eq(rv, OSD_OK);
+        ck_assert_uint_ge(num, 1);
+        num_rcv += num;
+    }
+    ck_assert_uint_eq(num_rcv, 3);
+
+    for (unsigned int i = 0; i < 3; i++) {
+        ck_assert(osd_packet_equal(event_pkgs[i], rcv_event_pkgs[i]));
+        osd_packet_free(&event_pkgs[i]);
+        osd_packet_free(&rcv_event_pkgs[i]);
+    }
+}
+END_TEST
+
+/**
+ * Wait for a packet on the pollfd and receive it without blocking
+ */
+static struct osd_packet *poll_receive(void)
+{
+    osd_result rv;
+    struct osd_packet *pkg;
+
+    struct pollfd pfd = {
+        .fd = osd_hostmod_get_pollfd(hostmod_ctx),
+        .events = POLLIN,
+    };
+    ck_assert_int_ge(pfd.fd, 0);
+
+    while (1) {
+        rv = osd_hostmod_try_receive(hostmod_ctx, &pkg);
+        ck_assert_int_eq(rv, OSD_OK);
+        if (pkg) {
+            return pkg;
+        }
+        ck_assert_int_ge(poll(&pfd, 1, 1000), 0);
+    }
+}
+
+START_TEST(test_core_try_receive)
+{
+    osd_result rv;
+    struct osd_packet *rcv_event_pkg;
+
+    rv = osd_hostmod_try_receive(hostmod_ctx, &rcv_event_pkg);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_ptr_eq(rcv_event_pkg, NULL);
+
+    struct osd_packet *event_pkg;
+    osd_packet_new(&event_pkg, osd_packet_sizeconv_payload2data(1));
+    osd_packet_set_header(event_pkg, 1, mock_hostmod_diaddr,
+                          OSD_PACKET_TYPE_EVENT, EV_LAST);
+    event_pkg->data.payload[0] = 0x1234;
+    mock_host_controller_queue_data_packet(event_pkg);
+
+    rcv_event_pkg = poll_receive();
+    ck_assert(osd_packet_equal(event_pkg, rcv_event_pkg));
+
+    osd_packet_free(&event_pkg);
+    osd_packet_free(&rcv_event_pkg);
+}
+END_TEST
+
+START_TEST(test_core_reg_access_start_finish)
+{
+    osd_result rv;
+
+    uint16_t rd_val = 0;
+    uint16_t wr_val = 0xdead;
+    struct osd_hostmod_reg_access acc[2] = {
+        { .diaddr = 1, .reg_addr = 0x0000, .reg_size_bit = 16,
+          .write = false, .reg_val = &rd_val },
+        { .diaddr = 1, .reg_addr = 0x0001, .reg_size_bit = 16,
+          .write = true, .reg_val = &wr_val },
+    };
+
+    mock_host_controller_expect_reg_read(mock_hostmod_diaddr, 1, 0x0000,
+                                         0x0042);
+    mock_host_controller_expect_reg_write(mock_hostmod_diaddr, 1, 0x0001,
+                                          0xdead);
+
+    for (unsigned int i = 0; i < 2; i++) {
+        rv = osd_hostmod_reg_access_start(hostmod_ctx, &acc[i]);
+        ck_assert_int_eq(rv, OSD_OK);
+    }
+
+    for (unsigned int i = 0; i < 2; i++) {
+        struct osd_packet *resp = poll_receive();
+        rv = osd_hostmod_reg_access_finish(hostmod_ctx, &acc[i], resp);
+        ck_assert_int_eq(rv, OSD_OK);
+        ck_assert_int_eq(acc[i].result, OSD_OK);
+        osd_packet_free(&resp);
+    }
+    ck_assert_uint_eq(rd_val, 0x0042);
+}
+END_TEST
+
+static void async_reg_access_cb(void *arg, struct osd_hostmod_reg_access *acc)
+{
+    unsigned int *num_done = arg;
+    ck_assert_int_eq(acc->result, OSD_OK);
+    (*num_done)++;
+}
+
+static osd_result process_event_handler(void *arg, struct osd_packet *pkg)
+{
+    struct osd_packet **rcv_pkg = arg;
+    ck_assert_ptr_eq(*rcv_pkg, NULL);
+    *rcv_pkg = pkg;
+    return OSD_OK;
+}
+
+START_TEST(test_core_reg_access_async)
+{
+    osd_result rv;
+    unsigned int num_done = 0;
+
+    uint16_t rd_val[2] = { 0 };
+    struct osd_hostmod_reg_access acc[2] = {
+        { .diaddr = 1, .reg_addr = 0x0000, .reg_size_bit = 16,
+          .write = false, .reg_val = &rd_val[0] },
+        { .diaddr = 1, .reg_addr = 0x0001, .reg_size_bit = 16,
+          .write = false, .reg_val = &rd_val[1] },
+    };
+
+    mock_host_controller_expect_reg_read(mock_hostmod_diaddr, 1, 0x0000,
+                                         0x0042);
+    mock_host_controller_expect_reg_read(mock_hostmod_diaddr, 1, 0x0001,
+                                         0x0043);
+
+    for (unsigned int i = 0; i < 2; i++) {
+        rv = osd_hostmod_reg_access_async(hostmod_ctx, &acc[i],
+                                          async_reg_access_cb, &num_done);
+        ck_assert_int_eq(rv, OSD_OK);
+    }
+
+    // an event packet received in between is passed to the event handler
+    struct osd_packet *event_pkg;
+    osd_packet_new(&event_pkg, osd_packet_sizeconv_payload2data(1));
+    osd_packet_set_header(event_pkg, 1, mock_hostmod_diaddr,
+                          OSD_PACKET_TYPE_EVENT, EV_LAST);
+    event_pkg->data.payload[0] = 0x1234;
+    mock_host_controller_queue_data_packet(event_pkg);
+
+    struct osd_packet *rcv_event_pkg = NULL;
+    struct pollfd pfd = {
+        .fd = osd_hostmod_get_pollfd(hostmod_ctx),
+        .events = POLLIN,
+    };
+    while (num_done < 2 || !rcv_event_pkg) {
+        ck_assert_int_ge(poll(&pfd, 1, 1000), 0);
+        rv = osd_hostmod_process(hostmod_ctx, process_event_handler,
+                                 &rcv_event_pkg);
+        ck_assert_int_eq(rv, OSD_OK);
+    }
+
+    ck_assert_uint_eq(rd_val[0], 0x0042);
+    ck_assert_uint_eq(rd_val[1], 0x0043);
+    ck_assert(osd_packet_equal(event_pkg, rcv_event_pkg));
+
+    osd_packet_free(&event_pkg);
+    osd_packet_free(&rcv_event_pkg);
+}
+END_TEST
+
+/**
+ * Queue a register access response sent by module @p src
+ *
+ * The response is sent independently of the request, use it together with
+ * requests expected without a response to control the response order.
+ */
+static void queue_reg_resp(unsigned int src, unsigned int subtype,
+                           const uint16_t *payload, unsigned int payload_len)
+{
+    osd_result rv;
+    struct osd_packet *pkg;
+
+    rv = osd_packet_new(&pkg, osd_packet_sizeconv_payload2data(payload_len));
+    ck_assert_int_eq(rv, OSD_OK);
+    osd_packet_set_header(pkg, mock_hostmod_diaddr, src, OSD_PACKET_TYPE_REG,
+                          subtype);
+    for (unsigned int i = 0; i < payload_len; i++) {
+        pkg->data.payload[i] = payload[i];
+    }
+    mock_host_controller_queue_data_packet(pkg);
+    osd_packet_free(&pkg);
+}
+
+#define BATCH_WINDOW_NUM_ACCESSES 40
+#define BATCH_WINDOW_SIZE 32
+
+static volatile size_t batch_window_req_left;
+
+/**
+ * Answer the register reads of test_core_reg_access_batch_window
+ *
+ * Responses are only sent once the request window is full, the number of
+ * requests received by then is recorded in batch_window_req_left.
+ */
+static void *batch_window_responder(void *arg)
+{
+    while (mock_host_controller_num_exp_requests() >
+           BATCH_WINDOW_NUM_ACCESSES - BATCH_WINDOW_SIZE) {
+        usleep(10);
+    }
+    // give the host module the chance to exceed the window
+    usleep(50 * 1000);
+    batch_window_req_left = mock_host_controller_num_exp_requests();
+
+    for (uint16_t i = 0; i < BATCH_WINDOW_NUM_ACCESSES; i++) {
+        uint16_t val = 0x100 + i;
+        queue_reg_resp(1, RESP_READ_REG_SUCCESS_16, &val, 1);
+    }
+    return NULL;
+}
+
+/**
+ * Perform more register accesses in one batch than may be in flight
+ */
+START_TEST(test_core_reg_access_batch_window)
+{
+    osd_result rv;
+    uint16_t rd_val[BATCH_WINDOW_NUM_ACCESSES];
+    struct osd_hostmod_reg_access acc[BATCH_WINDOW_NUM_ACCESSES];
+
+    for (uint16_t i = 0; i < BATCH_WINDOW_NUM_ACCESSES; i++) {
+        mock_host_controller_expect_reg_read_noresp(mock_hostmod_diaddr, 1, i);
+        acc[i] = (struct osd_hostmod_reg_access) {
+            .diaddr = 1, .reg_addr = i, .reg_size_bit = 16,
+            .write = false, .reg_val = &rd_val[i] };
+    }
+
+    pthread_t thread;
+    ck_assert_int_eq(pthread_create(&thread, NULL, batch_window_responder,
+                                    NULL), 0);
+    rv = osd_hostmod_reg_access_batch(hostmod_ctx, acc,
+                                      BATCH_WINDOW_NUM_ACCESSES, 0);
+    pthread_join(thread, NULL);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    // no more requests than the window size were sent without a response
+    ck_assert_uint_eq(batch_window_req_left,
+                      BATCH_WINDOW_NUM_ACCESSES - BATCH_WINDOW_SIZE);
+
+    for (unsigned int i = 0; i < BATCH_WINDOW_NUM_ACCESSES; i++) {
+        ck_assert_int_eq(acc[i].result, OSD_OK);
+        ck_assert_uint_eq(rd_val[i], 0x100 + i);
+    }
+}
+END_TEST
+
+/**
+ * Responses of two modules arrive interleaved with each other and with an
+ * unexpected packet
+ *
+ * Each response must be matched to the oldest access to the module sending
+ * it; the unexpected packet is dropped.
+ */
+START_TEST(test_core_reg_access_batch_interleaved)
+{
+    osd_result rv;
+    uint16_t rd_val[4] = { 0 };
+    struct osd_hostmod_reg_access acc[4] = {
+        { .diaddr = 1, .reg_addr = 0x0000, .reg_size_bit = 16,
+          .write = false, .reg_val = &rd_val[0] },
+        { .diaddr = 2, .reg_addr = 0x0000, .reg_size_bit = 16,
+          .write = false, .reg_val = &rd_val[1] },
+        { .diaddr = 1, .reg_addr = 0x0001, .reg_size_bit = 16,
+          .write = false, .reg_val = &rd_val[2] },
+        { .diaddr = 2, .reg_addr = 0x0001, .reg_size_bit = 16,
+          .write = false, .reg_val = &rd_val[3] },
+    };
+
+    for (unsigned int i = 0; i < 4; i++) {
+        mock_host_controller_expect_reg_read_noresp(
+            mock_hostmod_diaddr, acc[i].diaddr, acc[i].reg_addr);
+    }
+
+    uint16_t val;
+    val = 0x2000;
+    queue_reg_resp(2, RESP_READ_REG_SUCCESS_16, &val, 1);
+    val = 0xdead;
+    queue_reg_resp(3, RESP_READ_REG_SUCCESS_16, &val, 1);
+    val = 0x2001;
+    queue_reg_resp(2, RESP_READ_REG_SUCCESS_16, &val, 1);
+    val = 0x1000;
+    queue_reg_resp(1, RESP_READ_REG_SUCCESS_16, &val, 1);
+    val = 0x1001;
+    queue_reg_resp(1, RESP_READ_REG_SUCCESS_16, &val, 1);
+
+    rv = osd_hostmod_reg_access_batch(hostmod_ctx, acc, 4, 0);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    ck_assert_uint_eq(rd_val[0], 0x1000);
+    ck_assert_uint_eq(rd_val[1], 0x2000);
+    ck_assert_uint_eq(rd_val[2], 0x1001);
+    ck_assert_uint_eq(rd_val[3], 0x2001);
+    for (unsigned int i = 0; i < 4; i++) {
+        ck_assert_int_eq(acc[i].result, OSD_OK);
+    }
+}
+END_TEST
+
+/**
+ * An error response fails only the access it belongs to
+ */
+START_TEST(test_core_reg_access_batch_error)
+{
+    osd_result rv;
+    uint16_t rd_val[3] = { 0 };
+    struct osd_hostmod_reg_access acc[3] = {
+        { .diaddr = 1, .reg_addr = 0x0000, .reg_size_bit = 16,
+          .write = false, .reg_val = &rd_val[0] },
+        { .diaddr = 1, .reg_addr = 0x0001, .reg_size_bit = 16,
+          .write = false, .reg_val = &rd_val[1] },
+        { .diaddr = 2, .reg_addr = 0x0000, .reg_size_bit = 16,
+          .write = false, .reg_val = &rd_val[2] },
+    };
+
+    for (unsigned int i = 0; i < 3; i++) {
+        mock_host_controller_expect_reg_read_noresp(
+            mock_hostmod_diaddr, acc[i].diaddr, acc[i].reg_addr);
+    }
+
+    uint16_t val;
+    val = 0x1000;
+    queue_reg_resp(1, RESP_READ_REG_SUCCESS_16, &val, 1);
+    queue_reg_resp(1, RESP_READ_REG_ERROR, NULL, 0);
+    val = 0x2000;
+    queue_reg_resp(2, RESP_READ_REG_SUCCESS_16, &val, 1);
+
+    rv = osd_hostmod_reg_access_batch(hostmod_ctx, acc, 3, 0);
+    ck_assert_int_eq(rv, OSD_ERROR_DEVICE_ERROR);
+
+    ck_assert_int_eq(acc[0].result, OSD_OK);
+    ck_assert_uint_eq(rd_val[0], 0x1000);
+    ck_assert_int_eq(acc[1].result, OSD_ERROR_DEVICE_ERROR);
+    ck_assert_int_eq(acc[2].result, OSD_OK);
+    ck_assert_uint_eq(rd_val[2], 0x2000);
+}
+END_TEST
+
+/**
+ * A module which does not respond times out all outstanding accesses
+ */
+START_TEST(test_core_reg_access_batch_timeout)
+{
+    osd_result rv;
+    uint16_t rd_val[3] = { 0 };
+    struct osd_hostmod_reg_access acc[3] = {
+        { .diaddr = 1, .reg_addr = 0x0000, .reg_size_bit = 16,
+          .write = false, .reg_val = &rd_val[0] },
+        { .diaddr = 2, .reg_addr = 0x0000, .reg_size_bit = 16,
+          .write = false, .reg_val = &rd_val[1] },
+        { .diaddr = 1, .reg_addr = 0x0001, .reg_size_bit = 16,
+          .write = false, .reg_val = &rd_val[2] },
+    };
+
+    mock_host_controller_expect_reg_read(mock_hostmod_diaddr, 1, 0x0000,
+                                         0x1000);
+    mock_host_controller_expect_reg_read_noresp(mock_hostmod_diaddr, 2,
+                                                0x0000);
+    mock_host_controller_expect_reg_read(mock_hostmod_diaddr, 1, 0x0001,
+                                         0x1001);
+
+    rv = osd_hostmod_reg_access_batch(hostmod_ctx, acc, 3, 0);
+    ck_assert_int_eq(rv, OSD_ERROR_TIMEDOUT);
+
+    ck_assert_int_eq(acc[0].result, OSD_OK);
+    ck_assert_uint_eq(rd_val[0], 0x1000);
+    ck_assert_int_eq(acc[1].result, OSD_ERROR_TIMEDOUT);
+    ck_assert_int_eq(acc[2].result, OSD_OK);
+    ck_assert_uint_eq(rd_val[2], 0x1001);
+}
+END_TEST
+
 START_TEST(test_core_event_receive_split_transaction)
 {
     osd_result rv;
@@ -520,7 +970,16 @@ Suite *suite(void)
     tcase_add_test(tc_core, test_core_reg_setbit);
 
     tcase_add_test(tc_core, test_core_event_send);
+    tcase_add_test(tc_core, test_core_fd_handler);
     tcase_add_test(tc_core, test_core_event_receive);
+    tcase_add_test(tc_core, test_core_event_receive_batch);
+    tcase_add_test(tc_core, test_core_try_receive);
+    tcase_add_test(tc_core, test_core_reg_access_start_finish);
+    tcase_add_test(tc_core, test_core_reg_access_async);
+    tcase_add_test(tc_core, test_core_reg_access_batch_window);
+    tcase_add_test(tc_core, test_core_reg_access_batch_interleaved);
+    tcase_add_test(tc_core, test_core_reg_access_batch_error);
+    tcase_add_test(tc_core, test_core_reg_access_batch_timeout);
     tcase_add_test(tc_core, test_core_event_receive_split_transaction);
     tcase_add_test(tc_core,
                    test_core_event_receive_split_transaction_interleaved);
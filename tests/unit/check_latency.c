@@ -0,0 +1,112 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TEST_SUITE_NAME "check_latency"
+
+#include "testutil.h"
+
+#include <osd/osd.h>
+#include <osd/latency.h>
+
+START_TEST(test_hist_add)
+{
+    struct osd_latency_hist hist = { 0 };
+
+    ck_assert_uint_eq(osd_latency_hist_percentile(&hist, 50), 0);
+
+    osd_latency_hist_add(&hist, 0);
+    osd_latency_hist_add(&hist, 1);
+    osd_latency_hist_add(&hist, 1000);
+    osd_latency_hist_add(&hist, 1023);
+    osd_latency_hist_add(&hist, 1024);
+
+    ck_assert_uint_eq(hist.count, 5);
+    ck_assert_uint_eq(hist.sum_ns, 3048);
+    ck_assert_uint_eq(hist.min_ns, 0);
+    ck_assert_uint_eq(hist.max_ns, 1024);
+    ck_assert_uint_eq(hist.buckets[0], 1);
+    ck_assert_uint_eq(hist.buckets[1], 1);
+    ck_assert_uint_eq(hist.buckets[10], 2); // [512, 1024)
+    ck_assert_uint_eq(hist.buckets[11], 1); // [1024, 2048)
+
+    // very large latencies end up in the last bucket
+    osd_latency_hist_add(&hist, UINT64_MAX);
+    ck_assert_uint_eq(hist.buckets[OSD_LATENCY_HIST_BUCKETS - 1], 1);
+    ck_assert_uint_eq(hist.max_ns, UINT64_MAX);
+}
+END_TEST
+
+START_TEST(test_hist_percentile)
+{
+    struct osd_latency_hist hist = { 0 };
+
+    // 90 fast samples, 10 slow ones
+    for (unsigned int i = 0; i < 90; i++) {
+        osd_latency_hist_add(&hist, 3000);
+    }
+    for (unsigned int i = 0; i < 10; i++) {
+        osd_latency_hist_add(&hist, 1000000);
+    }
+
+    // upper bound of the bucket [2048, 4096)
+    ck_assert_uint_eq(osd_latency_hist_percentile(&hist, 50), 4095);
+    ck_assert_uint_eq(osd_latency_hist_percentile(&hist, 90), 4095);
+    // limited to the largest sample
+    ck_assert_uint_eq(osd_latency_hist_percentile(&hist, 99), 1000000);
+    ck_assert_uint_eq(osd_latency_hist_percentile(&hist, 100), 1000000);
+    ck_assert_uint_eq(osd_latency_hist_percentile(&hist, 0), 4095);
+}
+END_TEST
+
+START_TEST(test_stats_merge)
+{
+    struct osd_latency_stats stats = { 0 };
+    struct osd_latency_stats other = { 0 };
+
+    osd_latency_hist_add(&stats.hop[OSD_LATENCY_HOP_GATEWAY], 500);
+    osd_latency_hist_add(&other.hop[OSD_LATENCY_HOP_GATEWAY], 100);
+    osd_latency_hist_add(&other.hop[OSD_LATENCY_HOP_TOTAL], 900);
+
+    osd_latency_stats_merge(&stats, &other);
+    ck_assert_uint_eq(stats.hop[OSD_LATENCY_HOP_GATEWAY].count, 2);
+    ck_assert_uint_eq(stats.hop[OSD_LATENCY_HOP_GATEWAY].min_ns, 100);
+    ck_assert_uint_eq(stats.hop[OSD_LATENCY_HOP_GATEWAY].max_ns, 500);
+    ck_assert_uint_eq(stats.hop[OSD_LATENCY_HOP_TOTAL].count, 1);
+    ck_assert_uint_eq(stats.hop[OSD_LATENCY_HOP_TOTAL].min_ns, 900);
+    ck_assert_uint_eq(stats.hop[OSD_LATENCY_HOP_HOSTMOD].count, 0);
+
+    osd_latency_stats_reset(&stats);
+    ck_assert_uint_eq(stats.hop[OSD_LATENCY_HOP_GATEWAY].count, 0);
+
+    ck_assert_str_eq(osd_latency_hop_name(OSD_LATENCY_HOP_HOSTCTRL),
+                     "hostctrl");
+}
+END_TEST
+
+Suite *suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create(TEST_SUITE_NAME);
+
+    tc_core = tcase_create("Core");
+    tcase_add_test(tc_core, test_hist_add);
+    tcase_add_test(tc_core, test_hist_percentile);
+    tcase_add_test(tc_core, test_stats_merge);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
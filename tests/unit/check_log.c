@@ -20,6 +20,10 @@
 #include <osd/osd.h>
 #include "../../src/libosd/osd-private.h"
 
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
 int log_handler_called = 0;
 
 static void log_handler(struct osd_log_ctx *ctx, int priority, const char *file,
@@ -86,6 +90,228 @@ START_TEST(test_log_constructorparams)
 }
 END_TEST
 
+static pthread_t async_log_handler_thread;
+static int async_log_handler_called = 0;
+static char async_log_last_msg[256];
+static pthread_mutex_t async_log_block = PTHREAD_MUTEX_INITIALIZER;
+
+static void async_log_handler(struct osd_log_ctx *ctx, int priority,
+                              const char *file, int line, const char *fn,
+                              const char *format, va_list args)
+{
+    pthread_mutex_lock(&async_log_block);
+    pthread_mutex_unlock(&async_log_block);
+
+    ck_assert_int_eq(priority, LOG_ERR);
+    ck_assert_str_eq(file, __FILE__);
+    async_log_handler_thread = pthread_self();
+    vsnprintf(async_log_last_msg, sizeof(async_log_last_msg), format, args);
+    async_log_handler_called++;
+}
+
+START_TEST(test_log_async)
+{
+    osd_result rv;
+    struct osd_log_ctx *log_ctx;
+
+    rv = osd_log_new(&log_ctx, LOG_DEBUG, &async_log_handler);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert(!osd_log_is_async(log_ctx));
+
+    rv = osd_log_set_async(log_ctx, true);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert(osd_log_is_async(log_ctx));
+
+    async_log_handler_called = 0;
+    for (int i = 0; i < 10; i++) {
+        osd_log(log_ctx, LOG_ERR, __FILE__, __LINE__, __FUNCTION__,
+                "testmsg %d", i);
+    }
+    osd_log_flush(log_ctx);
+    ck_assert_int_eq(async_log_handler_called, 10);
+    ck_assert_str_eq(async_log_last_msg, "testmsg 9");
+
+    struct osd_log_async_stats stats;
+    osd_log_get_async_stats(log_ctx, &stats);
+    ck_assert_uint_eq(stats.num_records, 10);
+    ck_assert_uint_eq(stats.num_dropped, 0);
+
+    // the log handler is called from the drain thread
+    osd_log(log_ctx, LOG_ERR, __FILE__, __LINE__, __FUNCTION__, "testmsg");
+    rv = osd_log_set_async(log_ctx, false);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_int_eq(async_log_handler_called, 11);
+    ck_assert(!pthread_equal(async_log_handler_thread, pthread_self()));
+
+    // synchronous logging
+    osd_log(log_ctx, LOG_ERR, __FILE__, __LINE__, __FUNCTION__, "testmsg");
+    ck_assert_int_eq(async_log_handler_called, 12);
+    ck_assert(pthread_equal(async_log_handler_thread, pthread_self()));
+
+    osd_log_free(&log_ctx);
+}
+END_TEST
+
+/**
+ * Log from a thread to two contexts, free the one used last and continue
+ * logging to the other one
+ */
+static void *async_freed_ctx_thread(void *arg)
+{
+    osd_result rv;
+    struct osd_log_ctx *log_ctx_a = arg;
+    struct osd_log_ctx *log_ctx_b;
+
+    rv = osd_log_new(&log_ctx_b, LOG_DEBUG, &async_log_handler);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_log_set_async(log_ctx_b, true);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    osd_log(log_ctx_a, LOG_ERR, __FILE__, __LINE__, __FUNCTION__, "testmsg a");
+    osd_log(log_ctx_b, LOG_ERR, __FILE__, __LINE__, __FUNCTION__, "testmsg b");
+    osd_log_free(&log_ctx_b);
+
+    // drops the ring of log_ctx_b, which is the first ring of this thread
+    osd_log(log_ctx_a, LOG_ERR, __FILE__, __LINE__, __FUNCTION__, "testmsg a");
+    osd_log(log_ctx_a, LOG_ERR, __FILE__, __LINE__, __FUNCTION__, "testmsg a");
+
+    return NULL;
+}
+
+START_TEST(test_log_async_freed_ctx)
+{
+    osd_result rv;
+    struct osd_log_ctx *log_ctx;
+
+    rv = osd_log_new(&log_ctx, LOG_DEBUG, &async_log_handler);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_log_set_async(log_ctx, true);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    async_log_handler_called = 0;
+    pthread_t thread;
+    pthread_create(&thread, NULL, async_freed_ctx_thread, log_ctx);
+    pthread_join(thread, NULL);
+
+    osd_log_flush(log_ctx);
+    ck_assert_int_eq(async_log_handler_called, 4);
+    ck_assert_str_eq(async_log_last_msg, "testmsg a");
+
+    osd_log_free(&log_ctx);
+}
+END_TEST
+
+START_TEST(test_log_async_dropped)
+{
+    osd_result rv;
+    struct osd_log_ctx *log_ctx;
+
+    rv = osd_log_new(&log_ctx, LOG_DEBUG, &async_log_handler);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_log_set_async(log_ctx, true);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    // Block the log handler. The record being passed to the log handler
+    // stays in the queue until the handler returns, i.e. the queue (256
+    // records) is full after 256 records.
+    pthread_mutex_lock(&async_log_block);
+    async_log_handler_called = 0;
+    for (int i = 0; i < 300; i++) {
+        osd_log(log_ctx, LOG_ERR, __FILE__, __LINE__, __FUNCTION__,
+                "testmsg %d", i);
+    }
+    pthread_mutex_unlock(&async_log_block);
+    osd_log_flush(log_ctx);
+
+    ck_assert_int_eq(async_log_handler_called, 256);
+    ck_assert_str_eq(async_log_last_msg, "testmsg 255");
+
+    struct osd_log_async_stats stats;
+    osd_log_get_async_stats(log_ctx, &stats);
+    ck_assert_uint_eq(stats.num_records, 256);
+    ck_assert_uint_eq(stats.num_dropped, 44);
+
+    osd_log_free(&log_ctx);
+}
+END_TEST
+
+#define ASYNC_THREADS 4
+#define ASYNC_THREAD_MSGS 100
+
+static int async_order_last[ASYNC_THREADS];
+static int async_order_errors = 0;
+
+static void async_order_log_handler(struct osd_log_ctx *ctx, int priority,
+                                    const char *file, int line, const char *fn,
+                                    const char *format, va_list args)
+{
+    char msg[64];
+    vsnprintf(msg, sizeof(msg), format, args);
+
+    int thread, seq;
+    ck_assert_int_eq(sscanf(msg, "%d %d", &thread, &seq), 2);
+    ck_assert(thread >= 0 && thread < ASYNC_THREADS);
+
+    // the messages of one thread are delivered in order
+    if (seq != async_order_last[thread] + 1) {
+        async_order_errors++;
+    }
+    async_order_last[thread] = seq;
+}
+
+struct async_order_thread_arg {
+    struct osd_log_ctx *log_ctx;
+    int thread;
+};
+
+static void *async_order_thread(void *arg_void)
+{
+    struct async_order_thread_arg *arg = arg_void;
+    for (int i = 0; i < ASYNC_THREAD_MSGS; i++) {
+        osd_log(arg->log_ctx, LOG_ERR, __FILE__, __LINE__, __FUNCTION__,
+                "%d %d", arg->thread, i);
+    }
+    return NULL;
+}
+
+START_TEST(test_log_async_threads)
+{
+    osd_result rv;
+    struct osd_log_ctx *log_ctx;
+
+    rv = osd_log_new(&log_ctx, LOG_DEBUG, &async_order_log_handler);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_log_set_async(log_ctx, true);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    pthread_t threads[ASYNC_THREADS];
+    struct async_order_thread_arg args[ASYNC_THREADS];
+    for (int i = 0; i < ASYNC_THREADS; i++) {
+        async_order_last[i] = -1;
+        args[i].log_ctx = log_ctx;
+        args[i].thread = i;
+        pthread_create(&threads[i], NULL, async_order_thread, &args[i]);
+    }
+    for (int i = 0; i < ASYNC_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    osd_log_flush(log_ctx);
+
+    struct osd_log_async_stats stats;
+    osd_log_get_async_stats(log_ctx, &stats);
+    ck_assert_uint_eq(stats.num_records + stats.num_dropped,
+                      ASYNC_THREADS * ASYNC_THREAD_MSGS);
+    if (stats.num_dropped == 0) {
+        for (int i = 0; i < ASYNC_THREADS; i++) {
+            ck_assert_int_eq(async_order_last[i], ASYNC_THREAD_MSGS - 1);
+        }
+        ck_assert_int_eq(async_order_errors, 0);
+    }
+
+    osd_log_free(&log_ctx);
+}
+END_TEST
+
 Suite *suite(void)
 {
     Suite *s;
@@ -98,6 +324,10 @@ Suite *suite(void)
 
     tcase_add_test(tc_core, test_log_basic);
     tcase_add_test(tc_core, test_log_constructorparams);
+    tcase_add_test(tc_core, test_log_async);
+    tcase_add_test(tc_core, test_log_async_freed_ctx);
+    tcase_add_test(tc_core, test_log_async_dropped);
+    tcase_add_test(tc_core, test_log_async_threads);
     suite_add_tcase(s, tc_core);
 
     return s;
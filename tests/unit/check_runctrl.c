@@ -0,0 +1,324 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TEST_SUITE_NAME "check_runctrl"
+
+#include "testutil.h"
+
+#include <osd/osd.h>
+#include <osd/reg.h>
+#include <osd/runctrl.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include "mock_host_controller.h"
+
+#define NUM_CORES 3
+
+struct osd_runctrl_ctx *runctrl_ctx;
+struct osd_log_ctx* log_ctx;
+
+const unsigned int target_subnet_addr = 0;
+unsigned int mock_hostmod_diaddr;
+unsigned int mock_cdm_diaddrs[NUM_CORES];
+
+/**
+ * Setup everything related to osd_hostmod
+ */
+void setup_hostmod(void)
+{
+    osd_result rv;
+
+    log_ctx = testutil_get_log_ctx();
+
+    // initialize module context
+    rv = osd_runctrl_new(&runctrl_ctx, log_ctx, "inproc://testing");
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_ptr_ne(runctrl_ctx, NULL);
+
+    // connect
+    mock_host_controller_expect_diaddr_req(mock_hostmod_diaddr);
+
+    rv = osd_runctrl_connect(runctrl_ctx);
+    ck_assert_int_eq(rv, OSD_OK);
+}
+
+void teardown_hostmod(void)
+{
+    osd_result rv;
+    rv = osd_runctrl_disconnect(runctrl_ctx);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    osd_runctrl_free(&runctrl_ctx);
+    ck_assert_ptr_eq(runctrl_ctx, NULL);
+}
+
+/**
+ * Test fixture: setup (called before each tests)
+ */
+void setup(void)
+{
+    mock_hostmod_diaddr = osd_diaddr_build(1, 1);
+    for (unsigned int i = 0; i < NUM_CORES; i++) {
+        mock_cdm_diaddrs[i] = osd_diaddr_build(target_subnet_addr, 3 + i);
+    }
+
+    mock_host_controller_setup();
+    setup_hostmod();
+}
+
+/**
+ * Test fixture: setup (called after each test)
+ */
+void teardown(void)
+{
+    mock_host_controller_wait_for_event_tx();
+    teardown_hostmod();
+    mock_host_controller_teardown();
+}
+
+START_TEST(test_init_base)
+{
+    setup();
+    teardown();
+}
+END_TEST
+
+static void add_cores(void)
+{
+    osd_result rv;
+
+    for (unsigned int i = 0; i < NUM_CORES; i++) {
+        // CDM descriptor
+        mock_host_controller_expect_mod_describe(mock_hostmod_diaddr,
+                                                 mock_cdm_diaddrs[i],
+                                                 OSD_MODULE_VENDOR_OSD,
+                                                 OSD_MODULE_TYPE_STD_CDM, 0);
+        mock_host_controller_expect_reg_read(mock_hostmod_diaddr,
+                                             mock_cdm_diaddrs[i],
+                                             OSD_REG_CDM_CORE_CTRL, 0);
+        mock_host_controller_expect_reg_read(mock_hostmod_diaddr,
+                                             mock_cdm_diaddrs[i],
+                                             OSD_REG_CDM_CORE_REG_UPPER, 0);
+        mock_host_controller_expect_reg_read(mock_hostmod_diaddr,
+                                             mock_cdm_diaddrs[i],
+                                             OSD_REG_CDM_CORE_DATA_WIDTH, 32);
+
+        // set event dest
+        mock_host_controller_expect_reg_write(mock_hostmod_diaddr,
+                                              mock_cdm_diaddrs[i],
+                                              OSD_REG_BASE_MOD_EVENT_DEST,
+                                              mock_hostmod_diaddr);
+
+        // activate event sending
+        mock_host_controller_expect_reg_read(mock_hostmod_diaddr,
+                                             mock_cdm_diaddrs[i],
+                                             OSD_REG_BASE_MOD_CS, 0);
+        mock_host_controller_expect_reg_write(mock_hostmod_diaddr,
+                                              mock_cdm_diaddrs[i],
+                                              OSD_REG_BASE_MOD_CS, 1);
+    }
+
+    rv = osd_runctrl_add_cores(runctrl_ctx, mock_cdm_diaddrs, NUM_CORES);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_uint_eq(osd_runctrl_get_num_cores(runctrl_ctx), NUM_CORES);
+}
+
+START_TEST(test_core_add_cores)
+{
+    add_cores();
+
+    for (unsigned int i = 0; i < NUM_CORES; i++) {
+        struct osd_cdm_desc *desc = osd_runctrl_get_cdm_desc(runctrl_ctx, i);
+        ck_assert_uint_eq(desc->di_addr, mock_cdm_diaddrs[i]);
+        ck_assert_uint_eq(desc->core_data_width, 32);
+        ck_assert(!osd_runctrl_is_stalled(runctrl_ctx, i));
+    }
+}
+END_TEST
+
+/**
+ * Queue a stall event packet sent by the CDM of @p core
+ */
+static void queue_stall_event(unsigned int core, bool stalled)
+{
+    osd_result rv;
+    struct osd_packet *pkg;
+
+    rv = osd_packet_new(&pkg, osd_packet_sizeconv_payload2data(1));
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_packet_set_header(pkg, mock_hostmod_diaddr,
+                               mock_cdm_diaddrs[core], OSD_PACKET_TYPE_EVENT,
+                               0);
+    ck_assert_int_eq(rv, OSD_OK);
+    pkg->data.payload[0] = stalled;
+    mock_host_controller_queue_data_packet(pkg);
+    osd_packet_free(&pkg);
+}
+
+START_TEST(test_core_stall_release)
+{
+    osd_result rv;
+    struct osd_runctrl_sync_stats stats;
+
+    add_cores();
+
+    // all CORE_CTRL writes are part of one batch
+    for (unsigned int i = 0; i < NUM_CORES; i++) {
+        mock_host_controller_expect_reg_write(
+            mock_hostmod_diaddr, mock_cdm_diaddrs[i], OSD_REG_CDM_CORE_CTRL,
+            BIT(OSD_REG_CDM_CORE_CTRL_STALL_BIT));
+    }
+    rv = osd_runctrl_stall(runctrl_ctx, &stats);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_uint_eq(stats.num_cores, NUM_CORES);
+    // the mock does not send stall events
+    ck_assert_uint_eq(stats.num_events, 0);
+    ck_assert_uint_eq(stats.event_skew_ns, 0);
+
+    for (unsigned int i = 0; i < NUM_CORES; i++) {
+        mock_host_controller_expect_reg_write(
+            mock_hostmod_diaddr, mock_cdm_diaddrs[i], OSD_REG_CDM_CORE_CTRL, 0);
+    }
+    rv = osd_runctrl_release(runctrl_ctx, NULL);
+    ck_assert_int_eq(rv, OSD_OK);
+}
+END_TEST
+
+/**
+ * Let all CDMs confirm the new stall state once the CORE_CTRL writes arrived
+ *
+ * The events must not be queued before, as osd_runctrl_stall() and
+ * osd_runctrl_release() ignore all events received before the writes.
+ */
+static void *confirm_thread(void *arg)
+{
+    bool stalled = *(bool *)arg;
+
+    mock_host_controller_wait_for_requests();
+    for (unsigned int i = 0; i < NUM_CORES; i++) {
+        queue_stall_event(i, stalled);
+    }
+    return NULL;
+}
+
+static void confirm_stall_state(bool stalled)
+{
+    osd_result rv;
+    struct osd_runctrl_sync_stats stats;
+    pthread_t thread;
+
+    uint16_t core_ctrl = stalled ? BIT(OSD_REG_CDM_CORE_CTRL_STALL_BIT) : 0;
+    for (unsigned int i = 0; i < NUM_CORES; i++) {
+        mock_host_controller_expect_reg_write(mock_hostmod_diaddr,
+                                              mock_cdm_diaddrs[i],
+                                              OSD_REG_CDM_CORE_CTRL,
+                                              core_ctrl);
+    }
+    ck_assert_int_eq(pthread_create(&thread, NULL, confirm_thread, &stalled),
+                     0);
+    if (stalled) {
+        rv = osd_runctrl_stall(runctrl_ctx, &stats);
+    } else {
+        rv = osd_runctrl_release(runctrl_ctx, &stats);
+    }
+    ck_assert_int_eq(rv, OSD_OK);
+    pthread_join(thread, NULL);
+
+    ck_assert_uint_eq(stats.num_cores, NUM_CORES);
+    ck_assert_uint_eq(stats.num_events, NUM_CORES);
+    // the mock sends one event per timer tick
+    ck_assert_uint_gt(stats.event_skew_ns, 0);
+    ck_assert_uint_lt(stats.event_skew_ns,
+                      OSD_RUNCTRL_EVENT_TIMEOUT_MS * 1000 * 1000);
+
+    for (unsigned int i = 0; i < NUM_CORES; i++) {
+        ck_assert(osd_runctrl_is_stalled(runctrl_ctx, i) == stalled);
+    }
+}
+
+START_TEST(test_core_stall_release_events)
+{
+    add_cores();
+
+    confirm_stall_state(true);
+    confirm_stall_state(false);
+}
+END_TEST
+
+static volatile unsigned int stall_handler_calls;
+static volatile bool stall_handler_stalled[NUM_CORES];
+
+static void stall_handler(void *arg, unsigned int core, bool stalled)
+{
+    ck_assert_ptr_eq(arg, runctrl_ctx);
+    ck_assert_uint_lt(core, NUM_CORES);
+    stall_handler_stalled[core] = stalled;
+    stall_handler_calls++;
+}
+
+START_TEST(test_core_stall_event)
+{
+    add_cores();
+
+    stall_handler_calls = 0;
+    osd_runctrl_set_stall_handler(runctrl_ctx, stall_handler, runctrl_ctx);
+
+    // core 1 stalls by itself, e.g. on a breakpoint
+    queue_stall_event(1, true);
+    mock_host_controller_wait_for_event_tx();
+
+    // the event is handled asynchronously in the I/O thread
+    for (unsigned int i = 0; i < 1000 && stall_handler_calls == 0; i++) {
+        usleep(1000);
+    }
+    ck_assert_uint_eq(stall_handler_calls, 1);
+    ck_assert(stall_handler_stalled[1]);
+
+    ck_assert(!osd_runctrl_is_stalled(runctrl_ctx, 0));
+    ck_assert(osd_runctrl_is_stalled(runctrl_ctx, 1));
+    ck_assert(!osd_runctrl_is_stalled(runctrl_ctx, 2));
+
+    osd_runctrl_set_stall_handler(runctrl_ctx, NULL, NULL);
+}
+END_TEST
+
+Suite * suite(void)
+{
+    Suite *s;
+    TCase *tc_init, *tc_core;
+
+    s = suite_create(TEST_SUITE_NAME);
+
+    // Initialization
+    // As the setup and teardown functions are pretty heavy, we check them
+    // here independently and use them as test fixtures after this test
+    // succeeds.
+    tc_init = tcase_create("Init");
+    tcase_add_test(tc_init, test_init_base);
+    suite_add_tcase(s, tc_init);
+
+    // Core functionality
+    tc_core = tcase_create("Core");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+    tcase_add_test(tc_core, test_core_add_cores);
+    tcase_add_test(tc_core, test_core_stall_release);
+    tcase_add_test(tc_core, test_core_stall_release_events);
+    tcase_add_test(tc_core, test_core_stall_event);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
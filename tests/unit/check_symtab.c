@@ -0,0 +1,151 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TEST_SUITE_NAME "check_symtab"
+
+#include "testutil.h"
+
+#include <osd/osd.h>
+#include <osd/symtab.h>
+
+struct osd_symtab_ctx *symtab_ctx;
+struct osd_log_ctx *log_ctx;
+
+/**
+ * Test fixture: setup (called before each tests)
+ */
+void setup(void)
+{
+    osd_result rv;
+
+    log_ctx = testutil_get_log_ctx();
+
+    rv = osd_symtab_new(&symtab_ctx, log_ctx);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_ptr_ne(symtab_ctx, NULL);
+
+    // add in random order, the table must sort them
+    rv = osd_symtab_add(symtab_ctx, 0x2000, 0x100, "func_b");
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_symtab_add(symtab_ctx, 0x1000, 0, "func_a");
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_symtab_add(symtab_ctx, 0x3000, 0x40, "func_c");
+    ck_assert_int_eq(rv, OSD_OK);
+}
+
+/**
+ * Test fixture: teardown (called after each test)
+ */
+void teardown(void)
+{
+    osd_symtab_free(&symtab_ctx);
+    ck_assert_ptr_eq(symtab_ctx, NULL);
+
+    osd_log_free(&log_ctx);
+}
+
+START_TEST(test_sorted)
+{
+    ck_assert_uint_eq(osd_symtab_get_count(symtab_ctx), 3);
+
+    ck_assert_uint_eq(osd_symtab_get(symtab_ctx, 0)->addr, 0x1000);
+    ck_assert_str_eq(osd_symtab_get(symtab_ctx, 0)->name, "func_a");
+    ck_assert_uint_eq(osd_symtab_get(symtab_ctx, 1)->addr, 0x2000);
+    ck_assert_str_eq(osd_symtab_get(symtab_ctx, 1)->name, "func_b");
+    ck_assert_uint_eq(osd_symtab_get(symtab_ctx, 1)->size, 0x100);
+    ck_assert_uint_eq(osd_symtab_get(symtab_ctx, 2)->addr, 0x3000);
+    ck_assert_str_eq(osd_symtab_get(symtab_ctx, 2)->name, "func_c");
+}
+END_TEST
+
+START_TEST(test_find)
+{
+    const struct osd_symtab_entry *sym;
+
+    sym = osd_symtab_find(symtab_ctx, 0x2000);
+    ck_assert_ptr_ne(sym, NULL);
+    ck_assert_str_eq(sym->name, "func_b");
+
+    ck_assert_ptr_eq(osd_symtab_find(symtab_ctx, 0x2004), NULL);
+    ck_assert_ptr_eq(osd_symtab_find(symtab_ctx, 0x0), NULL);
+    ck_assert_ptr_eq(osd_symtab_find(symtab_ctx, 0x4000), NULL);
+}
+END_TEST
+
+START_TEST(test_find_containing)
+{
+    const struct osd_symtab_entry *sym;
+
+    sym = osd_symtab_find_containing(symtab_ctx, 0x1000);
+    ck_assert_str_eq(sym->name, "func_a");
+    sym = osd_symtab_find_containing(symtab_ctx, 0x1ffe);
+    ck_assert_str_eq(sym->name, "func_a");
+    sym = osd_symtab_find_containing(symtab_ctx, 0x2004);
+    ck_assert_str_eq(sym->name, "func_b");
+    sym = osd_symtab_find_containing(symtab_ctx, 0xffff0000);
+    ck_assert_str_eq(sym->name, "func_c");
+
+    // addresses before the first symbol are attributed to the first symbol
+    sym = osd_symtab_find_containing(symtab_ctx, 0x10);
+    ck_assert_str_eq(sym->name, "func_a");
+}
+END_TEST
+
+START_TEST(test_empty)
+{
+    osd_result rv;
+    struct osd_symtab_ctx *empty_ctx;
+
+    rv = osd_symtab_new(&empty_ctx, log_ctx);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    ck_assert_uint_eq(osd_symtab_get_count(empty_ctx), 0);
+    ck_assert_ptr_eq(osd_symtab_find(empty_ctx, 0x1000), NULL);
+    ck_assert_ptr_eq(osd_symtab_find_containing(empty_ctx, 0x1000), NULL);
+
+    osd_symtab_free(&empty_ctx);
+    ck_assert_ptr_eq(empty_ctx, NULL);
+}
+END_TEST
+
+START_TEST(test_load_elf_nonexisting)
+{
+    osd_result rv;
+    rv = osd_symtab_load_elf(symtab_ctx, "/nonexisting/file.elf");
+    ck_assert_int_eq(rv, OSD_ERROR_FILE);
+
+    // the existing symbols are still there
+    ck_assert_uint_eq(osd_symtab_get_count(symtab_ctx), 3);
+}
+END_TEST
+
+Suite *suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create(TEST_SUITE_NAME);
+
+    tc_core = tcase_create("Core");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+    tcase_add_test(tc_core, test_sorted);
+    tcase_add_test(tc_core, test_find);
+    tcase_add_test(tc_core, test_find_containing);
+    tcase_add_test(tc_core, test_empty);
+    tcase_add_test(tc_core, test_load_elf_nonexisting);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
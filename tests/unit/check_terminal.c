@@ -159,6 +159,51 @@ START_TEST(test_read_from_target)
 }
 END_TEST
 
+START_TEST(test_read_from_target_buffered)
+{
+    osd_result rv;
+
+    const char *TEST_STR = "line one\nline two";
+    const size_t len = strlen(TEST_STR);
+
+    struct osd_packet *packet;
+    osd_packet_new(&packet, osd_packet_sizeconv_payload2data(1));
+    osd_packet_set_header(packet, mock_hostmod_diaddr, mock_dem_uart_diaddr,
+                          OSD_PACKET_TYPE_EVENT, EV_LAST);
+
+    for (size_t i = 0; i < len; i++) {
+        packet->data.payload[0] = TEST_STR[i];
+        rv = mock_host_controller_queue_data_packet(packet);
+        ck_assert_int_eq(rv, OSD_OK);
+    }
+
+    mock_host_controller_wait_for_event_tx();
+    osd_packet_free(&packet);
+
+    int pts = open(osd_terminal_get_pts_path(terminal_ctx), O_RDONLY | O_NOCTTY);
+    ck_assert(pts > 0);
+
+    // the text after the newline is written after the idle timeout
+    char buf[64];
+    size_t rcv_len = 0;
+    while (rcv_len < len) {
+        int ret = read(pts, buf + rcv_len, sizeof(buf) - rcv_len);
+        ck_assert(ret > 0);
+        rcv_len += ret;
+    }
+    ck_assert_uint_eq(rcv_len, len);
+    ck_assert(memcmp(buf, TEST_STR, len) == 0);
+
+    close(pts);
+
+    struct osd_terminal_stats stats;
+    osd_terminal_get_stats(terminal_ctx, &stats);
+    ck_assert_uint_eq(stats.rx_chars, len);
+    ck_assert_uint_ge(stats.rx_writes, 1);
+    ck_assert_uint_lt(stats.rx_writes, len);
+}
+END_TEST
+
 START_TEST(test_write_to_target)
 {
     osd_result rv;
@@ -220,6 +265,7 @@ Suite *suite(void)
     tcase_add_checked_fixture(tc_core, setup, teardown);
     tcase_add_test(tc_core, test_file_status);
     tcase_add_test(tc_core, test_read_from_target);
+    tcase_add_test(tc_core, test_read_from_target_buffered);
     tcase_add_test(tc_core, test_write_to_target);
     suite_add_tcase(s, tc_core);
 
@@ -0,0 +1,370 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TEST_SUITE_NAME "check_tracepipe"
+
+#include "testutil.h"
+
+#include <osd/osd.h>
+#include <osd/tracepipe.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+struct osd_log_ctx *log_ctx;
+struct osd_tracepipe_ctx *pipe_ctx;
+
+/**
+ * Events seen by the collector stage
+ */
+pthread_mutex_t collected_lock = PTHREAD_MUTEX_INITIALIZER;
+struct osd_trace_batch collected;
+unsigned int collector_flushes;
+
+static osd_result collector_process(void *arg, struct osd_trace_batch *batch)
+{
+    pthread_mutex_lock(&collected_lock);
+    for (size_t i = 0; i < batch->num_events; i++) {
+        *osd_trace_batch_append(&collected) = batch->events[i];
+    }
+    pthread_mutex_unlock(&collected_lock);
+    return OSD_OK;
+}
+
+static osd_result collector_flush(void *arg, struct osd_trace_batch *batch)
+{
+    pthread_mutex_lock(&collected_lock);
+    collector_flushes++;
+    pthread_mutex_unlock(&collected_lock);
+    return OSD_OK;
+}
+
+static const struct osd_tracepipe_stage_ops collector_ops = {
+    .process = collector_process,
+    .flush = collector_flush,
+};
+
+static size_t collected_count(void)
+{
+    pthread_mutex_lock(&collected_lock);
+    size_t count = collected.num_events;
+    pthread_mutex_unlock(&collected_lock);
+    return count;
+}
+
+static void stm_event(struct osd_trace_event *ev, uint16_t di_addr,
+                      uint32_t timestamp, uint16_t id, uint64_t value)
+{
+    memset(ev, 0, sizeof(struct osd_trace_event));
+    ev->type = OSD_TRACE_EVENT_STM;
+    ev->di_addr = di_addr;
+    ev->timestamp = timestamp;
+    ev->data.stm.timestamp = timestamp;
+    ev->data.stm.id = id;
+    ev->data.stm.value = value;
+}
+
+static bool keep_even_ids(void *arg, const struct osd_trace_event *ev)
+{
+    unsigned int *calls = arg;
+    (*calls)++;
+    return ev->data.stm.id % 2 == 0;
+}
+
+/**
+ * Test fixture: setup (called before each tests)
+ */
+void setup(void)
+{
+    log_ctx = testutil_get_log_ctx();
+
+    memset(&collected, 0, sizeof(collected));
+    collector_flushes = 0;
+}
+
+/**
+ * Test fixture: teardown (called after each test)
+ */
+void teardown(void)
+{
+    osd_tracepipe_free(&pipe_ctx);
+    ck_assert_ptr_eq(pipe_ctx, NULL);
+
+    free(collected.events);
+    osd_log_free(&log_ctx);
+}
+
+START_TEST(test_text_sink)
+{
+    osd_result rv;
+    struct osd_trace_event ev;
+    struct osd_trace_counters counters = { 0 };
+    char *text = NULL;
+    size_t text_len = 0;
+
+    FILE *fp = open_memstream(&text, &text_len);
+    ck_assert_ptr_ne(fp, NULL);
+
+    rv = osd_tracepipe_new(&pipe_ctx, log_ctx, 0, 0);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_tracepipe_add_counter_sink(pipe_ctx, &counters, 0);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_tracepipe_add_text_sink(pipe_ctx, fp, NULL, 0);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    // not running yet
+    stm_event(&ev, 5, 0x10, 4, 'a');
+    rv = osd_tracepipe_push(pipe_ctx, &ev);
+    ck_assert_int_eq(rv, OSD_ERROR_FAILURE);
+
+    rv = osd_tracepipe_start(pipe_ctx);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert(osd_tracepipe_is_running(pipe_ctx));
+
+    // stages cannot be added any more
+    rv = osd_tracepipe_add_counter_sink(pipe_ctx, &counters, 0);
+    ck_assert_int_eq(rv, OSD_ERROR_FAILURE);
+
+    rv = osd_tracepipe_push(pipe_ctx, &ev);
+    ck_assert_int_eq(rv, OSD_OK);
+    stm_event(&ev, 5, 0x11, 8, 0xdead);
+    rv = osd_tracepipe_push(pipe_ctx, &ev);
+    ck_assert_int_eq(rv, OSD_OK);
+    stm_event(&ev, 5, 0, 0, 0);
+    ev.data.stm.overflow = 3;
+    rv = osd_tracepipe_push(pipe_ctx, &ev);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    rv = osd_tracepipe_flush(pipe_ctx);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    ck_assert_str_eq(text, "00000010 0004 0000000000000061\n"
+                           "00000011 0008 000000000000dead\n"
+                           "Overflow, missed 3 events\n");
+    ck_assert_uint_eq(counters.stm_events, 2);
+    ck_assert_uint_eq(counters.stm_print_events, 1);
+    ck_assert_uint_eq(counters.overflowed_events, 3);
+
+    struct osd_tracepipe_stats stats;
+    rv = osd_tracepipe_get_stats(pipe_ctx, &stats);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_uint_eq(stats.events, 3);
+    ck_assert_uint_eq(stats.stage_errors, 0);
+
+    osd_tracepipe_free(&pipe_ctx);
+    fclose(fp);
+    free(text);
+}
+END_TEST
+
+START_TEST(test_threaded)
+{
+    osd_result rv;
+    struct osd_trace_event ev;
+    struct osd_trace_counters counters = { 0 };
+    unsigned int filter_calls = 0;
+    const unsigned int num_events = 100000;
+
+    // small batches and queues to exercise the hand-over between threads
+    rv = osd_tracepipe_new(&pipe_ctx, log_ctx, 16, 2);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_tracepipe_add_filter(pipe_ctx, keep_even_ids, &filter_calls,
+                                  OSD_TRACEPIPE_THREADED);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_tracepipe_add_counter_sink(pipe_ctx, &counters, 0);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_tracepipe_add_stage(pipe_ctx, &collector_ops, NULL,
+                                 OSD_TRACEPIPE_THREADED);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_tracepipe_start(pipe_ctx);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    for (unsigned int i = 0; i < num_events; i++) {
+        stm_event(&ev, 5, i, i % 7, i);
+        rv = osd_tracepipe_push(pipe_ctx, &ev);
+        ck_assert_int_eq(rv, OSD_OK);
+    }
+    rv = osd_tracepipe_flush(pipe_ctx);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    ck_assert_uint_eq(filter_calls, num_events);
+    size_t exp_events = 0;
+    for (unsigned int i = 0; i < num_events; i++) {
+        exp_events += (i % 7) % 2 == 0;
+    }
+    ck_assert_uint_eq(counters.stm_events, exp_events);
+    ck_assert_uint_eq(collected.num_events, exp_events);
+    ck_assert_uint_eq(collector_flushes, 1);
+
+    // the order of the events is preserved
+    for (size_t i = 1; i < collected.num_events; i++) {
+        ck_assert_uint_lt(collected.events[i - 1].data.stm.value,
+                          collected.events[i].data.stm.value);
+    }
+
+    // a second flush reaches all stages again
+    rv = osd_tracepipe_flush(pipe_ctx);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_uint_eq(collector_flushes, 2);
+}
+END_TEST
+
+START_TEST(test_unwrap_merge)
+{
+    osd_result rv;
+    struct osd_trace_event ev;
+
+    rv = osd_tracepipe_new(&pipe_ctx, log_ctx, 4, 0);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_tracepipe_add_unwrap(pipe_ctx, 0);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_tracepipe_add_merge(pipe_ctx, 4, 0);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_tracepipe_add_stage(pipe_ctx, &collector_ops, NULL, 0);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_tracepipe_start(pipe_ctx);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    // two modules whose events arrive slightly out of order, both wrapping
+    // around their 32 bit timestamps
+    const struct {
+        uint16_t di_addr;
+        uint32_t timestamp;
+    } input[] = {
+        { 1, 0xfffffff0 }, { 2, 0xfffffff8 }, { 1, 0xfffffff4 },
+        { 1, 0x00000002 }, { 2, 0xfffffffe }, { 2, 0x00000001 },
+        { 1, 0x00000010 }, { 2, 0x00000008 },
+    };
+    const uint64_t exp_timestamps[] = {
+        0xfffffff0, 0xfffffff4, 0xfffffff8, 0xfffffffe,
+        0x100000001, 0x100000002, 0x100000008, 0x100000010,
+    };
+    const unsigned int num_input = sizeof(input) / sizeof(input[0]);
+
+    for (unsigned int i = 0; i < num_input; i++) {
+        stm_event(&ev, input[i].di_addr, input[i].timestamp, 0, i);
+        rv = osd_tracepipe_push(pipe_ctx, &ev);
+        ck_assert_int_eq(rv, OSD_OK);
+    }
+    rv = osd_tracepipe_flush(pipe_ctx);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    ck_assert_uint_eq(collected.num_events, num_input);
+    for (unsigned int i = 0; i < num_input; i++) {
+        ck_assert_uint_eq(collected.events[i].timestamp, exp_timestamps[i]);
+    }
+}
+END_TEST
+
+START_TEST(test_max_latency)
+{
+    osd_result rv;
+    struct osd_trace_event ev;
+
+    rv = osd_tracepipe_new(&pipe_ctx, log_ctx, 0, 0);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_tracepipe_add_stage(pipe_ctx, &collector_ops, NULL, 0);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_tracepipe_start(pipe_ctx);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    // a single event must be passed on without a flush
+    stm_event(&ev, 5, 1, 0, 0);
+    rv = osd_tracepipe_push(pipe_ctx, &ev);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    for (int i = 0; i < 100 && collected_count() == 0; i++) {
+        usleep(10 * 1000);
+    }
+    ck_assert_uint_eq(collected_count(), 1);
+    ck_assert_uint_eq(collector_flushes, 0);
+}
+END_TEST
+
+START_TEST(test_source)
+{
+    osd_result rv;
+    struct osd_trace_event ev;
+    struct osd_packet *pkg;
+
+    struct osd_stm_desc stm_desc = { .di_addr = 5, .value_width_bit = 32 };
+
+    rv = osd_tracepipe_new(&pipe_ctx, log_ctx, 0, 0);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_tracepipe_add_stage(pipe_ctx, &collector_ops, NULL, 0);
+    ck_assert_int_eq(rv, OSD_OK);
+    rv = osd_tracepipe_start(pipe_ctx);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    struct osd_tracepipe_source source = {
+        .pipe = pipe_ctx,
+        .type = OSD_TRACE_EVENT_STM,
+        .desc.stm = &stm_desc,
+    };
+
+    rv = osd_packet_new(&pkg, osd_packet_sizeconv_payload2data(5));
+    ck_assert_int_eq(rv, OSD_OK);
+    osd_packet_set_header(pkg, 1, 5, OSD_PACKET_TYPE_EVENT, 0);
+    pkg->data.payload[0] = 0xbeef; // timestamp (LSB)
+    pkg->data.payload[1] = 0xdead; // timestamp (MSB)
+    pkg->data.payload[2] = 4; // id
+    pkg->data.payload[3] = 'x'; // value (LSB)
+    pkg->data.payload[4] = 0; // value (MSB)
+
+    rv = osd_tracepipe_source_decode(&source, pkg, &ev);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_int_eq(ev.type, OSD_TRACE_EVENT_STM);
+    ck_assert_uint_eq(ev.di_addr, 5);
+    ck_assert_uint_eq(ev.timestamp, 0xdeadbeef);
+    ck_assert_uint_eq(ev.data.stm.id, 4);
+    ck_assert_uint_eq(ev.data.stm.value, 'x');
+    ck_assert_uint_gt(ev.host_ns, 0);
+
+    // the handler takes ownership of the packet
+    rv = osd_tracepipe_handle_packet(&source, pkg);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    // a packet which is too short is dropped
+    rv = osd_packet_new(&pkg, osd_packet_sizeconv_payload2data(2));
+    ck_assert_int_eq(rv, OSD_OK);
+    osd_packet_set_header(pkg, 1, 5, OSD_PACKET_TYPE_EVENT, 0);
+    rv = osd_tracepipe_handle_packet(&source, pkg);
+    ck_assert_int_eq(rv, OSD_ERROR_DEVICE_INVALID_DATA);
+
+    rv = osd_tracepipe_flush(pipe_ctx);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_uint_eq(collected.num_events, 1);
+    ck_assert_uint_eq(collected.events[0].data.stm.value, 'x');
+}
+END_TEST
+
+Suite *suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create(TEST_SUITE_NAME);
+
+    tc_core = tcase_create("Core");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+    tcase_add_test(tc_core, test_text_sink);
+    tcase_add_test(tc_core, test_threaded);
+    tcase_add_test(tc_core, test_unwrap_merge);
+    tcase_add_test(tc_core, test_max_latency);
+    tcase_add_test(tc_core, test_source);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
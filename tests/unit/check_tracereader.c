@@ -0,0 +1,243 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TEST_SUITE_NAME "check_tracereader"
+
+#include "testutil.h"
+
+#include <osd/osd.h>
+#include <osd/capture.h>
+#include <osd/cl_ctm.h>
+#include <osd/cl_stm.h>
+#include <osd/packet.h>
+#include <osd/tracereader.h>
+
+#include <unistd.h>
+
+#define NUM_TEST_EVENTS 100
+#define STM_DI_ADDR 0x10
+#define CTM_DI_ADDR 0x11
+
+struct osd_log_ctx *log_ctx;
+struct osd_capture_writer_ctx *writer;
+char capture_filename[] = "/tmp/check_tracereader_XXXXXX";
+
+const struct osd_stm_desc stm_desc = {
+    .di_addr = STM_DI_ADDR,
+    .value_width_bit = 32,
+};
+
+const struct osd_ctm_desc ctm_desc = {
+    .di_addr = CTM_DI_ADDR,
+    .addr_width_bit = 32,
+    .data_width_bit = 32,
+};
+
+static void write_pkg(uint16_t src, unsigned int type_sub,
+                      const uint16_t *payload, size_t payload_words)
+{
+    osd_result rv;
+    struct osd_packet *pkg;
+
+    rv = osd_packet_new(&pkg, osd_packet_sizeconv_payload2data(payload_words));
+    ck_assert_int_eq(rv, OSD_OK);
+    osd_packet_set_header(pkg, 0, src, OSD_PACKET_TYPE_EVENT, type_sub);
+    memcpy(pkg->data.payload, payload, payload_words * sizeof(uint16_t));
+
+    rv = osd_capture_writer_write(writer, pkg, 0);
+    ck_assert_int_eq(rv, OSD_OK);
+    osd_packet_free(&pkg);
+}
+
+/**
+ * Write the i-th STM event; every third event is split into two packets,
+ * with a CTM event in between.
+ */
+static void write_test_event(unsigned int i)
+{
+    uint16_t stm[5] = { i, 0x1000, i % 0x100, 0xabcd, 0 };
+    uint16_t ctm[7] = { i, 0, 0x1000 + i, 0, 0x2000 + i, 0, 0x2 | 0x8 };
+
+    if (i % 3 == 0) {
+        write_pkg(STM_DI_ADDR, EV_CONT, stm, 2);
+        write_pkg(CTM_DI_ADDR, EV_LAST, ctm, 7);
+        write_pkg(STM_DI_ADDR, EV_LAST, stm + 2, 3);
+    } else {
+        write_pkg(STM_DI_ADDR, EV_LAST, stm, 5);
+        write_pkg(CTM_DI_ADDR, EV_LAST, ctm, 7);
+    }
+}
+
+/**
+ * Test fixture: setup (called before each tests)
+ */
+void setup(void)
+{
+    osd_result rv;
+
+    log_ctx = testutil_get_log_ctx();
+
+    int fd = mkstemp(capture_filename);
+    ck_assert_int_ge(fd, 0);
+    close(fd);
+
+    FILE *fp = fopen(capture_filename, "wb");
+    ck_assert_ptr_ne(fp, NULL);
+    rv = osd_capture_writer_new(&writer, log_ctx, fp, 256);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    for (unsigned int i = 0; i < NUM_TEST_EVENTS; i++) {
+        write_test_event(i);
+    }
+
+    // an overflow event, an invalid event and an incomplete event
+    uint16_t overflow = 5;
+    write_pkg(STM_DI_ADDR, EV_OVERFLOW, &overflow, 1);
+    uint16_t invalid[3] = { 0 };
+    write_pkg(STM_DI_ADDR, EV_LAST, invalid, 3);
+    write_pkg(STM_DI_ADDR, EV_CONT, invalid, 2);
+
+    rv = osd_capture_writer_flush(writer);
+    ck_assert_int_eq(rv, OSD_OK);
+    osd_capture_writer_free(&writer);
+    fclose(fp);
+}
+
+/**
+ * Test fixture: teardown (called after each test)
+ */
+void teardown(void)
+{
+    unlink(capture_filename);
+    strcpy(capture_filename, "/tmp/check_tracereader_XXXXXX");
+
+    osd_log_free(&log_ctx);
+}
+
+static void check_stm_events(struct osd_tracereader_ctx *reader)
+{
+    osd_result rv;
+    struct osd_stm_event events[7];
+    size_t num_events;
+    unsigned int i = 0;
+
+    while (1) {
+        rv = osd_tracereader_read_stm(reader, &stm_desc, events, 7,
+                                      &num_events);
+        ck_assert_int_eq(rv, OSD_OK);
+        if (num_events == 0) {
+            break;
+        }
+        for (size_t e = 0; e < num_events; e++, i++) {
+            if (i == NUM_TEST_EVENTS) {
+                ck_assert_uint_eq(events[e].overflow, 5);
+                continue;
+            }
+            ck_assert_uint_eq(events[e].overflow, 0);
+            ck_assert_uint_eq(events[e].timestamp, 0x10000000 + i);
+            ck_assert_uint_eq(events[e].id, i % 0x100);
+            ck_assert_uint_eq(events[e].value, 0xabcd);
+        }
+    }
+    ck_assert_uint_eq(i, NUM_TEST_EVENTS + 1);
+
+    struct osd_tracereader_stats stats;
+    osd_tracereader_get_stats(reader, &stats);
+    ck_assert_uint_eq(stats.events, NUM_TEST_EVENTS);
+    ck_assert_uint_eq(stats.overflowed_events, 5);
+    ck_assert_uint_eq(stats.invalid_packets, 1);
+}
+
+START_TEST(test_read_stm)
+{
+    osd_result rv;
+    struct osd_tracereader_ctx *reader;
+
+    rv = osd_tracereader_new(&reader, log_ctx, capture_filename, STM_DI_ADDR);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    check_stm_events(reader);
+
+    // and once again
+    rv = osd_tracereader_rewind(reader);
+    ck_assert_int_eq(rv, OSD_OK);
+    check_stm_events(reader);
+
+    osd_tracereader_free(&reader);
+    ck_assert_ptr_eq(reader, NULL);
+}
+END_TEST
+
+START_TEST(test_read_ctm)
+{
+    osd_result rv;
+    struct osd_tracereader_ctx *reader;
+    struct osd_ctm_event events[NUM_TEST_EVENTS + 1];
+    size_t num_events;
+
+    rv = osd_tracereader_new(&reader, log_ctx, capture_filename, CTM_DI_ADDR);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    rv = osd_tracereader_read_ctm(reader, &ctm_desc, events,
+                                  NUM_TEST_EVENTS + 1, &num_events);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_uint_eq(num_events, NUM_TEST_EVENTS);
+
+    for (unsigned int i = 0; i < num_events; i++) {
+        ck_assert_uint_eq(events[i].timestamp, i);
+        ck_assert_uint_eq(events[i].npc, 0x1000 + i);
+        ck_assert_uint_eq(events[i].pc, 0x2000 + i);
+        ck_assert_uint_eq(events[i].mode, 2);
+        ck_assert(!events[i].is_ret);
+        ck_assert(events[i].is_call);
+        ck_assert(!events[i].is_modechange);
+    }
+
+    rv = osd_tracereader_read_ctm(reader, &ctm_desc, events,
+                                  NUM_TEST_EVENTS + 1, &num_events);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_uint_eq(num_events, 0);
+
+    osd_tracereader_free(&reader);
+}
+END_TEST
+
+START_TEST(test_no_capture_file)
+{
+    osd_result rv;
+    struct osd_tracereader_ctx *reader = NULL;
+
+    rv = osd_tracereader_new(&reader, log_ctx, "/nonexistent", -1);
+    ck_assert_int_eq(rv, OSD_ERROR_FILE);
+    ck_assert_ptr_eq(reader, NULL);
+}
+END_TEST
+
+Suite *suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create(TEST_SUITE_NAME);
+
+    tc_core = tcase_create("Core");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+    tcase_add_test(tc_core, test_read_stm);
+    tcase_add_test(tc_core, test_read_ctm);
+    tcase_add_test(tc_core, test_no_capture_file);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
@@ -0,0 +1,357 @@
+/* Copyright 2018 The Open SoC Debug Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define TEST_SUITE_NAME "check_tracestream"
+
+#include "testutil.h"
+
+#include <osd/osd.h>
+#include <osd/tracestream.h>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+struct osd_tracestream_ctx *tracestream_ctx;
+struct osd_log_ctx *log_ctx;
+char socket_path[64];
+
+static uint16_t get_le16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return get_le16(p) | ((uint32_t)get_le16(p + 2) << 16);
+}
+
+static uint64_t get_le64(const uint8_t *p)
+{
+    return get_le32(p) | ((uint64_t)get_le32(p + 4) << 32);
+}
+
+/**
+ * Connect to the trace stream and send a subscribe request
+ */
+static int subscribe(enum osd_tracestream_policy policy,
+                     uint16_t sample_interval)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    ck_assert_int_ge(fd, 0);
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+    ck_assert_int_eq(connect(fd, (struct sockaddr *)&addr, sizeof(addr)), 0);
+
+    uint8_t req[8] = { 'O', 'S', 'D', 'T', OSD_TRACESTREAM_PROTOCOL_VERSION,
+                       policy, sample_interval & 0xff, sample_interval >> 8 };
+    ck_assert_int_eq(write(fd, req, sizeof(req)), sizeof(req));
+
+    return fd;
+}
+
+/**
+ * Wait until the sink has activated |num| subscribers
+ */
+static void wait_for_subscribers(unsigned int num)
+{
+    for (int i = 0; i < 1000; i++) {
+        struct osd_tracestream_subscriber_stats stats;
+        unsigned int active = 0;
+        while (osd_tracestream_get_subscriber_stats(tracestream_ctx, active,
+                                                    &stats) == OSD_OK) {
+            active++;
+        }
+        // subscribers are listed before their subscribe request was
+        // processed, give the sink thread some more time
+        if (active >= num) {
+            usleep(10 * 1000);
+            return;
+        }
+        usleep(1000);
+    }
+    ck_abort_msg("Subscriber was not accepted.");
+}
+
+/**
+ * Read exactly |len| bytes from the subscriber socket
+ *
+ * @return false if the connection was closed
+ */
+static bool read_full(int fd, uint8_t *buf, size_t len)
+{
+    size_t done = 0;
+    while (done < len) {
+        struct pollfd pfd = { .fd = fd, .events = POLLIN };
+        ck_assert_int_eq(poll(&pfd, 1, 5000), 1);
+        ssize_t rv = read(fd, buf + done, len - done);
+        ck_assert_int_ge(rv, 0);
+        if (rv == 0) {
+            return false;
+        }
+        done += rv;
+    }
+    return true;
+}
+
+/**
+ * Read one record
+ *
+ * @return the record type
+ */
+static uint16_t read_record(int fd, uint8_t *rec)
+{
+    ck_assert(read_full(fd, rec, 16));
+    uint16_t len = get_le16(rec + 2);
+    ck_assert_int_ge(len, 16);
+    ck_assert(read_full(fd, rec + 16, len - 16));
+    return get_le16(rec);
+}
+
+/**
+ * Test fixture: setup (called before each tests)
+ */
+void setup(void)
+{
+    osd_result rv;
+
+    log_ctx = testutil_get_log_ctx();
+
+    snprintf(socket_path, sizeof(socket_path), "/tmp/check_tracestream.%d",
+             getpid());
+
+    rv = osd_tracestream_new(&tracestream_ctx, log_ctx, socket_path, 4096);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_ptr_ne(tracestream_ctx, NULL);
+}
+
+/**
+ * Test fixture: teardown (called after each test)
+ */
+void teardown(void)
+{
+    osd_tracestream_free(&tracestream_ctx);
+    ck_assert_ptr_eq(tracestream_ctx, NULL);
+
+    // the socket is removed
+    ck_assert_int_ne(access(socket_path, F_OK), 0);
+
+    osd_log_free(&log_ctx);
+}
+
+START_TEST(test_stream_events)
+{
+    osd_result rv;
+    uint8_t rec[64];
+
+    int fd = subscribe(OSD_TRACESTREAM_POLICY_BLOCK, 0);
+    wait_for_subscribers(1);
+
+    struct osd_stm_event stm_ev = {
+        .timestamp = 0x12345678, .id = 0xabc, .value = 0x1122334455667788,
+        .overflow = 0 };
+    rv = osd_tracestream_publish_stm(tracestream_ctx, 5, &stm_ev);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    struct osd_ctm_event ctm_ev = {
+        .overflow = 0, .timestamp = 0xcafe, .npc = 0x1000, .pc = 0x2000,
+        .mode = 3, .is_ret = false, .is_call = true, .is_modechange = false };
+    rv = osd_tracestream_publish_ctm(tracestream_ctx, 6, &ctm_ev);
+    ck_assert_int_eq(rv, OSD_OK);
+
+    ck_assert_uint_eq(read_record(fd, rec), OSD_TRACESTREAM_RECORD_STM);
+    ck_assert_uint_eq(get_le16(rec + 2), 32);
+    ck_assert_uint_eq(get_le16(rec + 4), 5);
+    ck_assert_uint_ne(get_le64(rec + 8), 0);
+    ck_assert_uint_eq(get_le32(rec + 16), 0x12345678);
+    ck_assert_uint_eq(get_le16(rec + 20), 0xabc);
+    ck_assert_uint_eq(get_le16(rec + 22), 0);
+    ck_assert_uint_eq(get_le64(rec + 24), 0x1122334455667788);
+
+    ck_assert_uint_eq(read_record(fd, rec), OSD_TRACESTREAM_RECORD_CTM);
+    ck_assert_uint_eq(get_le16(rec + 2), 40);
+    ck_assert_uint_eq(get_le16(rec + 4), 6);
+    ck_assert_uint_eq(get_le32(rec + 16), 0xcafe);
+    ck_assert_uint_eq(get_le16(rec + 20), 0);
+    ck_assert_uint_eq(rec[22], 3);
+    ck_assert_uint_eq(rec[23], 0x2);
+    ck_assert_uint_eq(get_le64(rec + 24), 0x1000);
+    ck_assert_uint_eq(get_le64(rec + 32), 0x2000);
+
+    struct osd_tracestream_stats stats;
+    rv = osd_tracestream_get_stats(tracestream_ctx, &stats);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_uint_eq(stats.published_records, 2);
+    ck_assert_uint_eq(stats.overrun_records, 0);
+    ck_assert_uint_eq(stats.num_subscribers, 1);
+
+    // the sink thread might not have updated the statistics yet
+    struct osd_tracestream_subscriber_stats sub_stats;
+    for (int i = 0; i < 1000; i++) {
+        rv = osd_tracestream_get_subscriber_stats(tracestream_ctx, 0,
+                                                  &sub_stats);
+        ck_assert_int_eq(rv, OSD_OK);
+        if (sub_stats.sent_bytes == 72) {
+            break;
+        }
+        usleep(1000);
+    }
+    ck_assert_int_eq(sub_stats.policy, OSD_TRACESTREAM_POLICY_BLOCK);
+    ck_assert_uint_eq(sub_stats.sent_records, 2);
+    ck_assert_uint_eq(sub_stats.sent_bytes, 72);
+    ck_assert_uint_eq(sub_stats.dropped_records, 0);
+
+    rv = osd_tracestream_get_subscriber_stats(tracestream_ctx, 1, &sub_stats);
+    ck_assert_int_eq(rv, OSD_ERROR_FAILURE);
+
+    close(fd);
+}
+END_TEST
+
+START_TEST(test_drop_oldest)
+{
+    osd_result rv;
+    uint8_t rec[64];
+
+    // this subscriber doesn't read until all events are published
+    int fd = subscribe(OSD_TRACESTREAM_POLICY_DROP_OLDEST, 0);
+    wait_for_subscribers(1);
+
+    // much more than fits into the queue and the socket buffer
+    const unsigned int num_events = 100000;
+    int64_t last_published_ts = -1;
+    for (unsigned int i = 0; i < num_events; i++) {
+        struct osd_stm_event ev = { .timestamp = i, .id = 1, .value = i };
+        rv = osd_tracestream_publish_stm(tracestream_ctx, 5, &ev);
+        if (rv == OSD_OK) {
+            last_published_ts = i;
+        } else {
+            // the input buffer is full, publishing never blocks
+            ck_assert_int_eq(rv, OSD_ERROR_BUSY);
+        }
+        if (i % 64 == 0) {
+            // give the sink thread a chance to take the input
+            usleep(10);
+        }
+    }
+    ck_assert_int_ge(last_published_ts, 0);
+
+    // The events arrive in order, with LOST records for the gaps. The newest
+    // events are never dropped.
+    uint64_t received = 0;
+    uint64_t lost = 0;
+    int64_t last_ts = -1;
+    while (received + lost < num_events) {
+        uint16_t type = read_record(fd, rec);
+        if (type == OSD_TRACESTREAM_RECORD_LOST) {
+            lost += get_le64(rec + 16);
+            continue;
+        }
+        ck_assert_uint_eq(type, OSD_TRACESTREAM_RECORD_STM);
+        int64_t ts = get_le32(rec + 16);
+        ck_assert_int_gt(ts, last_ts);
+        last_ts = ts;
+        received++;
+    }
+    ck_assert_int_eq(last_ts, last_published_ts);
+    ck_assert_uint_gt(lost, 0);
+
+    struct osd_tracestream_subscriber_stats sub_stats;
+    rv = osd_tracestream_get_subscriber_stats(tracestream_ctx, 0, &sub_stats);
+    ck_assert_int_eq(rv, OSD_OK);
+    ck_assert_uint_eq(sub_stats.sent_records, received);
+    ck_assert_uint_eq(sub_stats.dropped_records, lost);
+    ck_assert_uint_gt(sub_stats.max_lag_bytes, 0);
+
+    close(fd);
+}
+END_TEST
+
+START_TEST(test_block)
+{
+    osd_result rv;
+    uint8_t rec[64];
+
+    int fd = subscribe(OSD_TRACESTREAM_POLICY_BLOCK, 0);
+    wait_for_subscribers(1);
+
+    // publish slower than the sink can forward the events, nothing is lost
+    const unsigned int num_events = 10000;
+    for (unsigned int i = 0; i < num_events; i++) {
+        struct osd_stm_event ev = { .timestamp = i, .id = 1, .value = i };
+        do {
+            rv = osd_tracestream_publish_stm(tracestream_ctx, 5, &ev);
+            if (rv == OSD_ERROR_BUSY) {
+                usleep(100);
+            }
+        } while (rv == OSD_ERROR_BUSY);
+
+        // read in between to keep the socket buffer from filling up
+        if (i % 100 == 99) {
+            for (unsigned int j = i - 99; j <= i; j++) {
+                ck_assert_uint_eq(read_record(fd, rec),
+                                  OSD_TRACESTREAM_RECORD_STM);
+                ck_assert_uint_eq(get_le32(rec + 16), j);
+            }
+        }
+    }
+
+    close(fd);
+}
+END_TEST
+
+START_TEST(test_invalid_subscribe)
+{
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    ck_assert_int_ge(fd, 0);
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socket_path);
+    ck_assert_int_eq(connect(fd, (struct sockaddr *)&addr, sizeof(addr)), 0);
+
+    uint8_t req[8] = { 'N', 'O', 'P', 'E', 1, 0, 0, 0 };
+    ck_assert_int_eq(write(fd, req, sizeof(req)), sizeof(req));
+
+    // the sink closes the connection
+    uint8_t buf[16];
+    ck_assert(!read_full(fd, buf, sizeof(buf)));
+
+    close(fd);
+}
+END_TEST
+
+Suite *suite(void)
+{
+    Suite *s;
+    TCase *tc_core;
+
+    s = suite_create(TEST_SUITE_NAME);
+
+    tc_core = tcase_create("Core");
+    tcase_add_checked_fixture(tc_core, setup, teardown);
+    tcase_add_test(tc_core, test_stream_events);
+    tcase_add_test(tc_core, test_drop_oldest);
+    tcase_add_test(tc_core, test_block);
+    tcase_add_test(tc_core, test_invalid_subscribe);
+    suite_add_tcase(s, tc_core);
+
+    return s;
+}
@@ -52,6 +52,14 @@ void mock_host_controller_wait_for_requests(void)
     }
 }
 
+/**
+ * Number of expected incoming packets (requests) not received yet
+ */
+size_t mock_host_controller_num_exp_requests(void)
+{
+    return zlist_size(mock_exp_req_list);
+}
+
 /**
  * Called periodically to handle shutdown signal
  *
@@ -46,4 +46,5 @@ void mock_host_controller_expect_diaddr_req(unsigned int diaddr);
 void mock_host_controller_expect_data_req(struct osd_packet *req, struct osd_packet *resp);
 void mock_host_controller_wait_for_event_tx(void);
 void mock_host_controller_wait_for_requests(void);
+size_t mock_host_controller_num_exp_requests(void);
 #endif // MOCK_HOST_CONTROLLER_H
@@ -325,6 +325,31 @@ osd_result osd_hostmod_reg_write(struct osd_hostmod_ctx *ctx,
     return retval;
 }
 
+osd_result osd_hostmod_reg_access_batch(struct osd_hostmod_ctx *ctx,
+                                        struct osd_hostmod_reg_access *accesses,
+                                        size_t num_accesses, int flags)
+{
+    osd_result retval = OSD_OK;
+
+    for (size_t i = 0; i < num_accesses; i++) {
+        struct osd_hostmod_reg_access *acc = &accesses[i];
+        if (acc->write) {
+            acc->result = osd_hostmod_reg_write(ctx, acc->reg_val, acc->diaddr,
+                                                acc->reg_addr,
+                                                acc->reg_size_bit, flags);
+        } else {
+            acc->result = osd_hostmod_reg_read(ctx, acc->reg_val, acc->diaddr,
+                                               acc->reg_addr,
+                                               acc->reg_size_bit, flags);
+        }
+        if (OSD_FAILED(acc->result) && OSD_SUCCEEDED(retval)) {
+            retval = acc->result;
+        }
+    }
+
+    return retval;
+}
+
 uint16_t osd_hostmod_get_diaddr(struct osd_hostmod_ctx *ctx)
 {
     return MOCK_HOSTMOD_DIADDR;
@@ -382,6 +407,19 @@ osd_result osd_hostmod_event_send(struct osd_hostmod_ctx *ctx,
     return exp_retval;
 }
 
+osd_result osd_hostmod_event_send_batch(
+    struct osd_hostmod_ctx *ctx, const struct osd_packet *const *event_pkgs,
+    size_t num_pkgs)
+{
+    for (size_t i = 0; i < num_pkgs; i++) {
+        osd_result rv = osd_hostmod_event_send(ctx, event_pkgs[i]);
+        if (OSD_FAILED(rv)) {
+            return rv;
+        }
+    }
+    return OSD_OK;
+}
+
 osd_result osd_hostmod_event_receive(struct osd_hostmod_ctx *ctx,
                                      struct osd_packet **event_pkg,
                                      int flags)